@@ -1,24 +1,18 @@
 #include "max30100.h"
-#define CHECK_RD_PTR                                         \
-  {                                                          \
-    max30100_read_byte(MAX30100_REG_FIFO_READ, &aux_rd_ptr); \
-    if (aux_rd_ptr != read_data)                             \
-    {                                                        \
-      i--;                                                   \
-      continue;                                              \
-    }                                                        \
-  }
 
 float red_dc = DC_REMOVER_ALPHA, ir_dc = DC_REMOVER_ALPHA;
+static uint32_t fifo_overflows; // samples the chip dropped because the FIFO was full
+
+// FIFO pointers read, built once and replayed at every FIFO read
+static uint8_t fifo_ptr[3]; // FIFO_WRITE, FIFO_OVERFLOW_COUNTER, FIFO_READ
+static uint8_t fifo_ptr_link[I2C_LINK_RECOMMENDED_SIZE(2)];
+static i2c_cmd_handle_t fifo_ptr_cmd;
 
 float get_ir_dc();
 float get_red_dc();
 void max30100_set_led_width(uint8_t led_pulse_width);
 void max30100_set_sampling(uint8_t sampling_rate);
 void max30100_set_highres(uint8_t enabled);
-esp_err_t max30100_check_sample(uint16_t *ir_data, uint16_t *red_data,
-                                size_t data_len);
-float step(float dcw, float x);
 void max30100_test_conf();
 esp_err_t max30100_set_mode(uint8_t mode);
 esp_err_t max30100_set_leds(uint8_t red_c, uint8_t ir_c);
@@ -108,12 +102,17 @@ i2c_cmd_handle_t max30100_start(uint8_t reg_address, uint8_t mode)
   printf("Sending reg_address: ");
 #endif
 
-  ret = i2c_master_write_byte(cmd, reg_address, ACK_CHECK_EN);
+  if(ret == ESP_OK)
+    ret = i2c_master_write_byte(cmd, reg_address, ACK_CHECK_EN);
 
 #if defined(_DEBUG_) && defined(DEBUG_I2C)
   printf("%d\n", ret);
 #endif
 
+  // max30100_stop then fails the transaction, this only tells why
+  if(ret != ESP_OK)
+    ESP_LOGE("MAX30100", "Queueing register %x failed: %d\n", reg_address, ret);
+
   return cmd;
 }
 esp_err_t max30100_stop(i2c_cmd_handle_t cmd)
@@ -121,7 +120,11 @@ esp_err_t max30100_stop(i2c_cmd_handle_t cmd)
   esp_err_t ret;
   i2c_master_stop(cmd);
   ret = i2c_master_cmd_begin(MAX30100_NUM, cmd, 1000 / portTICK_RATE_MS);
-  if(ret < 0) return ESP_FAIL;
+  if(ret < 0)
+  {
+    i2c_cmd_link_delete(cmd);
+    return ESP_FAIL;
+  }
   ESP_ERROR_CHECK(ret);
 
 #if defined(_DEBUG_) && defined(DEBUG_I2C)
@@ -179,18 +182,41 @@ esp_err_t max30100_read_byte(uint8_t read_reg, uint8_t *data)
   return ret;
 }
 
+/**
+ * Queues a read of len bytes from read_reg: the register address is written
+ * and the data read back after a repeated start
+ * */
+static esp_err_t max30100_queue_read(i2c_cmd_handle_t cmd, uint8_t read_reg, uint8_t *data, uint8_t len)
+{
+  esp_err_t ret = ESP_OK;
+
+  ret |= i2c_master_start(cmd);
+  ret |= i2c_master_write_byte(cmd, MAX30100_ADDR << 1 | WRITE_BIT, ACK_CHECK_EN);
+  ret |= i2c_master_write_byte(cmd, read_reg, ACK_CHECK_EN);
+  ret |= i2c_master_start(cmd);
+  ret |= i2c_master_write_byte(cmd, MAX30100_ADDR << 1 | READ_BIT, ACK_CHECK_EN);
+  ret |= i2c_master_read(cmd, data, len, LAST_NACK_VAL);
+
+  return ret;
+}
+
+/**
+ * Reads len bytes from read_reg in a single transaction,
+ * the command link lives on the stack so the FIFO reads never touch the heap
+ * */
 esp_err_t max30100_read_burst(uint8_t read_reg, uint8_t *data, uint8_t len)
 {
+  uint8_t link[I2C_LINK_RECOMMENDED_SIZE(2)];
   i2c_cmd_handle_t cmd;
-  esp_err_t ret;
-  cmd = max30100_start(read_reg, WRITE_BIT);
-  ret = max30100_repeat_start(&cmd);
 
-  ret = i2c_master_read(cmd, data, len, LAST_NACK_VAL);
-
-  max30100_stop(cmd);
+  cmd = i2c_cmd_link_create_static(link, sizeof(link));
+  if (max30100_queue_read(cmd, read_reg, data, len) != ESP_OK)
+  {
+    i2c_cmd_link_delete_static(cmd);
+    return ESP_FAIL;
+  }
 
-  return ret;
+  return max30100_stop(cmd);
 }
 
 esp_err_t max30100_write_byte(uint8_t write_reg, uint8_t data)
@@ -227,91 +253,70 @@ esp_err_t max30100_reset_fifo()
   return ESP_OK;
 }
 
+/**
+ * Drains the FIFO with two bursts, the pointers and the overflow counter
+ * are consecutive registers and FIFO_DATA keeps the register address,
+ * every 4 bytes read from it pop one sample
+ * */
 esp_err_t max30100_read_fifo(uint16_t *ir_data, uint16_t *red_data,
                              size_t *data_len)
 {
-  uint8_t NUM_SAMPLES_TO_READ;
-  uint8_t read_data, write_data;
+  uint8_t data[MAX30100_FIFO_DEPTH * MAX30100_SAMPLE_SIZE];
+  uint8_t num;
+  esp_err_t ret;
+  int i;
 
   *data_len = 0;
-  max30100_read_byte(MAX30100_REG_FIFO_WRITE, &write_data);
-  max30100_read_byte(MAX30100_REG_FIFO_READ, &read_data);
-  NUM_SAMPLES_TO_READ = (write_data - read_data) & (MAX30100_FIFO_DEPTH - 1);
-
-#if defined(_DEBUG_) && defined(DEBUG_FIFO)
-  printf("Write\\read fifo:%d \t%d\n", write_data, read_data);
-  printf("NUM SAMPLES: %d\n", NUM_SAMPLES_TO_READ);
-#endif
-
-  if (NUM_SAMPLES_TO_READ <= 0)
+  if (!fifo_ptr_cmd)
   {
-    max30100_write_byte(MAX30100_REG_FIFO_READ, 0);
-    return ESP_OK;
+    fifo_ptr_cmd = i2c_cmd_link_create_static(fifo_ptr_link, sizeof(fifo_ptr_link));
+    max30100_queue_read(fifo_ptr_cmd, MAX30100_REG_FIFO_WRITE, fifo_ptr, sizeof(fifo_ptr));
+    i2c_master_stop(fifo_ptr_cmd);
   }
+  ret = i2c_master_cmd_begin(MAX30100_NUM, fifo_ptr_cmd, 1000 / portTICK_RATE_MS);
+  if (ret != ESP_OK)
+    return ret;
+  num = (fifo_ptr[0] - fifo_ptr[2]) & (MAX30100_FIFO_DEPTH - 1);
 
-  i2c_cmd_handle_t cmd;
-  esp_err_t ret;
-  int i;
+  // equal pointers with samples lost is a full FIFO rather than an empty one
+  if (fifo_ptr[1])
+  {
+    num = MAX30100_FIFO_DEPTH;
+    fifo_overflows += fifo_ptr[1];
+    max30100_write_byte(MAX30100_REG_FIFO_OVERFLOW_COUNTER, 0);
+  }
 
 #if defined(_DEBUG_) && defined(DEBUG_FIFO)
-  printf("Reading FIFO\n");
+  printf("Write\\read fifo:%d \t%d overflow: %d\n", fifo_ptr[0], fifo_ptr[2], fifo_ptr[1]);
+  printf("NUM SAMPLES: %d\n", num);
 #endif
 
-  int read = 0;
-  // IR[15:8] IR[7:0] RED[15:8] RED[7:0] -> One sample
-  for (i = 0; i < NUM_SAMPLES_TO_READ; i++)
-  {
-
-    uint8_t data;
-    uint8_t aux_rd_ptr;
-    max30100_read_byte(MAX30100_REG_FIFO_READ, &read_data);
-    //printf("Before RD PTR: %d\n", read_data);
-
-    CHECK_RD_PTR
-    max30100_read_byte(MAX30100_REG_FIFO_DATA, &data); // Read IR[15:8]
-    ir_data[i] = (uint16_t)data << 8;                  // Save IR[15:8]
-    //printf("data 1: %d\n", data);
-
-    CHECK_RD_PTR
-    max30100_read_byte(MAX30100_REG_FIFO_DATA, &data); // Read IR[7:0]
-    ir_data[i] |= (uint16_t)data;                      // Save IR[7:0]
-    //printf("data 2: %d\n", data);
-
-    CHECK_RD_PTR
-    max30100_read_byte(MAX30100_REG_FIFO_DATA, &data); // Read RED[15:8]
-    red_data[i] = (uint16_t)data << 8;                 // Save RED[15:8]
-    //printf("data 3: %d\n", data);
-
-    CHECK_RD_PTR
-    max30100_read_byte(MAX30100_REG_FIFO_DATA, &data); // Read RED[7:0]
-    red_data[i] |= (uint16_t)data;                     // Save IR[7:0]
-    //printf("data 4: %d\n", data);
+  if (!num)
+    return ESP_OK;
 
-    read++;
-    max30100_read_byte(MAX30100_REG_FIFO_READ, &read_data);
-    //printf("After RD PTR: %d\n", read_data);
+  ret = max30100_read_burst(MAX30100_REG_FIFO_DATA, data, num * MAX30100_SAMPLE_SIZE);
+  if (ret != ESP_OK)
+    return ret;
 
-#if defined(_DEBUG_) && defined(DEBUG_FIFO)
-    //printf("IR[%d]: %d\tRED[%d]: %d\n", i, ir_data[i], i, red_data[i]);
-#endif
+  // IR[15:8] IR[7:0] RED[15:8] RED[7:0] -> One sample
+  for (i = 0; i < num; i++)
+  {
+    ir_data[i] = (uint16_t)data[i * MAX30100_SAMPLE_SIZE] << 8 | data[i * MAX30100_SAMPLE_SIZE + 1];
+    red_data[i] = (uint16_t)data[i * MAX30100_SAMPLE_SIZE + 2] << 8 | data[i * MAX30100_SAMPLE_SIZE + 3];
   }
 
-#if defined(_DEBUG_) && defined(DEBUG_FIFO)
-  printf("Read fifo data length: %d\n", read);
-#endif
-  /*
-  i2c_master_stop(cmd);
-  i2c_cmd_link_delete(cmd);*/
-  //max30100_stop(cmd);
-
-  *data_len = read;
-  /*
-  i2c_master_stop(cmd);
-  ret = i2c_master_cmd_begin(MAX30100_NUM, cmd, 1000 / portTICK_RATE_MS);
-  i2c_cmd_link_delete(cmd);*/
+  *data_len = num;
   return ESP_OK;
 }
 
+/**
+ * Samples lost to a full FIFO since boot
+ * */
+uint32_t max30100_fifo_overflows()
+{
+  return fifo_overflows;
+}
+
 esp_err_t max30100_update(uint16_t *ir_data, uint16_t *red_data,
                           size_t *data_len)
 {
@@ -324,7 +329,7 @@ esp_err_t max30100_update(uint16_t *ir_data, uint16_t *red_data,
 #if defined(_DEBUG_) && defined(DEBUG_FIFO)
   printf("Updated data length: %d\n", *data_len);
 #endif
-  max30100_check_sample(ir_data, red_data, *data_len);
+  // raw samples, the filtering is up to pulse_oximeter
   return ESP_OK;
 }
 
@@ -418,24 +423,6 @@ void max30100_adjust_current()
 /*
  * Private functions
  */
-esp_err_t max30100_check_sample(uint16_t *ir_data, uint16_t *red_data,
-                                size_t data_len)
-{
-  int i;
-  for (i = 1; i < data_len; i++)
-  {
-    red_data[i] = (uint16_t)step(red_data[i], red_data[i - 1]);
-    ir_data[i] = (uint16_t)step(ir_data[i], ir_data[i - 1]);
-  }
-  return ESP_OK;
-}
-float step(float x, float prev_w)
-{
-  float oldcw = x + DC_REMOVER_ALPHA * prev_w;
-  float dcw = (float)oldcw - prev_w;
-
-  return dcw;
-}
 void max30100_set_led_width(uint8_t led_pulse_width)
 {
 #if defined(_DEBUG_) && defined(DEBUG_INIT)
@@ -450,8 +437,17 @@ void max30100_set_led_width(uint8_t led_pulse_width)
   printf("Led pulse width read config: previous %x -> return: %d\n", previous, ret);
 #endif
 
+  // without the current configuration the other fields would be overwritten
+  if(ret != ESP_OK)
+  {
+    ESP_LOGE("MAX30100", "Reading the SpO2 configuration failed: %d\n", ret);
+    return;
+  }
+
   ret = max30100_write_byte(MAX30100_REG_SPO2_CONFIGURATION,
                             (previous & 0xfc) | led_pulse_width);
+  if(ret != ESP_OK)
+    ESP_LOGE("MAX30100", "Setting the led pulse width failed: %d\n", ret);
 
 #if defined(_DEBUG_) && defined(DEBUG_INIT)
   printf("Led pulse width write: %d\n", ret);
@@ -474,8 +470,16 @@ void max30100_set_sampling(uint8_t sampling_rate)
   printf("Sampling rate reading conf:%x -> %d\n", previous, ret);
 #endif
 
+  if(ret != ESP_OK)
+  {
+    ESP_LOGE("MAX30100", "Reading the SpO2 configuration failed: %d\n", ret);
+    return;
+  }
+
   ret = max30100_write_byte(MAX30100_REG_SPO2_CONFIGURATION,
                             (previous & 0xe3) | (sampling_rate << 2));
+  if(ret != ESP_OK)
+    ESP_LOGE("MAX30100", "Setting the sampling rate failed: %d\n", ret);
 
 #if defined(_DEBUG_) && defined(DEBUG_INIT)
   printf("Sampling rate write: %d\n", ret);
@@ -495,9 +499,17 @@ void max30100_set_highres(uint8_t enabled)
   printf("Reading previous conf:%x -> %d\n", previous, ret);
 #endif
 
+  if(ret != ESP_OK)
+  {
+    ESP_LOGE("MAX30100", "Reading the SpO2 configuration failed: %d\n", ret);
+    return;
+  }
+
   uint8_t mode =
       enabled ? MAX30100_SPC_SPO2_HI_RES_EN : ~MAX30100_SPC_SPO2_HI_RES_EN;
   ret = max30100_write_byte(MAX30100_REG_SPO2_CONFIGURATION, previous | mode);
+  if(ret != ESP_OK)
+    ESP_LOGE("MAX30100", "Setting the high resolution mode failed: %d\n", ret);
 
 #if defined(_DEBUG_) && defined(DEBUG_INIT)
   printf("Setting mode: %x -> %d\n", enabled, ret);
@@ -19,6 +19,7 @@
 #define LAST_NACK_VAL I2C_MASTER_LAST_NACK /*!< I2C last_nack value */
 
 #define MAX30100_FIFO_DEPTH 0x10
+#define MAX30100_SAMPLE_SIZE 4 // bytes of an IR and RED sample in FIFO_DATA
 
 // FIFO control and data registers
 #define MAX30100_REG_FIFO_WRITE 0x02
@@ -73,7 +74,7 @@
 #define MAX30100_MODE_HRONLY 0x02   // Heart rate only
 #define MAX30100_MODE_SPO2_HR 0x03  // Enable SpO2 monitor
 
-#define MODE MAX30100_MODE_HRONLY
+#define MODE MAX30100_MODE_SPO2_HR // the red LED is only sampled in SpO2 mode
 
 esp_err_t max30100_init();
 i2c_cmd_handle_t max30100_start(uint8_t reg_addr, uint8_t mode);
@@ -81,6 +82,8 @@ esp_err_t max30100_stop(i2c_cmd_handle_t cmd);
 
 esp_err_t max30100_read_fifo(uint16_t *ir_data, uint16_t *red_data,
                              size_t *data_len);
+esp_err_t max30100_read_burst(uint8_t read_reg, uint8_t *data, uint8_t len);
+uint32_t max30100_fifo_overflows();
 esp_err_t max30100_write(uint8_t write_reg, uint8_t *data, size_t data_len);
 esp_err_t max30100_write_byte(uint8_t write_reg, uint8_t data);
 esp_err_t max30100_read_byte(uint8_t read_reg, uint8_t *data);
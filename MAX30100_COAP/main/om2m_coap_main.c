@@ -13,10 +13,18 @@
 #include "nvs_flash.h"
 
 #include <om2m/coap.h>
+#include <om2m/duty.h>
+#include <om2m/latency.h>
+#ifdef CONFIG_ENABLE_MDNS
+#include <om2m/discovery.h>
+#include "mdns.h"
+#endif
 
 #include "max30100.h"
+#include "pulse_oximeter.h"
 #include "om2m_coap_config.h"
 #include "cJSON.h"
+#include "esp_spsc_ring.h"
 
 #include <time.h>
 #include <stdlib.h>
@@ -24,9 +32,20 @@
 #define RETRANSMISSION 5000
 #define COAP_SERVER_PORT 5683
 
+#define SAMPLE_RING_LEN 128 // 1.28 s of samples at 100 Hz, drained every publication
+#define SAMPLE_BATCH 32     // samples the publisher takes from the ring at once
+
 #define SENSOR          // Enable use of sensor values, if disabled "Communication Test" sent to broker
 #define E2E             // Enable to measure end-to-end delay, reduces verbosity
 //#define DEBUG_SENSOR  // Disables middlware usage, use only to test sensor communication
+//#define DUTY_CYCLE    // Wake, read the sensor, publish in batches and deep sleep, see om2m/duty.h
+
+#define DUTY_PERIOD_MS 60000 // from one wake to the next
+#define DUTY_SAMPLE_MS 8000  // of samples behind each reading
+#define DUTY_BATCH 10        // readings per publication
+#define DUTY_PROVISION_MS (6 * RETRANSMISSION) // two tries for each level of the resource tree
+
+#define LATENCY_REPORT 30 // publications between two Latency lines on the serial port, see om2m/latency.h
 
 #define TEST_CONDITION(condition, true, false) \
   if (condition)                               \
@@ -45,14 +64,6 @@
 #define TEST_ASSERT_NULL(pointer, line, message, action) TEST_ASSERT(((pointer) == NULL), line, message, action)
 #define TEST_ASSERT_NOT_NULL(pointer, line, message, action) TEST_ASSERT(((pointer) != NULL), line, message, action)
 
-#define TEST_RESPONSE_SET_BIT(response, group, bit)                    \
-  {                                                                    \
-    TEST_CONDITION(response->hdr->code == COAP_RESPONSE_CODE(403) ||   \
-                       response->hdr->code == COAP_RESPONSE_CODE(201), \
-                   {xEventGroupSetBits(group, bit);return; },                                                \
-                   return;);                                           \
-  }
-
 #define TEST_JSON_ASSERT(object, value)                                               \
   {                                                                                   \
     TEST_ASSERT_NOT_NULL(object, value, "Not JSON", /*printf(cJSON_Print(object))*/); \
@@ -86,10 +97,15 @@ static inline uint64_t get_timestamp()
 }
 
 // Sensor variables
-uint16_t ir_buffer[MAX30100_FIFO_DEPTH];
-uint16_t red_buffer[MAX30100_FIFO_DEPTH];
-size_t data_len = 0;
-double avg;
+typedef struct
+{
+  uint16_t ir;
+  uint16_t red;
+} sample_t;
+
+// filled by max30100_updater only, drained by om2m_coap_client_task only
+static sample_t sample_storage[SAMPLE_RING_LEN];
+static esp_spsc_ring_t sample_ring;
 double diff_avg = 0, alpha = 0.1;
 
 // CoAP/OM2M variables
@@ -101,16 +117,32 @@ coap_address_t dst_addr, src_addr;
    but we only care about one event - are we connected
    to the AP with an IP? */
 const static int CONNECTED_BIT = BIT0;
-unsigned int AE_BIT = BIT1;
-unsigned int CNT_BIT = BIT2;
-unsigned int CTRL_BIT = BIT3;
-unsigned int SUB_BIT = BIT4;
-unsigned int BUFFER_BIT = BIT5;
+#define AE_BIT BIT1     // AE_NAME created
+#define CNT_BIT BIT2    // AE_NAME/CONTAINER_NAME created
+#define CTRL_BIT BIT3   // AE_NAME/ACTUATION created
+#define SUB_BIT BIT4    // CNTRL_SUB subscribed to AE_NAME/ACTUATION
+#define BUFFER_BIT BIT5
+#define PING_BIT BIT6   // AE_NAME/PING created
+#define SENSOR_BIT BIT7 // CNTRL_SUB created
+#define PROVISION_BITS (AE_BIT | CNT_BIT | CTRL_BIT | SUB_BIT | PING_BIT | SENSOR_BIT)
+#define IN_FLIGHT(bit) ((bit) << 8) // set while the request creating bit is unanswered
+
+// oneM2M client, matches responses to requests by request identifier
+static om2m_client_t om2m_client;
+static om2m_coap_binding_t om2m_binding;
+static om2m_latency_t om2m_latency; // also served on GET /latency
+
+#ifdef CONFIG_ENABLE_MDNS
+#define CSE_FAILOVER_TIMEOUTS 3 // provisioning requests in a row left unanswered before trying another CSE
+
+// CSE found by mDNS, CSE_IP is only used when none is announced
+static om2m_discovery_t cse_discovery;
+static char cse_path[OM2M_TO_MAX] = "/in-cse/" CSE_NAME;
+static int cse_timeouts;
+#endif
 
 // Auxiliary functions
-static void create_entity(char *entity);
-static void create_container(char *entity, char *container);
-static void create_sub(char *entity, char *container, char *sub_entity, char *sub_name);
+static void provision(void);
 
 void adjust_current()
 {
@@ -122,23 +154,29 @@ void adjust_current()
 }
 
 /**
- * Reads MAX30100 FIFO data
- * Calculates average HR every 160 ms
+ * Reads MAX30100 FIFO data every 160 ms
+ * Queues every sample for the publisher
  * */
 void max30100_updater()
 {
+  uint16_t ir_buffer[MAX30100_FIFO_DEPTH];
+  uint16_t red_buffer[MAX30100_FIFO_DEPTH];
+  sample_t samples[MAX30100_FIFO_DEPTH];
+  size_t data_len = 0;
   int i;
   while (1)
   {
     max30100_update(ir_buffer, red_buffer, &data_len);
     if (data_len)
     {
-      xEventGroupSetBits(coap_group, BUFFER_BIT);
-
-      int sum = 0;
       for (i = 0; i < data_len; i++)
-        sum += ir_buffer[i];
-      avg = sum / data_len;
+      {
+        samples[i].ir = ir_buffer[i];
+        samples[i].red = red_buffer[i];
+      }
+      // a full ring drops the new samples and counts them as overruns
+      esp_spsc_ring_push(&sample_ring, samples, data_len);
+      xEventGroupSetBits(coap_group, BUFFER_BIT);
     }
     vTaskDelay(160 / portTICK_RATE_MS);
   }
@@ -193,65 +231,30 @@ static void message_handler(struct coap_context_t *ctx,
                             const coap_address_t *remote, coap_pdu_t *sent,
                             coap_pdu_t *received, const coap_tid_t id)
 {
-  char *data = NULL;
-  size_t data_len;
-  int has_data = coap_get_data(received, &data_len, (unsigned char **)&data);
-
-  if (!(xEventGroupGetBits(coap_group) & AE_BIT))
-  {
-    TEST_RESPONSE_SET_BIT(received, coap_group, AE_BIT);
-  }
-  else if (!(xEventGroupGetBits(coap_group) & CNT_BIT))
-  {
-    TEST_RESPONSE_SET_BIT(received, coap_group, CNT_BIT);
-  }
-  else if (!(xEventGroupGetBits(coap_group) & SUB_BIT))
-  {
-    TEST_RESPONSE_SET_BIT(received, coap_group, SUB_BIT);
-  }
-  else
-  {
-    if (COAP_RESPONSE_CLASS(received->hdr->code) == COAP_RESPONSE_CLASS(COAP_RESPONSE_201))
-    { // Published
-      if (has_data)
-      {
-        double current_timestamp = get_timestamp();
-
-        cJSON *created = cJSON_Parse(data);
-        TEST_JSON_ASSERT(created, "Created");
-
-        cJSON *m2m_cin = cJSON_GetObjectItem(created, "m2m:cin");
-        cJSON_Delete(created);
-        TEST_JSON_ASSERT(m2m_cin, "m2m:cin");
-
-        cJSON *rn = cJSON_GetObjectItem(m2m_cin, "rn");
-        TEST_JSON_ASSERT(rn, "rn");
-
-        char *rn_str = cJSON_GetStringValue(rn);
-        if (rn_str[0] != 'd')
-        {
-          cJSON_Delete(rn);
-          cJSON_Delete(m2m_cin);
-          free(rn_str);
-          return;
-        }
+  // every request goes through the client, which also times it
+  om2m_coap_handle_response(&om2m_client, received);
+}
 
-        cJSON *con = cJSON_GetObjectItem(m2m_cin, "con");
-        cJSON_Delete(m2m_cin);
-        TEST_JSON_ASSERT(con, "con");
+/**
+ * Completion of a ping, arg is om2m_now_us when it was sent
+ * */
+static void ping_done(void *arg, const om2m_response_t *response)
+{
+  double diff;
 
-        char *con_str = cJSON_GetStringValue(con);
-        cJSON_Delete(con);
+  if (response->rsc != 2001)
+    return;
 
-        uint64_t received;
-        sscanf(con_str, "%lld", (long long *)&received);
-        free(con_str);
+  // half the round trip in ns, the monitor reads it from the heart beat
+  diff = (uint32_t)(om2m_now_us() - (uint32_t)(uintptr_t)arg) * 1000.0;
+  diff_avg = diff_avg * (1 - alpha) + diff * alpha / 2;
+}
 
-        uint64_t diff = current_timestamp - received;
-        diff_avg = diff_avg * (1 - alpha) + diff * alpha / 2;
-      }
-    }
-  }
+/**
+ * Completion of a heart beat, the client has timed it already
+ * */
+static void publish_done(void *arg, const om2m_response_t *response)
+{
 }
 
 /**
@@ -267,9 +270,13 @@ static void ping(void *pvParameters)
   {
     uint64_t timestamp = get_timestamp();
     sprintf(data, "%lld", (long long)timestamp);
-    sprintf(name, "delay_%d", i);
-    om2m_coap_create_content_instance(ctx, dst_addr, AE_NAME, PING,
-                                      name, data, &i, COAP_REQUEST_POST);
+    sprintf(name, "delay_%d", i++);
+    // half of the pending requests are left to the heart beats
+    if (om2m_client_pending(&om2m_client) < OM2M_PENDING_MAX / 2)
+      om2m_create_content_instance(&om2m_client, AE_NAME, PING, name, data,
+                                   ping_done, (void *)(uintptr_t)om2m_now_us());
+    // lost pings and heart beats give their slot back
+    om2m_client_expire(&om2m_client, om2m_now_ms());
     vTaskDelay(500 / portTICK_RATE_MS);
   }
 }
@@ -364,36 +371,57 @@ static void coap_context_handler(void *pvParameters)
  * */
 static void om2m_coap_client_task(void *pvParameters)
 {
-  create_entity(AE_NAME);                         // Create ESP8266
-  create_container(AE_NAME, CONTAINER_NAME);      // Create ESP8266/HR
-  create_container(AE_NAME, ACTUATION);           // Create ESP8266/Actuation
-  create_container(AE_NAME, PING);                // Create ESP8266/DELAY
-  create_entity(CNTRL_SUB);                       // Create Sensor
-  create_sub(AE_NAME, ACTUATION, CNTRL_SUB, SUB); // Subscribe to ESP8266/Actuation with Sensor entity
+  provision(); // Create ESP8266, its containers and the Sensor subscription
 
   xTaskCreate(ping, "ping_pong", 10000, NULL, 5, NULL);
 
   char name[50];
-  char data[20];
+  char data[48];
   unsigned short int i = 0;
+#if defined(E2E)
+  static char report[OM2M_LATENCY_REPORT_MAX];
+#endif
+  sample_t batch[SAMPLE_BATCH];
+  uint32_t overruns = 0, dropped, n, j;
+  static pulse_oximeter_t pulse;
+
+  pulse_oximeter_init(&pulse);
 
   while (1)
   {
     xEventGroupWaitBits(coap_group, BUFFER_BIT, false, true, portMAX_DELAY);
     xEventGroupClearBits(coap_group, BUFFER_BIT);
 
-    //Send Heart Beat
-    sprintf(data, "%lf:%lf", avg, diff_avg);
-    sprintf(name, "HB_%d", i);
+    // every sample read since the last publication goes through the pipeline
+    while ((n = esp_spsc_ring_pop(&sample_ring, batch, SAMPLE_BATCH)) > 0)
+    {
+      for (j = 0; j < n; j++)
+        pulse_oximeter_update(&pulse, batch[j].ir, batch[j].red);
+    }
+
+    dropped = esp_spsc_ring_overruns(&sample_ring) - overruns;
+    overruns += dropped;
+#if !defined(E2E)
+    if (dropped)
+      ESP_LOGW(TAG, "%u samples dropped", (unsigned)dropped);
+#endif
+
+    //Send Heart Beat, the monitor reads the first two fields
+    sprintf(data, "%u:%lf:%u", (unsigned)pulse_oximeter_bpm(&pulse), diff_avg,
+            (unsigned)pulse_oximeter_spo2(&pulse));
+    sprintf(name, "HB_%d", i++);
 
 #if defined(E2E)
     // Sent to Monitor for e2e estimation
     printf("Publish;rn:%s;timestamp:%lld\n", name, get_timestamp());
+    // p50/p99/max per operation and phase, also on GET /latency
+    if (i % LATENCY_REPORT == 0 && om2m_latency_report(&om2m_client, report, sizeof(report)) > 0)
+      printf("Latency;%s\n", report);
 #endif
 
-    om2m_coap_create_content_instance(ctx, dst_addr, AE_NAME, CONTAINER_NAME,
-                                      name, data, &i, COAP_REQUEST_POST);
-    //TODO: Send SpO2_%d id
+    // the callback only completes the request, the client times it
+    om2m_create_content_instance(&om2m_client, AE_NAME, CONTAINER_NAME,
+                                 name, data, publish_done, NULL);
     vTaskDelay(1000 / portTICK_RATE_MS);
   }
   while (1)
@@ -404,6 +432,14 @@ static void om2m_coap_client_task(void *pvParameters)
 
 static esp_err_t wifi_event_handler(void *ctx, system_event_t *event)
 {
+#ifdef CONFIG_ENABLE_MDNS
+  mdns_handle_system_event(ctx, event);
+#endif
+#if defined(DUTY_CYCLE)
+  // only the wakes that publish join, om2m_duty_esp_event drives the station
+  om2m_duty_esp_event(event);
+  return ESP_OK;
+#endif
   switch (event->event_id)
   {
   case SYSTEM_EVENT_STA_START:
@@ -428,6 +464,9 @@ static void wifi_conn_init(void)
 {
   tcpip_adapter_init();
   ESP_ERROR_CHECK(esp_event_loop_init(wifi_event_handler, NULL));
+#ifdef CONFIG_ENABLE_MDNS
+  ESP_ERROR_CHECK(mdns_init());
+#endif
   wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
   ESP_ERROR_CHECK(esp_wifi_init(&cfg));
   ESP_ERROR_CHECK(esp_wifi_set_storage(WIFI_STORAGE_RAM));
@@ -447,75 +486,148 @@ static void wifi_conn_init(void)
 #endif
   ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
   ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+#if defined(DUTY_CYCLE)
+  ESP_ERROR_CHECK(om2m_duty_esp_init());
+#else
   ESP_ERROR_CHECK(esp_wifi_start());
+#endif
 }
 /**
- * Create new subscription to entity/container,
- * with entity sub_entity,
- * registered with sub_name name
- * 
- * @param entity
- * @param container
- * @param sub_entity
- * @sub_name
+ * Completion of a provisioning request,
+ * arg is the event bit of the resource it creates
  * */
-static void create_sub(char *entity, char *container, char *sub_entity, char *sub_name)
+static void provision_done(void *arg, const om2m_response_t *response)
 {
-  xEventGroupClearBits(coap_group, SUB_BIT);
-
-  while (!(xEventGroupGetBits(coap_group) & SUB_BIT))
-  {
-#if !defined(E2E)
-    ESP_LOGI(TAG, "Subscribing to: %s/%s with %s", entity, container, sub_entity);
+  EventBits_t bit = (EventBits_t)(uintptr_t)arg;
+
+  // 4105/4103: already there from a previous boot, OM2M_RSC_TIMEOUT: sent again
+  if (response->rsc == 2001 || response->rsc == 4105 || response->rsc == 4103)
+    xEventGroupSetBits(coap_group, bit);
+  xEventGroupClearBits(coap_group, IN_FLIGHT(bit));
+#ifdef CONFIG_ENABLE_MDNS
+  cse_timeouts = response->rsc == OM2M_RSC_TIMEOUT ? cse_timeouts + 1 : 0;
 #endif
-    om2m_coap_create_subscription(ctx, dst_addr, entity, container, sub_entity, sub_name);
-    vTaskDelay(RETRANSMISSION / portTICK_RATE_MS);
-  }
-  printf("Subscribed to %s/%s with %s\tSub name: %s\n", entity, container, sub_entity, sub_name);
 }
 
-
+#ifdef CONFIG_ENABLE_MDNS
 /**
- * Create new entity
- * 
- * @param entity - Name of entity to create
- * */ 
-static void create_entity(char *entity)
+ * Point the CoAP binding at a discovered CSE
+ * */
+static void cse_use(const om2m_cse_t *cse)
 {
-  xEventGroupClearBits(coap_group, AE_BIT);
+  dst_addr.addr.sin.sin_port = htons(cse->port);
+  dst_addr.addr.sin.sin_addr.s_addr = cse->addr;
+  om2m_binding.dst = dst_addr;
+  if (om2m_cse_path(cse, cse_path, sizeof(cse_path)) < 0)
+    strcpy(cse_path, "/in-cse/" CSE_NAME);
+  cse_timeouts = 0;
+}
+#endif
 
-  while (!(xEventGroupGetBits(coap_group) & AE_BIT))
+static int provision_issue(EventBits_t bit, const char *poa)
+{
+  void *arg = (void *)(uintptr_t)bit;
+
+  switch (bit)
   {
-#if !defined(E2E)
-    ESP_LOGI(TAG, "Creating AE %s", entity);
-#endif
-    om2m_coap_create_ae(ctx, dst_addr, entity, 8989);
-    vTaskDelay(RETRANSMISSION / portTICK_RATE_MS);
+  case AE_BIT:
+    return om2m_create_ae(&om2m_client, AE_NAME, 8989, poa, provision_done, arg);
+  case SENSOR_BIT:
+    return om2m_create_ae(&om2m_client, CNTRL_SUB, 8989, poa, provision_done, arg);
+  case CNT_BIT:
+    return om2m_create_container(&om2m_client, AE_NAME, CONTAINER_NAME, provision_done, arg);
+  case CTRL_BIT:
+    return om2m_create_container(&om2m_client, AE_NAME, ACTUATION, provision_done, arg);
+  case PING_BIT:
+    return om2m_create_container(&om2m_client, AE_NAME, PING, provision_done, arg);
+  case SUB_BIT:
+    return om2m_create_subscription(&om2m_client, AE_NAME, ACTUATION, CNTRL_SUB, SUB, provision_done, arg);
   }
-  xEventGroupWaitBits(coap_group, AE_BIT, false, true, portMAX_DELAY);
-  printf("AE %s created\n", entity);
+  return -1;
 }
 
 /**
- * Create new container in path entity/container
- * 
- * @param entity - entity name
- * @param container - container name
+ * Create the entities, containers and subscription,
+ * every request whose parent already exists is in flight at the same time
+ * so provisioning takes one round trip per level of the resource tree
+ *
+ * Gives up after timeout_ms, a negative timeout waits for the CSE forever.
+ *
+ * @return 0 once everything is created, -1 at the timeout
  * */
-static void create_container(char *entity, char *container)
+static int provision_wait(int timeout_ms)
 {
-  xEventGroupClearBits(coap_group, CNT_BIT);
+  static const struct
+  {
+    EventBits_t bit;
+    EventBits_t depends;
+  } steps[] = {
+      {AE_BIT, 0},
+      {SENSOR_BIT, 0},
+      {CNT_BIT, AE_BIT},
+      {CTRL_BIT, AE_BIT},
+      {PING_BIT, AE_BIT},
+      {SUB_BIT, CTRL_BIT | SENSOR_BIT},
+  };
+  tcpip_adapter_ip_info_t local_ip;
+  uint32_t start = om2m_now_ms();
+  char poa[50];
+  EventBits_t bits;
+  int i;
 
-  while (!(xEventGroupGetBits(coap_group) & CNT_BIT))
+  tcpip_adapter_get_ip_info(TCPIP_ADAPTER_IF_STA, &local_ip);
+  sprintf(poa, "coap://" IPSTR ":%d", IP2STR(&local_ip.ip), CSE_PORT);
+
+  while (((bits = xEventGroupGetBits(coap_group)) & PROVISION_BITS) != PROVISION_BITS)
   {
+    if (timeout_ms >= 0 && om2m_now_ms() - start >= (uint32_t)timeout_ms)
+      return -1;
+
+    for (i = 0; i < sizeof(steps) / sizeof(steps[0]); i++)
+    {
+      EventBits_t bit = steps[i].bit;
+
+      if ((bits & (bit | IN_FLIGHT(bit))) || (bits & steps[i].depends) != steps[i].depends)
+        continue;
+
 #if !defined(E2E)
-    ESP_LOGI(TAG, "Creating publish container %s/%s", entity, container);
+      ESP_LOGI(TAG, "Provisioning step %d", i);
+#endif
+      xEventGroupSetBits(coap_group, IN_FLIGHT(bit));
+      if (provision_issue(bit, poa) < 0)
+        xEventGroupClearBits(coap_group, IN_FLIGHT(bit));
+    }
+
+#if defined(DUTY_CYCLE)
+    // there is no context handler task, the responses are read here
+    om2m_client_poll(&om2m_client, 100);
+#else
+    vTaskDelay(100 / portTICK_RATE_MS);
+#endif
+
+    // unanswered requests time out after RETRANSMISSION and are sent again
+    om2m_client_expire(&om2m_client, om2m_now_ms());
+
+#ifdef CONFIG_ENABLE_MDNS
+    if (cse_timeouts >= CSE_FAILOVER_TIMEOUTS)
+    {
+      om2m_cse_t cse;
+
+      if (om2m_discovery_failover(&cse_discovery, &cse) == 0)
+        cse_use(&cse);
+      cse_timeouts = 0;
+    }
 #endif
-    om2m_coap_create_container(ctx, dst_addr, entity, container);
-    vTaskDelay(RETRANSMISSION / portTICK_RATE_MS);
   }
-  xEventGroupWaitBits(coap_group, CNT_BIT, false, true, portMAX_DELAY);
-  printf("Container %s/%s created\n", entity, container);
+
+  printf("AE %s and %s created, containers created, subscribed to %s/%s with %s\n",
+         AE_NAME, CNTRL_SUB, AE_NAME, ACTUATION, CNTRL_SUB);
+  return 0;
+}
+
+static void provision(void)
+{
+  provision_wait(-1);
 }
 
 static void init_coap(void)
@@ -548,8 +660,27 @@ static void init_coap(void)
 
     vTaskDelay(2000 / portTICK_RATE_MS);
   }
+  om2m_coap_binding_init(&om2m_binding, ctx, &dst_addr, COAP_MESSAGE_NON);
+#ifdef CONFIG_ENABLE_MDNS
+  {
+    om2m_cse_t cse;
+
+    // the CSE cached from the last boot is used at once and re-validated in the background
+    ESP_ERROR_CHECK(om2m_discovery_init(&cse_discovery, "_udp"));
+    if (om2m_discovery_get(&cse_discovery, &cse) == 0)
+      cse_use(&cse);
+  }
+  ESP_ERROR_CHECK(om2m_client_init(&om2m_client, &om2m_coap_binding, &om2m_binding, cse_path, CSE_ORIGINATOR));
+#else
+  ESP_ERROR_CHECK(om2m_client_init(&om2m_client, &om2m_coap_binding, &om2m_binding, "/in-cse/" CSE_NAME, CSE_ORIGINATOR));
+#endif
+  om2m_client.timeout_ms = RETRANSMISSION;
+  om2m_client_latency(&om2m_client, &om2m_latency);
+
+  // replaces the handler of the binding, message_handler forwards to it
   coap_register_response_handler(ctx, message_handler);
   coap_register_request_handler(ctx, request_hanlder);
+  ESP_ERROR_CHECK(om2m_coap_latency_resource(ctx, &om2m_client));
 
   // create new task for context handling
   xTaskCreate(coap_context_handler, "coap_context_handler", 8192, ctx, 5, NULL);
@@ -557,20 +688,119 @@ static void init_coap(void)
   ESP_LOGI(TAG, "CoAP context created");
 #endif
 }
+#if defined(DUTY_CYCLE)
+/**
+ * One reading per wake, the pipeline over DUTY_SAMPLE_MS of samples,
+ * the sensor is shut down for the deep sleep
+ * */
+static int duty_sample(void *arg, om2m_duty_reading_t *reading)
+{
+  uint16_t ir_buffer[MAX30100_FIFO_DEPTH];
+  uint16_t red_buffer[MAX30100_FIFO_DEPTH];
+  static pulse_oximeter_t pulse;
+  uint32_t start = om2m_now_ms();
+  size_t data_len = 0;
+  int i;
+
+  if (max30100_resume() != ESP_OK)
+    return -1;
+
+  pulse_oximeter_init(&pulse);
+  while (om2m_now_ms() - start < DUTY_SAMPLE_MS)
+  {
+    max30100_update(ir_buffer, red_buffer, &data_len);
+    for (i = 0; i < data_len; i++)
+      pulse_oximeter_update(&pulse, ir_buffer[i], red_buffer[i]);
+    vTaskDelay(160 / portTICK_RATE_MS);
+  }
+  max30100_shutdown();
+
+  reading->value[0] = pulse_oximeter_bpm(&pulse);
+  reading->value[1] = pulse_oximeter_spo2(&pulse);
+  return 0;
+}
+
+/**
+ * Nothing published since the power on, the CSE may not know the resources
+ * */
+static int duty_provision(void *arg, int timeout_ms)
+{
+  return provision_wait(timeout_ms);
+}
+
+/**
+ * One wake of the duty cycle, ends in deep sleep
+ * the CSE is CSE_IP, a wake is too short for mDNS
+ * */
+static void duty_task(void *pvParameters)
+{
+  static om2m_duty_t duty;
+
+  coap_address_init(&src_addr);
+  coap_address_init(&dst_addr);
+
+  src_addr.addr.sin.sin_family = AF_INET;
+  src_addr.addr.sin.sin_port = htons(CSE_PORT);
+  src_addr.addr.sin.sin_addr.s_addr = INADDR_ANY;
+
+  dst_addr.addr.sin.sin_family = AF_INET;
+  dst_addr.addr.sin.sin_port = htons(CSE_PORT);
+  dst_addr.addr.sin.sin_addr.s_addr = inet_addr(CSE_IP);
+
+  // bound before the station joins, nothing is sent until then
+  while (!(ctx = coap_new_context(&src_addr)))
+    vTaskDelay(100 / portTICK_RATE_MS);
+  om2m_coap_binding_init(&om2m_binding, ctx, &dst_addr, COAP_MESSAGE_NON);
+  ESP_ERROR_CHECK(om2m_client_init(&om2m_client, &om2m_coap_binding, &om2m_binding, "/in-cse/" CSE_NAME, CSE_ORIGINATOR));
+  om2m_client.timeout_ms = RETRANSMISSION;
+
+  om2m_duty_init(&duty, &om2m_duty_esp_ops, NULL, &om2m_client, AE_NAME, CONTAINER_NAME);
+  om2m_duty_sampler(&duty, duty_sample, NULL);
+  om2m_duty_provisioner(&duty, duty_provision, NULL);
+  duty.period_ms = DUTY_PERIOD_MS;
+  duty.batch = DUTY_BATCH;
+  duty.provision_ms = DUTY_PROVISION_MS;
+
+  while (om2m_duty_step(&duty) != OM2M_DUTY_DONE)
+  {
+#if defined(E2E)
+    if (duty.state == OM2M_DUTY_SLEEP && duty.published > 0)
+      printf("Duty;wake_to_publish:%u;connect:%u;min:%u;max:%u;avg:%u\n",
+             (unsigned)duty.rtc.latency.last, (unsigned)duty.rtc.connect.last,
+             (unsigned)duty.rtc.latency.min, (unsigned)duty.rtc.latency.max,
+             (unsigned)(duty.rtc.latency.sum / duty.rtc.latency.count));
+#endif
+  }
+
+  vTaskDelete(NULL);
+}
+#endif
+
 void app_main(void)
 {
   printf("Starting ESP\n");
+#ifdef CONFIG_LOG_DEFERRED
+  // log lines are rendered below the priority of the sensor and CoAP tasks
+  esp_log_deferred_start(1);
+#endif
   ESP_ERROR_CHECK(nvs_flash_init());
   coap_group = xEventGroupCreate();
+  ESP_ERROR_CHECK(esp_spsc_ring_init(&sample_ring, sample_storage, SAMPLE_RING_LEN, sizeof(sample_t)));
 
 #if defined(SENSOR)
   max30100_init();
+#if !defined(DUTY_CYCLE)
   xTaskCreate(max30100_updater, "updater", 10000, NULL, 5, NULL);
+#endif
   //xTaskCreate(adjust_current, "ajdust current", 10000, NULL, 3, NULL);
 #endif
 #ifndef DEBUG_SENSOR
   wifi_conn_init();
+#if defined(DUTY_CYCLE)
+  xTaskCreate(duty_task, "duty", 16384, NULL, 5, NULL);
+#else
   init_coap();
   xTaskCreate(om2m_coap_client_task, "coap", 16384, NULL, 5, NULL);
 #endif
+#endif
 }
\ No newline at end of file
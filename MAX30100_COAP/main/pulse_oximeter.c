@@ -0,0 +1,291 @@
+#include "pulse_oximeter.h"
+
+#include <string.h>
+
+// DC remover, alpha 0.95 in Q15 and 1 / (1 - alpha) to start from the first sample
+#define PULSE_DC_ALPHA 31130
+#define PULSE_DC_GAIN 20
+
+// second order Butterworth low-pass, 5 Hz at 100 Hz, Q14; LP_A1 and LP_A2 are -a1 and -a2
+#define PULSE_LP_B0 329
+#define PULSE_LP_B1 658
+#define PULSE_LP_B2 329
+#define PULSE_LP_A1 25576
+#define PULSE_LP_A2 -10508
+
+// beat detector, thresholds in Q4 ADC counts
+#define PULSE_INIT_HOLDOFF_MS 2000     // filters settling before the first beat
+#define PULSE_MASKING_HOLDOFF_MS 200   // refractory period, caps the rate at 300 BPM
+#define PULSE_INVALID_MS 2000          // no beat for that long and the rate is unknown
+#define PULSE_THRESHOLD_MIN (20 << PULSE_Q)
+#define PULSE_THRESHOLD_MAX (800 << PULSE_Q)
+#define PULSE_STEP_RESILIENCY (30 << PULSE_Q)
+#define PULSE_PERIOD_ALPHA 19661       // 0.6 in Q15, weight of the last beat in the period
+#define PULSE_THRESHOLD_DECAY 32440    // 0.99 in Q15
+#define PULSE_FALLOFF_TARGET 3         // tenths of the last peak reached after one period
+
+#define PULSE_AC_MAX 32767             // AC counts squared into the SpO2 sums
+
+/**
+ * x * c / 2^q for a coefficient c in Q15 or Q14,
+ * with 32 bit multiplies only: the lx106 has no 64 bit one
+ * */
+static inline int32_t pulse_mul(int32_t x, int16_t c, int q)
+{
+  return (x >> 16) * c * (1 << (16 - q)) + (((x & 0xffff) * c) >> q);
+}
+
+// AC part of a sample, in Q4
+static inline int32_t pulse_dc_remove(int32_t *w, uint16_t x)
+{
+  int32_t prev = *w;
+
+  *w = ((int32_t)x << PULSE_Q) + pulse_mul(prev, PULSE_DC_ALPHA, 15);
+  return *w - prev;
+}
+
+// mean of the window less the sample, inverts the pulse so that beats go up
+static inline int32_t pulse_mean_diff(pulse_oximeter_t *pulse, int32_t x)
+{
+  pulse->mean_sum += x - pulse->mean_window[pulse->mean_index];
+  pulse->mean_window[pulse->mean_index] = x;
+  pulse->mean_index = (pulse->mean_index + 1) & (PULSE_MEAN_WINDOW - 1);
+
+  return pulse->mean_sum / PULSE_MEAN_WINDOW - x;
+}
+
+static inline int32_t pulse_lowpass(pulse_oximeter_t *pulse, int32_t x)
+{
+  int32_t y = pulse_mul(x, PULSE_LP_B0, 14) + pulse_mul(pulse->lp_x[0], PULSE_LP_B1, 14) +
+              pulse_mul(pulse->lp_x[1], PULSE_LP_B2, 14) + pulse_mul(pulse->lp_y[0], PULSE_LP_A1, 14) +
+              pulse_mul(pulse->lp_y[1], PULSE_LP_A2, 14);
+
+  pulse->lp_x[1] = pulse->lp_x[0];
+  pulse->lp_x[0] = x;
+  pulse->lp_y[1] = pulse->lp_y[0];
+  pulse->lp_y[0] = y;
+
+  return y;
+}
+
+static uint32_t pulse_isqrt(uint64_t x)
+{
+  uint64_t root = 0, bit = 1ULL << 62;
+
+  while (bit > x)
+    bit >>= 2;
+  while (bit)
+  {
+    if (x >= root + bit)
+    {
+      x -= root + bit;
+      root = (root >> 1) + bit;
+    }
+    else
+      root >>= 1;
+    bit >>= 2;
+  }
+
+  return root;
+}
+
+static void pulse_spo2_reset(pulse_oximeter_t *pulse)
+{
+  pulse->ir_sq = 0;
+  pulse->red_sq = 0;
+  pulse->beats = 0;
+}
+
+/**
+ * SpO2 = 110 - 25 R with R = (AC red / DC red) / (AC IR / DC IR),
+ * AC being the RMS over the last beats; runs once every PULSE_SPO2_BEATS
+ * beats so its divisions and square root stay out of the per sample cost
+ * */
+static void pulse_spo2(pulse_oximeter_t *pulse)
+{
+  uint64_t ac2, ac, dc, r;
+  int64_t spo2;
+
+  if (!pulse->ir_sq || pulse->ir_w <= 0 || pulse->red_w <= 0)
+  {
+    pulse->spo2 = 0;
+    return;
+  }
+
+  // Q16 ratios, clamped where R would be meaningless anyway
+  ac2 = (pulse->red_sq << 16) / pulse->ir_sq;
+  if (ac2 > 0xffffffffULL)
+    ac2 = 0xffffffffULL;
+  ac = pulse_isqrt(ac2 << 16);
+  dc = ((uint64_t)pulse->ir_w << 16) / pulse->red_w;
+  if (dc > 0xffffffULL)
+    dc = 0xffffffULL;
+  if (ac > 0xffffffULL)
+    ac = 0xffffffULL;
+  r = (ac * dc) >> 16;
+
+  spo2 = (110LL << 16) - 25 * (int64_t)r;
+  if (spo2 < 0)
+    spo2 = 0;
+  else if (spo2 > 100LL << 16)
+    spo2 = 100LL << 16;
+  pulse->spo2 = (spo2 + (1 << 15)) >> 16;
+}
+
+static void pulse_threshold_decrease(pulse_oximeter_t *pulse)
+{
+  if (pulse->threshold_step)
+    pulse->threshold -= pulse->threshold_step;
+  else
+    pulse->threshold = pulse_mul(pulse->threshold, PULSE_THRESHOLD_DECAY, 15);
+
+  if (pulse->threshold < PULSE_THRESHOLD_MIN)
+    pulse->threshold = PULSE_THRESHOLD_MIN;
+}
+
+static void pulse_beat_found(pulse_oximeter_t *pulse)
+{
+  uint32_t delta = pulse->now_ms - pulse->last_beat_ms;
+
+  if (pulse->last_beat_ms && delta <= PULSE_INVALID_MS)
+  {
+    if (pulse->beat_period_ms)
+      pulse->beat_period_ms = (PULSE_PERIOD_ALPHA * delta + (32768 - PULSE_PERIOD_ALPHA) * pulse->beat_period_ms) >> 15;
+    else
+      pulse->beat_period_ms = delta;
+  }
+  pulse->last_beat_ms = pulse->now_ms;
+
+  // the threshold falls from the peak to PULSE_FALLOFF_TARGET of it within a period
+  pulse->last_max = pulse->threshold;
+  if (pulse->beat_period_ms)
+    pulse->threshold_step = pulse->last_max * (10 - PULSE_FALLOFF_TARGET) * PULSE_SAMPLE_MS /
+                            (10 * (int32_t)pulse->beat_period_ms);
+  else
+    pulse->threshold_step = 0;
+}
+
+static int pulse_beat(pulse_oximeter_t *pulse, int32_t x)
+{
+  int beat = 0;
+
+  switch (pulse->state)
+  {
+  case PULSE_BEAT_INIT:
+    if (pulse->now_ms > PULSE_INIT_HOLDOFF_MS)
+      pulse->state = PULSE_BEAT_WAITING;
+    break;
+
+  case PULSE_BEAT_WAITING:
+    if (x > pulse->threshold)
+    {
+      pulse->threshold = x < PULSE_THRESHOLD_MAX ? x : PULSE_THRESHOLD_MAX;
+      pulse->state = PULSE_BEAT_FOLLOWING_SLOPE;
+    }
+
+    if (pulse->now_ms - pulse->last_beat_ms > PULSE_INVALID_MS)
+    {
+      pulse->beat_period_ms = 0;
+      pulse->last_max = 0;
+      pulse->threshold_step = 0;
+      pulse->spo2 = 0;
+      pulse_spo2_reset(pulse);
+    }
+    pulse_threshold_decrease(pulse);
+    break;
+
+  case PULSE_BEAT_FOLLOWING_SLOPE:
+    if (x < pulse->threshold)
+      pulse->state = PULSE_BEAT_MAYBE_DETECTED;
+    else
+      pulse->threshold = x < PULSE_THRESHOLD_MAX ? x : PULSE_THRESHOLD_MAX;
+    break;
+
+  case PULSE_BEAT_MAYBE_DETECTED:
+    if (x + PULSE_STEP_RESILIENCY < pulse->threshold)
+    {
+      beat = 1;
+      pulse_beat_found(pulse);
+      pulse->state = PULSE_BEAT_MASKING;
+    }
+    else
+      pulse->state = PULSE_BEAT_FOLLOWING_SLOPE;
+    break;
+
+  case PULSE_BEAT_MASKING:
+    if (pulse->now_ms - pulse->last_beat_ms > PULSE_MASKING_HOLDOFF_MS)
+      pulse->state = PULSE_BEAT_WAITING;
+    pulse_threshold_decrease(pulse);
+    break;
+  }
+
+  return beat;
+}
+
+void pulse_oximeter_init(pulse_oximeter_t *pulse)
+{
+  memset(pulse, 0, sizeof(*pulse));
+  pulse->state = PULSE_BEAT_INIT;
+  pulse->threshold = PULSE_THRESHOLD_MIN;
+}
+
+/**
+ * Feeds one sample of both LEDs
+ *
+ * @return 1 when the sample completes a beat, 0 otherwise
+ * */
+int pulse_oximeter_update(pulse_oximeter_t *pulse, uint16_t ir, uint16_t red)
+{
+  int32_t ir_ac, red_ac, pulse_value;
+  int beat;
+
+  // the DC removers start from the first sample instead of ramping up from 0
+  if (!pulse->now_ms)
+  {
+    pulse->ir_w = ((int32_t)ir << PULSE_Q) * PULSE_DC_GAIN;
+    pulse->red_w = ((int32_t)red << PULSE_Q) * PULSE_DC_GAIN;
+  }
+  pulse->now_ms += PULSE_SAMPLE_MS;
+
+  ir_ac = pulse_dc_remove(&pulse->ir_w, ir);
+  red_ac = pulse_dc_remove(&pulse->red_w, red);
+
+  pulse_value = pulse_lowpass(pulse, pulse_mean_diff(pulse, ir_ac));
+  beat = pulse_beat(pulse, pulse_value);
+
+  ir_ac >>= PULSE_Q;
+  red_ac >>= PULSE_Q;
+  if (ir_ac > PULSE_AC_MAX || ir_ac < -PULSE_AC_MAX)
+    ir_ac = PULSE_AC_MAX;
+  if (red_ac > PULSE_AC_MAX || red_ac < -PULSE_AC_MAX)
+    red_ac = PULSE_AC_MAX;
+  pulse->ir_sq += (uint32_t)(ir_ac * ir_ac);
+  pulse->red_sq += (uint32_t)(red_ac * red_ac);
+
+  if (beat && ++pulse->beats == PULSE_SPO2_BEATS)
+  {
+    pulse_spo2(pulse);
+    pulse_spo2_reset(pulse);
+  }
+
+  return beat;
+}
+
+/**
+ * Heart rate in beats per minute, 0 while unknown
+ * */
+uint32_t pulse_oximeter_bpm(const pulse_oximeter_t *pulse)
+{
+  if (!pulse->beat_period_ms)
+    return 0;
+
+  return (60000 + pulse->beat_period_ms / 2) / pulse->beat_period_ms;
+}
+
+/**
+ * Oxygen saturation in %, 0 while unknown
+ * */
+uint8_t pulse_oximeter_spo2(const pulse_oximeter_t *pulse)
+{
+  return pulse->spo2;
+}
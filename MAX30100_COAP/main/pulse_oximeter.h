@@ -0,0 +1,65 @@
+#ifndef PULSE_OXIMETER_H
+#define PULSE_OXIMETER_H
+
+#include <stdint.h>
+
+/*
+ * Heart rate and SpO2 from the raw MAX30100 samples, in fixed point.
+ * Every stage works sample by sample on int32_t values in Q4 ADC counts
+ * with Q15/Q14 coefficients, the state is a few words and nothing is allocated.
+ *
+ *   IR  -> DC remover -> mean difference -> Butterworth low-pass -> beat detector
+ *   RED -> DC remover --------------------------------------------> SpO2 (ratio of ratios)
+ */
+
+#define PULSE_SAMPLE_MS 10       // 100 Hz, SAMPLING_RATE
+#define PULSE_Q 4                // fractional bits of the signal
+#define PULSE_MEAN_WINDOW 16     // samples averaged by the mean difference filter, a power of two
+#define PULSE_SPO2_BEATS 3       // beats per SpO2 estimate
+
+typedef enum
+{
+  PULSE_BEAT_INIT,               // filters settling
+  PULSE_BEAT_WAITING,            // below the threshold
+  PULSE_BEAT_FOLLOWING_SLOPE,    // rising above the threshold, which follows it
+  PULSE_BEAT_MAYBE_DETECTED,     // past the peak
+  PULSE_BEAT_MASKING,            // refractory period after a beat
+} pulse_beat_state_t;
+
+typedef struct
+{
+  // DC removers, w[n] = x[n] + alpha * w[n-1], the AC part is w[n] - w[n-1]
+  int32_t ir_w;
+  int32_t red_w;
+
+  // mean difference filter
+  int32_t mean_window[PULSE_MEAN_WINDOW];
+  int32_t mean_sum;
+  uint8_t mean_index;
+
+  // low-pass biquad, direct form I
+  int32_t lp_x[2];
+  int32_t lp_y[2];
+
+  // beat detector, times in ms of samples
+  pulse_beat_state_t state;
+  uint32_t now_ms;
+  uint32_t last_beat_ms;
+  uint32_t beat_period_ms;       // filtered, 0 while no rate is known
+  int32_t threshold;
+  int32_t threshold_step;        // linear fall-off per sample, 0 for exponential decay
+  int32_t last_max;
+
+  // SpO2, squared AC sums over the last beats
+  uint64_t ir_sq;
+  uint64_t red_sq;
+  uint8_t beats;
+  uint8_t spo2;                  // %, 0 while unknown
+} pulse_oximeter_t;
+
+void pulse_oximeter_init(pulse_oximeter_t *pulse);
+int pulse_oximeter_update(pulse_oximeter_t *pulse, uint16_t ir, uint16_t red);
+uint32_t pulse_oximeter_bpm(const pulse_oximeter_t *pulse);
+uint8_t pulse_oximeter_spo2(const pulse_oximeter_t *pulse);
+
+#endif
@@ -0,0 +1,12 @@
+/*
+ * Host stand-in for the error codes of the IDF
+ */
+#pragma once
+
+#include <stdint.h>
+
+typedef int32_t esp_err_t;
+
+#define ESP_OK                          0
+#define ESP_FAIL                        -1
+#define ESP_ERR_INVALID_ARG             0x102
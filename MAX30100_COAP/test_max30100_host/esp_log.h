@@ -0,0 +1,19 @@
+/*
+ * Host stand-in for the IDF logging, the driver's messages are dropped
+ */
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#define ESP_LOGI(tag, format, ...)
+#define ESP_LOGE(tag, format, ...)
+
+#define ESP_ERROR_CHECK(x) do {                 \
+        esp_err_t __err_rc = (x);               \
+        if (__err_rc != ESP_OK)                 \
+            abort();                            \
+    } while(0)
@@ -0,0 +1,10 @@
+/*
+ * Host stand-in for the FreeRTOS kernel, only what the MAX30100 driver uses
+ */
+#pragma once
+
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+
+#define portTICK_RATE_MS    1
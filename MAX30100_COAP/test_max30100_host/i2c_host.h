@@ -0,0 +1,22 @@
+/*
+ * I2C bus with a MAX30100 on it, the FIFO behaves like the chip's:
+ * 16 samples, write and read pointers, a saturating overflow counter
+ * and FIFO_DATA keeping the register address while it pops samples
+ */
+#pragma once
+
+#include <stdint.h>
+
+typedef struct {
+  unsigned int links;         // command links allocated on the heap
+  unsigned int transactions;  // i2c_master_cmd_begin calls
+  unsigned int bytes;         // bytes on the bus, addresses included
+  unsigned int bits;          // SCL cycles, 9 per byte plus start and stop conditions
+} i2c_host_stats_t;
+
+void i2c_host_reset(void);
+void i2c_host_sample(uint16_t ir, uint16_t red);
+uint8_t i2c_host_reg(uint8_t reg);
+int i2c_host_fifo_count(void);
+const i2c_host_stats_t *i2c_host_stats(void);
+void i2c_host_stats_reset(void);
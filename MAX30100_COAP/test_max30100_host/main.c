@@ -0,0 +1,25 @@
+#include "unity.h"
+
+void test_max30100_fifo_drain(void);
+void test_max30100_fifo_wrap(void);
+void test_max30100_fifo_overflow(void);
+void test_max30100_fifo_bus_time(void);
+void test_pulse_oximeter_traces(void);
+void test_pulse_oximeter_flat(void);
+void test_pulse_oximeter_lost(void);
+void test_pulse_oximeter_benchmark(void);
+
+int main(void) {
+  UNITY_BEGIN();
+
+  RUN_TEST(test_max30100_fifo_drain);
+  RUN_TEST(test_max30100_fifo_wrap);
+  RUN_TEST(test_max30100_fifo_overflow);
+  RUN_TEST(test_max30100_fifo_bus_time);
+  RUN_TEST(test_pulse_oximeter_traces);
+  RUN_TEST(test_pulse_oximeter_flat);
+  RUN_TEST(test_pulse_oximeter_lost);
+  RUN_TEST(test_pulse_oximeter_benchmark);
+
+  return UNITY_END();
+}
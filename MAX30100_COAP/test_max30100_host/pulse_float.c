@@ -0,0 +1,149 @@
+#include <math.h>
+#include <string.h>
+
+#include "pulse_float.h"
+
+#define DC_ALPHA 0.95f
+#define LP_B0 0.020083f
+#define LP_B1 0.040167f
+#define LP_B2 0.020083f
+#define LP_A1 -1.561018f
+#define LP_A2 0.641351f
+#define INIT_HOLDOFF_MS 2000
+#define MASKING_HOLDOFF_MS 200
+#define INVALID_MS 2000
+#define THRESHOLD_MIN 20.0f
+#define THRESHOLD_MAX 800.0f
+#define STEP_RESILIENCY 30.0f
+#define PERIOD_ALPHA 0.6f
+#define THRESHOLD_DECAY 0.99f
+#define FALLOFF_TARGET 0.3f
+
+void pulse_float_init(pulse_float_t *pulse) {
+  memset(pulse, 0, sizeof(*pulse));
+  pulse->state = PULSE_BEAT_INIT;
+  pulse->threshold = THRESHOLD_MIN;
+}
+
+static float dc_remove(float *w, float x) {
+  float prev = *w;
+
+  *w = x + DC_ALPHA * prev;
+  return *w - prev;
+}
+
+static void threshold_decrease(pulse_float_t *pulse) {
+  if(pulse->last_max > 0 && pulse->beat_period_ms > 0)
+    pulse->threshold -= pulse->last_max * (1 - FALLOFF_TARGET) / (pulse->beat_period_ms / PULSE_SAMPLE_MS);
+  else
+    pulse->threshold *= THRESHOLD_DECAY;
+  if(pulse->threshold < THRESHOLD_MIN)
+    pulse->threshold = THRESHOLD_MIN;
+}
+
+static void spo2(pulse_float_t *pulse) {
+  float r;
+
+  if(pulse->ir_sq <= 0 || pulse->ir_w <= 0 || pulse->red_w <= 0) {
+    pulse->spo2 = 0;
+    return;
+  }
+
+  r = sqrtf(pulse->red_sq / pulse->ir_sq) * (pulse->ir_w / pulse->red_w);
+  r = 110 - 25 * r;
+  pulse->spo2 = r < 0 ? 0 : r > 100 ? 100 : (uint8_t)(r + 0.5f);
+}
+
+static int beat(pulse_float_t *pulse, float x) {
+  switch(pulse->state) {
+  case PULSE_BEAT_INIT:
+    if(pulse->now_ms > INIT_HOLDOFF_MS)
+      pulse->state = PULSE_BEAT_WAITING;
+    break;
+  case PULSE_BEAT_WAITING:
+    if(x > pulse->threshold) {
+      pulse->threshold = fminf(x, THRESHOLD_MAX);
+      pulse->state = PULSE_BEAT_FOLLOWING_SLOPE;
+    }
+    if(pulse->now_ms - pulse->last_beat_ms > INVALID_MS) {
+      pulse->beat_period_ms = 0;
+      pulse->last_max = 0;
+      pulse->spo2 = 0;
+      pulse->ir_sq = pulse->red_sq = 0;
+      pulse->beats = 0;
+    }
+    threshold_decrease(pulse);
+    break;
+  case PULSE_BEAT_FOLLOWING_SLOPE:
+    if(x < pulse->threshold)
+      pulse->state = PULSE_BEAT_MAYBE_DETECTED;
+    else
+      pulse->threshold = fminf(x, THRESHOLD_MAX);
+    break;
+  case PULSE_BEAT_MAYBE_DETECTED:
+    if(x + STEP_RESILIENCY < pulse->threshold) {
+      uint32_t delta = pulse->now_ms - pulse->last_beat_ms;
+
+      if(pulse->last_beat_ms && delta <= INVALID_MS)
+        pulse->beat_period_ms = pulse->beat_period_ms ? PERIOD_ALPHA * delta + (1 - PERIOD_ALPHA) * pulse->beat_period_ms : delta;
+      pulse->last_beat_ms = pulse->now_ms;
+      pulse->last_max = pulse->threshold;
+      pulse->state = PULSE_BEAT_MASKING;
+      return 1;
+    }
+    pulse->state = PULSE_BEAT_FOLLOWING_SLOPE;
+    break;
+  case PULSE_BEAT_MASKING:
+    if(pulse->now_ms - pulse->last_beat_ms > MASKING_HOLDOFF_MS)
+      pulse->state = PULSE_BEAT_WAITING;
+    threshold_decrease(pulse);
+    break;
+  }
+
+  return 0;
+}
+
+int pulse_float_update(pulse_float_t *pulse, uint16_t ir, uint16_t red) {
+  float ir_ac, red_ac, x, y;
+  int detected;
+
+  if(!pulse->now_ms) {
+    pulse->ir_w = ir / (1 - DC_ALPHA);
+    pulse->red_w = red / (1 - DC_ALPHA);
+  }
+  pulse->now_ms += PULSE_SAMPLE_MS;
+
+  ir_ac = dc_remove(&pulse->ir_w, ir);
+  red_ac = dc_remove(&pulse->red_w, red);
+
+  pulse->mean_sum += ir_ac - pulse->mean_window[pulse->mean_index];
+  pulse->mean_window[pulse->mean_index] = ir_ac;
+  pulse->mean_index = (pulse->mean_index + 1) % PULSE_MEAN_WINDOW;
+  x = pulse->mean_sum / PULSE_MEAN_WINDOW - ir_ac;
+
+  y = LP_B0 * x + LP_B1 * pulse->lp_x[0] + LP_B2 * pulse->lp_x[1] - LP_A1 * pulse->lp_y[0] - LP_A2 * pulse->lp_y[1];
+  pulse->lp_x[1] = pulse->lp_x[0];
+  pulse->lp_x[0] = x;
+  pulse->lp_y[1] = pulse->lp_y[0];
+  pulse->lp_y[0] = y;
+
+  detected = beat(pulse, y);
+
+  pulse->ir_sq += ir_ac * ir_ac;
+  pulse->red_sq += red_ac * red_ac;
+  if(detected && ++pulse->beats == PULSE_SPO2_BEATS) {
+    spo2(pulse);
+    pulse->ir_sq = pulse->red_sq = 0;
+    pulse->beats = 0;
+  }
+
+  return detected;
+}
+
+float pulse_float_bpm(const pulse_float_t *pulse) {
+  return pulse->beat_period_ms ? 60000 / pulse->beat_period_ms : 0;
+}
+
+uint8_t pulse_float_spo2(const pulse_float_t *pulse) {
+  return pulse->spo2;
+}
@@ -0,0 +1,34 @@
+/*
+ * The pulse oximeter pipeline in float, as the driver's DC remover did it,
+ * reference for the fixed point one in ../main/pulse_oximeter.c
+ */
+#pragma once
+
+#include <stdint.h>
+
+#include "pulse_oximeter.h"
+
+typedef struct {
+  float ir_w;
+  float red_w;
+  float mean_window[PULSE_MEAN_WINDOW];
+  float mean_sum;
+  uint8_t mean_index;
+  float lp_x[2];
+  float lp_y[2];
+  pulse_beat_state_t state;
+  uint32_t now_ms;
+  uint32_t last_beat_ms;
+  float beat_period_ms;
+  float threshold;
+  float last_max;
+  float ir_sq;
+  float red_sq;
+  uint8_t beats;
+  uint8_t spo2;
+} pulse_float_t;
+
+void pulse_float_init(pulse_float_t *pulse);
+int pulse_float_update(pulse_float_t *pulse, uint16_t ir, uint16_t red);
+float pulse_float_bpm(const pulse_float_t *pulse);
+uint8_t pulse_float_spo2(const pulse_float_t *pulse);
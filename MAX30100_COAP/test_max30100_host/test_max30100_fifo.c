@@ -0,0 +1,150 @@
+#include <stdio.h>
+
+#include "unity.h"
+#include "i2c_host.h"
+#include "max30100.h"
+
+#define TEST_BUS_KHZ  100   // bus clock of the software I2C master
+
+static uint16_t ir[MAX30100_FIFO_DEPTH];
+static uint16_t red[MAX30100_FIFO_DEPTH];
+
+// distinct values, the high byte differs from the low one
+static uint16_t test_ir(int n) {
+  return 0x1000 + n * 0x0101 + 1;
+}
+
+static uint16_t test_red(int n) {
+  return 0x8000 + n * 0x0102;
+}
+
+static void test_samples(int first, int num) {
+  int i;
+
+  for(i = 0; i < num; i++)
+    i2c_host_sample(test_ir(first + i), test_red(first + i));
+}
+
+static void test_expect(int first, int num, size_t len) {
+  int i;
+
+  TEST_ASSERT_EQUAL(num, len);
+  for(i = 0; i < num; i++) {
+    TEST_ASSERT_EQUAL_HEX16(test_ir(first + i), ir[i]);
+    TEST_ASSERT_EQUAL_HEX16(test_red(first + i), red[i]);
+  }
+}
+
+/**
+ * Pending samples come out in order in two transactions,
+ * leaving the read pointer on the write pointer
+ * */
+void test_max30100_fifo_drain(void) {
+  size_t len;
+
+  i2c_host_reset();
+  test_samples(0, 5);
+
+  TEST_ASSERT_EQUAL(ESP_OK, max30100_read_fifo(ir, red, &len));
+  test_expect(0, 5, len);
+  TEST_ASSERT_EQUAL(2, i2c_host_stats()->transactions);
+  TEST_ASSERT_EQUAL(0, i2c_host_fifo_count());
+  TEST_ASSERT_EQUAL(i2c_host_reg(MAX30100_REG_FIFO_WRITE), i2c_host_reg(MAX30100_REG_FIFO_READ));
+
+  // nothing new, a single transaction for the pointers
+  i2c_host_stats_reset();
+  TEST_ASSERT_EQUAL(ESP_OK, max30100_read_fifo(ir, red, &len));
+  TEST_ASSERT_EQUAL(0, len);
+  TEST_ASSERT_EQUAL(1, i2c_host_stats()->transactions);
+}
+
+/**
+ * The pointers wrap around the 16 entries of the FIFO
+ * */
+void test_max30100_fifo_wrap(void) {
+  size_t len;
+
+  i2c_host_reset();
+  test_samples(0, 10);
+  TEST_ASSERT_EQUAL(ESP_OK, max30100_read_fifo(ir, red, &len));
+  test_expect(0, 10, len);
+
+  test_samples(10, 15);
+  TEST_ASSERT_EQUAL(9, i2c_host_reg(MAX30100_REG_FIFO_WRITE));
+  TEST_ASSERT_EQUAL(ESP_OK, max30100_read_fifo(ir, red, &len));
+  test_expect(10, 15, len);
+  TEST_ASSERT_EQUAL(0, i2c_host_fifo_count());
+}
+
+/**
+ * A full FIFO has equal pointers, the overflow counter tells it from an
+ * empty one; the lost samples are counted and the chip counter cleared
+ * */
+void test_max30100_fifo_overflow(void) {
+  uint32_t before = max30100_fifo_overflows();
+  size_t len;
+
+  i2c_host_reset();
+  test_samples(0, MAX30100_FIFO_DEPTH + 4);
+  TEST_ASSERT_EQUAL(4, i2c_host_reg(MAX30100_REG_FIFO_OVERFLOW_COUNTER));
+
+  TEST_ASSERT_EQUAL(ESP_OK, max30100_read_fifo(ir, red, &len));
+  test_expect(0, MAX30100_FIFO_DEPTH, len);
+  TEST_ASSERT_EQUAL(4, max30100_fifo_overflows() - before);
+  TEST_ASSERT_EQUAL(0, i2c_host_reg(MAX30100_REG_FIFO_OVERFLOW_COUNTER));
+  TEST_ASSERT_EQUAL(0, i2c_host_fifo_count());
+
+  test_samples(100, 3);
+  TEST_ASSERT_EQUAL(ESP_OK, max30100_read_fifo(ir, red, &len));
+  test_expect(100, 3, len);
+  TEST_ASSERT_EQUAL(4, max30100_fifo_overflows() - before);
+}
+
+/**
+ * What the driver did before, one register per transaction and the
+ * read pointer checked around every byte of FIFO_DATA
+ * */
+static size_t test_read_fifo_bytewise(void) {
+  uint8_t wr, rd, rd_check, data;
+  int i, j, num;
+
+  max30100_read_byte(MAX30100_REG_FIFO_WRITE, &wr);
+  max30100_read_byte(MAX30100_REG_FIFO_READ, &rd);
+  num = (wr - rd) & (MAX30100_FIFO_DEPTH - 1);
+
+  for(i = 0; i < num; i++) {
+    max30100_read_byte(MAX30100_REG_FIFO_READ, &rd);
+    for(j = 0; j < MAX30100_SAMPLE_SIZE; j++) {
+      max30100_read_byte(MAX30100_REG_FIFO_READ, &rd_check);
+      max30100_read_byte(MAX30100_REG_FIFO_DATA, &data);
+    }
+    max30100_read_byte(MAX30100_REG_FIFO_READ, &rd);
+  }
+
+  return num;
+}
+
+void test_max30100_fifo_bus_time(void) {
+  i2c_host_stats_t bytewise, burst;
+  size_t len;
+
+  // 15 samples, what the FIFO holds after a 160 ms cycle at 100 Hz
+  i2c_host_reset();
+  test_samples(0, 15);
+  TEST_ASSERT_EQUAL(15, test_read_fifo_bytewise());
+  bytewise = *i2c_host_stats();
+
+  i2c_host_reset();
+  test_samples(0, 15);
+  TEST_ASSERT_EQUAL(ESP_OK, max30100_read_fifo(ir, red, &len));
+  test_expect(0, 15, len);
+  burst = *i2c_host_stats();
+
+  printf("FIFO drain of 15 samples: bytewise %u transactions %u us, burst %u transactions %u us\n",
+         bytewise.transactions, bytewise.bits * 1000 / TEST_BUS_KHZ,
+         burst.transactions, burst.bits * 1000 / TEST_BUS_KHZ);
+
+  TEST_ASSERT_EQUAL(2, burst.transactions);
+  TEST_ASSERT_EQUAL(0, burst.links);
+  TEST_ASSERT_LESS_THAN(bytewise.bits / 8, burst.bits);
+}
@@ -0,0 +1,190 @@
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "unity.h"
+#include "pulse_float.h"
+#include "pulse_oximeter.h"
+
+#define TRACE_DIR       "traces"
+#define TRACE_MAX       (100 * 120)   // two minutes at 100 Hz
+#define TRACE_SETTLE    (100 * 10)    // samples before the rate is checked
+#define BENCH_ROUNDS    200
+
+typedef struct {
+  char name[64];
+  int bpm;
+  int spo2;
+  size_t len;
+  uint16_t ir[TRACE_MAX];
+  uint16_t red[TRACE_MAX];
+} trace_t;
+
+static trace_t trace;
+
+/**
+ * Reads a trace, "# bpm=<n> spo2=<n>" then one "ir,red" line per sample
+ * */
+static int trace_load(const char *file) {
+  char path[300], line[64];
+  FILE *f;
+  unsigned int ir, red;
+
+  snprintf(path, sizeof(path), TRACE_DIR "/%s", file);
+  if(!(f = fopen(path, "r")))
+    return -1;
+
+  memset(&trace, 0, sizeof(trace));
+  snprintf(trace.name, sizeof(trace.name), "%.*s", (int)(strlen(file) - 4), file);
+  while(fgets(line, sizeof(line), f) && trace.len < TRACE_MAX) {
+    if(line[0] == '#')
+      sscanf(line, "# bpm=%d spo2=%d", &trace.bpm, &trace.spo2);
+    else if(sscanf(line, "%u,%u", &ir, &red) == 2) {
+      trace.ir[trace.len] = ir;
+      trace.red[trace.len] = red;
+      trace.len++;
+    }
+  }
+  fclose(f);
+
+  return trace.len ? 0 : -1;
+}
+
+static int trace_is_csv(const struct dirent *entry) {
+  size_t len = strlen(entry->d_name);
+
+  return len > 4 && !strcmp(entry->d_name + len - 4, ".csv");
+}
+
+/**
+ * Every recorded trace in traces/, both pipelines
+ * */
+void test_pulse_oximeter_traces(void) {
+  struct dirent **files;
+  int num, i;
+
+  num = scandir(TRACE_DIR, &files, trace_is_csv, alphasort);
+  TEST_ASSERT_GREATER_THAN(0, num);
+
+  printf("%-24s %9s %9s %9s %9s %9s %9s\n", "trace", "bpm", "fixed", "float", "spo2", "fixed", "float");
+  for(i = 0; i < num; i++) {
+    pulse_oximeter_t fixed;
+    pulse_float_t ref;
+    int fixed_beats = 0, float_beats = 0, worst = 0;
+    size_t n;
+
+    TEST_ASSERT_EQUAL(0, trace_load(files[i]->d_name));
+    free(files[i]);
+
+    pulse_oximeter_init(&fixed);
+    pulse_float_init(&ref);
+    for(n = 0; n < trace.len; n++) {
+      fixed_beats += pulse_oximeter_update(&fixed, trace.ir[n], trace.red[n]);
+      float_beats += pulse_float_update(&ref, trace.ir[n], trace.red[n]);
+
+      // once settled the rate stays within 5 BPM of the truth
+      if(n >= TRACE_SETTLE) {
+        int err = abs((int)pulse_oximeter_bpm(&fixed) - trace.bpm);
+
+        worst = err > worst ? err : worst;
+      }
+    }
+
+    printf("%-24s %9d %9u %9.1f %9d %9u %9u  beats %d/%d, worst %d BPM off\n", trace.name,
+           trace.bpm, pulse_oximeter_bpm(&fixed), pulse_float_bpm(&ref),
+           trace.spo2, pulse_oximeter_spo2(&fixed), pulse_float_spo2(&ref),
+           fixed_beats, float_beats, worst);
+
+    TEST_ASSERT_LESS_OR_EQUAL_MESSAGE(5, worst, trace.name);
+    TEST_ASSERT_INT_WITHIN_MESSAGE(2, trace.spo2, pulse_oximeter_spo2(&fixed), trace.name);
+    TEST_ASSERT_INT_WITHIN_MESSAGE(2, trace.spo2, pulse_float_spo2(&ref), trace.name);
+    TEST_ASSERT_INT_WITHIN_MESSAGE(2, float_beats, fixed_beats, trace.name);
+  }
+  free(files);
+}
+
+/**
+ * No finger, or a finger without pulse: neither a rate nor a saturation
+ * */
+void test_pulse_oximeter_flat(void) {
+  pulse_oximeter_t pulse;
+  int beats = 0, n;
+
+  pulse_oximeter_init(&pulse);
+  for(n = 0; n < 100 * 20; n++)
+    beats += pulse_oximeter_update(&pulse, 45000 + (n & 1) * 4, 30000);
+
+  TEST_ASSERT_EQUAL(0, beats);
+  TEST_ASSERT_EQUAL(0, pulse_oximeter_bpm(&pulse));
+  TEST_ASSERT_EQUAL(0, pulse_oximeter_spo2(&pulse));
+}
+
+/**
+ * The pulse stops: the rate goes back to unknown after two seconds
+ * */
+void test_pulse_oximeter_lost(void) {
+  pulse_oximeter_t pulse;
+  size_t n;
+
+  TEST_ASSERT_EQUAL(0, trace_load("rest_60bpm_98.csv"));
+  pulse_oximeter_init(&pulse);
+  for(n = 0; n < trace.len; n++)
+    pulse_oximeter_update(&pulse, trace.ir[n], trace.red[n]);
+  TEST_ASSERT_NOT_EQUAL(0, pulse_oximeter_bpm(&pulse));
+
+  for(n = 0; n < 100 * 3; n++)
+    pulse_oximeter_update(&pulse, trace.ir[trace.len - 1], trace.red[trace.len - 1]);
+  TEST_ASSERT_EQUAL(0, pulse_oximeter_bpm(&pulse));
+  TEST_ASSERT_EQUAL(0, pulse_oximeter_spo2(&pulse));
+}
+
+static uint64_t bench_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+void test_pulse_oximeter_benchmark(void) {
+  static pulse_oximeter_t fixed;
+  static pulse_float_t ref;
+  uint64_t start, fixed_ticks, float_ticks;
+  volatile int sink = 0;
+  size_t n;
+  int round;
+
+  TEST_ASSERT_EQUAL(0, trace_load("walk_90bpm_95.csv"));
+
+  start = bench_ticks();
+  for(round = 0; round < BENCH_ROUNDS; round++) {
+    pulse_oximeter_init(&fixed);
+    for(n = 0; n < trace.len; n++)
+      sink += pulse_oximeter_update(&fixed, trace.ir[n], trace.red[n]);
+  }
+  fixed_ticks = bench_ticks() - start;
+
+  start = bench_ticks();
+  for(round = 0; round < BENCH_ROUNDS; round++) {
+    pulse_float_init(&ref);
+    for(n = 0; n < trace.len; n++)
+      sink += pulse_float_update(&ref, trace.ir[n], trace.red[n]);
+  }
+  float_ticks = bench_ticks() - start;
+
+#if defined(__x86_64__) || defined(__i386__)
+  printf("pulse oximeter per sample: fixed point %.1f cycles, float %.1f cycles\n",
+#else
+  printf("pulse oximeter per sample: fixed point %.1f ns, float %.1f ns\n",
+#endif
+         (double)fixed_ticks / (BENCH_ROUNDS * trace.len), (double)float_ticks / (BENCH_ROUNDS * trace.len));
+}
@@ -0,0 +1,66 @@
+#!/usr/bin/env python3
+"""
+Writes the PPG traces the pulse oximeter tests replay: 30 s of IR and
+RED samples at 100 Hz as the MAX30100 reports them in high resolution
+mode, with beat to beat variability, respiration and sensor noise.
+
+The red pulse is scaled so that the ratio of ratios gives the SpO2 of
+the header through SpO2 = 110 - 25 R.
+
+    ./gen_traces.py   # rewrites the *.csv next to it
+"""
+import math
+import os
+import random
+
+RATE = 100
+SECONDS = 30
+
+TRACES = [
+    # name, bpm, spo2, IR DC, red DC, IR pulse, noise, respiration depth
+    ("rest_60bpm_98", 60, 98, 45000, 30000, 420, 6, 0.002),
+    ("walk_90bpm_95", 90, 95, 42000, 33000, 360, 12, 0.004),
+    ("exercise_140bpm_92", 140, 92, 38000, 28000, 300, 16, 0.006),
+]
+
+
+def shape(phase):
+    # systolic peak then the smaller diastolic one
+    return (math.exp(-((phase - 0.2) / 0.07) ** 2) +
+            0.35 * math.exp(-((phase - 0.5) / 0.09) ** 2))
+
+
+def trace(bpm, spo2, ir_dc, red_dc, ir_ac, noise, resp, rng):
+    r = (110.0 - spo2) / 25.0
+    red_ac = r * ir_ac / ir_dc * red_dc
+    period = 60.0 / bpm
+    beat_start, beat_len = 0.0, period
+    samples = []
+
+    for n in range(RATE * SECONDS):
+        t = n / RATE
+        while t >= beat_start + beat_len:
+            beat_start += beat_len
+            beat_len = period * rng.uniform(0.97, 1.03)
+        g = shape((t - beat_start) / beat_len)
+        breath = 1.0 + resp * math.sin(2 * math.pi * 0.25 * t)
+        ir = ir_dc * breath - ir_ac * g + rng.gauss(0, noise)
+        red = red_dc * breath - red_ac * g + rng.gauss(0, noise * red_dc / ir_dc)
+        samples.append((int(round(ir)), int(round(red))))
+
+    return samples
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    rng = random.Random(30100)
+
+    for name, bpm, spo2, ir_dc, red_dc, ir_ac, noise, resp in TRACES:
+        with open(os.path.join(here, name + ".csv"), "w") as f:
+            f.write("# bpm=%d spo2=%d\n" % (bpm, spo2))
+            for ir, red in trace(bpm, spo2, ir_dc, red_dc, ir_ac, noise, resp, rng):
+                f.write("%d,%d\n" % (ir, red))
+
+
+if __name__ == "__main__":
+    main()
@@ -30,6 +30,7 @@
 #include "sdkconfig.h"
 
 #include "esp_ota_ops.h"
+#include "esp_ota_pack.h"
 #include "sys/queue.h"
 #include "crc.h"
 #include "esp_log.h"
@@ -43,13 +44,19 @@ esp_err_t bootloader_flash_read(size_t src_addr, void *dest, size_t size, bool a
 #define OTA_MIN(a,b) ((a) <= (b) ? (a) : (b)) 
 #define SUB_TYPE_ID(i) (i & 0x0F) 
 
+/* Flash writes are full sectors out of buf, the last one padded to 16 bytes for flash encryption */
+#define OTA_WRITE_ALIGN 16
+
 typedef struct ota_ops_entry_ {
     uint32_t handle;
     const esp_partition_t *part;
-    uint32_t erased_size;
-    uint32_t wrote_size;
-    uint8_t partial_bytes;
-    uint8_t partial_data[16];
+    uint32_t erased_size;       /* bytes of the partition erased so far, whole sectors */
+    uint32_t wrote_size;        /* bytes taken by esp_ota_write(), buffered ones included */
+    uint32_t buf_len;           /* bytes of the current sector waiting in buf */
+    uint8_t *buf;               /* the sector being received */
+#ifdef CONFIG_APP_UPDATE_PACKED_IMAGE
+    esp_ota_pack_t *pack;       /* decoder of a packed image, NULL for a plain one */
+#endif
     LIST_ENTRY(ota_ops_entry_) entries;
 } ota_ops_entry_t;
 
@@ -78,10 +85,44 @@ static bool is_ota_partition(const esp_partition_t *p)
             && p->subtype < ESP_PARTITION_SUBTYPE_APP_OTA_MAX);
 }
 
+#ifdef CONFIG_BOOTLOADER_VERIFIED_IMAGE_CACHE
+/* Drop the bootloader's records of the partition, so it checks the whole image on the next boot */
+static void ota_drop_verified(const esp_partition_t *partition)
+{
+    const esp_partition_t *ota_data;
+    esp_image_verified_t rec;
+    uint32_t offset;
+    int sec, i, blank;
+
+    ota_data = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_OTA, NULL);
+    if (ota_data == NULL || ota_data->size < 2 * SPI_FLASH_SEC_SIZE) {
+        return;
+    }
+
+    for (sec = 0; sec < 2; sec++) {
+        for (offset = sec * SPI_FLASH_SEC_SIZE + ESP_IMAGE_VERIFIED_AREA;
+             offset + sizeof(rec) <= (sec + 1) * SPI_FLASH_SEC_SIZE; offset += sizeof(rec)) {
+            if (esp_partition_read(ota_data, offset, &rec, sizeof(rec)) != ESP_OK) {
+                break;
+            }
+            for (i = 0, blank = 1; i < sizeof(rec) / sizeof(uint32_t); i++) {
+                blank = blank && ((uint32_t *)&rec)[i] == UINT32_MAX;
+            }
+            if (blank) {
+                break;
+            }
+            if (rec.magic == ESP_IMAGE_VERIFIED_MAGIC && rec.offset == partition->address) {
+                rec.magic = 0;
+                esp_partition_write(ota_data, offset, &rec.magic, sizeof(rec.magic));
+            }
+        }
+    }
+}
+#endif
+
 esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *out_handle)
 {
     ota_ops_entry_t *new_entry;
-    esp_err_t ret = ESP_OK;
 
     if ((partition == NULL) || (out_handle == NULL)) {
         return ESP_ERR_INVALID_ARG;
@@ -100,40 +141,154 @@ esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp
         return ESP_ERR_OTA_PARTITION_CONFLICT;
     }
 
-    // If input image size is 0 or OTA_SIZE_UNKNOWN, erase entire partition
-    if ((image_size == 0) || (image_size == OTA_SIZE_UNKNOWN)) {
-        ret = esp_partition_erase_range(partition, 0, partition->size);
-    } else {
-        ret = esp_partition_erase_range(partition, 0, (image_size / SPI_FLASH_SEC_SIZE + 1) * SPI_FLASH_SEC_SIZE);
+    // If input image size is 0 or OTA_SIZE_UNKNOWN, the image may take the entire partition
+    if ((image_size != 0) && (image_size != OTA_SIZE_UNKNOWN) && (image_size > partition->size)) {
+        return ESP_ERR_INVALID_SIZE;
     }
 
-    if (ret != ESP_OK) {
-        return ret;
-    }
+#ifdef CONFIG_BOOTLOADER_VERIFIED_IMAGE_CACHE
+    ota_drop_verified(partition);
+#endif
 
+    // Nothing is erased yet, esp_ota_write() erases each sector as its first byte arrives
     new_entry = (ota_ops_entry_t *) calloc(sizeof(ota_ops_entry_t), 1);
     if (new_entry == NULL) {
         return ESP_ERR_NO_MEM;
     }
 
-    LIST_INSERT_HEAD(&s_ota_ops_entries_head, new_entry, entries);
-
-    if ((image_size == 0) || (image_size == OTA_SIZE_UNKNOWN)) {
-        new_entry->erased_size = partition->size;
-    } else {
-        new_entry->erased_size = image_size;
+    new_entry->buf = (uint8_t *) malloc(SPI_FLASH_SEC_SIZE);
+    if (new_entry->buf == NULL) {
+        free(new_entry);
+        return ESP_ERR_NO_MEM;
     }
 
+    LIST_INSERT_HEAD(&s_ota_ops_entries_head, new_entry, entries);
+
     new_entry->part = partition;
     new_entry->handle = ++s_ota_ops_last_handle;
     *out_handle = new_entry->handle;
     return ESP_OK;
 }
 
+esp_err_t esp_ota_begin_at(const esp_partition_t *partition, size_t offset, esp_ota_handle_t *out_handle)
+{
+    ota_ops_entry_t *it;
+    uint8_t magic;
+    esp_err_t ret;
+
+    if ((offset == 0) || (offset % SPI_FLASH_SEC_SIZE != 0)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    ret = esp_ota_begin(partition, OTA_SIZE_UNKNOWN, out_handle);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    for (it = LIST_FIRST(&s_ota_ops_entries_head); it != NULL; it = LIST_NEXT(it, entries)) {
+        if (it->handle == *out_handle) {
+            break;
+        }
+    }
+
+    // The sectors before offset were written by an earlier update, its image has to start there
+    if (offset >= it->part->size) {
+        ret = ESP_ERR_INVALID_SIZE;
+    } else {
+        ret = esp_partition_read(it->part, 0, &magic, sizeof(magic));
+        if (ret == ESP_OK && magic != 0xE9) {
+            ESP_LOGE(TAG, "no OTA image to resume (expected 0xE9, saw 0x%02x)", magic);
+            ret = ESP_ERR_OTA_VALIDATE_FAILED;
+        }
+    }
+
+    if (ret != ESP_OK) {
+        LIST_REMOVE(it, entries);
+        free(it->buf);
+        free(it);
+        return ret;
+    }
+
+    it->erased_size = offset;
+    it->wrote_size = offset;
+    return ESP_OK;
+}
+
+/* Erase the sector at offset unless it already is, the image may not go past the partition */
+static esp_err_t ota_erase_sector(ota_ops_entry_t *it, uint32_t offset)
+{
+    esp_err_t ret;
+
+    if (offset < it->erased_size) {
+        return ESP_OK;
+    }
+
+    if (offset + SPI_FLASH_SEC_SIZE > it->part->size) {
+        ESP_LOGE(TAG, "OTA image does not fit in partition (0x%x bytes)", it->part->size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    ret = esp_partition_erase_range(it->part, offset, SPI_FLASH_SEC_SIZE);
+    if (ret == ESP_OK) {
+        it->erased_size = offset + SPI_FLASH_SEC_SIZE;
+    }
+
+    return ret;
+}
+
+/* Write the buffered sector, len is a multiple of OTA_WRITE_ALIGN */
+static esp_err_t ota_flush_sector(ota_ops_entry_t *it, uint32_t len)
+{
+    esp_err_t ret;
+
+    ret = esp_partition_write(it->part, it->wrote_size - it->buf_len, it->buf, len);
+    if (ret == ESP_OK) {
+        it->buf_len = 0;
+    }
+
+    return ret;
+}
+
+/*
+ * Data is gathered in a sector buffer and written a whole sector at a time, whatever
+ * the transport delivers. A sector is erased when its first byte arrives, the erase
+ * then runs while the network stack keeps receiving the rest of it.
+ */
+static esp_err_t ota_write_image(void *arg, const uint8_t *data, size_t size)
+{
+    ota_ops_entry_t *it = (ota_ops_entry_t *)arg;
+    esp_err_t ret;
+    size_t copy_len;
+
+    while (size > 0) {
+        if (it->buf_len == 0) {
+            ret = ota_erase_sector(it, it->wrote_size);
+            if (ret != ESP_OK) {
+                return ret;
+            }
+        }
+
+        copy_len = OTA_MIN(SPI_FLASH_SEC_SIZE - it->buf_len, size);
+        memcpy(it->buf + it->buf_len, data, copy_len);
+        it->buf_len += copy_len;
+        it->wrote_size += copy_len;
+        data += copy_len;
+        size -= copy_len;
+
+        if (it->buf_len == SPI_FLASH_SEC_SIZE) {
+            ret = ota_flush_sector(it, SPI_FLASH_SEC_SIZE);
+            if (ret != ESP_OK) {
+                return ret;
+            }
+        }
+    }
+
+    return ESP_OK;
+}
+
 esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size)
 {
     const uint8_t *data_bytes = (const uint8_t *)data;
-    esp_err_t ret;
     ota_ops_entry_t *it;
 
     if (data == NULL) {
@@ -144,53 +299,26 @@ esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size)
     // find ota handle in linked list
     for (it = LIST_FIRST(&s_ota_ops_entries_head); it != NULL; it = LIST_NEXT(it, entries)) {
         if (it->handle == handle) {
-            // must erase the partition before writing to it
-            assert(it->erased_size > 0 && "must erase the partition before writing to it");
+#ifdef CONFIG_APP_UPDATE_PACKED_IMAGE
+            // a packed image is decoded on the fly, the decoder checks the rest of its header
+            if (it->wrote_size == 0 && it->pack == NULL && size > 0 && data_bytes[0] == (ESP_OTA_PACK_MAGIC & 0xFF)) {
+                it->pack = esp_ota_pack_begin(ota_write_image, it);
+                if (it->pack == NULL) {
+                    return ESP_ERR_NO_MEM;
+                }
+            }
+
+            if (it->pack != NULL) {
+                return esp_ota_pack_write(it->pack, data_bytes, size);
+            }
+#endif
 
             if(it->wrote_size == 0 && size > 0 && data_bytes[0] != 0xE9) {
                 ESP_LOGE(TAG, "OTA image has invalid magic byte (expected 0xE9, saw 0x%02x", data_bytes[0]);
                 return ESP_ERR_OTA_VALIDATE_FAILED;
             }
 
-#ifdef CONFIG_TARGET_PLATFORM_ESP32
-            if (esp_flash_encryption_enabled()) {
-                /* Can only write 16 byte blocks to flash, so need to cache anything else */
-                size_t copy_len;
-
-                /* check if we have partially written data from earlier */
-                if (it->partial_bytes != 0) {
-                    copy_len = OTA_MIN(16 - it->partial_bytes, size);
-                    memcpy(it->partial_data + it->partial_bytes, data_bytes, copy_len);
-                    it->partial_bytes += copy_len;
-                    if (it->partial_bytes != 16) {
-                        return ESP_OK; /* nothing to write yet, just filling buffer */
-                    }
-                    /* write 16 byte to partition */
-                    ret = esp_partition_write(it->part, it->wrote_size, it->partial_data, 16);
-                    if (ret != ESP_OK) {
-                        return ret;
-                    }
-                    it->partial_bytes = 0;
-                    memset(it->partial_data, 0xFF, 16);
-                    it->wrote_size += 16;
-                    data_bytes += copy_len;
-                    size -= copy_len;
-                }
-
-                /* check if we need to save trailing data that we're about to write */
-                it->partial_bytes = size % 16;
-                if (it->partial_bytes != 0) {
-                    size -= it->partial_bytes;
-                    memcpy(it->partial_data, data_bytes + size, it->partial_bytes);
-                }
-            }
-
-#endif
-            ret = esp_partition_write(it->part, it->wrote_size, data_bytes, size);
-            if(ret == ESP_OK){
-                it->wrote_size += size;
-            }
-            return ret;
+            return ota_write_image(it, data_bytes, size);
         }
     }
 
@@ -216,21 +344,34 @@ esp_err_t esp_ota_end(esp_ota_handle_t handle)
 
     /* 'it' holds the ota_ops_entry_t for 'handle' */
 
+#ifdef CONFIG_APP_UPDATE_PACKED_IMAGE
+    if (it->pack != NULL) {
+        // the decoded image has to be complete and match the hash of the packed header
+        ret = esp_ota_pack_end(it->pack);
+        it->pack = NULL;
+        if (ret != ESP_OK) {
+            ret = ESP_ERR_OTA_VALIDATE_FAILED;
+            goto cleanup;
+        }
+    }
+#endif
+
     // esp_ota_end() is only valid if some data was written to this handle
-    if ((it->erased_size == 0) || (it->wrote_size == 0)) {
+    if (it->wrote_size == 0) {
         ret = ESP_ERR_INVALID_ARG;
         goto cleanup;
     }
 
-    if (it->partial_bytes > 0) {
-        /* Write out last 16 bytes, if necessary */
-        ret = esp_partition_write(it->part, it->wrote_size, it->partial_data, 16);
+    if (it->buf_len > 0) {
+        /* Write out the last sector, padded as erased flash */
+        uint32_t len = (it->buf_len + OTA_WRITE_ALIGN - 1) & ~(OTA_WRITE_ALIGN - 1);
+
+        memset(it->buf + it->buf_len, 0xFF, len - it->buf_len);
+        ret = ota_flush_sector(it, len);
         if (ret != ESP_OK) {
             ret = ESP_ERR_INVALID_STATE;
             goto cleanup;
         }
-        it->wrote_size += 16;
-        it->partial_bytes = 0;
     }
 
     esp_image_metadata_t data;
@@ -254,6 +395,7 @@ esp_err_t esp_ota_end(esp_ota_handle_t handle)
 
  cleanup:
     LIST_REMOVE(it, entries);
+    free(it->buf);
     free(it);
     return ret;
 }
@@ -0,0 +1,455 @@
+// Copyright 2018-2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "sdkconfig.h"
+
+#ifdef CONFIG_APP_UPDATE_PACKED_IMAGE
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_err.h"
+#include "esp_partition.h"
+#include "esp_ota_ops.h"
+#include "esp_ota_pack.h"
+#include "bootloader_sha.h"
+#include "esp_log.h"
+
+#define PACK_SOURCE_BUF     256     /* bytes of the running image read at once */
+#define PACK_OUT_BUF        128     /* decoded image bytes handed to the output at once */
+#define PACK_VARINT_BITS    35      /* 5 bytes of 7 bits */
+
+typedef enum {
+    PACK_LZ_TAG,
+    PACK_LZ_LITERAL,
+    PACK_LZ_INDEX,
+    PACK_LZ_COUNT,
+} pack_lz_state_t;
+
+typedef enum {
+    PACK_DELTA_DIFF_LEN,
+    PACK_DELTA_EXTRA_LEN,
+    PACK_DELTA_SEEK,
+    PACK_DELTA_DIFF,
+    PACK_DELTA_EXTRA,
+} pack_delta_state_t;
+
+struct esp_ota_pack {
+    esp_ota_pack_output_t output;
+    void *arg;
+    esp_err_t err;                      /* sticky */
+
+    esp_ota_pack_header_t header;
+    uint32_t header_len;
+    bootloader_sha256_handle_t sha;
+    uint32_t image_len;                 /* decoded image bytes */
+
+    /* LZSS */
+    uint8_t *window;
+    uint32_t window_pos;
+    uint32_t bits;
+    uint32_t bit_count;
+    uint32_t index;
+    pack_lz_state_t lz_state;
+
+    /* delta */
+    const esp_partition_t *source;
+    pack_delta_state_t delta_state;
+    uint32_t varint;
+    uint32_t varint_shift;
+    uint32_t diff_len;
+    uint32_t extra_len;
+    int32_t seek;
+    uint32_t source_pos;
+    uint32_t source_buf_pos;
+    uint32_t source_buf_len;
+    uint8_t source_buf[PACK_SOURCE_BUF];
+
+    uint32_t out_len;
+    uint8_t out[PACK_OUT_BUF];
+};
+
+static const char *TAG = "esp_ota_pack";
+
+esp_ota_pack_t *esp_ota_pack_begin(esp_ota_pack_output_t output, void *arg)
+{
+    esp_ota_pack_t *pack = (esp_ota_pack_t *) calloc(1, sizeof(esp_ota_pack_t));
+
+    if (pack != NULL) {
+        pack->output = output;
+        pack->arg = arg;
+    }
+
+    return pack;
+}
+
+static esp_err_t pack_flush(esp_ota_pack_t *pack)
+{
+    esp_err_t ret;
+
+    if (pack->out_len == 0) {
+        return ESP_OK;
+    }
+
+    bootloader_sha256_data(pack->sha, pack->out, pack->out_len);
+    ret = pack->output(pack->arg, pack->out, pack->out_len);
+    pack->out_len = 0;
+    return ret;
+}
+
+static esp_err_t pack_image_byte(esp_ota_pack_t *pack, uint8_t byte)
+{
+    pack->out[pack->out_len++] = byte;
+    pack->image_len++;
+
+    if (pack->out_len == PACK_OUT_BUF || pack->image_len == pack->header.image_size) {
+        return pack_flush(pack);
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t pack_source_byte(esp_ota_pack_t *pack, uint8_t *byte)
+{
+    esp_err_t ret;
+
+    if (pack->source_pos - pack->source_buf_pos >= pack->source_buf_len) {
+        /* aligned reads stay clear of the bounce buffer of spi_flash_read() */
+        pack->source_buf_pos = pack->source_pos & ~3;
+        pack->source_buf_len = PACK_SOURCE_BUF;
+        if (pack->source_buf_pos + pack->source_buf_len > pack->source->size) {
+            pack->source_buf_len = pack->source->size - pack->source_buf_pos;
+        }
+        ret = esp_partition_read(pack->source, pack->source_buf_pos, pack->source_buf, pack->source_buf_len);
+        if (ret != ESP_OK) {
+            pack->source_buf_len = 0;
+            return ret;
+        }
+    }
+
+    *byte = pack->source_buf[pack->source_pos++ - pack->source_buf_pos];
+    return ESP_OK;
+}
+
+/* Next byte of a varint of a delta record, done once it is complete */
+static esp_err_t pack_varint(esp_ota_pack_t *pack, uint8_t byte, bool *done)
+{
+    if (pack->varint_shift >= PACK_VARINT_BITS) {
+        ESP_LOGE(TAG, "delta record length overflows");
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+
+    pack->varint |= (uint32_t)(byte & 0x7f) << pack->varint_shift;
+    pack->varint_shift += 7;
+    *done = !(byte & 0x80);
+
+    return ESP_OK;
+}
+
+static esp_err_t pack_delta_record_end(esp_ota_pack_t *pack)
+{
+    int64_t pos = (int64_t)pack->source_pos + pack->seek;
+
+    if (pos < 0 || pos > pack->header.source_size) {
+        ESP_LOGE(TAG, "delta seeks out of the source image");
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+
+    pack->source_pos = pos;
+    pack->delta_state = PACK_DELTA_DIFF_LEN;
+    return ESP_OK;
+}
+
+static esp_err_t pack_delta_byte(esp_ota_pack_t *pack, uint8_t byte)
+{
+    esp_err_t ret = ESP_OK;
+    uint8_t source;
+    bool done;
+
+    switch (pack->delta_state) {
+    case PACK_DELTA_DIFF_LEN:
+    case PACK_DELTA_EXTRA_LEN:
+    case PACK_DELTA_SEEK:
+        ret = pack_varint(pack, byte, &done);
+        if (ret != ESP_OK || !done) {
+            return ret;
+        }
+
+        if (pack->delta_state == PACK_DELTA_DIFF_LEN) {
+            pack->diff_len = pack->varint;
+            pack->delta_state = PACK_DELTA_EXTRA_LEN;
+        } else if (pack->delta_state == PACK_DELTA_EXTRA_LEN) {
+            pack->extra_len = pack->varint;
+            pack->delta_state = PACK_DELTA_SEEK;
+        } else {
+            pack->seek = (int32_t)(pack->varint >> 1) ^ -(int32_t)(pack->varint & 1);
+
+            if ((uint64_t)pack->image_len + pack->diff_len + pack->extra_len > pack->header.image_size
+                || (uint64_t)pack->source_pos + pack->diff_len > pack->header.source_size) {
+                ESP_LOGE(TAG, "delta record out of the images");
+                return ESP_ERR_OTA_VALIDATE_FAILED;
+            }
+
+            if (pack->diff_len > 0) {
+                pack->delta_state = PACK_DELTA_DIFF;
+            } else if (pack->extra_len > 0) {
+                pack->delta_state = PACK_DELTA_EXTRA;
+            } else {
+                ret = pack_delta_record_end(pack);
+            }
+        }
+        pack->varint = 0;
+        pack->varint_shift = 0;
+        break;
+
+    case PACK_DELTA_DIFF:
+        ret = pack_source_byte(pack, &source);
+        if (ret == ESP_OK) {
+            ret = pack_image_byte(pack, source + byte);
+        }
+        if (ret == ESP_OK && --pack->diff_len == 0) {
+            if (pack->extra_len > 0) {
+                pack->delta_state = PACK_DELTA_EXTRA;
+            } else {
+                ret = pack_delta_record_end(pack);
+            }
+        }
+        break;
+
+    case PACK_DELTA_EXTRA:
+        ret = pack_image_byte(pack, byte);
+        if (ret == ESP_OK && --pack->extra_len == 0) {
+            ret = pack_delta_record_end(pack);
+        }
+        break;
+    }
+
+    return ret;
+}
+
+/* One byte out of the LZSS decoder, into the window and on to the image */
+static esp_err_t pack_lz_byte(esp_ota_pack_t *pack, uint8_t byte)
+{
+    pack->window[pack->window_pos++ & ((1 << pack->header.window_bits) - 1)] = byte;
+
+    if (pack->header.flags & ESP_OTA_PACK_FLAG_DELTA) {
+        return pack_delta_byte(pack, byte);
+    }
+
+    return pack_image_byte(pack, byte);
+}
+
+static esp_err_t pack_lz_decode(esp_ota_pack_t *pack, const uint8_t *data, size_t size)
+{
+    const uint32_t window_mask = (1 << pack->header.window_bits) - 1;
+    uint32_t need, value, count;
+    esp_err_t ret = ESP_OK;
+
+    while (ret == ESP_OK && pack->image_len < pack->header.image_size) {
+        switch (pack->lz_state) {
+        case PACK_LZ_TAG:
+            need = 1;
+            break;
+        case PACK_LZ_LITERAL:
+            need = 8;
+            break;
+        case PACK_LZ_INDEX:
+            need = pack->header.window_bits;
+            break;
+        default:
+            need = pack->header.lookahead_bits;
+            break;
+        }
+
+        while (pack->bit_count < need && size > 0) {
+            pack->bits = (pack->bits << 8) | *data++;
+            pack->bit_count += 8;
+            size--;
+        }
+        if (pack->bit_count < need) {
+            break;
+        }
+
+        pack->bit_count -= need;
+        value = (pack->bits >> pack->bit_count) & ((1 << need) - 1);
+
+        switch (pack->lz_state) {
+        case PACK_LZ_TAG:
+            pack->lz_state = value ? PACK_LZ_LITERAL : PACK_LZ_INDEX;
+            break;
+        case PACK_LZ_LITERAL:
+            ret = pack_lz_byte(pack, value);
+            pack->lz_state = PACK_LZ_TAG;
+            break;
+        case PACK_LZ_INDEX:
+            pack->index = value;
+            pack->lz_state = PACK_LZ_COUNT;
+            break;
+        case PACK_LZ_COUNT:
+            /* the source may overlap the bytes being copied, one at a time */
+            for (count = value + 1; ret == ESP_OK && count > 0 && pack->image_len < pack->header.image_size; count--) {
+                ret = pack_lz_byte(pack, pack->window[(pack->window_pos - pack->index - 1) & window_mask]);
+            }
+            pack->lz_state = PACK_LZ_TAG;
+            break;
+        }
+    }
+
+    return ret;
+}
+
+/* The delta applies to the running image only if it was built against it */
+static esp_err_t pack_check_source(esp_ota_pack_t *pack)
+{
+    bootloader_sha256_handle_t sha;
+    uint8_t digest[32];
+    uint32_t pos, len;
+    esp_err_t ret = ESP_OK;
+
+    pack->source = esp_ota_get_running_partition();
+    if (pack->source == NULL || pack->header.source_size > pack->source->size) {
+        ESP_LOGE(TAG, "delta source does not fit in the running partition");
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+
+    sha = bootloader_sha256_start();
+    if (sha == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (pos = 0; ret == ESP_OK && pos < pack->header.source_size; pos += len) {
+        len = pack->header.source_size - pos;
+        if (len > PACK_SOURCE_BUF) {
+            len = PACK_SOURCE_BUF;
+        }
+        ret = esp_partition_read(pack->source, pos, pack->source_buf, len);
+        if (ret == ESP_OK) {
+            bootloader_sha256_data(sha, pack->source_buf, len);
+        }
+    }
+
+    bootloader_sha256_finish(sha, digest);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+
+    if (memcmp(digest, pack->header.source_sha256, sizeof(digest)) != 0) {
+        ESP_LOGE(TAG, "delta was built against another image than the running one");
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t pack_start(esp_ota_pack_t *pack)
+{
+    const esp_ota_pack_header_t *header = &pack->header;
+    esp_err_t ret;
+
+    if (header->magic != ESP_OTA_PACK_MAGIC) {
+        ESP_LOGE(TAG, "OTA image has invalid magic 0x%08x", header->magic);
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+
+    if ((header->flags & ~ESP_OTA_PACK_FLAG_DELTA)
+        || header->window_bits < ESP_OTA_PACK_WINDOW_BITS_MIN
+        || header->window_bits > ESP_OTA_PACK_WINDOW_BITS_MAX
+        || header->lookahead_bits < ESP_OTA_PACK_LOOKAHEAD_BITS_MIN
+        || header->lookahead_bits >= header->window_bits) {
+        ESP_LOGE(TAG, "unsupported packed image, flags 0x%x window %d lookahead %d",
+                 header->flags, header->window_bits, header->lookahead_bits);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    if (header->flags & ESP_OTA_PACK_FLAG_DELTA) {
+        ret = pack_check_source(pack);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+    }
+
+    pack->window = (uint8_t *) calloc(1, 1 << header->window_bits);
+    if (pack->window == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    pack->sha = bootloader_sha256_start();
+    if (pack->sha == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_pack_write(esp_ota_pack_t *pack, const void *data, size_t size)
+{
+    const uint8_t *data_bytes = (const uint8_t *)data;
+    size_t copy_len;
+
+    if (pack->err != ESP_OK) {
+        return pack->err;
+    }
+
+    if (pack->header_len < sizeof(esp_ota_pack_header_t)) {
+        copy_len = sizeof(esp_ota_pack_header_t) - pack->header_len;
+        if (copy_len > size) {
+            copy_len = size;
+        }
+        memcpy((uint8_t *)&pack->header + pack->header_len, data_bytes, copy_len);
+        pack->header_len += copy_len;
+        data_bytes += copy_len;
+        size -= copy_len;
+
+        if (pack->header_len < sizeof(esp_ota_pack_header_t)) {
+            return ESP_OK;
+        }
+
+        pack->err = pack_start(pack);
+        if (pack->err != ESP_OK) {
+            return pack->err;
+        }
+    }
+
+    pack->err = pack_lz_decode(pack, data_bytes, size);
+    return pack->err;
+}
+
+esp_err_t esp_ota_pack_end(esp_ota_pack_t *pack)
+{
+    uint8_t digest[32];
+    esp_err_t ret = pack->err;
+
+    if (pack->sha != NULL) {
+        bootloader_sha256_finish(pack->sha, digest);
+        if (ret == ESP_OK && pack->image_len != pack->header.image_size) {
+            ESP_LOGE(TAG, "packed image ends after %d of %d bytes", pack->image_len, pack->header.image_size);
+            ret = ESP_ERR_OTA_VALIDATE_FAILED;
+        }
+        if (ret == ESP_OK && memcmp(digest, pack->header.image_sha256, sizeof(digest)) != 0) {
+            ESP_LOGE(TAG, "decoded image hash does not match");
+            ret = ESP_ERR_OTA_VALIDATE_FAILED;
+        }
+    } else if (ret == ESP_OK) {
+        ESP_LOGE(TAG, "packed image header is incomplete");
+        ret = ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+
+    free(pack->window);
+    free(pack);
+    return ret;
+}
+
+#endif /* CONFIG_APP_UPDATE_PACKED_IMAGE */
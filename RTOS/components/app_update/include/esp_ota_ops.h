@@ -45,16 +45,17 @@ typedef uint32_t esp_ota_handle_t;
 /**
  * @brief   Commence an OTA update writing to the specified partition.
 
- * The specified partition is erased to the specified image size.
+ * Nothing is erased here, esp_ota_write() erases each sector of the
+ * partition just before the image reaches it.
  *
- * If image size is not yet known, pass OTA_SIZE_UNKNOWN which will
- * cause the entire partition to be erased.
+ * If image size is not yet known, pass OTA_SIZE_UNKNOWN, the image may
+ * then take the entire partition.
  *
- * On success, this function allocates memory that remains in use
- * until esp_ota_end() is called with the returned handle.
+ * On success, this function allocates memory, a sector buffer included,
+ * that remains in use until esp_ota_end() is called with the returned handle.
  *
  * @param partition Pointer to info for partition which will receive the OTA update. Required.
- * @param image_size Size of new OTA app image. Partition will be erased in order to receive this size of image. If 0 or OTA_SIZE_UNKNOWN, the entire partition is erased.
+ * @param image_size Size of new OTA app image, checked against the partition size. If 0 or OTA_SIZE_UNKNOWN, the image may take the entire partition.
  * @param out_handle On success, returns a handle which should be used for subsequent esp_ota_write() and esp_ota_end() calls.
 
  * @return
@@ -69,6 +70,30 @@ typedef uint32_t esp_ota_handle_t;
  */
 esp_err_t esp_ota_begin(const esp_partition_t* partition, size_t image_size, esp_ota_handle_t* out_handle);
 
+/**
+ * @brief   Resume an OTA update interrupted by a reset or a lost connection.
+ *
+ * esp_ota_write() puts each sector on flash as soon as its last byte
+ * arrives, so once an update has taken a whole number of sectors they
+ * are all on the partition. The update carries on from there: the next
+ * esp_ota_write() gives the image bytes from offset on, and esp_ota_end()
+ * verifies the whole image.
+ *
+ * Only for plain images, a packed one is decoded from its start.
+ *
+ * @param partition Partition which was receiving the OTA update. Required.
+ * @param offset Bytes of the image already on the partition, a non-zero multiple of SPI_FLASH_SEC_SIZE.
+ * @param out_handle On success, returns a handle which should be used for subsequent esp_ota_write() and esp_ota_end() calls.
+ *
+ * @return
+ *    - ESP_OK: OTA operation resumed successfully.
+ *    - ESP_ERR_INVALID_ARG: offset is not a multiple of the sector size, or as for esp_ota_begin().
+ *    - ESP_ERR_INVALID_SIZE: offset is past the end of the partition.
+ *    - ESP_ERR_OTA_VALIDATE_FAILED: The partition does not hold the start of an app image.
+ *    - The errors of esp_ota_begin() and of reading the partition.
+ */
+esp_err_t esp_ota_begin_at(const esp_partition_t* partition, size_t offset, esp_ota_handle_t* out_handle);
+
 
 uint8_t get_ota_partition_count(void);
 
@@ -79,6 +104,15 @@ uint8_t get_ota_partition_count(void);
  * data is received during the OTA operation. Data is written
  * sequentially to the partition.
  *
+ * Data is gathered into a sector buffer and written one whole sector
+ * at a time, whatever the size of the chunks. A sector is erased when
+ * its first byte arrives. The bytes of the last, partial sector are
+ * written by esp_ota_end().
+ *
+ * With CONFIG_APP_UPDATE_PACKED_IMAGE, the data may also be a packed
+ * image, compressed or a delta against the running app, which is decoded
+ * as it arrives. See esp_ota_pack.h.
+ *
  * @param handle  Handle obtained from esp_ota_begin
  * @param data    Data buffer to write
  * @param size    Size of data buffer in bytes.
@@ -86,8 +120,10 @@ uint8_t get_ota_partition_count(void);
  * @return
  *    - ESP_OK: Data was written to flash successfully.
  *    - ESP_ERR_INVALID_ARG: handle is invalid.
- *    - ESP_ERR_OTA_VALIDATE_FAILED: First byte of image contains invalid app image magic byte.
- *    - ESP_ERR_FLASH_OP_TIMEOUT or ESP_ERR_FLASH_OP_FAIL: Flash write failed.
+ *    - ESP_ERR_OTA_VALIDATE_FAILED: First byte of image contains invalid app image magic byte, or the packed image is invalid.
+ *    - ESP_ERR_INVALID_SIZE: Image goes past the end of the partition.
+ *    - ESP_ERR_NO_MEM: Cannot allocate the decoder of a packed image.
+ *    - ESP_ERR_FLASH_OP_TIMEOUT or ESP_ERR_FLASH_OP_FAIL: Flash erase or write failed.
  *    - ESP_ERR_OTA_SELECT_INFO_INVALID: OTA data partition has invalid contents
  */
 esp_err_t esp_ota_write(esp_ota_handle_t handle, const void* data, size_t size);
@@ -103,8 +139,8 @@ esp_err_t esp_ota_write(esp_ota_handle_t handle, const void* data, size_t size);
  *    - ESP_OK: Newly written OTA app image is valid.
  *    - ESP_ERR_NOT_FOUND: OTA handle was not found.
  *    - ESP_ERR_INVALID_ARG: Handle was never written to.
- *    - ESP_ERR_OTA_VALIDATE_FAILED: OTA image is invalid (either not a valid app image, or - if secure boot is enabled - signature failed to verify.)
- *    - ESP_ERR_INVALID_STATE: If flash encryption is enabled, this result indicates an internal error writing the final encrypted bytes to flash.
+ *    - ESP_ERR_OTA_VALIDATE_FAILED: OTA image is invalid (either not a valid app image, a packed image that did not decode to the image of its header, or - if secure boot is enabled - signature failed to verify.)
+ *    - ESP_ERR_INVALID_STATE: Writing the last buffered sector to flash failed.
  */
 esp_err_t esp_ota_end(esp_ota_handle_t handle);
 
@@ -0,0 +1,127 @@
+// Copyright 2018-2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _OTA_PACK_H
+#define _OTA_PACK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/*
+ * Packed OTA image
+ *
+ * esp_ota_write() takes either a plain app image, starting with 0xE9, or a
+ * packed one: an esp_ota_pack_header_t followed by an LZSS bit stream. The
+ * stream decodes to the app image itself or, with ESP_OTA_PACK_FLAG_DELTA,
+ * to a delta against the image of the running partition.
+ *
+ * LZSS: bits are read MSB first. A 1 bit is followed by a literal byte, a
+ * 0 bit by a back-reference of window_bits (distance - 1) and lookahead_bits
+ * (length - 1) into the last 2^window_bits decoded bytes. Trailing bits
+ * after image_size bytes are ignored.
+ *
+ * Delta: records of three LEB128 varints, diff length, extra length and a
+ * zigzag coded seek, then the diff bytes, added to the source image bytes
+ * from the current source offset, then the extra bytes, copied as they are.
+ * The source offset moves past the diff bytes, then by the seek.
+ *
+ * Decoding takes 2^window_bits bytes of window and a few hundred bytes of
+ * state besides the sector buffer of esp_ota_write().
+ */
+
+#define ESP_OTA_PACK_MAGIC              0x4B50544F  /*!< "OTPK" */
+
+#define ESP_OTA_PACK_FLAG_DELTA         (1 << 0)    /*!< The stream decodes to a delta against the running image */
+
+#define ESP_OTA_PACK_WINDOW_BITS_MIN    4
+#define ESP_OTA_PACK_WINDOW_BITS_MAX    12
+#define ESP_OTA_PACK_LOOKAHEAD_BITS_MIN 3
+
+/**
+ * @brief Header of a packed OTA image, little endian
+ */
+typedef struct {
+    uint32_t magic;                 /*!< ESP_OTA_PACK_MAGIC */
+    uint8_t flags;                  /*!< ESP_OTA_PACK_FLAG_* */
+    uint8_t window_bits;            /*!< LZSS window of 2^window_bits bytes */
+    uint8_t lookahead_bits;         /*!< LZSS back-references up to 2^lookahead_bits bytes, less than window_bits */
+    uint8_t reserved;
+    uint32_t image_size;            /*!< Bytes of the decoded app image */
+    uint32_t source_size;           /*!< Delta: bytes of the running image it was built against */
+    uint8_t image_sha256[32];       /*!< SHA-256 of the decoded app image */
+    uint8_t source_sha256[32];      /*!< Delta: SHA-256 of the source_size first bytes of the running partition */
+} esp_ota_pack_header_t;
+
+/**
+ * @brief Decoded image data, written to the update partition by esp_ota_write()
+ */
+typedef esp_err_t (*esp_ota_pack_output_t)(void *arg, const uint8_t *data, size_t size);
+
+typedef struct esp_ota_pack esp_ota_pack_t;
+
+/**
+ * @brief   Start decoding a packed OTA image
+ *
+ * Called by esp_ota_write() when the image does not start with 0xE9.
+ *
+ * @param output  Called with the decoded image, in order
+ * @param arg     Argument of output
+ *
+ * @return The decoder, NULL if out of memory
+ */
+esp_ota_pack_t *esp_ota_pack_begin(esp_ota_pack_output_t output, void *arg);
+
+/**
+ * @brief   Decode the next bytes of a packed OTA image
+ *
+ * A delta is checked against the running partition as soon as its
+ * header is complete, before any output.
+ *
+ * @param pack  Decoder from esp_ota_pack_begin()
+ * @param data  Packed image data
+ * @param size  Size of data in bytes
+ *
+ * @return
+ *    - ESP_OK: Data was decoded, the output took the image bytes it produced.
+ *    - ESP_ERR_OTA_VALIDATE_FAILED: Invalid header or stream, or the delta was built against another image.
+ *    - ESP_ERR_NOT_SUPPORTED: Unknown flags or LZSS parameters.
+ *    - ESP_ERR_NO_MEM: Cannot allocate the window.
+ *    - Errors of the output or of reading the running partition.
+ *    Errors stick, later calls return the same.
+ */
+esp_err_t esp_ota_pack_write(esp_ota_pack_t *pack, const void *data, size_t size);
+
+/**
+ * @brief   Finish decoding and free the decoder
+ *
+ * @param pack  Decoder from esp_ota_pack_begin()
+ *
+ * @return
+ *    - ESP_OK: The whole image was decoded and matches the hash of the header.
+ *    - ESP_ERR_OTA_VALIDATE_FAILED: The image is incomplete or its hash does not match.
+ *    - The error of an earlier esp_ota_pack_write().
+ */
+esp_err_t esp_ota_pack_end(esp_ota_pack_t *pack);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _OTA_PACK_H */
@@ -0,0 +1,48 @@
+/*
+ * A firmware for the delta tests, linked twice: APP_HOST_V2 adds a feature
+ * in front of the libraries, everything after it moves
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cJSON.h"
+#include "crc.h"
+
+#ifndef APP_HOST_V2
+#define APP_HOST_VERSION "1.0.0"
+#else
+#define APP_HOST_VERSION "1.1.0"
+
+static cJSON *app_sensor(const char *name, double value, const char *unit)
+{
+    cJSON *sensor = cJSON_CreateObject();
+
+    cJSON_AddStringToObject(sensor, "name", name);
+    cJSON_AddNumberToObject(sensor, "value", value);
+    cJSON_AddStringToObject(sensor, "unit", unit);
+    return sensor;
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    cJSON *root = cJSON_CreateObject();
+    char *text;
+
+    cJSON_AddStringToObject(root, "version", APP_HOST_VERSION);
+    cJSON_AddNumberToObject(root, "argc", argc);
+#ifdef APP_HOST_V2
+    cJSON *sensors = cJSON_AddArrayToObject(root, "sensors");
+
+    cJSON_AddItemToArray(sensors, app_sensor("heart_rate", 72, "bpm"));
+    cJSON_AddItemToArray(sensors, app_sensor("spo2", 98, "%"));
+#endif
+
+    text = cJSON_PrintUnformatted(root);
+    printf("%s %08x\n", text, crc32_le(0, (const uint8_t *)text, strlen(text)));
+
+    free(text);
+    cJSON_Delete(root);
+    return 0;
+}
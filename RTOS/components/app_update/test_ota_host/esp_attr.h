@@ -0,0 +1,6 @@
+/*
+ * Host stand-in, nothing is placed in IRAM
+ */
+#pragma once
+
+#define IRAM_ATTR
@@ -0,0 +1,10 @@
+/*
+ * Host stand-in for the IDF logging, errors are expected by some tests
+ */
+#pragma once
+
+#define ESP_LOGE(tag, format, ...) ((void) (tag))
+#define ESP_LOGW(tag, format, ...) ((void) (tag))
+#define ESP_LOGI(tag, format, ...) ((void) (tag))
+#define ESP_LOGD(tag, format, ...) ((void) (tag))
+#define ESP_LOGV(tag, format, ...) ((void) (tag))
@@ -0,0 +1,208 @@
+#include <string.h>
+
+#include "esp_err.h"
+#include "esp_flash_data_types.h"
+#include "spi_flash.h"
+#include "bootloader_flash.h"
+#include "flash_host.h"
+
+#define FLASH_HOST_ALIGN        4
+#define FLASH_HOST_PAGE_SIZE    256
+
+// microseconds for 4 << i bytes, measured on an ESP8266
+static const unsigned int read_us[] = { 7, 5, 6, 7, 11, 18, 32, 60, 118, 231, 459 };
+static const unsigned int write_us[] = { 19, 23, 35, 57, 106, 205, 417, 814, 1622, 3200, 6367 };
+static const unsigned int erase_us = 37142;
+
+#define FLASH_HOST_TIMES (sizeof(read_us) / sizeof(read_us[0]))
+
+static uint8_t flash[FLASH_HOST_SIZE];
+static flash_host_stats_t stats;
+
+static const esp_partition_info_t partitions[] = {
+    { ESP_PARTITION_MAGIC, PART_TYPE_DATA, PART_SUBTYPE_DATA_OTA, { 0xd000, 0x2000 }, "otadata", 0 },
+    { ESP_PARTITION_MAGIC, PART_TYPE_DATA, PART_SUBTYPE_DATA_RF, { 0xf000, 0x1000 }, "phy_init", 0 },
+    { ESP_PARTITION_MAGIC, PART_TYPE_APP, PART_SUBTYPE_OTA_FLAG, { FLASH_HOST_OTA_0, FLASH_HOST_OTA_SIZE }, "ota_0", 0 },
+    { ESP_PARTITION_MAGIC, PART_TYPE_APP, PART_SUBTYPE_OTA_FLAG | 1, { FLASH_HOST_OTA_1, FLASH_HOST_OTA_SIZE }, "ota_1", 0 },
+};
+
+// linear between the measured sizes, proportional past the largest one
+static unsigned int flash_host_time(const unsigned int *table, size_t size)
+{
+    size_t i, lo;
+
+    if (size <= 4)
+        return table[0];
+    if (size >= 4 << (FLASH_HOST_TIMES - 1))
+        return table[FLASH_HOST_TIMES - 1] * size / (4 << (FLASH_HOST_TIMES - 1));
+
+    for (i = 0; size >= (size_t)8 << i; i++)
+        ;
+    lo = 4 << i;
+    return table[i] + (table[i + 1] - table[i]) * (size - lo) / lo;
+}
+
+void flash_host_reset(void)
+{
+    memset(flash, 0xff, sizeof(flash));
+    memcpy(flash + ESP_PARTITION_TABLE_ADDR, partitions, sizeof(partitions));
+    flash_host_stats_reset();
+}
+
+void flash_host_fill(size_t addr, size_t size, uint8_t value)
+{
+    memset(flash + addr, value, size);
+}
+
+void flash_host_load(size_t addr, const void *data, size_t size)
+{
+    memcpy(flash + addr, data, size);
+}
+
+const uint8_t *flash_host_data(size_t addr)
+{
+    return flash + addr;
+}
+
+const flash_host_stats_t *flash_host_stats(void)
+{
+    return &stats;
+}
+
+void flash_host_stats_reset(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+static void flash_host_read_raw(size_t addr, void *dest, size_t size)
+{
+    memcpy(dest, flash + addr, size);
+    stats.busy_us += flash_host_time(read_us, size);
+}
+
+// one page program at most, like spi_flash_write_raw()
+static void flash_host_program(size_t addr, const uint8_t *src, size_t size)
+{
+    size_t i;
+
+    for (i = 0; i < size; i++) {
+        if (src[i] & ~flash[addr + i])
+            stats.bad_writes++;
+        flash[addr + i] &= src[i];
+    }
+    stats.programs++;
+    stats.busy_us += flash_host_time(write_us, size);
+}
+
+// spi_flash_program(): the first page up to its boundary, then whole pages
+static void flash_host_write_raw(size_t addr, const uint8_t *src, size_t size)
+{
+    size_t len;
+
+    while (size > 0) {
+        len = FLASH_HOST_PAGE_SIZE - addr % FLASH_HOST_PAGE_SIZE;
+        if (len > size)
+            len = size;
+        flash_host_program(addr, src, len);
+        addr += len;
+        src += len;
+        size -= len;
+    }
+}
+
+esp_err_t spi_flash_read(size_t src_addr, void *dest, size_t size)
+{
+    if (!size)
+        return ESP_OK;
+    if (dest == NULL || src_addr + size > FLASH_HOST_SIZE)
+        return ESP_ERR_FLASH_OP_FAIL;
+
+    flash_host_read_raw(src_addr, dest, size);
+    return ESP_OK;
+}
+
+esp_err_t bootloader_flash_read(size_t src_addr, void *dest, size_t size, bool allow_decrypt)
+{
+    return spi_flash_read(src_addr, dest, size);
+}
+
+esp_err_t spi_flash_write(size_t dest_addr, const void *src, size_t size)
+{
+    const uint8_t *tmp = src;
+    uint8_t buf[SPI_READ_BUF_MAX];
+
+    if (!size)
+        return ESP_OK;
+    if (src == NULL || dest_addr + size > FLASH_HOST_SIZE)
+        return ESP_ERR_FLASH_OP_FAIL;
+
+    stats.writes++;
+    if (!(dest_addr % FLASH_HOST_ALIGN) && !((uintptr_t)src % FLASH_HOST_ALIGN) && !(size % FLASH_HOST_ALIGN)) {
+        if (!(dest_addr % SPI_FLASH_SEC_SIZE) && size == SPI_FLASH_SEC_SIZE)
+            stats.sector_writes++;
+        flash_host_write_raw(dest_addr, src, size);
+        return ESP_OK;
+    }
+
+    // the driver's bounce buffer: read-modify-write of the unaligned head, then 64 bytes at a time
+    stats.unaligned++;
+    if (dest_addr % FLASH_HOST_ALIGN) {
+        size_t r_addr = dest_addr & ~(FLASH_HOST_ALIGN - 1);
+        size_t c_off = dest_addr - r_addr;
+        size_t wbytes = FLASH_HOST_ALIGN - c_off;
+
+        if (wbytes > size)
+            wbytes = size;
+        flash_host_read_raw(r_addr, buf, FLASH_HOST_ALIGN);
+        memcpy(buf + c_off, tmp, wbytes);
+        flash_host_write_raw(r_addr, buf, FLASH_HOST_ALIGN);
+        dest_addr += wbytes;
+        tmp += wbytes;
+        size -= wbytes;
+    }
+
+    while (size > 0) {
+        size_t len = size >= SPI_READ_BUF_MAX ? SPI_READ_BUF_MAX : size;
+        size_t wlen = (len + FLASH_HOST_ALIGN - 1) & ~(FLASH_HOST_ALIGN - 1);
+
+        if (wlen != len)
+            flash_host_read_raw(dest_addr + wlen - FLASH_HOST_ALIGN, buf + wlen - FLASH_HOST_ALIGN, FLASH_HOST_ALIGN);
+        memcpy(buf, tmp, len);
+        flash_host_write_raw(dest_addr, buf, wlen);
+        dest_addr += len;
+        tmp += len;
+        size -= len;
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t bootloader_flash_write(size_t dest_addr, void *src, size_t size, bool write_encrypted)
+{
+    return spi_flash_write(dest_addr, src, size);
+}
+
+esp_err_t spi_flash_erase_sector(size_t sector)
+{
+    if (sector >= FLASH_HOST_SIZE / SPI_FLASH_SEC_SIZE)
+        return ESP_ERR_FLASH_OP_FAIL;
+
+    memset(flash + sector * SPI_FLASH_SEC_SIZE, 0xff, SPI_FLASH_SEC_SIZE);
+    stats.erases++;
+    stats.busy_us += erase_us;
+    return ESP_OK;
+}
+
+esp_err_t spi_flash_erase_range(size_t start_address, size_t size)
+{
+    esp_err_t ret = ESP_OK;
+    size_t sec;
+
+    if (start_address % SPI_FLASH_SEC_SIZE || size % SPI_FLASH_SEC_SIZE)
+        return ESP_ERR_FLASH_OP_FAIL;
+
+    for (sec = start_address / SPI_FLASH_SEC_SIZE; ret == ESP_OK && size > 0; sec++, size -= SPI_FLASH_SEC_SIZE)
+        ret = spi_flash_erase_sector(sec);
+
+    return ret;
+}
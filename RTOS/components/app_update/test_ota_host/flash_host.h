@@ -0,0 +1,32 @@
+/*
+ * ESP8266 SPI flash in RAM: erased bytes read 0xFF, a write can only clear bits
+ * and spi_flash_write() splits unaligned requests the way the driver does.
+ * Busy time follows the ESP8266 timings of nvs_flash/test_nvs_host.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FLASH_HOST_SIZE         (2 * 1024 * 1024)
+
+#define FLASH_HOST_OTA_0        0x10000
+#define FLASH_HOST_OTA_1        0x110000
+#define FLASH_HOST_OTA_SIZE     0xF0000
+
+typedef struct {
+    unsigned int erases;        // sectors erased
+    unsigned int writes;        // spi_flash_write() calls
+    unsigned int sector_writes; // of them, whole aligned sectors
+    unsigned int unaligned;     // of them, split through the 64 byte bounce buffer
+    unsigned int programs;      // program operations sent to the chip
+    unsigned int bad_writes;    // programs that tried to set a cleared bit
+    uint64_t busy_us;           // time the chip kept the CPU waiting
+} flash_host_stats_t;
+
+void flash_host_reset(void);
+void flash_host_fill(size_t addr, size_t size, uint8_t value);
+void flash_host_load(size_t addr, const void *data, size_t size);
+const uint8_t *flash_host_data(size_t addr);
+const flash_host_stats_t *flash_host_stats(void);
+void flash_host_stats_reset(void);
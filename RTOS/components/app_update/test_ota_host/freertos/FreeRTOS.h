@@ -0,0 +1,6 @@
+/*
+ * Host stand-in for the FreeRTOS kernel, the OTA code needs none of it
+ */
+#pragma once
+
+#include <stdint.h>
@@ -0,0 +1,4 @@
+/*
+ * Host stand-in for the FreeRTOS tasks, the OTA code needs none of it
+ */
+#pragma once
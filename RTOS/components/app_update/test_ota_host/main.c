@@ -0,0 +1,39 @@
+#include "unity.h"
+
+void test_ota_write_round_trip(void);
+void test_ota_write_sector_boundary(void);
+void test_ota_write_too_big(void);
+void test_ota_write_resume(void);
+void test_ota_write_corrupt(void);
+void test_ota_write_benchmark(void);
+void test_ota_pack_image(void);
+void test_ota_pack_delta(void);
+void test_ota_pack_wrong_source(void);
+void test_ota_pack_corrupt(void);
+void test_ota_pack_benchmark(void);
+void test_image_verified_boot(void);
+void test_image_verified_changed(void);
+void test_image_verified_ota(void);
+void test_image_verified_benchmark(void);
+
+int main(void) {
+  UNITY_BEGIN();
+
+  RUN_TEST(test_ota_write_round_trip);
+  RUN_TEST(test_ota_write_sector_boundary);
+  RUN_TEST(test_ota_write_too_big);
+  RUN_TEST(test_ota_write_resume);
+  RUN_TEST(test_ota_write_corrupt);
+  RUN_TEST(test_ota_write_benchmark);
+  RUN_TEST(test_ota_pack_image);
+  RUN_TEST(test_ota_pack_delta);
+  RUN_TEST(test_ota_pack_wrong_source);
+  RUN_TEST(test_ota_pack_corrupt);
+  RUN_TEST(test_ota_pack_benchmark);
+  RUN_TEST(test_image_verified_boot);
+  RUN_TEST(test_image_verified_changed);
+  RUN_TEST(test_image_verified_ota);
+  RUN_TEST(test_image_verified_benchmark);
+
+  return UNITY_END();
+}
@@ -0,0 +1,195 @@
+#include <elf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "unity.h"
+#include "esp_ota_ops.h"
+#include "esp_image_format.h"
+#include "flash_host.h"
+#include "ota_host.h"
+
+#define OTA_HOST_IROM_ADDR  0x40210000
+#define OTA_HOST_DRAM_ADDR  0x3ffe8000
+
+/*
+ * An app image the bootloader accepts: header, segments and the
+ * checksum byte closing the 16 byte padding
+ */
+size_t ota_host_image(uint8_t *buf, const ota_host_segment_t *segs, int count)
+{
+    esp_image_header_t *header = (esp_image_header_t *)buf;
+    uint32_t checksum = 0xef, word;
+    size_t len = sizeof(*header), j;
+    int i;
+
+    memset(header, 0, sizeof(*header));
+    header->magic = ESP_IMAGE_HEADER_MAGIC;
+    header->segment_count = count;
+    header->entry_addr = 0x40100004;
+
+    for (i = 0; i < count; i++) {
+        esp_image_segment_header_t seg = { segs[i].load_addr, segs[i].len };
+
+        memcpy(buf + len, &seg, sizeof(seg));
+        len += sizeof(seg);
+        memcpy(buf + len, segs[i].data, segs[i].len);
+        for (j = 0; j < segs[i].len; j += 4) {
+            memcpy(&word, buf + len + j, 4);
+            checksum ^= word;
+        }
+        len += segs[i].len;
+    }
+
+    checksum ^= checksum >> 16;
+    checksum ^= checksum >> 8;
+    memset(buf + len, 0, 16);
+    len = (len + 16) & ~15;
+    buf[len - 1] = checksum;
+    return len;
+}
+
+size_t ota_host_image_random(uint8_t *buf, size_t irom_len, size_t dram_len, unsigned int seed)
+{
+    uint8_t *data = malloc(irom_len + dram_len);
+    ota_host_segment_t segs[] = {
+        { OTA_HOST_IROM_ADDR, data, irom_len },
+        { OTA_HOST_DRAM_ADDR, data + irom_len, dram_len },
+    };
+    size_t i, len;
+    uint32_t word;
+
+    TEST_ASSERT_NOT_NULL(data);
+    srand(seed);
+    for (i = 0; i < irom_len + dram_len; i += 4) {
+        word = rand();
+        memcpy(data + i, &word, 4);
+    }
+
+    len = ota_host_image(buf, segs, 2);
+    free(data);
+    return len;
+}
+
+/*
+ * The allocated sections of a host ELF as an app image: code and constants
+ * in the flash mapped segment, writable data in the RAM one
+ */
+size_t ota_host_image_elf(uint8_t *buf, size_t size, const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    uint8_t *elf, *seg_data[2];
+    ota_host_segment_t segs[2];
+    Elf64_Ehdr *ehdr;
+    Elf64_Shdr *shdr;
+    long elf_len;
+    size_t len;
+    int i, s;
+
+    TEST_ASSERT_NOT_NULL_MESSAGE(f, path);
+    fseek(f, 0, SEEK_END);
+    elf_len = ftell(f);
+    rewind(f);
+    elf = malloc(elf_len);
+    TEST_ASSERT_NOT_NULL(elf);
+    TEST_ASSERT_EQUAL(1, fread(elf, elf_len, 1, f));
+    fclose(f);
+
+    ehdr = (Elf64_Ehdr *)elf;
+    TEST_ASSERT_EQUAL_MEMORY(ELFMAG, ehdr->e_ident, SELFMAG);
+    TEST_ASSERT_EQUAL(ELFCLASS64, ehdr->e_ident[EI_CLASS]);
+    shdr = (Elf64_Shdr *)(elf + ehdr->e_shoff);
+
+    for (s = 0; s < 2; s++) {
+        seg_data[s] = malloc(size);
+        TEST_ASSERT_NOT_NULL(seg_data[s]);
+        segs[s].load_addr = s ? OTA_HOST_DRAM_ADDR : OTA_HOST_IROM_ADDR;
+        segs[s].data = seg_data[s];
+        segs[s].len = 0;
+    }
+
+    for (i = 0; i < ehdr->e_shnum; i++) {
+        if (shdr[i].sh_type != SHT_PROGBITS || !(shdr[i].sh_flags & SHF_ALLOC))
+            continue;
+
+        s = (shdr[i].sh_flags & SHF_WRITE) ? 1 : 0;
+        TEST_ASSERT_TRUE(segs[s].len + shdr[i].sh_size + 4 <= size);
+        memcpy(seg_data[s] + segs[s].len, elf + shdr[i].sh_offset, shdr[i].sh_size);
+        segs[s].len += shdr[i].sh_size;
+        while (segs[s].len % 4)
+            seg_data[s][segs[s].len++] = 0;
+    }
+
+    TEST_ASSERT_TRUE(segs[0].len + segs[1].len + 64 <= size);
+    len = ota_host_image(buf, segs, 2);
+
+    free(seg_data[0]);
+    free(seg_data[1]);
+    free(elf);
+    return len;
+}
+
+/*
+ * Flash operations block the receiving task while the network keeps filling
+ * the TCP window, the sender stalls once OTA_HOST_NET_WINDOW segments are unread
+ */
+static void ota_host_net(const esp_partition_t *part, const uint8_t *data, size_t len, esp_ota_handle_t handle,
+                         ota_host_download_t *result)
+{
+    const flash_host_stats_t *stats = flash_host_stats();
+    uint64_t done[OTA_HOST_NET_WINDOW] = { 0 }, arrive = 0, now, busy;
+    esp_image_metadata_t image;
+    const esp_partition_pos_t part_pos = { part->address, part->size };
+    size_t pos, chunk;
+    int i;
+
+    now = stats->busy_us;
+    for (i = 0, pos = 0; pos < len; i++, pos += chunk) {
+        chunk = i ? OTA_HOST_NET_MSS : OTA_HOST_NET_MSS - OTA_HOST_NET_HEADER;
+        if (chunk > len - pos)
+            chunk = len - pos;
+
+        if (arrive < done[i % OTA_HOST_NET_WINDOW])
+            arrive = done[i % OTA_HOST_NET_WINDOW];
+        arrive += (uint64_t)chunk * 1000000 / OTA_HOST_NET_BYTES_S;
+        if (now < arrive)
+            now = arrive;
+
+        busy = stats->busy_us;
+        if (handle)
+            TEST_ASSERT_EQUAL(ESP_OK, esp_ota_write(handle, data + pos, chunk));
+        else
+            TEST_ASSERT_EQUAL(ESP_OK, esp_partition_write(part, pos, data + pos, chunk));
+        now += stats->busy_us - busy;
+        done[i % OTA_HOST_NET_WINDOW] = now;
+
+        if (!i)
+            result->first_us = now;
+    }
+
+    busy = stats->busy_us;
+    if (handle)
+        TEST_ASSERT_EQUAL(ESP_OK, esp_ota_end(handle));
+    else
+        TEST_ASSERT_EQUAL(ESP_OK, esp_image_load(ESP_IMAGE_VERIFY, &part_pos, &image));
+    now += stats->busy_us - busy;
+
+    result->total_us = now;
+    result->flash_us = stats->busy_us;
+}
+
+void ota_host_download_eager(const esp_partition_t *part, const uint8_t *data, size_t len, ota_host_download_t *result)
+{
+    flash_host_stats_reset();
+    TEST_ASSERT_EQUAL(ESP_OK, esp_partition_erase_range(part, 0, (len / SPI_FLASH_SEC_SIZE + 1) * SPI_FLASH_SEC_SIZE));
+    ota_host_net(part, data, len, 0, result);
+}
+
+void ota_host_download(const esp_partition_t *part, const uint8_t *data, size_t len, ota_host_download_t *result)
+{
+    esp_ota_handle_t handle;
+
+    flash_host_stats_reset();
+    TEST_ASSERT_EQUAL(ESP_OK, esp_ota_begin(part, OTA_SIZE_UNKNOWN, &handle));
+    ota_host_net(part, data, len, handle, result);
+}
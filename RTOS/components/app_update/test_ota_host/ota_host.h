@@ -0,0 +1,35 @@
+/*
+ * App images for the OTA tests and the download they arrive through
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_partition.h"
+
+// an HTTP response split in TCP segments, the headers take the start of the first one
+#define OTA_HOST_NET_BYTES_S    (64 * 1024)
+#define OTA_HOST_NET_MSS        1460
+#define OTA_HOST_NET_WINDOW     4
+#define OTA_HOST_NET_HEADER     213
+
+typedef struct {
+    uint32_t load_addr;
+    const uint8_t *data;
+    size_t len;                 // multiple of 4
+} ota_host_segment_t;
+
+typedef struct {
+    uint64_t first_us;          // the first chunk is on flash
+    uint64_t total_us;          // the image is written and verified
+    uint64_t flash_us;          // of which the CPU waited on the flash
+} ota_host_download_t;
+
+size_t ota_host_image(uint8_t *buf, const ota_host_segment_t *segs, int count);
+size_t ota_host_image_random(uint8_t *buf, size_t irom_len, size_t dram_len, unsigned int seed);
+size_t ota_host_image_elf(uint8_t *buf, size_t size, const char *path);
+
+// the old esp_ota_begin() and esp_ota_write(), erasing the whole image up front
+void ota_host_download_eager(const esp_partition_t *part, const uint8_t *data, size_t len, ota_host_download_t *result);
+void ota_host_download(const esp_partition_t *part, const uint8_t *data, size_t len, ota_host_download_t *result);
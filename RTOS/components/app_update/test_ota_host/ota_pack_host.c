@@ -0,0 +1,330 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "esp_ota_pack.h"
+#include "bootloader_sha.h"
+#include "ota_pack_host.h"
+
+#define LZSS_HASH_BITS      16
+#define LZSS_CHAIN_MAX      256
+
+typedef struct {
+    uint8_t *out;
+    size_t size;
+    size_t len;
+    uint32_t bits;
+    int bit_count;
+} bit_writer_t;
+
+static void bits_put(bit_writer_t *w, uint32_t value, int count)
+{
+    while (count--) {
+        w->bits = (w->bits << 1) | ((value >> count) & 1);
+        if (++w->bit_count == 8) {
+            if (w->len == w->size)
+                abort();
+            w->out[w->len++] = w->bits;
+            w->bits = 0;
+            w->bit_count = 0;
+        }
+    }
+}
+
+static uint32_t lzss_hash(const uint8_t *p)
+{
+    return ((p[0] << 16 | p[1] << 8 | p[2]) * 2654435761u) >> (32 - LZSS_HASH_BITS);
+}
+
+/*
+ * Greedy LZSS over hash chains of 3 byte prefixes, a back-reference
+ * when it takes fewer bits than the literals it replaces
+ */
+size_t ota_pack_host_lzss(uint8_t *out, size_t out_size, const uint8_t *in, size_t len, int window_bits, int lookahead_bits)
+{
+    const size_t window = (size_t)1 << window_bits, lookahead = (size_t)1 << lookahead_bits;
+    const size_t min_len = (1 + window_bits + lookahead_bits) / 9 + 1;
+    int32_t *head = malloc(sizeof(int32_t) << LZSS_HASH_BITS);
+    int32_t *prev = malloc(sizeof(int32_t) * (len + 1));
+    bit_writer_t w = { out, out_size, 0, 0, 0 };
+    size_t pos = 0, best_len, best_dist, n, max, i;
+    int32_t cand;
+    int chain;
+
+    memset(head, 0xff, sizeof(int32_t) << LZSS_HASH_BITS);
+    while (pos < len) {
+        best_len = 0;
+        best_dist = 0;
+        max = len - pos < lookahead ? len - pos : lookahead;
+
+        if (len - pos >= 3) {
+            for (cand = head[lzss_hash(in + pos)], chain = 0; cand >= 0 && pos - cand <= window && chain < LZSS_CHAIN_MAX;
+                 cand = prev[cand], chain++) {
+                for (n = 0; n < max && in[cand + n] == in[pos + n]; n++)
+                    ;
+                if (n > best_len) {
+                    best_len = n;
+                    best_dist = pos - cand;
+                    if (n == max)
+                        break;
+                }
+            }
+        }
+
+        if (best_len >= min_len) {
+            bits_put(&w, 0, 1);
+            bits_put(&w, best_dist - 1, window_bits);
+            bits_put(&w, best_len - 1, lookahead_bits);
+        } else {
+            best_len = 1;
+            bits_put(&w, 1, 1);
+            bits_put(&w, in[pos], 8);
+        }
+
+        for (i = 0; i < best_len; i++, pos++) {
+            if (len - pos >= 3) {
+                uint32_t h = lzss_hash(in + pos);
+
+                prev[pos] = head[h];
+                head[h] = pos;
+            }
+        }
+    }
+
+    if (w.bit_count)
+        bits_put(&w, 0, 8 - w.bit_count);
+
+    free(head);
+    free(prev);
+    return w.len;
+}
+
+static void pack_header(esp_ota_pack_header_t *header, int flags, const uint8_t *source, size_t source_len,
+                        const uint8_t *image, size_t len, int window_bits, int lookahead_bits)
+{
+    bootloader_sha256_handle_t sha;
+
+    memset(header, 0, sizeof(*header));
+    header->magic = ESP_OTA_PACK_MAGIC;
+    header->flags = flags;
+    header->window_bits = window_bits;
+    header->lookahead_bits = lookahead_bits;
+    header->image_size = len;
+
+    sha = bootloader_sha256_start();
+    bootloader_sha256_data(sha, image, len);
+    bootloader_sha256_finish(sha, header->image_sha256);
+
+    if (flags & ESP_OTA_PACK_FLAG_DELTA) {
+        header->source_size = source_len;
+        sha = bootloader_sha256_start();
+        bootloader_sha256_data(sha, source, source_len);
+        bootloader_sha256_finish(sha, header->source_sha256);
+    }
+}
+
+size_t ota_pack_host_image(uint8_t *out, size_t out_size, const uint8_t *image, size_t len,
+                           int window_bits, int lookahead_bits)
+{
+    if (out_size < sizeof(esp_ota_pack_header_t))
+        abort();
+
+    pack_header((esp_ota_pack_header_t *)out, 0, NULL, 0, image, len, window_bits, lookahead_bits);
+    return sizeof(esp_ota_pack_header_t) + ota_pack_host_lzss(out + sizeof(esp_ota_pack_header_t),
+                                                             out_size - sizeof(esp_ota_pack_header_t),
+                                                             image, len, window_bits, lookahead_bits);
+}
+
+/*
+ * Suffix array of the source by prefix doubling, the empty suffix first
+ */
+static const int32_t *sa_rank;
+static int32_t sa_k, sa_n;
+
+static int sa_cmp(const void *a, const void *b)
+{
+    int32_t i = *(const int32_t *)a, j = *(const int32_t *)b;
+    int32_t ri, rj;
+
+    if (sa_rank[i] != sa_rank[j])
+        return sa_rank[i] < sa_rank[j] ? -1 : 1;
+    ri = i + sa_k <= sa_n ? sa_rank[i + sa_k] : -1;
+    rj = j + sa_k <= sa_n ? sa_rank[j + sa_k] : -1;
+    return ri < rj ? -1 : ri > rj;
+}
+
+static int32_t *suffix_array(const uint8_t *s, int32_t n)
+{
+    int32_t *sa = malloc(sizeof(int32_t) * (n + 1));
+    int32_t *rank = malloc(sizeof(int32_t) * (n + 1));
+    int32_t *tmp = malloc(sizeof(int32_t) * (n + 1));
+    int32_t i;
+
+    for (i = 0; i <= n; i++) {
+        sa[i] = i;
+        rank[i] = i < n ? s[i] + 1 : 0;
+    }
+
+    sa_rank = rank;
+    sa_n = n;
+    for (sa_k = 1; ; sa_k <<= 1) {
+        qsort(sa, n + 1, sizeof(int32_t), sa_cmp);
+        tmp[sa[0]] = 0;
+        for (i = 1; i <= n; i++)
+            tmp[sa[i]] = tmp[sa[i - 1]] + (sa_cmp(&sa[i - 1], &sa[i]) < 0);
+        memcpy(rank, tmp, sizeof(int32_t) * (n + 1));
+        if (rank[sa[n]] == n)
+            break;
+    }
+
+    free(rank);
+    free(tmp);
+    return sa;
+}
+
+static size_t match_len(const uint8_t *a, size_t a_len, const uint8_t *b, size_t b_len)
+{
+    size_t i;
+
+    for (i = 0; i < a_len && i < b_len && a[i] == b[i]; i++)
+        ;
+    return i;
+}
+
+static size_t sa_search(const int32_t *sa, const uint8_t *old, size_t old_len, const uint8_t *new, size_t new_len,
+                        size_t st, size_t en, size_t *pos)
+{
+    size_t x, y, n;
+
+    while (en - st >= 2) {
+        x = st + (en - st) / 2;
+        n = old_len - sa[x] < new_len ? old_len - sa[x] : new_len;
+        if (memcmp(old + sa[x], new, n) < 0)
+            st = x;
+        else
+            en = x;
+    }
+
+    x = match_len(old + sa[st], old_len - sa[st], new, new_len);
+    y = match_len(old + sa[en], old_len - sa[en], new, new_len);
+    *pos = x > y ? sa[st] : sa[en];
+    return x > y ? x : y;
+}
+
+static size_t varint_put(uint8_t *out, uint32_t value)
+{
+    size_t len = 0;
+
+    while (value >= 0x80) {
+        out[len++] = value | 0x80;
+        value >>= 7;
+    }
+    out[len++] = value;
+    return len;
+}
+
+/*
+ * bsdiff: approximate matches against the source, where only the bytes
+ * the new build changed, the addresses that moved, differ. Their difference
+ * is mostly zeroes that LZSS then takes
+ */
+static size_t delta_records(uint8_t *out, const uint8_t *old, size_t old_len, const uint8_t *new, size_t new_len)
+{
+    int32_t *sa = suffix_array(old, old_len);
+    size_t scan = 0, len = 0, pos = 0, last_scan = 0, last_pos = 0, out_len = 0;
+    ssize_t last_offset = 0, old_score, s, sf, sb, ss, lenf, lenb, lens, overlap, i, scsc, extra;
+    int32_t seek;
+
+    while (scan < new_len) {
+        old_score = 0;
+        for (scsc = scan += len; scan < new_len; scan++) {
+            len = sa_search(sa, old, old_len, new + scan, new_len - scan, 0, old_len, &pos);
+            for (; scsc < (ssize_t)(scan + len); scsc++)
+                if (scsc + last_offset < (ssize_t)old_len && old[scsc + last_offset] == new[scsc])
+                    old_score++;
+            if ((len == (size_t)old_score && len != 0) || (ssize_t)len > old_score + 8)
+                break;
+            if (scan + last_offset < old_len && old[scan + last_offset] == new[scan])
+                old_score--;
+        }
+
+        if (len == (size_t)old_score && scan != new_len)
+            continue;
+
+        // extend the last match forwards and this one backwards while they are mostly equal
+        for (s = 0, sf = 0, lenf = 0, i = 0; last_scan + i < scan && last_pos + i < old_len; ) {
+            if (old[last_pos + i] == new[last_scan + i])
+                s++;
+            i++;
+            if (s * 2 - i > sf * 2 - lenf) {
+                sf = s;
+                lenf = i;
+            }
+        }
+
+        lenb = 0;
+        if (scan < new_len) {
+            for (s = 0, sb = 0, i = 1; (ssize_t)scan >= (ssize_t)last_scan + i && (ssize_t)pos >= i; i++) {
+                if (old[pos - i] == new[scan - i])
+                    s++;
+                if (s * 2 - i > sb * 2 - lenb) {
+                    sb = s;
+                    lenb = i;
+                }
+            }
+        }
+
+        if ((ssize_t)last_scan + lenf > (ssize_t)scan - lenb) {
+            overlap = (last_scan + lenf) - (scan - lenb);
+            for (s = 0, ss = 0, lens = 0, i = 0; i < overlap; i++) {
+                if (new[last_scan + lenf - overlap + i] == old[last_pos + lenf - overlap + i])
+                    s++;
+                if (new[scan - lenb + i] == old[pos - lenb + i])
+                    s--;
+                if (s > ss) {
+                    ss = s;
+                    lens = i + 1;
+                }
+            }
+            lenf += lens - overlap;
+            lenb -= lens;
+        }
+
+        extra = (scan - lenb) - (last_scan + lenf);
+        seek = (pos - lenb) - (last_pos + lenf);
+        out_len += varint_put(out + out_len, lenf);
+        out_len += varint_put(out + out_len, extra);
+        out_len += varint_put(out + out_len, ((uint32_t)seek << 1) ^ (uint32_t)(seek >> 31));
+        for (i = 0; i < lenf; i++)
+            out[out_len++] = new[last_scan + i] - old[last_pos + i];
+        memcpy(out + out_len, new + last_scan + lenf, extra);
+        out_len += extra;
+
+        last_scan = scan - lenb;
+        last_pos = pos - lenb;
+        last_offset = pos - scan;
+    }
+
+    free(sa);
+    return out_len;
+}
+
+size_t ota_pack_host_delta(uint8_t *out, size_t out_size, const uint8_t *source, size_t source_len,
+                           const uint8_t *image, size_t len, int window_bits, int lookahead_bits)
+{
+    // a record per scanned byte at worst, 3 varints and the byte
+    uint8_t *records = malloc((len + 1) * (3 * 5 + 1));
+    size_t records_len, packed_len;
+
+    if (records == NULL || out_size < sizeof(esp_ota_pack_header_t))
+        abort();
+
+    pack_header((esp_ota_pack_header_t *)out, ESP_OTA_PACK_FLAG_DELTA, source, source_len, image, len,
+                window_bits, lookahead_bits);
+    records_len = delta_records(records, source, source_len, image, len);
+    packed_len = ota_pack_host_lzss(out + sizeof(esp_ota_pack_header_t), out_size - sizeof(esp_ota_pack_header_t),
+                                    records, records_len, window_bits, lookahead_bits);
+
+    free(records);
+    return sizeof(esp_ota_pack_header_t) + packed_len;
+}
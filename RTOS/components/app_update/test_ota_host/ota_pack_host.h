@@ -0,0 +1,14 @@
+/*
+ * Encoder of the packed OTA images of esp_ota_pack.h
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// the encoders abort when the packed image does not fit in out_size bytes
+size_t ota_pack_host_lzss(uint8_t *out, size_t out_size, const uint8_t *in, size_t len, int window_bits, int lookahead_bits);
+size_t ota_pack_host_image(uint8_t *out, size_t out_size, const uint8_t *image, size_t len,
+                           int window_bits, int lookahead_bits);
+size_t ota_pack_host_delta(uint8_t *out, size_t out_size, const uint8_t *source, size_t source_len,
+                           const uint8_t *image, size_t len, int window_bits, int lookahead_bits);
@@ -0,0 +1,10 @@
+/*
+ * Host stand-in for the project configuration of an ESP8266 app
+ */
+#pragma once
+
+#define CONFIG_TARGET_PLATFORM_ESP8266 1
+#define CONFIG_PARTITION_TABLE_OFFSET 0x8000
+#define CONFIG_ENABLE_BOOT_CHECK_SUM 1
+#define CONFIG_BOOTLOADER_VERIFIED_IMAGE_CACHE 1
+#define CONFIG_APP_UPDATE_PACKED_IMAGE 1
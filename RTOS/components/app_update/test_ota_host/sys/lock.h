@@ -0,0 +1,9 @@
+/*
+ * Host stand-in for the newlib locks, the tests run on one thread
+ */
+#pragma once
+
+typedef int _lock_t;
+
+#define _lock_acquire(lock) ((void) (lock))
+#define _lock_release(lock) ((void) (lock))
@@ -0,0 +1,201 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "unity.h"
+#include "esp_ota_ops.h"
+#include "esp_image_format.h"
+#include "flash_host.h"
+#include "ota_host.h"
+
+#define TEST_IMAGE_MAX      (FLASH_HOST_OTA_SIZE + SPI_FLASH_SEC_SIZE)
+#define TEST_OTA_DATA       0xd000
+
+static uint8_t image_v1[TEST_IMAGE_MAX], image_v2[TEST_IMAGE_MAX], image[TEST_IMAGE_MAX];
+static size_t len_v1, len_v2;
+
+static const esp_partition_pos_t ota_data = { TEST_OTA_DATA, 2 * SPI_FLASH_SEC_SIZE };
+static const esp_partition_pos_t ota_0 = { FLASH_HOST_OTA_0, FLASH_HOST_OTA_SIZE };
+static const esp_partition_pos_t ota_1 = { FLASH_HOST_OTA_1, FLASH_HOST_OTA_SIZE };
+
+static double test_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// ota_0 holds v1, ota_data is blank and boots it
+static void test_verified_init(void)
+{
+    if (!len_v1) {
+        len_v1 = ota_host_image_elf(image_v1, TEST_IMAGE_MAX, "app_v1.elf");
+        len_v2 = ota_host_image_elf(image_v2, TEST_IMAGE_MAX, "app_v2.elf");
+    }
+
+    flash_host_reset();
+    flash_host_load(FLASH_HOST_OTA_0, image_v1, len_v1);
+    flash_host_stats_reset();
+}
+
+static const esp_image_verified_t *test_record(int sec, int index)
+{
+    return (const esp_image_verified_t *)flash_host_data(TEST_OTA_DATA + sec * SPI_FLASH_SEC_SIZE +
+                                                         ESP_IMAGE_VERIFIED_AREA + index * sizeof(esp_image_verified_t));
+}
+
+// flash time of one boot check
+static uint64_t test_boot(const esp_partition_pos_t *part, esp_image_metadata_t *data, esp_err_t expect)
+{
+    flash_host_stats_reset();
+    TEST_ASSERT_EQUAL(expect, esp_image_load_verified(ESP_IMAGE_VERIFY, part, &ota_data, data));
+    return flash_host_stats()->busy_us;
+}
+
+void test_image_verified_boot(void)
+{
+    esp_image_metadata_t full, data;
+    uint64_t load_us, full_us, fast_us;
+
+    test_verified_init();
+    TEST_ASSERT_EQUAL(ESP_OK, esp_image_load(ESP_IMAGE_VERIFY, &ota_0, &full));
+    load_us = flash_host_stats()->busy_us;
+
+    // first boot: the whole image, then a record in the first sector, no selection entry is valid yet
+    full_us = test_boot(&ota_0, &data, ESP_OK);
+    TEST_ASSERT_EQUAL_MEMORY(&full, &data, sizeof(data));
+    TEST_ASSERT_EQUAL_HEX32(ESP_IMAGE_VERIFIED_MAGIC, test_record(0, 0)->magic);
+    TEST_ASSERT_EQUAL_HEX32(FLASH_HOST_OTA_0, test_record(0, 0)->offset);
+    TEST_ASSERT_EQUAL(full.image_len, test_record(0, 0)->image_len);
+    TEST_ASSERT_EQUAL(0, flash_host_stats()->bad_writes);
+
+    // next boots: headers only, the same metadata, no more records
+    fast_us = test_boot(&ota_0, &data, ESP_OK);
+    TEST_ASSERT_EQUAL_MEMORY(&full, &data, sizeof(data));
+    TEST_ASSERT_TRUE(fast_us * 10 < full_us);
+    TEST_ASSERT_EQUAL(0, flash_host_stats()->writes);
+    TEST_ASSERT_EQUAL_HEX32(UINT32_MAX, test_record(0, 1)->magic);
+
+    // no OTA data partition, no record: esp_image_load() itself
+    const esp_partition_pos_t none = { 0, 0 };
+
+    flash_host_stats_reset();
+    TEST_ASSERT_EQUAL(ESP_OK, esp_image_load_verified(ESP_IMAGE_VERIFY, &ota_0, &none, &data));
+    TEST_ASSERT_EQUAL(load_us, flash_host_stats()->busy_us);
+    TEST_ASSERT_TRUE(full_us > load_us);
+}
+
+void test_image_verified_changed(void)
+{
+    esp_image_metadata_t data;
+    uint64_t full_us;
+    uint32_t torn[sizeof(esp_image_verified_t) / 4];
+
+    test_verified_init();
+
+    // a record cut short by a reset is skipped
+    memset(torn, 0xff, sizeof(torn));
+    torn[2] = 0x1234;
+    flash_host_load(TEST_OTA_DATA + ESP_IMAGE_VERIFIED_AREA, torn, sizeof(torn));
+
+    full_us = test_boot(&ota_0, &data, ESP_OK);
+    TEST_ASSERT_EQUAL_HEX32(ESP_IMAGE_VERIFIED_MAGIC, test_record(0, 1)->magic);
+
+    // another image written over it without esp_ota_begin(): its headers and checksum differ
+    flash_host_load(FLASH_HOST_OTA_0, image_v2, len_v2);
+    TEST_ASSERT_TRUE(test_boot(&ota_0, &data, ESP_OK) * 2 > full_us);
+    TEST_ASSERT_EQUAL_HEX32(0, test_record(0, 1)->magic);
+    TEST_ASSERT_EQUAL_HEX32(ESP_IMAGE_VERIFIED_MAGIC, test_record(0, 2)->magic);
+    TEST_ASSERT_TRUE(test_boot(&ota_0, &data, ESP_OK) * 10 < full_us);
+
+    // a broken image loses its record and fails
+    flash_host_fill(FLASH_HOST_OTA_0 + len_v2 - 1, 1, 0);
+    test_boot(&ota_0, &data, ESP_ERR_IMAGE_INVALID);
+    TEST_ASSERT_EQUAL_HEX32(0, test_record(0, 2)->magic);
+    TEST_ASSERT_EQUAL_HEX32(UINT32_MAX, test_record(0, 3)->magic);
+    TEST_ASSERT_EQUAL(0, flash_host_stats()->bad_writes);
+}
+
+void test_image_verified_ota(void)
+{
+    const esp_partition_t *part;
+    const esp_ota_select_entry_t *s0, *s1;
+    esp_image_metadata_t data;
+    esp_ota_handle_t handle;
+    uint64_t full_us;
+    int sec;
+
+    test_verified_init();
+    // both partitions were booted before
+    flash_host_load(FLASH_HOST_OTA_1, image_v2, len_v2);
+    test_boot(&ota_0, &data, ESP_OK);
+    test_boot(&ota_1, &data, ESP_OK);
+    TEST_ASSERT_EQUAL_HEX32(FLASH_HOST_OTA_1, test_record(0, 1)->offset);
+
+    // starting the update drops the record of ota_1 only
+    part = esp_ota_get_next_update_partition(NULL);
+    TEST_ASSERT_EQUAL_HEX32(FLASH_HOST_OTA_1, part->address);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_ota_begin(part, OTA_SIZE_UNKNOWN, &handle));
+    TEST_ASSERT_EQUAL_HEX32(ESP_IMAGE_VERIFIED_MAGIC, test_record(0, 0)->magic);
+    TEST_ASSERT_EQUAL_HEX32(0, test_record(0, 1)->magic);
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_ota_write(handle, image_v1, len_v1));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_ota_end(handle));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_ota_set_boot_partition(part));
+
+    // the first boot checks all of it, the record goes after the selection entry that boots
+    full_us = test_boot(&ota_1, &data, ESP_OK);
+    s0 = (const esp_ota_select_entry_t *)flash_host_data(TEST_OTA_DATA);
+    s1 = (const esp_ota_select_entry_t *)flash_host_data(TEST_OTA_DATA + SPI_FLASH_SEC_SIZE);
+    sec = (s1->ota_seq != UINT32_MAX && (s0->ota_seq == UINT32_MAX || s1->ota_seq > s0->ota_seq)) ? 1 : 0;
+    TEST_ASSERT_EQUAL_HEX32(FLASH_HOST_OTA_1, test_record(sec, 0)->offset);
+    TEST_ASSERT_EQUAL_HEX32(ESP_IMAGE_VERIFIED_MAGIC, test_record(sec, 0)->magic);
+    TEST_ASSERT_TRUE(test_boot(&ota_1, &data, ESP_OK) * 10 < full_us);
+
+    // an update cut short: the half written image is never taken for the old one
+    part = esp_ota_get_next_update_partition(NULL);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_ota_begin(part, OTA_SIZE_UNKNOWN, &handle));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_ota_write(handle, image_v2, len_v2 / 2));
+    TEST_ASSERT_NOT_EQUAL(ESP_OK, esp_ota_end(handle));
+    test_boot((part->address == FLASH_HOST_OTA_0) ? &ota_0 : &ota_1, &data, ESP_ERR_IMAGE_INVALID);
+}
+
+void test_image_verified_benchmark(void)
+{
+    static const struct {
+        const char *name;
+        size_t irom_len;
+        size_t dram_len;
+    } images[] = {
+        { "app_v1.elf", 0, 0 },
+        { "256 KB", 240 * 1024, 16 * 1024 },
+        { "896 KB", 864 * 1024, 32 * 1024 },
+    };
+    esp_image_metadata_t data;
+    size_t len;
+
+    for (int i = 0; i < sizeof(images) / sizeof(images[0]); i++) {
+        uint64_t full_us, fast_us;
+        double t0, full_ns, fast_ns;
+
+        if (images[i].irom_len)
+            len = ota_host_image_random(image, images[i].irom_len, images[i].dram_len, i);
+        else
+            len = ota_host_image_elf(image, TEST_IMAGE_MAX, images[i].name);
+
+        flash_host_reset();
+        flash_host_load(FLASH_HOST_OTA_0, image, len);
+
+        t0 = test_now_ns();
+        full_us = test_boot(&ota_0, &data, ESP_OK);
+        full_ns = test_now_ns() - t0;
+        t0 = test_now_ns();
+        fast_us = test_boot(&ota_0, &data, ESP_OK);
+        fast_ns = test_now_ns() - t0;
+
+        printf("boot check %-10s %7zu B: whole image %7.1f ms flash %8.1f us host, recorded %5.2f ms flash %6.1f us host\n",
+               images[i].name, len, full_us / 1e3, full_ns / 1e3, fast_us / 1e3, fast_ns / 1e3);
+        TEST_ASSERT_TRUE(fast_us * 10 < full_us);
+    }
+}
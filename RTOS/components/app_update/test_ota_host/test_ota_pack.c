@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "unity.h"
+#include "esp_ota_ops.h"
+#include "esp_ota_pack.h"
+#include "flash_host.h"
+#include "ota_host.h"
+#include "ota_pack_host.h"
+
+#define TEST_IMAGE_MAX      (512 * 1024)
+#define TEST_PACKED_MAX     (2 * TEST_IMAGE_MAX)
+#define TEST_WINDOW_BITS    11
+#define TEST_LOOKAHEAD_BITS 5
+
+static uint8_t image_v1[TEST_IMAGE_MAX], image_v2[TEST_IMAGE_MAX];
+static uint8_t packed[TEST_PACKED_MAX];
+static size_t len_v1, len_v2;
+
+static double test_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// ota_0 runs v1, the update goes to ota_1
+static const esp_partition_t *test_pack_init(void)
+{
+    const esp_partition_t *part;
+
+    if (!len_v1) {
+        len_v1 = ota_host_image_elf(image_v1, TEST_IMAGE_MAX, "app_v1.elf");
+        len_v2 = ota_host_image_elf(image_v2, TEST_IMAGE_MAX, "app_v2.elf");
+    }
+
+    flash_host_reset();
+    flash_host_load(FLASH_HOST_OTA_0, image_v1, len_v1);
+    flash_host_fill(FLASH_HOST_OTA_1, FLASH_HOST_OTA_SIZE, 0x5a);
+    part = esp_ota_get_next_update_partition(NULL);
+    TEST_ASSERT_NOT_NULL(part);
+    TEST_ASSERT_EQUAL_HEX32(FLASH_HOST_OTA_1, part->address);
+    flash_host_stats_reset();
+    return part;
+}
+
+// random chunks, single bytes through the header
+static esp_err_t test_pack_write(const esp_partition_t *part, const uint8_t *data, size_t len, unsigned int seed)
+{
+    esp_ota_handle_t handle;
+    esp_err_t ret = ESP_OK;
+    size_t pos, chunk;
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_ota_begin(part, OTA_SIZE_UNKNOWN, &handle));
+
+    srand(seed);
+    for (pos = 0; pos < len && ret == ESP_OK; pos += chunk) {
+        chunk = pos < sizeof(esp_ota_pack_header_t) + 8 ? 1 : 1 + rand() % 2000;
+        if (chunk > len - pos)
+            chunk = len - pos;
+        ret = esp_ota_write(handle, data + pos, chunk);
+    }
+
+    if (ret != ESP_OK) {
+        esp_ota_end(handle);
+        return ret;
+    }
+    return esp_ota_end(handle);
+}
+
+void test_ota_pack_image(void)
+{
+    const esp_partition_t *part = test_pack_init();
+    static const int params[][2] = { { 4, 3 }, { 8, 4 }, { 10, 5 }, { 12, 6 }, { 12, 11 } };
+    size_t len;
+    int i;
+
+    for (i = 0; i < sizeof(params) / sizeof(params[0]); i++) {
+        flash_host_fill(FLASH_HOST_OTA_1, FLASH_HOST_OTA_SIZE, 0x5a);
+        len = ota_pack_host_image(packed, TEST_PACKED_MAX, image_v2, len_v2, params[i][0], params[i][1]);
+        TEST_ASSERT_EQUAL(ESP_OK, test_pack_write(part, packed, len, i));
+        TEST_ASSERT_EQUAL_MEMORY(image_v2, flash_host_data(FLASH_HOST_OTA_1), len_v2);
+    }
+    TEST_ASSERT_EQUAL(0, flash_host_stats()->bad_writes);
+}
+
+void test_ota_pack_delta(void)
+{
+    const esp_partition_t *part = test_pack_init();
+    const flash_host_stats_t *stats = flash_host_stats();
+    size_t len;
+
+    len = ota_pack_host_delta(packed, TEST_PACKED_MAX, image_v1, len_v1, image_v2, len_v2,
+                              TEST_WINDOW_BITS, TEST_LOOKAHEAD_BITS);
+    TEST_ASSERT_EQUAL(ESP_OK, test_pack_write(part, packed, len, 1));
+    TEST_ASSERT_EQUAL_MEMORY(image_v2, flash_host_data(FLASH_HOST_OTA_1), len_v2);
+
+    // sector by sector as for a plain image
+    TEST_ASSERT_EQUAL((len_v2 + SPI_FLASH_SEC_SIZE - 1) / SPI_FLASH_SEC_SIZE, stats->erases);
+    TEST_ASSERT_EQUAL(0, stats->unaligned);
+    TEST_ASSERT_EQUAL(0, stats->bad_writes);
+
+    // the running image is left as it was
+    TEST_ASSERT_EQUAL_MEMORY(image_v1, flash_host_data(FLASH_HOST_OTA_0), len_v1);
+
+    // from v2 back to v1, v2 running
+    flash_host_load(FLASH_HOST_OTA_0, image_v2, len_v2);
+    flash_host_fill(FLASH_HOST_OTA_1, FLASH_HOST_OTA_SIZE, 0x5a);
+    len = ota_pack_host_delta(packed, TEST_PACKED_MAX, image_v2, len_v2, image_v1, len_v1,
+                              TEST_WINDOW_BITS, TEST_LOOKAHEAD_BITS);
+    TEST_ASSERT_EQUAL(ESP_OK, test_pack_write(part, packed, len, 2));
+    TEST_ASSERT_EQUAL_MEMORY(image_v1, flash_host_data(FLASH_HOST_OTA_1), len_v1);
+}
+
+void test_ota_pack_wrong_source(void)
+{
+    const esp_partition_t *part = test_pack_init();
+    size_t len;
+
+    len = ota_pack_host_delta(packed, TEST_PACKED_MAX, image_v1, len_v1, image_v2, len_v2,
+                              TEST_WINDOW_BITS, TEST_LOOKAHEAD_BITS);
+
+    // the running image is v2 already, the delta is refused before anything is erased
+    flash_host_load(FLASH_HOST_OTA_0, image_v2, len_v2);
+    TEST_ASSERT_EQUAL(ESP_ERR_OTA_VALIDATE_FAILED, test_pack_write(part, packed, len, 1));
+    TEST_ASSERT_EQUAL(0, flash_host_stats()->erases);
+}
+
+void test_ota_pack_corrupt(void)
+{
+    const esp_partition_t *part = test_pack_init();
+    esp_ota_pack_header_t *header = (esp_ota_pack_header_t *)packed;
+    size_t len;
+
+    len = ota_pack_host_image(packed, TEST_PACKED_MAX, image_v2, len_v2, TEST_WINDOW_BITS, TEST_LOOKAHEAD_BITS);
+
+    // cut short
+    TEST_ASSERT_EQUAL(ESP_ERR_OTA_VALIDATE_FAILED, test_pack_write(part, packed, len / 2, 1));
+    TEST_ASSERT_EQUAL(ESP_ERR_OTA_VALIDATE_FAILED, test_pack_write(part, packed, sizeof(*header) / 2, 1));
+
+    // a flipped bit decodes to something else
+    packed[len / 2] ^= 0x08;
+    TEST_ASSERT_EQUAL(ESP_ERR_OTA_VALIDATE_FAILED, test_pack_write(part, packed, len, 1));
+    packed[len / 2] ^= 0x08;
+
+    header->window_bits = ESP_OTA_PACK_WINDOW_BITS_MAX + 1;
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_SUPPORTED, test_pack_write(part, packed, len, 1));
+    header->window_bits = TEST_WINDOW_BITS;
+
+    header->magic ^= 0x100;
+    TEST_ASSERT_EQUAL(ESP_ERR_OTA_VALIDATE_FAILED, test_pack_write(part, packed, len, 1));
+    header->magic ^= 0x100;
+
+    TEST_ASSERT_EQUAL(ESP_OK, test_pack_write(part, packed, len, 1));
+}
+
+void test_ota_pack_benchmark(void)
+{
+    const esp_partition_t *part = test_pack_init();
+    ota_host_download_t raw, lz, delta;
+    size_t lz_len, delta_len;
+    double start, decode_ns;
+
+    ota_host_download(part, image_v2, len_v2, &raw);
+
+    lz_len = ota_pack_host_image(packed, TEST_PACKED_MAX, image_v2, len_v2, TEST_WINDOW_BITS, TEST_LOOKAHEAD_BITS);
+    ota_host_download(part, packed, lz_len, &lz);
+    TEST_ASSERT_EQUAL_MEMORY(image_v2, flash_host_data(FLASH_HOST_OTA_1), len_v2);
+
+    delta_len = ota_pack_host_delta(packed, TEST_PACKED_MAX, image_v1, len_v1, image_v2, len_v2,
+                                    TEST_WINDOW_BITS, TEST_LOOKAHEAD_BITS);
+    start = test_now_ns();
+    ota_host_download(part, packed, delta_len, &delta);
+    decode_ns = test_now_ns() - start;
+    TEST_ASSERT_EQUAL_MEMORY(image_v2, flash_host_data(FLASH_HOST_OTA_1), len_v2);
+
+    TEST_ASSERT_LESS_THAN(len_v2, lz_len);
+    TEST_ASSERT_LESS_THAN(lz_len / 4, delta_len);
+    // the flash takes as long either way, the radio is what gets shorter
+    TEST_ASSERT_LESS_THAN((raw.total_us - raw.flash_us) / 4, delta.total_us - delta.flash_us);
+
+    printf("ota %u byte image at %u KB/s, window %d: plain %.2f s; lzss %u bytes %.2f s; "
+           "delta %u bytes %.2f s, flash %.2f s, host decode %.1f ms\n",
+           (unsigned int)len_v2, OTA_HOST_NET_BYTES_S / 1024, 1 << TEST_WINDOW_BITS,
+           raw.total_us / 1e6, (unsigned int)lz_len, lz.total_us / 1e6,
+           (unsigned int)delta_len, delta.total_us / 1e6, delta.flash_us / 1e6, decode_ns / 1e6);
+}
@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "unity.h"
+#include "esp_ota_ops.h"
+#include "flash_host.h"
+#include "ota_host.h"
+
+#define TEST_IMAGE_MAX      (FLASH_HOST_OTA_SIZE + SPI_FLASH_SEC_SIZE)
+
+static uint8_t image[TEST_IMAGE_MAX];
+
+static const esp_partition_t *test_ota_init(void)
+{
+    const esp_partition_t *part;
+
+    flash_host_reset();
+    // the update partition holds the previous firmware
+    flash_host_fill(FLASH_HOST_OTA_1, FLASH_HOST_OTA_SIZE, 0x5a);
+    part = esp_ota_get_next_update_partition(NULL);
+    TEST_ASSERT_NOT_NULL(part);
+    TEST_ASSERT_EQUAL_HEX32(FLASH_HOST_OTA_1, part->address);
+    flash_host_stats_reset();
+    return part;
+}
+
+void test_ota_write_round_trip(void)
+{
+    const esp_partition_t *part = test_ota_init();
+    const flash_host_stats_t *stats = flash_host_stats();
+    esp_ota_handle_t handle;
+    size_t len, pos, chunk;
+
+    len = ota_host_image_random(image, 150000, 30000, 1);
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_ota_begin(part, OTA_SIZE_UNKNOWN, &handle));
+    TEST_ASSERT_EQUAL(0, stats->erases);
+
+    srand(2);
+    for (pos = 0; pos < len; pos += chunk) {
+        chunk = 1 + rand() % 3000;
+        if (chunk > len - pos)
+            chunk = len - pos;
+        TEST_ASSERT_EQUAL(ESP_OK, esp_ota_write(handle, image + pos, chunk));
+        // one sector erased ahead of the data at most
+        TEST_ASSERT_EQUAL((pos + chunk + SPI_FLASH_SEC_SIZE - 1) / SPI_FLASH_SEC_SIZE, stats->erases);
+    }
+    TEST_ASSERT_EQUAL(ESP_OK, esp_ota_end(handle));
+
+    TEST_ASSERT_EQUAL_MEMORY(image, flash_host_data(FLASH_HOST_OTA_1), len);
+    TEST_ASSERT_EQUAL(0, stats->bad_writes);
+    TEST_ASSERT_EQUAL((len + SPI_FLASH_SEC_SIZE - 1) / SPI_FLASH_SEC_SIZE, stats->erases);
+
+    // whole sectors, then the padded tail, never through the bounce buffer
+    TEST_ASSERT_EQUAL(len / SPI_FLASH_SEC_SIZE, stats->sector_writes);
+    TEST_ASSERT_EQUAL(len / SPI_FLASH_SEC_SIZE + 1, stats->writes);
+    TEST_ASSERT_EQUAL(0, stats->unaligned);
+
+    // the rest of the old firmware is left alone
+    TEST_ASSERT_EQUAL_HEX8(0x5a, flash_host_data(FLASH_HOST_OTA_1)[stats->erases * SPI_FLASH_SEC_SIZE]);
+}
+
+void test_ota_write_sector_boundary(void)
+{
+    const esp_partition_t *part = test_ota_init();
+    const flash_host_stats_t *stats = flash_host_stats();
+    esp_ota_handle_t handle;
+    size_t len;
+
+    // 4 sectors exactly, nothing is left to flush at the end
+    len = ota_host_image_random(image, 4 * SPI_FLASH_SEC_SIZE - 48, 16, 3);
+    TEST_ASSERT_EQUAL(4 * SPI_FLASH_SEC_SIZE, len);
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_ota_begin(part, len, &handle));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_ota_write(handle, image, len));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_ota_end(handle));
+
+    TEST_ASSERT_EQUAL_MEMORY(image, flash_host_data(FLASH_HOST_OTA_1), len);
+    TEST_ASSERT_EQUAL(4, stats->erases);
+    TEST_ASSERT_EQUAL(4, stats->writes);
+    TEST_ASSERT_EQUAL(4, stats->sector_writes);
+}
+
+void test_ota_write_too_big(void)
+{
+    const esp_partition_t *part = test_ota_init();
+    esp_ota_handle_t handle;
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, esp_ota_begin(part, FLASH_HOST_OTA_SIZE + 1, &handle));
+
+    memset(image, 0xe9, TEST_IMAGE_MAX);
+    TEST_ASSERT_EQUAL(ESP_OK, esp_ota_begin(part, OTA_SIZE_UNKNOWN, &handle));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_ota_write(handle, image, FLASH_HOST_OTA_SIZE));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, esp_ota_write(handle, image, 1));
+    TEST_ASSERT_EQUAL(ESP_ERR_OTA_VALIDATE_FAILED, esp_ota_end(handle));
+
+    // the next partition is untouched
+    TEST_ASSERT_EQUAL(FLASH_HOST_OTA_SIZE / SPI_FLASH_SEC_SIZE, flash_host_stats()->erases);
+    TEST_ASSERT_EQUAL(FLASH_HOST_OTA_1 + FLASH_HOST_OTA_SIZE, FLASH_HOST_SIZE);
+}
+
+void test_ota_write_resume(void)
+{
+    const esp_partition_t *part = test_ota_init();
+    const flash_host_stats_t *stats = flash_host_stats();
+    esp_ota_handle_t handle;
+    size_t len, cut = 5 * SPI_FLASH_SEC_SIZE + 1000;
+
+    len = ota_host_image_random(image, 60000, 8000, 6);
+
+    // nothing to resume yet
+    TEST_ASSERT_EQUAL(ESP_ERR_OTA_VALIDATE_FAILED, esp_ota_begin_at(part, SPI_FLASH_SEC_SIZE, &handle));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, esp_ota_begin_at(part, 0, &handle));
+
+    // the connection drops in the middle of the sixth sector, the handle is dropped with it
+    TEST_ASSERT_EQUAL(ESP_OK, esp_ota_begin(part, OTA_SIZE_UNKNOWN, &handle));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_ota_write(handle, image, cut));
+    TEST_ASSERT_EQUAL(ESP_ERR_OTA_VALIDATE_FAILED, esp_ota_end(handle));
+    TEST_ASSERT_EQUAL_MEMORY(image, flash_host_data(FLASH_HOST_OTA_1), 5 * SPI_FLASH_SEC_SIZE);
+
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, esp_ota_begin_at(part, 5 * SPI_FLASH_SEC_SIZE + 16, &handle));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_SIZE, esp_ota_begin_at(part, FLASH_HOST_OTA_SIZE, &handle));
+
+    flash_host_stats_reset();
+    TEST_ASSERT_EQUAL(ESP_OK, esp_ota_begin_at(part, 5 * SPI_FLASH_SEC_SIZE, &handle));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_ota_write(handle, image + 5 * SPI_FLASH_SEC_SIZE, len - 5 * SPI_FLASH_SEC_SIZE));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_ota_end(handle));
+
+    TEST_ASSERT_EQUAL_MEMORY(image, flash_host_data(FLASH_HOST_OTA_1), len);
+    // the sectors already there are neither erased nor written again
+    TEST_ASSERT_EQUAL((len + SPI_FLASH_SEC_SIZE - 1) / SPI_FLASH_SEC_SIZE - 5, stats->erases);
+    TEST_ASSERT_EQUAL(0, stats->bad_writes);
+}
+
+void test_ota_write_corrupt(void)
+{
+    const esp_partition_t *part = test_ota_init();
+    esp_ota_handle_t handle;
+    size_t len;
+
+    len = ota_host_image_random(image, 20000, 4000, 4);
+
+    TEST_ASSERT_EQUAL(ESP_OK, esp_ota_begin(part, OTA_SIZE_UNKNOWN, &handle));
+    TEST_ASSERT_EQUAL(ESP_ERR_OTA_VALIDATE_FAILED, esp_ota_write(handle, image + 1, len - 1));
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_ARG, esp_ota_end(handle));
+
+    image[len / 2] ^= 0x10;
+    TEST_ASSERT_EQUAL(ESP_OK, esp_ota_begin(part, OTA_SIZE_UNKNOWN, &handle));
+    TEST_ASSERT_EQUAL(ESP_OK, esp_ota_write(handle, image, len));
+    TEST_ASSERT_EQUAL(ESP_ERR_OTA_VALIDATE_FAILED, esp_ota_end(handle));
+}
+
+void test_ota_write_benchmark(void)
+{
+    const esp_partition_t *part = test_ota_init();
+    ota_host_download_t eager, lazy;
+    size_t len;
+
+    len = ota_host_image_random(image, 360000, 40000, 5);
+
+    ota_host_download_eager(part, image, len, &eager);
+    TEST_ASSERT_EQUAL_MEMORY(image, flash_host_data(FLASH_HOST_OTA_1), len);
+    TEST_ASSERT_NOT_EQUAL(0, flash_host_stats()->unaligned);
+    flash_host_fill(FLASH_HOST_OTA_1, FLASH_HOST_OTA_SIZE, 0x5a);
+    ota_host_download(part, image, len, &lazy);
+    TEST_ASSERT_EQUAL_MEMORY(image, flash_host_data(FLASH_HOST_OTA_1), len);
+    TEST_ASSERT_EQUAL(0, flash_host_stats()->unaligned);
+
+    TEST_ASSERT_LESS_THAN(eager.first_us, lazy.first_us);
+    TEST_ASSERT_LESS_THAN(eager.total_us, lazy.total_us);
+
+    printf("ota %u byte image at %u KB/s: up-front erase first write %.2f s, total %.2f s, flash %.2f s; "
+           "per sector first write %.2f s, total %.2f s, flash %.2f s\n",
+           (unsigned int)len, OTA_HOST_NET_BYTES_S / 1024,
+           eager.first_us / 1e6, eager.total_us / 1e6, eager.flash_us / 1e6,
+           lazy.first_us / 1e6, lazy.total_us / 1e6, lazy.flash_us / 1e6);
+}
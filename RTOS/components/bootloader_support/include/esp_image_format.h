@@ -171,6 +171,42 @@ esp_err_t esp_image_load(esp_image_load_mode_t mode, const esp_partition_pos_t *
  */
 esp_err_t esp_image_verify_bootloader(uint32_t *length);
 
+#ifdef CONFIG_TARGET_PLATFORM_ESP8266
+
+#define ESP_IMAGE_VERIFIED_MAGIC 0x44465256 /* "VRFD" */
+#define ESP_IMAGE_VERIFIED_AREA  0x40       /* Offset of the records in each sector of the OTA data partition */
+
+/* Record of an app image that passed the whole image check, kept in the OTA data partition
+   after the selection entry of a sector. Erasing the sector drops it, so does clearing its magic. */
+typedef struct {
+    uint32_t magic;          /* ESP_IMAGE_VERIFIED_MAGIC, 0 once dropped */
+    uint32_t offset;         /* Partition offset of the image */
+    uint32_t image_len;      /* Length of image on flash, in bytes */
+    uint8_t digest[32];      /* SHA-256 of the image header, the segment headers and the end of the image */
+    uint32_t crc;            /* CRC32 of offset, image_len and digest */
+} esp_image_verified_t;
+
+/**
+ * @brief Verify and (optionally, in bootloader mode) load an app image, skipping the whole
+ * image check when it passed it on an earlier boot.
+ *
+ * When the OTA data partition holds a record for the partition whose length and digest match
+ * the image, only the headers and the checksum and hash at the end of the image are read.
+ * Otherwise the image is checked as by esp_image_load() and, once it passes, a record of it is
+ * written after the selection entry that boots, with bootloader_flash_write().
+ *
+ * @param mode Mode of operation (verify, silent verify, or load).
+ * @param part Partition to load the app from.
+ * @param ota_data OTA data partition holding the records, the check is never skipped if its size is 0.
+ * @param[out] data Pointer to the image metadata structure, filled in as by esp_image_load().
+ *
+ * @return As per esp_image_load().
+ */
+esp_err_t esp_image_load_verified(esp_image_load_mode_t mode, const esp_partition_pos_t *part,
+                                  const esp_partition_pos_t *ota_data, esp_image_metadata_t *data);
+
+#endif
+
 typedef struct {
     uint32_t drom_addr;
     uint32_t drom_load_addr;
@@ -714,14 +714,19 @@ static void log_invalid_app_partition(int index)
 }
 
 /* Return true if a partition has a valid app image that was successfully loaded */
-static bool try_load_partition(const esp_partition_pos_t *partition, esp_image_metadata_t *data)
+static bool try_load_partition(const bootloader_state_t *bs, const esp_partition_pos_t *partition, esp_image_metadata_t *data)
 {
     if (partition->size == 0) {
         ESP_LOGD(TAG, "Can't boot from zero-length partition");
         return false;
     }
 #ifdef BOOTLOADER_BUILD
-    if (esp_image_load(ESP_IMAGE_LOAD, partition, data) == ESP_OK) {
+#ifdef CONFIG_BOOTLOADER_VERIFIED_IMAGE_CACHE
+    esp_err_t err = esp_image_load_verified(ESP_IMAGE_LOAD, partition, &bs->ota_info, data);
+#else
+    esp_err_t err = esp_image_load(ESP_IMAGE_LOAD, partition, data);
+#endif
+    if (err == ESP_OK) {
         ESP_LOGI(TAG, "Loaded app from partition at offset 0x%x",
                  partition->offset);
         return true;
@@ -738,7 +743,7 @@ bool bootloader_utility_load_boot_image(const bootloader_state_t *bs, int start_
     int index = start_index;
     esp_partition_pos_t part;
     if(start_index == TEST_APP_INDEX) {
-        if (try_load_partition(&bs->test, result)) {
+        if (try_load_partition(bs, &bs->test, result)) {
             return true;
         } else {
             ESP_LOGE(TAG, "No bootable test partition in the partition table");
@@ -752,7 +757,7 @@ bool bootloader_utility_load_boot_image(const bootloader_state_t *bs, int start_
             continue;
         }
         ESP_LOGD(TAG, TRY_LOG_FORMAT, index, part.offset, part.size);
-        if (try_load_partition(&part, result)) {
+        if (try_load_partition(bs, &part, result)) {
             return true;
         }
         log_invalid_app_partition(index);
@@ -765,13 +770,13 @@ bool bootloader_utility_load_boot_image(const bootloader_state_t *bs, int start_
             continue;
         }
         ESP_LOGD(TAG, TRY_LOG_FORMAT, index, part.offset, part.size);
-        if (try_load_partition(&part, result)) {
+        if (try_load_partition(bs, &part, result)) {
             return true;
         }
         log_invalid_app_partition(index);
     }
 
-    if (try_load_partition(&bs->test, result)) {
+    if (try_load_partition(bs, &bs->test, result)) {
         ESP_LOGW(TAG, "Falling back to test app as only bootable partition");
         return true;
     }
@@ -586,6 +586,7 @@ static void debug_log_hash(const uint8_t *image_hash, const char *label)
 #ifdef CONFIG_TARGET_PLATFORM_ESP8266
 
 #include <string.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <sys/param.h>
 
@@ -596,6 +597,8 @@ static void debug_log_hash(const uint8_t *image_hash, const char *label)
 #include <bootloader_flash.h>
 #include <bootloader_random.h>
 #include <bootloader_sha.h>
+#include <bootloader_common.h>
+#include "crc.h"
 
 static const char *TAG = "esp_image";
 
@@ -879,14 +882,13 @@ static esp_err_t process_segment(int index, uint32_t flash_addr, esp_image_segme
         FAIL_LOAD("unaligned segment length 0x%x", data_len);
     }
 
-    bool is_mapping = should_map(load_addr);
     do_load = do_load && should_load(load_addr);
 
     if (!silent) {
         ESP_LOGI(TAG, "segment %d: paddr=0x%08x vaddr=0x%08x size=0x%05x (%6d) %s",
                  index, data_addr, load_addr,
                  data_len, data_len,
-                 (do_load)?"load":(is_mapping)?"map":"");
+                 (do_load)?"load":should_map(load_addr)?"map":"");
     }
 
 #ifdef BOOTLOADER_UNPACK_APP
@@ -935,7 +937,7 @@ static esp_err_t process_segment_data(intptr_t load_addr, uint32_t data_addr, ui
 {
     esp_err_t ret = ESP_OK;
 #if defined(CONFIG_ENABLE_BOOT_CHECK_SUM) || defined(CONFIG_ENABLE_BOOT_CHECK_SHA256)
-    const char *src = (const char *)data_addr;
+    const char *src = (const char *)(uintptr_t)data_addr;
 #ifndef BOOTLOADER_BUILD
     uint32_t *pbuf;
 
@@ -1042,6 +1044,209 @@ esp_err_t esp_image_verify_bootloader(uint32_t *length)
     return err;
 }
 
+#ifdef CONFIG_BOOTLOADER_VERIFIED_IMAGE_CACHE
+
+#define VERIFIED_RECORDS ((SPI_FLASH_SEC_SIZE - ESP_IMAGE_VERIFIED_AREA) / sizeof(esp_image_verified_t))
+
+static uint32_t verified_crc(const esp_image_verified_t *rec)
+{
+    return crc32_le(UINT32_MAX, (const uint8_t *)&rec->offset, offsetof(esp_image_verified_t, crc) - offsetof(esp_image_verified_t, offset));
+}
+
+static bool verified_blank(const esp_image_verified_t *rec)
+{
+    const uint32_t *p = (const uint32_t *)rec;
+
+    for (int i = 0; i < sizeof(esp_image_verified_t) / sizeof(uint32_t); i++) {
+        if (p[i] != UINT32_MAX) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static uint32_t verified_addr(const esp_partition_pos_t *ota_data, int sec, int index)
+{
+    return ota_data->offset + sec * SPI_FLASH_SEC_SIZE + ESP_IMAGE_VERIFIED_AREA + index * sizeof(esp_image_verified_t);
+}
+
+/* Address of the record of the image at offset, 0 if there is none */
+static uint32_t verified_find(const esp_partition_pos_t *ota_data, uint32_t offset, esp_image_verified_t *rec)
+{
+    for (int sec = 0; sec < 2; sec++) {
+        for (int i = 0; i < VERIFIED_RECORDS; i++) {
+            uint32_t addr = verified_addr(ota_data, sec, i);
+
+            if (bootloader_flash_read(addr, rec, sizeof(esp_image_verified_t), true) != ESP_OK || verified_blank(rec)) {
+                break;
+            }
+            if (rec->magic == ESP_IMAGE_VERIFIED_MAGIC && rec->offset == offset && rec->crc == verified_crc(rec)) {
+                return addr;
+            }
+        }
+    }
+    return 0;
+}
+
+/* Records go to the sector of the selection entry that boots, the next esp_ota_set_boot_partition() erases the other one */
+static void verified_add(const esp_partition_pos_t *ota_data, esp_image_verified_t *rec)
+{
+    esp_ota_select_entry_t s[2];
+    esp_image_verified_t slot;
+    int sec = 0;
+
+    if (bootloader_flash_read(ota_data->offset, &s[0], sizeof(esp_ota_select_entry_t), true) != ESP_OK
+        || bootloader_flash_read(ota_data->offset + SPI_FLASH_SEC_SIZE, &s[1], sizeof(esp_ota_select_entry_t), true) != ESP_OK) {
+        return;
+    }
+    if (bootloader_common_ota_select_valid(&s[1])
+        && (!bootloader_common_ota_select_valid(&s[0]) || s[1].ota_seq > s[0].ota_seq)) {
+        sec = 1;
+    }
+
+    for (int i = 0; i < VERIFIED_RECORDS; i++) {
+        uint32_t addr = verified_addr(ota_data, sec, i);
+
+        if (bootloader_flash_read(addr, &slot, sizeof(esp_image_verified_t), true) != ESP_OK) {
+            return;
+        }
+        if (verified_blank(&slot)) {
+            bootloader_flash_write(addr, rec, sizeof(esp_image_verified_t), false);
+            return;
+        }
+    }
+    ESP_LOGW(TAG, "no room for the record of image at 0x%x", rec->offset);
+}
+
+/* Drop every record of the image at offset, clearing bits needs no erase */
+static void verified_drop(const esp_partition_pos_t *ota_data, uint32_t offset)
+{
+    esp_image_verified_t rec;
+    uint32_t addr;
+
+    while ((addr = verified_find(ota_data, offset, &rec)) != 0) {
+        rec.magic = 0;
+        if (bootloader_flash_write(addr, &rec.magic, sizeof(rec.magic), false) != ESP_OK) {
+            return;
+        }
+    }
+}
+
+/* Read the image header, the segment headers and the checksum and hash at the end of the image,
+   what changes when the image does, and hash them. Fills in data as esp_image_load() does. */
+static esp_err_t verified_digest(const esp_partition_pos_t *part, esp_image_metadata_t *data, uint8_t *digest)
+{
+    uint8_t buf[16 + HASH_LEN];
+    bootloader_sha256_handle_t sha_handle;
+    esp_err_t err;
+
+    bzero(data, sizeof(esp_image_metadata_t));
+    data->start_addr = part->offset;
+
+    err = bootloader_flash_read(data->start_addr, &data->image, sizeof(esp_image_header_t), true);
+    if (err != ESP_OK) {
+        return err;
+    }
+    if (data->image.magic != ESP_IMAGE_HEADER_MAGIC || data->image.segment_count > ESP_IMAGE_MAX_SEGMENTS) {
+        return ESP_ERR_IMAGE_INVALID;
+    }
+
+    sha_handle = bootloader_sha256_start();
+    if (sha_handle == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    bootloader_sha256_data(sha_handle, &data->image, sizeof(esp_image_header_t));
+
+    uint32_t next_addr = data->start_addr + sizeof(esp_image_header_t);
+
+    for (int i = 0; i < data->image.segment_count; i++) {
+        esp_image_segment_header_t *header = &data->segments[i];
+
+        err = bootloader_flash_read(next_addr, header, sizeof(esp_image_segment_header_t), true);
+        if (err != ESP_OK) {
+            goto exit;
+        }
+        bootloader_sha256_data(sha_handle, header, sizeof(esp_image_segment_header_t));
+        next_addr += sizeof(esp_image_segment_header_t);
+        data->segment_data[i] = next_addr;
+        next_addr += header->data_len;
+        if (header->data_len % 4 != 0 || next_addr < data->start_addr || next_addr - data->start_addr > part->size) {
+            err = ESP_ERR_IMAGE_INVALID;
+            goto exit;
+        }
+    }
+
+    // The length verify_checksum() comes to
+    uint32_t unpadded_length = next_addr - data->start_addr;
+    uint32_t length = unpadded_length;
+#if defined(CONFIG_ENABLE_BOOT_CHECK_SUM) || defined(CONFIG_ENABLE_BOOT_CHECK_SHA256)
+    length = (length + 1 + 15) & ~15;
+#ifdef CONFIG_ENABLE_BOOT_CHECK_SHA256
+    length += HASH_LEN;
+#endif
+#endif
+    if (length > part->size) {
+        err = ESP_ERR_IMAGE_INVALID;
+        goto exit;
+    }
+    if (length > unpadded_length) {
+        err = bootloader_flash_read(data->start_addr + unpadded_length, buf, length - unpadded_length, true);
+        if (err != ESP_OK) {
+            goto exit;
+        }
+        bootloader_sha256_data(sha_handle, buf, length - unpadded_length);
+    }
+    data->image_len = length;
+
+exit:
+    bootloader_sha256_finish(sha_handle, err == ESP_OK ? digest : NULL);
+    return err;
+}
+
+esp_err_t esp_image_load_verified(esp_image_load_mode_t mode, const esp_partition_pos_t *part,
+                                  const esp_partition_pos_t *ota_data, esp_image_metadata_t *data)
+{
+    esp_image_verified_t rec;
+    uint8_t digest[HASH_LEN];
+    esp_err_t err;
+
+    if (data == NULL || part == NULL || ota_data == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (ota_data->size < 2 * SPI_FLASH_SEC_SIZE || part->size > SIXTEEN_MB) {
+        return esp_image_load(mode, part, data);
+    }
+
+    if (verified_find(ota_data, part->offset, &rec) != 0) {
+        if (verified_digest(part, data, digest) == ESP_OK
+            && data->image_len == rec.image_len
+            && memcmp(digest, rec.digest, HASH_LEN) == 0) {
+            ESP_LOGI(TAG, "image at 0x%x checked on an earlier boot", part->offset);
+            return ESP_OK;
+        }
+        verified_drop(ota_data, part->offset);
+    }
+
+    err = esp_image_load(mode, part, data);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    // data is left as esp_image_load() filled it in, verified_digest() comes to the same
+    if (verified_digest(part, data, digest) == ESP_OK) {
+        rec.magic = ESP_IMAGE_VERIFIED_MAGIC;
+        rec.offset = part->offset;
+        rec.image_len = data->image_len;
+        memcpy(rec.digest, digest, HASH_LEN);
+        rec.crc = verified_crc(&rec);
+        verified_add(ota_data, &rec);
+    }
+
+    return ESP_OK;
+}
+
+#endif /* CONFIG_BOOTLOADER_VERIFIED_IMAGE_CACHE */
+
 static esp_err_t verify_checksum(bootloader_sha256_handle_t sha_handle, uint32_t checksum_word, esp_image_metadata_t *data)
 {
     esp_err_t err = ESP_OK;
@@ -71,6 +71,10 @@ typedef void (*coap_response_handler_t)(struct coap_context_t  *,
 typedef void (*coap_request_handler_t)(struct coap_context_t *,
                                        coap_pdu_t *received);
 
+/** Called with the confirmable PDU an empty ACK acknowledged */
+typedef void (*coap_ack_handler_t)(struct coap_context_t *,
+                                   coap_pdu_t *sent);
+
 #define COAP_MID_CACHE_SIZE 3
 typedef struct {
   unsigned char flags[COAP_MID_CACHE_SIZE];
@@ -126,6 +130,7 @@ typedef struct coap_context_t {
 
   coap_response_handler_t response_handler;
   coap_request_handler_t request_handler;
+  coap_ack_handler_t ack_handler;
 
   ssize_t (*network_send)(struct coap_context_t *context,
                           const coap_endpoint_t *local_interface,
@@ -155,6 +160,16 @@ coap_register_request_handler(coap_context_t *context,
   context->request_handler = handler;
 }
 
+/**
+ * Registers a handler for the empty ACKs of separate responses, which
+ * never reach the response handler.
+ */
+static inline void
+coap_register_ack_handler(coap_context_t *context,
+                          coap_ack_handler_t handler) {
+  context->ack_handler = handler;
+}
+
 /**
  * Registers the option type @p type with the given context object @p ctx.
  *
@@ -72,6 +72,14 @@ typedef struct coap_attr_t {
  */
 #define COAP_RESOURCE_FLAGS_NOTIFY_CON  0x2
 
+/**
+ * The representation sent to observers does not depend on the observer. The
+ * GET handler is called once per change and its output is copied into an
+ * exactly sized notification for every observer, which differs only in
+ * token and message id.
+ */
+#define COAP_RESOURCE_FLAGS_NOTIFY_SHARED 0x4
+
 typedef struct coap_resource_t {
   unsigned int dirty:1;          /**< set to 1 if resource has changed */
   unsigned int partiallydirty:1; /**< set to 1 if some subscribers have not yet
@@ -128,7 +136,7 @@ coap_resource_t *coap_resource_init(const unsigned char *uri,
  */
 static inline void
 coap_resource_set_mode(coap_resource_t *r, int mode) {
-  r->flags = (r->flags & !COAP_RESOURCE_FLAGS_NOTIFY_CON) | mode;
+  r->flags = (r->flags & ~COAP_RESOURCE_FLAGS_NOTIFY_CON) | mode;
 }
 
 /**
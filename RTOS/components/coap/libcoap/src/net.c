@@ -1837,7 +1837,12 @@ void coap_dispatch(coap_context_t *context, coap_queue_t *rcvd)
       //printf("rcv id = %d\n\n", htons(rcvd->pdu->hdr->id));
 
       if (rcvd->pdu->hdr->code == 0)
+      {
+        /* the response follows separately */
+        if (sent && context->ack_handler)
+          context->ack_handler(context, sent->pdu);
         goto cleanup;
+      }
 
       /* if sent code was >= 64 the message might have been a
        * notification. Then, we must flag the observer to be alive
@@ -605,12 +605,127 @@ coap_delete_observer(coap_resource_t *resource, const coap_address_t *observer,
   return s != NULL;
 }
 
+/**
+ * Sends @p response to @p obs. On failure the observer and the resource
+ * stay dirty so that the notification is tried again.
+ */
+static void
+coap_notify_send(coap_context_t *context, coap_resource_t *r,
+		 coap_subscription_t *obs, coap_pdu_t *response) {
+  coap_tid_t tid;
+
+  /* TODO: do not send response and remove observer when 
+   *  COAP_RESPONSE_CLASS(response->hdr->code) > 2
+   */
+  if (response->hdr->type == COAP_MESSAGE_CON) {
+    tid = coap_send_confirmed(context, &obs->local_if, &obs->subscriber, response);
+    obs->non_cnt = 0;
+  } else {
+    tid = coap_send(context, &obs->local_if, &obs->subscriber, response);
+    obs->non_cnt++;
+  }
+
+  if (COAP_INVALID_TID == tid || response->hdr->type != COAP_MESSAGE_CON)
+    coap_delete_pdu(response);
+  if (COAP_INVALID_TID == tid)
+  {
+    debug("coap_check_notify: sending failed, resource stays partially dirty\n");
+    obs->dirty = 1;
+    r->partiallydirty = 1;
+  }
+}
+
+static inline unsigned char
+coap_notify_type(coap_resource_t *r, coap_subscription_t *obs) {
+  if ((r->flags & COAP_RESOURCE_FLAGS_NOTIFY_CON) == 0
+      && obs->non_cnt < COAP_OBS_MAX_NON)
+    return COAP_MESSAGE_NON;
+  return COAP_MESSAGE_CON;
+}
+
+/**
+ * Renders the representation of @p r for @p obs into a full sized PDU
+ * of type @p type by calling the GET handler @p h.
+ */
+static coap_pdu_t *
+coap_notify_render(coap_context_t *context, coap_resource_t *r,
+		   coap_subscription_t *obs, coap_method_handler_t h,
+		   unsigned char type) {
+  coap_pdu_t *response;
+  str token;
+
+  response = coap_pdu_init(COAP_MESSAGE_CON, 0, 0, COAP_MAX_PDU_SIZE);
+  if (!response) {
+    debug("coap_check_notify: pdu init failed, resource stays partially dirty\n");
+    return NULL;
+  }
+
+  if (!coap_add_token(response, obs->token_length, obs->token)) {
+    debug("coap_check_notify: cannot add token, resource stays partially dirty\n");
+    coap_delete_pdu(response);
+    return NULL;
+  }
+
+  token.length = obs->token_length;
+  token.s = obs->token;
+
+  response->hdr->id = coap_new_message_id(context);
+  response->hdr->type = type;
+
+  /* fill with observer-specific data */
+  h(context, r, &obs->local_if, &obs->subscriber, NULL, &token, response);
+
+  return response;
+}
+
+/**
+ * Copies the notification @p rendered for another observer into a PDU of
+ * exactly the size needed for @p obs. Options and payload are independent
+ * of the token, so they are copied as they are; the type is that of @p obs.
+ */
+static coap_pdu_t *
+coap_notify_copy(coap_context_t *context, coap_resource_t *r,
+		 coap_subscription_t *obs, const coap_pdu_t *rendered) {
+  const unsigned char *options;
+  coap_pdu_t *response;
+  size_t length;
+  unsigned char type;
+
+  options = rendered->hdr->token + rendered->hdr->token_length;
+  length = (const unsigned char *)rendered->hdr + rendered->length - options;
+
+  /* a handler that asks for confirmable notifications asks for all of them */
+  type = rendered->hdr->type == COAP_MESSAGE_CON ?
+    COAP_MESSAGE_CON : coap_notify_type(r, obs);
+
+  response = coap_pdu_init(type, rendered->hdr->code,
+			   coap_new_message_id(context),
+			   sizeof(coap_hdr_t) + obs->token_length + length);
+  if (!response) {
+    debug("coap_check_notify: pdu init failed, resource stays partially dirty\n");
+    return NULL;
+  }
+
+  if (!coap_add_token(response, obs->token_length, obs->token)) {
+    debug("coap_check_notify: cannot add token, resource stays partially dirty\n");
+    coap_delete_pdu(response);
+    return NULL;
+  }
+
+  memcpy((unsigned char *)response->hdr + response->length, options, length);
+  response->data = rendered->data ?
+    response->hdr->token + obs->token_length + (rendered->data - options) : NULL;
+  response->max_delta = rendered->max_delta;
+  response->length += length;
+
+  return response;
+}
+
 static void
 coap_notify_observers(coap_context_t *context, coap_resource_t *r) {
   coap_method_handler_t h;
   coap_subscription_t *obs;
-  str token;
-  coap_pdu_t *response;
+  coap_pdu_t *response, *rendered = NULL;
 
   if (r->observable && (r->dirty || r->partiallydirty)) {
     r->partiallydirty = 0;
@@ -625,60 +740,31 @@ coap_notify_observers(coap_context_t *context, coap_resource_t *r) {
         /* running this resource due to partiallydirty, but this observation's notification was already enqueued */
         continue;
 
-      coap_tid_t tid = COAP_INVALID_TID;
       obs->dirty = 0;
-      /* initialize response */
-      response = coap_pdu_init(COAP_MESSAGE_CON, 0, 0, COAP_MAX_PDU_SIZE);
-      if (!response) {
-        obs->dirty = 1;
-        r->partiallydirty = 1;
-	debug("coap_check_notify: pdu init failed, resource stays partially dirty\n");
-	continue;
-      }
 
-      if (!coap_add_token(response, obs->token_length, obs->token)) {
-        obs->dirty = 1;
-        r->partiallydirty = 1;
-	debug("coap_check_notify: cannot add token, resource stays partially dirty\n");
-	coap_delete_pdu(response);
-	continue;
-      }
-
-      token.length = obs->token_length;
-      token.s = obs->token;
-
-      response->hdr->id = coap_new_message_id(context);
-      if ((r->flags & COAP_RESOURCE_FLAGS_NOTIFY_CON) == 0
-	  && obs->non_cnt < COAP_OBS_MAX_NON) {
-	response->hdr->type = COAP_MESSAGE_NON;
-      } else {
-	response->hdr->type = COAP_MESSAGE_CON;
-      }
-      /* fill with observer-specific data */
-      h(context, r, &obs->local_if, &obs->subscriber, NULL, &token, response);
-
-      /* TODO: do not send response and remove observer when 
-       *  COAP_RESPONSE_CLASS(response->hdr->code) > 2
-       */
-      if (response->hdr->type == COAP_MESSAGE_CON) {
-	tid = coap_send_confirmed(context, &obs->local_if, &obs->subscriber, response);
-	obs->non_cnt = 0;
+      if ((r->flags & COAP_RESOURCE_FLAGS_NOTIFY_SHARED) == 0) {
+	response = coap_notify_render(context, r, obs, h,
+				      coap_notify_type(r, obs));
       } else {
-	tid = coap_send(context, &obs->local_if, &obs->subscriber, response);
-	obs->non_cnt++;
+	/* render once, the Observe value is the same for all observers;
+	 * rendered as NON, so that a CON type can only come from the handler */
+	if (!rendered)
+	  rendered = coap_notify_render(context, r, obs, h, COAP_MESSAGE_NON);
+	response = rendered ? coap_notify_copy(context, r, obs, rendered) : NULL;
       }
 
-      if (COAP_INVALID_TID == tid || response->hdr->type != COAP_MESSAGE_CON)
-	coap_delete_pdu(response);
-      if (COAP_INVALID_TID == tid)
-      {
-	debug("coap_check_notify: sending failed, resource stays partially dirty\n");
+      if (!response) {
         obs->dirty = 1;
         r->partiallydirty = 1;
+	continue;
       }
 
+      coap_notify_send(context, r, obs, response);
     }
 
+    if (rendered)
+      coap_delete_pdu(rendered);
+
     /* Increment value for next Observe use. */
     context->observe++;
   }
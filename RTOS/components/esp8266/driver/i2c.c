@@ -49,6 +49,7 @@ static const char *I2C_TAG = "i2c";
 #define I2C_SDA_IO_ERR_STR             "sda gpio number error"
 #define I2C_SCL_IO_ERR_STR             "scl gpio number error"
 #define I2C_CMD_LINK_INIT_ERR_STR      "i2c command link error"
+#define I2C_CMD_LINK_SIZE_ERR_STR      "i2c command link buffer too small"
 #define I2C_GPIO_PULLUP_ERR_STR        "this i2c pin does not support internal pull-up"
 #define I2C_ACK_TYPE_ERR_STR           "i2c ack type error"
 #define I2C_DATA_LEN_ERR_STR           "i2c data read length error"
@@ -79,8 +80,13 @@ typedef struct {
     i2c_cmd_link_t *head;     /*!< head of the command link */
     i2c_cmd_link_t *cur;      /*!< last node of the command link */
     i2c_cmd_link_t *free;     /*!< the first node to free of the command link */
+    uint8_t *free_buffer;     /*!< next free byte of the caller buffer, NULL for a heap allocated link */
+    uint32_t free_size;       /*!< bytes left in the caller buffer */
 } i2c_cmd_desc_t;
 
+_Static_assert(sizeof(i2c_cmd_desc_t) <= I2C_INTERNAL_STRUCT_SIZE, "I2C_INTERNAL_STRUCT_SIZE is too small for the command descriptor");
+_Static_assert(sizeof(i2c_cmd_link_t) <= I2C_INTERNAL_STRUCT_SIZE, "I2C_INTERNAL_STRUCT_SIZE is too small for a command node");
+
 typedef enum {
     I2C_STATUS_READ,      /*!< read status for current master command */
     I2C_STATUS_WRITE,     /*!< write status for current master command */
@@ -272,6 +278,34 @@ i2c_cmd_handle_t i2c_cmd_link_create()
     return (i2c_cmd_handle_t) cmd_desc;
 }
 
+i2c_cmd_handle_t i2c_cmd_link_create_static(uint8_t *buffer, uint32_t size)
+{
+    // the descriptor and the nodes hold pointers, keep them aligned whatever the buffer is
+    uint32_t skip = (sizeof(void *) - ((uintptr_t) buffer & (sizeof(void *) - 1))) & (sizeof(void *) - 1);
+
+    I2C_CHECK(buffer != NULL, I2C_ADDR_ERROR_STR, NULL);
+    I2C_CHECK(size >= skip + I2C_INTERNAL_STRUCT_SIZE, I2C_CMD_LINK_SIZE_ERR_STR, NULL);
+
+    i2c_cmd_desc_t *cmd_desc = (i2c_cmd_desc_t *) (buffer + skip);
+    memset(cmd_desc, 0, sizeof(i2c_cmd_desc_t));
+    cmd_desc->free_buffer = buffer + skip + I2C_INTERNAL_STRUCT_SIZE;
+    cmd_desc->free_size = size - skip - I2C_INTERNAL_STRUCT_SIZE;
+    return (i2c_cmd_handle_t) cmd_desc;
+}
+
+void i2c_cmd_link_delete_static(i2c_cmd_handle_t cmd_handle)
+{
+    i2c_cmd_desc_t *cmd = (i2c_cmd_desc_t *) cmd_handle;
+
+    if (cmd == NULL || cmd->free_buffer == NULL) {
+        return;
+    }
+
+    // the storage belongs to the caller, only forget the nodes built in it
+    cmd->cur = NULL;
+    cmd->head = NULL;
+}
+
 void i2c_cmd_link_delete(i2c_cmd_handle_t cmd_handle)
 {
     if (cmd_handle == NULL) {
@@ -280,6 +314,11 @@ void i2c_cmd_link_delete(i2c_cmd_handle_t cmd_handle)
 
     i2c_cmd_desc_t *cmd = (i2c_cmd_desc_t *) cmd_handle;
 
+    if (cmd->free_buffer != NULL) {
+        i2c_cmd_link_delete_static(cmd_handle);
+        return;
+    }
+
     while (cmd->free) {
         i2c_cmd_link_t *ptmp = cmd->free;
         cmd->free = cmd->free->next;
@@ -293,12 +332,31 @@ void i2c_cmd_link_delete(i2c_cmd_handle_t cmd_handle)
     return;
 }
 
+static i2c_cmd_link_t *i2c_cmd_link_alloc(i2c_cmd_desc_t *cmd_desc)
+{
+    i2c_cmd_link_t *link;
+
+    if (cmd_desc->free_buffer == NULL) {
+        return (i2c_cmd_link_t *) heap_caps_calloc(1, sizeof(i2c_cmd_link_t), MALLOC_CAP_8BIT);
+    }
+
+    if (cmd_desc->free_size < I2C_INTERNAL_STRUCT_SIZE) {
+        return NULL;
+    }
+
+    link = (i2c_cmd_link_t *) cmd_desc->free_buffer;
+    cmd_desc->free_buffer += I2C_INTERNAL_STRUCT_SIZE;
+    cmd_desc->free_size -= I2C_INTERNAL_STRUCT_SIZE;
+    memset(link, 0, sizeof(i2c_cmd_link_t));
+    return link;
+}
+
 static esp_err_t i2c_cmd_link_append(i2c_cmd_handle_t cmd_handle, i2c_cmd_t *cmd)
 {
     i2c_cmd_desc_t *cmd_desc = (i2c_cmd_desc_t *) cmd_handle;
 
     if (cmd_desc->head == NULL) {
-        cmd_desc->head = (i2c_cmd_link_t *) heap_caps_calloc(1, sizeof(i2c_cmd_link_t), MALLOC_CAP_8BIT);
+        cmd_desc->head = i2c_cmd_link_alloc(cmd_desc);
 
         if (cmd_desc->head == NULL) {
             ESP_LOGE(I2C_TAG, I2C_CMD_MALLOC_ERR_STR);
@@ -306,9 +364,9 @@ static esp_err_t i2c_cmd_link_append(i2c_cmd_handle_t cmd_handle, i2c_cmd_t *cmd
         }
 
         cmd_desc->cur = cmd_desc->head;
-        cmd_desc->free = cmd_desc->head;
+        cmd_desc->free = cmd_desc->free_buffer ? NULL : cmd_desc->head;
     } else {
-        cmd_desc->cur->next = (i2c_cmd_link_t *) heap_caps_calloc(1, sizeof(i2c_cmd_link_t), MALLOC_CAP_8BIT);
+        cmd_desc->cur->next = i2c_cmd_link_alloc(cmd_desc);
 
         if (cmd_desc->cur->next == NULL) {
             ESP_LOGE(I2C_TAG, I2C_CMD_MALLOC_ERR_STR);
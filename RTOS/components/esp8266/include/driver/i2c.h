@@ -68,6 +68,21 @@ typedef struct {
 
 typedef void *i2c_cmd_handle_t;   /*!< I2C command handle  */
 
+/**
+ * @brief Bytes taken in a static command link buffer by the link descriptor
+ *        and by each queued command
+ */
+#define I2C_INTERNAL_STRUCT_SIZE (4 * sizeof(void *) + 8)
+
+/**
+ * @brief Buffer size for a static command link of TRANSACTIONS register accesses,
+ *        each made of start, address, register, data and stop.
+ *        A repeated start read takes two of them, a read with LAST_NACK of more
+ *        than one byte takes one command more for the last byte.
+ *        The extra struct leaves room to align the buffer.
+ */
+#define I2C_LINK_RECOMMENDED_SIZE(TRANSACTIONS) (2 * I2C_INTERNAL_STRUCT_SIZE + I2C_INTERNAL_STRUCT_SIZE * (5 * (TRANSACTIONS)))
+
 /**
  * @brief I2C driver install
  *
@@ -147,6 +162,30 @@ i2c_cmd_handle_t i2c_cmd_link_create();
  */
 void i2c_cmd_link_delete(i2c_cmd_handle_t cmd_handle);
 
+/**
+ * @brief Create and init I2C command link in a caller provided buffer
+ *        @note
+ *        The descriptor and all the queued commands are taken from the buffer,
+ *        building and sending the link never allocates. A queue function returns
+ *        ESP_FAIL once the buffer is full, size it with I2C_LINK_RECOMMENDED_SIZE().
+ *        The buffer must stay valid as long as the handle is used.
+ *
+ * @param buffer storage for the command link, any alignment
+ * @param size bytes of the buffer
+ *
+ * @return i2c command link handler, NULL if the buffer cannot hold the descriptor
+ */
+i2c_cmd_handle_t i2c_cmd_link_create_static(uint8_t *buffer, uint32_t size);
+
+/**
+ * @brief Release a command link created by i2c_cmd_link_create_static()
+ *        @note
+ *        Nothing is freed, the buffer can be reused for a new link afterwards.
+ *
+ * @param cmd_handle I2C command handle
+ */
+void i2c_cmd_link_delete_static(i2c_cmd_handle_t cmd_handle);
+
 /**
  * @brief Queue command for I2C master to generate a start signal
  *        @note
@@ -249,6 +288,11 @@ esp_err_t i2c_master_stop(i2c_cmd_handle_t cmd_handle);
  *        you need to take care of the multi-thread issue.
  *        @note
  *        Only call this function in I2C master mode
+ *        @note
+ *        The command link is left untouched, the same link can be sent again
+ *        without rebuilding it. Write commands send the current content of their
+ *        data buffers and read commands store into theirs, so a link built once
+ *        with i2c_cmd_link_create_static() is a transaction replayed at no cost.
  *
  * @param i2c_num I2C port number
  * @param cmd_handle I2C command handler
@@ -0,0 +1,17 @@
+/*
+ * Host stand-in for the FreeRTOS kernel, only what the I2C driver uses
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef uint32_t TickType_t;
+
+#define portTICK_PERIOD_MS      10
+#define portMAX_DELAY           0xffffffffUL
+
+#define portENTER_CRITICAL()
+#define portEXIT_CRITICAL()
+
+void os_delay_us(uint16_t us);
@@ -0,0 +1,11 @@
+/*
+ * Host stand-in for the IDF heap, counted by gpio_host.c
+ */
+#pragma once
+
+#include <stddef.h>
+
+#define MALLOC_CAP_8BIT     (1 << 2)
+
+void *heap_caps_calloc(size_t n, size_t size, int caps);
+void heap_caps_free(void *ptr);
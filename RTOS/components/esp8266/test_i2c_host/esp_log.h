@@ -0,0 +1,6 @@
+/*
+ * Host stand-in for the IDF logging, the driver only logs errors
+ */
+#pragma once
+
+#define ESP_LOGE(tag, format, ...) ((void) (tag))
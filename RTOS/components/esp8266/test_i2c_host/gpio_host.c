@@ -0,0 +1,258 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_heap_caps.h"
+#include "driver/gpio.h"
+
+#include "gpio_host.h"
+
+#define TRACE_LEN 8192
+
+typedef enum {
+    SLAVE_IDLE,         // waiting for a start
+    SLAVE_RX,           // master writes
+    SLAVE_TX,           // master reads
+} slave_state_t;
+
+static struct {
+    int sda_io_num;
+    int scl_io_num;
+    uint8_t master_sda;
+    uint8_t master_scl;
+    uint8_t slave_sda;
+
+    slave_state_t state;
+    uint8_t bits;       // SCL rising edges in the current byte, 9 with the acknowledge
+    uint8_t shift;
+    uint8_t tx;
+    uint8_t index;      // bytes received since the start
+    uint8_t addressed;
+    uint8_t master_nack;
+    uint8_t reg;
+    uint8_t regs[256];
+    uint8_t counter;
+} bus;
+
+static char trace[TRACE_LEN];
+static size_t trace_len;
+static gpio_host_stats_t stats;
+
+// the log keeps the beginning of long runs, tests look at short ones
+static void trace_add(const char *fmt, unsigned int val)
+{
+    char item[8];
+    size_t len = snprintf(item, sizeof(item), trace_len ? " " : "");
+
+    len += snprintf(item + len, sizeof(item) - len, fmt, val);
+    if (trace_len + len < TRACE_LEN) {
+        memcpy(trace + trace_len, item, len + 1);
+        trace_len += len;
+    }
+}
+
+static uint8_t wire_sda(void)
+{
+    return bus.master_sda & bus.slave_sda;
+}
+
+static uint8_t slave_read(void)
+{
+    if (bus.reg == GPIO_HOST_COUNTER_REG) {
+        return ++bus.counter;
+    }
+
+    return bus.regs[bus.reg++];
+}
+
+static void slave_received(void)
+{
+    trace_add("%02x", bus.shift);
+    stats.bytes++;
+
+    if (bus.index == 0) {
+        bus.addressed = (bus.shift >> 1) == GPIO_HOST_ADDR;
+        bus.state = bus.addressed && (bus.shift & 1) ? SLAVE_TX : SLAVE_RX;
+    } else if (bus.addressed && bus.index == 1) {
+        bus.reg = bus.shift;
+    } else if (bus.addressed) {
+        bus.regs[bus.reg++] = bus.shift;
+    }
+    bus.index++;
+
+    // acknowledge during the ninth clock
+    bus.slave_sda = bus.addressed ? 0 : 1;
+}
+
+static void slave_rising(uint8_t sda)
+{
+    if (bus.bits < 8) {
+        if (bus.state == SLAVE_RX) {
+            bus.shift = (bus.shift << 1) | sda;
+        }
+    } else if (bus.bits == 8) {
+        trace_add("%c", sda ? 'N' : 'A');
+        if (bus.state == SLAVE_TX) {
+            bus.master_nack = sda;
+        }
+    }
+    bus.bits++;
+}
+
+static void slave_falling(void)
+{
+    if (bus.bits == 8) {
+        if (bus.state == SLAVE_RX) {
+            slave_received();
+        } else {
+            // release SDA for the master acknowledge
+            bus.slave_sda = 1;
+        }
+        return;
+    }
+
+    if (bus.bits == 9) {
+        bus.bits = 0;
+        bus.shift = 0;
+        bus.slave_sda = 1;
+
+        if (bus.state == SLAVE_TX && !bus.master_nack) {
+            bus.tx = slave_read();
+            trace_add("<%02x", bus.tx);
+            stats.bytes++;
+            bus.index++;
+            bus.slave_sda = bus.tx >> 7;
+        } else if (bus.state == SLAVE_TX) {
+            bus.state = SLAVE_IDLE;
+        }
+        return;
+    }
+
+    if (bus.state == SLAVE_TX && bus.bits > 0) {
+        bus.slave_sda = (bus.tx >> (7 - bus.bits)) & 1;
+    }
+}
+
+static void slave_start(void)
+{
+    trace_add("%c", 'S');
+    stats.starts++;
+    bus.state = SLAVE_RX;
+    bus.bits = 0;
+    bus.shift = 0;
+    bus.index = 0;
+    bus.master_nack = 0;
+    bus.slave_sda = 1;
+}
+
+static void slave_stop(void)
+{
+    trace_add("%c", 'P');
+    stats.stops++;
+    bus.state = SLAVE_IDLE;
+    bus.slave_sda = 1;
+}
+
+esp_err_t gpio_config(const gpio_config_t *gpio_cfg)
+{
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    uint8_t scl = bus.master_scl;
+    uint8_t sda = wire_sda();
+
+    if (gpio_num == bus.sda_io_num) {
+        bus.master_sda = level & 1;
+    } else if (gpio_num == bus.scl_io_num) {
+        bus.master_scl = level & 1;
+    } else {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (scl && bus.master_scl && sda != wire_sda()) {
+        if (sda) {
+            slave_start();
+        } else {
+            slave_stop();
+        }
+    } else if (!scl && bus.master_scl && bus.state != SLAVE_IDLE) {
+        slave_rising(wire_sda());
+    } else if (scl && !bus.master_scl && bus.state != SLAVE_IDLE) {
+        slave_falling();
+    }
+
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num)
+{
+    if (gpio_num == bus.sda_io_num) {
+        return wire_sda();
+    }
+
+    return bus.master_scl;
+}
+
+void os_delay_us(uint16_t us)
+{
+    stats.delay_us += us;
+}
+
+void *heap_caps_calloc(size_t n, size_t size, int caps)
+{
+    stats.allocs++;
+    return calloc(n, size);
+}
+
+void heap_caps_free(void *ptr)
+{
+    if (ptr) {
+        stats.frees++;
+    }
+    free(ptr);
+}
+
+void gpio_host_init(int sda_io_num, int scl_io_num)
+{
+    memset(&bus, 0, sizeof(bus));
+    bus.sda_io_num = sda_io_num;
+    bus.scl_io_num = scl_io_num;
+    bus.master_sda = 1;
+    bus.master_scl = 1;
+    bus.slave_sda = 1;
+    gpio_host_trace_reset();
+    gpio_host_stats_reset();
+}
+
+void gpio_host_set_reg(uint8_t reg, uint8_t val)
+{
+    bus.regs[reg] = val;
+}
+
+uint8_t gpio_host_reg(uint8_t reg)
+{
+    return bus.regs[reg];
+}
+
+const char *gpio_host_trace(void)
+{
+    return trace;
+}
+
+void gpio_host_trace_reset(void)
+{
+    trace[0] = '\0';
+    trace_len = 0;
+}
+
+const gpio_host_stats_t *gpio_host_stats(void)
+{
+    return &stats;
+}
+
+void gpio_host_stats_reset(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
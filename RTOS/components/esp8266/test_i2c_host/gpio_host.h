@@ -0,0 +1,38 @@
+/*
+ * Open drain I2C bus on two GPIOs, bit-banged by the driver through
+ * gpio_set_level()/gpio_get_level(). A slave decodes the waveform edge
+ * by edge: start and stop are SDA changes while SCL is high, bits are
+ * sampled on SCL rising edges and the slave drives SDA on falling ones.
+ *
+ * The slave is a register device, writes after the register address
+ * store with auto increment, reads return from the register pointer.
+ * GPIO_HOST_COUNTER_REG returns a new value on each read and keeps the
+ * pointer, like a FIFO data register.
+ *
+ * Everything seen on the bus is logged as text:
+ *   "S ae A 02 A S af A <01 A <02 N P"
+ * start, address or data byte written, ACK or NACK, byte read, stop.
+ */
+#pragma once
+
+#include <stdint.h>
+
+#define GPIO_HOST_ADDR          0x57
+#define GPIO_HOST_COUNTER_REG   0x05
+
+typedef struct {
+    unsigned int allocs;        // heap_caps_calloc calls
+    unsigned int frees;         // heap_caps_free calls
+    unsigned int starts;        // start and repeated start conditions
+    unsigned int stops;
+    unsigned int bytes;         // bytes on the bus, addresses included
+    unsigned int delay_us;      // bus time spent in os_delay_us
+} gpio_host_stats_t;
+
+void gpio_host_init(int sda_io_num, int scl_io_num);
+void gpio_host_set_reg(uint8_t reg, uint8_t val);
+uint8_t gpio_host_reg(uint8_t reg);
+const char *gpio_host_trace(void);
+void gpio_host_trace_reset(void);
+const gpio_host_stats_t *gpio_host_stats(void);
+void gpio_host_stats_reset(void);
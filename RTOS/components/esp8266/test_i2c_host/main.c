@@ -0,0 +1,19 @@
+#include "unity.h"
+
+void test_i2c_link_waveform(void);
+void test_i2c_link_allocs(void);
+void test_i2c_link_replay(void);
+void test_i2c_link_full(void);
+void test_i2c_link_benchmark(void);
+
+int main(void) {
+  UNITY_BEGIN();
+
+  RUN_TEST(test_i2c_link_waveform);
+  RUN_TEST(test_i2c_link_allocs);
+  RUN_TEST(test_i2c_link_replay);
+  RUN_TEST(test_i2c_link_full);
+  RUN_TEST(test_i2c_link_benchmark);
+
+  return UNITY_END();
+}
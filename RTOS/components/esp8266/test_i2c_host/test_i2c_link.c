@@ -0,0 +1,265 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "unity.h"
+#include "driver/i2c.h"
+#include "gpio_host.h"
+
+#define TEST_SDA_IO     GPIO_NUM_2
+#define TEST_SCL_IO     GPIO_NUM_14
+#define TEST_WRITE_ADDR ((GPIO_HOST_ADDR << 1) | I2C_MASTER_WRITE)
+#define TEST_READ_ADDR  ((GPIO_HOST_ADDR << 1) | I2C_MASTER_READ)
+
+// commands queued by test_read_reg() for more than one byte
+#define TEST_READ_CMDS  8
+
+static void test_bus_init(void)
+{
+    i2c_config_t conf = {
+        .mode = I2C_MODE_MASTER,
+        .sda_io_num = TEST_SDA_IO,
+        .sda_pullup_en = GPIO_PULLUP_ENABLE,
+        .scl_io_num = TEST_SCL_IO,
+        .scl_pullup_en = GPIO_PULLUP_ENABLE,
+    };
+
+    gpio_host_init(TEST_SDA_IO, TEST_SCL_IO);
+    TEST_ASSERT_EQUAL(ESP_OK, i2c_driver_install(I2C_NUM_0, I2C_MODE_MASTER));
+    TEST_ASSERT_EQUAL(ESP_OK, i2c_param_config(I2C_NUM_0, &conf));
+    gpio_host_trace_reset();
+    gpio_host_stats_reset();
+}
+
+static void test_bus_deinit(void)
+{
+    TEST_ASSERT_EQUAL(ESP_OK, i2c_driver_delete(I2C_NUM_0));
+}
+
+static esp_err_t test_write_reg(i2c_cmd_handle_t cmd, uint8_t reg, uint8_t *data, size_t len)
+{
+    esp_err_t ret = ESP_OK;
+
+    ret |= i2c_master_start(cmd);
+    ret |= i2c_master_write_byte(cmd, TEST_WRITE_ADDR, true);
+    ret |= i2c_master_write_byte(cmd, reg, true);
+    ret |= i2c_master_write(cmd, data, len, true);
+    ret |= i2c_master_stop(cmd);
+    return ret;
+}
+
+// register address, repeated start and burst read, the MAX30100 FIFO access
+static esp_err_t test_read_reg(i2c_cmd_handle_t cmd, uint8_t reg, uint8_t *data, size_t len)
+{
+    esp_err_t ret = ESP_OK;
+
+    ret |= i2c_master_start(cmd);
+    ret |= i2c_master_write_byte(cmd, TEST_WRITE_ADDR, true);
+    ret |= i2c_master_write_byte(cmd, reg, true);
+    ret |= i2c_master_start(cmd);
+    ret |= i2c_master_write_byte(cmd, TEST_READ_ADDR, true);
+    ret |= i2c_master_read(cmd, data, len, I2C_MASTER_LAST_NACK);
+    ret |= i2c_master_stop(cmd);
+    return ret;
+}
+
+static void test_transfer(i2c_cmd_handle_t cmd, uint8_t *out, uint8_t *in)
+{
+    TEST_ASSERT_NOT_NULL(cmd);
+    TEST_ASSERT_EQUAL(ESP_OK, test_write_reg(cmd, 0x06, out, 2));
+    TEST_ASSERT_EQUAL(ESP_OK, test_read_reg(cmd, 0x06, in, 3));
+    TEST_ASSERT_EQUAL(ESP_OK, i2c_master_cmd_begin(I2C_NUM_0, cmd, 1000 / portTICK_PERIOD_MS));
+}
+
+/**
+ * A link built in a caller buffer drives the same waveform as a heap one
+ */
+void test_i2c_link_waveform(void)
+{
+    static const char expected[] =
+        "S ae A 06 A 0b A 27 A P "
+        "S ae A 06 A S af A <0b A <27 A <5a N P";
+    uint8_t buffer[I2C_LINK_RECOMMENDED_SIZE(3)];
+    uint8_t out[2] = {0x0b, 0x27};
+    uint8_t in[3];
+    char heap_trace[256];
+    i2c_cmd_handle_t cmd;
+
+    test_bus_init();
+    gpio_host_set_reg(0x08, 0x5a);
+
+    cmd = i2c_cmd_link_create();
+    test_transfer(cmd, out, in);
+    i2c_cmd_link_delete(cmd);
+    TEST_ASSERT_EQUAL_STRING(expected, gpio_host_trace());
+    TEST_ASSERT_EQUAL_HEX8(0x0b, in[0]);
+    TEST_ASSERT_EQUAL_HEX8(0x27, in[1]);
+    TEST_ASSERT_EQUAL_HEX8(0x5a, in[2]);
+    TEST_ASSERT_EQUAL_HEX8(0x27, gpio_host_reg(0x07));
+    strcpy(heap_trace, gpio_host_trace());
+
+    gpio_host_trace_reset();
+    memset(in, 0, sizeof(in));
+    cmd = i2c_cmd_link_create_static(buffer, sizeof(buffer));
+    test_transfer(cmd, out, in);
+    i2c_cmd_link_delete_static(cmd);
+    TEST_ASSERT_EQUAL_STRING(heap_trace, gpio_host_trace());
+    TEST_ASSERT_EQUAL_HEX8(0x5a, in[2]);
+
+    test_bus_deinit();
+}
+
+/**
+ * A heap link allocates its descriptor and one node per command,
+ * a static link nothing at all
+ */
+void test_i2c_link_allocs(void)
+{
+    uint8_t buffer[I2C_LINK_RECOMMENDED_SIZE(2)];
+    uint8_t data[4];
+    i2c_cmd_handle_t cmd;
+
+    test_bus_init();
+
+    cmd = i2c_cmd_link_create();
+    TEST_ASSERT_EQUAL(ESP_OK, test_read_reg(cmd, GPIO_HOST_COUNTER_REG, data, sizeof(data)));
+    TEST_ASSERT_EQUAL(ESP_OK, i2c_master_cmd_begin(I2C_NUM_0, cmd, 1000 / portTICK_PERIOD_MS));
+    i2c_cmd_link_delete(cmd);
+    TEST_ASSERT_EQUAL(1 + TEST_READ_CMDS, gpio_host_stats()->allocs);
+    TEST_ASSERT_EQUAL(gpio_host_stats()->allocs, gpio_host_stats()->frees);
+
+    gpio_host_stats_reset();
+    cmd = i2c_cmd_link_create_static(buffer, sizeof(buffer));
+    TEST_ASSERT_EQUAL(ESP_OK, test_read_reg(cmd, GPIO_HOST_COUNTER_REG, data, sizeof(data)));
+    TEST_ASSERT_EQUAL(ESP_OK, i2c_master_cmd_begin(I2C_NUM_0, cmd, 1000 / portTICK_PERIOD_MS));
+    i2c_cmd_link_delete_static(cmd);
+    TEST_ASSERT_EQUAL(0, gpio_host_stats()->allocs);
+    TEST_ASSERT_EQUAL(0, gpio_host_stats()->frees);
+
+    // i2c_cmd_link_delete() leaves the caller buffer alone as well
+    cmd = i2c_cmd_link_create_static(buffer, sizeof(buffer));
+    TEST_ASSERT_EQUAL(ESP_OK, test_read_reg(cmd, GPIO_HOST_COUNTER_REG, data, sizeof(data)));
+    i2c_cmd_link_delete(cmd);
+    TEST_ASSERT_EQUAL(0, gpio_host_stats()->frees);
+
+    test_bus_deinit();
+}
+
+/**
+ * A link is built once and sent many times, each run reads fresh data
+ */
+void test_i2c_link_replay(void)
+{
+    uint8_t buffer[I2C_LINK_RECOMMENDED_SIZE(2)];
+    uint8_t data[4];
+    uint8_t counter = 0;
+    i2c_cmd_handle_t cmd;
+    int i, j;
+
+    test_bus_init();
+
+    cmd = i2c_cmd_link_create_static(buffer, sizeof(buffer));
+    TEST_ASSERT_EQUAL(ESP_OK, test_read_reg(cmd, GPIO_HOST_COUNTER_REG, data, sizeof(data)));
+
+    for (i = 0; i < 1000; i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, i2c_master_cmd_begin(I2C_NUM_0, cmd, 1000 / portTICK_PERIOD_MS));
+        for (j = 0; j < sizeof(data); j++) {
+            TEST_ASSERT_EQUAL_HEX8(++counter, data[j]);
+        }
+    }
+    i2c_cmd_link_delete_static(cmd);
+
+    TEST_ASSERT_EQUAL(0, gpio_host_stats()->allocs);
+    TEST_ASSERT_EQUAL(2 * 1000, gpio_host_stats()->starts);
+    TEST_ASSERT_EQUAL(1000, gpio_host_stats()->stops);
+    TEST_ASSERT_EQUAL((3 + sizeof(data)) * 1000, gpio_host_stats()->bytes);
+
+    test_bus_deinit();
+}
+
+/**
+ * The buffer limits the link, whatever its alignment
+ */
+void test_i2c_link_full(void)
+{
+    uint8_t buffer[I2C_LINK_RECOMMENDED_SIZE(2) + 1];
+    uint8_t data[4];
+    i2c_cmd_handle_t cmd;
+    int i;
+
+    test_bus_init();
+
+    TEST_ASSERT_NULL(i2c_cmd_link_create_static(NULL, sizeof(buffer)));
+    TEST_ASSERT_NULL(i2c_cmd_link_create_static(buffer, I2C_INTERNAL_STRUCT_SIZE - 1));
+
+    // room for the descriptor and two commands, starting on an odd address
+    cmd = i2c_cmd_link_create_static(buffer + 1, 4 * I2C_INTERNAL_STRUCT_SIZE - 1);
+    TEST_ASSERT_NOT_NULL(cmd);
+    TEST_ASSERT_EQUAL(0, (uintptr_t) cmd % sizeof(void *));
+    TEST_ASSERT_EQUAL(ESP_OK, i2c_master_start(cmd));
+    TEST_ASSERT_EQUAL(ESP_OK, i2c_master_write_byte(cmd, TEST_WRITE_ADDR, true));
+    TEST_ASSERT_EQUAL(ESP_FAIL, i2c_master_stop(cmd));
+    i2c_cmd_link_delete_static(cmd);
+
+    // the recommended size fits a burst read with room to spare
+    cmd = i2c_cmd_link_create_static(buffer + 1, sizeof(buffer) - 1);
+    TEST_ASSERT_EQUAL(ESP_OK, test_read_reg(cmd, GPIO_HOST_COUNTER_REG, data, sizeof(data)));
+    for (i = TEST_READ_CMDS; i < 2 * 5; i++) {
+        TEST_ASSERT_EQUAL(ESP_OK, i2c_master_stop(cmd));
+    }
+    TEST_ASSERT_EQUAL(ESP_FAIL, i2c_master_stop(cmd));
+    i2c_cmd_link_delete_static(cmd);
+
+    TEST_ASSERT_EQUAL(0, gpio_host_stats()->allocs);
+    test_bus_deinit();
+}
+
+static double test_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * CPU time of a MAX30100 FIFO read: building and freeing the link
+ * every time against sending a link built once
+ */
+void test_i2c_link_benchmark(void)
+{
+    const int runs = 20000;
+    uint8_t buffer[I2C_LINK_RECOMMENDED_SIZE(2)];
+    uint8_t data[4];
+    i2c_cmd_handle_t cmd;
+    double start, rebuilt, replayed;
+    int i;
+
+    test_bus_init();
+
+    start = test_now_ns();
+    for (i = 0; i < runs; i++) {
+        cmd = i2c_cmd_link_create();
+        test_read_reg(cmd, GPIO_HOST_COUNTER_REG, data, sizeof(data));
+        i2c_master_cmd_begin(I2C_NUM_0, cmd, 1000 / portTICK_PERIOD_MS);
+        i2c_cmd_link_delete(cmd);
+    }
+    rebuilt = (test_now_ns() - start) / runs;
+    TEST_ASSERT_EQUAL(runs * (1 + TEST_READ_CMDS), gpio_host_stats()->allocs);
+
+    gpio_host_stats_reset();
+    start = test_now_ns();
+    cmd = i2c_cmd_link_create_static(buffer, sizeof(buffer));
+    test_read_reg(cmd, GPIO_HOST_COUNTER_REG, data, sizeof(data));
+    for (i = 0; i < runs; i++) {
+        i2c_master_cmd_begin(I2C_NUM_0, cmd, 1000 / portTICK_PERIOD_MS);
+    }
+    i2c_cmd_link_delete_static(cmd);
+    replayed = (test_now_ns() - start) / runs;
+    TEST_ASSERT_EQUAL(0, gpio_host_stats()->allocs);
+
+    printf("i2c 4 byte register read: rebuilt %.0f ns, %d allocs; replayed %.0f ns, 0 allocs\n",
+           rebuilt, 1 + TEST_READ_CMDS, replayed);
+
+    test_bus_deinit();
+}
@@ -21,6 +21,7 @@
 #include "esp8266/rom_functions.h"
 #include "rom/ets_sys.h"
 #include "esp_err.h"
+#include "esp_log.h"
 
 #include "FreeRTOS.h"
 #include "task.h"
@@ -201,6 +202,11 @@ static __attribute__((noreturn)) void panic_info(void *frame, int wdt)
         panic_str("\r\n");
     }
 
+#ifdef CONFIG_LOG_DEFERRED
+    panic_str("\r\nDeferred log:\r\n\r\n");
+    esp_log_deferred_render(ets_putc, -1);
+#endif
+
     /*
      * Todo: add more option to select here to 'Kconfig':
      *     1. blocking
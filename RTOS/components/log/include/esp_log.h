@@ -78,6 +78,33 @@ void esp_log_level_set(const char* tag, esp_log_level_t level);
  */
 putchar_like_t esp_log_set_putchar(putchar_like_t func);
 
+#ifdef CONFIG_LOG_DEFERRED
+/**
+ * @brief Render the log records written since the last call
+ *
+ * With CONFIG_LOG_DEFERRED, esp_log_write only records the level, tag, format
+ * string and arguments into a ring buffer and returns. Records are rendered
+ * and sent to the output function by this function, either called directly
+ * or from the task started by esp_log_deferred_start. Records still in the
+ * ring are rendered by the panic handler.
+ *
+ * Tags and format strings are kept by address, so they must not be changed
+ * or released after the call, as is the case for string literals.
+ *
+ * @return number of records rendered
+ */
+int esp_log_deferred_flush(void);
+
+/**
+ * @brief Start a task rendering the deferred log records
+ *
+ * @param priority  task priority, lower than the tasks whose timing matters
+ *
+ * @return 0 on success, -1 if the task could not be created
+ */
+int esp_log_deferred_start(unsigned int priority);
+#endif /* CONFIG_LOG_DEFERRED */
+
 /**
  * @brief Write message into the log
  *
@@ -20,5 +20,14 @@ void esp_log_buffer_hex_internal(const char *tag, const void *buffer, uint16_t b
 void esp_log_buffer_char_internal(const char *tag, const void *buffer, uint16_t buff_len, esp_log_level_t level);
 void esp_log_buffer_hexdump_internal( const char *tag, const void *buffer, uint16_t buff_len, esp_log_level_t log_level);
 
+uint32_t esp_log_timestamp(void);
+
+#ifdef CONFIG_LOG_DEFERRED
+//deferred logging, records are rendered by esp_log_deferred_flush
+int esp_log_deferred_write(esp_log_level_t level, const char *tag, const char *fmt, va_list va);
+int esp_log_deferred_render(putchar_like_t func, int max);
+int esp_log_emit(putchar_like_t func, esp_log_level_t level, uint32_t timestamp, const char *tag, const char *msg);
+#endif
+
 #endif
 
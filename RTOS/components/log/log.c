@@ -68,9 +68,23 @@ typedef struct uncached_tag_entry_{
     char tag[0];    // beginning of a zero-terminated string
 } uncached_tag_entry_t;
 
+/*
+ * Levels of recently used tags keyed on the tag pointer, two slots per
+ * hash value. Only filled and cleared with s_lock held, readers check
+ * s_log_cache_seq instead of taking the lock.
+ */
+#define TAG_CACHE_BITS  5
+#define TAG_CACHE_SIZE  (1 << TAG_CACHE_BITS)
+
+typedef struct cached_tag_entry_{
+    const char *tag;
+    uint32_t level;         // esp_log_level_t
+} cached_tag_entry_t;
+
 static esp_log_level_t s_global_tag_level = ESP_LOG_VERBOSE;
 static SLIST_HEAD(log_tags_head , uncached_tag_entry_) s_log_uncached_tags = SLIST_HEAD_INITIALIZER(s_log_uncached_tags);
-static uncached_tag_entry_t *s_uncached_tag_entry_prev;
+static cached_tag_entry_t s_log_cache[TAG_CACHE_SIZE];
+static volatile uint32_t s_log_cache_seq;   // odd while the cache is being changed
 #endif /* CONFIG_LOG_SET_LEVEL */
 
 static _lock_t s_lock;
@@ -98,41 +112,93 @@ static bool esp_log_get_tag_entry(const char *tag, uncached_tag_entry_t **entry)
 
 static void clear_log_level_list(void)
 {
-    uncached_tag_entry_t *it = NULL;
+    uncached_tag_entry_t *it;
 
-    SLIST_FOREACH(it, &s_log_uncached_tags, entries) {
-        SLIST_REMOVE(&s_log_uncached_tags, it, uncached_tag_entry_, entries);
+    while ((it = SLIST_FIRST(&s_log_uncached_tags)) != NULL) {
+        SLIST_REMOVE_HEAD(&s_log_uncached_tags, entries);
         free(it);
     }
 }
 
+static inline uint32_t esp_log_cache_hash(const char *tag)
+{
+    // Fibonacci hashing of the address, the top bits pick a pair of slots
+    return ((uint32_t)(uintptr_t)tag * 2654435761u) >> (32 - TAG_CACHE_BITS) & (TAG_CACHE_SIZE - 2);
+}
+
 /**
- * @brief get level by inputting tag
+ * @brief forget the cached levels, called with s_lock held
+ */
+static void esp_log_cache_clear(void)
+{
+    s_log_cache_seq++;
+    __asm__ __volatile__("" ::: "memory");
+    memset(s_log_cache, 0, sizeof(s_log_cache));
+    __asm__ __volatile__("" ::: "memory");
+    s_log_cache_seq++;
+}
+
+/**
+ * @brief get level by inputting tag, slow path through the tag list
  */
-static esp_log_level_t esp_log_get_level(const char *tag)
+static esp_log_level_t esp_log_lookup_level(const char *tag)
 {
     esp_log_level_t out_level;
     uncached_tag_entry_t *entry;
+    cached_tag_entry_t *slot;
 
     _lock_acquire_recursive(&s_lock);
 
-    if (s_uncached_tag_entry_prev && !strcmp(s_uncached_tag_entry_prev->tag, tag)) {
-        out_level = (esp_log_level_t)s_uncached_tag_entry_prev->level;
-        goto exit;
-    }
-
-    if (esp_log_get_tag_entry(tag, &entry) == true) {
+    if (esp_log_get_tag_entry(tag, &entry) == true)
         out_level = (esp_log_level_t)entry->level;
-        s_uncached_tag_entry_prev = entry;
-        goto exit;
-    } else
+    else
         out_level = s_global_tag_level;
 
-exit:
+    // the second slot of the pair unless the first one is free
+    slot = &s_log_cache[esp_log_cache_hash(tag)];
+    if (slot->tag)
+        slot++;
+
+    s_log_cache_seq++;
+    __asm__ __volatile__("" ::: "memory");
+    if (slot->tag && slot[-1].tag) {
+        // both taken, the older entry moves up
+        slot[-1] = slot[0];
+    }
+    slot->tag = tag;
+    slot->level = out_level;
+    __asm__ __volatile__("" ::: "memory");
+    s_log_cache_seq++;
+
     _lock_release_recursive(&s_lock);
     return out_level;
 }
 
+/**
+ * @brief get level by inputting tag
+ */
+static inline esp_log_level_t esp_log_get_level(const char *tag)
+{
+    const cached_tag_entry_t *slot = &s_log_cache[esp_log_cache_hash(tag)];
+    uint32_t seq = s_log_cache_seq;
+    esp_log_level_t out_level;
+
+    __asm__ __volatile__("" ::: "memory");
+    if (slot[0].tag == tag)
+        out_level = (esp_log_level_t)slot[0].level;
+    else if (slot[1].tag == tag)
+        out_level = (esp_log_level_t)slot[1].level;
+    else
+        return esp_log_lookup_level(tag);
+    __asm__ __volatile__("" ::: "memory");
+
+    // a change in between means the slot may be torn
+    if ((seq & 1) || seq != s_log_cache_seq)
+        return esp_log_lookup_level(tag);
+
+    return out_level;
+}
+
 /**
  * @brief check if system should output data
  */
@@ -151,6 +217,9 @@ void esp_log_level_set(const char *tag, esp_log_level_t level)
 
     _lock_acquire_recursive(&s_lock);
 
+    // cached levels may be stale from here on
+    esp_log_cache_clear();
+
     if (!strcmp(tag, GLOBAL_TAG)) {
         s_global_tag_level = level;
         clear_log_level_list();
@@ -178,21 +247,75 @@ exit:
 }
 #endif /* CONFIG_LOG_SET_LEVEL */
 
-static int esp_log_write_str(const char *s)
+static int esp_log_put_str(putchar_like_t func, const char *s)
 {
     int ret;
 
     do {
-        ret = s_putchar_func(*s);
+        ret = func(*s);
     } while (ret != EOF && *++s);
 
     return ret;
 }
 
-static uint32_t esp_log_timestamp()
+#ifndef CONFIG_LOG_DEFERRED
+static int esp_log_write_str(const char *s)
+{
+    return esp_log_put_str(s_putchar_func, s);
+}
+#endif
+
+uint32_t esp_log_timestamp(void)
 {
     return clock() * (1000 / CLOCKS_PER_SEC) + esp_log_early_timestamp() % (1000 / CLOCKS_PER_SEC);
 }
+
+#ifdef CONFIG_LOG_DEFERRED
+/**
+ * @brief Output one rendered line with prefix and colors
+ */
+int esp_log_emit(putchar_like_t func, esp_log_level_t level, uint32_t timestamp, const char *tag, const char *msg)
+{
+    char buf[32];
+    char prefix = level >= ESP_LOG_MAX ? 'N' : s_log_prefix[level];
+
+#ifdef CONFIG_LOG_COLORS
+    uint32_t color = level >= ESP_LOG_MAX ? 0 : s_log_color[level];
+
+    if (color) {
+        sprintf(buf, LOG_COLOR, color);
+        if (esp_log_put_str(func, buf) == EOF)
+            return EOF;
+    }
+#endif
+    snprintf(buf, sizeof(buf), "%c (%u) ", prefix, timestamp);
+    if (esp_log_put_str(func, buf) == EOF || esp_log_put_str(func, tag) == EOF ||
+        esp_log_put_str(func, ": ") == EOF)
+        return EOF;
+    if (*msg && esp_log_put_str(func, msg) == EOF)
+        return EOF;
+#ifdef CONFIG_LOG_COLORS
+    if (color && esp_log_put_str(func, LOG_RESET_COLOR) == EOF)
+        return EOF;
+#endif
+
+    return func('\n');
+}
+
+/**
+ * @brief Render the deferred log records through the output function
+ */
+int esp_log_deferred_flush(void)
+{
+    int n;
+
+    _lock_acquire_recursive(&s_lock);
+    n = esp_log_deferred_render(s_putchar_func, -1);
+    _lock_release_recursive(&s_lock);
+
+    return n;
+}
+#endif /* CONFIG_LOG_DEFERRED */
 #endif
 
 /**
@@ -231,18 +354,27 @@ out:
  */
 void esp_log_write(esp_log_level_t level, const char *tag,  const char *fmt, ...)
 {
-    int ret;
     va_list va;
+#ifndef CONFIG_LOG_DEFERRED
+    int ret;
     char *pbuf;
     char prefix;
-
-    _lock_acquire_recursive(&s_lock);
+#endif
 
 #ifdef CONFIG_LOG_SET_LEVEL
+    // filtered out calls only look at the tag cache
     if (!should_output(level, esp_log_get_level(tag)))
-        goto exit;
+        return;
 #endif
 
+#ifdef CONFIG_LOG_DEFERRED
+    // only the raw call is recorded, esp_log_deferred_flush renders it
+    va_start(va, fmt);
+    esp_log_deferred_write(level, tag, fmt, va);
+    va_end(va);
+#else
+    _lock_acquire_recursive(&s_lock);
+
 #ifdef CONFIG_LOG_COLORS
     static char buf[16];
     uint32_t color = level >= ESP_LOG_MAX ? 0 : s_log_color[level];
@@ -286,6 +418,7 @@ out:
 
 exit:
     _lock_release_recursive(&s_lock);
+#endif
 }
 
 /**
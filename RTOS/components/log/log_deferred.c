@@ -0,0 +1,465 @@
+// Copyright 2018-2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+#if defined(CONFIG_LOG_DEFERRED) && !defined(BOOTLOADER_BUILD)
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define LOG_RING_SIZE           (CONFIG_LOG_DEFERRED_BUFFER_SIZE & ~3)
+#define LOG_RECORD_MAX          256     // largest record, header included
+#define LOG_STR_MAX             64      // longest %s argument copied into a record
+#define LOG_LINE_MAX            256     // longest rendered message
+#define LOG_SPEC_MAX            24      // longest conversion specification
+
+#define LOG_ALIGN(n)            (((n) + 3) & ~3)
+
+enum {
+    LOG_RECORD_FREE = 0,
+    LOG_RECORD_RESERVED,    // being written by esp_log_write
+    LOG_RECORD_COMMITTED,   // ready to render
+    LOG_RECORD_PAD          // filler up to the end of the ring
+};
+
+/* argument classes, tell how a conversion is stored in a record */
+enum {
+    LOG_ARG_NONE = 0,
+    LOG_ARG_INT,
+    LOG_ARG_LONG,
+    LOG_ARG_LLONG,
+    LOG_ARG_SIZE,
+    LOG_ARG_PTR,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_STR
+};
+
+/*
+ * A record is the raw call, rendering happens later against the format
+ * string and tag which stay in flash
+ */
+typedef struct log_record {
+    uint16_t size;          // bytes of the record with its arguments, multiple of 4
+    uint8_t state;
+    uint8_t level;
+    uint32_t timestamp;
+    const char *tag;
+    const char *fmt;
+    uint8_t args[0];        // arguments, each 4 byte aligned
+} log_record_t;
+
+typedef struct log_conv {
+    const char *start;      // the '%'
+    size_t len;             // length of the specification
+    uint8_t stars;          // '*' width and precision arguments
+    uint8_t arg;            // class of the converted argument
+    int precision;          // literal precision, -1 if none or '*'
+} log_conv_t;
+
+static uint8_t s_log_ring[LOG_RING_SIZE] __attribute__((aligned(4)));
+static volatile uint32_t s_log_head;    // bytes ever reserved
+static volatile uint32_t s_log_tail;    // bytes ever released
+static volatile uint32_t s_log_dropped;
+
+/**
+ * @brief find the next conversion of a format string
+ *
+ * @return pointer behind the conversion, NULL at the end of the format string
+ */
+static const char *log_next_conv(const char *fmt, log_conv_t *conv)
+{
+    const char *p;
+    int lng = 0, size = 0;
+
+    while (*fmt && (*fmt != '%' || fmt[1] == '%'))
+        fmt += *fmt == '%' ? 2 : 1;
+    if (!*fmt)
+        return NULL;
+
+    conv->start = p = fmt++;
+    conv->stars = 0;
+    conv->precision = -1;
+
+    p++;
+    while (*p && strchr("-+ #0'", *p))
+        p++;
+    if (*p == '*') {
+        conv->stars++;
+        p++;
+    } else {
+        while (*p >= '0' && *p <= '9')
+            p++;
+    }
+    if (*p == '.') {
+        p++;
+        if (*p == '*') {
+            conv->stars++;
+            p++;
+        } else {
+            conv->precision = 0;
+            while (*p >= '0' && *p <= '9')
+                conv->precision = conv->precision * 10 + *p++ - '0';
+        }
+    }
+    for (; *p && strchr("hlLqjzt", *p); p++) {
+        if (*p == 'l')
+            lng++;
+        else if (*p == 'L' || *p == 'q' || *p == 'j')
+            lng = 2;
+        else if (*p == 'z' || *p == 't')
+            size = 1;
+    }
+
+    switch (*p) {
+    case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+        conv->arg = lng >= 2 ? LOG_ARG_LLONG : lng ? LOG_ARG_LONG : size ? LOG_ARG_SIZE : LOG_ARG_INT;
+        break;
+    case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+        conv->arg = LOG_ARG_DOUBLE;
+        break;
+    case 's':
+        conv->arg = LOG_ARG_STR;
+        break;
+    case 'p':
+        conv->arg = LOG_ARG_PTR;
+        break;
+    case 'n':
+    default:
+        // %n writes back and has no place in a deferred record
+        conv->arg = *p == 'n' ? LOG_ARG_PTR : LOG_ARG_NONE;
+        break;
+    }
+
+    if (*p)
+        p++;
+    conv->len = p - conv->start;
+
+    return p;
+}
+
+static size_t log_arg_size(int arg)
+{
+    switch (arg) {
+    case LOG_ARG_LONG:   return LOG_ALIGN(sizeof(long));
+    case LOG_ARG_LLONG:  return LOG_ALIGN(sizeof(long long));
+    case LOG_ARG_SIZE:   return LOG_ALIGN(sizeof(size_t));
+    case LOG_ARG_PTR:    return LOG_ALIGN(sizeof(void *));
+    case LOG_ARG_DOUBLE: return LOG_ALIGN(sizeof(double));
+    case LOG_ARG_NONE:   return 0;
+    default:             return LOG_ALIGN(sizeof(int));
+    }
+}
+
+/**
+ * @brief copy the arguments of a call, strings are copied by value
+ *
+ * @return bytes used, -1 if they do not fit
+ */
+static int log_pack_args(uint8_t *out, size_t size, const char *fmt, va_list va)
+{
+    log_conv_t conv;
+    size_t off = 0;
+    int i;
+
+    while ((fmt = log_next_conv(fmt, &conv)) != NULL) {
+        if (off + conv.stars * sizeof(int) + LOG_ALIGN(LOG_STR_MAX + 1) + sizeof(long long) > size)
+            return -1;
+
+        for (i = 0; i < conv.stars; i++) {
+            int star = va_arg(va, int);
+
+            memcpy(out + off, &star, sizeof(star));
+            off += LOG_ALIGN(sizeof(star));
+        }
+
+        switch (conv.arg) {
+        case LOG_ARG_INT: {
+            int v = va_arg(va, int);
+            memcpy(out + off, &v, sizeof(v));
+            break;
+        }
+        case LOG_ARG_LONG: {
+            long v = va_arg(va, long);
+            memcpy(out + off, &v, sizeof(v));
+            break;
+        }
+        case LOG_ARG_LLONG: {
+            long long v = va_arg(va, long long);
+            memcpy(out + off, &v, sizeof(v));
+            break;
+        }
+        case LOG_ARG_SIZE: {
+            size_t v = va_arg(va, size_t);
+            memcpy(out + off, &v, sizeof(v));
+            break;
+        }
+        case LOG_ARG_PTR: {
+            void *v = va_arg(va, void *);
+            memcpy(out + off, &v, sizeof(v));
+            break;
+        }
+        case LOG_ARG_DOUBLE: {
+            double v = va_arg(va, double);
+            memcpy(out + off, &v, sizeof(v));
+            break;
+        }
+        case LOG_ARG_STR: {
+            const char *s = va_arg(va, const char *);
+            size_t len, max = LOG_STR_MAX;
+
+            if (!s)
+                s = "(null)";
+            if (conv.precision >= 0 && conv.precision < max)
+                max = conv.precision;
+            for (len = 0; len < max && s[len]; len++)
+                ;
+            memcpy(out + off, s, len);
+            out[off + len] = '\0';
+            off += LOG_ALIGN(len + 1);
+            continue;
+        }
+        }
+
+        off += log_arg_size(conv.arg);
+    }
+
+    return off;
+}
+
+/**
+ * @brief rebuild a conversion specification with its '*' values spelled out,
+ *        so that every conversion takes exactly one argument
+ */
+static void log_spec(char *spec, size_t size, const log_conv_t *conv, const int *stars)
+{
+    size_t i, s = 0, star = 0;
+
+    for (i = 0; i < conv->len && s + 12 < size; i++) {
+        if (conv->start[i] == '*')
+            s += sprintf(spec + s, "%d", stars[star++]);
+        else
+            spec[s++] = conv->start[i];
+    }
+    spec[i == conv->len ? s : 0] = '\0';
+}
+
+/**
+ * @brief render a record into a line, the inverse of log_pack_args
+ */
+static void log_render_args(char *line, size_t size, const char *fmt, const uint8_t *args)
+{
+    log_conv_t conv;
+    const char *next;
+    size_t out = 0, off = 0;
+
+    while (1) {
+        char spec[LOG_SPEC_MAX];
+        int stars[2], i, n = 0;
+
+        next = log_next_conv(fmt, &conv);
+
+        // literal text with "%%" folded
+        for (; *fmt && (!next || fmt < conv.start); fmt++) {
+            if (out + 1 < size)
+                line[out++] = *fmt;
+            if (*fmt == '%')
+                fmt++;
+        }
+        if (!next)
+            break;
+        fmt = next;
+
+        for (i = 0; i < conv.stars; i++) {
+            memcpy(&stars[i], args + off, sizeof(int));
+            off += LOG_ALIGN(sizeof(int));
+        }
+        log_spec(spec, sizeof(spec), &conv, stars);
+
+        switch (spec[0] && out + 1 < size ? conv.arg : LOG_ARG_NONE) {
+        case LOG_ARG_INT: {
+            int v;
+            memcpy(&v, args + off, sizeof(v));
+            n = snprintf(line + out, size - out, spec, v);
+            break;
+        }
+        case LOG_ARG_LONG: {
+            long v;
+            memcpy(&v, args + off, sizeof(v));
+            n = snprintf(line + out, size - out, spec, v);
+            break;
+        }
+        case LOG_ARG_LLONG: {
+            long long v;
+            memcpy(&v, args + off, sizeof(v));
+            n = snprintf(line + out, size - out, spec, v);
+            break;
+        }
+        case LOG_ARG_SIZE: {
+            size_t v;
+            memcpy(&v, args + off, sizeof(v));
+            n = snprintf(line + out, size - out, spec, v);
+            break;
+        }
+        case LOG_ARG_PTR: {
+            void *v;
+            memcpy(&v, args + off, sizeof(v));
+            if (conv.start[conv.len - 1] != 'n')
+                n = snprintf(line + out, size - out, spec, v);
+            break;
+        }
+        case LOG_ARG_DOUBLE: {
+            double v;
+            memcpy(&v, args + off, sizeof(v));
+            n = snprintf(line + out, size - out, spec, v);
+            break;
+        }
+        case LOG_ARG_STR:
+            n = snprintf(line + out, size - out, spec, (const char *)args + off);
+            break;
+        }
+
+        if (conv.arg == LOG_ARG_STR)
+            off += LOG_ALIGN(strlen((const char *)args + off) + 1);
+        else
+            off += log_arg_size(conv.arg);
+
+        if (n > 0)
+            out = out + n < size ? out + n : size - 1;
+    }
+
+    line[out] = '\0';
+}
+
+/**
+ * @brief reserve a record, the only step that needs exclusive access
+ */
+static log_record_t *log_reserve(size_t size)
+{
+    log_record_t *rec = NULL;
+    uint32_t pos, pad;
+
+    portENTER_CRITICAL();
+
+    pos = s_log_head % LOG_RING_SIZE;
+    pad = pos + size > LOG_RING_SIZE ? LOG_RING_SIZE - pos : 0;
+
+    if (s_log_head + pad + size - s_log_tail > LOG_RING_SIZE) {
+        s_log_dropped++;
+    } else {
+        // a gap too small for a header is skipped by the reader as well
+        if (pad >= sizeof(log_record_t)) {
+            log_record_t *filler = (log_record_t *)&s_log_ring[pos];
+
+            filler->size = pad;
+            filler->state = LOG_RECORD_PAD;
+        }
+
+        rec = (log_record_t *)&s_log_ring[(pos + pad) % LOG_RING_SIZE];
+        rec->size = size;
+        rec->state = LOG_RECORD_RESERVED;
+        s_log_head += pad + size;
+    }
+
+    portEXIT_CRITICAL();
+
+    return rec;
+}
+
+int esp_log_deferred_write(esp_log_level_t level, const char *tag, const char *fmt, va_list va)
+{
+    uint8_t args[LOG_RECORD_MAX - sizeof(log_record_t)];
+    log_record_t *rec;
+    int len;
+
+    // arguments are packed on the stack first, the ring only sees complete records
+    len = log_pack_args(args, sizeof(args), fmt, va);
+    if (len < 0)
+        len = 0, fmt = "<log record too large>";
+
+    rec = log_reserve(sizeof(log_record_t) + len);
+    if (!rec)
+        return -1;
+
+    rec->level = level;
+    rec->timestamp = esp_log_timestamp();
+    rec->tag = tag;
+    rec->fmt = fmt;
+    memcpy(rec->args, args, len);
+
+    __sync_synchronize();
+    rec->state = LOG_RECORD_COMMITTED;
+
+    return 0;
+}
+
+int esp_log_deferred_render(putchar_like_t putc_func, int max)
+{
+    char line[LOG_LINE_MAX];
+    uint32_t dropped;
+    int n = 0;
+
+    if ((dropped = s_log_dropped) != 0) {
+        s_log_dropped = 0;
+        snprintf(line, sizeof(line), "%u log records dropped", dropped);
+        esp_log_emit(putc_func, ESP_LOG_WARN, esp_log_timestamp(), "log", line);
+    }
+
+    while (s_log_tail != s_log_head && n != max) {
+        uint32_t pos = s_log_tail % LOG_RING_SIZE;
+        log_record_t *rec = (log_record_t *)&s_log_ring[pos];
+        uint32_t size;
+
+        if (LOG_RING_SIZE - pos < sizeof(log_record_t)) {
+            s_log_tail += LOG_RING_SIZE - pos;
+            continue;
+        }
+
+        if (rec->state == LOG_RECORD_COMMITTED) {
+            log_render_args(line, sizeof(line), rec->fmt, rec->args);
+            if (esp_log_emit(putc_func, rec->level, rec->timestamp, rec->tag, line) == EOF)
+                break;
+            n++;
+        } else if (rec->state != LOG_RECORD_PAD) {
+            break;  // still being written
+        }
+
+        size = rec->size;
+        rec->state = LOG_RECORD_FREE;
+        __sync_synchronize();
+        s_log_tail += size;
+    }
+
+    return n;
+}
+
+static void esp_log_deferred_task(void *arg)
+{
+    while (1) {
+        if (!esp_log_deferred_flush())
+            vTaskDelay(CONFIG_LOG_DEFERRED_FLUSH_MS / portTICK_RATE_MS);
+    }
+}
+
+int esp_log_deferred_start(unsigned int priority)
+{
+    return xTaskCreate(esp_log_deferred_task, "log", 2048, NULL, priority, NULL) == pdPASS ? 0 : -1;
+}
+
+#endif /* CONFIG_LOG_DEFERRED && !BOOTLOADER_BUILD */
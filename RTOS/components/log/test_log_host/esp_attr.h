@@ -0,0 +1,6 @@
+/*
+ * Host stand-in for esp_attr.h
+ */
+#pragma once
+
+#define IRAM_ATTR
@@ -0,0 +1,29 @@
+/*
+ * Host stand-in for esp_libc.h
+ */
+#pragma once
+
+#include <stdio.h>
+#include <time.h>
+
+/* the target counts clock() in RTOS ticks read from memory, not by a system call */
+#undef CLOCKS_PER_SEC
+#define CLOCKS_PER_SEC 100
+
+static inline clock_t test_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * CLOCKS_PER_SEC + ts.tv_nsec / (1000000000 / CLOCKS_PER_SEC);
+}
+
+#define clock() test_clock()
+
+#define ets_printf printf
+#define ets_vprintf vprintf
+
+static inline int ets_putc(int c)
+{
+    return putchar(c);
+}
@@ -0,0 +1,10 @@
+/*
+ * Host stand-in for the FreeRTOS kernel, only what the log component uses
+ */
+#pragma once
+
+#define pdPASS                  1
+#define portTICK_RATE_MS        1
+
+#define portENTER_CRITICAL()
+#define portEXIT_CRITICAL()
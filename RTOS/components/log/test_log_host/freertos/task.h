@@ -0,0 +1,15 @@
+/*
+ * Host stand-in for FreeRTOS tasks
+ */
+#pragma once
+
+#include <unistd.h>
+
+typedef void (*TaskFunction_t)(void *);
+
+int xTaskCreate(TaskFunction_t func, const char *name, unsigned int stack, void *arg, unsigned int priority, void *handle);
+
+static inline void vTaskDelay(unsigned int ticks)
+{
+    usleep(ticks * 1000);
+}
@@ -0,0 +1,21 @@
+#include "unity.h"
+
+void test_log_deferred_format(void);
+void test_log_deferred_ring(void);
+void test_log_deferred_benchmark(void);
+void test_log_level_tags(void);
+void test_log_level_many_tags(void);
+void test_log_level_benchmark(void);
+
+int main(void) {
+  UNITY_BEGIN();
+
+  RUN_TEST(test_log_deferred_format);
+  RUN_TEST(test_log_deferred_ring);
+  RUN_TEST(test_log_deferred_benchmark);
+  RUN_TEST(test_log_level_tags);
+  RUN_TEST(test_log_level_many_tags);
+  RUN_TEST(test_log_level_benchmark);
+
+  return UNITY_END();
+}
@@ -0,0 +1,4 @@
+/*
+ * Host stand-in for rom/ets_sys.h
+ */
+#pragma once
@@ -0,0 +1,10 @@
+/*
+ * Host configuration of the log component under test
+ */
+#pragma once
+
+#define CONFIG_LOG_DEFAULT_LEVEL 3
+#define CONFIG_LOG_SET_LEVEL 1
+#define CONFIG_LOG_DEFERRED 1
+#define CONFIG_LOG_DEFERRED_BUFFER_SIZE 2048
+#define CONFIG_LOG_DEFERRED_FLUSH_MS 20
@@ -0,0 +1,17 @@
+/*
+ * Host stand-in for the newlib locks used by the log component,
+ * the tests are single threaded so a lock only counts its holders
+ */
+#pragma once
+
+typedef int _lock_t;
+
+static inline void _lock_acquire_recursive(_lock_t *lock)
+{
+    (*lock)++;
+}
+
+static inline void _lock_release_recursive(_lock_t *lock)
+{
+    (*lock)--;
+}
@@ -0,0 +1,211 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "unity.h"
+#include "esp_log.h"
+#include "freertos/task.h"
+
+#define TEST_BENCH_COUNT	200000
+
+static char s_out[8192];
+static size_t s_out_len;
+
+static int test_putchar(int c)
+{
+    if (s_out_len + 1 < sizeof(s_out))
+        s_out[s_out_len++] = c;
+    s_out[s_out_len] = '\0';
+    return c;
+}
+
+static void test_out_reset(void)
+{
+    s_out_len = 0;
+    s_out[0] = '\0';
+}
+
+int xTaskCreate(TaskFunction_t func, const char *name, unsigned int stack, void *arg, unsigned int priority, void *handle)
+{
+    return 1;
+}
+
+static uint64_t test_time_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Message part of the only rendered line, behind "I (<ms>) <tag>: "
+ */
+static const char *test_message(const char *tag)
+{
+    const char *msg = strstr(s_out, tag);
+
+    TEST_ASSERT_NOT_NULL(msg);
+    TEST_ASSERT_EQUAL('\n', s_out[s_out_len - 1]);
+    s_out[s_out_len - 1] = '\0';
+    return msg + strlen(tag) + 2;
+}
+
+static void test_expect(const char *expected, const char *fmt, ...)
+{
+    char direct[256];
+    va_list va;
+
+    va_start(va, fmt);
+    vsnprintf(direct, sizeof(direct), fmt, va);
+    va_end(va);
+    TEST_ASSERT_EQUAL_STRING(expected, direct);
+
+    test_out_reset();
+    TEST_ASSERT_EQUAL(1, esp_log_deferred_flush());
+    TEST_ASSERT_EQUAL_STRING(expected, test_message("fmt"));
+}
+
+#define TEST_FORMAT(expected, fmt, ...) \
+    do { \
+        ESP_LOGI("fmt", fmt, ##__VA_ARGS__); \
+        test_expect(expected, fmt, ##__VA_ARGS__); \
+    } while (0)
+
+/*
+ * A deferred record renders to what printf would have printed
+ */
+void test_log_deferred_format(void)
+{
+    long long big = -1234567890123LL;
+    size_t len = 42;
+    char name[8] = "sensor";
+    // a NULL string the compiler cannot see, it warns about a literal one
+    const char *volatile none = NULL;
+
+    esp_log_set_putchar(test_putchar);
+    esp_log_deferred_flush();
+
+    TEST_FORMAT("plain", "plain");
+    TEST_FORMAT("100% done", "100%% done");
+    TEST_FORMAT("hr 72 spo2 98", "hr %d spo2 %u", 72, 98u);
+    TEST_FORMAT("-1234567890123 42", "%lld %zu", big, len);
+    TEST_FORMAT("0x1f 0X1F 17 c", "%#x %#X %o %c", 31, 31, 15, 'c');
+    TEST_FORMAT("[   7] [7   ] [0007]", "[%4d] [%-4d] [%04d]", 7, 7, 7);
+    TEST_FORMAT("[   7] [7.50]", "[%*d] [%.*f]", 4, 7, 2, 7.5);
+    TEST_FORMAT("3.14159 2.500000e+00", "%.5f %e", 3.14159265, 2.5);
+    TEST_FORMAT("-123456789 4294967295", "%ld %lu", -123456789L, 4294967295UL);
+    TEST_FORMAT("sensor [sen] (null)", "%s [%.3s] %s", name, name, none);
+    TEST_FORMAT("[  sensor]", "[%8s]", name);
+
+    // strings are copied when the call is made
+    ESP_LOGI("fmt", "name %s", name);
+    strcpy(name, "other");
+    test_expect("name sensor", "name %s", "sensor");
+}
+
+/*
+ * Records wrap around the ring, a full ring drops and counts
+ */
+void test_log_deferred_ring(void)
+{
+    char expected[48];
+    int i, round;
+
+    esp_log_set_putchar(test_putchar);
+    esp_log_deferred_flush();
+
+    for (round = 0; round < 50; round++) {
+        for (i = 0; i < 7; i++)
+            ESP_LOGI("ring", "round %d record %d", round, i);
+
+        test_out_reset();
+        TEST_ASSERT_EQUAL(7, esp_log_deferred_flush());
+        for (i = 0; i < 7; i++) {
+            sprintf(expected, "ring: round %d record %d\n", round, i);
+            TEST_ASSERT_NOT_NULL(strstr(s_out, expected));
+        }
+    }
+
+    // 16 bytes of header and two ints, 2048 bytes hold 85 of them
+    for (i = 0; i < 200; i++)
+        ESP_LOGW("ring", "fill %d %d", i, i);
+
+    test_out_reset();
+    i = esp_log_deferred_flush();
+    TEST_ASSERT_TRUE(i > 60 && i < 100);
+    sprintf(expected, "log: %d log records dropped", 200 - i);
+    TEST_ASSERT_NOT_NULL(strstr(s_out, expected));
+    TEST_ASSERT_NOT_NULL(strstr(s_out, "ring: fill 0 0\n"));
+    TEST_ASSERT_NULL(strstr(s_out, "ring: fill 199 199\n"));
+
+    // the task only renders what it finds
+    TEST_ASSERT_EQUAL(0, esp_log_deferred_start(1));
+    TEST_ASSERT_EQUAL(0, esp_log_deferred_flush());
+}
+
+static void test_log_direct(const char *tag, const char *fmt, ...)
+{
+    char *pbuf, *s;
+    va_list va;
+
+    if (asprintf(&pbuf, "%c (%d) %s: ", 'I', 1234, tag) < 0)
+        return;
+    for (s = pbuf; *s; s++)
+        test_putchar(*s);
+    free(pbuf);
+
+    va_start(va, fmt);
+    if (vasprintf(&pbuf, fmt, va) < 0)
+        pbuf = NULL;
+    va_end(va);
+    if (!pbuf)
+        return;
+    for (s = pbuf; *s; s++)
+        test_putchar(*s);
+    free(pbuf);
+    test_putchar('\n');
+
+    if (s_out_len > sizeof(s_out) / 2)
+        test_out_reset();
+}
+
+/*
+ * Cost of a log call in the caller, recorded vs formatted on the spot
+ */
+void test_log_deferred_benchmark(void)
+{
+    uint64_t start, deferred_ns, direct_ns, render_ns = 0;
+    int i;
+
+    esp_log_set_putchar(test_putchar);
+    esp_log_deferred_flush();
+
+    // what esp_log_write does without CONFIG_LOG_DEFERRED, less the UART
+    start = test_time_ns();
+    for (i = 0; i < TEST_BENCH_COUNT; i++)
+        test_log_direct("coap", "sample %d delay %llu us", i, 5123ULL);
+    direct_ns = test_time_ns() - start;
+
+    // batches of 32 calls keep the ring from filling up
+    deferred_ns = 0;
+    for (i = 0; i < TEST_BENCH_COUNT; i += 32) {
+        int j;
+
+        start = test_time_ns();
+        for (j = 0; j < 32; j++)
+            ESP_LOGI("coap", "sample %d delay %llu us", i + j, 5123ULL);
+        deferred_ns += test_time_ns() - start;
+
+        test_out_reset();
+        start = test_time_ns();
+        esp_log_deferred_flush();
+        render_ns += test_time_ns() - start;
+    }
+
+    printf("log call: deferred %.1f ns, formatted %.1f ns, later rendering %.1f ns\n",
+           (double)deferred_ns / TEST_BENCH_COUNT, (double)direct_ns / TEST_BENCH_COUNT,
+           (double)render_ns / TEST_BENCH_COUNT);
+}
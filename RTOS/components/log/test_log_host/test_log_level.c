@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "unity.h"
+#include "esp_log.h"
+
+#define TEST_BENCH_COUNT	1000000
+
+static const char *TAGS[] = {"coap", "om2m", "wifi", "lwip", "max30100"};
+
+static int s_lines;
+
+static int test_count_lines(int c)
+{
+    if (c == '\n')
+        s_lines++;
+    return c;
+}
+
+static int test_lines(void)
+{
+    s_lines = 0;
+    esp_log_deferred_flush();
+    return s_lines;
+}
+
+static uint64_t test_time_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Per-tag levels hold whether the tag is found by pointer or by name
+ */
+void test_log_level_tags(void)
+{
+    char copy[16];
+    int i;
+
+    esp_log_set_putchar(test_count_lines);
+    esp_log_level_set("*", ESP_LOG_INFO);
+    esp_log_level_set("coap", ESP_LOG_WARN);
+    esp_log_level_set("wifi", ESP_LOG_ERROR);
+    esp_log_level_set("om2m", ESP_LOG_NONE);
+    test_lines();
+
+    // twice, the second round hits the cache
+    for (i = 0; i < 2; i++) {
+        ESP_LOGI(TAGS[0], "filtered");
+        ESP_LOGW(TAGS[0], "emitted");
+        ESP_LOGE(TAGS[1], "filtered");
+        ESP_LOGW(TAGS[2], "filtered");
+        ESP_LOGE(TAGS[2], "emitted");
+        ESP_LOGI(TAGS[3], "emitted, global level");
+        TEST_ASSERT_EQUAL(3, test_lines());
+    }
+
+    // another string with the same name
+    strcpy(copy, "coap");
+    ESP_LOGI(copy, "filtered");
+    ESP_LOGW(copy, "emitted");
+    TEST_ASSERT_EQUAL(1, test_lines());
+
+    // changes are seen by tags already cached
+    esp_log_level_set("coap", ESP_LOG_INFO);
+    ESP_LOGI(TAGS[0], "emitted");
+    ESP_LOGI(copy, "emitted");
+    TEST_ASSERT_EQUAL(2, test_lines());
+
+    esp_log_level_set("*", ESP_LOG_WARN);
+    ESP_LOGI(TAGS[0], "filtered, per-tag levels are reset");
+    ESP_LOGI(TAGS[3], "filtered");
+    ESP_LOGW(TAGS[1], "emitted");
+    TEST_ASSERT_EQUAL(1, test_lines());
+
+    esp_log_level_set("*", ESP_LOG_VERBOSE);
+}
+
+/*
+ * More tags than cache slots, every one keeps its own level
+ */
+void test_log_level_many_tags(void)
+{
+    static char tags[100][8];
+    int i, round;
+
+    esp_log_set_putchar(test_count_lines);
+    esp_log_level_set("*", ESP_LOG_INFO);
+    for (i = 0; i < 100; i++) {
+        sprintf(tags[i], "t%d", i);
+        if (i & 1)
+            esp_log_level_set(tags[i], ESP_LOG_WARN);
+    }
+    test_lines();
+
+    for (round = 0; round < 3; round++) {
+        for (i = 0; i < 100; i++)
+            ESP_LOGI(tags[i], "even tags only");
+        TEST_ASSERT_EQUAL(50, test_lines());
+    }
+
+    esp_log_level_set("*", ESP_LOG_VERBOSE);
+}
+
+/*
+ * Cost of log calls with per-tag levels set for the tags of the application
+ */
+void test_log_level_benchmark(void)
+{
+    uint64_t start, filtered_ns, emitted_ns = 0;
+    int i, j;
+
+    esp_log_set_putchar(test_count_lines);
+    esp_log_level_set("*", ESP_LOG_INFO);
+    for (i = 0; i < sizeof(TAGS) / sizeof(TAGS[0]); i++)
+        esp_log_level_set(TAGS[i], ESP_LOG_WARN);
+    test_lines();
+
+    start = test_time_ns();
+    for (i = 0; i < TEST_BENCH_COUNT; i++)
+        ESP_LOGI(TAGS[i % 5], "filtered %d", i);
+    filtered_ns = test_time_ns() - start;
+    TEST_ASSERT_EQUAL(0, test_lines());
+
+    // batches keep the deferred ring from filling up
+    for (i = 0; i < TEST_BENCH_COUNT / 10; i += 32) {
+        start = test_time_ns();
+        for (j = 0; j < 32; j++)
+            ESP_LOGW(TAGS[j % 5], "emitted %d", i + j);
+        emitted_ns += test_time_ns() - start;
+        TEST_ASSERT_EQUAL(32, test_lines());
+    }
+
+    printf("per-tag level: filtered call %.1f ns, emitted call %.1f ns\n",
+           (double)filtered_ns / TEST_BENCH_COUNT, (double)emitted_ns / (TEST_BENCH_COUNT / 10 / 32 * 32));
+
+    esp_log_level_set("*", ESP_LOG_VERBOSE);
+}
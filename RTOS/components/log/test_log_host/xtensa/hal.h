@@ -0,0 +1,20 @@
+/*
+ * Host stand-in for the Xtensa HAL, the cycle counter read by the log
+ * timestamps is a single instruction on the target
+ */
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+static inline uint32_t xthal_get_ccount(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return (uint32_t)__builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)(ts.tv_sec * 80000000ULL + ts.tv_nsec / 25 * 2);
+#endif
+}
@@ -0,0 +1,67 @@
+// Copyright 2018-2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef _ETHERNETIF_H
+#define _ETHERNETIF_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * reasons a frame is copied before it is handed to the WiFi driver
+ */
+typedef enum ethernetif_copy_reason {
+    ETHERNETIF_COPY_CHAIN = 0,      // the frame spans several pbufs
+    ETHERNETIF_COPY_CUSTOM,         // the payload belongs to a custom pbuf, e.g. a receive buffer
+    ETHERNETIF_COPY_NOT_DRAM,       // the payload is in flash or IRAM
+
+    ETHERNETIF_COPY_MAX
+} ethernetif_copy_reason_t;
+
+/*
+ * low-level output counters, they only grow
+ */
+typedef struct ethernetif_tx_stats {
+    uint32_t    tx_direct;                          // frames handed to the driver without a copy
+    uint32_t    tx_no_mem;                          // frames dropped for lack of memory to copy them
+    uint32_t    copy_frames[ETHERNETIF_COPY_MAX];   // frames copied, by reason
+    uint32_t    copy_bytes[ETHERNETIF_COPY_MAX];    // bytes copied, by reason
+    uint32_t    copy_preallocated;                  // copies made into a preallocated frame buffer
+
+    uint32_t    retry_queued;       // TCP frames put on the resend queue
+    uint32_t    retry_duplicate;    // failures of a frame which was already queued
+    uint32_t    retry_sent;         // frames handed to the WiFi driver again
+    uint32_t    retry_released;     // frames released by TCP before they could be sent again
+    uint32_t    retry_drop_full;    // frames not queued because the queue was full
+    uint32_t    retry_drop_error;   // frames given up after repeated or hard send errors
+
+    uint16_t    retry_pending;      // frames currently queued
+    uint16_t    retry_peak;         // highest number of frames ever queued
+} ethernetif_tx_stats_t;
+
+/*
+ * @brief get a snapshot of the low-level output counters
+ *
+ * @param stats counters output
+ */
+void ethernetif_get_tx_stats(ethernetif_tx_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _ETHERNETIF_H */
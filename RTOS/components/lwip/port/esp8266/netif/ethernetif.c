@@ -24,6 +24,7 @@
 #include "freertos/semphr.h"
 #include "lwip/tcpip.h"
 #include "stdlib.h"
+#include "ethernetif.h"
 
 #include "esp8266/eagle_soc.h"
 
@@ -35,15 +36,44 @@ void wifi_station_set_default_hostname(uint8_t* hwaddr);
 #define IFNAME1 'n'
 
 
-typedef struct pbuf_send_list {
-    struct pbuf_send_list* next;
+/*
+ * TCP frames the driver failed to send wait in a FIFO ring for the TCPIP thread
+ * to send them again, a small open addressing table indexed by the pbuf address
+ * finds a frame already queued without walking the ring.
+ */
+#define TX_RETRY_MAX            LWIP_MIN(CONFIG_LWIP_TX_RETRY_QUEUE_SIZE, TCP_SND_QUEUELEN * MEMP_NUM_TCP_PCB + MEMP_NUM_TCP_PCB)
+#define TX_RETRY_HASH_BITS      (TX_RETRY_MAX <= 8 ? 4 : TX_RETRY_MAX <= 16 ? 5 : TX_RETRY_MAX <= 32 ? 6 : TX_RETRY_MAX <= 64 ? 7 : 8)
+#define TX_RETRY_HASH_SIZE      (1 << TX_RETRY_HASH_BITS)
+#define TX_RETRY_ERR_MAX        3
+
+typedef struct tx_retry {
     struct pbuf* p;
-    int aiofd;
-    int err_cnt;
-} pbuf_send_list_t;
+    uint8_t aiofd;
+    uint8_t err_cnt;
+} tx_retry_t;
+
+static tx_retry_t s_tx_retry[TX_RETRY_MAX];
+static uint8_t s_tx_retry_hash[TX_RETRY_HASH_SIZE]; /* ring index + 1, 0 is a free bucket */
+static uint16_t s_tx_retry_head;
+static uint16_t s_tx_retry_num;
+static ethernetif_tx_stats_t s_tx_stats;
+
+#if CONFIG_LWIP_TX_COPY_BUFFERS
+/*
+ * Frames which have to be copied before they are sent go to one of these
+ * buffers while one is free, with room for the 802.11 header in front
+ */
+#define TX_FRAME_SIZE           (LWIP_MEM_ALIGN_SIZE(PBUF_LINK_ENCAPSULATION_HLEN) + PBUF_LINK_HLEN + 1500)
+
+typedef struct tx_frame {
+    struct pbuf_custom pc;
+    bool busy;
+    uint32_t mem[(TX_FRAME_SIZE + 3) / 4];
+} tx_frame_t;
+
+static tx_frame_t s_tx_frame[CONFIG_LWIP_TX_COPY_BUFFERS];
+#endif
 
-static pbuf_send_list_t* pbuf_list_head = NULL;
-static int pbuf_send_list_num = 0;
 static int low_level_send_cb(esp_aio_t* aio);
 
 static inline bool check_pbuf_to_insert(struct pbuf* p)
@@ -58,121 +88,181 @@ static inline bool check_pbuf_to_insert(struct pbuf* p)
     return false;
 }
 
+static inline uint32_t tx_retry_hash(struct pbuf* p)
+{
+    return ((uint32_t)(size_t)p * 2654435761U) >> (32 - TX_RETRY_HASH_BITS);
+}
+
+/*
+ * @brief find the hash bucket of a queued pbuf
+ *
+ * @return the bucket index, -1 if the pbuf is not queued
+ */
+static int tx_retry_lookup(struct pbuf* p)
+{
+    uint32_t i = tx_retry_hash(p);
+
+    while (s_tx_retry_hash[i]) {
+        if (s_tx_retry[s_tx_retry_hash[i] - 1].p == p) {
+            return i;
+        }
+
+        i = (i + 1) & (TX_RETRY_HASH_SIZE - 1);
+    }
+
+    return -1;
+}
+
+/*
+ * @brief free a hash bucket, moving back the entries probed past it so that
+ *        no tombstone is needed
+ */
+static void tx_retry_unhash(uint32_t i)
+{
+    uint32_t j = i, k;
+
+    s_tx_retry_hash[i] = 0;
+
+    while (1) {
+        j = (j + 1) & (TX_RETRY_HASH_SIZE - 1);
+
+        if (!s_tx_retry_hash[j]) {
+            break;
+        }
+
+        k = tx_retry_hash(s_tx_retry[s_tx_retry_hash[j] - 1].p);
+
+        /* the entry stays if its home bucket lies cyclically in (i, j] */
+        if (i <= j ? (i < k && k <= j) : (i < k || k <= j)) {
+            continue;
+        }
+
+        s_tx_retry_hash[i] = s_tx_retry_hash[j];
+        s_tx_retry_hash[j] = 0;
+        i = j;
+    }
+}
+
 static void insert_to_list(int fd, struct pbuf* p)
 {
-    pbuf_send_list_t* tmp_pbuf_list1;
-    pbuf_send_list_t* tmp_pbuf_list2;
+    uint32_t i;
+    uint16_t tail;
+    int bucket;
 
-    if (pbuf_send_list_num > (TCP_SND_QUEUELEN * MEMP_NUM_TCP_PCB + MEMP_NUM_TCP_PCB)) {
+    if (!check_pbuf_to_insert(p)) {
         return;
     }
 
-    if (!check_pbuf_to_insert(p)) {
+    bucket = tx_retry_lookup(p);
+
+    if (bucket >= 0) {
+        s_tx_retry[s_tx_retry_hash[bucket] - 1].err_cnt++;
+        s_tx_stats.retry_duplicate++;
         return;
     }
 
-    LWIP_DEBUGF(PBUF_CACHE_DEBUG, ("Insert %p,%d\n", p, pbuf_send_list_num));
+    if (s_tx_retry_num >= TX_RETRY_MAX) {
+        LWIP_DEBUGF(PBUF_CACHE_DEBUG, ("pbuf list full, drop %p\n", p));
+        s_tx_stats.retry_drop_full++;
+        return;
+    }
 
-    if (pbuf_list_head == NULL) {
-        tmp_pbuf_list1 = (pbuf_send_list_t*)malloc(sizeof(pbuf_send_list_t));
+    LWIP_DEBUGF(PBUF_CACHE_DEBUG, ("Insert %p,%d\n", p, s_tx_retry_num));
 
-        if (!tmp_pbuf_list1) {
-            LWIP_DEBUGF(PBUF_CACHE_DEBUG, ("no memory malloc pbuf list error\n"));
-            return;
-        }
+    tail = s_tx_retry_head + s_tx_retry_num;
 
-        pbuf_ref(p);
-        tmp_pbuf_list1->aiofd = fd;
-        tmp_pbuf_list1->p = p;
-        tmp_pbuf_list1->next = NULL;
-        tmp_pbuf_list1->err_cnt = 0;
-        pbuf_list_head = tmp_pbuf_list1;
-        pbuf_send_list_num++;
-        return;
+    if (tail >= TX_RETRY_MAX) {
+        tail -= TX_RETRY_MAX;
     }
 
-    tmp_pbuf_list1 = pbuf_list_head;
-    tmp_pbuf_list2 = tmp_pbuf_list1;
+    pbuf_ref(p);
+    s_tx_retry[tail].aiofd = fd;
+    s_tx_retry[tail].p = p;
+    s_tx_retry[tail].err_cnt = 0;
 
-    while (tmp_pbuf_list1 != NULL) {
-        if (tmp_pbuf_list1->p == p) {
-            tmp_pbuf_list1->err_cnt ++;
-            return;
-        }
+    i = tx_retry_hash(p);
 
-        tmp_pbuf_list2 = tmp_pbuf_list1;
-        tmp_pbuf_list1 = tmp_pbuf_list2->next;
+    while (s_tx_retry_hash[i]) {
+        i = (i + 1) & (TX_RETRY_HASH_SIZE - 1);
     }
 
-    tmp_pbuf_list1 = (pbuf_send_list_t*)malloc(sizeof(pbuf_send_list_t));
+    s_tx_retry_hash[i] = tail + 1;
 
-    if (!tmp_pbuf_list1) {
-        LWIP_DEBUGF(PBUF_CACHE_DEBUG, ("no memory malloc pbuf list error\n"));
-        return;
+    s_tx_retry_num++;
+    s_tx_stats.retry_queued++;
+
+    if (s_tx_retry_num > s_tx_stats.retry_peak) {
+        s_tx_stats.retry_peak = s_tx_retry_num;
     }
+}
 
-    pbuf_ref(p);
-    tmp_pbuf_list1->aiofd = fd;
-    tmp_pbuf_list1->p = p;
-    tmp_pbuf_list1->next = NULL;
-    tmp_pbuf_list1->err_cnt = 0;
-    tmp_pbuf_list2->next = tmp_pbuf_list1;
-    pbuf_send_list_num++;
+/*
+ * @brief drop the oldest entry, its pbuf reference is passed to the caller
+ */
+static void tx_retry_pop(void)
+{
+    tx_retry_t* head = &s_tx_retry[s_tx_retry_head];
+
+    LWIP_DEBUGF(PBUF_CACHE_DEBUG, ("Delete %p,%d\n", head->p, s_tx_retry_num));
+
+    tx_retry_unhash(tx_retry_lookup(head->p));
+    head->p = NULL;
+
+    if (++s_tx_retry_head >= TX_RETRY_MAX) {
+        s_tx_retry_head = 0;
+    }
+
+    s_tx_retry_num--;
 }
 
 void send_from_list()
 {
-    pbuf_send_list_t* tmp_pbuf_list1;
-
-    while (pbuf_list_head != NULL) {
-        if (pbuf_list_head->p->ref == 1) {
-            tmp_pbuf_list1 = pbuf_list_head->next;
-            LWIP_DEBUGF(PBUF_CACHE_DEBUG, ("Delete %p,%d\n", pbuf_list_head->p, pbuf_send_list_num));
-            pbuf_free(pbuf_list_head->p);
-            free(pbuf_list_head);
-            pbuf_send_list_num--;
-            pbuf_list_head = tmp_pbuf_list1;
+    while (s_tx_retry_num) {
+        tx_retry_t* head = &s_tx_retry[s_tx_retry_head];
+        struct pbuf* p = head->p;
+
+        if (p->ref == 1) {
+            tx_retry_pop();
+            pbuf_free(p);
+            s_tx_stats.retry_released++;
         } else {
             esp_aio_t aio;
             esp_err_t err;
-            aio.fd = (int)pbuf_list_head->aiofd;
-            aio.pbuf = pbuf_list_head->p->payload;
-            aio.len = pbuf_list_head->p->len;
+            aio.fd = (int)head->aiofd;
+            aio.pbuf = p->payload;
+            aio.len = p->len;
             aio.cb = low_level_send_cb;
-            aio.arg = pbuf_list_head->p;
+            aio.arg = p;
             aio.ret = 0;
 
             err = esp_aio_sendto(&aio, NULL, 0);
-            tmp_pbuf_list1 = pbuf_list_head->next;
 
             if (err == ERR_MEM) {
-                pbuf_list_head->err_cnt++;
-
-                if (pbuf_list_head->err_cnt >= 3) {
-                    LWIP_DEBUGF(PBUF_CACHE_DEBUG, ("Delete %p,%d\n", pbuf_list_head->p, pbuf_send_list_num));
-                    pbuf_free(pbuf_list_head->p);
-                    free(pbuf_list_head);
-                    pbuf_send_list_num--;
-                    pbuf_list_head = tmp_pbuf_list1;
+                if (++head->err_cnt >= TX_RETRY_ERR_MAX) {
+                    tx_retry_pop();
+                    pbuf_free(p);
+                    s_tx_stats.retry_drop_error++;
                 }
 
                 return;
             } else if (err == ERR_OK) {
-                LWIP_DEBUGF(PBUF_CACHE_DEBUG, ("Delete %p,%d\n", pbuf_list_head->p, pbuf_send_list_num));
-                free(pbuf_list_head);
-                pbuf_send_list_num--;
-                pbuf_list_head = tmp_pbuf_list1;
+                tx_retry_pop();
+                s_tx_stats.retry_sent++;
             } else {
-                LWIP_DEBUGF(PBUF_CACHE_DEBUG, ("Delete %p,%d\n", pbuf_list_head->p, pbuf_send_list_num));
-                pbuf_free(pbuf_list_head->p);
-                free(pbuf_list_head);
-                pbuf_send_list_num--;
-                pbuf_list_head = tmp_pbuf_list1;
+                tx_retry_pop();
+                pbuf_free(p);
+                s_tx_stats.retry_drop_error++;
             }
         }
     }
 }
 
+void ethernetif_get_tx_stats(ethernetif_tx_stats_t* stats)
+{
+    *stats = s_tx_stats;
+    stats->retry_pending = s_tx_retry_num;
+}
+
 /**
  * In this function, the hardware should be initialized.
  * Called from ethernetif_init().
@@ -245,39 +335,104 @@ static int low_level_send_cb(esp_aio_t* aio)
     return 0;
 }
 
+#if CONFIG_LWIP_TX_COPY_BUFFERS
+/*
+ * @brief release a preallocated frame buffer once the driver and the resend
+ *        queue are done with it
+ */
+static void tx_frame_free(struct pbuf* p)
+{
+    ((tx_frame_t*)p)->busy = false;
+}
+
+/*
+ * @brief take a free preallocated frame buffer
+ *
+ * @return the frame pbuf, NULL if the frame does not fit or all are in flight
+ */
+static struct pbuf* tx_frame_alloc(uint16_t len)
+{
+    int i;
+
+    for (i = 0; i < CONFIG_LWIP_TX_COPY_BUFFERS; i++) {
+        tx_frame_t* frame = &s_tx_frame[i];
+        struct pbuf* p;
+
+        if (frame->busy) {
+            continue;
+        }
+
+        p = pbuf_alloced_custom(PBUF_RAW_TX, len, PBUF_RAM, &frame->pc, frame->mem, sizeof(frame->mem));
+
+        if (!p) {
+            return NULL;
+        }
+
+        frame->busy = true;
+        frame->pc.custom_free_function = tx_frame_free;
+        s_tx_stats.copy_preallocated++;
+        return p;
+    }
+
+    return NULL;
+}
+#endif
+
 /*
- * @brief transform custom pbuf to LWIP core pbuf, LWIP may use input custom pbuf
- *        to send ARP data directly
+ * @brief transform the pbuf to one the WiFi driver can send, that is a single
+ *        LWIP core pbuf whose payload is in DRAM, LWIP may use input custom
+ *        pbuf to send ARP data directly
  *
  * @param pbuf LWIP pbuf pointer
  *
- * @return LWIP pbuf pointer which it not "PBUF_FLAG_IS_CUSTOM" attribute
+ * @return LWIP pbuf pointer which it not "PBUF_FLAG_IS_CUSTOM" attribute or
+ *         comes from a preallocated frame buffer
  */
 static inline struct pbuf* ethernetif_transform_pbuf(struct pbuf* pbuf)
 {
-    struct pbuf* p;
-
-    if (!(pbuf->flags & PBUF_FLAG_IS_CUSTOM) && IS_DRAM(pbuf->payload)) {
+    struct pbuf* p = NULL;
+    ethernetif_copy_reason_t reason;
+
+    if (pbuf->next) {
+        reason = ETHERNETIF_COPY_CHAIN;
+    } else if (pbuf->flags & PBUF_FLAG_IS_CUSTOM) {
+        reason = ETHERNETIF_COPY_CUSTOM;
+    } else if (!IS_DRAM(pbuf->payload)) {
+        reason = ETHERNETIF_COPY_NOT_DRAM;
+    } else {
         /*
          * Add ref to pbuf to avoid it to be freed by upper layer.
          */
         pbuf_ref(pbuf);
+        s_tx_stats.tx_direct++;
         return pbuf;
     }
 
-    p = pbuf_alloc(PBUF_RAW, pbuf->len, PBUF_RAM);
+#if CONFIG_LWIP_TX_COPY_BUFFERS
+    p = tx_frame_alloc(pbuf->tot_len);
+#endif
 
     if (!p) {
-        return NULL;
-    }
+        p = pbuf_alloc(PBUF_RAW_TX, pbuf->tot_len, PBUF_RAM);
 
-    if (IS_IRAM(p->payload)) {
-        LWIP_DEBUGF(NETIF_DEBUG, ("low_level_output: data in IRAM\n"));
-        pbuf_free(p);
-        return NULL;
+        if (!p) {
+            s_tx_stats.tx_no_mem++;
+            return NULL;
+        }
+
+        if (IS_IRAM(p->payload)) {
+            LWIP_DEBUGF(NETIF_DEBUG, ("low_level_output: data in IRAM\n"));
+            pbuf_free(p);
+            s_tx_stats.tx_no_mem++;
+            return NULL;
+        }
     }
 
-    memcpy(p->payload, pbuf->payload, pbuf->len);
+    /* one pass over the chain, the copy is the only one the frame gets */
+    pbuf_copy_partial(pbuf, p->payload, pbuf->tot_len, 0);
+
+    s_tx_stats.copy_frames[reason]++;
+    s_tx_stats.copy_bytes[reason] += pbuf->tot_len;
 
     /*
      * The input pbuf(named "pbuf") should not be freed, becasue it will be
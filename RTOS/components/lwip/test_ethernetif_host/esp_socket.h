@@ -0,0 +1,3 @@
+#pragma once
+
+#include "ethernetif_host_compat.h"
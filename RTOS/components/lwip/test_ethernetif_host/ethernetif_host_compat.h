@@ -0,0 +1,151 @@
+/*
+ * Host stand-in for the lwIP core, the WiFi driver and the socket layer,
+ * only what the ESP8266 network interface uses
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "sdkconfig.h"
+
+typedef uint8_t u8_t;
+typedef uint16_t u16_t;
+typedef int8_t err_t;
+typedef int esp_err_t;
+
+#define ERR_OK                  0
+#define ERR_MEM                 -1
+#define ERR_RTE                 -4
+#define ERR_IF                  -12
+#define ERR_ARG                 -16
+
+#define LWIP_DEBUGF(debug, message)
+#define LWIP_MIN(x, y)          (((x) < (y)) ? (x) : (y))
+#define LWIP_MEM_ALIGN_SIZE(size) (((size) + 3U) & ~3U)
+
+#define TCP_SND_QUEUELEN        8
+#define MEMP_NUM_TCP_PCB        5
+
+#define htons(x)                __builtin_bswap16(x)
+
+/* pbuf */
+#define PBUF_LINK_ENCAPSULATION_HLEN    36u
+#define PBUF_LINK_HLEN          14
+
+#define PBUF_RAW_TX             3
+#define PBUF_RAW                4
+#define PBUF_RAM                0
+#define PBUF_REF                2
+#define PBUF_FLAG_IS_CUSTOM     0x02U
+
+struct pbuf {
+    struct pbuf *next;
+    void *payload;
+    u16_t tot_len;
+    u16_t len;
+    u8_t type;
+    u8_t flags;
+    u16_t ref;
+};
+
+typedef void (*pbuf_free_custom_fn)(struct pbuf *p);
+
+struct pbuf_custom {
+    struct pbuf pbuf;
+    pbuf_free_custom_fn custom_free_function;
+};
+
+struct pbuf *pbuf_alloc(int layer, u16_t length, int type);
+struct pbuf *pbuf_alloced_custom(int layer, u16_t length, int type, struct pbuf_custom *p,
+                                 void *payload_mem, u16_t payload_mem_len);
+void pbuf_ref(struct pbuf *p);
+u8_t pbuf_free(struct pbuf *p);
+u16_t pbuf_copy_partial(const struct pbuf *p, void *dataptr, u16_t len, u16_t offset);
+
+/* netif */
+#define NETIF_FLAG_UP           0x01U
+#define NETIF_FLAG_BROADCAST    0x02U
+#define NETIF_FLAG_LINK_UP      0x04U
+#define NETIF_FLAG_ETHARP       0x08U
+#define NETIF_FLAG_IGMP         0x40U
+
+struct netif;
+
+typedef err_t (*netif_output_fn)(struct netif *netif, struct pbuf *p, const void *ipaddr);
+typedef err_t (*netif_linkoutput_fn)(struct netif *netif, struct pbuf *p);
+typedef err_t (*netif_input_fn)(struct pbuf *p, struct netif *inp);
+
+struct netif {
+    netif_input_fn input;
+    netif_output_fn output;
+    netif_linkoutput_fn linkoutput;
+    void *state;
+    u16_t mtu;
+    u8_t hwaddr_len;
+    u8_t flags;
+    char name[2];
+};
+
+#define netif_is_up(netif)      (((netif)->flags & NETIF_FLAG_UP) ? 1 : 0)
+
+/* ethernet */
+#define ETH_HWADDR_LEN          6
+#define ETHARP_HWADDR_LEN       ETH_HWADDR_LEN
+#define ETHTYPE_IP              0x0800U
+#define ETHTYPE_ARP             0x0806U
+#define ETHTYPE_IPV6            0x86DDU
+
+struct eth_addr {
+    u8_t addr[ETH_HWADDR_LEN];
+};
+
+struct eth_hdr {
+    struct eth_addr dest;
+    struct eth_addr src;
+    u16_t type;
+} __attribute__((packed));
+
+err_t etharp_output(struct netif *netif, struct pbuf *q, const void *ipaddr);
+
+/* WiFi driver */
+typedef enum {
+    TX_STATUS_SUCCESS = 1,
+    TX_STATUS_SRC_EXCEED,
+    TX_STATUS_LRC_EXCEED,
+    TX_STATUS_DISCARD,
+} wifi_tx_result_t;
+
+typedef struct {
+    unsigned wifi_tx_result: 8;
+    unsigned wifi_tx_src: 6;
+    unsigned wifi_tx_lrc: 6;
+    unsigned wifi_tx_rate: 8;
+    unsigned unused: 4;
+} wifi_tx_status_t;
+
+/* socket layer */
+struct esp_aio;
+
+typedef int (*esp_aio_cb_t)(struct esp_aio *aio);
+
+typedef struct esp_aio {
+    int fd;
+    const char *pbuf;
+    size_t len;
+    esp_aio_cb_t cb;
+    void *arg;
+    int ret;
+} esp_aio_t;
+
+struct sockaddr_ll;
+typedef uint32_t socklen_t;
+
+int esp_aio_sendto(esp_aio_t *aio, const struct sockaddr_ll *to, socklen_t len);
+
+/* memory map, the tests decide where a payload lives */
+extern int (*test_is_dram)(const void *addr);
+
+#define IS_DRAM(a)              test_is_dram(a)
+#define IS_IRAM(a)              0
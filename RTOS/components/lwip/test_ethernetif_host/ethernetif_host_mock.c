@@ -0,0 +1,140 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "ethernetif_host_compat.h"
+#include "ethernetif_host_mock.h"
+
+#define PBUF_HEADROOM           PBUF_LINK_ENCAPSULATION_HLEN
+
+int mock_pbuf_live;
+mock_driver_t mock_driver;
+
+static int mock_is_dram(const void *addr) {
+    return 1;
+}
+
+int (*test_is_dram)(const void *addr) = mock_is_dram;
+
+struct pbuf *pbuf_alloc(int layer, u16_t length, int type) {
+    struct pbuf *p = calloc(1, sizeof(*p) + PBUF_HEADROOM + length);
+
+    if (!p) {
+        return NULL;
+    }
+
+    // room in front of the payload, the driver keeps the 802.11 header there
+    p->payload = (uint8_t *)(p + 1) + PBUF_HEADROOM;
+    p->tot_len = p->len = length;
+    p->ref = 1;
+    mock_pbuf_live++;
+
+    return p;
+}
+
+void pbuf_ref(struct pbuf *p) {
+    p->ref++;
+}
+
+struct pbuf *pbuf_alloced_custom(int layer, u16_t length, int type, struct pbuf_custom *p,
+                                 void *payload_mem, u16_t payload_mem_len) {
+    u16_t offset = layer == PBUF_RAW_TX ? LWIP_MEM_ALIGN_SIZE(PBUF_LINK_ENCAPSULATION_HLEN) : 0;
+
+    if (offset + length > payload_mem_len) {
+        return NULL;
+    }
+
+    memset(p, 0, sizeof(*p));
+    p->pbuf.payload = (uint8_t *)payload_mem + offset;
+    p->pbuf.tot_len = p->pbuf.len = length;
+    p->pbuf.flags = PBUF_FLAG_IS_CUSTOM;
+    p->pbuf.ref = 1;
+
+    return &p->pbuf;
+}
+
+u8_t pbuf_free(struct pbuf *p) {
+    u8_t count = 0;
+
+    while (p && --p->ref == 0) {
+        struct pbuf *next = p->next;
+
+        if (p->flags & PBUF_FLAG_IS_CUSTOM) {
+            ((struct pbuf_custom *)p)->custom_free_function(p);
+        } else {
+            free(p);
+            mock_pbuf_live--;
+        }
+
+        count++;
+        p = next;
+    }
+
+    return count;
+}
+
+/* the interface only copies whole frames, the offset is always 0 */
+u16_t pbuf_copy_partial(const struct pbuf *p, void *dataptr, u16_t len, u16_t offset) {
+    u16_t copied = 0;
+
+    for (; p && copied < len; p = p->next) {
+        u16_t n = LWIP_MIN(p->len, len - copied);
+
+        memcpy((uint8_t *)dataptr + copied, p->payload, n);
+        copied += n;
+    }
+
+    return copied;
+}
+
+err_t etharp_output(struct netif *netif, struct pbuf *q, const void *ipaddr) {
+    return ERR_OK;
+}
+
+/*
+ * The WiFi driver, frames are accepted while there is budget left and
+ * completed later by mock_driver_complete
+ */
+int8_t ieee80211_output_pbuf(uint8_t fd, uint8_t *dataptr, uint16_t datalen) {
+    mock_driver.calls++;
+
+    if (mock_driver.budget == 0) {
+        return ERR_MEM;
+    }
+
+    if (mock_driver.budget > 0) {
+        mock_driver.budget--;
+    }
+
+    return ERR_OK;
+}
+
+/*
+ * The socket layer, hands the frame to the driver and keeps the control
+ * block of the accepted ones until the transmission completes
+ */
+int esp_aio_sendto(esp_aio_t *aio, const struct sockaddr_ll *to, socklen_t len) {
+    int ret = ieee80211_output_pbuf(aio->fd, (uint8_t *)aio->pbuf, aio->len);
+
+    if (ret == ERR_OK) {
+        if (mock_driver.inflight_num >= MOCK_DRIVER_INFLIGHT_MAX) {
+            abort();
+        }
+        mock_driver.inflight[mock_driver.inflight_num++] = *aio;
+    }
+
+    return ret;
+}
+
+void mock_driver_complete(int result) {
+    int i, num = mock_driver.inflight_num;
+
+    mock_driver.inflight_num = 0;
+
+    for (i = 0; i < num; i++) {
+        esp_aio_t *aio = &mock_driver.inflight[i];
+        wifi_tx_status_t *status = (wifi_tx_status_t *)&aio->ret;
+
+        status->wifi_tx_result = result;
+        aio->cb(aio);
+    }
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "ethernetif_host_compat.h"
+
+#define MOCK_DRIVER_INFLIGHT_MAX    64
+
+typedef struct {
+    int budget;                 // frames accepted before the driver runs out of buffers, -1 for no limit
+    int calls;
+    esp_aio_t inflight[MOCK_DRIVER_INFLIGHT_MAX];
+    int inflight_num;
+} mock_driver_t;
+
+extern mock_driver_t mock_driver;
+extern int mock_pbuf_live;
+
+int8_t ieee80211_output_pbuf(uint8_t fd, uint8_t *dataptr, uint16_t datalen);
+
+/*
+ * @brief finish the transmission of the accepted frames
+ *
+ * @param result one of wifi_tx_result_t
+ */
+void mock_driver_complete(int result);
@@ -0,0 +1,25 @@
+#include "unity.h"
+
+void test_ethernetif_retry_fifo(void);
+void test_ethernetif_retry_duplicate(void);
+void test_ethernetif_retry_full(void);
+void test_ethernetif_retry_model(void);
+void test_ethernetif_copy_direct(void);
+void test_ethernetif_copy_flash(void);
+void test_ethernetif_copy_chain(void);
+void test_ethernetif_copy_custom(void);
+
+int main(void) {
+  UNITY_BEGIN();
+
+  RUN_TEST(test_ethernetif_retry_fifo);
+  RUN_TEST(test_ethernetif_retry_duplicate);
+  RUN_TEST(test_ethernetif_retry_full);
+  RUN_TEST(test_ethernetif_retry_model);
+  RUN_TEST(test_ethernetif_copy_direct);
+  RUN_TEST(test_ethernetif_copy_flash);
+  RUN_TEST(test_ethernetif_copy_chain);
+  RUN_TEST(test_ethernetif_copy_custom);
+
+  return UNITY_END();
+}
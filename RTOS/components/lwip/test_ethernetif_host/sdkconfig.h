@@ -0,0 +1,7 @@
+/*
+ * Host stand-in for the build configuration
+ */
+#pragma once
+
+#define CONFIG_LWIP_TX_RETRY_QUEUE_SIZE 16
+#define CONFIG_LWIP_TX_COPY_BUFFERS 1
@@ -0,0 +1,190 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "unity.h"
+#include "ethernetif_host_mock.h"
+#include "ethernetif.h"
+
+err_t ethernetif_init(struct netif *netif);
+
+/* stands for a constant string in flash */
+static const char s_flash_payload[] = "{\"m2m:cin\":{\"cnf\":\"application/json\",\"con\":\"\"}}";
+
+static struct netif s_netif;
+
+static int test_is_dram_not_flash(const void *addr) {
+    return (const char *)addr < s_flash_payload || (const char *)addr >= s_flash_payload + sizeof(s_flash_payload);
+}
+
+static void test_copy_init(void) {
+    memset(&mock_driver, 0, sizeof(mock_driver));
+    mock_driver.budget = -1;
+    mock_pbuf_live = 0;
+    test_is_dram = test_is_dram_not_flash;
+
+    ethernetif_init(&s_netif);
+    s_netif.flags |= NETIF_FLAG_UP;
+    s_netif.state = (void *)1;
+}
+
+static struct pbuf *test_ram(uint16_t len, uint8_t fill) {
+    struct pbuf *p = pbuf_alloc(PBUF_RAW, len, PBUF_RAM);
+
+    memset(p->payload, fill, len);
+    return p;
+}
+
+static struct pbuf *test_ref(const void *payload, uint16_t len) {
+    struct pbuf *p = pbuf_alloc(PBUF_RAW, 0, PBUF_REF);
+
+    p->payload = (void *)payload;
+    p->tot_len = p->len = len;
+    p->type = PBUF_REF;
+    return p;
+}
+
+static ethernetif_tx_stats_t test_stats(void) {
+    ethernetif_tx_stats_t stats;
+
+    ethernetif_get_tx_stats(&stats);
+    return stats;
+}
+
+/*
+ * A single pbuf in DRAM goes to the driver as it is
+ */
+void test_ethernetif_copy_direct(void) {
+    ethernetif_tx_stats_t before, after;
+    struct pbuf *p;
+
+    test_copy_init();
+    before = test_stats();
+
+    p = test_ram(100, 0x5a);
+    TEST_ASSERT_EQUAL(ERR_OK, s_netif.linkoutput(&s_netif, p));
+
+    after = test_stats();
+    TEST_ASSERT_EQUAL(1, after.tx_direct - before.tx_direct);
+    TEST_ASSERT_EQUAL(0, after.copy_frames[ETHERNETIF_COPY_NOT_DRAM] - before.copy_frames[ETHERNETIF_COPY_NOT_DRAM]);
+    TEST_ASSERT_EQUAL(1, mock_driver.inflight_num);
+    TEST_ASSERT_EQUAL_PTR(p->payload, mock_driver.inflight[0].pbuf);
+    TEST_ASSERT_EQUAL(2, p->ref);
+
+    mock_driver_complete(TX_STATUS_SUCCESS);
+    pbuf_free(p);
+    TEST_ASSERT_EQUAL(0, mock_pbuf_live);
+}
+
+/*
+ * A frame the driver cannot read in place is copied once into a
+ * preallocated buffer, the heap is the fallback while it is in flight
+ */
+void test_ethernetif_copy_flash(void) {
+    ethernetif_tx_stats_t before, after;
+    struct pbuf *p;
+    int i;
+
+    test_copy_init();
+    before = test_stats();
+
+    for (i = 0; i < 2; i++) {
+        p = test_ref(s_flash_payload, sizeof(s_flash_payload));
+        s_netif.linkoutput(&s_netif, p);
+        pbuf_free(p);
+    }
+
+    after = test_stats();
+    TEST_ASSERT_EQUAL(2, after.copy_frames[ETHERNETIF_COPY_NOT_DRAM] - before.copy_frames[ETHERNETIF_COPY_NOT_DRAM]);
+    TEST_ASSERT_EQUAL(2 * sizeof(s_flash_payload), after.copy_bytes[ETHERNETIF_COPY_NOT_DRAM] - before.copy_bytes[ETHERNETIF_COPY_NOT_DRAM]);
+    TEST_ASSERT_EQUAL(1, after.copy_preallocated - before.copy_preallocated);
+    TEST_ASSERT_EQUAL(0, after.tx_direct - before.tx_direct);
+
+    TEST_ASSERT_EQUAL(2, mock_driver.inflight_num);
+    for (i = 0; i < 2; i++) {
+        TEST_ASSERT_TRUE(mock_driver.inflight[i].pbuf != s_flash_payload);
+        TEST_ASSERT_EQUAL(sizeof(s_flash_payload), mock_driver.inflight[i].len);
+        TEST_ASSERT_EQUAL_MEMORY(s_flash_payload, mock_driver.inflight[i].pbuf, sizeof(s_flash_payload));
+    }
+    // the first copy went to the preallocated buffer, the second one to the heap
+    TEST_ASSERT_TRUE(((struct pbuf *)mock_driver.inflight[0].arg)->flags & PBUF_FLAG_IS_CUSTOM);
+    TEST_ASSERT_FALSE(((struct pbuf *)mock_driver.inflight[1].arg)->flags & PBUF_FLAG_IS_CUSTOM);
+    TEST_ASSERT_EQUAL(1, mock_pbuf_live);
+
+    // once sent the buffer serves the next copy
+    mock_driver_complete(TX_STATUS_SUCCESS);
+    TEST_ASSERT_EQUAL(0, mock_pbuf_live);
+
+    p = test_ref(s_flash_payload, sizeof(s_flash_payload));
+    s_netif.linkoutput(&s_netif, p);
+    pbuf_free(p);
+    TEST_ASSERT_EQUAL(2, test_stats().copy_preallocated - before.copy_preallocated);
+
+    mock_driver_complete(TX_STATUS_SUCCESS);
+    TEST_ASSERT_EQUAL(0, mock_pbuf_live);
+}
+
+/*
+ * A chain goes to the driver as one frame, whatever memory its parts are in
+ */
+void test_ethernetif_copy_chain(void) {
+    ethernetif_tx_stats_t before, after;
+    struct pbuf *hdr, *data;
+    const uint8_t *frame;
+
+    test_copy_init();
+    before = test_stats();
+
+    hdr = test_ram(42, 0xa5);
+    data = test_ref(s_flash_payload, sizeof(s_flash_payload));
+    hdr->next = data;
+    hdr->tot_len = hdr->len + data->len;
+
+    s_netif.linkoutput(&s_netif, hdr);
+
+    after = test_stats();
+    TEST_ASSERT_EQUAL(1, after.copy_frames[ETHERNETIF_COPY_CHAIN] - before.copy_frames[ETHERNETIF_COPY_CHAIN]);
+    TEST_ASSERT_EQUAL(hdr->tot_len, after.copy_bytes[ETHERNETIF_COPY_CHAIN] - before.copy_bytes[ETHERNETIF_COPY_CHAIN]);
+    TEST_ASSERT_EQUAL(0, after.copy_frames[ETHERNETIF_COPY_NOT_DRAM] - before.copy_frames[ETHERNETIF_COPY_NOT_DRAM]);
+
+    TEST_ASSERT_EQUAL(1, mock_driver.inflight_num);
+    TEST_ASSERT_EQUAL(hdr->tot_len, mock_driver.inflight[0].len);
+    frame = (const uint8_t *)mock_driver.inflight[0].pbuf;
+    TEST_ASSERT_EACH_EQUAL_HEX8(0xa5, frame, 42);
+    TEST_ASSERT_EQUAL_MEMORY(s_flash_payload, frame + 42, sizeof(s_flash_payload));
+
+    mock_driver_complete(TX_STATUS_SUCCESS);
+    pbuf_free(hdr);
+    TEST_ASSERT_EQUAL(0, mock_pbuf_live);
+}
+
+static void test_rx_free(struct pbuf *p) {
+    free(p);
+}
+
+/*
+ * A receive buffer of the driver, e.g. answered in place by ARP, is copied
+ */
+void test_ethernetif_copy_custom(void) {
+    ethernetif_tx_stats_t before, after;
+    struct pbuf_custom *rx = calloc(1, sizeof(*rx) + 64);
+    struct pbuf *p;
+
+    test_copy_init();
+    before = test_stats();
+
+    p = pbuf_alloced_custom(PBUF_RAW, 60, PBUF_REF, rx, rx + 1, 64);
+    rx->custom_free_function = test_rx_free;
+    memset(p->payload, 0x11, 60);
+
+    s_netif.linkoutput(&s_netif, p);
+
+    after = test_stats();
+    TEST_ASSERT_EQUAL(1, after.copy_frames[ETHERNETIF_COPY_CUSTOM] - before.copy_frames[ETHERNETIF_COPY_CUSTOM]);
+    TEST_ASSERT_EQUAL(60, after.copy_bytes[ETHERNETIF_COPY_CUSTOM] - before.copy_bytes[ETHERNETIF_COPY_CUSTOM]);
+    TEST_ASSERT_EQUAL(1, p->ref);
+    TEST_ASSERT_TRUE(mock_driver.inflight[0].pbuf != p->payload);
+
+    pbuf_free(p);
+    mock_driver_complete(TX_STATUS_SUCCESS);
+    TEST_ASSERT_EQUAL(0, mock_pbuf_live);
+}
@@ -0,0 +1,289 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "unity.h"
+#include "ethernetif_host_mock.h"
+#include "ethernetif.h"
+
+#define TEST_QUEUE_SIZE         CONFIG_LWIP_TX_RETRY_QUEUE_SIZE
+#define TEST_FRAME_LEN          64
+
+err_t ethernetif_init(struct netif *netif);
+void send_from_list();
+
+static struct netif s_netif;
+
+static void test_retry_init(void) {
+    memset(&mock_driver, 0, sizeof(mock_driver));
+    mock_driver.budget = -1;
+    mock_pbuf_live = 0;
+
+    ethernetif_init(&s_netif);
+    s_netif.flags |= NETIF_FLAG_UP;
+    s_netif.state = (void *)1;
+}
+
+/*
+ * A frame as TCP hands it to the interface, the 802.11 header in front of
+ * the payload marks it as sent to the DS
+ */
+static struct pbuf *test_frame(bool tcp, uint16_t id) {
+    struct pbuf *p = pbuf_alloc(PBUF_RAW, TEST_FRAME_LEN, PBUF_RAM);
+    uint8_t *buf = p->payload;
+
+    buf[12] = 0x08;
+    buf[13] = 0x00;
+    buf[23] = tcp ? 0x06 : 0x11;
+    memcpy(&buf[40], &id, sizeof(id));
+    *(buf - 17) = 0x02;
+
+    return p;
+}
+
+static uint16_t test_frame_id(const void *payload) {
+    uint16_t id;
+
+    memcpy(&id, (const uint8_t *)payload + 40, sizeof(id));
+    return id;
+}
+
+static err_t test_output(struct pbuf *p) {
+    return s_netif.linkoutput(&s_netif, p);
+}
+
+static ethernetif_tx_stats_t test_stats_delta(const ethernetif_tx_stats_t *before) {
+    ethernetif_tx_stats_t now;
+
+    ethernetif_get_tx_stats(&now);
+    now.retry_queued -= before->retry_queued;
+    now.retry_duplicate -= before->retry_duplicate;
+    now.retry_sent -= before->retry_sent;
+    now.retry_released -= before->retry_released;
+    now.retry_drop_full -= before->retry_drop_full;
+    now.retry_drop_error -= before->retry_drop_error;
+
+    return now;
+}
+
+/*
+ * TCP frames refused by the driver go out again in the order they failed,
+ * other frames are left to their protocol
+ */
+void test_ethernetif_retry_fifo(void) {
+    struct pbuf *frames[6];
+    ethernetif_tx_stats_t before, stats;
+    int i;
+
+    test_retry_init();
+    ethernetif_get_tx_stats(&before);
+
+    mock_driver.budget = 0;
+    for (i = 0; i < 6; i++) {
+        frames[i] = test_frame(i != 3, i);
+        TEST_ASSERT_EQUAL(ERR_OK, test_output(frames[i]));
+    }
+
+    stats = test_stats_delta(&before);
+    TEST_ASSERT_EQUAL(5, stats.retry_queued);
+    TEST_ASSERT_EQUAL(5, stats.retry_pending);
+    TEST_ASSERT_EQUAL(0, mock_driver.inflight_num);
+
+    mock_driver.budget = -1;
+    send_from_list();
+
+    stats = test_stats_delta(&before);
+    TEST_ASSERT_EQUAL(5, stats.retry_sent);
+    TEST_ASSERT_EQUAL(0, stats.retry_pending);
+    TEST_ASSERT_EQUAL(5, mock_driver.inflight_num);
+    TEST_ASSERT_EQUAL(0, test_frame_id(mock_driver.inflight[0].pbuf));
+    TEST_ASSERT_EQUAL(1, test_frame_id(mock_driver.inflight[1].pbuf));
+    TEST_ASSERT_EQUAL(2, test_frame_id(mock_driver.inflight[2].pbuf));
+    TEST_ASSERT_EQUAL(4, test_frame_id(mock_driver.inflight[3].pbuf));
+    TEST_ASSERT_EQUAL(5, test_frame_id(mock_driver.inflight[4].pbuf));
+
+    mock_driver_complete(TX_STATUS_SUCCESS);
+    for (i = 0; i < 6; i++) {
+        TEST_ASSERT_EQUAL(1, frames[i]->ref);
+        pbuf_free(frames[i]);
+    }
+    TEST_ASSERT_EQUAL(0, mock_pbuf_live);
+}
+
+/*
+ * A frame failing again while queued keeps its place and spends its
+ * attempts, a frame TCP let go is not sent
+ */
+void test_ethernetif_retry_duplicate(void) {
+    struct pbuf *p, *acked;
+    ethernetif_tx_stats_t before, stats;
+
+    test_retry_init();
+    ethernetif_get_tx_stats(&before);
+
+    mock_driver.budget = 0;
+    p = test_frame(true, 1);
+    acked = test_frame(true, 2);
+    test_output(p);
+    test_output(p);
+    test_output(acked);
+
+    stats = test_stats_delta(&before);
+    TEST_ASSERT_EQUAL(2, stats.retry_queued);
+    TEST_ASSERT_EQUAL(1, stats.retry_duplicate);
+    TEST_ASSERT_EQUAL(2, stats.retry_pending);
+
+    // the duplicate counted as a failed attempt, two more give up the frame
+    send_from_list();
+    TEST_ASSERT_EQUAL(0, test_stats_delta(&before).retry_drop_error);
+    send_from_list();
+    stats = test_stats_delta(&before);
+    TEST_ASSERT_EQUAL(1, stats.retry_drop_error);
+    TEST_ASSERT_EQUAL(1, stats.retry_pending);
+    TEST_ASSERT_EQUAL(1, p->ref);
+
+    pbuf_free(acked);
+    send_from_list();
+    stats = test_stats_delta(&before);
+    TEST_ASSERT_EQUAL(1, stats.retry_released);
+    TEST_ASSERT_EQUAL(0, stats.retry_pending);
+    TEST_ASSERT_EQUAL(0, mock_driver.inflight_num);
+
+    // a transmission failing in the air comes back to the queue
+    mock_driver.budget = -1;
+    test_output(p);
+    mock_driver_complete(TX_STATUS_DISCARD);
+    stats = test_stats_delta(&before);
+    TEST_ASSERT_EQUAL(3, stats.retry_queued);
+    TEST_ASSERT_EQUAL(1, stats.retry_pending);
+
+    send_from_list();
+    mock_driver_complete(TX_STATUS_SUCCESS);
+    TEST_ASSERT_EQUAL(0, test_stats_delta(&before).retry_pending);
+
+    pbuf_free(p);
+    TEST_ASSERT_EQUAL(0, mock_pbuf_live);
+}
+
+/*
+ * The queue is bounded, the frames failing while it is full are dropped
+ * and counted
+ */
+void test_ethernetif_retry_full(void) {
+    struct pbuf *frames[TEST_QUEUE_SIZE + 4];
+    ethernetif_tx_stats_t before, stats;
+    int i;
+
+    test_retry_init();
+    ethernetif_get_tx_stats(&before);
+
+    mock_driver.budget = 0;
+    for (i = 0; i < TEST_QUEUE_SIZE + 4; i++) {
+        frames[i] = test_frame(true, i);
+        test_output(frames[i]);
+    }
+
+    stats = test_stats_delta(&before);
+    TEST_ASSERT_EQUAL(TEST_QUEUE_SIZE, stats.retry_queued);
+    TEST_ASSERT_EQUAL(4, stats.retry_drop_full);
+    TEST_ASSERT_EQUAL(TEST_QUEUE_SIZE, stats.retry_pending);
+    TEST_ASSERT_EQUAL(TEST_QUEUE_SIZE, stats.retry_peak);
+
+    // the driver takes a few, the rest stays in order
+    mock_driver.budget = 5;
+    send_from_list();
+    mock_driver.budget = -1;
+    send_from_list();
+
+    TEST_ASSERT_EQUAL(TEST_QUEUE_SIZE, mock_driver.inflight_num);
+    for (i = 0; i < TEST_QUEUE_SIZE; i++) {
+        TEST_ASSERT_EQUAL(i, test_frame_id(mock_driver.inflight[i].pbuf));
+    }
+
+    mock_driver_complete(TX_STATUS_SUCCESS);
+    for (i = 0; i < TEST_QUEUE_SIZE + 4; i++) {
+        pbuf_free(frames[i]);
+    }
+    TEST_ASSERT_EQUAL(0, mock_pbuf_live);
+}
+
+/*
+ * Random failures and resends against a plain FIFO model, the lookup table
+ * must keep finding every queued frame while entries come and go
+ */
+void test_ethernetif_retry_model(void) {
+    struct pbuf *frames[TEST_QUEUE_SIZE * 4];
+    struct pbuf *model[TEST_QUEUE_SIZE];
+    int err_cnt[TEST_QUEUE_SIZE];
+    int head = 0, num = 0, round, i;
+    ethernetif_tx_stats_t before, stats;
+    uint32_t duplicates = 0, dropped = 0;
+
+    test_retry_init();
+    ethernetif_get_tx_stats(&before);
+    srand(34);
+
+    for (i = 0; i < TEST_QUEUE_SIZE * 4; i++) {
+        frames[i] = test_frame(true, i);
+    }
+
+    for (round = 0; round < 20000; round++) {
+        struct pbuf *p = frames[rand() % (TEST_QUEUE_SIZE * 4)];
+        int found = -1;
+
+        for (i = 0; i < num; i++) {
+            if (model[(head + i) % TEST_QUEUE_SIZE] == p) {
+                found = (head + i) % TEST_QUEUE_SIZE;
+            }
+        }
+
+        if (rand() % 3) {
+            // the frame fails
+            mock_driver.budget = 0;
+            test_output(p);
+
+            if (found >= 0) {
+                err_cnt[found]++;
+                duplicates++;
+            } else if (num < TEST_QUEUE_SIZE) {
+                model[(head + num) % TEST_QUEUE_SIZE] = p;
+                err_cnt[(head + num) % TEST_QUEUE_SIZE] = 0;
+                num++;
+            }
+        } else {
+            // the driver takes some of the queued frames
+            int budget = rand() % 4;
+
+            mock_driver.budget = budget;
+            send_from_list();
+            mock_driver_complete(TX_STATUS_SUCCESS);
+
+            while (num && budget--) {
+                head = (head + 1) % TEST_QUEUE_SIZE;
+                num--;
+            }
+
+            if (num && ++err_cnt[head] >= 3) {
+                head = (head + 1) % TEST_QUEUE_SIZE;
+                num--;
+                dropped++;
+            }
+        }
+
+        stats = test_stats_delta(&before);
+        TEST_ASSERT_EQUAL(num, stats.retry_pending);
+        TEST_ASSERT_EQUAL(duplicates, stats.retry_duplicate);
+        TEST_ASSERT_EQUAL(dropped, stats.retry_drop_error);
+    }
+
+    mock_driver.budget = -1;
+    send_from_list();
+    for (i = 0; i < num; i++) {
+        TEST_ASSERT_EQUAL_PTR(model[(head + i) % TEST_QUEUE_SIZE], mock_driver.inflight[i].arg);
+    }
+    mock_driver_complete(TX_STATUS_SUCCESS);
+
+    for (i = 0; i < TEST_QUEUE_SIZE * 4; i++) {
+        pbuf_free(frames[i]);
+    }
+    TEST_ASSERT_EQUAL(0, mock_pbuf_live);
+}
@@ -74,6 +74,8 @@ typedef struct mdns_result_s {
     size_t txt_count;                       /*!< number of txt items */
     // A and AAAA
     mdns_ip_addr_t * addr;                  /*!< linked list of IP addreses found */
+
+    uint32_t ttl;                           /*!< lowest TTL in seconds of the records the result was built from */
 } mdns_result_t;
 
 /**
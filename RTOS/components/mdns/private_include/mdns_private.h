@@ -59,6 +59,7 @@
 #define MDNS_NAME_MAX_LEN           64                      // Maximum string length of hostname, instance, service and proto
 #define MDNS_NAME_BUF_LEN           (MDNS_NAME_MAX_LEN+1)   // Maximum char buffer size to hold hostname, instance, service or proto
 #define MDNS_MAX_PACKET_SIZE        1460                    // Maximum size of mDNS  outgoing packet
+#define MDNS_NAME_TABLE_LEN         64                      // Maximum name suffixes remembered to compress an outgoing packet
 
 #define MDNS_HEAD_LEN               12
 #define MDNS_HEAD_ID_OFFSET         0
@@ -248,8 +249,16 @@ typedef struct {
     uint16_t weight;
     uint16_t port;
     mdns_txt_linked_item_t * txt;
+    uint16_t hash;                          /*!< case insensitive hash of service and proto */
+    uint8_t * txt_data;                     /*!< encoded TXT items, NULL until needed or after they change */
+    uint16_t txt_data_len;
 } mdns_service_t;
 
+typedef struct {
+    uint16_t hash;                          /*!< hash of the name starting at offset */
+    uint16_t offset;                        /*!< offset of the first label in the packet */
+} mdns_name_ref_t;
+
 typedef struct mdns_srv_item_s {
     struct mdns_srv_item_s * next;
     mdns_service_t * service;
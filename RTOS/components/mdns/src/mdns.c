@@ -18,6 +18,7 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <ctype.h>
 
 #ifdef MDNS_ENABLE_DEBUG
 void mdns_debug_packet(const uint8_t * data, size_t len);
@@ -28,15 +29,19 @@ static const char * MDNS_SUB_STR = "_sub";
 
 mdns_server_t * _mdns_server = NULL;
 
+static mdns_name_ref_t _mdns_name_table[MDNS_NAME_TABLE_LEN];
+static uint8_t _mdns_name_table_len = 0;
+
 static volatile TaskHandle_t _mdns_service_task_handle = NULL;
 static SemaphoreHandle_t _mdns_service_semaphore = NULL;
 
 static void _mdns_search_finish_done();
 static mdns_search_once_t * _mdns_search_find_from(mdns_search_once_t * search, mdns_name_t * name, uint16_t type, tcpip_adapter_if_t tcpip_if, mdns_ip_protocol_t ip_protocol);
-static void _mdns_search_result_add_ip(mdns_search_once_t * search, const char * hostname, ip_addr_t * ip, tcpip_adapter_if_t tcpip_if, mdns_ip_protocol_t ip_protocol);
-static void _mdns_search_result_add_srv(mdns_search_once_t * search, const char * hostname, uint16_t port, tcpip_adapter_if_t tcpip_if, mdns_ip_protocol_t ip_protocol);
-static void _mdns_search_result_add_txt(mdns_search_once_t * search, mdns_txt_item_t * txt, size_t txt_count, tcpip_adapter_if_t tcpip_if, mdns_ip_protocol_t ip_protocol);
-static mdns_result_t * _mdns_search_result_add_ptr(mdns_search_once_t * search, const char * instance, tcpip_adapter_if_t tcpip_if, mdns_ip_protocol_t ip_protocol);
+static void _mdns_search_result_add_ip(mdns_search_once_t * search, const char * hostname, ip_addr_t * ip, uint32_t ttl, tcpip_adapter_if_t tcpip_if, mdns_ip_protocol_t ip_protocol);
+static void _mdns_search_result_add_srv(mdns_search_once_t * search, const char * hostname, uint16_t port, uint32_t ttl, tcpip_adapter_if_t tcpip_if, mdns_ip_protocol_t ip_protocol);
+static void _mdns_search_result_add_txt(mdns_search_once_t * search, mdns_txt_item_t * txt, size_t txt_count, uint32_t ttl, tcpip_adapter_if_t tcpip_if, mdns_ip_protocol_t ip_protocol);
+static mdns_result_t * _mdns_search_result_add_ptr(mdns_search_once_t * search, const char * instance, uint32_t ttl, tcpip_adapter_if_t tcpip_if, mdns_ip_protocol_t ip_protocol);
+static void _mdns_result_update_ttl(mdns_result_t * r, uint32_t ttl);
 
 static inline bool _str_null_or_empty(const char * str){
     return (str == NULL || *str == 0);
@@ -78,6 +83,28 @@ static char * _mdns_mangle_name(char* in) {
     return ret;
 }
 
+/**
+ * @brief  case insensitive hash of a label followed by the labels already hashed
+ *
+ * @param  hash         hash of the labels that follow, 0 for none
+ * @param  label        the label
+ *
+ * @return the hash of the name
+ */
+static uint16_t _mdns_name_hash(uint16_t hash, const char * label)
+{
+    uint32_t h = 2166136261u ^ hash;
+    while (*label) {
+        h = (h ^ (uint8_t)tolower((unsigned char)*label++)) * 16777619u;
+    }
+    return (h >> 16) ^ (h & 0xFFFF);
+}
+
+static inline uint16_t _mdns_service_hash(const char * service, const char * proto)
+{
+    return _mdns_name_hash(_mdns_name_hash(0, proto), service);
+}
+
 /**
  * @brief  finds service from given service type
  * @param  server       the server
@@ -88,9 +115,10 @@ static char * _mdns_mangle_name(char* in) {
  */
 static mdns_srv_item_t * _mdns_get_service_item(const char * service, const char * proto)
 {
+    uint16_t hash = _mdns_service_hash(service, proto);
     mdns_srv_item_t * s = _mdns_server->services;
     while (s) {
-        if (!strcasecmp(s->service->service, service) && !strcasecmp(s->service->proto, proto)) {
+        if (s->service->hash == hash && !strcasecmp(s->service->service, service) && !strcasecmp(s->service->proto, proto)) {
             return s;
         }
         s = s->next;
@@ -345,10 +373,52 @@ static inline uint8_t _mdns_append_string(uint8_t * packet, uint16_t * index, co
     return len + 1;
 }
 
+/**
+ * @brief  checks if the name written at offset in the packet is the given FQDN
+ *
+ * @param  packet       MDNS packet
+ * @param  offset       offset of the first label of the name
+ * @param  strings      string array containing the parts of the FQDN
+ * @param  count        number of strings in the array
+ *
+ * @return true if the name matches
+ */
+static bool _mdns_name_matches(const uint8_t * packet, uint16_t offset, const char * strings[], uint8_t count)
+{
+    uint8_t i = 0;
+    uint8_t len;
+    uint16_t address;
+
+    while (offset < MDNS_MAX_PACKET_SIZE) {
+        len = packet[offset];
+        if ((len & 0xC0) == 0xC0) {
+            address = ((uint16_t)(len & 0x3F) << 8) | packet[offset + 1];
+            if (address >= offset) {
+                //reference address can not be after where we are
+                return false;
+            }
+            offset = address;
+            continue;
+        }
+        if (i == count) {
+            return len == 0;
+        }
+        if (len != (uint8_t)strlen(strings[i]) || strncasecmp((const char *)packet + offset + 1, strings[i], len)) {
+            return false;
+        }
+        offset += len + 1;
+        i++;
+    }
+    return false;
+}
+
 /**
  * @brief  appends FQDN to a packet, incrementing the index and
  *         compressing the output if previous occurrence of the string (or part of it) has been found
  *
+ * The names written to the packet are remembered in a table of hashed suffixes,
+ * which has to be reset whenever a new packet is started.
+ *
  * @param  packet       MDNS packet
  * @param  index        offset in the packet
  * @param  strings      string array containing the parts of the FQDN
@@ -358,64 +428,51 @@ static inline uint8_t _mdns_append_string(uint8_t * packet, uint16_t * index, co
  */
 static uint16_t _mdns_append_fqdn(uint8_t * packet, uint16_t * index, const char * strings[], uint8_t count)
 {
-    if (!count) {
-        //empty string so terminate
-        return _mdns_append_u8(packet, index, 0);
+    uint16_t hashes[count + 1];
+    uint8_t table_len = _mdns_name_table_len;
+    uint16_t length = 0;
+    uint16_t offset;
+    uint8_t written;
+    uint8_t i, j;
+
+    hashes[count] = 0;
+    for (i = count; i > 0; i--) {
+        hashes[i - 1] = _mdns_name_hash(hashes[i], strings[i - 1]);
     }
-    mdns_name_t name;
-    static char buf[MDNS_NAME_BUF_LEN];
-    uint8_t len = strlen(strings[0]);
-    //try to find first the string length in the packet (if it exists)
-    uint8_t * len_location = (uint8_t *)memchr(packet, (char)len, *index);
-    while (len_location) {
-        //check if the string after len_location is the string that we are looking for
-        if (memcmp(len_location+1, strings[0], len)) { //not continuing with our string
-search_next:
-            //try and find the length byte further in the packet
-            len_location = (uint8_t *)memchr(len_location+1, (char)len, *index - (len_location+1 - packet));
-            continue;
-        }
-        //seems that we might have found the string that we are looking for
-        //read the destination into name and compare
-        name.parts = 0;
-        name.sub = 0;
-        name.host[0] = 0;
-        name.service[0] = 0;
-        name.proto[0] = 0;
-        name.domain[0] = 0;
-        const uint8_t * content = _mdns_read_fqdn(packet, len_location, &name, buf);
-        if (!content) {
-            //not a readable fqdn?
-            return 0;
-        }
-        if (name.parts == count) {
-            uint8_t i;
-            for (i=0; i<count; i++) {
-                if (strcasecmp(strings[i], (const char *)&name + (i * (MDNS_NAME_BUF_LEN)))) {
-                    //not our string! let's search more
-                    goto search_next;
+
+    for (i = 0; i < count; i++) {
+        for (j = 0; j < _mdns_name_table_len; j++) {
+            if (_mdns_name_table[j].hash == hashes[i] && _mdns_name_matches(packet, _mdns_name_table[j].offset, &strings[i], count - i)) {
+                //we have found the rest of the name so let's insert a pointer to it instead
+                if (!_mdns_append_u16(packet, index, _mdns_name_table[j].offset | MDNS_NAME_REF)) {
+                    goto error;
                 }
+                return length + 2;
             }
-            //we actually have found the string
-            break;
-        } else {
-            goto search_next;
         }
-    }
-    //string is not yet in the packet, so let's add it
-    if (!len_location) {
-        uint8_t written = _mdns_append_string(packet, index, strings[0]);
+        //string is not yet in the packet, so let's add it
+        offset = *index;
+        written = _mdns_append_string(packet, index, strings[i]);
         if (!written) {
-            return 0;
+            goto error;
+        }
+        length += written;
+        if (_mdns_name_table_len < MDNS_NAME_TABLE_LEN) {
+            _mdns_name_table[_mdns_name_table_len].hash = hashes[i];
+            _mdns_name_table[_mdns_name_table_len].offset = offset;
+            _mdns_name_table_len++;
         }
-        //run the same for the other strings in the name
-        return written + _mdns_append_fqdn(packet, index, &strings[1], count - 1);
     }
+    //terminate the name
+    if (!_mdns_append_u8(packet, index, 0)) {
+        goto error;
+    }
+    return length + 1;
 
-    //we have found the string so let's insert a pointer to it instead
-    uint16_t offset = len_location - packet;
-    offset |= MDNS_NAME_REF;
-    return _mdns_append_u16(packet, index, offset);
+error:
+    //a name cut short can not be pointed to
+    _mdns_name_table_len = table_len;
+    return 0;
 }
 
 /**
@@ -507,6 +564,69 @@ static uint16_t _mdns_append_sdptr_record(uint8_t * packet, uint16_t * index, md
     return record_length;
 }
 
+/**
+ * @brief  frees the encoded TXT items of a service, to be called whenever they change
+ *
+ * @param  service      the service
+ */
+static void _mdns_free_txt_data(mdns_service_t * service)
+{
+    free(service->txt_data);
+    service->txt_data = NULL;
+    service->txt_data_len = 0;
+}
+
+/**
+ * @brief  gets the TXT items of a service as they are sent, encoding them
+ *         only the first time after they have changed
+ *
+ * @param  service      the service
+ * @param  len          length of the encoded items: 0 if there are none or on error
+ *
+ * @return the encoded items or NULL
+ */
+static const uint8_t * _mdns_get_txt_data(mdns_service_t * service, uint16_t * len)
+{
+    mdns_txt_linked_item_t * txt;
+    size_t data_len = 0;
+    size_t item_len;
+
+    if (service->txt_data || !service->txt) {
+        *len = service->txt_data_len;
+        return service->txt_data;
+    }
+
+    *len = 0;
+    for (txt = service->txt; txt; txt = txt->next) {
+        item_len = strlen(txt->key) + 1 + strlen(txt->value);
+        data_len += 1 + (item_len > 255 ? 255 : item_len);
+    }
+    if (data_len >= MDNS_MAX_PACKET_SIZE) {
+        return NULL;
+    }
+
+    //one more byte for the terminator written by snprintf
+    service->txt_data = (uint8_t *)malloc(data_len + 1);
+    if (!service->txt_data) {
+        return NULL;
+    }
+
+    data_len = 0;
+    for (txt = service->txt; txt; txt = txt->next) {
+        item_len = strlen(txt->key) + 1 + strlen(txt->value);
+        if (item_len > 255) {
+            item_len = 255;
+        }
+        service->txt_data[data_len++] = item_len;
+        snprintf((char *)service->txt_data + data_len, item_len + 1, "%s=%s", txt->key, txt->value);
+        data_len += item_len;
+    }
+    service->txt_data_len = data_len;
+
+    *len = service->txt_data_len;
+    return service->txt_data;
+}
+
 /**
  * @brief  appends TXT record for service to a packet, incrementing the index
  *
@@ -547,20 +667,13 @@ static uint16_t _mdns_append_txt_record(uint8_t * packet, uint16_t * index, mdns
     uint16_t data_len_location = *index - 2;
     uint16_t data_len = 0;
 
-    char * tmp;
-    mdns_txt_linked_item_t * txt = service->txt;
-    while (txt) {
-        tmp = (char *)malloc(2 + strlen(txt->key) + strlen(txt->value));
-        if (tmp) {
-            sprintf(tmp, "%s=%s", txt->key, txt->value);
-            uint8_t l = _mdns_append_string(packet, index, tmp);
-            free(tmp);
-            if (!l) {
-                return 0;
-            }
-            data_len += l;
+    const uint8_t * data = _mdns_get_txt_data(service, &data_len);
+    if (data_len) {
+        if ((*index + data_len) >= MDNS_MAX_PACKET_SIZE) {
+            return 0;
         }
-        txt = txt->next;
+        memcpy(packet + *index, data, data_len);
+        *index += data_len;
     }
     if (!data_len) {
         data_len = 1;
@@ -905,6 +1018,7 @@ static void _mdns_dispatch_tx_packet(mdns_tx_packet_t * p)
     mdns_out_answer_t * a;
     uint8_t count;
 
+    _mdns_name_table_len = 0;
     _mdns_set_u16(packet, MDNS_HEAD_FLAGS_OFFSET, p->flags);
 
     count = 0;
@@ -1798,6 +1912,8 @@ static mdns_service_t * _mdns_create_service(const char * service, const char *
     s->weight = 0;
     s->instance = instance?strndup(instance, MDNS_NAME_BUF_LEN - 1):NULL;
     s->txt = new_txt;
+    s->txt_data = NULL;
+    s->txt_data_len = 0;
     s->port = port;
 
     s->service = strndup(service, MDNS_NAME_BUF_LEN - 1);
@@ -1812,6 +1928,7 @@ static mdns_service_t * _mdns_create_service(const char * service, const char *
         free(s);
         return NULL;
     }
+    s->hash = _mdns_service_hash(s->service, s->proto);
 
     return s;
 }
@@ -1946,6 +2063,7 @@ static void _mdns_free_service(mdns_service_t * service)
         free(s);
     }
     free(service->txt);
+    _mdns_free_txt_data(service);
     free(service);
 }
 
@@ -2016,7 +2134,6 @@ static int _mdns_check_srv_collision(mdns_service_t * service, uint16_t priority
  */
 static int _mdns_check_txt_collision(mdns_service_t * service, const uint8_t * data, size_t len)
 {
-    size_t data_len = 1;
     if (len == 1 && service->txt) {
         return -1;//we win
     } else if (len > 1 && !service->txt) {
@@ -2025,10 +2142,10 @@ static int _mdns_check_txt_collision(mdns_service_t * service, const uint8_t * d
         return 0;//same
     }
 
-    mdns_txt_linked_item_t * txt = service->txt;
-    while (txt) {
-        data_len += 2 + strlen(service->txt->key) + strlen(service->txt->value);
-        txt = txt->next;
+    uint16_t data_len;
+    const uint8_t * ours = _mdns_get_txt_data(service, &data_len);
+    if (!ours) {
+        return 0;//can not tell
     }
 
     if (len > data_len) {
@@ -2037,21 +2154,6 @@ static int _mdns_check_txt_collision(mdns_service_t * service, const uint8_t * d
         return -1;//we win
     }
 
-    uint8_t ours[len];
-    uint16_t index = 0;
-    char * tmp;
-
-    txt = service->txt;
-    while (txt) {
-        tmp = (char *)malloc(2 + strlen(txt->key) + strlen(txt->value));
-        if (tmp) {
-            sprintf(tmp, "%s=%s", txt->key, txt->value);
-            _mdns_append_string(ours, &index, tmp);
-            free(tmp);
-        }
-        txt = txt->next;
-    }
-
     int ret = memcmp(ours, data, len);
     if (ret > 0) {
         return -1;//we win
@@ -2666,7 +2768,7 @@ void mdns_parse_packet(mdns_rx_packet_t * packet)
                     continue;//error
                 }
                 if (search_result) {
-                    _mdns_search_result_add_ptr(search_result, name->host, packet->tcpip_if, packet->ip_protocol);
+                    _mdns_search_result_add_ptr(search_result, name->host, ttl, packet->tcpip_if, packet->ip_protocol);
                 } else if ((discovery || ours) && !name->sub && _mdns_name_is_ours(name)) {
                     if (discovery) {
                         service = _mdns_get_service_item(name->service, name->proto);
@@ -2693,7 +2795,7 @@ void mdns_parse_packet(mdns_rx_packet_t * packet)
                         result = result->next;
                     }
                     if (!result) {
-                        result = _mdns_search_result_add_ptr(search_result, name->host, packet->tcpip_if, packet->ip_protocol);
+                        result = _mdns_search_result_add_ptr(search_result, name->host, ttl, packet->tcpip_if, packet->ip_protocol);
                         if (!result) {
                             continue;//error
                         }
@@ -2711,8 +2813,9 @@ void mdns_parse_packet(mdns_rx_packet_t * packet)
                     if (search_result->type == MDNS_TYPE_PTR) {
                         result->port = port;
                         result->hostname = strdup(name->host);
+                        _mdns_result_update_ttl(result, ttl);
                     } else {
-                        _mdns_search_result_add_srv(search_result, name->host, port, packet->tcpip_if, packet->ip_protocol);
+                        _mdns_search_result_add_srv(search_result, name->host, port, ttl, packet->tcpip_if, packet->ip_protocol);
                     }
                 } else if (ours) {
                     if (parsed_packet->questions && !parsed_packet->probe) {
@@ -2788,7 +2891,7 @@ void mdns_parse_packet(mdns_rx_packet_t * packet)
                             result = result->next;
                         }
                         if (!result) {
-                            result = _mdns_search_result_add_ptr(search_result, name->host, packet->tcpip_if, packet->ip_protocol);
+                            result = _mdns_search_result_add_ptr(search_result, name->host, ttl, packet->tcpip_if, packet->ip_protocol);
                             if (!result) {
                                 continue;//error
                             }
@@ -2796,9 +2899,10 @@ void mdns_parse_packet(mdns_rx_packet_t * packet)
                         if (!result->txt) {
                             result->txt = txt;
                             result->txt_count = txt_count;
+                            _mdns_result_update_ttl(result, ttl);
                         }
                     } else {
-                        _mdns_search_result_add_txt(search_result, txt, txt_count, packet->tcpip_if, packet->ip_protocol);
+                        _mdns_search_result_add_txt(search_result, txt, txt_count, ttl, packet->tcpip_if, packet->ip_protocol);
                     }
                 } else if (ours) {
                     if (parsed_packet->questions && !parsed_packet->probe) {
@@ -2829,7 +2933,7 @@ void mdns_parse_packet(mdns_rx_packet_t * packet)
                 if (search_result) {
                     //check for more applicable searches (PTR & A/AAAA at the same time)
                     while (search_result) {
-                        _mdns_search_result_add_ip(search_result, name->host, &ip6, packet->tcpip_if, packet->ip_protocol);
+                        _mdns_search_result_add_ip(search_result, name->host, &ip6, ttl, packet->tcpip_if, packet->ip_protocol);
                         search_result = _mdns_search_find_from(search_result->next, name, type, packet->tcpip_if, packet->ip_protocol);
                     }
                 } else if (ours) {
@@ -2875,7 +2979,7 @@ void mdns_parse_packet(mdns_rx_packet_t * packet)
                 if (search_result) {
                     //check for more applicable searches (PTR & A/AAAA at the same time)
                     while (search_result) {
-                        _mdns_search_result_add_ip(search_result, name->host, &ip, packet->tcpip_if, packet->ip_protocol);
+                        _mdns_search_result_add_ip(search_result, name->host, &ip, ttl, packet->tcpip_if, packet->ip_protocol);
                         search_result = _mdns_search_find_from(search_result->next, name, type, packet->tcpip_if, packet->ip_protocol);
                     }
                 } else if (ours) {
@@ -3177,10 +3281,20 @@ static void _mdns_result_add_ip(mdns_result_t * r, ip_addr_t * ip)
     r->addr = a;
 }
 
+/**
+ * @brief  Lower the TTL of a result to that of a record merged into it
+ */
+static void _mdns_result_update_ttl(mdns_result_t * r, uint32_t ttl)
+{
+    if (ttl < r->ttl) {
+        r->ttl = ttl;
+    }
+}
+
 /**
  * @brief  Called from parser to add A/AAAA data to search result
  */
-static void _mdns_search_result_add_ip(mdns_search_once_t * search, const char * hostname, ip_addr_t * ip, tcpip_adapter_if_t tcpip_if, mdns_ip_protocol_t ip_protocol)
+static void _mdns_search_result_add_ip(mdns_search_once_t * search, const char * hostname, ip_addr_t * ip, uint32_t ttl, tcpip_adapter_if_t tcpip_if, mdns_ip_protocol_t ip_protocol)
 {
     mdns_result_t * r = NULL;
     mdns_ip_addr_t * a = NULL;
@@ -3192,6 +3306,7 @@ static void _mdns_search_result_add_ip(mdns_search_once_t * search, const char *
         while (r) {
             if (r->tcpip_if == tcpip_if && r->ip_protocol == ip_protocol) {
                 _mdns_result_add_ip(r, ip);
+                _mdns_result_update_ttl(r, ttl);
                 return;
             }
             r = r->next;
@@ -3211,6 +3326,7 @@ static void _mdns_search_result_add_ip(mdns_search_once_t * search, const char *
             }
             a->next = r->addr;
             r->addr = a;
+            r->ttl = ttl;
             r->tcpip_if = tcpip_if;
             r->ip_protocol = ip_protocol;
             r->next = search->result;
@@ -3222,6 +3338,7 @@ static void _mdns_search_result_add_ip(mdns_search_once_t * search, const char *
         while (r) {
             if (r->tcpip_if == tcpip_if && r->ip_protocol == ip_protocol && !_str_null_or_empty(r->hostname) && !strcasecmp(hostname, r->hostname)) {
                 _mdns_result_add_ip(r, ip);
+                _mdns_result_update_ttl(r, ttl);
                 break;
             }
             r = r->next;
@@ -3232,11 +3349,12 @@ static void _mdns_search_result_add_ip(mdns_search_once_t * search, const char *
 /**
  * @brief  Called from parser to add PTR data to search result
  */
-static mdns_result_t * _mdns_search_result_add_ptr(mdns_search_once_t * search, const char * instance, tcpip_adapter_if_t tcpip_if, mdns_ip_protocol_t ip_protocol)
+static mdns_result_t * _mdns_search_result_add_ptr(mdns_search_once_t * search, const char * instance, uint32_t ttl, tcpip_adapter_if_t tcpip_if, mdns_ip_protocol_t ip_protocol)
 {
     mdns_result_t * r = search->result;
     while (r) {
         if (r->tcpip_if == tcpip_if && r->ip_protocol == ip_protocol && !_str_null_or_empty(r->instance_name) && !strcasecmp(instance, r->instance_name)) {
+            _mdns_result_update_ttl(r, ttl);
             return r;
         }
         r = r->next;
@@ -3254,6 +3372,7 @@ static mdns_result_t * _mdns_search_result_add_ptr(mdns_search_once_t * search,
             return NULL;
         }
 
+        r->ttl = ttl;
         r->tcpip_if = tcpip_if;
         r->ip_protocol = ip_protocol;
         r->next = search->result;
@@ -3267,7 +3386,7 @@ static mdns_result_t * _mdns_search_result_add_ptr(mdns_search_once_t * search,
 /**
  * @brief  Called from parser to add SRV data to search result
  */
-static void _mdns_search_result_add_srv(mdns_search_once_t * search, const char * hostname, uint16_t port, tcpip_adapter_if_t tcpip_if, mdns_ip_protocol_t ip_protocol)
+static void _mdns_search_result_add_srv(mdns_search_once_t * search, const char * hostname, uint16_t port, uint32_t ttl, tcpip_adapter_if_t tcpip_if, mdns_ip_protocol_t ip_protocol)
 {
     mdns_result_t * r = search->result;
     while (r) {
@@ -3289,6 +3408,7 @@ static void _mdns_search_result_add_srv(mdns_search_once_t * search, const char
             return;
         }
         r->port = port;
+        r->ttl = ttl;
         r->tcpip_if = tcpip_if;
         r->ip_protocol = ip_protocol;
         r->next = search->result;
@@ -3300,7 +3420,7 @@ static void _mdns_search_result_add_srv(mdns_search_once_t * search, const char
 /**
  * @brief  Called from parser to add TXT data to search result
  */
-static void _mdns_search_result_add_txt(mdns_search_once_t * search, mdns_txt_item_t * txt, size_t txt_count, tcpip_adapter_if_t tcpip_if, mdns_ip_protocol_t ip_protocol)
+static void _mdns_search_result_add_txt(mdns_search_once_t * search, mdns_txt_item_t * txt, size_t txt_count, uint32_t ttl, tcpip_adapter_if_t tcpip_if, mdns_ip_protocol_t ip_protocol)
 {
     int i;
     mdns_result_t * r = search->result;
@@ -3311,6 +3431,7 @@ static void _mdns_search_result_add_txt(mdns_search_once_t * search, mdns_txt_it
             }
             r->txt = txt;
             r->txt_count = txt_count;
+            _mdns_result_update_ttl(r, ttl);
             return;
         }
         r = r->next;
@@ -3329,6 +3450,7 @@ static void _mdns_search_result_add_txt(mdns_search_once_t * search, mdns_txt_it
         memset(r, 0 , sizeof(mdns_result_t));
         r->txt = txt;
         r->txt_count = txt_count;
+        r->ttl = ttl;
         r->tcpip_if = tcpip_if;
         r->ip_protocol = ip_protocol;
         r->next = search->result;
@@ -3651,6 +3773,7 @@ static void _mdns_execute_action(mdns_action_t * action)
         service->txt = NULL;
         _mdns_free_linked_txt(txt);
         service->txt = action->data.srv_txt_replace.txt;
+        _mdns_free_txt_data(service);
         _mdns_announce_all_pcbs(&action->data.srv_txt_replace.service, 1, false);
 
         break;
@@ -3679,6 +3802,7 @@ static void _mdns_execute_action(mdns_action_t * action)
             txt->next = service->txt;
             service->txt = txt;
         }
+        _mdns_free_txt_data(service);
 
         _mdns_announce_all_pcbs(&action->data.srv_txt_set.service, 1, false);
 
@@ -3710,6 +3834,7 @@ static void _mdns_execute_action(mdns_action_t * action)
             }
         }
         free(key);
+        _mdns_free_txt_data(service);
 
         _mdns_announce_all_pcbs(&action->data.srv_txt_set.service, 1, false);
 
@@ -34,6 +34,11 @@
 #include <signal.h>
 #include <sys/time.h>
 
+#if !defined(USE_BSD_STRING) && !defined(__APPLE__)
+// without libbsd, see esp32_mock.c
+size_t strlcat(char * dst, const char * src, size_t size);
+#endif
+
 #define CONFIG_MDNS_MAX_SERVICES    25
 
 #define ERR_OK                      0
@@ -40,6 +40,12 @@ void GetLastItem(void *pvBuffer);
 
 void ForceTaskDelete();
 
-#define _mdns_udp_pcb_write(tcpip_if, ip_protocol, ip, port, data, len) len
+size_t mdns_test_udp_pcb_write(const uint8_t * data, size_t len);
+
+extern uint32_t g_tx_packets;
+extern uint32_t g_tx_bytes;
+extern uint32_t g_tx_hash;
+
+#define _mdns_udp_pcb_write(tcpip_if, ip_protocol, ip, port, data, len) mdns_test_udp_pcb_write(data, len)
 
 #endif /* ESP32_MOCK_H_ */
\ No newline at end of file
@@ -11,12 +11,18 @@ mdns_srv_item_t * (*mdns_test_static_mdns_get_service_item)(const char * service
 mdns_search_once_t * (*mdns_test_static_search_init)(const char * name, const char * service, const char * proto, uint16_t type, uint32_t timeout, uint8_t max_results) = NULL;
 esp_err_t         (*mdns_test_static_send_search_action)(mdns_action_type_t type, mdns_search_once_t * search) = NULL;
 void              (*mdns_test_static_search_free)(mdns_search_once_t * search) = NULL;
+void              (*mdns_test_static_dispatch_tx_packet)(mdns_tx_packet_t * p) = NULL;
+void              (*mdns_test_static_clear_tx_queue_head)() = NULL;
+
+extern mdns_server_t * _mdns_server;
 
 static void _mdns_execute_action(mdns_action_t * action);
 static mdns_srv_item_t * _mdns_get_service_item(const char * service, const char * proto);
 static mdns_search_once_t * _mdns_search_init(const char * name, const char * service, const char * proto, uint16_t type, uint32_t timeout, uint8_t max_results);
 static esp_err_t _mdns_send_search_action(mdns_action_type_t type, mdns_search_once_t * search);
 static void _mdns_search_free(mdns_search_once_t * search);
+static void _mdns_dispatch_tx_packet(mdns_tx_packet_t * p);
+static void _mdns_clear_tx_queue_head();
 
 void mdns_test_init_di()
 {
@@ -25,6 +31,8 @@ void mdns_test_init_di()
     mdns_test_static_search_init = _mdns_search_init;
     mdns_test_static_send_search_action = _mdns_send_search_action;
     mdns_test_static_search_free = _mdns_search_free;
+    mdns_test_static_dispatch_tx_packet = _mdns_dispatch_tx_packet;
+    mdns_test_static_clear_tx_queue_head = _mdns_clear_tx_queue_head;
 }
 
 void mdns_test_execute_action(void * action)
@@ -47,6 +55,17 @@ mdns_search_once_t * mdns_test_search_init(const char * name, const char * servi
     return mdns_test_static_search_init(name, service, proto, type, timeout, max_results);
 }
 
+void mdns_test_flush_tx_queue()
+{
+    mdns_tx_packet_t * p;
+
+    // everything scheduled goes out at once, whenever it was due
+    for (p = _mdns_server->tx_queue_head; p; p = p->next) {
+        mdns_test_static_dispatch_tx_packet(p);
+    }
+    mdns_test_static_clear_tx_queue_head();
+}
+
 mdns_srv_item_t * mdns_test_mdns_get_service_item(const char * service, const char * proto)
 {
     return mdns_test_static_mdns_get_service_item(service, proto);
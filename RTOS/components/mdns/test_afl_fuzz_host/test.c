@@ -17,6 +17,7 @@
 #include <unistd.h>
 #include <signal.h>
 #include <string.h>
+#include <time.h>
 
 #include "mdns.h"
 #include "mdns_private.h"
@@ -35,6 +36,12 @@ mdns_search_once_t * mdns_test_search_init(const char * name, const char * servi
 esp_err_t mdns_test_send_search_action(mdns_action_type_t type, mdns_search_once_t * search);
 void mdns_test_search_free(mdns_search_once_t * search);
 void mdns_test_init_di();
+void mdns_test_flush_tx_queue();
+
+extern mdns_server_t * _mdns_server;
+extern uint32_t g_tx_packets;
+extern uint32_t g_tx_bytes;
+extern uint32_t g_tx_hash;
 
 //
 // mdns function wrappers for mdns setup in test mode
@@ -103,11 +110,90 @@ static void mdns_test_query_free()
     mdns_test_search_free(search);
 }
 
+static void mdns_test_print_results(mdns_result_t * r)
+{
+    size_t i;
+    mdns_ip_addr_t * a;
+
+    for (; r; r = r->next) {
+        printf("%s host: %s port: %u ttl: %u", r->instance_name ? r->instance_name : "-", r->hostname ? r->hostname : "-", r->port, r->ttl);
+        for (i = 0; i < r->txt_count; i++) {
+            printf(" %s=%s", r->txt[i].key, r->txt[i].value ? r->txt[i].value : "");
+        }
+        for (a = r->addr; a; a = a->next) {
+            if (a->addr.type == IPADDR_TYPE_V4) {
+                uint8_t * ip = (uint8_t *)&a->addr.u_addr.ip4.addr;
+                printf(" %u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+            }
+        }
+        printf("\n");
+    }
+}
+
 //
 // function "under test" where afl-mangled packets passed
 //
 void mdns_parse_packet(mdns_rx_packet_t * packet);
 
+#ifdef INSTR_IS_OFF
+#define BENCH_MAX_PACKETS   64
+
+//
+// Replays the corpus listed in input_packets.txt through the parser and the responder,
+// the answers are hashed so that two builds can be checked to send the same bytes
+static int mdns_test_benchmark(int rounds)
+{
+    static uint8_t packets[BENCH_MAX_PACKETS][1460];
+    static struct udp_pcb pcb;
+    size_t lens[BENCH_MAX_PACKETS];
+    char line[256], name[128];
+    struct timespec start, end;
+    int i, n = 0, r;
+    double s;
+    FILE * list = fopen("input_packets.txt", "r");
+    FILE * file;
+
+    if (!list) {
+        printf("input_packets.txt not found\n");
+        return 1;
+    }
+    while (n < BENCH_MAX_PACKETS && fgets(line, sizeof(line), list)) {
+        if (sscanf(line, "Input: %127s", name) != 1 || !(file = fopen(name, "r"))) {
+            continue;
+        }
+        lens[n] = fread(packets[n], 1, 1460, file);
+        fclose(file);
+        n++;
+    }
+    fclose(list);
+
+    // answers are only sent once the interface is up
+    _mdns_server->interfaces[TCPIP_ADAPTER_IF_STA].pcbs[MDNS_IP_PROTOCOL_V4].pcb = &pcb;
+    _mdns_server->interfaces[TCPIP_ADAPTER_IF_STA].pcbs[MDNS_IP_PROTOCOL_V4].state = PCB_RUNNING;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (r = 0; r < rounds; r++) {
+        for (i = 0; i < n; i++) {
+            mypbuf.payload = packets[i];
+            mypbuf.len = lens[i];
+            g_packet.pb = &mypbuf;
+            g_packet.src_port = MDNS_SERVICE_PORT;
+            mdns_parse_packet(&g_packet);
+            mdns_test_flush_tx_queue();
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    _mdns_server->interfaces[TCPIP_ADAPTER_IF_STA].pcbs[MDNS_IP_PROTOCOL_V4].pcb = NULL;
+    _mdns_server->interfaces[TCPIP_ADAPTER_IF_STA].pcbs[MDNS_IP_PROTOCOL_V4].state = PCB_OFF;
+
+    s = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("%d packets x %d rounds: %.3f s, %.0f packets/s\n", n, rounds, s, n * rounds / s);
+    printf("sent %u packets, %u bytes, hash %08x\n", g_tx_packets, g_tx_bytes, g_tx_hash);
+    return 0;
+}
+#endif
+
 //
 // Test starts here
 //
@@ -124,6 +210,8 @@ int main(int argc, char** argv)
     };
 
     const uint8_t mac[6] = {0xDE, 0xAD, 0xBE, 0xEF, 0x00, 0x32};
+    const char * query_service = "_afpovertcp";
+    const char * query_proto = "_tcp";
     
     uint8_t buf[1460];
     char winstance[21+strlen(mdns_hostname)];
@@ -194,9 +282,18 @@ int main(int argc, char** argv)
     size_t len = 1460;
     memset(buf, 0, 1460);
 
-    if (argc != 2)
+    if (argc >= 2 && !strcmp(argv[1], "-b"))
+    {
+        int ret = mdns_test_benchmark(argc > 2 ? atoi(argv[2]) : 1000);
+        ForceTaskDelete();
+        mdns_free();
+        return ret;
+    }
+    else if (argc != 2 && argc != 4)
     {
         printf("Non-instrumentation mode: please supply a file name created by AFL to reproduce crash\n");
+        printf("optionally followed by the service and protocol to query, e.g. _onem2m _udp, to print what the packet answers\n");
+        printf("or -b [rounds] to replay the packets of input_packets.txt as a benchmark\n");
         return 1;
     }
     else
@@ -208,6 +305,10 @@ int main(int argc, char** argv)
             len = fread(buf, 1, 1460, file);
         }
         fclose(file);
+        if (argc == 4) {
+            query_service = argv[2];
+            query_proto = argv[3];
+        }
     }
 
     for (i=0; i<1; i++) {
@@ -219,8 +320,15 @@ int main(int argc, char** argv)
         mypbuf.payload = buf;
         mypbuf.len = len;
         g_packet.pb = &mypbuf;
-        mdns_test_query("_afpovertcp", "_tcp");
+        // responses from any other port are dropped before they reach the answer parser
+        g_packet.src_port = MDNS_SERVICE_PORT;
+        mdns_test_query(query_service, query_proto);
         mdns_parse_packet(&g_packet);
+#ifdef INSTR_IS_OFF
+        if (argc == 4) {
+            mdns_test_print_results(search->result);
+        }
+#endif
     }
     ForceTaskDelete();
     mdns_free();
@@ -0,0 +1,574 @@
+#include "om2m/cbor.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+#define CBOR_UINT	0
+#define CBOR_NEGINT	1
+#define CBOR_BYTES	2
+#define CBOR_TEXT	3
+#define CBOR_ARRAY	4
+#define CBOR_MAP	5
+#define CBOR_TAG	6	// not used by oneM2M, rejected
+#define CBOR_SIMPLE	7	// false, true, null and floats
+
+#define CBOR_FALSE	20
+#define CBOR_TRUE	21
+#define CBOR_BREAK	0xff
+
+#define CBOR_INDEFINITE	UINT64_MAX	// length of a container ended by a break
+
+/**
+ * Bounded CBOR writer, the counterpart of the JSON one in om2m.c;
+ * only definite lengths are written, they are all known up front
+ * */
+typedef struct {
+  uint8_t *buf;
+  size_t size;
+  size_t len;
+  int overflow;
+} cbor_writer_t;
+
+static void cbor_init(cbor_writer_t *w, char *buf, size_t size) {
+  w->buf = (uint8_t *)buf;
+  w->size = size;
+  w->len = 0;
+  w->overflow = 0;
+}
+
+static void cbor_raw(cbor_writer_t *w, const void *s, size_t n) {
+  if(w->len + n > w->size) {
+    w->overflow = 1;
+    return;
+  }
+  memcpy(w->buf + w->len, s, n);
+  w->len += n;
+}
+
+// initial byte and argument in the shortest form
+static void cbor_put_head(cbor_writer_t *w, int major, uint32_t value) {
+  uint8_t head[5];
+  size_t n;
+
+  if(value < 24) {
+    head[0] = major << 5 | value;
+    n = 1;
+  }
+  else if(value <= 0xff) {
+    head[0] = major << 5 | 24;
+    head[1] = value;
+    n = 2;
+  }
+  else if(value <= 0xffff) {
+    head[0] = major << 5 | 25;
+    head[1] = value >> 8;
+    head[2] = value;
+    n = 3;
+  }
+  else {
+    head[0] = major << 5 | 26;
+    head[1] = value >> 24;
+    head[2] = value >> 16;
+    head[3] = value >> 8;
+    head[4] = value;
+    n = 5;
+  }
+
+  cbor_raw(w, head, n);
+}
+
+static void cbor_put_text(cbor_writer_t *w, const char *s) {
+  size_t n = strlen(s);
+
+  cbor_put_head(w, CBOR_TEXT, n);
+  cbor_raw(w, s, n);
+}
+
+static void cbor_put_int(cbor_writer_t *w, int n) {
+  if(n < 0)
+    cbor_put_head(w, CBOR_NEGINT, -1 - n);
+  else
+    cbor_put_head(w, CBOR_UINT, n);
+}
+
+static void cbor_put_bool(cbor_writer_t *w, bool b) {
+  uint8_t c = CBOR_SIMPLE << 5 | (b ? CBOR_TRUE : CBOR_FALSE);
+
+  cbor_raw(w, &c, 1);
+}
+
+static int cbor_done(cbor_writer_t *w) {
+  return w->overflow ? -1 : (int)w->len;
+}
+
+/**
+ * Serialize the primitive content of each resource type,
+ * with the same attributes as om2m_pc_ae and friends
+ *
+ * @return length written to buf, -1 if it does not fit
+ * */
+int om2m_cbor_ae(char *buf, size_t size, const char *rn, int api, const char *poa) {
+  cbor_writer_t w;
+
+  cbor_init(&w, buf, size);
+  cbor_put_head(&w, CBOR_MAP, 1);
+  cbor_put_text(&w, "m2m:ae");
+  cbor_put_head(&w, CBOR_MAP, poa ? 4 : 3);
+  cbor_put_text(&w, "rr");
+  cbor_put_bool(&w, true);
+  cbor_put_text(&w, "api");
+  cbor_put_int(&w, api);
+  cbor_put_text(&w, "rn");
+  cbor_put_text(&w, rn);
+  if(poa) {
+    cbor_put_text(&w, "poa");
+    cbor_put_head(&w, CBOR_ARRAY, 1);
+    cbor_put_text(&w, poa);
+  }
+
+  return cbor_done(&w);
+}
+
+int om2m_cbor_cnt(char *buf, size_t size, const char *rn) {
+  cbor_writer_t w;
+
+  cbor_init(&w, buf, size);
+  cbor_put_head(&w, CBOR_MAP, 1);
+  cbor_put_text(&w, "m2m:cnt");
+  cbor_put_head(&w, CBOR_MAP, 1);
+  cbor_put_text(&w, "rn");
+  cbor_put_text(&w, rn);
+
+  return cbor_done(&w);
+}
+
+static void cbor_put_cin(cbor_writer_t *w, const char *rn, const char *con) {
+  char cnf[24];
+
+  sprintf(cnf, "text/plain:%u", (unsigned)strlen(con));
+
+  cbor_put_head(w, CBOR_MAP, 1);
+  cbor_put_text(w, "m2m:cin");
+  cbor_put_head(w, CBOR_MAP, rn ? 3 : 2);
+  cbor_put_text(w, "con");
+  cbor_put_text(w, con);
+  cbor_put_text(w, "cnf");
+  cbor_put_text(w, cnf);
+  if(rn) {
+    cbor_put_text(w, "rn");
+    cbor_put_text(w, rn);
+  }
+}
+
+int om2m_cbor_cin(char *buf, size_t size, const char *rn, const char *con) {
+  cbor_writer_t w;
+
+  cbor_init(&w, buf, size);
+  cbor_put_cin(&w, rn, con);
+
+  return cbor_done(&w);
+}
+
+int om2m_cbor_sub(char *buf, size_t size, const char *rn, const char *nu) {
+  cbor_writer_t w;
+
+  cbor_init(&w, buf, size);
+  cbor_put_head(&w, CBOR_MAP, 1);
+  cbor_put_text(&w, "m2m:sub");
+  cbor_put_head(&w, CBOR_MAP, 3);
+  cbor_put_text(&w, "rn");
+  cbor_put_text(&w, rn);
+  cbor_put_text(&w, "nct");
+  cbor_put_int(&w, 2);
+  cbor_put_text(&w, "nu");
+  cbor_put_head(&w, CBOR_ARRAY, 1);
+  cbor_put_text(&w, nu);
+
+  return cbor_done(&w);
+}
+
+/**
+ * Notification of a new content instance, or the verification
+ * request of the subscription when con is NULL
+ *
+ * @return length written to buf, -1 if it does not fit
+ * */
+int om2m_cbor_sgn(char *buf, size_t size, const char *sur, int net, const char *rn, const char *con) {
+  cbor_writer_t w;
+
+  cbor_init(&w, buf, size);
+  cbor_put_head(&w, CBOR_MAP, 1);
+  cbor_put_text(&w, "m2m:sgn");
+  cbor_put_head(&w, CBOR_MAP, 2);
+  if(con) {
+    cbor_put_text(&w, "nev");
+    cbor_put_head(&w, CBOR_MAP, 2);
+    cbor_put_text(&w, "rep");
+    cbor_put_cin(&w, rn, con);
+    cbor_put_text(&w, "net");
+    cbor_put_int(&w, net);
+  }
+  else {
+    cbor_put_text(&w, "vrq");
+    cbor_put_bool(&w, true);
+  }
+  cbor_put_text(&w, "sur");
+  cbor_put_text(&w, sur);
+
+  return cbor_done(&w);
+}
+
+/**
+ * Reader over a received payload, decoding in place; CSEs written
+ * with streaming encoders send maps of indefinite length, so those
+ * are accepted along with the definite ones
+ * */
+typedef struct {
+  const uint8_t *p;
+  const uint8_t *end;
+} cbor_reader_t;
+
+static int cbor_get_head(cbor_reader_t *r, int *major, uint64_t *value) {
+  uint8_t info;
+  int i, n;
+
+  if(r->p >= r->end)
+    return -1;
+
+  *major = *r->p >> 5;
+  info = *r->p++ & 0x1f;
+
+  if(info < 24) {
+    *value = info;
+    return 0;
+  }
+
+  if(info == 31) {
+    // a break is consumed by cbor_more, indefinite strings are not used by oneM2M
+    if(*major != CBOR_ARRAY && *major != CBOR_MAP)
+      return -1;
+    *value = CBOR_INDEFINITE;
+    return 0;
+  }
+
+  if(info > 27)
+    return -1;
+
+  n = 1 << (info - 24);
+  if(r->end - r->p < n)
+    return -1;
+
+  *value = 0;
+  for(i = 0; i < n; i++)
+    *value = *value << 8 | *r->p++;
+
+  return 0;
+}
+
+// whether another element of the container follows
+static int cbor_more(cbor_reader_t *r, uint64_t *count) {
+  if(*count == CBOR_INDEFINITE) {
+    if(r->p < r->end && *r->p == CBOR_BREAK) {
+      r->p++;
+      return 0;
+    }
+    return 1;
+  }
+
+  if(*count == 0)
+    return 0;
+
+  (*count)--;
+  return 1;
+}
+
+static int cbor_peek(const cbor_reader_t *r) {
+  return r->p < r->end ? *r->p >> 5 : -1;
+}
+
+static int cbor_get_container(cbor_reader_t *r, int expected, uint64_t *count) {
+  int major;
+
+  if(cbor_get_head(r, &major, count) < 0 || major != expected)
+    return -1;
+
+  // every element takes at least a byte, this also bounds count * 2 for maps
+  if(*count != CBOR_INDEFINITE && *count > (uint64_t)(r->end - r->p))
+    return -1;
+
+  return 0;
+}
+
+static int cbor_get_text(cbor_reader_t *r, om2m_cbor_str_t *str) {
+  uint64_t len;
+  int major;
+
+  if(cbor_get_head(r, &major, &len) < 0 || major != CBOR_TEXT || len > (uint64_t)(r->end - r->p))
+    return -1;
+
+  str->p = (const char *)r->p;
+  str->len = len;
+  r->p += len;
+
+  return 0;
+}
+
+static int cbor_get_int(cbor_reader_t *r, int *n) {
+  uint64_t value;
+  int major;
+
+  if(cbor_get_head(r, &major, &value) < 0 || value > INT_MAX)
+    return -1;
+
+  if(major == CBOR_UINT)
+    *n = value;
+  else if(major == CBOR_NEGINT)
+    *n = -1 - (int)value;
+  else
+    return -1;
+
+  return 0;
+}
+
+static int cbor_get_bool(cbor_reader_t *r, bool *b) {
+  uint64_t value;
+  int major;
+
+  if(cbor_get_head(r, &major, &value) < 0 || major != CBOR_SIMPLE || (value != CBOR_TRUE && value != CBOR_FALSE))
+    return -1;
+
+  *b = value == CBOR_TRUE;
+  return 0;
+}
+
+static int cbor_skip(cbor_reader_t *r, int depth) {
+  uint64_t value;
+  int major;
+
+  if(depth > OM2M_CBOR_DEPTH_MAX || cbor_get_head(r, &major, &value) < 0)
+    return -1;
+
+  switch(major) {
+    case CBOR_BYTES:
+    case CBOR_TEXT:
+      if(value > (uint64_t)(r->end - r->p))
+        return -1;
+      r->p += value;
+      return 0;
+
+    case CBOR_ARRAY:
+    case CBOR_MAP:
+      if(value != CBOR_INDEFINITE && value > (uint64_t)(r->end - r->p))
+        return -1;
+      if(major == CBOR_MAP && value != CBOR_INDEFINITE)
+        value *= 2;
+      while(cbor_more(r, &value))
+        if(cbor_skip(r, depth + 1) < 0)
+          return -1;
+      return 0;
+
+    case CBOR_TAG:
+      return -1;
+
+    default:
+      // integers, simple values and floats carry nothing past their head
+      return 0;
+  }
+}
+
+// first text element of an array, e.g. poa or nu
+static int cbor_get_first_text(cbor_reader_t *r, om2m_cbor_str_t *str, int depth) {
+  uint64_t count;
+
+  if(cbor_get_container(r, CBOR_ARRAY, &count) < 0)
+    return -1;
+
+  if(cbor_more(r, &count) && cbor_get_text(r, str) < 0)
+    return -1;
+
+  while(cbor_more(r, &count))
+    if(cbor_skip(r, depth + 1) < 0)
+      return -1;
+
+  return 0;
+}
+
+int om2m_cbor_str_eq(const om2m_cbor_str_t *str, const char *s) {
+  size_t len = strlen(s);
+
+  return str->p && str->len == len && !memcmp(str->p, s, len);
+}
+
+static int cbor_get_attributes(cbor_reader_t *r, om2m_cbor_resource_t *resource, int depth) {
+  om2m_cbor_str_t key;
+  uint64_t count;
+  int rc;
+
+  if(cbor_get_container(r, CBOR_MAP, &count) < 0)
+    return -1;
+
+  while(cbor_more(r, &count)) {
+    if(cbor_get_text(r, &key) < 0)
+      return -1;
+
+    if(om2m_cbor_str_eq(&key, "rn"))
+      rc = cbor_get_text(r, &resource->rn);
+    else if(om2m_cbor_str_eq(&key, "ri"))
+      rc = cbor_get_text(r, &resource->ri);
+    else if(om2m_cbor_str_eq(&key, "pi"))
+      rc = cbor_get_text(r, &resource->pi);
+    else if(om2m_cbor_str_eq(&key, "con"))
+      rc = cbor_get_text(r, &resource->con);
+    else if(om2m_cbor_str_eq(&key, "cnf"))
+      rc = cbor_get_text(r, &resource->cnf);
+    else if(om2m_cbor_str_eq(&key, "poa"))
+      rc = cbor_get_first_text(r, &resource->poa, depth);
+    else if(om2m_cbor_str_eq(&key, "nu"))
+      rc = cbor_get_first_text(r, &resource->nu, depth);
+    else if(om2m_cbor_str_eq(&key, "nct"))
+      rc = cbor_get_int(r, &resource->nct);
+    else if(om2m_cbor_str_eq(&key, "rr"))
+      rc = cbor_get_bool(r, &resource->rr);
+    // some CSEs send the App-ID as a string, only the numeric form is kept
+    else if(om2m_cbor_str_eq(&key, "api") && cbor_peek(r) <= CBOR_NEGINT)
+      rc = cbor_get_int(r, &resource->api);
+    else
+      rc = cbor_skip(r, depth + 1);
+
+    if(rc < 0)
+      return -1;
+  }
+
+  return 0;
+}
+
+static om2m_ty_t cbor_resource_type(const om2m_cbor_str_t *key) {
+  if(om2m_cbor_str_eq(key, "m2m:ae"))
+    return OM2M_TY_AE;
+  if(om2m_cbor_str_eq(key, "m2m:cnt"))
+    return OM2M_TY_CNT;
+  if(om2m_cbor_str_eq(key, "m2m:cin"))
+    return OM2M_TY_CIN;
+  if(om2m_cbor_str_eq(key, "m2m:sub"))
+    return OM2M_TY_SUB;
+
+  return OM2M_TY_NONE;
+}
+
+// {"m2m:<type>":{...}}, the attributes of other resources are still decoded
+static int cbor_get_resource(cbor_reader_t *r, om2m_cbor_resource_t *resource, int depth) {
+  om2m_cbor_str_t key;
+  uint64_t count;
+
+  if(cbor_get_container(r, CBOR_MAP, &count) < 0)
+    return -1;
+
+  while(cbor_more(r, &count)) {
+    if(cbor_get_text(r, &key) < 0)
+      return -1;
+
+    if(key.len > 4 && !memcmp(key.p, "m2m:", 4)) {
+      resource->ty = cbor_resource_type(&key);
+      if(cbor_get_attributes(r, resource, depth + 1) < 0)
+        return -1;
+    }
+    else if(cbor_skip(r, depth + 1) < 0)
+      return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Decode the primitive content of a resource
+ *
+ * @return 0 on success, -1 if buf is not a well formed resource
+ * */
+int om2m_cbor_parse(const char *buf, size_t len, om2m_cbor_resource_t *resource) {
+  cbor_reader_t r = { (const uint8_t *)buf, (const uint8_t *)buf + len };
+
+  memset(resource, 0, sizeof(*resource));
+
+  if(cbor_get_resource(&r, resource, 0) < 0 || r.p != r.end)
+    return -1;
+
+  return 0;
+}
+
+static int cbor_get_nev(cbor_reader_t *r, om2m_cbor_sgn_t *sgn, int depth) {
+  om2m_cbor_str_t key;
+  uint64_t count;
+  int rc;
+
+  if(cbor_get_container(r, CBOR_MAP, &count) < 0)
+    return -1;
+
+  while(cbor_more(r, &count)) {
+    if(cbor_get_text(r, &key) < 0)
+      return -1;
+
+    if(om2m_cbor_str_eq(&key, "rep"))
+      rc = cbor_get_resource(r, &sgn->rep, depth + 1);
+    else if(om2m_cbor_str_eq(&key, "net"))
+      rc = cbor_get_int(r, &sgn->net);
+    else
+      rc = cbor_skip(r, depth + 1);
+
+    if(rc < 0)
+      return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Decode a notification, {"m2m:sgn":{"nev":{"rep":{...},"net":3},"sur":"..."}}
+ *
+ * @return 0 on success, -1 if buf is not a well formed notification
+ * */
+int om2m_cbor_parse_sgn(const char *buf, size_t len, om2m_cbor_sgn_t *sgn) {
+  cbor_reader_t r = { (const uint8_t *)buf, (const uint8_t *)buf + len };
+  om2m_cbor_str_t key;
+  uint64_t outer, count;
+  int found = 0, rc;
+
+  memset(sgn, 0, sizeof(*sgn));
+
+  if(cbor_get_container(&r, CBOR_MAP, &outer) < 0)
+    return -1;
+
+  while(cbor_more(&r, &outer)) {
+    if(cbor_get_text(&r, &key) < 0)
+      return -1;
+
+    if(!om2m_cbor_str_eq(&key, "m2m:sgn")) {
+      if(cbor_skip(&r, 1) < 0)
+        return -1;
+      continue;
+    }
+
+    found = 1;
+    if(cbor_get_container(&r, CBOR_MAP, &count) < 0)
+      return -1;
+
+    while(cbor_more(&r, &count)) {
+      if(cbor_get_text(&r, &key) < 0)
+        return -1;
+
+      if(om2m_cbor_str_eq(&key, "sur"))
+        rc = cbor_get_text(&r, &sgn->sur);
+      else if(om2m_cbor_str_eq(&key, "vrq"))
+        rc = cbor_get_bool(&r, &sgn->vrq);
+      else if(om2m_cbor_str_eq(&key, "nev"))
+        rc = cbor_get_nev(&r, sgn, 2);
+      else
+        rc = cbor_skip(&r, 2);
+
+      if(rc < 0)
+        return -1;
+    }
+  }
+
+  return found && r.p == r.end ? 0 : -1;
+}
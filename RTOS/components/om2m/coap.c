@@ -1,212 +1,369 @@
 #include "om2m/coap.h"
-#include "cJSON.h"
+#include "om2m/latency.h"
 
+#include <stdio.h>
 #include <string.h>
+#include <sys/socket.h>
 
 #include "tcpip_adapter.h"
 
+#define COAP_URI_MAX	(OM2M_TO_MAX + 1)
+
+static om2m_coap_binding_t *s_coap_bindings[OM2M_COAP_MAX_BINDINGS];
+static om2m_client_t *s_coap_latency_client;
+
+/**
+ * Build and send a oneM2M request PDU, options in ascending order
+ *
+ * @return the transaction id, COAP_INVALID_TID on error
+ * */
+static coap_tid_t om2m_coap_send(coap_context_t *ctx, const coap_address_t *dst, unsigned char type, unsigned short id, unsigned char code,
+                                 const unsigned char *token, size_t token_len, const char *uri, const char *fr, const char *rqi, int ty,
+                                 unsigned int media_type, const char *pc, size_t pc_len) {
+  unsigned char content_format[2], accept[2], type_opt[2];
+  coap_pdu_t *request;
+  coap_tid_t tid;
+
+  request = coap_new_pdu();
+  if(request == NULL)
+    return COAP_INVALID_TID;
+
+  request->hdr->type = type;
+  request->hdr->id   = id;
+  request->hdr->code = code;
+  coap_add_token(request, token_len, token);
+  coap_add_option(request, COAP_OPTION_URI_PATH, strlen(uri), (unsigned char*)uri);
+  if(pc_len)
+    coap_add_option(request, COAP_OPTION_CONTENT_FORMAT, coap_encode_var_bytes(content_format, media_type), content_format);
+  // responses come back in the format of the request
+  coap_add_option(request, COAP_OPTION_ACCEPT, coap_encode_var_bytes(accept, media_type), accept);
+  coap_add_option(request, ONEM2M_OPTION_FR, strlen(fr), (unsigned char*)fr);
+  if(rqi)
+    coap_add_option(request, ONEM2M_OPTION_RQI, strlen(rqi), (unsigned char*)rqi);
+  if(ty)
+    coap_add_option(request, ONEM2M_OPTION_TY, coap_encode_var_bytes(type_opt, ty), type_opt);
+  if(pc_len)
+    coap_add_data(request, pc_len, (unsigned char*)pc);
+
+  // a confirmable PDU belongs to the retransmission queue once it is sent
+  if(type == COAP_MESSAGE_CON) {
+    tid = coap_send_confirmed(ctx, ctx->endpoint, dst, request);
+    if(tid == COAP_INVALID_TID)
+      coap_delete_pdu(request);
+  }
+  else {
+    tid = coap_send(ctx, ctx->endpoint, dst, request);
+    coap_delete_pdu(request);
+  }
+
+  return tid;
+}
+
+static unsigned char om2m_coap_code(om2m_op_t op) {
+  switch(op) {
+    case OM2M_OP_RETRIEVE: return COAP_REQUEST_GET;
+    case OM2M_OP_UPDATE:   return COAP_REQUEST_PUT;
+    case OM2M_OP_DELETE:   return COAP_REQUEST_DELETE;
+    default:               return COAP_REQUEST_POST;
+  }
+}
+
+/**
+ * Response status code from the CoAP code when the CSE leaves out the RSC option
+ * */
+static int om2m_coap_rsc(unsigned char code) {
+  switch(code) {
+    case COAP_RESPONSE_CODE(201): return 2001;
+    case COAP_RESPONSE_CODE(202): return 2002;
+    case COAP_RESPONSE_CODE(204): return 2004;
+    case COAP_RESPONSE_CODE(205): return 2000;
+    case COAP_RESPONSE_CODE(400): return 4000;
+    case COAP_RESPONSE_CODE(403): return 4103;
+    case COAP_RESPONSE_CODE(404): return 4004;
+    case COAP_RESPONSE_CODE(405): return 4005;
+    default:                      return code >= COAP_RESPONSE_CODE(500) ? 5000 : 4000;
+  }
+}
+
+static int coap_binding_send(om2m_client_t *client, const om2m_request_t *request) {
+  om2m_coap_binding_t *binding = client->binding_ctx;
+  char uri[COAP_URI_MAX];
+
+  sprintf(uri, "~%s", request->to);
+
+  // the rqi doubles as token, so responses match even without the RQI option
+  if(om2m_coap_send(binding->ctx, &binding->dst, binding->type, coap_new_message_id(binding->ctx), om2m_coap_code(request->op),
+                    (const unsigned char*)request->rqi, strlen(request->rqi), uri, request->fr, request->rqi, request->ty,
+                    request->format == OM2M_FORMAT_CBOR ? COAP_MEDIATYPE_APPLICATION_CBOR : COAP_MEDIATYPE_APPLICATION_JSON,
+                    request->pc, request->pc_len) == COAP_INVALID_TID)
+    return -1;
+
+  return 0;
+}
+
+/**
+ * Decode a response and hand it to the client,
+ * for applications that register their own response handler
+ *
+ * @return 0 if it matched a pending request, -1 otherwise
+ * */
+int om2m_coap_handle_response(om2m_client_t *client, coap_pdu_t *received) {
+  coap_opt_iterator_t opt_iter;
+  coap_opt_t *opt;
+  om2m_response_t response;
+  char rqi[OM2M_RQI_MAX];
+  unsigned char *data;
+  size_t len;
+
+  memset(&response, 0, sizeof(response));
+
+  if((opt = coap_check_option(received, ONEM2M_OPTION_RQI, &opt_iter)) != NULL) {
+    len = coap_opt_length(opt);
+    if(len >= sizeof(rqi))
+      return -1;
+    memcpy(rqi, coap_opt_value(opt), len);
+  }
+  else {
+    len = received->hdr->token_length;
+    if(len >= sizeof(rqi))
+      return -1;
+    memcpy(rqi, received->hdr->token, len);
+  }
+  rqi[len] = '\0';
+  response.rqi = rqi;
+
+  // a piggybacked response is its own acknowledgement
+  if(received->hdr->type == COAP_MESSAGE_ACK)
+    om2m_client_ack(client, rqi);
+
+  if((opt = coap_check_option(received, ONEM2M_OPTION_RSC, &opt_iter)) != NULL)
+    response.rsc = coap_decode_var_bytes(coap_opt_value(opt), coap_opt_length(opt));
+  else
+    response.rsc = om2m_coap_rsc(received->hdr->code);
+
+  if((opt = coap_check_option(received, COAP_OPTION_CONTENT_FORMAT, &opt_iter)) != NULL &&
+     coap_decode_var_bytes(coap_opt_value(opt), coap_opt_length(opt)) == COAP_MEDIATYPE_APPLICATION_CBOR)
+    response.format = OM2M_FORMAT_CBOR;
+
+  if(coap_get_data(received, &len, &data)) {
+    response.pc = (const char*)data;
+    response.pc_len = len;
+  }
+
+  return om2m_client_response(client, &response);
+}
+
+static void coap_binding_response_handler(struct coap_context_t *ctx, const coap_endpoint_t *local_interface, const coap_address_t *remote,
+                                          coap_pdu_t *sent, coap_pdu_t *received, const coap_tid_t id) {
+  int i;
+
+  for(i = 0; i < OM2M_COAP_MAX_BINDINGS; i++)
+    if(s_coap_bindings[i] && s_coap_bindings[i]->ctx == ctx && s_coap_bindings[i]->client)
+      if(om2m_coap_handle_response(s_coap_bindings[i]->client, received) == 0)
+        return;
+}
+
+// separate response to a CON request, the token is the rqi
+static void coap_binding_ack_handler(struct coap_context_t *ctx, coap_pdu_t *sent) {
+  char rqi[OM2M_RQI_MAX];
+  int i;
+
+  if(sent->hdr->token_length >= sizeof(rqi))
+    return;
+  memcpy(rqi, sent->hdr->token, sent->hdr->token_length);
+  rqi[sent->hdr->token_length] = '\0';
+
+  for(i = 0; i < OM2M_COAP_MAX_BINDINGS; i++)
+    if(s_coap_bindings[i] && s_coap_bindings[i]->ctx == ctx && s_coap_bindings[i]->client)
+      if(om2m_client_ack(s_coap_bindings[i]->client, rqi) == 0)
+        return;
+}
+
+static int coap_binding_attach(om2m_client_t *client) {
+  om2m_coap_binding_t *binding = client->binding_ctx;
+  int i, slot = -1;
+
+  for(i = 0; i < OM2M_COAP_MAX_BINDINGS; i++) {
+    if(s_coap_bindings[i] == binding)
+      slot = i;
+    else if(s_coap_bindings[i] == NULL && slot < 0)
+      slot = i;
+  }
+  if(slot < 0)
+    return -1;
+
+  s_coap_bindings[slot] = binding;
+  binding->client = client;
+  coap_register_response_handler(binding->ctx, coap_binding_response_handler);
+  coap_register_ack_handler(binding->ctx, coap_binding_ack_handler);
+
+  return 0;
+}
+
+static void coap_binding_detach(om2m_client_t *client) {
+  int i;
+
+  for(i = 0; i < OM2M_COAP_MAX_BINDINGS; i++)
+    if(s_coap_bindings[i] == client->binding_ctx)
+      s_coap_bindings[i] = NULL;
+  if(s_coap_latency_client == client)
+    s_coap_latency_client = NULL;
+}
+
+static int coap_binding_poll(om2m_client_t *client, int timeout_ms) {
+  om2m_coap_binding_t *binding = client->binding_ctx;
+  struct timeval tv;
+  fd_set readfds;
+  int ready;
+
+  FD_ZERO(&readfds);
+  FD_SET(binding->ctx->sockfd, &readfds);
+
+  tv.tv_sec = timeout_ms / 1000;
+  tv.tv_usec = (timeout_ms % 1000) * 1000;
+
+  ready = select(binding->ctx->sockfd + 1, &readfds, NULL, NULL, &tv);
+  if(ready > 0)
+    coap_read(binding->ctx);	// dispatches to the response handler
+
+  return ready;
+}
+
+const om2m_binding_t om2m_coap_binding = {
+  .name = "coap",
+  .cbor = 1,
+  .attach = coap_binding_attach,
+  .detach = coap_binding_detach,
+  .send = coap_binding_send,
+  .poll = coap_binding_poll,
+};
+
+void om2m_coap_binding_init(om2m_coap_binding_t *binding, coap_context_t *ctx, const coap_address_t *dst, unsigned char type) {
+  memset(binding, 0, sizeof(*binding));
+  binding->ctx = ctx;
+  binding->dst = *dst;
+  binding->type = type;
+}
+
+static void coap_latency_get(coap_context_t *ctx, struct coap_resource_t *resource, const coap_endpoint_t *local_interface,
+                             coap_address_t *peer, coap_pdu_t *request, str *token, coap_pdu_t *response) {
+  char report[OM2M_LATENCY_REPORT_MAX];
+  unsigned char buf[2];
+  int len;
+
+  if(!s_coap_latency_client || (len = om2m_latency_report(s_coap_latency_client, report, sizeof(report))) < 0) {
+    response->hdr->code = COAP_RESPONSE_CODE(503);
+    return;
+  }
+
+  response->hdr->code = COAP_RESPONSE_CODE(205);
+  coap_add_option(response, COAP_OPTION_CONTENT_FORMAT, coap_encode_var_bytes(buf, COAP_MEDIATYPE_APPLICATION_JSON), buf);
+  coap_add_data(response, len, (unsigned char*)report);
+}
+
+/**
+ * Serve om2m_latency_report of client on GET OM2M_COAP_LATENCY_PATH,
+ * one client per application
+ *
+ * @return 0 on success, -1 if the resource cannot be created
+ * */
+int om2m_coap_latency_resource(coap_context_t *ctx, om2m_client_t *client) {
+  coap_resource_t *resource;
+  coap_key_t key;
+
+  // called again, e.g. for a new client: the resource is already there
+  s_coap_latency_client = client;
+  coap_hash_path((const unsigned char*)OM2M_COAP_LATENCY_PATH, strlen(OM2M_COAP_LATENCY_PATH), key);
+  if(coap_get_resource_from_key(ctx, key))
+    return 0;
+
+  if((resource = coap_resource_init((unsigned char*)OM2M_COAP_LATENCY_PATH, strlen(OM2M_COAP_LATENCY_PATH), 0)) == NULL)
+    return -1;
+  coap_register_handler(resource, COAP_REQUEST_GET, coap_latency_get);
+  coap_add_resource(ctx, resource);
+
+  return 0;
+}
+
+/**
+ * Token and RQI of the standalone calls, both derived from the message id
+ * so that any number of them can be in flight; the prefix keeps the RQI
+ * apart from those assigned by an om2m client
+ * */
+static size_t om2m_coap_request_id(unsigned short id, unsigned char *token, char *rqi) {
+  sprintf(rqi, "m%04x", ntohs(id));
+  memcpy(token, &id, sizeof(id));
+
+  return sizeof(id);
+}
 
 int om2m_coap_create_ae(coap_context_t* ctx, coap_address_t dst_addr, char *ae_name, int ae_id) {
-  int rc = -1;
-  char *out = NULL;
-  char poa_url[50], uri[50], originator[50];
-  unsigned char content_format[2], accept[2], type[2];
-  /*FIX THIS*/
-  unsigned char token[] = {"fd22"};
-  /*FIX THIS*/
-  cJSON *payload = NULL, *ae = NULL, *poa_array = NULL, *lbls = NULL;
+  char poa_url[50], uri[50], pc[OM2M_PC_MAX], rqi[8];
+  unsigned char token[2];
+  unsigned short id = coap_new_message_id(ctx);
   tcpip_adapter_ip_info_t local_ip;
-  coap_pdu_t *request = NULL;
+  int len;
 
   tcpip_adapter_get_ip_info(TCPIP_ADAPTER_IF_STA, &local_ip);
-  //sprintf(poa_url, "coap://"IPSTR":%d", IP2STR(&local_ip.ip), CSE_PORT);
   sprintf(poa_url, "coap://"IPSTR":%d",IP2STR(&local_ip.ip),CSE_PORT);
   sprintf(uri, "~/in-cse/%s", CSE_NAME);
-  //sprintf(uri, "~/in-cse");
-  sprintf(originator, "%s", CSE_ORIGINATOR);
-
-  //create JSON payload
-  payload = cJSON_CreateObject();
-  poa_array = cJSON_CreateArray();
-  lbls = cJSON_CreateArray();
-
-  cJSON_AddItemToArray(poa_array, cJSON_CreateString(poa_url));
-  cJSON_AddItemToArray(lbls,cJSON_CreateString("AE"));
-
-  cJSON_AddItemToObject(payload, "m2m:ae", ae = cJSON_CreateObject());
-  cJSON_AddTrueToObject(ae, "rr");
-  cJSON_AddNumberToObject(ae, "api", ae_id);
-  cJSON_AddStringToObject(ae, "rn", ae_name);
-  cJSON_AddItemToObject(ae, "poa", poa_array);
-  //cJSON_AddItemToObject(ae,"lbl",lbls);
-
-  out = cJSON_PrintUnformatted(payload);
-  cJSON_Delete(lbls);
-  cJSON_Delete(poa_array);
-  cJSON_Delete(payload);
-
-  //create and send CoAP request
-  request = coap_new_pdu();
-  request->hdr->type = COAP_MESSAGE_NON;
-  request->hdr->id   = coap_new_message_id(ctx);
-  request->hdr->code = COAP_REQUEST_POST;
-  coap_add_token(request, sizeof(token), token);
-  coap_add_option(request, COAP_OPTION_URI_PATH, strlen(uri), (unsigned char*)uri);
-  coap_add_option(request, COAP_OPTION_CONTENT_FORMAT, coap_encode_var_bytes(content_format, COAP_MEDIATYPE_APPLICATION_JSON), content_format);
-  coap_add_option(request, COAP_OPTION_ACCEPT, coap_encode_var_bytes(accept, COAP_MEDIATYPE_APPLICATION_JSON), accept);
-  coap_add_option(request, ONEM2M_OPTION_FR, strlen(originator), (unsigned char*)originator);
-  coap_add_option(request, ONEM2M_OPTION_TY, coap_encode_var_bytes(type, 2), (unsigned char*)type);
-  coap_add_data(request, strlen(out), (unsigned char*)out);
-  if(request->hdr->type == COAP_MESSAGE_CON)
-    rc = coap_send_confirmed(ctx, ctx->endpoint, &dst_addr, request);
-  else
-    rc = coap_send(ctx, ctx->endpoint, &dst_addr, request);
 
-  coap_delete_pdu(request);
-  free(out);
-  return rc;
+  if((len = om2m_pc_ae(pc, sizeof(pc), ae_name, ae_id, poa_url)) < 0)
+    return -1;
+
+  return om2m_coap_send(ctx, &dst_addr, COAP_MESSAGE_NON, id, COAP_REQUEST_POST,
+                        token, om2m_coap_request_id(id, token, rqi), uri, CSE_ORIGINATOR, rqi, OM2M_TY_AE,
+                        COAP_MEDIATYPE_APPLICATION_JSON, pc, len);
 }
 
 int om2m_coap_create_container(coap_context_t *ctx, coap_address_t dst_addr, char *ae_name, char *container_name) {
-  int rc = -1;
-  char *out = NULL;
-  char uri[50], originator[50];
-  unsigned char content_format[2], accept[2], type[2];
-  unsigned char token[] = {"fd42"};
-  cJSON *payload = NULL, *cnt = NULL;
-  coap_pdu_t *request = NULL;
+  char uri[50], pc[OM2M_PC_MAX], rqi[8];
+  unsigned char token[2];
+  unsigned short id = coap_new_message_id(ctx);
+  int len;
 
   sprintf(uri, "~/in-cse/%s/%s", CSE_NAME, ae_name);
-  //sprintf(uri, "~/in-cse/%s", ae_name);
-  sprintf(originator, "%s", CSE_ORIGINATOR);
-
-  //create JSON payload
-  payload = cJSON_CreateObject();
-  cJSON_AddItemToObject(payload, "m2m:cnt", cnt = cJSON_CreateObject());
-  cJSON_AddStringToObject(cnt, "rn", container_name);
-  out = cJSON_PrintUnformatted(payload);
-  cJSON_Delete(payload);
 
-  //create and send CoAP request
-  request = coap_new_pdu();
-  request->hdr->type = COAP_MESSAGE_NON;
-  request->hdr->id   = coap_new_message_id(ctx);
-  request->hdr->code = COAP_REQUEST_POST;
-  coap_add_token(request, sizeof(token), token);
-  coap_add_option(request, COAP_OPTION_URI_PATH, strlen(uri), (unsigned char*)uri);
-  coap_add_option(request, COAP_OPTION_CONTENT_FORMAT, coap_encode_var_bytes(content_format, COAP_MEDIATYPE_APPLICATION_JSON), content_format);
-  coap_add_option(request, COAP_OPTION_ACCEPT, coap_encode_var_bytes(accept, COAP_MEDIATYPE_APPLICATION_JSON), accept);
-  coap_add_option(request, ONEM2M_OPTION_FR, strlen(originator), (unsigned char*)originator);
-  coap_add_option(request, ONEM2M_OPTION_TY, coap_encode_var_bytes(type, 3), (unsigned char*)type);
-  coap_add_data(request, strlen(out), (unsigned char*)out);
-  if(request->hdr->type == COAP_MESSAGE_CON)
-    rc = coap_send_confirmed(ctx, ctx->endpoint, &dst_addr, request);
-  else
-    rc = coap_send(ctx, ctx->endpoint, &dst_addr, request);
+  if((len = om2m_pc_cnt(pc, sizeof(pc), container_name)) < 0)
+    return -1;
 
-  coap_delete_pdu(request);
-  free(out);
-  return rc;
+  return om2m_coap_send(ctx, &dst_addr, COAP_MESSAGE_NON, id, COAP_REQUEST_POST,
+                        token, om2m_coap_request_id(id, token, rqi), uri, CSE_ORIGINATOR, rqi, OM2M_TY_CNT,
+                        COAP_MEDIATYPE_APPLICATION_JSON, pc, len);
 }
 
 int om2m_coap_create_content_instance(coap_context_t *ctx, coap_address_t dst_addr, char *ae_name, char *container_name, char *content_instance_name, char *data, unsigned short *msg_id, unsigned short msg_type) {
-  int rc = -1;
-  char *out = NULL;
-  char uri[50], originator[50], cnf[50];
-  unsigned char content_format[2], accept[2], type[2], token[2];
-
-  cJSON *payload = NULL, *cin = NULL;
-  coap_pdu_t *request = NULL;
+  char uri[50], pc[OM2M_PC_MAX], rqi[8];
+  unsigned char token[2];
+  unsigned short id = htons(*msg_id);
+  int len, rc;
 
   sprintf(uri, "~/in-cse/%s/%s/%s", CSE_NAME, ae_name, container_name);
-  //sprintf(uri, "~/in-cse/%s/%s", ae_name, container_name);
-  //sprintf(uri, "~/in-cse/%s", ae_name);
-  sprintf(originator, "%s", CSE_ORIGINATOR);
-  sprintf(cnf, "text/plain:%d", strlen(data));
-  //printf("URI: %s\n",uri);
-  
-  //create JSON payload
-  payload = cJSON_CreateObject();
-  cJSON_AddItemToObject(payload, "m2m:cin", cin = cJSON_CreateObject());
-  cJSON_AddStringToObject(cin, "con", data);
-  cJSON_AddStringToObject(cin, "cnf", cnf);
-  cJSON_AddStringToObject(cin, "rn", content_instance_name);
-  out = cJSON_PrintUnformatted(payload);
-  cJSON_Delete(payload);
-
-  //create and send CoAP request
-  coap_encode_var_bytes(token, htons(*msg_id));
-  request = coap_new_pdu();
-  request->hdr->type = msg_type;
-  request->hdr->id   = htons(*msg_id);
-  request->hdr->code = COAP_REQUEST_POST;
-  coap_add_token(request, sizeof(token), token);
-  coap_add_option(request, COAP_OPTION_URI_PATH, strlen(uri), (unsigned char*)uri);
-  coap_add_option(request, COAP_OPTION_CONTENT_FORMAT, coap_encode_var_bytes(content_format, COAP_MEDIATYPE_APPLICATION_JSON), content_format);
-  coap_add_option(request, COAP_OPTION_ACCEPT, coap_encode_var_bytes(accept, COAP_MEDIATYPE_APPLICATION_JSON), accept);
-  coap_add_option(request, ONEM2M_OPTION_FR, strlen(originator), (unsigned char*)originator);
-  coap_add_option(request, ONEM2M_OPTION_TY, coap_encode_var_bytes(type, 4), (unsigned char*)type);
-  coap_add_data(request, strlen(out), (unsigned char*)out);
-
-  if(request->hdr->type == COAP_MESSAGE_CON)
-    rc = coap_send_confirmed(ctx, ctx->endpoint, &dst_addr, request);
-  else {
-    rc = coap_send(ctx, ctx->endpoint, &dst_addr, request);
-    coap_delete_pdu(request);
-  }
+
+  if((len = om2m_pc_cin(pc, sizeof(pc), content_instance_name, data)) < 0)
+    return -1;
+
+  rc = om2m_coap_send(ctx, &dst_addr, msg_type, id, COAP_REQUEST_POST,
+                      token, om2m_coap_request_id(id, token, rqi), uri, CSE_ORIGINATOR, rqi, OM2M_TY_CIN,
+                      COAP_MEDIATYPE_APPLICATION_JSON, pc, len);
 
   *msg_id = *msg_id + 1;
-  free(out);
   return rc;
 }
 
 int om2m_coap_create_subscription(coap_context_t *ctx, coap_address_t dst_addr, char *ae_name, char* container_name, char *ae_monitor_name, char *sub_name) {
-  int rc = -1;
-  char *out = NULL;
-  char uri[50], originator[50], nu_uri[50];
-  unsigned char content_format[2], accept[2], type[2], token[2];
-  unsigned short msg_id = 0;
-  cJSON *payload = NULL, *sub = NULL, *nu_array = NULL;
-  coap_pdu_t *request = NULL;
+  char uri[50], nu_uri[50], pc[OM2M_PC_MAX], rqi[8];
+  unsigned char token[2];
+  unsigned short id = coap_new_message_id(ctx);
+  int len;
 
   sprintf(nu_uri, "/in-cse/%s/%s", CSE_NAME, ae_monitor_name);
   sprintf(uri, "~/in-cse/%s/%s/%s", CSE_NAME, ae_name, container_name);
-  /*sprintf(nu_uri, "/in-cse/%s/%s",ae_name, ae_monitor_name);
-  sprintf(uri, "~/in-cse/%s",rid);*/
-  sprintf(originator, "%s", CSE_ORIGINATOR);
-
-  //create JSON payload
-  payload = cJSON_CreateObject();
-  nu_array = cJSON_CreateArray();
-  cJSON_AddItemToArray(nu_array, cJSON_CreateString(nu_uri));
-  cJSON_AddItemToObject(payload, "m2m:sub", sub = cJSON_CreateObject());
-  cJSON_AddStringToObject(sub, "rn", sub_name);
-  cJSON_AddNumberToObject(sub, "nct", 2);
-  cJSON_AddItemToObject(sub, "nu", nu_array);
-  out = cJSON_PrintUnformatted(payload);
-  cJSON_Delete(payload);
-
-  //create and send CoAP request
-  msg_id = coap_new_message_id(ctx);
-  coap_encode_var_bytes(token, msg_id);
 
-  request = coap_new_pdu();
-  request->hdr->type = COAP_MESSAGE_NON;
-  request->hdr->id   = msg_id;
-  request->hdr->code = COAP_REQUEST_POST;
-  coap_add_token(request, sizeof(token)-1, token);
-  coap_add_option(request, COAP_OPTION_URI_PATH, strlen(uri), (unsigned char*)uri);
-  coap_add_option(request, COAP_OPTION_CONTENT_FORMAT, coap_encode_var_bytes(content_format, COAP_MEDIATYPE_APPLICATION_JSON), content_format);
-  coap_add_option(request, COAP_OPTION_ACCEPT, coap_encode_var_bytes(accept, COAP_MEDIATYPE_APPLICATION_JSON), accept);
-  coap_add_option(request, ONEM2M_OPTION_FR, strlen(originator), (unsigned char*)originator);
-  coap_add_option(request, ONEM2M_OPTION_TY, coap_encode_var_bytes(type, 23), (unsigned char*)type);
-  coap_add_data(request, strlen(out), (unsigned char*)out);
-  if(request->hdr->type == COAP_MESSAGE_CON)
-    rc = coap_send_confirmed(ctx, ctx->endpoint, &dst_addr, request);
-  else
-    rc = coap_send(ctx, ctx->endpoint, &dst_addr, request);
+  if((len = om2m_pc_sub(pc, sizeof(pc), sub_name, nu_uri)) < 0)
+    return -1;
 
-  coap_delete_pdu(request);
-  free(out);
-  return rc;
+  return om2m_coap_send(ctx, &dst_addr, COAP_MESSAGE_NON, id, COAP_REQUEST_POST,
+                        token, om2m_coap_request_id(id, token, rqi), uri, CSE_ORIGINATOR, rqi, OM2M_TY_SUB,
+                        COAP_MEDIATYPE_APPLICATION_JSON, pc, len);
 }
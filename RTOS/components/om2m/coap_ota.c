@@ -0,0 +1,553 @@
+#include "om2m/coap_ota.h"
+#include "om2m/om2m.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "nvs.h"
+#include "esp_ota_pack.h"
+
+#define COAP_OTA_OPTION_SIZE2	28	// RFC 7959, newer than this libcoap
+#define COAP_OTA_KEY		"coap_ota"
+
+#define COAP_OTA_FREE		0
+#define COAP_OTA_SENT		1
+#define COAP_OTA_RECEIVED	2
+
+#define COAP_OTA_BLOCK_MAX	(1 << (OM2M_COAP_OTA_SZX_MAX + 4))
+#define COAP_OTA_SIZE(szx)	(1u << ((szx) + 4))
+
+/**
+ * Resume point as stored in NVS
+ * */
+typedef struct {
+  uint32_t path_hash;
+  uint32_t num;			// next block, 0 when there is nothing to resume
+  uint32_t szx;			// of num
+  uint32_t etag_len;
+  uint8_t etag[OM2M_COAP_OTA_ETAG_MAX];
+} om2m_coap_ota_resume_t;
+
+static om2m_coap_ota_t *s_coap_ota;	// one download at a time
+
+static uint32_t coap_ota_path_hash(const char *path) {
+  uint32_t hash = 2166136261u;
+
+  while(*path)
+    hash = (hash ^ (unsigned char)*path++) * 16777619u;
+
+  return hash;
+}
+
+/**
+ * @return the offset to go on from, 0 when there is nothing to resume
+ * */
+static uint32_t coap_ota_load(const om2m_coap_ota_t *ota, om2m_coap_ota_resume_t *resume) {
+  size_t len = sizeof(*resume);
+  nvs_handle handle;
+  esp_err_t err;
+
+  if(nvs_open(OM2M_COAP_OTA_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+    return 0;
+  err = nvs_get_blob(handle, COAP_OTA_KEY, resume, &len);
+  nvs_close(handle);
+
+  if(err != ESP_OK || len != sizeof(*resume) || resume->path_hash != coap_ota_path_hash(ota->path) ||
+     resume->szx > OM2M_COAP_OTA_SZX_MAX || resume->etag_len > OM2M_COAP_OTA_ETAG_MAX)
+    return 0;
+
+  return resume->num << (resume->szx + 4);
+}
+
+// offset is a multiple of OM2M_COAP_OTA_COMMIT, 0 to forget the download
+static void coap_ota_store(const om2m_coap_ota_t *ota, uint32_t offset) {
+  om2m_coap_ota_resume_t resume;
+  nvs_handle handle;
+
+  memset(&resume, 0, sizeof(resume));
+  resume.path_hash = coap_ota_path_hash(ota->path);
+  resume.szx = OM2M_COAP_OTA_SZX_MAX;
+  resume.num = offset >> (resume.szx + 4);
+  resume.etag_len = ota->etag_len;
+  memcpy(resume.etag, ota->etag, ota->etag_len);
+
+  if(nvs_open(OM2M_COAP_OTA_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK)
+    return;
+  if(nvs_set_blob(handle, COAP_OTA_KEY, &resume, sizeof(resume)) == ESP_OK)
+    nvs_commit(handle);
+  nvs_close(handle);
+}
+
+// largest block size up to szx that offset is a multiple of
+static int coap_ota_szx_at(uint32_t offset, int szx) {
+  while(szx > 0 && offset % COAP_OTA_SIZE(szx))
+    szx--;
+
+  return szx;
+}
+
+static int coap_ota_send(om2m_coap_ota_t *ota, om2m_coap_ota_block_t *block) {
+  unsigned char token[sizeof(block->offset)], opt[4];
+  const char *path = ota->path;
+  coap_pdu_t *request;
+  coap_tid_t tid;
+  size_t len;
+
+  request = coap_new_pdu();
+  if(request == NULL)
+    return -1;
+
+  request->hdr->type = COAP_MESSAGE_NON;
+  request->hdr->id = coap_new_message_id(ota->ctx);
+  request->hdr->code = COAP_REQUEST_GET;
+  // the offset doubles as token, the response finds its block without a lookup table
+  memcpy(token, &block->offset, sizeof(token));
+  coap_add_token(request, sizeof(token), token);
+
+  while(*path) {
+    len = strcspn(path, "/");
+    if(len)
+      coap_add_option(request, COAP_OPTION_URI_PATH, len, (unsigned char*)path);
+    path += len;
+    if(*path == '/')
+      path++;
+  }
+
+  coap_add_option(request, COAP_OPTION_BLOCK2,
+                  coap_encode_var_bytes(opt, (block->offset >> (block->szx + 4)) << 4 | block->szx), opt);
+  // asks for the size of the image, RFC 7959 section 4
+  if(ota->end == UINT32_MAX)
+    coap_add_option(request, COAP_OTA_OPTION_SIZE2, 0, NULL);
+
+  tid = coap_send(ota->ctx, ota->ctx->endpoint, &ota->dst, request);
+  coap_delete_pdu(request);
+
+  block->state = COAP_OTA_SENT;
+  block->sent_ms = om2m_now_ms();
+  ota->requests++;
+
+  return tid == COAP_INVALID_TID ? -1 : 0;
+}
+
+static void coap_ota_request(om2m_coap_ota_t *ota, uint32_t offset) {
+  om2m_coap_ota_block_t *block = NULL;
+  int i;
+
+  for(i = 0; i < OM2M_COAP_OTA_WINDOW && !block; i++) {
+    if(ota->block[i].state == COAP_OTA_FREE)
+      block = &ota->block[i];
+  }
+
+  block->offset = offset;
+  block->szx = coap_ota_szx_at(offset, ota->szx);
+  block->tries = 0;
+  block->len = 0;
+  if(offset == ota->next)
+    ota->next += COAP_OTA_SIZE(block->szx);
+
+  coap_ota_send(ota, block);
+}
+
+/**
+ * First byte from done on that no block covers, a response smaller than
+ * its request, or a request sent again with smaller blocks, leaves gaps
+ * before next
+ * */
+static uint32_t coap_ota_gap(const om2m_coap_ota_t *ota) {
+  uint32_t offset = ota->done, end;
+  int i, moved = 1;
+
+  while(moved) {
+    moved = 0;
+    for(i = 0; i < OM2M_COAP_OTA_WINDOW; i++) {
+      const om2m_coap_ota_block_t *block = &ota->block[i];
+
+      if(block->state == COAP_OTA_FREE)
+        continue;
+      end = block->offset + (block->state == COAP_OTA_RECEIVED ? block->len : COAP_OTA_SIZE(block->szx));
+      if(block->offset <= offset && offset < end) {
+        offset = end;
+        moved = 1;
+      }
+    }
+  }
+
+  return offset;
+}
+
+/**
+ * Keep the window full
+ *
+ * @return the number of requests in flight
+ * */
+static int coap_ota_fill(om2m_coap_ota_t *ota) {
+  int i, slots = 0;
+  uint32_t gap;
+
+  for(i = 0; i < OM2M_COAP_OTA_WINDOW; i++) {
+    if(ota->block[i].state == COAP_OTA_FREE)
+      slots++;
+  }
+
+  while(slots) {
+    gap = coap_ota_gap(ota);
+    if(gap < ota->next && gap < ota->end)
+      coap_ota_request(ota, gap);
+    else if(ota->next < ota->end && !ota->last)
+      coap_ota_request(ota, ota->next);
+    else
+      break;
+    slots--;
+  }
+
+  for(i = slots = 0; i < OM2M_COAP_OTA_WINDOW; i++) {
+    if(ota->block[i].state == COAP_OTA_SENT)
+      slots++;
+  }
+
+  return slots;
+}
+
+/**
+ * Bytes on the air per image byte at block size szx, 16.16 fixed point,
+ * from the loss at the current size
+ * */
+static uint32_t coap_ota_cost(const om2m_coap_ota_t *ota, int szx) {
+  uint32_t air = COAP_OTA_SIZE(szx) + OM2M_COAP_OTA_OVERHEAD;
+  uint64_t loss = (uint64_t)ota->loss * air / (COAP_OTA_SIZE(ota->szx) + OM2M_COAP_OTA_OVERHEAD);
+
+  if(loss >= 65536)
+    return UINT32_MAX;
+
+  return ((uint64_t)air << 32) / ((uint64_t)COAP_OTA_SIZE(szx) * (65536 - loss));
+}
+
+/**
+ * Block size from the loss average, a change waits for the outcome of
+ * OM2M_COAP_OTA_SZX_HOLD requests of the size before
+ * */
+static void coap_ota_adapt(om2m_coap_ota_t *ota, int lost) {
+  int szx = ota->szx;
+
+  if(lost)
+    ota->loss += (65536 - ota->loss) >> 4;
+  else
+    ota->loss -= ota->loss >> 4;
+
+  if(ota->hold > 0 && --ota->hold > 0)
+    return;
+
+  if(szx > ota->szx_min && coap_ota_cost(ota, szx - 1) < coap_ota_cost(ota, szx))
+    szx--;
+  else if(szx < ota->szx_max && coap_ota_cost(ota, szx + 1) < coap_ota_cost(ota, szx))
+    szx++;
+  if(szx == ota->szx)
+    return;
+
+  // the same link at the new size
+  ota->loss = (uint64_t)ota->loss * (COAP_OTA_SIZE(szx) + OM2M_COAP_OTA_OVERHEAD) /
+              (COAP_OTA_SIZE(ota->szx) + OM2M_COAP_OTA_OVERHEAD);
+  if(ota->loss > 65535)
+    ota->loss = 65535;
+  ota->szx = szx;
+  ota->hold = OM2M_COAP_OTA_SZX_HOLD;
+}
+
+static void coap_ota_receive(om2m_coap_ota_t *ota, om2m_coap_ota_block_t *block, coap_pdu_t *received) {
+  coap_opt_iterator_t opt_iter;
+  coap_block_t block2;
+  coap_opt_t *opt;
+  unsigned char *data;
+  size_t len = 0;
+
+  if(COAP_RESPONSE_CLASS(received->hdr->code) != 2) {
+    // past the end of an image whose size the server did not tell
+    if(received->hdr->code == COAP_RESPONSE_CODE(402) && block->offset > 0 && ota->opened) {
+      if(block->offset < ota->end)
+        ota->end = block->offset;
+      block->state = COAP_OTA_FREE;
+      return;
+    }
+    ota->err = -1;
+    return;
+  }
+
+  if((opt = coap_check_option(received, COAP_OPTION_ETAG, &opt_iter)) != NULL) {
+    len = coap_opt_length(opt);
+    if(len > OM2M_COAP_OTA_ETAG_MAX)
+      len = OM2M_COAP_OTA_ETAG_MAX;
+  }
+  if(!ota->opened) {
+    ota->etag_len = len;
+    if(len)
+      memcpy(ota->etag, coap_opt_value(opt), len);
+  }
+  else if(len != ota->etag_len || (len && memcmp(ota->etag, coap_opt_value(opt), len))) {
+    // the image changed on the server, what is on flash is of no use
+    coap_ota_store(ota, 0);
+    ota->err = -1;
+    return;
+  }
+
+  // a small image may come whole
+  if(!coap_get_block(received, COAP_OPTION_BLOCK2, &block2)) {
+    block2.num = 0;
+    block2.m = 0;
+    block2.szx = block->szx;
+  }
+  if(block2.num << (block2.szx + 4) != block->offset || block2.szx > block->szx)
+    return;
+
+  coap_get_data(received, &len, &data);
+  if(len > COAP_OTA_SIZE(block->szx) || (block2.m && len != COAP_OTA_SIZE(block2.szx))) {
+    ota->err = -1;
+    return;
+  }
+
+  // the server may cap the block size, RFC 7959 section 2.4
+  if(block2.szx < ota->szx_max) {
+    ota->szx_max = block2.szx;
+    if(ota->szx > ota->szx_max)
+      ota->szx = ota->szx_max;
+  }
+
+  if(!block2.m) {
+    ota->last = 1;
+    ota->end = block->offset + len;
+  }
+  else if(ota->end == UINT32_MAX && (opt = coap_check_option(received, COAP_OTA_OPTION_SIZE2, &opt_iter)) != NULL) {
+    ota->end = coap_decode_var_bytes(coap_opt_value(opt), coap_opt_length(opt));
+  }
+
+  memcpy(block->data, data, len);
+  block->len = len;
+  block->state = COAP_OTA_RECEIVED;
+  coap_ota_adapt(ota, 0);
+}
+
+static void coap_ota_response_handler(struct coap_context_t *ctx, const coap_endpoint_t *local_interface, const coap_address_t *remote,
+                                      coap_pdu_t *sent, coap_pdu_t *received, const coap_tid_t id) {
+  om2m_coap_ota_t *ota = s_coap_ota;
+  uint32_t offset;
+  int i;
+
+  if(ota && ctx == ota->ctx && received->hdr->token_length == sizeof(offset)) {
+    memcpy(&offset, received->hdr->token, sizeof(offset));
+    for(i = 0; i < OM2M_COAP_OTA_WINDOW; i++) {
+      if(ota->block[i].offset != offset || ota->block[i].state == COAP_OTA_FREE)
+        continue;
+      // a late answer to a request sent again
+      if(ota->block[i].state == COAP_OTA_SENT)
+        coap_ota_receive(ota, &ota->block[i], received);
+      return;
+    }
+  }
+
+  // e.g. the om2m client sharing the context
+  if(ota && ota->prev_handler)
+    ota->prev_handler(ctx, local_interface, remote, sent, received, id);
+}
+
+// requests not answered in time are sent again, with the current block size when it is smaller
+static void coap_ota_expire(om2m_coap_ota_t *ota) {
+  uint32_t now = om2m_now_ms();
+  int i;
+
+  for(i = 0; i < OM2M_COAP_OTA_WINDOW; i++) {
+    om2m_coap_ota_block_t *block = &ota->block[i];
+
+    if(block->state != COAP_OTA_SENT || (int32_t)(now - block->sent_ms) < ota->timeout_ms)
+      continue;
+
+    ota->lost++;
+    coap_ota_adapt(ota, 1);
+    if(++block->tries > ota->retries) {
+      ota->err = -1;
+      return;
+    }
+    if(block->szx > ota->szx)
+      block->szx = ota->szx;
+    coap_ota_send(ota, block);
+  }
+}
+
+// the header of a packed image is little endian
+static int coap_ota_is_packed(const uint8_t *data, size_t len) {
+  return len >= 4 && (data[0] | data[1] << 8 | data[2] << 16 | (uint32_t)data[3] << 24) == ESP_OTA_PACK_MAGIC;
+}
+
+// hand the blocks to the OTA writer in order, every OM2M_COAP_OTA_COMMIT bytes is a resume point
+static void coap_ota_deliver(om2m_coap_ota_t *ota) {
+  uint32_t before = ota->done;
+  int i, moved = 1;
+
+  while(moved && !ota->err) {
+    moved = 0;
+    for(i = 0; i < OM2M_COAP_OTA_WINDOW; i++) {
+      om2m_coap_ota_block_t *block = &ota->block[i];
+
+      if(block->state != COAP_OTA_RECEIVED || block->offset != ota->done)
+        continue;
+      // the decoder writes the flash, a resume point would be a download offset and no flash offset
+      if(block->offset == 0 && coap_ota_is_packed(block->data, block->len)) {
+        ota->packed = 1;
+        coap_ota_store(ota, 0);
+      }
+      if(esp_ota_write(ota->handle, block->data, block->len) != ESP_OK) {
+        ota->err = -1;
+        return;
+      }
+      ota->done += block->len;
+      block->state = COAP_OTA_FREE;
+      moved = 1;
+    }
+  }
+
+  // esp_ota_write puts a sector on flash when it is full, everything before done is there
+  if(!ota->packed && ota->done / OM2M_COAP_OTA_COMMIT != before / OM2M_COAP_OTA_COMMIT)
+    coap_ota_store(ota, ota->done - ota->done % OM2M_COAP_OTA_COMMIT);
+}
+
+static void coap_ota_wait(om2m_coap_ota_t *ota) {
+  uint32_t now = om2m_now_ms();
+  int i, wait = ota->timeout_ms, left;
+  struct timeval tv;
+  fd_set readfds;
+
+  for(i = 0; i < OM2M_COAP_OTA_WINDOW; i++) {
+    if(ota->block[i].state != COAP_OTA_SENT)
+      continue;
+    left = ota->timeout_ms - (int32_t)(now - ota->block[i].sent_ms);
+    if(left < wait)
+      wait = left > 0 ? left : 0;
+  }
+
+  FD_ZERO(&readfds);
+  FD_SET(ota->ctx->sockfd, &readfds);
+  tv.tv_sec = wait / 1000;
+  tv.tv_usec = (wait % 1000) * 1000;
+
+  if(select(ota->ctx->sockfd + 1, &readfds, NULL, NULL, &tv) > 0)
+    coap_read(ota->ctx);	// dispatches to coap_ota_response_handler
+
+  coap_ota_expire(ota);
+  if(ota->opened)
+    coap_ota_deliver(ota);
+}
+
+/**
+ * Ask for the block at offset and wait for it, learning the ETag,
+ * the size of the image and the block size of the server
+ * */
+static int coap_ota_probe(om2m_coap_ota_t *ota, uint32_t offset) {
+  int i;
+
+  for(i = 0; i < OM2M_COAP_OTA_WINDOW; i++)
+    ota->block[i].state = COAP_OTA_FREE;
+  ota->next = ota->done = offset;
+  ota->end = UINT32_MAX;
+  ota->last = 0;
+  ota->err = 0;
+
+  coap_ota_request(ota, offset);
+  while(!ota->err && ota->block[0].state == COAP_OTA_SENT)
+    coap_ota_wait(ota);
+
+  return ota->err || ota->block[0].state != COAP_OTA_RECEIVED ? -1 : 0;
+}
+
+void om2m_coap_ota_init(om2m_coap_ota_t *ota, coap_context_t *ctx, const coap_address_t *dst, const char *path) {
+  memset(ota, 0, sizeof(*ota));
+  ota->ctx = ctx;
+  ota->dst = *dst;
+  ota->path = path;
+  ota->timeout_ms = OM2M_COAP_OTA_TIMEOUT_MS;
+  ota->retries = OM2M_COAP_OTA_RETRIES;
+  ota->szx_min = OM2M_COAP_OTA_SZX_MIN;
+  ota->szx_max = OM2M_COAP_OTA_SZX_MAX;
+}
+
+/**
+ * Download the image into the update partition, from where an earlier
+ * download of the same image stopped if it can
+ *
+ * Takes the response handler of the context until it returns, handing
+ * on the responses that are not its own. Selecting the new partition
+ * for boot is up to the caller.
+ *
+ * @return 0 when the image is on flash and verified, -1 otherwise
+ * */
+int om2m_coap_ota_run(om2m_coap_ota_t *ota) {
+  om2m_coap_ota_resume_t resume;
+  uint32_t offset;
+  uint8_t *buf;
+  esp_err_t err;
+  int i, ret = -1;
+
+  if(s_coap_ota)
+    return -1;
+  if(!ota->partition && !(ota->partition = esp_ota_get_next_update_partition(NULL)))
+    return -1;
+  if(ota->szx_max > OM2M_COAP_OTA_SZX_MAX || ota->szx_min > ota->szx_max)
+    return -1;
+  if(!(buf = malloc(OM2M_COAP_OTA_WINDOW * COAP_OTA_BLOCK_MAX)))
+    return -1;
+  for(i = 0; i < OM2M_COAP_OTA_WINDOW; i++)
+    ota->block[i].data = buf + i * COAP_OTA_BLOCK_MAX;
+
+  s_coap_ota = ota;
+  ota->prev_handler = ota->ctx->response_handler;
+  coap_register_response_handler(ota->ctx, coap_ota_response_handler);
+
+  ota->opened = 0;
+  ota->packed = 0;
+  ota->szx = ota->szx_max;
+  ota->hold = OM2M_COAP_OTA_SZX_HOLD;
+  ota->loss = 0;
+  offset = coap_ota_load(ota, &resume);
+
+  while(1) {
+    if(coap_ota_probe(ota, offset) < 0)
+      goto out;
+
+    // the partition holds the start of this very image
+    if(offset && resume.etag_len && resume.etag_len == ota->etag_len && !memcmp(resume.etag, ota->etag, ota->etag_len) &&
+       esp_ota_begin_at(ota->partition, offset, &ota->handle) == ESP_OK)
+      break;
+    if(!offset) {
+      if(esp_ota_begin(ota->partition, ota->end == UINT32_MAX ? OTA_SIZE_UNKNOWN : ota->end, &ota->handle) != ESP_OK)
+        goto out;
+      break;
+    }
+    offset = 0;
+  }
+  ota->opened = 1;
+  ota->resumed_at = offset;
+  coap_ota_deliver(ota);
+
+  while(!ota->err && !(ota->last && ota->done == ota->end)) {
+    // the server stopped short of a block with M=0
+    if(!coap_ota_fill(ota)) {
+      ota->err = -1;
+      break;
+    }
+    coap_ota_wait(ota);
+  }
+
+  err = esp_ota_end(ota->handle);
+  if(!ota->err) {
+    // a verified image, or one that will never be
+    coap_ota_store(ota, 0);
+    ret = err == ESP_OK ? 0 : -1;
+  }
+
+out:
+  coap_register_response_handler(ota->ctx, ota->prev_handler);
+  s_coap_ota = NULL;
+  for(i = 0; i < OM2M_COAP_OTA_WINDOW; i++)
+    ota->block[i].data = NULL;
+  free(buf);
+
+  return ret;
+}
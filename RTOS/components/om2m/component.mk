@@ -4,3 +4,7 @@
 
 COMPONENT_ADD_INCLUDEDIRS += include
 COMPONENT_SRCDIRS := ./
+
+ifndef CONFIG_ENABLE_MDNS
+COMPONENT_OBJEXCLUDE := discovery.o
+endif
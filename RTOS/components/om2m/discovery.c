@@ -0,0 +1,333 @@
+#include "om2m/discovery.h"
+#include "om2m/om2m.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/task.h"
+#include "mdns.h"
+#include "nvs.h"
+
+#define DISCOVERY_KEY_MAX	16	// NVS keys are at most 15 characters
+
+/**
+ * Candidates as stored in NVS, one blob per protocol
+ * */
+typedef struct {
+  int32_t num;
+  om2m_cse_t cse[OM2M_DISCOVERY_CANDIDATES];
+} om2m_discovery_cache_t;
+
+static void om2m_discovery_key(const om2m_discovery_t *discovery, char *key) {
+  snprintf(key, DISCOVERY_KEY_MAX, "cse%s", discovery->proto);
+}
+
+static void om2m_discovery_load(om2m_discovery_t *discovery) {
+  om2m_discovery_cache_t cache;
+  char key[DISCOVERY_KEY_MAX];
+  size_t len = sizeof(cache);
+  nvs_handle handle;
+  esp_err_t err;
+
+  om2m_discovery_key(discovery, key);
+  if(nvs_open(OM2M_DISCOVERY_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+    return;
+  err = nvs_get_blob(handle, key, &cache, &len);
+  nvs_close(handle);
+
+  if(err != ESP_OK || len != sizeof(cache) || cache.num <= 0 || cache.num > OM2M_DISCOVERY_CANDIDATES)
+    return;
+
+  memcpy(discovery->cse, cache.cse, sizeof(cache.cse));
+  discovery->num = cache.num;
+  // the time spent powered off is unknown, re-validate on first use
+  discovery->expires = om2m_now_ms();
+}
+
+static void om2m_discovery_store(const om2m_discovery_t *discovery, const om2m_discovery_cache_t *cache) {
+  char key[DISCOVERY_KEY_MAX];
+  nvs_handle handle;
+
+  om2m_discovery_key(discovery, key);
+  if(nvs_open(OM2M_DISCOVERY_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK)
+    return;
+  if(nvs_set_blob(handle, key, cache, sizeof(*cache)) == ESP_OK)
+    nvs_commit(handle);
+  nvs_close(handle);
+}
+
+// caller holds the lock
+static void om2m_discovery_snapshot(const om2m_discovery_t *discovery, om2m_discovery_cache_t *cache) {
+  memset(cache, 0, sizeof(*cache));
+  cache->num = discovery->num;
+  memcpy(cache->cse, discovery->cse, discovery->num * sizeof(om2m_cse_t));
+}
+
+static void om2m_discovery_txt(char *dst, size_t size, const char *value) {
+  snprintf(dst, size, "%s", value ? value : "");
+}
+
+/**
+ * Ask the network for the CSEs of the protocol
+ *
+ * @return the number of CSEs found, -1 when mDNS is not running
+ * */
+static int om2m_discovery_query(const char *proto, om2m_cse_t *found, unsigned int *queries) {
+  mdns_result_t *results = NULL, *r;
+  int n = 0;
+  size_t i;
+
+  (*queries)++;
+  if(mdns_query_ptr(OM2M_DISCOVERY_SERVICE, proto, OM2M_DISCOVERY_TIMEOUT_MS, OM2M_DISCOVERY_CANDIDATES, &results) != ESP_OK)
+    return -1;
+
+  for(r = results; r && n < OM2M_DISCOVERY_CANDIDATES; r = r->next) {
+    om2m_cse_t *cse = &found[n];
+    mdns_ip_addr_t *a;
+
+    // no SRV record, or a CSE saying goodbye
+    if(!r->port || !r->ttl)
+      continue;
+
+    memset(cse, 0, sizeof(*cse));
+    cse->port = r->port;
+    cse->ttl = r->ttl;
+    for(a = r->addr; a; a = a->next) {
+      if(a->addr.type == IPADDR_TYPE_V4) {
+        cse->addr = a->addr.u_addr.ip4.addr;
+        break;
+      }
+    }
+
+    // the responder left the address out of the additional records
+    if(!cse->addr) {
+      ip4_addr_t ip;
+
+      (*queries)++;
+      if(!r->hostname || mdns_query_a(r->hostname, OM2M_DISCOVERY_TIMEOUT_MS, &ip) != ESP_OK)
+        continue;
+      cse->addr = ip.addr;
+    }
+
+    for(i = 0; i < r->txt_count; i++) {
+      if(!strcmp(r->txt[i].key, "rn"))
+        om2m_discovery_txt(cse->rn, sizeof(cse->rn), r->txt[i].value);
+      else if(!strcmp(r->txt[i].key, "csi"))
+        om2m_discovery_txt(cse->csi, sizeof(cse->csi), r->txt[i].value);
+    }
+
+    n++;
+  }
+
+  mdns_query_results_free(results);
+  return n;
+}
+
+static uint32_t om2m_discovery_ttl_ms(uint32_t ttl) {
+  if(ttl < OM2M_DISCOVERY_TTL_MIN)
+    ttl = OM2M_DISCOVERY_TTL_MIN;
+  else if(ttl > OM2M_DISCOVERY_TTL_MAX)
+    ttl = OM2M_DISCOVERY_TTL_MAX;
+
+  return ttl * 1000;
+}
+
+static int om2m_discovery_same(const om2m_cse_t *a, const om2m_cse_t *b) {
+  return a->addr == b->addr && a->port == b->port;
+}
+
+// the TTL is left out, a CSE announcing the same thing again is no change
+static int om2m_discovery_changed(const om2m_cse_t *a, int num_a, const om2m_cse_t *b, int num_b) {
+  int i;
+
+  if(num_a != num_b)
+    return 1;
+
+  for(i = 0; i < num_a; i++) {
+    if(!om2m_discovery_same(&a[i], &b[i]) || strcmp(a[i].rn, b[i].rn) || strcmp(a[i].csi, b[i].csi))
+      return 1;
+  }
+
+  return 0;
+}
+
+int om2m_discovery_init(om2m_discovery_t *discovery, const char *proto) {
+  memset(discovery, 0, sizeof(*discovery));
+  discovery->proto = proto;
+
+  if((discovery->lock = xSemaphoreCreateMutex()) == NULL)
+    return -1;
+
+  return 0;
+}
+
+/**
+ * Query the network and replace the candidates, the CSE in use stays first
+ * while it is still announced so that a re-validation does not move the
+ * client for nothing. When nothing answers the candidates are kept.
+ *
+ * @return 0 when a CSE was found, -1 otherwise
+ * */
+int om2m_discovery_refresh(om2m_discovery_t *discovery) {
+  om2m_cse_t found[OM2M_DISCOVERY_CANDIDATES];
+  om2m_discovery_cache_t cache;
+  unsigned int queries = 0;
+  int n, i, changed = 0;
+
+  n = om2m_discovery_query(discovery->proto, found, &queries);
+
+  xSemaphoreTake(discovery->lock, portMAX_DELAY);
+  discovery->queries += queries;
+
+  if(n > 0) {
+    for(i = 1; discovery->num && i < n; i++) {
+      if(om2m_discovery_same(&found[i], &discovery->cse[0])) {
+        om2m_cse_t current = found[i];
+
+        memmove(&found[1], &found[0], i * sizeof(om2m_cse_t));
+        found[0] = current;
+        break;
+      }
+    }
+
+    changed = om2m_discovery_changed(found, n, discovery->cse, discovery->num);
+    memcpy(discovery->cse, found, n * sizeof(om2m_cse_t));
+    discovery->num = n;
+    discovery->expires = om2m_now_ms() + om2m_discovery_ttl_ms(found[0].ttl);
+  }
+  else {
+    // ask again later rather than on every use
+    discovery->expires = om2m_now_ms() + om2m_discovery_ttl_ms(0);
+  }
+
+  if(changed)
+    om2m_discovery_snapshot(discovery, &cache);
+  xSemaphoreGive(discovery->lock);
+
+  // flash is only written when the answer differs from what is cached
+  if(changed)
+    om2m_discovery_store(discovery, &cache);
+
+  return n > 0 ? 0 : -1;
+}
+
+static void om2m_discovery_task(void *arg) {
+  om2m_discovery_t *discovery = arg;
+
+  om2m_discovery_refresh(discovery);
+
+  xSemaphoreTake(discovery->lock, portMAX_DELAY);
+  discovery->refreshing = false;
+  xSemaphoreGive(discovery->lock);
+
+  vTaskDelete(NULL);
+}
+
+/**
+ * CSE to talk to
+ *
+ * Answered from memory, or from NVS after a reboot, without any round
+ * trip; once the TTL of the answer has run out it is still returned while
+ * a background task asks the network again. Only the very first discovery
+ * waits for mDNS.
+ *
+ * @return 0 on success, -1 when no CSE is known or announced
+ * */
+int om2m_discovery_get(om2m_discovery_t *discovery, om2m_cse_t *cse) {
+  int start = 0;
+
+  xSemaphoreTake(discovery->lock, portMAX_DELAY);
+
+  if(!discovery->loaded) {
+    discovery->loaded = true;
+    om2m_discovery_load(discovery);
+  }
+
+  if(discovery->num) {
+    *cse = discovery->cse[0];
+    if(!discovery->refreshing && (int32_t)(om2m_now_ms() - discovery->expires) >= 0)
+      start = discovery->refreshing = true;
+    xSemaphoreGive(discovery->lock);
+
+    if(start && xTaskCreate(om2m_discovery_task, "om2m_discovery", 3072, discovery, tskIDLE_PRIORITY + 1, NULL) != pdPASS) {
+      xSemaphoreTake(discovery->lock, portMAX_DELAY);
+      discovery->refreshing = false;
+      xSemaphoreGive(discovery->lock);
+    }
+    return 0;
+  }
+
+  xSemaphoreGive(discovery->lock);
+
+  if(om2m_discovery_refresh(discovery) < 0)
+    return -1;
+
+  xSemaphoreTake(discovery->lock, portMAX_DELAY);
+  *cse = discovery->cse[0];
+  xSemaphoreGive(discovery->lock);
+
+  return 0;
+}
+
+/**
+ * The CSE in use stopped answering, move on to the next candidate without
+ * asking the network; the failed CSE comes back only if a later query still
+ * finds it announced
+ *
+ * @return 0 with the next CSE in cse, -1 when none is left or announced
+ * */
+int om2m_discovery_failover(om2m_discovery_t *discovery, om2m_cse_t *cse) {
+  om2m_discovery_cache_t cache;
+
+  xSemaphoreTake(discovery->lock, portMAX_DELAY);
+  discovery->loaded = true;
+  if(discovery->num) {
+    discovery->num--;
+    memmove(&discovery->cse[0], &discovery->cse[1], discovery->num * sizeof(om2m_cse_t));
+  }
+  om2m_discovery_snapshot(discovery, &cache);
+  xSemaphoreGive(discovery->lock);
+
+  om2m_discovery_store(discovery, &cache);
+
+  return om2m_discovery_get(discovery, cse);
+}
+
+/**
+ * Release the discovery once its background query, if any, is over
+ * */
+void om2m_discovery_close(om2m_discovery_t *discovery) {
+  bool refreshing = true;
+
+  if(!discovery->lock)
+    return;
+
+  while(refreshing) {
+    xSemaphoreTake(discovery->lock, portMAX_DELAY);
+    refreshing = discovery->refreshing;
+    xSemaphoreGive(discovery->lock);
+    if(refreshing)
+      vTaskDelay(10 / portTICK_RATE_MS);
+  }
+
+  vSemaphoreDelete(discovery->lock);
+  discovery->lock = NULL;
+}
+
+/**
+ * CSE-relative root of the resources, e.g. /in-cse/dartes
+ *
+ * @return the length, -1 when the CSE did not announce its name or buf is too small
+ * */
+int om2m_cse_path(const om2m_cse_t *cse, char *buf, size_t size) {
+  int len;
+
+  if(!cse->rn[0] || !cse->csi[0])
+    return -1;
+
+  len = snprintf(buf, size, "%s/%s", cse->csi, cse->rn);
+  if(len < 0 || len >= size)
+    return -1;
+
+  return len;
+}
@@ -0,0 +1,327 @@
+#include "om2m/duty.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/task.h"
+#include "nvs.h"
+#include "crc.h"
+
+#define DUTY_LINK_KEY	"duty_link"
+#define DUTY_CON_MAX	192	// leaves room for the rest of the content instance in OM2M_PC_MAX
+
+static uint32_t om2m_duty_now(om2m_duty_t *duty) {
+  return duty->ops->now_ms ? duty->ops->now_ms(duty->ops_arg) : om2m_now_ms();
+}
+
+static uint32_t om2m_duty_crc(const om2m_duty_rtc_t *rtc) {
+  return crc32_le(0, (const uint8_t *)rtc, offsetof(om2m_duty_rtc_t, crc));
+}
+
+/**
+ * After a power on the RTC memory holds garbage, the link comes from NVS
+ * so that only the very first join of the device scans
+ * */
+static void om2m_duty_link_load(om2m_duty_link_t *link) {
+  size_t len = sizeof(*link);
+  nvs_handle handle;
+  esp_err_t err;
+
+  if(nvs_open(OM2M_DUTY_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+    return;
+  err = nvs_get_blob(handle, DUTY_LINK_KEY, link, &len);
+  nvs_close(handle);
+
+  if(err != ESP_OK || len != sizeof(*link))
+    memset(link, 0, sizeof(*link));
+  // the lease may have run out while powered off
+  link->uses = OM2M_DUTY_REUSE;
+}
+
+static void om2m_duty_link_store(const om2m_duty_link_t *link) {
+  nvs_handle handle;
+
+  if(nvs_open(OM2M_DUTY_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK)
+    return;
+  if(nvs_set_blob(handle, DUTY_LINK_KEY, link, sizeof(*link)) == ESP_OK)
+    nvs_commit(handle);
+  nvs_close(handle);
+}
+
+// the use count is left out, joining the same AP again is no change
+static int om2m_duty_link_changed(const om2m_duty_link_t *a, const om2m_duty_link_t *b) {
+  return memcmp(a->bssid, b->bssid, sizeof(a->bssid)) || a->channel != b->channel ||
+         a->ip != b->ip || a->netmask != b->netmask || a->gw != b->gw || a->dns != b->dns;
+}
+
+static void om2m_duty_metric(om2m_duty_metric_t *metric, uint32_t ms) {
+  metric->last = ms;
+  if(!metric->count || ms < metric->min)
+    metric->min = ms;
+  if(ms > metric->max)
+    metric->max = ms;
+  metric->sum += ms;
+  metric->count++;
+}
+
+static void om2m_duty_push(om2m_duty_rtc_t *rtc, int batch, const om2m_duty_reading_t *reading) {
+  // a batch that could not be published for long keeps the newest readings
+  if(rtc->num >= batch) {
+    memmove(&rtc->batch[0], &rtc->batch[1], (rtc->num - 1) * sizeof(rtc->batch[0]));
+    rtc->num--;
+    rtc->seq++;
+    rtc->dropped++;
+  }
+  rtc->batch[rtc->num++] = *reading;
+}
+
+static void om2m_duty_failed(om2m_duty_t *duty) {
+  om2m_duty_rtc_t *rtc = &duty->rtc;
+  uint32_t backoff;
+
+  rtc->fails++;
+  backoff = rtc->fails < 5 ? 1u << rtc->fails : OM2M_DUTY_BACKOFF_MAX;
+  if(backoff > OM2M_DUTY_BACKOFF_MAX)
+    backoff = OM2M_DUTY_BACKOFF_MAX;
+  rtc->retry = rtc->wakes + backoff;
+  duty->published = -1;
+}
+
+static int om2m_duty_due(const om2m_duty_t *duty, uint32_t wake, int num) {
+  return num >= duty->batch && (int32_t)(wake - duty->rtc.retry) >= 0;
+}
+
+static void om2m_duty_done(void *arg, const om2m_response_t *response) {
+  om2m_duty_t *duty = arg;
+
+  duty->rsc = response->rsc;
+  duty->answered = 1;
+}
+
+/**
+ * Content of the batch, see om2m_duty_t
+ *
+ * @return the length, -1 if it does not fit
+ * */
+int om2m_duty_content(const om2m_duty_rtc_t *rtc, char *buf, size_t size) {
+  size_t len;
+  int i, j, n;
+
+  n = snprintf(buf, size, "%u;", (unsigned)rtc->seq);
+  if(n < 0 || n >= size)
+    return -1;
+  len = n;
+
+  for(i = 0; i < rtc->num; i++) {
+    for(j = 0; j < OM2M_DUTY_VALUES; j++) {
+      n = snprintf(buf + len, size - len, j ? ":%d" : (i ? ",%d" : "%d"), rtc->batch[i].value[j]);
+      if(n < 0 || n >= size - len)
+        return -1;
+      len += n;
+    }
+  }
+
+  return len;
+}
+
+void om2m_duty_init(om2m_duty_t *duty, const om2m_duty_ops_t *ops, void *ops_arg, om2m_client_t *client, const char *ae, const char *cnt) {
+  memset(duty, 0, sizeof(*duty));
+  duty->ops = ops;
+  duty->ops_arg = ops_arg;
+  duty->client = client;
+  duty->ae = ae;
+  duty->cnt = cnt;
+  duty->period_ms = OM2M_DUTY_PERIOD_MS;
+  duty->batch = OM2M_DUTY_BATCH;
+  duty->connect_ms = OM2M_DUTY_CONNECT_MS;
+  duty->scan_ms = OM2M_DUTY_SCAN_MS;
+  duty->publish_ms = OM2M_DUTY_PUBLISH_MS;
+  duty->provision_ms = OM2M_DUTY_PROVISION_MS;
+  duty->state = OM2M_DUTY_WAKE;
+  // as early as possible, the latency counts from here
+  duty->wake_ms = om2m_duty_now(duty);
+}
+
+void om2m_duty_sampler(om2m_duty_t *duty, om2m_duty_sample_t sample, void *arg) {
+  duty->sample = sample;
+  duty->sample_arg = arg;
+}
+
+void om2m_duty_provisioner(om2m_duty_t *duty, om2m_duty_provision_t provision, void *arg) {
+  duty->provision = provision;
+  duty->provision_arg = arg;
+}
+
+static om2m_duty_state_t om2m_duty_wake(om2m_duty_t *duty) {
+  om2m_duty_rtc_t *rtc = &duty->rtc;
+
+  if(duty->batch < 1 || duty->batch > OM2M_DUTY_BATCH)
+    duty->batch = OM2M_DUTY_BATCH;
+
+  duty->cold = duty->ops->load(duty->ops_arg, rtc) < 0 || rtc->magic != OM2M_DUTY_MAGIC || rtc->crc != om2m_duty_crc(rtc) ||
+               rtc->num > OM2M_DUTY_BATCH;
+  if(duty->cold) {
+    memset(rtc, 0, sizeof(*rtc));
+    rtc->magic = OM2M_DUTY_MAGIC;
+    // the radio is on after a power on
+    rtc->radio = 1;
+    om2m_duty_link_load(&rtc->link);
+  }
+
+  rtc->wakes++;
+  return OM2M_DUTY_SAMPLE;
+}
+
+static om2m_duty_state_t om2m_duty_sample(om2m_duty_t *duty) {
+  om2m_duty_rtc_t *rtc = &duty->rtc;
+  om2m_duty_reading_t reading;
+
+  memset(&reading, 0, sizeof(reading));
+  if(duty->sample && duty->sample(duty->sample_arg, &reading) == 0)
+    om2m_duty_push(rtc, duty->batch, &reading);
+
+  // the radio is off on wakes that only sample
+  if(rtc->radio && om2m_duty_due(duty, rtc->wakes, rtc->num))
+    return OM2M_DUTY_CONNECT;
+
+  return OM2M_DUTY_SLEEP;
+}
+
+static om2m_duty_state_t om2m_duty_connect(om2m_duty_t *duty) {
+  om2m_duty_rtc_t *rtc = &duty->rtc;
+  const om2m_duty_ops_t *ops = duty->ops;
+  om2m_duty_link_t cache = rtc->link, link;
+  uint32_t start = om2m_duty_now(duty);
+  int cached = 0;
+
+  // the lease is asked for again once used long enough, or after a power on
+  if(cache.uses >= OM2M_DUTY_REUSE)
+    cache.ip = 0;
+
+  if(cache.channel)
+    cached = ops->connect(duty->ops_arg, &cache) == 0 && ops->wait(duty->ops_arg, &link, duty->connect_ms) == 0;
+
+  if(!cached) {
+    memset(&link, 0, sizeof(link));
+    if(ops->connect(duty->ops_arg, NULL) < 0 || ops->wait(duty->ops_arg, &link, duty->scan_ms) < 0) {
+      // the AP moved or went away, scan on the next try too
+      rtc->link.channel = 0;
+      om2m_duty_failed(duty);
+      return OM2M_DUTY_SLEEP;
+    }
+  }
+
+  link.uses = cached && cache.ip ? rtc->link.uses + 1 : 0;
+  // flash is only written when the AP or the lease changed
+  if(om2m_duty_link_changed(&link, &rtc->link))
+    om2m_duty_link_store(&link);
+  rtc->link = link;
+
+  duty->joined_ms = om2m_duty_now(duty) - start;
+  return OM2M_DUTY_PUBLISH;
+}
+
+static om2m_duty_state_t om2m_duty_publish(om2m_duty_t *duty) {
+  om2m_duty_rtc_t *rtc = &duty->rtc;
+  char con[DUTY_CON_MAX];
+  uint32_t start;
+
+  duty->answered = 0;
+  duty->rsc = OM2M_RSC_TIMEOUT;
+
+  // the CSE may not know the resources yet, a CSE that never answers must not keep the radio on
+  if(duty->provision && !rtc->published && duty->provision(duty->provision_arg, duty->provision_ms) < 0) {
+    om2m_duty_failed(duty);
+    return OM2M_DUTY_SLEEP;
+  }
+
+  if(om2m_duty_content(rtc, con, sizeof(con)) < 0 ||
+     om2m_create_content_instance(duty->client, duty->ae, duty->cnt, NULL, con, om2m_duty_done, duty) < 0) {
+    om2m_duty_failed(duty);
+    return OM2M_DUTY_SLEEP;
+  }
+
+  start = om2m_duty_now(duty);
+  while(!duty->answered && om2m_duty_now(duty) - start < duty->publish_ms) {
+    om2m_client_poll(duty->client, OM2M_DUTY_POLL_MS);
+    // responses come from the task reading the transport
+    if(!duty->client->binding->poll)
+      vTaskDelay(OM2M_DUTY_POLL_MS / portTICK_RATE_MS);
+  }
+
+  if(!duty->answered || duty->rsc != 2001) {
+    om2m_duty_failed(duty);
+    return OM2M_DUTY_SLEEP;
+  }
+
+  om2m_duty_metric(&rtc->latency, om2m_duty_now(duty) - duty->wake_ms);
+  om2m_duty_metric(&rtc->connect, duty->joined_ms);
+  rtc->seq += rtc->num;
+  rtc->num = 0;
+  rtc->fails = 0;
+  rtc->retry = rtc->wakes;
+  rtc->published++;
+  duty->published = 1;
+
+  return OM2M_DUTY_SLEEP;
+}
+
+static om2m_duty_state_t om2m_duty_sleep(om2m_duty_t *duty) {
+  om2m_duty_rtc_t *rtc = &duty->rtc;
+  uint32_t awake, sleep_ms;
+
+  // the radio is only on for a wake that will publish
+  rtc->radio = om2m_duty_due(duty, rtc->wakes + 1, rtc->num + 1);
+  rtc->crc = om2m_duty_crc(rtc);
+  duty->ops->store(duty->ops_arg, rtc);
+
+  // wakes keep to the period however long this one took
+  awake = om2m_duty_now(duty) - duty->wake_ms;
+  sleep_ms = awake + OM2M_DUTY_SLEEP_MIN_MS < duty->period_ms ? duty->period_ms - awake : OM2M_DUTY_SLEEP_MIN_MS;
+  duty->ops->sleep(duty->ops_arg, sleep_ms * 1000, rtc->radio);
+
+  return OM2M_DUTY_DONE;
+}
+
+/**
+ * Go through one state of the wake
+ *
+ * @return the next state, OM2M_DUTY_DONE once the wake is over
+ * */
+om2m_duty_state_t om2m_duty_step(om2m_duty_t *duty) {
+  switch(duty->state) {
+  case OM2M_DUTY_WAKE:
+    duty->state = om2m_duty_wake(duty);
+    break;
+  case OM2M_DUTY_SAMPLE:
+    duty->state = om2m_duty_sample(duty);
+    break;
+  case OM2M_DUTY_CONNECT:
+    duty->state = om2m_duty_connect(duty);
+    break;
+  case OM2M_DUTY_PUBLISH:
+    duty->state = om2m_duty_publish(duty);
+    break;
+  case OM2M_DUTY_SLEEP:
+    duty->state = om2m_duty_sleep(duty);
+    break;
+  case OM2M_DUTY_DONE:
+    break;
+  }
+
+  return duty->state;
+}
+
+/**
+ * One whole wake, on the target the deep sleep at its end does not
+ * return
+ *
+ * @return 0 when the batch was published or was not due, -1 when publishing it failed
+ * */
+int om2m_duty_run(om2m_duty_t *duty) {
+  while(om2m_duty_step(duty) != OM2M_DUTY_DONE)
+    ;
+
+  return duty->published < 0 ? -1 : 0;
+}
@@ -0,0 +1,189 @@
+#include "om2m/duty.h"
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/task.h"
+#include "esp_sleep.h"
+#include "esp_wifi.h"
+#include "tcpip_adapter.h"
+
+#define DUTY_ESP_GOT_IP		BIT0
+#define DUTY_ESP_LOST		BIT1	// the cached AP did not take the station
+#define DUTY_ESP_RTC_END	0x60001400	// end of rtc_seg in esp8266.ld
+
+extern uint32_t _rtc_data_end;
+
+static EventGroupHandle_t s_duty_group;
+static int s_duty_started;	// SYSTEM_EVENT_STA_START came
+static int s_duty_joining;
+static int s_duty_cached;	// joining with the cached link, a disconnection ends it
+
+/**
+ * The state goes in the user RTC memory after the .rtc.data of the
+ * application, no segment of the image covers it so the bootloader
+ * leaves it alone on a wake from deep sleep
+ * */
+static volatile uint32_t *om2m_duty_esp_rtc(void) {
+  uintptr_t addr = ((uintptr_t)&_rtc_data_end + 3) & ~3;
+
+  if(addr + sizeof(om2m_duty_rtc_t) > DUTY_ESP_RTC_END)
+    return NULL;
+
+  return (volatile uint32_t *)addr;
+}
+
+// the RTC memory only takes word accesses, om2m_duty_rtc_t is a whole number of words
+static int om2m_duty_esp_load(void *arg, om2m_duty_rtc_t *rtc) {
+  volatile uint32_t *src = om2m_duty_esp_rtc();
+  uint32_t *dst = (uint32_t *)rtc;
+  size_t i;
+
+  if(!src)
+    return -1;
+
+  for(i = 0; i < sizeof(*rtc) / 4; i++)
+    dst[i] = src[i];
+
+  return 0;
+}
+
+static void om2m_duty_esp_store(void *arg, const om2m_duty_rtc_t *rtc) {
+  volatile uint32_t *dst = om2m_duty_esp_rtc();
+  const uint32_t *src = (const uint32_t *)rtc;
+  size_t i;
+
+  if(!dst)
+    return;
+
+  for(i = 0; i < sizeof(*rtc) / 4; i++)
+    dst[i] = src[i];
+}
+
+static int om2m_duty_esp_connect(void *arg, const om2m_duty_link_t *link) {
+  tcpip_adapter_ip_info_t ip;
+  tcpip_adapter_dns_info_t dns;
+  wifi_config_t config;
+
+  if(s_duty_started)
+    esp_wifi_disconnect();
+  xEventGroupClearBits(s_duty_group, DUTY_ESP_GOT_IP | DUTY_ESP_LOST);
+
+  // SSID and password as set by the application
+  if(esp_wifi_get_config(WIFI_IF_STA, &config) != ESP_OK)
+    return -1;
+  config.sta.bssid_set = link != NULL;
+  config.sta.channel = link ? link->channel : 0;
+  if(link)
+    memcpy(config.sta.bssid, link->bssid, sizeof(config.sta.bssid));
+  if(esp_wifi_set_config(WIFI_IF_STA, &config) != ESP_OK)
+    return -1;
+
+  if(link && link->ip) {
+    tcpip_adapter_dhcpc_stop(TCPIP_ADAPTER_IF_STA);
+    memset(&ip, 0, sizeof(ip));
+    ip.ip.addr = link->ip;
+    ip.netmask.addr = link->netmask;
+    ip.gw.addr = link->gw;
+    if(tcpip_adapter_set_ip_info(TCPIP_ADAPTER_IF_STA, &ip) != ESP_OK)
+      return -1;
+    memset(&dns, 0, sizeof(dns));
+    ip_addr_set_ip4_u32(&dns.ip, link->dns);
+    tcpip_adapter_set_dns_info(TCPIP_ADAPTER_IF_STA, TCPIP_ADAPTER_DNS_MAIN, &dns);
+  }
+  else
+    tcpip_adapter_dhcpc_start(TCPIP_ADAPTER_IF_STA);
+
+  s_duty_cached = link != NULL;
+  s_duty_joining = 1;
+
+  // the first join of the wake starts the station, om2m_duty_esp_event joins once it is up
+  if(!s_duty_started)
+    return esp_wifi_start() == ESP_OK ? 0 : -1;
+
+  return esp_wifi_connect() == ESP_OK ? 0 : -1;
+}
+
+static int om2m_duty_esp_wait(void *arg, om2m_duty_link_t *link, int timeout_ms) {
+  tcpip_adapter_dns_info_t dns;
+  tcpip_adapter_ip_info_t ip;
+  wifi_ap_record_t ap;
+  EventBits_t bits;
+
+  bits = xEventGroupWaitBits(s_duty_group, DUTY_ESP_GOT_IP | DUTY_ESP_LOST, false, false, timeout_ms / portTICK_RATE_MS);
+  s_duty_joining = 0;
+
+  if(!(bits & DUTY_ESP_GOT_IP) || esp_wifi_sta_get_ap_info(&ap) != ESP_OK ||
+     tcpip_adapter_get_ip_info(TCPIP_ADAPTER_IF_STA, &ip) != ESP_OK)
+    return -1;
+
+  memcpy(link->bssid, ap.bssid, sizeof(link->bssid));
+  link->channel = ap.primary;
+  link->ip = ip.ip.addr;
+  link->netmask = ip.netmask.addr;
+  link->gw = ip.gw.addr;
+  link->dns = 0;
+  if(tcpip_adapter_get_dns_info(TCPIP_ADAPTER_IF_STA, TCPIP_ADAPTER_DNS_MAIN, &dns) == ESP_OK)
+    link->dns = ip_addr_get_ip4_u32(&dns.ip);
+
+  return 0;
+}
+
+static void om2m_duty_esp_sleep(void *arg, uint32_t us, int radio) {
+  // 2: up without calibrating it, 4: off for the whole wake
+  esp_deep_sleep_set_rf_option(radio ? 2 : 4);
+  esp_deep_sleep(us);
+
+  // the chip powers down once the idle task runs
+  while(1)
+    vTaskDelay(1000 / portTICK_RATE_MS);
+}
+
+const om2m_duty_ops_t om2m_duty_esp_ops = {
+  .load = om2m_duty_esp_load,
+  .store = om2m_duty_esp_store,
+  .connect = om2m_duty_esp_connect,
+  .wait = om2m_duty_esp_wait,
+  .sleep = om2m_duty_esp_sleep,
+};
+
+/**
+ * Before om2m_duty_run, with Wi-Fi initialized and configured but not
+ * started: only the wakes that publish start it
+ * */
+int om2m_duty_esp_init(void) {
+  if(!s_duty_group && (s_duty_group = xEventGroupCreate()) == NULL)
+    return -1;
+
+  return 0;
+}
+
+/**
+ * To be called from the system event handler of the application
+ * */
+void om2m_duty_esp_event(system_event_t *event) {
+  if(!s_duty_group)
+    return;
+
+  switch(event->event_id) {
+  case SYSTEM_EVENT_STA_START:
+    s_duty_started = 1;
+    if(s_duty_joining)
+      esp_wifi_connect();
+    break;
+  case SYSTEM_EVENT_STA_GOT_IP:
+    xEventGroupSetBits(s_duty_group, DUTY_ESP_GOT_IP);
+    break;
+  case SYSTEM_EVENT_STA_DISCONNECTED:
+    xEventGroupClearBits(s_duty_group, DUTY_ESP_GOT_IP);
+    // the AP moved or changed its mind, scanning beats waiting out the timeout
+    if(s_duty_cached)
+      xEventGroupSetBits(s_duty_group, DUTY_ESP_LOST);
+    else if(s_duty_joining)
+      esp_wifi_connect();
+    break;
+  default:
+    break;
+  }
+}
@@ -1,158 +1,579 @@
 #include "om2m/http.h"
-#include "cJSON.h"
+#include "om2m/http_server.h"
 
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
 
 #include "tcpip_adapter.h"
 
+enum {
+  HTTP_STATUS_LINE = 0,
+  HTTP_HEADER,
+  HTTP_BODY,
+  HTTP_BODY_UNTIL_CLOSE,
+  HTTP_CHUNK_SIZE,
+  HTTP_CHUNK_DATA,
+  HTTP_CHUNK_END,
+  HTTP_TRAILER,
+  HTTP_DONE
+};
+
+void om2m_http_parser_init(om2m_http_parser_t *parser, om2m_http_body_cb_t on_body, void *arg) {
+  memset(parser, 0, sizeof(*parser));
+  parser->state = HTTP_STATUS_LINE;
+  parser->content_length = -1;
+  parser->on_body = on_body;
+  parser->arg = arg;
+}
+
+int om2m_http_parser_done(const om2m_http_parser_t *parser) {
+  return parser->state == HTTP_DONE;
+}
 
-static int om2m_http_post(int clientfd, char* url, char *payload, int ty) {
-  char *buf = malloc(strlen(payload)+sizeof(char)*250);
-  memset(buf, 0, strlen(payload)+250);
+static int http_parse_status_line(om2m_http_parser_t *parser) {
+  int minor;
 
-  if(buf == NULL)
+  if(sscanf(parser->line, "HTTP/1.%d %d", &minor, &parser->response.status) != 2)
     return -1;
 
+  // HTTP/1.1 defaults to persistent connections, HTTP/1.0 does not
+  parser->response.keep_alive = minor >= 1;
+  return 0;
+}
+
+static void http_parse_header(om2m_http_parser_t *parser) {
+  char *value = strchr(parser->line, ':');
+
+  if(value == NULL)
+    return;
+
+  *value++ = '\0';
+  while(*value == ' ' || *value == '\t')
+    value++;
+
+  if(!strcasecmp(parser->line, "Content-Length"))
+    parser->content_length = strtol(value, NULL, 10);
+  else if(!strcasecmp(parser->line, "Transfer-Encoding"))
+    parser->chunked = strstr(value, "chunked") != NULL || strstr(value, "Chunked") != NULL;
+  else if(!strcasecmp(parser->line, "X-M2M-RSC"))
+    parser->response.rsc = atoi(value);
+  else if(!strcasecmp(parser->line, "X-M2M-RI")) {
+    strncpy(parser->response.rqi, value, sizeof(parser->response.rqi) - 1);
+    parser->response.rqi[sizeof(parser->response.rqi) - 1] = '\0';
+  }
+  else if(!strcasecmp(parser->line, "Connection"))
+    parser->response.keep_alive = strcasecmp(value, "close") != 0;
+}
+
+/**
+ * Select how the body is framed once all headers are known
+ * */
+static void http_headers_done(om2m_http_parser_t *parser) {
+  int status = parser->response.status;
+
+  if((status >= 100 && status < 200) || status == 204 || status == 304)
+    parser->state = HTTP_DONE;
+  else if(parser->chunked)
+    parser->state = HTTP_CHUNK_SIZE;
+  else if(parser->content_length >= 0) {
+    parser->remaining = parser->content_length;
+    parser->state = parser->remaining ? HTTP_BODY : HTTP_DONE;
+  }
   else {
-    sprintf(buf, "POST %s HTTP/1.1\r\nX-M2M-Origin: admin:admin\r\nContent-Type: application/json;ty=%d\r\nAccept: application/json\r\nContent-Length: %d\r\nHost: %s:%d\r\nConnection: Keep-Alive\r\nUser-Agent: ESP8266\r\n\r\n%s", url, ty, strlen(payload), CSE_IP, CSE_PORT_HTTP, payload);
-    printf("sending...!\n");
-    int res = write(clientfd, buf, strlen(buf));
+    parser->response.keep_alive = 0;
+    parser->state = HTTP_BODY_UNTIL_CLOSE;
+  }
+}
 
-    free(buf);
-    return res;
+/**
+ * Handle one complete line, CR/LF already stripped
+ * */
+static int http_parse_line(om2m_http_parser_t *parser) {
+  switch(parser->state) {
+    case HTTP_STATUS_LINE:
+      if(parser->line_overflow)
+        return -1;
+      if(parser->line_len == 0)	// tolerate stray CRLF before the status line
+        return 0;
+      if(http_parse_status_line(parser) < 0)
+        return -1;
+      parser->state = HTTP_HEADER;
+      break;
+
+    case HTTP_HEADER:
+      if(parser->line_len == 0)
+        http_headers_done(parser);
+      else if(!parser->line_overflow)
+        http_parse_header(parser);
+      break;
+
+    case HTTP_CHUNK_SIZE:
+      if(parser->line_overflow)
+        return -1;
+      parser->remaining = strtol(parser->line, NULL, 16);	// chunk extensions are ignored
+      if(parser->remaining < 0)
+        return -1;
+      parser->state = parser->remaining ? HTTP_CHUNK_DATA : HTTP_TRAILER;
+      break;
+
+    case HTTP_CHUNK_END:
+      if(parser->line_len != 0)
+        return -1;
+      parser->state = HTTP_CHUNK_SIZE;
+      break;
+
+    case HTTP_TRAILER:
+      if(parser->line_len == 0)
+        parser->state = HTTP_DONE;
+      break;
   }
+
+  return 0;
 }
 
-int om2m_http_ok(int clientfd) {
-  char buf[] = {"HTTP/1.1 200 OK\r\nTransfer-encoding: chunked\r\n\r\n0\r\n\r\n"};
+/**
+ * Feed received bytes to the parser
+ *
+ * Stops at the end of the response, so that the bytes of a following
+ * pipelined response are left to the caller.
+ *
+ * @return number of bytes consumed, -1 if the response is malformed
+ * */
+int om2m_http_parser_feed(om2m_http_parser_t *parser, const char *data, size_t len) {
+  size_t off = 0;
+
+  while(off < len && parser->state != HTTP_DONE) {
+    if(parser->state == HTTP_BODY || parser->state == HTTP_CHUNK_DATA || parser->state == HTTP_BODY_UNTIL_CLOSE) {
+      size_t n = len - off;
+
+      if(parser->state != HTTP_BODY_UNTIL_CLOSE && n > (size_t)parser->remaining)
+        n = parser->remaining;
+      if(parser->on_body)
+        parser->on_body(parser->arg, data + off, n);
+      off += n;
+
+      if(parser->state != HTTP_BODY_UNTIL_CLOSE) {
+        parser->remaining -= n;
+        if(parser->remaining == 0)
+          parser->state = parser->state == HTTP_BODY ? HTTP_DONE : HTTP_CHUNK_END;
+      }
+      continue;
+    }
+
+    char c = data[off++];
+    if(c == '\r')
+      continue;
+
+    if(c != '\n') {
+      if(parser->line_len < OM2M_HTTP_LINE_MAX - 1)
+        parser->line[parser->line_len++] = c;
+      else
+        parser->line_overflow = 1;
+      continue;
+    }
+
+    parser->line[parser->line_len] = '\0';
+    if(http_parse_line(parser) < 0)
+      return -1;
+    parser->line_len = 0;
+    parser->line_overflow = 0;
+  }
 
-  printf("%s\n", buf);
-  return send(clientfd, buf, strlen(buf), 0);
+  return off;
+}
+
+int om2m_http_client_init(om2m_http_client_t *client, const char *host, int port) {
+  if(strlen(host) >= sizeof(client->host))
+    return -1;
+
+  memset(client, 0, sizeof(*client));
+  strcpy(client->host, host);
+  client->port = port;
+  client->fd = -1;
+  client->timeout_ms = OM2M_TIMEOUT_MS;
+
+  return 0;
 }
 
-int om2m_http_delete(int clientfd, char *url) {
-  char *buf = malloc(sizeof(char)*300);
-  memset(buf, 0, sizeof(char)*300);
+int om2m_http_client_connect(om2m_http_client_t *client) {
+  struct sockaddr_in addr;
+  int nodelay = 1;
 
-  if(buf == NULL)
+  if(client->fd >= 0)
+    return 0;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(client->port);
+  addr.sin_addr.s_addr = inet_addr(client->host);
+
+  client->fd = socket(AF_INET, SOCK_STREAM, 0);
+  if(client->fd < 0)
     return -1;
 
-  else {
-    sprintf(buf, "DELETE %s HTTP/1.1\r\nX-M2M-Origin: admin:admin\r\nAccept: application/json\r\nHost: %s:%d\r\nConnection: Keep-Alive\r\nUser-Agent: ESP8266\r\n\r\n", url, CSE_IP, CSE_PORT_HTTP);
-    int res = send(clientfd, buf, strlen(buf), 0);
-    free(buf);
-    return res;
+  if(connect(client->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+    om2m_http_client_close(client);
+    return -1;
   }
+
+  // pipelined requests must not wait for the ACK of the previous one
+  setsockopt(client->fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+  return 0;
 }
 
-int om2m_http_create_ae(int clientfd, char *ae_name, int ae_id) {
-  cJSON *payload = NULL;
-  cJSON *ae = NULL;
-  cJSON *poa_array = NULL;
+void om2m_http_client_close(om2m_http_client_t *client) {
+  if(client->fd >= 0)
+    close(client->fd);
 
-  char *out = NULL;
+  client->fd = -1;
+  client->pending = 0;
+  client->receiving = 0;
+  client->rx_off = client->rx_len = 0;
+}
 
-  tcpip_adapter_ip_info_t local_ip;
-  tcpip_adapter_get_ip_info(TCPIP_ADAPTER_IF_STA, &local_ip);
+static int http_writev_all(int fd, struct iovec *iov, int iovcnt) {
+  while(iovcnt) {
+    int res = writev(fd, iov, iovcnt);
+
+    if(res < 0) {
+      if(errno == EINTR)
+        continue;
+      return -1;
+    }
+
+    while(iovcnt && (size_t)res >= iov->iov_len) {
+      res -= iov->iov_len;
+      iov++;
+      iovcnt--;
+    }
+    if(iovcnt) {
+      iov->iov_base = (char *)iov->iov_base + res;
+      iov->iov_len -= res;
+    }
+  }
+
+  return 0;
+}
 
-  char poa_url[50];
-  //sprintf(poa_url, "http://"IPSTR":%d", IP2STR(&local_ip.ip), HTTP_SERVER_PORT);
-  sprintf(poa_url, "http://192.168.106.167:96");
+/**
+ * Send a request on the persistent connection
+ *
+ * Header and body go out with a single writev, without copying the body.
+ * A broken idle connection is reopened once; with responses still pending
+ * the request fails instead, since those responses would be lost.
+ *
+ * @param rqi request identifier sent as X-M2M-RI, NULL for none
+ * @param ty resource type of the created resource, 0 for none
+ * @return 0 on success, -1 on error
+ * */
+int om2m_http_client_send(om2m_http_client_t *client, const char *method, const char *url, const char *fr, const char *rqi, int ty, const char *payload, size_t payload_len) {
+  char header[320];
+  char content_type[40] = "";
+  char request_id[40] = "";
+  struct iovec iov[2];
+  int len, retry;
+
+  if(client->pending >= OM2M_HTTP_PIPELINE_DEPTH)
+    return -1;
 
-  payload = cJSON_CreateObject();
-  poa_array = cJSON_CreateArray();
-  cJSON_AddItemToArray(poa_array, cJSON_CreateString(poa_url));
+  if(ty)
+    sprintf(content_type, "Content-Type: application/json;ty=%d\r\n", ty);
+  if(rqi)
+    snprintf(request_id, sizeof(request_id), "X-M2M-RI: %s\r\n", rqi);
 
-  cJSON_AddItemToObject(payload, "m2m:ae", ae = cJSON_CreateObject());
-  cJSON_AddTrueToObject(ae, "rr");
-  cJSON_AddNumberToObject(ae, "api", ae_id);
-  cJSON_AddStringToObject(ae, "rn", ae_name);
-  cJSON_AddItemToObject(ae, "poa", poa_array);
-  out = cJSON_PrintUnformatted(payload);
-  cJSON_Delete(payload);
+  len = snprintf(header, sizeof(header), "%s %s HTTP/1.1\r\nX-M2M-Origin: %s\r\n%s%sAccept: application/json\r\nContent-Length: %u\r\nHost: %s:%d\r\nConnection: Keep-Alive\r\nUser-Agent: ESP8266\r\n\r\n",
+                 method, url, fr, request_id, content_type, (unsigned)payload_len, client->host, client->port);
+  if(len < 0 || len >= (int)sizeof(header))
+    return -1;
 
-  char url[50];
-  sprintf(url, "/~/in-cse/%s", CSE_NAME);
+  for(retry = 0; retry < 2; retry++) {
+    if(om2m_http_client_connect(client) < 0)
+      return -1;
 
-  int res = om2m_http_post(clientfd, url, out, 2);
-  free(out);
+    iov[0].iov_base = header;
+    iov[0].iov_len = len;
+    iov[1].iov_base = (void *)payload;
+    iov[1].iov_len = payload_len;
 
-  return res;
+    if(http_writev_all(client->fd, iov, payload_len ? 2 : 1) == 0) {
+      client->pending++;
+      return 0;
+    }
+
+    if(client->pending)
+      break;
+    om2m_http_client_close(client);
+  }
+
+  om2m_http_client_close(client);
+  return -1;
 }
 
+int om2m_http_client_request(om2m_http_client_t *client, const char *method, const char *url, int ty, const char *payload, size_t payload_len) {
+  return om2m_http_client_send(client, method, url, CSE_ORIGINATOR, NULL, ty, payload, payload_len);
+}
+
+/**
+ * Read the response to the oldest pending request, waiting at most
+ * timeout_ms for the rest of it
+ *
+ * The body is streamed to on_body (may be NULL), anything received past
+ * the end of this response is kept for the next call. A response that is
+ * not complete by then is carried on by the next call, on_body and arg
+ * stay those of the call that started it.
+ *
+ * @return HTTP status code, 0 if the response is not complete yet,
+ *         -1 on error or closed connection
+ * */
+int om2m_http_client_response_wait(om2m_http_client_t *client, om2m_http_response_t *response, om2m_http_body_cb_t on_body, void *arg, int timeout_ms) {
+  om2m_http_parser_t *parser = &client->parser;
+  uint32_t deadline = om2m_now_ms() + timeout_ms;
+
+  if(client->fd < 0 || client->pending == 0)
+    return -1;
+
+  if(!client->receiving) {
+    om2m_http_parser_init(parser, on_body, arg);
+    client->receiving = 1;
+  }
 
-int om2m_http_create_container(int clientfd, char *ae_name, char *container_name) {
-  cJSON *payload = NULL;
-  cJSON *cnt = NULL;
+  while(!om2m_http_parser_done(parser)) {
+    if(client->rx_off == client->rx_len) {
+      int32_t left = (int32_t)(deadline - om2m_now_ms());
+      struct timeval tv;
+      fd_set readfds;
+      int res;
+
+      if(left < 0)
+        left = 0;
+      FD_ZERO(&readfds);
+      FD_SET(client->fd, &readfds);
+      tv.tv_sec = left / 1000;
+      tv.tv_usec = (left % 1000) * 1000;
+
+      // read only what has arrived, a peer that stops mid-response must not stall the caller
+      res = select(client->fd + 1, &readfds, NULL, NULL, &tv);
+      if(res == 0)
+        return 0;
+      if(res > 0)
+        res = read(client->fd, client->rx, sizeof(client->rx));
+
+      if(res < 0 && errno == EINTR)
+        continue;
+      if(res == 0 && parser->state == HTTP_BODY_UNTIL_CLOSE) {
+        parser->state = HTTP_DONE;
+        break;
+      }
+      if(res <= 0) {
+        om2m_http_client_close(client);
+        return -1;
+      }
+      client->rx_off = 0;
+      client->rx_len = res;
+    }
+
+    int used = om2m_http_parser_feed(parser, client->rx + client->rx_off, client->rx_len - client->rx_off);
+    if(used < 0) {
+      om2m_http_client_close(client);
+      return -1;
+    }
+    client->rx_off += used;
+  }
 
-  char *out = NULL;
+  client->receiving = 0;
+  client->pending--;
+  if(response)
+    *response = parser->response;
+  if(!parser->response.keep_alive)
+    om2m_http_client_close(client);
 
-  payload = cJSON_CreateObject();
-  cJSON_AddItemToObject(payload, "m2m:cnt", cnt = cJSON_CreateObject());
-  cJSON_AddStringToObject(cnt, "rn", container_name);
-  out = cJSON_PrintUnformatted(payload);
-  cJSON_Delete(payload);
+  return parser->response.status;
+}
+
+/**
+ * Read the response to the oldest pending request
+ *
+ * Waits at most client->timeout_ms for the whole response.
+ *
+ * @return HTTP status code, -1 on error, timeout or closed connection
+ * */
+int om2m_http_client_response(om2m_http_client_t *client, om2m_http_response_t *response, om2m_http_body_cb_t on_body, void *arg) {
+  int status = om2m_http_client_response_wait(client, response, on_body, arg, client->timeout_ms);
+
+  // the rest of a late response would be taken for the next one
+  if(status == 0) {
+    om2m_http_client_close(client);
+    return -1;
+  }
+
+  return status;
+}
+
+int om2m_http_ok(int clientfd) {
+  char buf[] = {"HTTP/1.1 200 OK\r\nTransfer-encoding: chunked\r\n\r\n0\r\n\r\n"};
+
+  printf("%s\n", buf);
+  return send(clientfd, buf, strlen(buf), 0);
+}
+
+int om2m_http_delete(om2m_http_client_t *client, char *url) {
+  return om2m_http_client_request(client, "DELETE", url, 0, NULL, 0);
+}
+
+int om2m_http_create_ae(om2m_http_client_t *client, char *ae_name, int ae_id) {
+  char poa_url[50], url[50], pc[OM2M_PC_MAX];
+  int len;
+
+  tcpip_adapter_ip_info_t local_ip;
+  tcpip_adapter_get_ip_info(TCPIP_ADAPTER_IF_STA, &local_ip);
+
+  sprintf(poa_url, "http://"IPSTR":%d", IP2STR(&local_ip.ip), OM2M_HTTP_SERVER_PORT);
+  sprintf(url, "/~/in-cse/%s", CSE_NAME);
+
+  if((len = om2m_pc_ae(pc, sizeof(pc), ae_name, ae_id, poa_url)) < 0)
+    return -1;
+
+  return om2m_http_client_request(client, "POST", url, OM2M_TY_AE, pc, len);
+}
+
+int om2m_http_create_container(om2m_http_client_t *client, char *ae_name, char *container_name) {
+  char url[50], pc[OM2M_PC_MAX];
+  int len;
 
-  char url[50];
   sprintf(url, "/~/in-cse/%s/%s", CSE_NAME, ae_name);
 
-  int res = om2m_http_post(clientfd, url, out, 3);
-  free(out);
+  if((len = om2m_pc_cnt(pc, sizeof(pc), container_name)) < 0)
+    return -1;
+
+  return om2m_http_client_request(client, "POST", url, OM2M_TY_CNT, pc, len);
+}
+
+int om2m_http_create_content_instance(om2m_http_client_t *client, char *ae_name, char *container_name, char *content_instance_name, char *data) {
+  char url[50], pc[OM2M_PC_MAX];
+  int len;
+
+  sprintf(url, "/~/in-cse/%s/%s/%s", CSE_NAME, ae_name, container_name);
+
+  if((len = om2m_pc_cin(pc, sizeof(pc), content_instance_name, data)) < 0)
+    return -1;
 
-  return res;
+  return om2m_http_client_request(client, "POST", url, OM2M_TY_CIN, pc, len);
+  //{"m2m:cin":{"pc":"cenas_teste","con":"8001","cnf":"application/json","rn":"8001"}}
 }
 
-int om2m_http_create_content_instance(int clientfd, char *ae_name, char *container_name, char *content_instance_name, char *data) {
-  cJSON *payload = NULL;
-  cJSON *cin = NULL;
+int om2m_http_create_subscription(om2m_http_client_t *client, char *ae_name, char* container_name, char *ae_monitor_name, char *sub_name) {
+  char nu_url[50], url[50], pc[OM2M_PC_MAX];
+  int len;
 
-  char *out = NULL;
-  char cnf[50], url[50];
+  sprintf(nu_url, "/in-cse/%s/%s", CSE_NAME, ae_monitor_name);
   sprintf(url, "/~/in-cse/%s/%s/%s", CSE_NAME, ae_name, container_name);
-  sprintf(cnf, "text/plain:%d", strlen(data));
 
-  payload = cJSON_CreateObject();
-  cJSON_AddItemToObject(payload, "m2m:cin", cin = cJSON_CreateObject());
-  cJSON_AddStringToObject(cin, "con", data);
-  cJSON_AddStringToObject(cin, "cnf", cnf);
-  cJSON_AddStringToObject(cin, "rn", content_instance_name);
-  out = cJSON_PrintUnformatted(payload);
-  cJSON_Delete(payload);
+  if((len = om2m_pc_sub(pc, sizeof(pc), sub_name, nu_url)) < 0)
+    return -1;
+
+  return om2m_http_client_request(client, "POST", url, OM2M_TY_SUB, pc, len);
+}
+
+static const char *om2m_http_method(om2m_op_t op) {
+  switch(op) {
+    case OM2M_OP_RETRIEVE: return "GET";
+    case OM2M_OP_UPDATE:   return "PUT";
+    case OM2M_OP_DELETE:   return "DELETE";
+    default:               return "POST";
+  }
+}
+
+static int http_binding_send(om2m_client_t *client, const om2m_request_t *request) {
+  om2m_http_binding_t *binding = client->binding_ctx;
+  int slot = (binding->sent_head + binding->http.pending) % OM2M_HTTP_PIPELINE_DEPTH;
+  char url[OM2M_TO_MAX + 2];
 
+  sprintf(url, "/~%s", request->to);
 
-  int res = om2m_http_post(clientfd, url, out, 4);
-  free(out);
+  if(om2m_http_client_send(&binding->http, om2m_http_method(request->op), url, request->fr, request->rqi, request->ty,
+                           request->pc, request->pc_len) < 0)
+    return -1;
 
-  return res;
-  //{"m2m:cin":{"pc":"cenas_teste","con":"8001","cnf":"application/json","rn":"8001"}}
+  strcpy(binding->sent[slot], request->rqi);
+  return 0;
 }
 
-int om2m_http_create_subscription(int clientfd, char *ae_name, char* container_name, char *ae_monitor_name, char *sub_name) {
-  cJSON *payload = NULL;
-  cJSON *sub = NULL;
-  cJSON *nu_array = NULL;
+static void http_binding_body(void *arg, const char *data, size_t len) {
+  om2m_http_binding_t *binding = arg;
 
-  char *out = NULL;
+  if(len > sizeof(binding->pc) - binding->pc_len)
+    len = sizeof(binding->pc) - binding->pc_len;
+  memcpy(binding->pc + binding->pc_len, data, len);
+  binding->pc_len += len;
+}
 
-  char nu_url[50];
-  sprintf(nu_url, "/in-cse/%s/%s", CSE_NAME, ae_monitor_name);
+// oneM2M response class of an HTTP status, for a CSE that sends no X-M2M-RSC
+static int http_status_rsc(int status) {
+  if(status >= 200 && status < 300)
+    return 2000;
+  if(status >= 400 && status < 500)
+    return 4000;
+  return 5000;
+}
 
-  payload = cJSON_CreateObject();
-  nu_array = cJSON_CreateArray();
-  cJSON_AddItemToArray(nu_array, cJSON_CreateString(nu_url));
+/**
+ * Wait for the next response, then hand every buffered one to the client
+ *
+ * A response still arriving when the wait is over is completed by a
+ * later poll.
+ * */
+static int http_binding_poll(om2m_client_t *client, int timeout_ms) {
+  om2m_http_binding_t *binding = client->binding_ctx;
+  om2m_http_client_t *http = &binding->http;
+  om2m_http_response_t rsp;
+  om2m_response_t response;
+  int n = 0;
+
+  while(http->pending) {
+    int status;
+
+    if(!http->receiving)
+      binding->pc_len = 0;
+
+    // past the first response, only take what has already arrived
+    status = om2m_http_client_response_wait(http, &rsp, http_binding_body, binding, n ? 0 : timeout_ms);
+    if(status == 0)
+      break;
+    if(status < 0) {
+      // the responses to whatever was pending are lost with the connection
+      binding->sent_head = 0;
+      return -1;
+    }
+
+    // the CSE echoes X-M2M-RI, otherwise responses come back in request order
+    response.rqi = rsp.rqi[0] ? rsp.rqi : binding->sent[binding->sent_head];
+    response.rsc = rsp.rsc ? rsp.rsc : http_status_rsc(rsp.status);
+    response.pc = binding->pc;
+    response.pc_len = binding->pc_len;
+    binding->sent_head = (binding->sent_head + 1) % OM2M_HTTP_PIPELINE_DEPTH;
+
+    om2m_client_response(client, &response);
+    n++;
+  }
 
-  cJSON_AddItemToObject(payload, "m2m:sub", sub = cJSON_CreateObject());
-  cJSON_AddStringToObject(sub, "rn", sub_name);
-  cJSON_AddNumberToObject(sub, "nct", 2);
-  cJSON_AddItemToObject(sub, "nu", nu_array);
-  out = cJSON_PrintUnformatted(payload);
-  cJSON_Delete(payload);
+  return n;
+}
 
-  char url[50];
-  sprintf(url, "/~/in-cse/%s/%s/%s", CSE_NAME, ae_name, container_name);
+const om2m_binding_t om2m_http_binding = {
+  .name = "http",
+  .send = http_binding_send,
+  .poll = http_binding_poll,
+};
 
-  int res = om2m_http_post(clientfd, url, out, 23);
-  free(out);
+int om2m_http_binding_init(om2m_http_binding_t *binding, const char *host, int port) {
+  memset(binding, 0, sizeof(*binding));
 
-  return res;
+  return om2m_http_client_init(&binding->http, host, port);
 }
@@ -0,0 +1,346 @@
+#include "om2m/http_server.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#define HTTP_RESPONSE_MAX	128
+
+static int http_str_eq(const om2m_http_str_t *str, const char *s) {
+  return str->len == strlen(s) && !strncasecmp(str->p, s, str->len);
+}
+
+/**
+ * Find the end of the line starting at p, CRLF or bare LF
+ *
+ * @return pointer to the LF, NULL if the line is incomplete
+ * */
+static const char *http_line_end(const char *p, const char *end) {
+  return memchr(p, '\n', end - p);
+}
+
+static size_t http_trim_cr(const char *p, const char *lf) {
+  return (lf > p && lf[-1] == '\r') ? lf - p - 1 : lf - p;
+}
+
+/**
+ * Parse one request from buf without copying it
+ *
+ * @return length of the request including its body,
+ *         0 if more data is needed, -1 if the request is malformed
+ * */
+int om2m_http_parse_request(const char *buf, size_t len, om2m_http_request_t *request) {
+  const char *p = buf, *end = buf + len, *lf, *sp;
+  size_t line_len;
+  long content_length = 0;
+  int minor;
+
+  memset(request, 0, sizeof(*request));
+
+  // request line: METHOD SP path SP HTTP/1.x
+  if((lf = http_line_end(p, end)) == NULL)
+    return 0;
+  line_len = http_trim_cr(p, lf);
+
+  if((sp = memchr(p, ' ', line_len)) == NULL)
+    return -1;
+  request->method.p = p;
+  request->method.len = sp - p;
+
+  request->path.p = sp + 1;
+  if((sp = memchr(request->path.p, ' ', p + line_len - request->path.p)) == NULL)
+    return -1;
+  request->path.len = sp - request->path.p;
+
+  if(p + line_len - (sp + 1) != 8 || strncmp(sp + 1, "HTTP/1.", 7))
+    return -1;
+  minor = sp[8] - '0';
+  request->keep_alive = minor >= 1;
+
+  p = lf + 1;
+
+  // headers up to the empty line
+  while(1) {
+    om2m_http_header_t header;
+    const char *colon, *value;
+
+    if((lf = http_line_end(p, end)) == NULL)
+      return 0;
+    line_len = http_trim_cr(p, lf);
+    if(line_len == 0) {
+      p = lf + 1;
+      break;
+    }
+
+    if((colon = memchr(p, ':', line_len)) == NULL)
+      return -1;
+    value = colon + 1;
+    while(value < p + line_len && (*value == ' ' || *value == '\t'))
+      value++;
+
+    header.name.p = p;
+    header.name.len = colon - p;
+    header.value.p = value;
+    header.value.len = p + line_len - value;
+
+    // the framing headers count wherever they are, only the stored ones are capped
+    if(http_str_eq(&header.name, "Content-Length"))
+      content_length = strtol(value, NULL, 10);
+    else if(http_str_eq(&header.name, "Connection"))
+      request->keep_alive = !http_str_eq(&header.value, "close");
+    else if(http_str_eq(&header.name, "Transfer-Encoding"))
+      return -1;	// the CSE sends Content-Length, chunked requests are not supported
+
+    if(request->num_headers < OM2M_HTTP_SERVER_MAX_HEADERS)
+      request->headers[request->num_headers++] = header;
+
+    p = lf + 1;
+  }
+
+  if(content_length < 0)
+    return -1;
+  if(end - p < content_length)
+    return 0;
+
+  request->body.p = p;
+  request->body.len = content_length;
+
+  return p + content_length - buf;
+}
+
+const om2m_http_str_t *om2m_http_request_header(const om2m_http_request_t *request, const char *name) {
+  int i;
+
+  for(i = 0; i < request->num_headers; i++)
+    if(http_str_eq(&request->headers[i].name, name))
+      return &request->headers[i].value;
+
+  return NULL;
+}
+
+int om2m_http_server_init(om2m_http_server_t *server, int port) {
+  struct sockaddr_in addr;
+  int i, one = 1;
+
+  memset(server, 0, sizeof(*server));
+  for(i = 0; i < OM2M_HTTP_SERVER_MAX_CONN; i++)
+    server->conns[i].fd = -1;
+
+  server->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+  if(server->listen_fd < 0)
+    return -1;
+
+  setsockopt(server->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+  if(bind(server->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+     listen(server->listen_fd, OM2M_HTTP_SERVER_MAX_CONN) < 0) {
+    close(server->listen_fd);
+    server->listen_fd = -1;
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Register a handler for notifications POSTed to path,
+ * path must stay valid while the server runs
+ * */
+int om2m_http_server_route(om2m_http_server_t *server, const char *path, om2m_http_handler_t handler, void *arg) {
+  om2m_http_route_t *route;
+
+  if(server->num_routes == OM2M_HTTP_SERVER_MAX_ROUTES)
+    return -1;
+
+  route = &server->routes[server->num_routes++];
+  route->path = path;
+  route->handler = handler;
+  route->arg = arg;
+
+  return 0;
+}
+
+void om2m_http_server_close(om2m_http_server_t *server) {
+  int i;
+
+  for(i = 0; i < OM2M_HTTP_SERVER_MAX_CONN; i++) {
+    if(server->conns[i].fd >= 0)
+      close(server->conns[i].fd);
+    server->conns[i].fd = -1;
+  }
+
+  if(server->listen_fd >= 0)
+    close(server->listen_fd);
+  server->listen_fd = -1;
+}
+
+static void http_conn_close(om2m_http_conn_t *conn) {
+  close(conn->fd);
+  conn->fd = -1;
+  conn->len = 0;
+}
+
+static int http_format_response(char *rsp, int status, int keep_alive) {
+  const char *reason;
+  int rsc;
+
+  switch(status) {
+    case 200: reason = "OK";			rsc = 2000; break;
+    case 201: reason = "Created";		rsc = 2001; break;
+    case 400: reason = "Bad Request";		rsc = 4000; break;
+    case 404: reason = "Not Found";		rsc = 4004; break;
+    case 413: reason = "Payload Too Large";	rsc = 4000; break;
+    default:  reason = "Internal Server Error";	rsc = 5000; status = 500; break;
+  }
+
+  return sprintf(rsp, "HTTP/1.1 %d %s\r\nX-M2M-RSC: %d\r\nContent-Length: 0\r\n%s\r\n",
+                 status, reason, rsc, keep_alive ? "" : "Connection: close\r\n");
+}
+
+static int http_send(om2m_http_conn_t *conn, const char *data, int len) {
+  return len == 0 || send(conn->fd, data, len, 0) == len ? 0 : -1;
+}
+
+static void http_fail(om2m_http_conn_t *conn, int status) {
+  char rsp[HTTP_RESPONSE_MAX];
+
+  http_send(conn, rsp, http_format_response(rsp, status, 0));
+  http_conn_close(conn);
+}
+
+static int http_dispatch(om2m_http_server_t *server, const om2m_http_request_t *request) {
+  int i;
+
+  for(i = 0; i < server->num_routes; i++) {
+    om2m_http_route_t *route = &server->routes[i];
+
+    if(request->path.len == strlen(route->path) && !strncmp(request->path.p, route->path, request->path.len))
+      return route->handler(route->arg, request);
+  }
+
+  return 404;
+}
+
+/**
+ * Read what is available and serve every complete request in the buffer,
+ * pipelined requests included
+ * */
+static void http_conn_read(om2m_http_server_t *server, om2m_http_conn_t *conn) {
+  om2m_http_request_t request;
+  char tx[4 * HTTP_RESPONSE_MAX];
+  int tx_len = 0, keep_alive = 1;
+  size_t off = 0;
+  int res;
+
+  res = recv(conn->fd, conn->buf + conn->len, sizeof(conn->buf) - conn->len, 0);
+  if(res <= 0) {
+    if(res < 0 && (errno == EINTR || errno == EAGAIN))
+      return;
+    http_conn_close(conn);
+    return;
+  }
+  conn->len += res;
+
+  // responses to pipelined requests are batched into as few segments as possible
+  while(keep_alive && (res = om2m_http_parse_request(conn->buf + off, conn->len - off, &request)) > 0) {
+    int status = http_dispatch(server, &request);
+
+    off += res;
+    keep_alive = request.keep_alive;
+
+    if(tx_len + HTTP_RESPONSE_MAX > (int)sizeof(tx)) {
+      if(http_send(conn, tx, tx_len) < 0) {
+        http_conn_close(conn);
+        return;
+      }
+      tx_len = 0;
+    }
+    tx_len += http_format_response(tx + tx_len, status, keep_alive);
+  }
+
+  if(http_send(conn, tx, tx_len) < 0 || !keep_alive) {
+    http_conn_close(conn);
+    return;
+  }
+
+  if(res < 0) {
+    http_fail(conn, 400);
+    return;
+  }
+
+  // keep the start of an incomplete request
+  memmove(conn->buf, conn->buf + off, conn->len - off);
+  conn->len -= off;
+
+  if(conn->len == sizeof(conn->buf))
+    http_fail(conn, 413);
+}
+
+static void http_accept(om2m_http_server_t *server) {
+  int i, fd = accept(server->listen_fd, NULL, NULL);
+
+  if(fd < 0)
+    return;
+
+  for(i = 0; i < OM2M_HTTP_SERVER_MAX_CONN; i++) {
+    if(server->conns[i].fd < 0) {
+      server->conns[i].fd = fd;
+      server->conns[i].len = 0;
+      return;
+    }
+  }
+
+  // out of connection slots
+  close(fd);
+}
+
+/**
+ * Wait up to timeout_ms for activity and serve it,
+ * meant to be called in a loop by the task owning the server
+ *
+ * @return number of ready sockets, -1 on error
+ * */
+int om2m_http_server_poll(om2m_http_server_t *server, int timeout_ms) {
+  struct timeval tv;
+  fd_set readfds;
+  int i, maxfd, ready;
+
+  FD_ZERO(&readfds);
+  FD_SET(server->listen_fd, &readfds);
+  maxfd = server->listen_fd;
+
+  for(i = 0; i < OM2M_HTTP_SERVER_MAX_CONN; i++) {
+    if(server->conns[i].fd >= 0) {
+      FD_SET(server->conns[i].fd, &readfds);
+      if(server->conns[i].fd > maxfd)
+        maxfd = server->conns[i].fd;
+    }
+  }
+
+  tv.tv_sec = timeout_ms / 1000;
+  tv.tv_usec = (timeout_ms % 1000) * 1000;
+
+  ready = select(maxfd + 1, &readfds, NULL, NULL, &tv);
+  if(ready <= 0)
+    return ready < 0 && errno != EINTR ? -1 : 0;
+
+  for(i = 0; i < OM2M_HTTP_SERVER_MAX_CONN; i++)
+    if(server->conns[i].fd >= 0 && FD_ISSET(server->conns[i].fd, &readfds))
+      http_conn_read(server, &server->conns[i]);
+
+  if(FD_ISSET(server->listen_fd, &readfds))
+    http_accept(server);
+
+  return ready;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "om2m/om2m.h"
+
+#define OM2M_CBOR_DEPTH_MAX	8	// nesting skipped over in unknown attributes
+
+/**
+ * String view into the decoded buffer, not NUL terminated,
+ * p is NULL when the attribute was not present
+ * */
+typedef struct {
+  const char *p;
+  size_t len;
+} om2m_cbor_str_t;
+
+/**
+ * Resource decoded in place from {"m2m:<type>":{...}}, the CBOR
+ * serialization uses the same short names as the JSON one; poa and
+ * nu only keep their first element
+ * */
+typedef struct {
+  om2m_ty_t ty;			// from the m2m: key, OM2M_TY_NONE for other resources
+  om2m_cbor_str_t rn;
+  om2m_cbor_str_t ri;
+  om2m_cbor_str_t pi;
+  om2m_cbor_str_t con;
+  om2m_cbor_str_t cnf;
+  om2m_cbor_str_t poa;
+  om2m_cbor_str_t nu;
+  int api;
+  int nct;
+  bool rr;
+} om2m_cbor_resource_t;
+
+/**
+ * Notification, m2m:sgn
+ * */
+typedef struct {
+  om2m_cbor_str_t sur;		// subscription which triggered it
+  bool vrq;			// verification request sent when the subscription is created
+  int net;			// notification event type
+  om2m_cbor_resource_t rep;	// representation of the resource, ty is OM2M_TY_NONE when absent
+} om2m_cbor_sgn_t;
+
+int om2m_cbor_ae(char *buf, size_t size, const char *rn, int api, const char *poa);
+int om2m_cbor_cnt(char *buf, size_t size, const char *rn);
+int om2m_cbor_cin(char *buf, size_t size, const char *rn, const char *con);
+int om2m_cbor_sub(char *buf, size_t size, const char *rn, const char *nu);
+int om2m_cbor_sgn(char *buf, size_t size, const char *sur, int net, const char *rn, const char *con);
+
+int om2m_cbor_parse(const char *buf, size_t len, om2m_cbor_resource_t *resource);
+int om2m_cbor_parse_sgn(const char *buf, size_t len, om2m_cbor_sgn_t *sgn);
+int om2m_cbor_str_eq(const om2m_cbor_str_t *str, const char *s);
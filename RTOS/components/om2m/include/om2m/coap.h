@@ -1,5 +1,9 @@
+#pragma once
+
 #include <coap/coap.h>
 
+#include "om2m/om2m.h"
+
 #define ONEM2M_OPTION_FR	256
 #define ONEM2M_OPTION_RQI	257
 #define ONEM2M_OPTION_NM	258
@@ -15,14 +19,30 @@
 
 //#define COAP_MESSAGE_TYPE_RQST 	COAP_MESSAGE_NON
 
-#define CSE_IP 			"192.168.137.1" // IP broker
 #define CSE_PORT 		5683
-#define CSE_NAME 		"dartes"
-#define CSE_ORIGINATOR  "admin:admin"
 
 //extern uint8_t msg_type = COAP_MESSAGE_NON;
 
 int om2m_coap_create_ae(coap_context_t* ctx, coap_address_t dst_addr, char *ae_name, int ae_id);
 int om2m_coap_create_container(coap_context_t *ctx, coap_address_t dst_addr, char *ae_name, char *container_name);
 int om2m_coap_create_content_instance(coap_context_t *ctx, coap_address_t dst_addr, char *ae_name, char *container_name, char *content_instance_name, char *data, unsigned short *msg_id, unsigned short msg_type);
-int om2m_coap_create_subscription(coap_context_t *ctx, coap_address_t dst_addr, char *ae_name, char* container_name, char *ae_monitor_name, char *sub_name);
\ No newline at end of file
+int om2m_coap_create_subscription(coap_context_t *ctx, coap_address_t dst_addr, char *ae_name, char* container_name, char *ae_monitor_name, char *sub_name);
+
+#define OM2M_COAP_MAX_BINDINGS	2	// CoAP contexts carrying an om2m client
+#define OM2M_COAP_LATENCY_PATH	"latency"	// Uri-Path of om2m_coap_latency_resource
+
+/**
+ * CoAP binding context, one per client
+ * */
+typedef struct {
+  coap_context_t *ctx;
+  coap_address_t dst;
+  unsigned char type;		// COAP_MESSAGE_NON or COAP_MESSAGE_CON
+  om2m_client_t *client;
+} om2m_coap_binding_t;
+
+extern const om2m_binding_t om2m_coap_binding;
+
+void om2m_coap_binding_init(om2m_coap_binding_t *binding, coap_context_t *ctx, const coap_address_t *dst, unsigned char type);
+int om2m_coap_handle_response(om2m_client_t *client, coap_pdu_t *received);
+int om2m_coap_latency_resource(coap_context_t *ctx, om2m_client_t *client);
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <coap/coap.h>
+
+#include "esp_ota_ops.h"
+
+#define OM2M_COAP_OTA_WINDOW		4	// block requests in flight
+#define OM2M_COAP_OTA_SZX_MIN		2	// 64 byte blocks
+#define OM2M_COAP_OTA_SZX_MAX		6	// 1024 byte blocks, the largest that fits COAP_MAX_PDU_SIZE
+#define OM2M_COAP_OTA_TIMEOUT_MS	2000	// before a block is asked for again, ACK_TIMEOUT of RFC 7252
+#define OM2M_COAP_OTA_RETRIES		4	// MAX_RETRANSMIT of RFC 7252
+#define OM2M_COAP_OTA_COMMIT		(4 * SPI_FLASH_SEC_SIZE)	// image bytes between two resume points
+#define OM2M_COAP_OTA_NAMESPACE		"om2m"	// NVS namespace of the resume point
+#define OM2M_COAP_OTA_ETAG_MAX		8
+
+#define OM2M_COAP_OTA_OVERHEAD		128	// bytes on the air besides the block: the request, headers of both datagrams
+#define OM2M_COAP_OTA_SZX_HOLD		16	// requests answered or lost between two changes of the block size
+
+/**
+ * Block2 request in flight, or its response waiting for the
+ * blocks before it
+ * */
+typedef struct {
+  uint8_t state;		// free, sent or received
+  uint8_t szx;
+  uint8_t tries;
+  uint16_t len;			// bytes received
+  uint32_t offset;		// in the image, also the token of the request
+  uint32_t sent_ms;
+  uint8_t *data;		// 1 << (OM2M_COAP_OTA_SZX_MAX + 4) bytes
+} om2m_coap_ota_block_t;
+
+/**
+ * Firmware download over CoAP blockwise transfers (RFC 7959) into the
+ * OTA partition
+ *
+ * The block size follows the loss: a block that does not come back in
+ * time counts as lost, and taking the loss of a datagram to grow with its
+ * bytes on the air, the moving average of the losses at one size tells
+ * which of the sizes next to it costs the fewest bytes on the air per
+ * image byte.
+ *
+ * Every OM2M_COAP_OTA_COMMIT bytes the index of the next block goes to
+ * NVS with the ETag of the image, a download cut short by a reset or a
+ * lost link goes on from there when the server still has the same image.
+ * A packed image (esp_ota_pack.h) has no resume points: it is decoded as
+ * it comes, its offsets are not those of the image on flash.
+ * */
+typedef struct {
+  coap_context_t *ctx;
+  coap_address_t dst;
+  const char *path;		// Uri-Path of the image, e.g. fw/app.bin
+  const esp_partition_t *partition;	// NULL for the next update partition
+  int timeout_ms;
+  int retries;			// of a block before the download gives up
+  int szx_min;
+  int szx_max;
+
+  esp_ota_handle_t handle;
+  int opened;			// the handle is valid
+  int szx;			// of new requests
+  int hold;			// blocks to receive before the next size change
+  uint32_t loss;		// moving average at the current size, out of 65536
+  uint32_t next;		// offset of the next new request
+  uint32_t done;		// bytes handed to esp_ota_write
+  uint32_t end;			// image size, UINT32_MAX until known
+  int last;			// the block with M=0 came
+  int packed;			// the image starts with ESP_OTA_PACK_MAGIC
+  int err;
+  size_t etag_len;
+  uint8_t etag[OM2M_COAP_OTA_ETAG_MAX];
+  om2m_coap_ota_block_t block[OM2M_COAP_OTA_WINDOW];
+  coap_response_handler_t prev_handler;
+
+  uint32_t resumed_at;		// offset the download went on from, 0 for a new one
+  unsigned int requests;	// block requests sent, again or not
+  unsigned int lost;		// of them, not answered in time
+} om2m_coap_ota_t;
+
+void om2m_coap_ota_init(om2m_coap_ota_t *ota, coap_context_t *ctx, const coap_address_t *dst, const char *path);
+int om2m_coap_ota_run(om2m_coap_ota_t *ota);
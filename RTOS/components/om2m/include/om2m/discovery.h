@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#define OM2M_DISCOVERY_SERVICE		"_onem2m"
+#define OM2M_DISCOVERY_CANDIDATES	3	// CSEs remembered for failover
+#define OM2M_DISCOVERY_TIMEOUT_MS	1000	// to wait for mDNS answers
+#define OM2M_DISCOVERY_TTL_MIN		30	// s, floor on the TTL of an announcement
+#define OM2M_DISCOVERY_TTL_MAX		86400	// s, ceiling, keeps the deadline within 32 bits of ms
+#define OM2M_DISCOVERY_NAMESPACE	"om2m"	// NVS namespace of the cached candidates
+
+#define OM2M_CSE_RN_MAX		24
+#define OM2M_CSE_CSI_MAX	24
+
+/**
+ * CSE announced as <instance>._onem2m.<proto>.local,
+ * from the SRV, TXT (rn, csi) and A records of the announcement
+ * */
+typedef struct {
+  uint32_t addr;		// IPv4, network byte order
+  uint16_t port;
+  uint32_t ttl;			// s, lowest of the records
+  char rn[OM2M_CSE_RN_MAX];	// CSE name, e.g. dartes, empty when not announced
+  char csi[OM2M_CSE_CSI_MAX];	// CSE-ID, e.g. /in-cse, empty when not announced
+} om2m_cse_t;
+
+/**
+ * Discovered CSEs of one protocol, cached in NVS so that a warm boot
+ * uses the last known CSE straight away and only re-validates it in the
+ * background
+ * */
+typedef struct {
+  const char *proto;		// _udp for CoAP, _tcp for HTTP and MQTT
+  SemaphoreHandle_t lock;
+  bool loaded;			// NVS was read
+  bool refreshing;		// a background query is running
+  uint32_t expires;		// ms, see om2m_now_ms
+  int num;			// candidates, the first one is in use
+  om2m_cse_t cse[OM2M_DISCOVERY_CANDIDATES];
+  unsigned int queries;		// mDNS queries sent
+} om2m_discovery_t;
+
+int om2m_discovery_init(om2m_discovery_t *discovery, const char *proto);
+int om2m_discovery_get(om2m_discovery_t *discovery, om2m_cse_t *cse);
+int om2m_discovery_failover(om2m_discovery_t *discovery, om2m_cse_t *cse);
+int om2m_discovery_refresh(om2m_discovery_t *discovery);
+void om2m_discovery_close(om2m_discovery_t *discovery);
+int om2m_cse_path(const om2m_cse_t *cse, char *buf, size_t size);
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "om2m/om2m.h"
+
+#define OM2M_DUTY_VALUES	2	// per reading, e.g. heart rate and SpO2
+#define OM2M_DUTY_BATCH		16	// readings kept across deep sleeps, their content fits OM2M_PC_MAX
+#define OM2M_DUTY_PERIOD_MS	60000	// from one wake to the next
+#define OM2M_DUTY_CONNECT_MS	3000	// to join with the cached link before scanning
+#define OM2M_DUTY_SCAN_MS	15000	// to scan, join and get a DHCP lease
+#define OM2M_DUTY_PUBLISH_MS	3000	// to wait for the response to the batch
+#define OM2M_DUTY_PROVISION_MS	10000	// to create the resources before the first batch
+#define OM2M_DUTY_POLL_MS	10
+#define OM2M_DUTY_REUSE		32	// joins on a cached lease before asking DHCP again
+#define OM2M_DUTY_BACKOFF_MAX	16	// wakes between two tries while publishing fails
+#define OM2M_DUTY_SLEEP_MIN_MS	100
+#define OM2M_DUTY_MAGIC		0x4d324443	// "CD2M"
+#define OM2M_DUTY_NAMESPACE	"om2m"	// NVS namespace of the link, read after a power on
+
+typedef enum {
+  OM2M_DUTY_WAKE = 0,
+  OM2M_DUTY_SAMPLE,
+  OM2M_DUTY_CONNECT,
+  OM2M_DUTY_PUBLISH,
+  OM2M_DUTY_SLEEP,
+  OM2M_DUTY_DONE
+} om2m_duty_state_t;
+
+typedef struct {
+  int16_t value[OM2M_DUTY_VALUES];
+} om2m_duty_reading_t;
+
+/**
+ * Access point and IP configuration of the last join, the next one
+ * goes straight to the channel and BSSID and skips DHCP
+ * */
+typedef struct {
+  uint8_t bssid[6];
+  uint8_t channel;		// 0 when nothing is cached
+  uint8_t uses;			// joins on this lease
+  uint32_t ip;			// IPv4, network byte order
+  uint32_t netmask;
+  uint32_t gw;
+  uint32_t dns;
+} om2m_duty_link_t;
+
+/**
+ * ms, over every wake that published since the last power on
+ * */
+typedef struct {
+  uint32_t last;
+  uint32_t min;
+  uint32_t max;
+  uint32_t sum;
+  uint32_t count;
+} om2m_duty_metric_t;
+
+/**
+ * Everything that outlives a deep sleep, in RTC memory on the target
+ * */
+typedef struct {
+  uint32_t magic;
+  uint32_t wakes;		// since power on
+  uint32_t seq;			// readings taken before the first one of the batch
+  uint16_t num;			// readings in the batch
+  uint16_t dropped;		// oldest readings pushed out of a full batch
+  uint16_t fails;		// publications in a row that failed
+  uint16_t radio;		// the radio is on for this wake
+  uint32_t retry;		// wake of the next try after a failure
+  uint32_t published;		// batches
+  om2m_duty_link_t link;
+  om2m_duty_metric_t latency;	// wake to the response of the batch
+  om2m_duty_metric_t connect;	// of which joining the AP
+  om2m_duty_reading_t batch[OM2M_DUTY_BATCH];
+  uint32_t crc;			// of the above
+} om2m_duty_rtc_t;
+
+typedef int (*om2m_duty_sample_t)(void *arg, om2m_duty_reading_t *reading);
+
+/**
+ * Creates the AE and containers the batches go to, called on the wakes
+ * that publish until one batch was published since the power on
+ *
+ * Has to give up after timeout_ms, the wake then fails like a publication
+ * and the next try comes after the backoff.
+ *
+ * @return 0 once the resources exist, -1 otherwise
+ * */
+typedef int (*om2m_duty_provision_t)(void *arg, int timeout_ms);
+
+/**
+ * Platform side of the duty cycle, om2m_duty_esp_ops on the target,
+ * stubs on Linux
+ *
+ * now_ms may be NULL for om2m_now_ms.
+ * */
+typedef struct {
+  int (*load)(void *arg, om2m_duty_rtc_t *rtc);		// -1 when the RTC memory is lost
+  void (*store)(void *arg, const om2m_duty_rtc_t *rtc);
+  int (*connect)(void *arg, const om2m_duty_link_t *link);	// NULL to scan, ip 0 to ask DHCP
+  int (*wait)(void *arg, om2m_duty_link_t *link, int timeout_ms);	// 0 with the link in use once there is an IP
+  void (*sleep)(void *arg, uint32_t us, int radio);	// does not return on the target
+  uint32_t (*now_ms)(void *arg);
+} om2m_duty_ops_t;
+
+/**
+ * Duty-cycled publication: each wake takes one reading into a batch
+ * kept in RTC memory and goes back to deep sleep, every batch-th wake
+ * also joins the AP and publishes the whole batch as one content
+ * instance. Wi-Fi is only powered on the wakes that publish.
+ *
+ * The content is <seq>;<v0>:<v1>,<v0>:<v1>,... with seq the number of
+ * readings taken before the first one, so a lost or dropped batch shows
+ * as a gap. The CSE names the instance, seq starts over after a power on.
+ * */
+typedef struct {
+  const om2m_duty_ops_t *ops;
+  void *ops_arg;
+  om2m_duty_sample_t sample;
+  void *sample_arg;
+  om2m_duty_provision_t provision;
+  void *provision_arg;
+  om2m_client_t *client;
+  const char *ae;
+  const char *cnt;
+
+  uint32_t period_ms;
+  int batch;			// readings per publication, at most OM2M_DUTY_BATCH
+  int connect_ms;
+  int scan_ms;
+  int publish_ms;
+  int provision_ms;
+
+  om2m_duty_state_t state;
+  uint32_t wake_ms;		// now_ms when the wake began
+  uint32_t joined_ms;		// spent joining the AP on this wake
+  int cold;			// the RTC memory did not survive, e.g. power on
+  int published;		// 1 when this wake published its batch, -1 when it failed to
+  volatile int answered;
+  volatile int rsc;
+  om2m_duty_rtc_t rtc;
+} om2m_duty_t;
+
+void om2m_duty_init(om2m_duty_t *duty, const om2m_duty_ops_t *ops, void *ops_arg, om2m_client_t *client, const char *ae, const char *cnt);
+void om2m_duty_sampler(om2m_duty_t *duty, om2m_duty_sample_t sample, void *arg);
+void om2m_duty_provisioner(om2m_duty_t *duty, om2m_duty_provision_t provision, void *arg);
+om2m_duty_state_t om2m_duty_step(om2m_duty_t *duty);
+int om2m_duty_run(om2m_duty_t *duty);
+int om2m_duty_content(const om2m_duty_rtc_t *rtc, char *buf, size_t size);
+
+#ifdef ESP_PLATFORM
+#include "esp_event.h"
+
+extern const om2m_duty_ops_t om2m_duty_esp_ops;
+
+int om2m_duty_esp_init(void);
+void om2m_duty_esp_event(system_event_t *event);
+#endif
@@ -1,20 +1,97 @@
+#pragma once
+
 #include "malloc.h"
 
 #include <netdb.h>
 #include <sys/socket.h>
 
+#include "om2m/om2m.h"
+
 
-#define CSE_IP 			"192.168.106.xxx"//"192.168.43.175"//192.168.106.131"
 #define CSE_PORT_HTTP 		8080
-#define CSE_NAME 		"dartes"
-#define CSE_ORIGINATOR 		"admin:admin"
 
-int om2m_http_ok(int clientfd);
-int om2m_http_create_ae(int clientfd, char *ae_name, int ae_id);
-int om2m_http_create_container(int clientfd, char *ae_name, char *container_name);
-int om2m_http_create_content_instance(int clientfd, char *ae_name, char *container_name, char *content_instance_name, char *data);
-int om2m_http_create_subscription(int clientfd, char *ae_name, char* container_name, char *ae_monitor_name, char *sub_name);
+#define OM2M_HTTP_HOST_MAX		40
+#define OM2M_HTTP_LINE_MAX		128	// longer header lines are skipped
+#define OM2M_HTTP_RX_SIZE		512
+#define OM2M_HTTP_PIPELINE_DEPTH	4	// requests in flight on one connection
+#define OM2M_HTTP_PC_MAX		512	// response content kept for the binding callback
+
+/**
+ * Called for every piece of response body as it is received,
+ * the data is only valid during the call
+ * */
+typedef void (*om2m_http_body_cb_t)(void *arg, const char *data, size_t len);
+
+typedef struct {
+  int status;	// HTTP status code
+  int rsc;	// oneM2M response status code (X-M2M-RSC), 0 if absent
+  char rqi[OM2M_RQI_MAX];	// X-M2M-RI, empty if absent
+  int keep_alive;
+} om2m_http_response_t;
 
+/**
+ * Incremental HTTP/1.1 response parser,
+ * bodies are handed to on_body and never buffered
+ * */
+typedef struct {
+  int state;
+  om2m_http_response_t response;
+  int chunked;
+  long content_length;	// -1 when not given
+  long remaining;	// body or chunk bytes left
+  size_t line_len;
+  int line_overflow;
+  char line[OM2M_HTTP_LINE_MAX];
+  om2m_http_body_cb_t on_body;
+  void *arg;
+} om2m_http_parser_t;
 
+/**
+ * Persistent connection to the CSE,
+ * reconnected on demand and able to pipeline requests
+ * */
+typedef struct {
+  int fd;
+  char host[OM2M_HTTP_HOST_MAX];
+  int port;
+  int pending;		// requests sent, response not yet read
+  int receiving;	// the oldest response is partly parsed
+  int timeout_ms;	// longest wait in om2m_http_client_response, OM2M_TIMEOUT_MS by default
+  om2m_http_parser_t parser;
+  size_t rx_off, rx_len;	// unparsed bytes left in rx, e.g. the next pipelined response
+  char rx[OM2M_HTTP_RX_SIZE];
+} om2m_http_client_t;
 
+/**
+ * HTTP binding context, one per client
+ * */
+typedef struct {
+  om2m_http_client_t http;
+  char sent[OM2M_HTTP_PIPELINE_DEPTH][OM2M_RQI_MAX];	// rqi of the pending requests, oldest first
+  int sent_head;
+  size_t pc_len;
+  char pc[OM2M_HTTP_PC_MAX];	// response body, truncated when longer
+} om2m_http_binding_t;
+
+extern const om2m_binding_t om2m_http_binding;
+
+void om2m_http_parser_init(om2m_http_parser_t *parser, om2m_http_body_cb_t on_body, void *arg);
+int om2m_http_parser_feed(om2m_http_parser_t *parser, const char *data, size_t len);
+int om2m_http_parser_done(const om2m_http_parser_t *parser);
+
+int om2m_http_client_init(om2m_http_client_t *client, const char *host, int port);
+int om2m_http_client_connect(om2m_http_client_t *client);
+void om2m_http_client_close(om2m_http_client_t *client);
+int om2m_http_client_request(om2m_http_client_t *client, const char *method, const char *url, int ty, const char *payload, size_t payload_len);
+int om2m_http_client_send(om2m_http_client_t *client, const char *method, const char *url, const char *fr, const char *rqi, int ty, const char *payload, size_t payload_len);
+int om2m_http_client_response(om2m_http_client_t *client, om2m_http_response_t *response, om2m_http_body_cb_t on_body, void *arg);
+int om2m_http_client_response_wait(om2m_http_client_t *client, om2m_http_response_t *response, om2m_http_body_cb_t on_body, void *arg, int timeout_ms);
+
+int om2m_http_ok(int clientfd);
+int om2m_http_delete(om2m_http_client_t *client, char *url);
+int om2m_http_create_ae(om2m_http_client_t *client, char *ae_name, int ae_id);
+int om2m_http_create_container(om2m_http_client_t *client, char *ae_name, char *container_name);
+int om2m_http_create_content_instance(om2m_http_client_t *client, char *ae_name, char *container_name, char *content_instance_name, char *data);
+int om2m_http_create_subscription(om2m_http_client_t *client, char *ae_name, char* container_name, char *ae_monitor_name, char *sub_name);
 
+int om2m_http_binding_init(om2m_http_binding_t *binding, const char *host, int port);
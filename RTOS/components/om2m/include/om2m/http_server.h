@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stddef.h>
+
+#define OM2M_HTTP_SERVER_PORT		96
+#define OM2M_HTTP_SERVER_MAX_CONN	4
+#define OM2M_HTTP_SERVER_MAX_ROUTES	4
+#define OM2M_HTTP_SERVER_MAX_HEADERS	16
+#define OM2M_HTTP_SERVER_RX_SIZE	1536	// request line, headers and body must fit
+
+/**
+ * String view into the receive buffer, not NUL terminated
+ * */
+typedef struct {
+  const char *p;
+  size_t len;
+} om2m_http_str_t;
+
+typedef struct {
+  om2m_http_str_t name;
+  om2m_http_str_t value;
+} om2m_http_header_t;
+
+/**
+ * Request parsed in place, every view borrows the connection buffer
+ * and is only valid during the handler call
+ * */
+typedef struct {
+  om2m_http_str_t method;
+  om2m_http_str_t path;
+  om2m_http_header_t headers[OM2M_HTTP_SERVER_MAX_HEADERS];
+  int num_headers;
+  om2m_http_str_t body;
+  int keep_alive;
+} om2m_http_request_t;
+
+/**
+ * Notification handler
+ *
+ * @return HTTP status code of the response
+ * */
+typedef int (*om2m_http_handler_t)(void *arg, const om2m_http_request_t *request);
+
+typedef struct {
+  int fd;
+  size_t len;
+  char buf[OM2M_HTTP_SERVER_RX_SIZE];
+} om2m_http_conn_t;
+
+typedef struct {
+  const char *path;
+  om2m_http_handler_t handler;
+  void *arg;
+} om2m_http_route_t;
+
+typedef struct {
+  int listen_fd;
+  int num_routes;
+  om2m_http_route_t routes[OM2M_HTTP_SERVER_MAX_ROUTES];
+  om2m_http_conn_t conns[OM2M_HTTP_SERVER_MAX_CONN];
+} om2m_http_server_t;
+
+int om2m_http_parse_request(const char *buf, size_t len, om2m_http_request_t *request);
+const om2m_http_str_t *om2m_http_request_header(const om2m_http_request_t *request, const char *name);
+
+int om2m_http_server_init(om2m_http_server_t *server, int port);
+int om2m_http_server_route(om2m_http_server_t *server, const char *path, om2m_http_handler_t handler, void *arg);
+int om2m_http_server_poll(om2m_http_server_t *server, int timeout_ms);
+void om2m_http_server_close(om2m_http_server_t *server);
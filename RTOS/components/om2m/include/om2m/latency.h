@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "om2m/om2m.h"
+
+#define OM2M_LATENCY_SUB_BITS	3	// 8 buckets per power of two, a bucket is within 12.5% of its values
+#define OM2M_LATENCY_BITS	24	// us, up to 16.7 s, longer intervals count in the last bucket
+#define OM2M_LATENCY_BUCKETS	((OM2M_LATENCY_BITS - OM2M_LATENCY_SUB_BITS + 1) << OM2M_LATENCY_SUB_BITS)
+#define OM2M_LATENCY_OPS	OM2M_OP_NOTIFY	// one set of histograms per operation
+#define OM2M_LATENCY_REPORT_MAX	1024	// om2m_latency_report with every operation in use
+
+/**
+ * Points of a request the intervals run between: built by om2m_create_*,
+ * handed to the transport, acknowledged by it, answered by the CSE
+ * */
+typedef enum {
+  OM2M_LATENCY_SEND = 0,	// build to send() returning
+  OM2M_LATENCY_ACK,		// send to the transport acknowledgement, CoAP CON only
+  OM2M_LATENCY_RESPONSE,	// build to response, as the callback sees it
+  OM2M_LATENCY_PHASES
+} om2m_latency_phase_t;
+
+/**
+ * Log-linear histogram in the manner of HDR histograms: values below
+ * 2^OM2M_LATENCY_SUB_BITS us have a bucket each, every power of two
+ * above is split in 2^OM2M_LATENCY_SUB_BITS buckets
+ *
+ * A bucket about to overflow halves every bucket, the percentiles
+ * stay while the older requests weigh less.
+ * */
+typedef struct {
+  uint32_t count;		// sum of the buckets
+  uint32_t min;			// us, exact
+  uint32_t max;
+  uint16_t bucket[OM2M_LATENCY_BUCKETS];
+} om2m_latency_hist_t;
+
+typedef struct {
+  uint32_t count;
+  uint32_t p50;			// us, upper bound of the bucket, at most max
+  uint32_t p99;
+  uint32_t max;
+} om2m_latency_summary_t;
+
+/**
+ * Latency of the requests of a client, see om2m_client_latency
+ *
+ * Recording takes a few integer operations under the lock of the client
+ * and allocates nothing. The application owns the storage, about 1 KB
+ * per operation.
+ * */
+struct om2m_latency {
+  uint32_t (*now_us)(void);	// NULL for om2m_now_us
+  uint32_t timeouts[OM2M_LATENCY_OPS];
+  om2m_latency_hist_t hist[OM2M_LATENCY_OPS][OM2M_LATENCY_PHASES];
+};
+
+void om2m_latency_init(om2m_latency_t *latency);
+uint32_t om2m_latency_now(const om2m_latency_t *latency);
+void om2m_latency_record(om2m_latency_hist_t *hist, uint32_t us);
+uint32_t om2m_latency_percentile(const om2m_latency_hist_t *hist, int permille);
+void om2m_latency_summary(const om2m_latency_hist_t *hist, om2m_latency_summary_t *summary);
+void om2m_latency_add(om2m_latency_t *latency, om2m_op_t op, om2m_latency_phase_t phase, uint32_t us);
+void om2m_latency_timeout(om2m_latency_t *latency, om2m_op_t op);
+
+int om2m_latency_get(om2m_client_t *client, om2m_op_t op, om2m_latency_phase_t phase, om2m_latency_summary_t *summary);
+int om2m_latency_report(om2m_client_t *client, char *buf, size_t size);
@@ -1,18 +1,39 @@
+#pragma once
+
 #include "MQTTClient.h"
 #include "malloc.h"
 
-#define CSE_NAME  		"dartes"
+#include "om2m/om2m.h"
 
-#define MQTT_FROM		"admin:admin"
-#define MQTT_BROKER_IP 		"192.168.106.xxx"//"192.168.43.175"//192.168.106.131"
+#define MQTT_BROKER_IP 		CSE_IP	// the broker runs next to the CSE
 #define MQTT_BROKER_PORT	1883
 #define MQTT_QOS		QOS0
 #define MQTT_SEND_BUF_SIZE	2000
 #define MQTT_READ_BUF_SIZE	2000
 #define MQTT_TIMEOUT		900000
+#define OM2M_MQTT_TOPIC_MAX	80
+#define OM2M_MQTT_MAX_BINDINGS	2
+
+/**
+ * MQTT binding context, one per client
+ *
+ * Requests are published to /oneM2M/req/<aei>/<cse_id>/json,
+ * responses are received on /oneM2M/resp/<aei>/<cse_id>/json.
+ * */
+typedef struct {
+  MQTTClient *mqtt;
+  char req_topic[OM2M_MQTT_TOPIC_MAX];
+  char resp_topic[OM2M_MQTT_TOPIC_MAX];
+  om2m_client_t *client;
+} om2m_mqtt_binding_t;
+
+extern const om2m_binding_t om2m_mqtt_binding;
 
 
 int om2m_mqtt_create_ae(MQTTClient* client, char *ae_name, int ae_id);
 int om2m_mqtt_create_container(MQTTClient* client, char *ae_name, char *container_name);
 int om2m_mqtt_create_content_instance(MQTTClient* client, char *ae_name, char *container_name, char *content_instance_name, char *data);
-int om2m_create_subscription(MQTTClient* client, char *ae_name, char* container_name, char *ae_monitor_name, char *sub_name);
+int om2m_mqtt_create_subscription(MQTTClient* client, char *ae_name, char* container_name, char *ae_monitor_name, char *sub_name);
+
+int om2m_mqtt_binding_init(om2m_mqtt_binding_t *binding, MQTTClient *mqtt, const char *aei, const char *cse_id);
+int om2m_mqtt_handle_response(om2m_client_t *client, const char *payload, size_t len);
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#define OM2M_TO_MAX		64	// target resource, CSE-relative
+#define OM2M_RQI_MAX		16
+#define OM2M_PC_MAX		256	// serialized primitive content
+#define OM2M_PENDING_MAX	8	// requests awaiting a response
+#define OM2M_PENDING_SLOTS	16	// hash table size, power of two, at most half full
+#define OM2M_TIMEOUT_MS		5000	// default time to wait for a response
+
+#define OM2M_RSC_TIMEOUT	0	// rsc passed to the callback when no response came in time
+
+/**
+ * CSE of the deployment, for every binding: a client is given its CSE
+ * and originator by om2m_client_init, the om2m_<binding>_create_* calls
+ * of the former API use these. A project may define them to override.
+ * */
+#ifndef CSE_IP
+#define CSE_IP			"192.168.137.1"	// when discovery finds none
+#endif
+#ifndef CSE_NAME
+#define CSE_NAME		"dartes"
+#endif
+#ifndef CSE_ORIGINATOR
+#define CSE_ORIGINATOR		"admin:admin"
+#endif
+
+typedef enum {
+  OM2M_OP_CREATE = 1,
+  OM2M_OP_RETRIEVE,
+  OM2M_OP_UPDATE,
+  OM2M_OP_DELETE,
+  OM2M_OP_NOTIFY
+} om2m_op_t;
+
+/**
+ * Serialization of the primitive content
+ * */
+typedef enum {
+  OM2M_FORMAT_JSON = 0,
+  OM2M_FORMAT_CBOR		// see om2m/cbor.h
+} om2m_format_t;
+
+typedef enum {
+  OM2M_TY_NONE = 0,
+  OM2M_TY_AE = 2,
+  OM2M_TY_CNT = 3,
+  OM2M_TY_CIN = 4,
+  OM2M_TY_SUB = 23
+} om2m_ty_t;
+
+/**
+ * Request primitive, built once and handed as is to whichever
+ * binding carries it
+ * */
+typedef struct {
+  om2m_op_t op;
+  om2m_ty_t ty;
+  const char *fr;
+  char to[OM2M_TO_MAX];		// e.g. /in-cse/dartes/ae, each binding adds its own prefix
+  char rqi[OM2M_RQI_MAX];
+  om2m_format_t format;
+  size_t pc_len;
+  char pc[OM2M_PC_MAX];		// JSON, not NUL terminated when full, or CBOR
+  uint32_t built_us;		// see om2m/latency.h, 0 when not built by om2m_create_*
+} om2m_request_t;
+
+/**
+ * Response primitive as decoded by a binding,
+ * pc is only valid during the callback and NULL on timeout
+ * */
+typedef struct {
+  const char *rqi;
+  int rsc;
+  om2m_format_t format;		// as announced by the binding, JSON when it cannot tell
+  const char *pc;
+  size_t pc_len;
+} om2m_response_t;
+
+typedef void (*om2m_response_cb_t)(void *arg, const om2m_response_t *response);
+
+typedef struct om2m_client om2m_client_t;
+typedef struct om2m_latency om2m_latency_t;	// see om2m/latency.h
+
+/**
+ * Transport binding
+ *
+ * attach, detach and poll may be NULL, e.g. when the application task
+ * already reads the transport and forwards responses with om2m_client_response.
+ * */
+typedef struct {
+  const char *name;
+  int cbor;			// the binding can carry CBOR content
+  int (*attach)(om2m_client_t *client);
+  void (*detach)(om2m_client_t *client);	// from om2m_client_close
+  int (*send)(om2m_client_t *client, const om2m_request_t *request);
+  int (*poll)(om2m_client_t *client, int timeout_ms);
+} om2m_binding_t;
+
+typedef struct {
+  uint32_t hash;		// of rqi, compared before the string
+  uint32_t deadline;		// ms, see om2m_client_expire
+  char rqi[OM2M_RQI_MAX];	// empty when the slot is free
+  om2m_response_cb_t cb;
+  void *arg;
+  uint8_t op;
+  uint8_t acked;
+  uint32_t built_us;		// only kept with om2m_client_latency
+  uint32_t sent_us;
+} om2m_pending_t;
+
+struct om2m_client {
+  const om2m_binding_t *binding;
+  void *binding_ctx;
+  const char *cse;		// e.g. /in-cse/dartes
+  const char *originator;
+  om2m_format_t format;		// of the requests built by om2m_create_*
+  uint32_t timeout_ms;		// 0 to wait forever
+  unsigned int next_rqi;
+  SemaphoreHandle_t lock;	// responses are usually dispatched from another task
+  int num_pending;
+  om2m_pending_t pending[OM2M_PENDING_SLOTS];	// open addressing keyed by rqi
+  om2m_latency_t *latency;	// NULL when not measured
+};
+
+int om2m_pc_ae(char *buf, size_t size, const char *rn, int api, const char *poa);
+int om2m_pc_cnt(char *buf, size_t size, const char *rn);
+int om2m_pc_cin(char *buf, size_t size, const char *rn, const char *con);
+int om2m_pc_sub(char *buf, size_t size, const char *rn, const char *nu);
+int om2m_rqp(char *buf, size_t size, const om2m_request_t *request);
+
+int om2m_client_init(om2m_client_t *client, const om2m_binding_t *binding, void *binding_ctx, const char *cse, const char *originator);
+int om2m_client_format(om2m_client_t *client, om2m_format_t format);
+int om2m_client_send(om2m_client_t *client, om2m_request_t *request, om2m_response_cb_t cb, void *arg);
+int om2m_client_response(om2m_client_t *client, const om2m_response_t *response);
+int om2m_client_ack(om2m_client_t *client, const char *rqi);
+int om2m_client_poll(om2m_client_t *client, int timeout_ms);
+int om2m_client_expire(om2m_client_t *client, uint32_t now_ms);
+int om2m_client_pending(om2m_client_t *client);
+void om2m_client_close(om2m_client_t *client);
+void om2m_client_latency(om2m_client_t *client, om2m_latency_t *latency);
+uint32_t om2m_now_ms(void);
+uint32_t om2m_now_us(void);
+
+int om2m_create_ae(om2m_client_t *client, const char *ae_name, int ae_id, const char *poa, om2m_response_cb_t cb, void *arg);
+int om2m_create_container(om2m_client_t *client, const char *ae_name, const char *container_name, om2m_response_cb_t cb, void *arg);
+int om2m_create_content_instance(om2m_client_t *client, const char *ae_name, const char *container_name, const char *content_instance_name, const char *data, om2m_response_cb_t cb, void *arg);
+int om2m_create_subscription(om2m_client_t *client, const char *ae_name, const char *container_name, const char *ae_monitor_name, const char *sub_name, om2m_response_cb_t cb, void *arg);
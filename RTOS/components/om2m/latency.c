@@ -0,0 +1,199 @@
+#include "om2m/latency.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define LATENCY_SUB	(1u << OM2M_LATENCY_SUB_BITS)
+
+static const char *const s_latency_ops[OM2M_LATENCY_OPS] = { "create", "retrieve", "update", "delete", "notify" };
+static const char *const s_latency_phases[OM2M_LATENCY_PHASES] = { "send", "ack", "response" };
+
+static int om2m_latency_bucket(uint32_t us) {
+  int shift;
+
+  if(us < LATENCY_SUB)
+    return us;
+  if(us >= 1u << OM2M_LATENCY_BITS)
+    return OM2M_LATENCY_BUCKETS - 1;
+
+  // the power of two picks the row, the next OM2M_LATENCY_SUB_BITS bits the bucket in it
+  shift = 31 - __builtin_clz(us) - OM2M_LATENCY_SUB_BITS;
+  return ((shift + 1) << OM2M_LATENCY_SUB_BITS) + ((us >> shift) & (LATENCY_SUB - 1));
+}
+
+// largest value that falls in bucket i
+static uint32_t om2m_latency_upper(int i) {
+  int shift;
+
+  if(i < (int)LATENCY_SUB)
+    return i;
+
+  shift = (i >> OM2M_LATENCY_SUB_BITS) - 1;
+  return (((i & (LATENCY_SUB - 1)) + LATENCY_SUB + 1) << shift) - 1;
+}
+
+void om2m_latency_init(om2m_latency_t *latency) {
+  uint32_t (*now_us)(void) = latency->now_us;
+  int op, phase;
+
+  memset(latency, 0, sizeof(*latency));
+  latency->now_us = now_us;
+  for(op = 0; op < OM2M_LATENCY_OPS; op++)
+    for(phase = 0; phase < OM2M_LATENCY_PHASES; phase++)
+      latency->hist[op][phase].min = UINT32_MAX;
+}
+
+uint32_t om2m_latency_now(const om2m_latency_t *latency) {
+  return latency->now_us ? latency->now_us() : om2m_now_us();
+}
+
+void om2m_latency_record(om2m_latency_hist_t *hist, uint32_t us) {
+  int i = om2m_latency_bucket(us), j;
+
+  if(hist->bucket[i] == UINT16_MAX) {
+    hist->count = 0;
+    for(j = 0; j < OM2M_LATENCY_BUCKETS; j++) {
+      hist->bucket[j] >>= 1;
+      hist->count += hist->bucket[j];
+    }
+  }
+
+  hist->bucket[i]++;
+  hist->count++;
+  if(us < hist->min)
+    hist->min = us;
+  if(us > hist->max)
+    hist->max = us;
+}
+
+/**
+ * Value at or below which permille of the recorded ones are,
+ * within the width of a bucket
+ *
+ * @return us, 0 when nothing was recorded
+ * */
+uint32_t om2m_latency_percentile(const om2m_latency_hist_t *hist, int permille) {
+  uint32_t rank, seen = 0, us;
+  int i;
+
+  if(!hist->count)
+    return 0;
+
+  rank = ((uint64_t)hist->count * permille + 999) / 1000;
+  if(rank == 0)
+    rank = 1;
+
+  for(i = 0; i < OM2M_LATENCY_BUCKETS - 1; i++)
+    if((seen += hist->bucket[i]) >= rank)
+      break;
+
+  // the last bucket has no upper bound, neither has any bucket past max
+  us = i == OM2M_LATENCY_BUCKETS - 1 ? hist->max : om2m_latency_upper(i);
+  if(us > hist->max)
+    us = hist->max;
+  if(us < hist->min)
+    us = hist->min;
+
+  return us;
+}
+
+void om2m_latency_summary(const om2m_latency_hist_t *hist, om2m_latency_summary_t *summary) {
+  summary->count = hist->count;
+  summary->p50 = om2m_latency_percentile(hist, 500);
+  summary->p99 = om2m_latency_percentile(hist, 990);
+  summary->max = hist->count ? hist->max : 0;
+}
+
+void om2m_latency_add(om2m_latency_t *latency, om2m_op_t op, om2m_latency_phase_t phase, uint32_t us) {
+  if(op < 1 || op > OM2M_LATENCY_OPS || phase >= OM2M_LATENCY_PHASES)
+    return;
+
+  om2m_latency_record(&latency->hist[op - 1][phase], us);
+}
+
+void om2m_latency_timeout(om2m_latency_t *latency, om2m_op_t op) {
+  if(op >= 1 && op <= OM2M_LATENCY_OPS)
+    latency->timeouts[op - 1]++;
+}
+
+/**
+ * Summary of one operation and phase, taken under the lock of the client
+ *
+ * @return 0 on success, -1 if the client is not measured
+ * */
+int om2m_latency_get(om2m_client_t *client, om2m_op_t op, om2m_latency_phase_t phase, om2m_latency_summary_t *summary) {
+  int res = -1;
+
+  if(op < 1 || op > OM2M_LATENCY_OPS || phase >= OM2M_LATENCY_PHASES)
+    return -1;
+
+  xSemaphoreTake(client->lock, portMAX_DELAY);
+  if(client->latency) {
+    om2m_latency_summary(&client->latency->hist[op - 1][phase], summary);
+    res = 0;
+  }
+  xSemaphoreGive(client->lock);
+
+  return res;
+}
+
+/**
+ * Render the latency of the client as JSON, one member per operation
+ * in use with [count, p50, p99, max] in us for each phase, e.g.
+ * {"create":{"timeouts":0,"send":[12,310,420,420],"ack":[0,0,0,0],"response":[...]}}
+ *
+ * For the serial monitor and the CoAP resource of om2m_coap_latency_resource,
+ * only the summaries are taken under the lock.
+ *
+ * @return length written to buf, -1 if it does not fit or the client is not measured
+ * */
+int om2m_latency_report(om2m_client_t *client, char *buf, size_t size) {
+  om2m_latency_summary_t summary[OM2M_LATENCY_PHASES];
+  uint32_t timeouts;
+  size_t len = 0;
+  int op, phase, n, first = 1;
+
+  if(size < 3)
+    return -1;
+  buf[len++] = '{';
+
+  for(op = 0; op < OM2M_LATENCY_OPS; op++) {
+    xSemaphoreTake(client->lock, portMAX_DELAY);
+    if(!client->latency) {
+      xSemaphoreGive(client->lock);
+      return -1;
+    }
+    for(phase = 0; phase < OM2M_LATENCY_PHASES; phase++)
+      om2m_latency_summary(&client->latency->hist[op][phase], &summary[phase]);
+    timeouts = client->latency->timeouts[op];
+    xSemaphoreGive(client->lock);
+
+    if(!summary[OM2M_LATENCY_SEND].count && !timeouts)
+      continue;
+
+    n = snprintf(buf + len, size - len, "%s\"%s\":{\"timeouts\":%u", first ? "" : ",", s_latency_ops[op], (unsigned)timeouts);
+    if(n < 0 || (size_t)n >= size - len)
+      return -1;
+    len += n;
+    first = 0;
+
+    for(phase = 0; phase < OM2M_LATENCY_PHASES; phase++) {
+      n = snprintf(buf + len, size - len, ",\"%s\":[%u,%u,%u,%u]", s_latency_phases[phase], (unsigned)summary[phase].count,
+                   (unsigned)summary[phase].p50, (unsigned)summary[phase].p99, (unsigned)summary[phase].max);
+      if(n < 0 || (size_t)n >= size - len)
+        return -1;
+      len += n;
+    }
+
+    if(len + 1 >= size)
+      return -1;
+    buf[len++] = '}';
+  }
+
+  if(len + 1 >= size)
+    return -1;
+  buf[len++] = '}';
+  buf[len] = '\0';
+
+  return len;
+}
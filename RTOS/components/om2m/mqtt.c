@@ -1,186 +1,233 @@
 #include "om2m/mqtt.h"
 #include "cJSON.h"
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "tcpip_adapter.h"
 
+#define MQTT_RQP_MAX	(OM2M_PC_MAX + 2 * OM2M_TO_MAX + 64)	// envelope around the primitive content
 
-int mqtt_publish(MQTTClient* client, char* payload) {
+static om2m_mqtt_binding_t *s_mqtt_bindings[OM2M_MQTT_MAX_BINDINGS];
+
+static int mqtt_publish_len(MQTTClient* client, const char *topic, char* payload, size_t len) {
   MQTTMessage message;
 
   message.qos = MQTT_QOS;
   message.retained = 0;
   message.payload = payload;
-  message.payloadlen = strlen(message.payload);
+  message.payloadlen = len;
 
+  return MQTTPublish(client, topic, &message);
+}
+
+int mqtt_publish(MQTTClient* client, char* payload) {
   tcpip_adapter_ip_info_t local_ip;
   tcpip_adapter_get_ip_info(TCPIP_ADAPTER_IF_STA, &local_ip);
   char topic[70];
   sprintf(topic, "/oneM2M/req/ESP8266_"IPSTR"/in-cse/json", IP2STR(&local_ip.ip));
 
-  int rc = -1;
-  rc = MQTTPublish(client, topic, &message);
-
-  return rc;
+  return mqtt_publish_len(client, topic, payload, strlen(payload));
 }
 
-int om2m_mqtt_create_ae(MQTTClient* client, char *ae_name, int ae_id) {
-  cJSON *payload = NULL;
-  cJSON *poa_array = NULL;
+/**
+ * Wrap the primitive content of a legacy request into m2m:rqp and publish it
+ * */
+static int mqtt_publish_request(MQTTClient* client, om2m_request_t *request, int pc_len) {
+  char out[MQTT_RQP_MAX];
+
+  if(pc_len < 0)
+    return -1;
 
-  cJSON *rqp = NULL;
-  cJSON *pc = NULL;
-  cJSON *ae = NULL;
+  request->op = OM2M_OP_CREATE;
+  request->fr = CSE_ORIGINATOR;
+  request->pc_len = pc_len;
 
-  char *out = NULL;
+  if(om2m_rqp(out, sizeof(out), request) < 0)
+    return -1;
+
+  return mqtt_publish(client, out);
+}
 
-  char *to = malloc(sizeof(CSE_NAME)+10);
-  sprintf(to, "/in-cse/%s", CSE_NAME);
+int om2m_mqtt_create_ae(MQTTClient* client, char *ae_name, int ae_id) {
+  om2m_request_t request;
+  char poa[70];
 
   tcpip_adapter_ip_info_t local_ip;
   tcpip_adapter_get_ip_info(TCPIP_ADAPTER_IF_STA, &local_ip);
-  char poa[70];
   sprintf(poa, "mqtt://%s:%d/oneM2M/req/ESP8266_"IPSTR"/json", MQTT_BROKER_IP, MQTT_BROKER_PORT, IP2STR(&local_ip.ip));
-  poa_array = cJSON_CreateArray();
-  cJSON_AddItemToArray(poa_array, cJSON_CreateString(poa));
-
-
-  payload = cJSON_CreateObject();
-  cJSON_AddItemToObject(payload, "m2m:rqp", rqp = cJSON_CreateObject());
-  cJSON_AddStringToObject(rqp, "m2m:fr", MQTT_FROM);
-  cJSON_AddStringToObject(rqp, "m2m:to", to);
-  cJSON_AddNumberToObject(rqp, "m2m:op", 1);
-  //cJSON_AddNumberToObject(rqp, "m2m:rqi", rqi);
-  cJSON_AddItemToObject(rqp, "m2m:pc", pc = cJSON_CreateObject());
-  cJSON_AddItemToObject(pc, "m2m:ae", ae = cJSON_CreateObject());
-  cJSON_AddStringToObject(ae, "rr", "true");
-  cJSON_AddItemToObject(ae, "poa", poa_array);
-  cJSON_AddNumberToObject(ae, "api", ae_id);
-  cJSON_AddStringToObject(ae, "rn", ae_name);
-  cJSON_AddNumberToObject(rqp, "m2m:ty", 2);
 
-  out = cJSON_PrintUnformatted(payload);
+  memset(&request, 0, sizeof(request));
+  request.ty = OM2M_TY_AE;
+  sprintf(request.to, "/in-cse/%s", CSE_NAME);
 
-  int res = mqtt_publish(client, out);
-
-  cJSON_Delete(payload);
-  free(out);
-  free(to);
-
-  return res;
+  return mqtt_publish_request(client, &request, om2m_pc_ae(request.pc, sizeof(request.pc), ae_name, ae_id, poa));
 }
 
 int om2m_mqtt_create_container(MQTTClient* client, char *ae_name, char *container_name) {
+  om2m_request_t request;
 
-  cJSON *payload = NULL;
-  cJSON *rqp = NULL;
-  cJSON *pc = NULL;
-  cJSON *cnt = NULL;
-
-  char *out = NULL;
-
-  char *to = malloc(sizeof(CSE_NAME)+20);
-  sprintf(to, "/in-cse/%s/%s", CSE_NAME, ae_name);
+  memset(&request, 0, sizeof(request));
+  request.ty = OM2M_TY_CNT;
+  if(snprintf(request.to, sizeof(request.to), "/in-cse/%s/%s", CSE_NAME, ae_name) >= (int)sizeof(request.to))
+    return -1;
 
-  payload = cJSON_CreateObject();
-
-  cJSON_AddItemToObject(payload, "m2m:rqp", rqp = cJSON_CreateObject());
-  cJSON_AddStringToObject(rqp, "m2m:fr", MQTT_FROM);
-  cJSON_AddStringToObject(rqp, "m2m:to", to);
-  cJSON_AddNumberToObject(rqp, "m2m:op", 1);
-  //cJSON_AddNumberToObject(rqp, "m2m:rqi", rqi);
-  cJSON_AddItemToObject(rqp, "m2m:pc", pc = cJSON_CreateObject());
-  cJSON_AddItemToObject(pc, "m2m:cnt", cnt = cJSON_CreateObject());
-  cJSON_AddStringToObject(cnt, "rn", container_name);
-  cJSON_AddNumberToObject(rqp, "m2m:ty", 3);
-
-  out = cJSON_PrintUnformatted(payload);
+  return mqtt_publish_request(client, &request, om2m_pc_cnt(request.pc, sizeof(request.pc), container_name));
+}
 
-  int res = mqtt_publish(client, out);
+int om2m_mqtt_create_content_instance(MQTTClient* client, char *ae_name, char *container_name, char *content_instance_name, char *data) {
+  om2m_request_t request;
 
-  cJSON_Delete(payload);
-  free(out);
-  free(to);
+  memset(&request, 0, sizeof(request));
+  request.ty = OM2M_TY_CIN;
+  if(snprintf(request.to, sizeof(request.to), "/in-cse/%s/%s/%s", CSE_NAME, ae_name, container_name) >= (int)sizeof(request.to))
+    return -1;
 
-  return res;
+  return mqtt_publish_request(client, &request, om2m_pc_cin(request.pc, sizeof(request.pc), content_instance_name, data));
 }
 
-int om2m_mqtt_create_content_instance(MQTTClient* client, char *ae_name, char *container_name, char *content_instance_name, char *data) {
-  cJSON *payload = NULL;
-  cJSON *rqp = NULL;
-  cJSON *pc = NULL;
-  cJSON *cin = NULL;
-
-  char *out = NULL;
-  char *to = malloc(sizeof(CSE_NAME)+30);
-  char cnf[20];
+int om2m_mqtt_create_subscription(MQTTClient* client, char *ae_name, char* container_name, char *ae_monitor_name, char *sub_name) {
+  om2m_request_t request;
+  char nu_url[50];
 
-  sprintf(to, "/in-cse/%s/%s/%s", CSE_NAME, ae_name, container_name);
-  sprintf(cnf, "text/plain:%d", sizeof(data));
+  sprintf(nu_url, "/in-cse/%s/%s", CSE_NAME, ae_monitor_name);
 
-  payload = cJSON_CreateObject();
-  cJSON_AddItemToObject(payload, "m2m:rqp", rqp = cJSON_CreateObject());
-  cJSON_AddStringToObject(rqp, "m2m:fr", MQTT_FROM);
-  cJSON_AddStringToObject(rqp, "m2m:to", to);
-  cJSON_AddNumberToObject(rqp, "m2m:op", 1);
-  cJSON_AddItemToObject(rqp, "m2m:pc", pc = cJSON_CreateObject());
-  cJSON_AddItemToObject(pc, "m2m:cin", cin = cJSON_CreateObject());
-  cJSON_AddStringToObject(cin, "con", data);
+  memset(&request, 0, sizeof(request));
+  request.ty = OM2M_TY_SUB;
+  if(snprintf(request.to, sizeof(request.to), "/in-cse/%s/%s/%s", CSE_NAME, ae_name, container_name) >= (int)sizeof(request.to))
+    return -1;
 
-  cJSON_AddStringToObject(cin, "cnf", cnf);
-  cJSON_AddStringToObject(cin, "rn", content_instance_name);
-  cJSON_AddNumberToObject(rqp, "m2m:ty", 4);
+  return mqtt_publish_request(client, &request, om2m_pc_sub(request.pc, sizeof(request.pc), sub_name, nu_url));
+}
 
-  out = cJSON_PrintUnformatted(payload);
+static int mqtt_binding_send(om2m_client_t *client, const om2m_request_t *request) {
+  om2m_mqtt_binding_t *binding = client->binding_ctx;
+  char out[MQTT_RQP_MAX];
+  int len;
 
-  int res = mqtt_publish(client, out);
+  if((len = om2m_rqp(out, sizeof(out), request)) < 0)
+    return -1;
 
-  cJSON_Delete(payload);
-  free(out);
-  free(to);
+  return mqtt_publish_len(binding->mqtt, binding->req_topic, out, len) < 0 ? -1 : 0;
+}
 
+/**
+ * Decode an m2m:rsp envelope and hand it to the client,
+ * for applications that dispatch MQTT messages themselves
+ *
+ * @return 0 if it matched a pending request, -1 otherwise
+ * */
+int om2m_mqtt_handle_response(om2m_client_t *client, const char *payload, size_t len) {
+  cJSON *root, *rsp, *item;
+  om2m_response_t response;
+  char *pc = NULL;
+  int res = -1;
+
+  // payloads are not NUL terminated, cJSON_Parse needs a copy
+  char *json = malloc(len + 1);
+  if(json == NULL)
+    return -1;
+  memcpy(json, payload, len);
+  json[len] = '\0';
+
+  root = cJSON_Parse(json);
+  free(json);
+  if(root == NULL)
+    return -1;
+
+  memset(&response, 0, sizeof(response));
+  if((rsp = cJSON_GetObjectItem(root, "m2m:rsp")) == NULL)
+    goto out;
+
+  if((item = cJSON_GetObjectItem(rsp, "m2m:rqi")) == NULL || !cJSON_IsString(item))
+    goto out;
+  response.rqi = item->valuestring;
+
+  // some CSEs send the status code as a string
+  if((item = cJSON_GetObjectItem(rsp, "m2m:rsc")) != NULL)
+    response.rsc = cJSON_IsString(item) ? atoi(item->valuestring) : item->valueint;
+
+  if((item = cJSON_GetObjectItem(rsp, "m2m:pc")) != NULL && (pc = cJSON_PrintUnformatted(item)) != NULL) {
+    response.pc = pc;
+    response.pc_len = strlen(pc);
+  }
+
+  res = om2m_client_response(client, &response);
+  free(pc);
+
+out:
+  cJSON_Delete(root);
   return res;
 }
 
-int om2m_create_subscription(MQTTClient* client, char *ae_name, char* container_name, char *ae_monitor_name, char *sub_name) {
-  cJSON *payload = NULL;
-  cJSON *nu_array = NULL;
-  cJSON *rqp = NULL;
-  cJSON *pc = NULL;
-  cJSON *sub = NULL;
+static void mqtt_binding_message(MessageData *data) {
+  MQTTLenString *topic = &data->topicName->lenstring;
+  int i;
 
-  char *out = NULL;
+  for(i = 0; i < OM2M_MQTT_MAX_BINDINGS; i++) {
+    om2m_mqtt_binding_t *binding = s_mqtt_bindings[i];
 
-  char *to = malloc(sizeof(CSE_NAME)+30);
-  sprintf(to, "/in-cse/%s/%s/%s", CSE_NAME, ae_name, container_name);
+    if(binding && binding->client && topic->len == (int)strlen(binding->resp_topic) &&
+       !strncmp(topic->data, binding->resp_topic, topic->len)) {
+      om2m_mqtt_handle_response(binding->client, data->message->payload, data->message->payloadlen);
+      return;
+    }
+  }
+}
 
-  char nu_url[50];
-  sprintf(nu_url, "/in-cse/%s/%s", CSE_NAME, ae_monitor_name);
+static int mqtt_binding_attach(om2m_client_t *client) {
+  om2m_mqtt_binding_t *binding = client->binding_ctx;
+  int i, slot = -1;
 
-  payload = cJSON_CreateObject();
-  nu_array = cJSON_CreateArray();
-  cJSON_AddItemToArray(nu_array, cJSON_CreateString(nu_url));
+  for(i = 0; i < OM2M_MQTT_MAX_BINDINGS; i++) {
+    if(s_mqtt_bindings[i] == binding)
+      slot = i;
+    else if(s_mqtt_bindings[i] == NULL && slot < 0)
+      slot = i;
+  }
+  if(slot < 0)
+    return -1;
 
-  cJSON_AddItemToObject(payload, "m2m:rqp", rqp = cJSON_CreateObject());
-  cJSON_AddStringToObject(rqp, "m2m:fr", MQTT_FROM);
-  cJSON_AddStringToObject(rqp, "m2m:to", to);
-  cJSON_AddNumberToObject(rqp, "m2m:op", 1);
-  //cJSON_AddNumberToObject(rqp, "m2m:rqi", rqi);
-  cJSON_AddItemToObject(rqp, "m2m:pc", pc = cJSON_CreateObject());
-  cJSON_AddItemToObject(pc, "m2m:sub", sub = cJSON_CreateObject());
-  cJSON_AddItemToObject(sub, "nu", nu_array);
-  cJSON_AddStringToObject(sub, "rn", sub_name);
-  cJSON_AddNumberToObject(sub, "nct", 2);
-  cJSON_AddNumberToObject(rqp, "m2m:ty", 23);
+  s_mqtt_bindings[slot] = binding;
+  binding->client = client;
 
-  out = cJSON_PrintUnformatted(payload);
+  return MQTTSubscribe(binding->mqtt, binding->resp_topic, MQTT_QOS, mqtt_binding_message) < 0 ? -1 : 0;
+}
 
-  int res = mqtt_publish(client, out);
+static void mqtt_binding_detach(om2m_client_t *client) {
+  int i;
 
-  cJSON_Delete(payload);
-  free(out);
-  free(to);
+  for(i = 0; i < OM2M_MQTT_MAX_BINDINGS; i++)
+    if(s_mqtt_bindings[i] == client->binding_ctx)
+      s_mqtt_bindings[i] = NULL;
+}
 
-  return res;
+#if !defined(MQTT_TASK)
+static int mqtt_binding_poll(om2m_client_t *client, int timeout_ms) {
+  om2m_mqtt_binding_t *binding = client->binding_ctx;
+
+  return MQTTYield(binding->mqtt, timeout_ms) < 0 ? -1 : 0;
+}
+#endif
+
+const om2m_binding_t om2m_mqtt_binding = {
+  .name = "mqtt",
+  .attach = mqtt_binding_attach,
+  .detach = mqtt_binding_detach,
+  .send = mqtt_binding_send,
+#if !defined(MQTT_TASK)
+  .poll = mqtt_binding_poll,	// with MQTT_TASK the background task reads the socket
+#endif
+};
+
+int om2m_mqtt_binding_init(om2m_mqtt_binding_t *binding, MQTTClient *mqtt, const char *aei, const char *cse_id) {
+  memset(binding, 0, sizeof(*binding));
+  binding->mqtt = mqtt;
+
+  if(snprintf(binding->req_topic, sizeof(binding->req_topic), "/oneM2M/req/%s/%s/json", aei, cse_id) >= (int)sizeof(binding->req_topic) ||
+     snprintf(binding->resp_topic, sizeof(binding->resp_topic), "/oneM2M/resp/%s/%s/json", aei, cse_id) >= (int)sizeof(binding->resp_topic))
+    return -1;
+
+  return 0;
 }
@@ -0,0 +1,609 @@
+#include "om2m/om2m.h"
+#include "om2m/cbor.h"
+#include "om2m/latency.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+
+/**
+ * Bounded JSON writer, primitives are small enough to be built
+ * directly into the request without a DOM or any allocation
+ * */
+typedef struct {
+  char *buf;
+  size_t size;
+  size_t len;
+  int overflow;
+} json_writer_t;
+
+static void json_init(json_writer_t *w, char *buf, size_t size) {
+  w->buf = buf;
+  w->size = size;
+  w->len = 0;
+  w->overflow = 0;
+}
+
+static void json_raw(json_writer_t *w, const char *s, size_t n) {
+  if(w->len + n > w->size) {
+    w->overflow = 1;
+    return;
+  }
+  memcpy(w->buf + w->len, s, n);
+  w->len += n;
+}
+
+static void json_lit(json_writer_t *w, const char *s) {
+  json_raw(w, s, strlen(s));
+}
+
+static void json_str(json_writer_t *w, const char *s) {
+  const char *run = s;
+  char esc[8];
+
+  json_raw(w, "\"", 1);
+
+  // copy runs of plain characters in one go, escape the rest
+  for(; *s; s++) {
+    unsigned char c = *s;
+
+    if(c >= 0x20 && c != '"' && c != '\\')
+      continue;
+
+    json_raw(w, run, s - run);
+    if(c == '"' || c == '\\') {
+      esc[0] = '\\';
+      esc[1] = c;
+      json_raw(w, esc, 2);
+    }
+    else
+      json_raw(w, esc, sprintf(esc, "\\u%04x", c));
+    run = s + 1;
+  }
+  json_raw(w, run, s - run);
+
+  json_raw(w, "\"", 1);
+}
+
+static void json_int(json_writer_t *w, int n) {
+  char num[12];
+
+  json_raw(w, num, sprintf(num, "%d", n));
+}
+
+static int json_done(json_writer_t *w) {
+  // NUL terminate when there is room, callers go by the length
+  if(w->len < w->size)
+    w->buf[w->len] = '\0';
+
+  return w->overflow ? -1 : (int)w->len;
+}
+
+/**
+ * Serialize the primitive content of each resource type
+ *
+ * @return length written to buf, -1 if it does not fit
+ * */
+int om2m_pc_ae(char *buf, size_t size, const char *rn, int api, const char *poa) {
+  json_writer_t w;
+
+  json_init(&w, buf, size);
+  json_lit(&w, "{\"m2m:ae\":{\"rr\":true,\"api\":");
+  json_int(&w, api);
+  json_lit(&w, ",\"rn\":");
+  json_str(&w, rn);
+  if(poa) {
+    json_lit(&w, ",\"poa\":[");
+    json_str(&w, poa);
+    json_lit(&w, "]");
+  }
+  json_lit(&w, "}}");
+
+  return json_done(&w);
+}
+
+int om2m_pc_cnt(char *buf, size_t size, const char *rn) {
+  json_writer_t w;
+
+  json_init(&w, buf, size);
+  json_lit(&w, "{\"m2m:cnt\":{\"rn\":");
+  json_str(&w, rn);
+  json_lit(&w, "}}");
+
+  return json_done(&w);
+}
+
+int om2m_pc_cin(char *buf, size_t size, const char *rn, const char *con) {
+  json_writer_t w;
+  char cnf[24];
+
+  sprintf(cnf, "text/plain:%u", (unsigned)strlen(con));
+
+  json_init(&w, buf, size);
+  json_lit(&w, "{\"m2m:cin\":{\"con\":");
+  json_str(&w, con);
+  json_lit(&w, ",\"cnf\":");
+  json_str(&w, cnf);
+  // the CSE names the instance when rn is NULL
+  if(rn) {
+    json_lit(&w, ",\"rn\":");
+    json_str(&w, rn);
+  }
+  json_lit(&w, "}}");
+
+  return json_done(&w);
+}
+
+int om2m_pc_sub(char *buf, size_t size, const char *rn, const char *nu) {
+  json_writer_t w;
+
+  json_init(&w, buf, size);
+  json_lit(&w, "{\"m2m:sub\":{\"rn\":");
+  json_str(&w, rn);
+  json_lit(&w, ",\"nct\":2,\"nu\":[");
+  json_str(&w, nu);
+  json_lit(&w, "]}}");
+
+  return json_done(&w);
+}
+
+/**
+ * Wrap a request into an m2m:rqp envelope, for bindings
+ * that carry the whole primitive in the payload such as MQTT
+ *
+ * @return length written to buf, -1 if it does not fit
+ * */
+int om2m_rqp(char *buf, size_t size, const om2m_request_t *request) {
+  json_writer_t w;
+
+  json_init(&w, buf, size);
+  json_lit(&w, "{\"m2m:rqp\":{\"m2m:fr\":");
+  json_str(&w, request->fr);
+  json_lit(&w, ",\"m2m:to\":");
+  json_str(&w, request->to);
+  json_lit(&w, ",\"m2m:op\":");
+  json_int(&w, request->op);
+  if(request->rqi[0]) {
+    json_lit(&w, ",\"m2m:rqi\":");
+    json_str(&w, request->rqi);
+  }
+  if(request->ty) {
+    json_lit(&w, ",\"m2m:ty\":");
+    json_int(&w, request->ty);
+  }
+  if(request->pc_len) {
+    json_lit(&w, ",\"m2m:pc\":");
+    json_raw(&w, request->pc, request->pc_len);
+  }
+  json_lit(&w, "}}");
+
+  return json_done(&w);
+}
+
+uint32_t om2m_now_ms(void) {
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  // wraps every 49 days, the unsigned product keeps the wrap defined with a 32 bit time_t
+  return (uint32_t)tv.tv_sec * 1000u + tv.tv_usec / 1000;
+}
+
+// wraps every 71 minutes, intervals are taken modulo 2^32
+uint32_t om2m_now_us(void) {
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return (uint32_t)tv.tv_sec * 1000000u + tv.tv_usec;
+}
+
+int om2m_client_init(om2m_client_t *client, const om2m_binding_t *binding, void *binding_ctx, const char *cse, const char *originator) {
+  memset(client, 0, sizeof(*client));
+  client->binding = binding;
+  client->binding_ctx = binding_ctx;
+  client->cse = cse;
+  client->originator = originator;
+  client->timeout_ms = OM2M_TIMEOUT_MS;
+  client->next_rqi = 1;
+
+  if((client->lock = xSemaphoreCreateMutex()) == NULL)
+    return -1;
+
+  if(binding->attach && binding->attach(client) < 0) {
+    om2m_client_close(client);
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Select the serialization of the requests built by om2m_create_*
+ *
+ * @return 0 on success, -1 if the binding cannot carry it
+ * */
+int om2m_client_format(om2m_client_t *client, om2m_format_t format) {
+  if(format == OM2M_FORMAT_CBOR && !client->binding->cbor)
+    return -1;
+
+  client->format = format;
+  return 0;
+}
+
+/**
+ * Measure the latency of the requests sent from now on into latency,
+ * which is cleared first; NULL stops measuring. See om2m/latency.h
+ * */
+void om2m_client_latency(om2m_client_t *client, om2m_latency_t *latency) {
+  if(latency)
+    om2m_latency_init(latency);
+
+  xSemaphoreTake(client->lock, portMAX_DELAY);
+  client->latency = latency;
+  xSemaphoreGive(client->lock);
+}
+
+/**
+ * Release the client, pending callbacks are dropped without being called
+ * */
+void om2m_client_close(om2m_client_t *client) {
+  if(client->binding->detach)
+    client->binding->detach(client);
+  if(client->lock)
+    vSemaphoreDelete(client->lock);
+  client->lock = NULL;
+  client->num_pending = 0;
+  memset(client->pending, 0, sizeof(client->pending));
+}
+
+// FNV-1a, rqis are short counters so anything cheap spreads them well enough
+static uint32_t om2m_rqi_hash(const char *rqi) {
+  uint32_t hash = 2166136261u;
+
+  while(*rqi)
+    hash = (hash ^ (unsigned char)*rqi++) * 16777619u;
+
+  return hash;
+}
+
+#define PENDING_MASK	(OM2M_PENDING_SLOTS - 1)
+
+static int om2m_pending_find(om2m_client_t *client, const char *rqi, uint32_t hash) {
+  int i = hash & PENDING_MASK;
+
+  while(client->pending[i].rqi[0]) {
+    if(client->pending[i].hash == hash && !strcmp(client->pending[i].rqi, rqi))
+      return i;
+    i = (i + 1) & PENDING_MASK;
+  }
+
+  return -1;
+}
+
+static om2m_pending_t *om2m_pending_insert(om2m_client_t *client, const char *rqi, uint32_t hash) {
+  int i = hash & PENDING_MASK;
+
+  if(client->num_pending == OM2M_PENDING_MAX)
+    return NULL;
+
+  while(client->pending[i].rqi[0])
+    i = (i + 1) & PENDING_MASK;
+
+  client->num_pending++;
+  client->pending[i].hash = hash;
+  strcpy(client->pending[i].rqi, rqi);
+  return &client->pending[i];
+}
+
+/**
+ * Free slot i, shifting back the entries of its probe run
+ * so that lookups never need tombstones
+ * */
+static void om2m_pending_remove(om2m_client_t *client, int i) {
+  int j = i;
+
+  while(1) {
+    int home;
+
+    j = (j + 1) & PENDING_MASK;
+    if(client->pending[j].rqi[0] == '\0')
+      break;
+
+    // an entry may move into the hole only if that keeps it at or past its home slot
+    home = client->pending[j].hash & PENDING_MASK;
+    if(((j - home) & PENDING_MASK) >= ((j - i) & PENDING_MASK)) {
+      client->pending[i] = client->pending[j];
+      i = j;
+    }
+  }
+
+  client->pending[i].rqi[0] = '\0';
+  client->num_pending--;
+}
+
+int om2m_client_pending(om2m_client_t *client) {
+  int n;
+
+  xSemaphoreTake(client->lock, portMAX_DELAY);
+  n = client->num_pending;
+  xSemaphoreGive(client->lock);
+
+  return n;
+}
+
+/**
+ * Assign fr and rqi and send the request through the binding,
+ * cb is called once with the matching response or on timeout (cb may be NULL)
+ *
+ * @return 0 on success, -1 if the binding fails or too many requests are pending
+ * */
+int om2m_client_send(om2m_client_t *client, om2m_request_t *request, om2m_response_cb_t cb, void *arg) {
+  om2m_pending_t *pending;
+  uint32_t hash, now = 0;
+
+  xSemaphoreTake(client->lock, portMAX_DELAY);
+
+  request->fr = client->originator;
+  sprintf(request->rqi, "%x", client->next_rqi++);
+  hash = om2m_rqi_hash(request->rqi);
+
+  // a request built by hand starts here
+  if(client->latency) {
+    now = om2m_latency_now(client->latency);
+    if(!request->built_us)
+      request->built_us = now;
+  }
+
+  // registered before sending, the response may beat send() back
+  if(cb) {
+    if((pending = om2m_pending_insert(client, request->rqi, hash)) == NULL) {
+      xSemaphoreGive(client->lock);
+      return -1;
+    }
+    pending->deadline = om2m_now_ms() + client->timeout_ms;
+    pending->cb = cb;
+    pending->arg = arg;
+    pending->op = request->op;
+    pending->acked = 0;
+    pending->built_us = request->built_us;
+    pending->sent_us = now;	// until send() returns, an early ACK counts from here
+  }
+
+  xSemaphoreGive(client->lock);
+
+  if(client->binding->send(client, request) < 0) {
+    if(cb) {
+      int i;
+
+      xSemaphoreTake(client->lock, portMAX_DELAY);
+      if((i = om2m_pending_find(client, request->rqi, hash)) >= 0)
+        om2m_pending_remove(client, i);
+      xSemaphoreGive(client->lock);
+    }
+    return -1;
+  }
+
+  if(client->latency) {
+    int i;
+
+    xSemaphoreTake(client->lock, portMAX_DELAY);
+    if(client->latency) {
+      now = om2m_latency_now(client->latency);
+      om2m_latency_add(client->latency, request->op, OM2M_LATENCY_SEND, now - request->built_us);
+      if(cb && (i = om2m_pending_find(client, request->rqi, hash)) >= 0 && !client->pending[i].acked)
+        client->pending[i].sent_us = now;
+    }
+    xSemaphoreGive(client->lock);
+  }
+
+  return 0;
+}
+
+/**
+ * Called by the bindings when the transport acknowledges a request
+ * ahead of its response, e.g. the empty ACK of a CoAP CON request
+ *
+ * @return 0 if it matched a pending request, -1 otherwise
+ * */
+int om2m_client_ack(om2m_client_t *client, const char *rqi) {
+  om2m_pending_t *pending;
+  int i;
+
+  if(rqi == NULL || rqi[0] == '\0')
+    return -1;
+
+  xSemaphoreTake(client->lock, portMAX_DELAY);
+
+  if((i = om2m_pending_find(client, rqi, om2m_rqi_hash(rqi))) < 0) {
+    xSemaphoreGive(client->lock);
+    return -1;
+  }
+
+  // retransmissions are acknowledged once
+  pending = &client->pending[i];
+  if(!pending->acked && client->latency && pending->sent_us)
+    om2m_latency_add(client->latency, pending->op, OM2M_LATENCY_ACK, om2m_latency_now(client->latency) - pending->sent_us);
+  pending->acked = 1;
+
+  xSemaphoreGive(client->lock);
+
+  return 0;
+}
+
+/**
+ * Called by the bindings for every response they decode
+ *
+ * @return 0 if it matched a pending request, -1 otherwise
+ * */
+int om2m_client_response(om2m_client_t *client, const om2m_response_t *response) {
+  om2m_response_cb_t cb;
+  void *arg;
+  int i;
+
+  if(response->rqi == NULL || response->rqi[0] == '\0')
+    return -1;
+
+  xSemaphoreTake(client->lock, portMAX_DELAY);
+
+  if((i = om2m_pending_find(client, response->rqi, om2m_rqi_hash(response->rqi))) < 0) {
+    xSemaphoreGive(client->lock);
+    return -1;
+  }
+
+  // built_us is 0 for the requests sent before measuring began
+  if(client->latency && client->pending[i].built_us)
+    om2m_latency_add(client->latency, client->pending[i].op, OM2M_LATENCY_RESPONSE,
+                     om2m_latency_now(client->latency) - client->pending[i].built_us);
+
+  // free the slot first, the callback may well send the next request
+  cb = client->pending[i].cb;
+  arg = client->pending[i].arg;
+  om2m_pending_remove(client, i);
+
+  xSemaphoreGive(client->lock);
+
+  cb(arg, response);
+
+  return 0;
+}
+
+/**
+ * Complete the requests whose deadline has passed with OM2M_RSC_TIMEOUT,
+ * a late response to them is then ignored
+ *
+ * @return number of requests that timed out
+ * */
+int om2m_client_expire(om2m_client_t *client, uint32_t now_ms) {
+  om2m_response_t response;
+  char rqi[OM2M_RQI_MAX];
+  int i, n = 0;
+
+  if(client->timeout_ms == 0)
+    return 0;
+
+  memset(&response, 0, sizeof(response));
+  response.rqi = rqi;
+  response.rsc = OM2M_RSC_TIMEOUT;
+
+  xSemaphoreTake(client->lock, portMAX_DELAY);
+
+  for(i = 0; i < OM2M_PENDING_SLOTS; i++) {
+    om2m_pending_t *pending = &client->pending[i];
+    om2m_response_cb_t cb;
+    void *arg;
+
+    if(pending->rqi[0] == '\0' || (int32_t)(now_ms - pending->deadline) < 0)
+      continue;
+
+    if(client->latency)
+      om2m_latency_timeout(client->latency, pending->op);
+    cb = pending->cb;
+    arg = pending->arg;
+    strcpy(rqi, pending->rqi);
+    om2m_pending_remove(client, i);
+
+    xSemaphoreGive(client->lock);
+    cb(arg, &response);
+    n++;
+    xSemaphoreTake(client->lock, portMAX_DELAY);
+
+    // the removal may have shifted another entry into this slot
+    i--;
+  }
+
+  xSemaphoreGive(client->lock);
+
+  return n;
+}
+
+int om2m_client_poll(om2m_client_t *client, int timeout_ms) {
+  int res = 0;
+
+  if(client->binding->poll)
+    res = client->binding->poll(client, timeout_ms);
+
+  om2m_client_expire(client, om2m_now_ms());
+
+  return res;
+}
+
+static int om2m_request_init(om2m_client_t *client, om2m_request_t *request, om2m_ty_t ty, const char *parent, const char *child) {
+  int len;
+
+  memset(request, 0, sizeof(*request));
+  request->op = OM2M_OP_CREATE;
+  request->ty = ty;
+  request->format = client->format;
+  if(client->latency)
+    request->built_us = om2m_latency_now(client->latency);
+
+  if(child)
+    len = snprintf(request->to, sizeof(request->to), "%s/%s/%s", client->cse, parent, child);
+  else if(parent)
+    len = snprintf(request->to, sizeof(request->to), "%s/%s", client->cse, parent);
+  else
+    len = snprintf(request->to, sizeof(request->to), "%s", client->cse);
+
+  return len < 0 || len >= (int)sizeof(request->to) ? -1 : 0;
+}
+
+static int om2m_request_pc(om2m_request_t *request, int len) {
+  if(len < 0)
+    return -1;
+
+  request->pc_len = len;
+  return 0;
+}
+
+int om2m_create_ae(om2m_client_t *client, const char *ae_name, int ae_id, const char *poa, om2m_response_cb_t cb, void *arg) {
+  om2m_request_t request;
+
+  if(om2m_request_init(client, &request, OM2M_TY_AE, NULL, NULL) < 0 ||
+     om2m_request_pc(&request, request.format == OM2M_FORMAT_CBOR ?
+                               om2m_cbor_ae(request.pc, sizeof(request.pc), ae_name, ae_id, poa) :
+                               om2m_pc_ae(request.pc, sizeof(request.pc), ae_name, ae_id, poa)) < 0)
+    return -1;
+
+  return om2m_client_send(client, &request, cb, arg);
+}
+
+int om2m_create_container(om2m_client_t *client, const char *ae_name, const char *container_name, om2m_response_cb_t cb, void *arg) {
+  om2m_request_t request;
+
+  if(om2m_request_init(client, &request, OM2M_TY_CNT, ae_name, NULL) < 0 ||
+     om2m_request_pc(&request, request.format == OM2M_FORMAT_CBOR ?
+                               om2m_cbor_cnt(request.pc, sizeof(request.pc), container_name) :
+                               om2m_pc_cnt(request.pc, sizeof(request.pc), container_name)) < 0)
+    return -1;
+
+  return om2m_client_send(client, &request, cb, arg);
+}
+
+int om2m_create_content_instance(om2m_client_t *client, const char *ae_name, const char *container_name, const char *content_instance_name, const char *data, om2m_response_cb_t cb, void *arg) {
+  om2m_request_t request;
+
+  if(om2m_request_init(client, &request, OM2M_TY_CIN, ae_name, container_name) < 0 ||
+     om2m_request_pc(&request, request.format == OM2M_FORMAT_CBOR ?
+                               om2m_cbor_cin(request.pc, sizeof(request.pc), content_instance_name, data) :
+                               om2m_pc_cin(request.pc, sizeof(request.pc), content_instance_name, data)) < 0)
+    return -1;
+
+  return om2m_client_send(client, &request, cb, arg);
+}
+
+int om2m_create_subscription(om2m_client_t *client, const char *ae_name, const char *container_name, const char *ae_monitor_name, const char *sub_name, om2m_response_cb_t cb, void *arg) {
+  om2m_request_t request;
+  char nu[OM2M_TO_MAX];
+  int len;
+
+  len = snprintf(nu, sizeof(nu), "%s/%s", client->cse, ae_monitor_name);
+  if(len < 0 || len >= (int)sizeof(nu))
+    return -1;
+
+  if(om2m_request_init(client, &request, OM2M_TY_SUB, ae_name, container_name) < 0 ||
+     om2m_request_pc(&request, request.format == OM2M_FORMAT_CBOR ?
+                               om2m_cbor_sub(request.pc, sizeof(request.pc), sub_name, nu) :
+                               om2m_pc_sub(request.pc, sizeof(request.pc), sub_name, nu)) < 0)
+    return -1;
+
+  return om2m_client_send(client, &request, cb, arg);
+}
@@ -0,0 +1,55 @@
+/*
+ * Host stand-in for the Paho MQTTClient-C API used by the om2m component,
+ * messages are queued in memory and delivered by MQTTYield
+ */
+#pragma once
+
+#include <stddef.h>
+
+#define MAX_MESSAGE_HANDLERS 5
+
+enum QoS { QOS0, QOS1, QOS2, SUBFAIL = 0x80 };
+
+typedef struct {
+    int len;
+    char *data;
+} MQTTLenString;
+
+typedef struct {
+    char *cstring;
+    MQTTLenString lenstring;
+} MQTTString;
+
+typedef struct MQTTMessage {
+    enum QoS qos;
+    unsigned char retained;
+    unsigned char dup;
+    unsigned short id;
+    void *payload;
+    size_t payloadlen;
+} MQTTMessage;
+
+typedef struct MessageData {
+    MQTTMessage *message;
+    MQTTString *topicName;
+} MessageData;
+
+typedef void (*messageHandler)(MessageData *);
+
+typedef struct MQTTClient {
+    const char *topicFilter;
+    messageHandler fp;
+    /* called for every publish, plays the broker and the CSE behind it */
+    void (*on_publish)(struct MQTTClient *c, const char *topic, MQTTMessage *message);
+    int queued;
+    char topic[8][80];
+    char payload[8][512];
+    size_t payloadlen[8];
+} MQTTClient;
+
+int MQTTPublish(MQTTClient *c, const char *topicName, MQTTMessage *message);
+int MQTTSubscribe(MQTTClient *c, const char *topicFilter, enum QoS qos, messageHandler messageHandler);
+int MQTTYield(MQTTClient *c, int timeout_ms);
+
+/* queue a message for delivery by the next MQTTYield */
+int test_mqtt_deliver(MQTTClient *c, const char *topic, const char *payload, size_t len);
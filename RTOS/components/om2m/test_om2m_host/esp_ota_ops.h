@@ -0,0 +1,40 @@
+/*
+ * Host stand-in for the OTA API of app_update, the update partition is a
+ * buffer that only takes whole sectors like esp_ota_write() does: what is
+ * left in the sector buffer is lost when the download stops
+ *
+ * A packed image stands for one that decodes to what follows its header,
+ * so the image on flash is esp_ota_pack_header_t bytes behind the download.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+
+#define SPI_FLASH_SEC_SIZE      4096
+#define OTA_SIZE_UNKNOWN        0xffffffff
+
+#define ESP_ERR_OTA_BASE                0x1500
+#define ESP_ERR_OTA_VALIDATE_FAILED     (ESP_ERR_OTA_BASE + 0x03)
+
+typedef uint32_t esp_ota_handle_t;
+
+typedef struct {
+    uint32_t address;
+    uint32_t size;
+} esp_partition_t;
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from);
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *out_handle);
+esp_err_t esp_ota_begin_at(const esp_partition_t *partition, size_t offset, esp_ota_handle_t *out_handle);
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size);
+esp_err_t esp_ota_end(esp_ota_handle_t handle);
+
+/* test hooks */
+extern size_t ota_host_written;     // bytes taken by esp_ota_write, the header of a packed image too
+extern size_t ota_host_fail_at;     // esp_ota_write fails from there on like after a reset, 0 for never
+extern int ota_host_resumes;        // esp_ota_begin_at calls that succeeded
+void ota_host_reset(void);
+const uint8_t *ota_host_data(void);
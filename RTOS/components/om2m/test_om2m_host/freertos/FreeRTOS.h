@@ -0,0 +1,15 @@
+/*
+ * Host stand-in for the FreeRTOS kernel, only what the om2m component uses
+ */
+#pragma once
+
+#include <stdint.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+
+#define pdTRUE          1
+#define pdFALSE         0
+#define pdPASS          pdTRUE
+#define portMAX_DELAY   ((TickType_t)0xffffffffUL)
+#define portTICK_RATE_MS    1
@@ -0,0 +1,36 @@
+/*
+ * Host stand-in for FreeRTOS mutexes on top of pthreads
+ */
+#pragma once
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "freertos/FreeRTOS.h"
+
+typedef pthread_mutex_t *SemaphoreHandle_t;
+
+static inline SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    SemaphoreHandle_t mutex = malloc(sizeof(pthread_mutex_t));
+
+    if (mutex)
+        pthread_mutex_init(mutex, NULL);
+    return mutex;
+}
+
+static inline void vSemaphoreDelete(SemaphoreHandle_t mutex)
+{
+    pthread_mutex_destroy(mutex);
+    free(mutex);
+}
+
+static inline BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t ticks)
+{
+    return pthread_mutex_lock(mutex) == 0 ? pdTRUE : pdFALSE;
+}
+
+static inline BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex)
+{
+    return pthread_mutex_unlock(mutex) == 0 ? pdTRUE : pdFALSE;
+}
@@ -0,0 +1,59 @@
+/*
+ * Host stand-in for FreeRTOS tasks on top of pthreads
+ */
+#pragma once
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "freertos/FreeRTOS.h"
+
+typedef void (*TaskFunction_t)(void *);
+typedef void *TaskHandle_t;
+
+#define tskIDLE_PRIORITY    0
+
+typedef struct {
+    TaskFunction_t task;
+    void *arg;
+} host_task_t;
+
+static inline void *host_task_start(void *arg)
+{
+    host_task_t start = *(host_task_t *)arg;
+
+    free(arg);
+    start.task(start.arg);
+    return NULL;
+}
+
+static inline BaseType_t xTaskCreate(TaskFunction_t task, const char *name, uint32_t stack_depth, void *arg,
+                                     unsigned int priority, TaskHandle_t *handle)
+{
+    host_task_t *start = malloc(sizeof(*start));
+    pthread_t thread;
+
+    if (!start)
+        return pdFALSE;
+
+    start->task = task;
+    start->arg = arg;
+    if (pthread_create(&thread, NULL, host_task_start, start)) {
+        free(start);
+        return pdFALSE;
+    }
+    pthread_detach(thread);
+    return pdPASS;
+}
+
+/* only ever called by a task on itself */
+static inline void vTaskDelete(TaskHandle_t task)
+{
+    pthread_exit(NULL);
+}
+
+static inline void vTaskDelay(TickType_t ticks)
+{
+    usleep(ticks * 1000);
+}
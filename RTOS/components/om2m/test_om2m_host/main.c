@@ -0,0 +1,120 @@
+#include <signal.h>
+
+#include "unity.h"
+
+void test_coap_notify_shared(void);
+void test_coap_notify_shared_type(void);
+void test_coap_notify_benchmark(void);
+void test_coap_ota_download(void);
+void test_coap_ota_server_limits(void);
+void test_coap_ota_resume(void);
+void test_coap_ota_resume_changed(void);
+void test_coap_ota_resume_packed(void);
+void test_coap_ota_loss(void);
+void test_coap_ota_benchmark(void);
+void test_http_parser_content_length(void);
+void test_http_parser_chunked(void);
+void test_http_parser_pipelined(void);
+void test_http_parser_malformed(void);
+void test_http_client_loopback(void);
+void test_http_client_benchmark(void);
+void test_http_request_parse(void);
+void test_http_request_parse_malformed(void);
+void test_http_request_parse_many_headers(void);
+void test_http_server_loopback(void);
+void test_om2m_serialize(void);
+void test_om2m_serialize_rqp(void);
+void test_om2m_client_correlation(void);
+void test_om2m_client_timeout(void);
+void test_om2m_client_table(void);
+void test_om2m_binding_http(void);
+void test_om2m_binding_http_partial(void);
+void test_om2m_binding_coap(void);
+void test_om2m_coap_legacy_ids(void);
+void test_om2m_binding_mqtt(void);
+void test_om2m_serialize_benchmark(void);
+void test_om2m_discovery_cold(void);
+void test_om2m_discovery_warm_boot(void);
+void test_om2m_discovery_moved(void);
+void test_om2m_discovery_expired(void);
+void test_om2m_discovery_failover(void);
+void test_om2m_discovery_records(void);
+void test_om2m_cbor_serialize(void);
+void test_om2m_cbor_parse_sgn(void);
+void test_om2m_cbor_malformed(void);
+void test_om2m_binding_coap_cbor(void);
+void test_om2m_cbor_format_unsupported(void);
+void test_om2m_cbor_benchmark(void);
+void test_om2m_duty_cycle(void);
+void test_om2m_duty_link(void);
+void test_om2m_duty_fail(void);
+void test_om2m_duty_provision(void);
+void test_om2m_duty_content(void);
+void test_om2m_duty_benchmark(void);
+void test_om2m_latency_histogram(void);
+void test_om2m_latency_client(void);
+void test_om2m_latency_coap(void);
+void test_om2m_latency_benchmark(void);
+
+int main(void) {
+  // lwIP has no signals, a write to a dead socket only returns an error
+  signal(SIGPIPE, SIG_IGN);
+
+  UNITY_BEGIN();
+
+  RUN_TEST(test_http_parser_content_length);
+  RUN_TEST(test_http_parser_chunked);
+  RUN_TEST(test_http_parser_pipelined);
+  RUN_TEST(test_http_parser_malformed);
+  RUN_TEST(test_http_client_loopback);
+  RUN_TEST(test_http_client_benchmark);
+  RUN_TEST(test_http_request_parse);
+  RUN_TEST(test_http_request_parse_malformed);
+  RUN_TEST(test_http_request_parse_many_headers);
+  RUN_TEST(test_http_server_loopback);
+  RUN_TEST(test_om2m_serialize);
+  RUN_TEST(test_om2m_serialize_rqp);
+  RUN_TEST(test_om2m_client_correlation);
+  RUN_TEST(test_om2m_client_timeout);
+  RUN_TEST(test_om2m_client_table);
+  RUN_TEST(test_om2m_binding_http);
+  RUN_TEST(test_om2m_binding_http_partial);
+  RUN_TEST(test_om2m_binding_coap);
+  RUN_TEST(test_om2m_coap_legacy_ids);
+  RUN_TEST(test_om2m_binding_mqtt);
+  RUN_TEST(test_om2m_serialize_benchmark);
+  RUN_TEST(test_coap_notify_shared);
+  RUN_TEST(test_coap_notify_shared_type);
+  RUN_TEST(test_coap_notify_benchmark);
+  RUN_TEST(test_coap_ota_download);
+  RUN_TEST(test_coap_ota_server_limits);
+  RUN_TEST(test_coap_ota_resume);
+  RUN_TEST(test_coap_ota_resume_changed);
+  RUN_TEST(test_coap_ota_resume_packed);
+  RUN_TEST(test_coap_ota_loss);
+  RUN_TEST(test_coap_ota_benchmark);
+  RUN_TEST(test_om2m_discovery_cold);
+  RUN_TEST(test_om2m_discovery_warm_boot);
+  RUN_TEST(test_om2m_discovery_moved);
+  RUN_TEST(test_om2m_discovery_expired);
+  RUN_TEST(test_om2m_discovery_failover);
+  RUN_TEST(test_om2m_discovery_records);
+  RUN_TEST(test_om2m_cbor_serialize);
+  RUN_TEST(test_om2m_cbor_parse_sgn);
+  RUN_TEST(test_om2m_cbor_malformed);
+  RUN_TEST(test_om2m_binding_coap_cbor);
+  RUN_TEST(test_om2m_cbor_format_unsupported);
+  RUN_TEST(test_om2m_cbor_benchmark);
+  RUN_TEST(test_om2m_duty_cycle);
+  RUN_TEST(test_om2m_duty_link);
+  RUN_TEST(test_om2m_duty_fail);
+  RUN_TEST(test_om2m_duty_provision);
+  RUN_TEST(test_om2m_duty_content);
+  RUN_TEST(test_om2m_duty_benchmark);
+  RUN_TEST(test_om2m_latency_histogram);
+  RUN_TEST(test_om2m_latency_client);
+  RUN_TEST(test_om2m_latency_coap);
+  RUN_TEST(test_om2m_latency_benchmark);
+
+  return UNITY_END();
+}
@@ -0,0 +1,52 @@
+/*
+ * Host stand-in for the mdns component, the queries are answered by the tests
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "tcpip_adapter.h"
+
+#define IPADDR_TYPE_V4  0U
+#define IPADDR_TYPE_V6  6U
+
+typedef struct {
+    uint32_t addr[4];
+} ip6_addr_t;
+
+typedef struct {
+    union {
+        ip6_addr_t ip6;
+        ip4_addr_t ip4;
+    } u_addr;
+    uint8_t type;
+} ip_addr_t;
+
+typedef struct {
+    char * key;
+    char * value;
+} mdns_txt_item_t;
+
+typedef struct mdns_ip_addr_s {
+    ip_addr_t addr;
+    struct mdns_ip_addr_s * next;
+} mdns_ip_addr_t;
+
+typedef struct mdns_result_s {
+    struct mdns_result_s * next;
+
+    char * instance_name;
+    char * hostname;
+    uint16_t port;
+    mdns_txt_item_t * txt;
+    size_t txt_count;
+    mdns_ip_addr_t * addr;
+
+    uint32_t ttl;
+} mdns_result_t;
+
+esp_err_t mdns_query_ptr(const char * service_type, const char * proto, uint32_t timeout, size_t max_results, mdns_result_t ** results);
+esp_err_t mdns_query_a(const char * host_name, uint32_t timeout, ip4_addr_t * addr);
+void mdns_query_results_free(mdns_result_t * results);
@@ -0,0 +1,81 @@
+#include <string.h>
+
+#include "nvs.h"
+
+#define NVS_HOST_ENTRIES    4
+#define NVS_HOST_BLOB_MAX   256
+
+int nvs_host_writes;
+
+typedef struct {
+  char key[16];
+  unsigned char blob[NVS_HOST_BLOB_MAX];
+  size_t len;
+} nvs_host_entry_t;
+
+static nvs_host_entry_t s_entries[NVS_HOST_ENTRIES];
+
+void nvs_host_erase(void) {
+  memset(s_entries, 0, sizeof(s_entries));
+  nvs_host_writes = 0;
+}
+
+static nvs_host_entry_t *nvs_host_find(const char *key) {
+  int i;
+
+  for(i = 0; i < NVS_HOST_ENTRIES; i++) {
+    if(s_entries[i].len && !strcmp(s_entries[i].key, key))
+      return &s_entries[i];
+  }
+
+  return NULL;
+}
+
+esp_err_t nvs_open(const char *name, nvs_open_mode open_mode, nvs_handle *out_handle) {
+  *out_handle = 1;
+  return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle handle, const char *key, const void *value, size_t length) {
+  nvs_host_entry_t *entry = nvs_host_find(key);
+  int i;
+
+  if(length > NVS_HOST_BLOB_MAX || !length)
+    return ESP_ERR_NVS_INVALID_LENGTH;
+
+  for(i = 0; !entry && i < NVS_HOST_ENTRIES; i++) {
+    if(!s_entries[i].len)
+      entry = &s_entries[i];
+  }
+  if(!entry)
+    return ESP_FAIL;
+
+  strncpy(entry->key, key, sizeof(entry->key) - 1);
+  memcpy(entry->blob, value, length);
+  entry->len = length;
+  nvs_host_writes++;
+
+  return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle handle, const char *key, void *out_value, size_t *length) {
+  nvs_host_entry_t *entry = nvs_host_find(key);
+
+  if(!entry)
+    return ESP_ERR_NVS_NOT_FOUND;
+
+  if(*length < entry->len)
+    return ESP_ERR_NVS_INVALID_LENGTH;
+
+  memcpy(out_value, entry->blob, entry->len);
+  *length = entry->len;
+
+  return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle handle) {
+  return ESP_OK;
+}
+
+void nvs_close(nvs_handle handle) {
+}
@@ -0,0 +1,9 @@
+/*
+ * Force-included when building the om2m component on Linux,
+ * supplies what lwIP's sockets.h provides on the target.
+ */
+#pragma once
+
+#include <sys/uio.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
@@ -0,0 +1,121 @@
+#include <string.h>
+
+#include "esp_ota_ops.h"
+#include "esp_ota_pack.h"
+
+#define OTA_HOST_SIZE   (256 * 1024)
+
+size_t ota_host_written;
+size_t ota_host_fail_at;
+int ota_host_resumes;
+
+static const esp_partition_t s_partition = { 0x110000, OTA_HOST_SIZE };
+static uint8_t s_flash[OTA_HOST_SIZE];
+static uint8_t s_sector[SPI_FLASH_SEC_SIZE];
+static size_t s_wrote;
+static size_t s_header_left;    // of a packed image, dropped instead of decoded
+static int s_start;             // nothing taken since esp_ota_begin
+static int s_open;
+
+void ota_host_reset(void) {
+  memset(s_flash, 0xff, sizeof(s_flash));
+  ota_host_written = 0;
+  ota_host_fail_at = 0;
+  ota_host_resumes = 0;
+  s_open = 0;
+}
+
+const uint8_t *ota_host_data(void) {
+  return s_flash;
+}
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from) {
+  return &s_partition;
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *out_handle) {
+  if(image_size != OTA_SIZE_UNKNOWN && image_size > partition->size)
+    return ESP_ERR_INVALID_SIZE;
+
+  s_wrote = 0;
+  s_header_left = 0;
+  s_start = 1;
+  s_open = 1;
+  *out_handle = 1;
+  return ESP_OK;
+}
+
+esp_err_t esp_ota_begin_at(const esp_partition_t *partition, size_t offset, esp_ota_handle_t *out_handle) {
+  if(!offset || offset % SPI_FLASH_SEC_SIZE)
+    return ESP_ERR_INVALID_ARG;
+  if(offset >= partition->size)
+    return ESP_ERR_INVALID_SIZE;
+  if(s_flash[0] != 0xE9)
+    return ESP_ERR_OTA_VALIDATE_FAILED;
+
+  s_wrote = offset;
+  s_header_left = 0;
+  s_start = 0;
+  s_open = 1;
+  ota_host_resumes++;
+  *out_handle = 1;
+  return ESP_OK;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size) {
+  const uint8_t *bytes = data;
+  size_t len;
+
+  if(!s_open)
+    return ESP_ERR_INVALID_ARG;
+  if(s_start && size >= 4 && !memcmp(bytes, "OTPK", 4))
+    s_header_left = sizeof(esp_ota_pack_header_t);
+  s_start = 0;
+
+  while(size) {
+    if(ota_host_fail_at && ota_host_written == ota_host_fail_at) {
+      s_open = 0;
+      return ESP_FAIL;
+    }
+    if(s_header_left) {
+      len = s_header_left < size ? s_header_left : size;
+      if(ota_host_fail_at && len > ota_host_fail_at - ota_host_written)
+        len = ota_host_fail_at - ota_host_written;
+      s_header_left -= len;
+      ota_host_written += len;
+      bytes += len;
+      size -= len;
+      continue;
+    }
+    if(!s_wrote && bytes[0] != 0xE9)
+      return ESP_ERR_OTA_VALIDATE_FAILED;
+    if(s_wrote == OTA_HOST_SIZE)
+      return ESP_ERR_INVALID_SIZE;
+
+    len = SPI_FLASH_SEC_SIZE - s_wrote % SPI_FLASH_SEC_SIZE;
+    if(len > size)
+      len = size;
+    if(ota_host_fail_at && len > ota_host_fail_at - ota_host_written)
+      len = ota_host_fail_at - ota_host_written;
+
+    memcpy(s_sector + s_wrote % SPI_FLASH_SEC_SIZE, bytes, len);
+    s_wrote += len;
+    ota_host_written += len;
+    bytes += len;
+    size -= len;
+
+    if(s_wrote % SPI_FLASH_SEC_SIZE == 0)
+      memcpy(s_flash + s_wrote - SPI_FLASH_SEC_SIZE, s_sector, SPI_FLASH_SEC_SIZE);
+  }
+
+  return ESP_OK;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle) {
+  if(!s_open)
+    return ESP_ERR_OTA_VALIDATE_FAILED;
+
+  memcpy(s_flash + s_wrote - s_wrote % SPI_FLASH_SEC_SIZE, s_sector, s_wrote % SPI_FLASH_SEC_SIZE);
+  s_open = 0;
+  return ESP_OK;
+}
@@ -0,0 +1,42 @@
+/*
+ * Host stand-in for the tcpip_adapter component
+ */
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#define IP2STR(ipaddr) ip4_addr1_16(ipaddr), \
+    ip4_addr2_16(ipaddr), \
+    ip4_addr3_16(ipaddr), \
+    ip4_addr4_16(ipaddr)
+
+#define IPSTR "%d.%d.%d.%d"
+
+#define ip4_addr1_16(ipaddr) ((uint16_t)(((uint8_t *)&(ipaddr)->addr)[0]))
+#define ip4_addr2_16(ipaddr) ((uint16_t)(((uint8_t *)&(ipaddr)->addr)[1]))
+#define ip4_addr3_16(ipaddr) ((uint16_t)(((uint8_t *)&(ipaddr)->addr)[2]))
+#define ip4_addr4_16(ipaddr) ((uint16_t)(((uint8_t *)&(ipaddr)->addr)[3]))
+
+typedef struct {
+    uint32_t addr;
+} ip4_addr_t;
+
+typedef struct {
+    ip4_addr_t ip;
+    ip4_addr_t netmask;
+    ip4_addr_t gw;
+} tcpip_adapter_ip_info_t;
+
+typedef enum {
+    TCPIP_ADAPTER_IF_STA = 0,
+    TCPIP_ADAPTER_IF_AP,
+    TCPIP_ADAPTER_IF_MAX
+} tcpip_adapter_if_t;
+
+static inline int tcpip_adapter_get_ip_info(tcpip_adapter_if_t tcpip_if, tcpip_adapter_ip_info_t *ip_info)
+{
+    memset(ip_info, 0, sizeof(*ip_info));
+    ip_info->ip.addr = 0x0100007f;  /* 127.0.0.1 */
+    return 0;
+}
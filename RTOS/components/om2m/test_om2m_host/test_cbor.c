@@ -0,0 +1,414 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "unity.h"
+#include "cJSON.h"
+#include "om2m/om2m.h"
+#include "om2m/cbor.h"
+#include "om2m/coap.h"
+
+#define TEST_CSE		"/in-cse/dartes"
+#define TEST_ORIGINATOR		"admin:admin"
+#define TEST_CBOR_COUNT		100000
+#define TEST_SAMPLE		"{\"hr\":72,\"spo2\":98}"
+
+/*
+ * Notification as sent by a streaming encoder: maps of indefinite length,
+ * attributes the client does not know about (ty, lt with a half float and
+ * null, st) and the keys in another order
+ */
+static const char s_sgn_streamed[] =
+  "\xbf\x67\x6d\x32\x6d\x3a\x73\x67\x6e\xbf\x63\x6e\x65\x76\xbf\x63"
+  "\x72\x65\x70\xbf\x67\x6d\x32\x6d\x3a\x63\x69\x6e\xbf\x62\x72\x6e"
+  "\x65\x63\x69\x6e\x5f\x31\x62\x74\x79\x04\x62\x6c\x74\x83\x01\xf9"
+  "\x41\x00\xf6\x63\x63\x6f\x6e\x62\x37\x32\x62\x73\x74\x00\xff\xff"
+  "\x63\x6e\x65\x74\x03\xff\x63\x73\x75\x72\x6d\x2f\x69\x6e\x2d\x63"
+  "\x73\x65\x2f\x73\x75\x62\x2d\x31\x63\x76\x72\x71\xf4\xff\xff";
+
+static uint64_t test_time_us(void) {
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+static void test_assert_str(const char *expected, const om2m_cbor_str_t *str) {
+  TEST_ASSERT_NOT_NULL(str->p);
+  TEST_ASSERT_EQUAL(strlen(expected), str->len);
+  TEST_ASSERT_EQUAL_MEMORY(expected, str->p, str->len);
+}
+
+void test_om2m_cbor_serialize(void) {
+  char buf[OM2M_PC_MAX];
+  om2m_cbor_resource_t resource;
+  int len;
+
+  // {"m2m:cnt":{"rn":"DATA"}}
+  TEST_ASSERT_EQUAL(18, om2m_cbor_cnt(buf, sizeof(buf), "DATA"));
+  TEST_ASSERT_EQUAL_MEMORY("\xa1\x67m2m:cnt\xa1\x62rn\x64" "DATA", buf, 18);
+  TEST_ASSERT_EQUAL(0, om2m_cbor_parse(buf, 18, &resource));
+  TEST_ASSERT_EQUAL(OM2M_TY_CNT, resource.ty);
+  test_assert_str("DATA", &resource.rn);
+
+  len = om2m_cbor_ae(buf, sizeof(buf), "MAX30100", 1234, "coap://127.0.0.1:5683");
+  TEST_ASSERT_TRUE(len > 0);
+  TEST_ASSERT_EQUAL(0, om2m_cbor_parse(buf, len, &resource));
+  TEST_ASSERT_EQUAL(OM2M_TY_AE, resource.ty);
+  TEST_ASSERT_TRUE(resource.rr);
+  TEST_ASSERT_EQUAL(1234, resource.api);
+  test_assert_str("MAX30100", &resource.rn);
+  test_assert_str("coap://127.0.0.1:5683", &resource.poa);
+
+  len = om2m_cbor_sub(buf, sizeof(buf), "SUB", "/in-cse/dartes/MONITOR");
+  TEST_ASSERT_TRUE(len > 0);
+  TEST_ASSERT_EQUAL(0, om2m_cbor_parse(buf, len, &resource));
+  TEST_ASSERT_EQUAL(OM2M_TY_SUB, resource.ty);
+  TEST_ASSERT_EQUAL(2, resource.nct);
+  test_assert_str("SUB", &resource.rn);
+  test_assert_str("/in-cse/dartes/MONITOR", &resource.nu);
+
+  // text needs no escaping, control characters and quotes go through as they are
+  len = om2m_cbor_cin(buf, sizeof(buf), "cin_1", "say \"hi\"\\\n\x01");
+  TEST_ASSERT_TRUE(len > 0);
+  TEST_ASSERT_EQUAL(0, om2m_cbor_parse(buf, len, &resource));
+  TEST_ASSERT_EQUAL(OM2M_TY_CIN, resource.ty);
+  test_assert_str("say \"hi\"\\\n\x01", &resource.con);
+  test_assert_str("text/plain:11", &resource.cnf);
+  TEST_ASSERT_NULL(resource.poa.p);
+
+  // exactly full is fine, one byte short is not
+  TEST_ASSERT_EQUAL(18, om2m_cbor_cnt(buf, 18, "DATA"));
+  TEST_ASSERT_EQUAL(-1, om2m_cbor_cnt(buf, 17, "DATA"));
+
+  // lengths past 23 take an extra byte
+  memset(buf, 'x', 100);
+  buf[100] = '\0';
+  TEST_ASSERT_EQUAL(0, om2m_cbor_parse(buf + 104, om2m_cbor_cnt(buf + 104, sizeof(buf) - 104, buf), &resource));
+  TEST_ASSERT_EQUAL(100, resource.rn.len);
+}
+
+void test_om2m_cbor_parse_sgn(void) {
+  char buf[OM2M_PC_MAX];
+  om2m_cbor_sgn_t sgn;
+  int len;
+
+  len = om2m_cbor_sgn(buf, sizeof(buf), "/in-cse/sub-1", 3, "cin_1", TEST_SAMPLE);
+  TEST_ASSERT_TRUE(len > 0);
+  TEST_ASSERT_EQUAL(0, om2m_cbor_parse_sgn(buf, len, &sgn));
+  TEST_ASSERT_FALSE(sgn.vrq);
+  TEST_ASSERT_EQUAL(3, sgn.net);
+  test_assert_str("/in-cse/sub-1", &sgn.sur);
+  TEST_ASSERT_EQUAL(OM2M_TY_CIN, sgn.rep.ty);
+  test_assert_str("cin_1", &sgn.rep.rn);
+  test_assert_str(TEST_SAMPLE, &sgn.rep.con);
+
+  len = om2m_cbor_sgn(buf, sizeof(buf), "/in-cse/sub-1", 0, NULL, NULL);
+  TEST_ASSERT_TRUE(len > 0);
+  TEST_ASSERT_EQUAL(0, om2m_cbor_parse_sgn(buf, len, &sgn));
+  TEST_ASSERT_TRUE(sgn.vrq);
+  TEST_ASSERT_EQUAL(OM2M_TY_NONE, sgn.rep.ty);
+  TEST_ASSERT_NULL(sgn.rep.con.p);
+
+  TEST_ASSERT_EQUAL(0, om2m_cbor_parse_sgn(s_sgn_streamed, sizeof(s_sgn_streamed) - 1, &sgn));
+  TEST_ASSERT_FALSE(sgn.vrq);
+  TEST_ASSERT_EQUAL(3, sgn.net);
+  test_assert_str("/in-cse/sub-1", &sgn.sur);
+  TEST_ASSERT_EQUAL(OM2M_TY_CIN, sgn.rep.ty);
+  test_assert_str("cin_1", &sgn.rep.rn);
+  test_assert_str("72", &sgn.rep.con);
+
+  // a resource is not a notification
+  len = om2m_cbor_cnt(buf, sizeof(buf), "DATA");
+  TEST_ASSERT_EQUAL(-1, om2m_cbor_parse_sgn(buf, len, &sgn));
+}
+
+void test_om2m_cbor_malformed(void) {
+  char buf[OM2M_PC_MAX];
+  om2m_cbor_resource_t resource;
+  om2m_cbor_sgn_t sgn;
+  size_t i;
+  int len;
+
+  // every truncation is rejected, without reading past the end
+  len = om2m_cbor_ae(buf, sizeof(buf), "MAX30100", 1234, "coap://127.0.0.1:5683");
+  for(i = 0; i < (size_t)len; i++)
+    TEST_ASSERT_EQUAL(-1, om2m_cbor_parse(buf, i, &resource));
+  for(i = 0; i < sizeof(s_sgn_streamed) - 1; i++)
+    TEST_ASSERT_EQUAL(-1, om2m_cbor_parse_sgn(s_sgn_streamed, i, &sgn));
+
+  // trailing bytes
+  len = om2m_cbor_cnt(buf, sizeof(buf), "DATA");
+  buf[len] = 0;
+  TEST_ASSERT_EQUAL(-1, om2m_cbor_parse(buf, len + 1, &resource));
+
+  // wrong types: rn as a number, a tagged map, a stray break
+  TEST_ASSERT_EQUAL(-1, om2m_cbor_parse("\xa1\x67m2m:cnt\xa1\x62rn\x01", 14, &resource));
+  TEST_ASSERT_EQUAL(-1, om2m_cbor_parse("\xc0\xa0", 2, &resource));
+  TEST_ASSERT_EQUAL(-1, om2m_cbor_parse("\xa1\x67m2m:cnt\xff", 10, &resource));
+
+  // lengths far past the buffer
+  TEST_ASSERT_EQUAL(-1, om2m_cbor_parse("\xa1\x67m2m:cnt\xa1\x62rn\x7b\xff\xff\xff\xff\xff\xff\xff\xff", 22, &resource));
+  TEST_ASSERT_EQUAL(-1, om2m_cbor_parse("\xbb\xff\xff\xff\xff\xff\xff\xff\xff", 9, &resource));
+
+  // nesting is bounded in the attributes that are skipped
+  memcpy(buf, "\xa1\x67m2m:cnt\xa1\x62xx", 13);
+  len = 13;
+  for(i = 0; i < 2 * OM2M_CBOR_DEPTH_MAX; i++)
+    buf[len++] = '\x81';
+  buf[len++] = '\x00';
+  TEST_ASSERT_EQUAL(-1, om2m_cbor_parse(buf, len, &resource));
+}
+
+/*
+ * CSE answering a CBOR request in CBOR, with the resource it created
+ */
+static void test_cbor_cse_serve(int fd) {
+  unsigned char buf[COAP_MAX_PDU_SIZE], opt_buf[2];
+  struct sockaddr_in from;
+  socklen_t from_len = sizeof(from);
+  coap_opt_iterator_t opt_iter;
+  coap_opt_t *opt;
+  coap_pdu_t *request, *response;
+  om2m_cbor_resource_t resource;
+  char pc[OM2M_PC_MAX];
+  unsigned char *data;
+  size_t data_len;
+  int len;
+
+  len = recvfrom(fd, buf, sizeof(buf), 0, (struct sockaddr *)&from, &from_len);
+  TEST_ASSERT_TRUE(len > 0);
+
+  request = coap_pdu_init(0, 0, 0, COAP_MAX_PDU_SIZE);
+  TEST_ASSERT_TRUE(coap_pdu_parse(buf, len, request));
+  TEST_ASSERT_NOT_NULL(opt = coap_check_option(request, COAP_OPTION_CONTENT_FORMAT, &opt_iter));
+  TEST_ASSERT_EQUAL(COAP_MEDIATYPE_APPLICATION_CBOR, coap_decode_var_bytes(coap_opt_value(opt), coap_opt_length(opt)));
+  TEST_ASSERT_NOT_NULL(opt = coap_check_option(request, COAP_OPTION_ACCEPT, &opt_iter));
+  TEST_ASSERT_EQUAL(COAP_MEDIATYPE_APPLICATION_CBOR, coap_decode_var_bytes(coap_opt_value(opt), coap_opt_length(opt)));
+  TEST_ASSERT_TRUE(coap_get_data(request, &data_len, &data));
+  TEST_ASSERT_EQUAL(0, om2m_cbor_parse((const char *)data, data_len, &resource));
+  TEST_ASSERT_EQUAL(OM2M_TY_CIN, resource.ty);
+  test_assert_str(TEST_SAMPLE, &resource.con);
+
+  response = coap_pdu_init(COAP_MESSAGE_NON, COAP_RESPONSE_CODE(201), request->hdr->id, COAP_MAX_PDU_SIZE);
+  coap_add_token(response, request->hdr->token_length, request->hdr->token);
+  coap_add_option(response, COAP_OPTION_CONTENT_FORMAT, coap_encode_var_bytes(opt_buf, COAP_MEDIATYPE_APPLICATION_CBOR), opt_buf);
+  coap_add_option(response, ONEM2M_OPTION_RSC, coap_encode_var_bytes(opt_buf, 2001), opt_buf);
+  len = om2m_cbor_cin(pc, sizeof(pc), "cin_1", TEST_SAMPLE);
+  coap_add_data(response, len, (unsigned char *)pc);
+
+  TEST_ASSERT_EQUAL(response->length, sendto(fd, response->hdr, response->length, 0, (struct sockaddr *)&from, from_len));
+
+  coap_delete_pdu(request);
+  coap_delete_pdu(response);
+}
+
+typedef struct {
+  int calls;
+  int rsc;
+  om2m_format_t format;
+  char rn[16];
+} test_cbor_result_t;
+
+static void test_cbor_response_cb(void *arg, const om2m_response_t *response) {
+  test_cbor_result_t *result = arg;
+  om2m_cbor_resource_t resource;
+
+  result->calls++;
+  result->rsc = response->rsc;
+  result->format = response->format;
+  if(response->format == OM2M_FORMAT_CBOR && om2m_cbor_parse(response->pc, response->pc_len, &resource) == 0 && resource.rn.len < sizeof(result->rn))
+    memcpy(result->rn, resource.rn.p, resource.rn.len);
+}
+
+static int test_cbor_cse_listen(int *port) {
+  struct sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  TEST_ASSERT_EQUAL(0, bind(fd, (struct sockaddr *)&addr, sizeof(addr)));
+  getsockname(fd, (struct sockaddr *)&addr, &len);
+  *port = ntohs(addr.sin_port);
+
+  return fd;
+}
+
+static coap_context_t *test_cbor_client(om2m_coap_binding_t *binding, om2m_client_t *client, int port) {
+  coap_address_t local, dst;
+  coap_context_t *ctx;
+
+  coap_address_init(&local);
+  local.addr.sin.sin_family = AF_INET;
+  local.addr.sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  TEST_ASSERT_NOT_NULL(ctx = coap_new_context(&local));
+
+  coap_address_init(&dst);
+  dst.addr.sin.sin_family = AF_INET;
+  dst.addr.sin.sin_port = htons(port);
+  dst.addr.sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  om2m_coap_binding_init(binding, ctx, &dst, COAP_MESSAGE_NON);
+  TEST_ASSERT_EQUAL(0, om2m_client_init(client, &om2m_coap_binding, binding, TEST_CSE, TEST_ORIGINATOR));
+
+  return ctx;
+}
+
+void test_om2m_binding_coap_cbor(void) {
+  om2m_coap_binding_t binding;
+  om2m_client_t client;
+  test_cbor_result_t result;
+  coap_context_t *ctx;
+  int fd, port;
+
+  memset(&result, 0, sizeof(result));
+  fd = test_cbor_cse_listen(&port);
+  ctx = test_cbor_client(&binding, &client, port);
+
+  TEST_ASSERT_EQUAL(0, om2m_client_format(&client, OM2M_FORMAT_CBOR));
+  TEST_ASSERT_EQUAL(0, om2m_create_content_instance(&client, "ae", "DATA", "cin_1", TEST_SAMPLE, test_cbor_response_cb, &result));
+  test_cbor_cse_serve(fd);
+
+  while(om2m_client_pending(&client))
+    TEST_ASSERT_TRUE(om2m_client_poll(&client, 1000) > 0);
+
+  TEST_ASSERT_EQUAL(1, result.calls);
+  TEST_ASSERT_EQUAL(2001, result.rsc);
+  TEST_ASSERT_EQUAL(OM2M_FORMAT_CBOR, result.format);
+  TEST_ASSERT_EQUAL_STRING("cin_1", result.rn);
+
+  om2m_client_close(&client);
+  coap_free_context(ctx);
+  close(fd);
+}
+
+void test_om2m_cbor_format_unsupported(void) {
+  static const om2m_binding_t json_only = { .name = "json" };
+  om2m_client_t client;
+
+  TEST_ASSERT_EQUAL(0, om2m_client_init(&client, &json_only, NULL, TEST_CSE, TEST_ORIGINATOR));
+  TEST_ASSERT_EQUAL(-1, om2m_client_format(&client, OM2M_FORMAT_CBOR));
+  TEST_ASSERT_EQUAL(OM2M_FORMAT_JSON, client.format);
+  om2m_client_close(&client);
+}
+
+/*
+ * CoAP message carrying the request, as it goes on the air
+ * */
+static int test_cbor_on_air(om2m_client_t *client, int fd, om2m_format_t format, om2m_ty_t ty) {
+  unsigned char buf[COAP_MAX_PDU_SIZE];
+
+  TEST_ASSERT_EQUAL(0, om2m_client_format(client, format));
+  switch(ty) {
+    case OM2M_TY_AE:
+      TEST_ASSERT_EQUAL(0, om2m_create_ae(client, "MAX30100", 1234, "coap://192.168.137.20:5683", NULL, NULL));
+      break;
+    case OM2M_TY_CNT:
+      TEST_ASSERT_EQUAL(0, om2m_create_container(client, "MAX30100", "DATA", NULL, NULL));
+      break;
+    case OM2M_TY_SUB:
+      TEST_ASSERT_EQUAL(0, om2m_create_subscription(client, "MAX30100", "DATA", "MONITOR", "SUB", NULL, NULL));
+      break;
+    default:
+      TEST_ASSERT_EQUAL(0, om2m_create_content_instance(client, "MAX30100", "DATA", "HB_42", TEST_SAMPLE, NULL, NULL));
+      break;
+  }
+
+  return recv(fd, buf, sizeof(buf), 0);
+}
+
+void test_om2m_cbor_benchmark(void) {
+  static const struct {
+    const char *name;
+    om2m_ty_t ty;
+  } types[] = {
+    { "AE", OM2M_TY_AE },
+    { "CNT", OM2M_TY_CNT },
+    { "CIN", OM2M_TY_CIN },
+    { "SUB", OM2M_TY_SUB },
+  };
+  om2m_coap_binding_t binding;
+  om2m_client_t client;
+  coap_context_t *ctx;
+  om2m_cbor_sgn_t sgn;
+  char json[OM2M_PC_MAX], cbor[OM2M_PC_MAX];
+  uint64_t start, json_us, cjson_us, cbor_us;
+  int i, fd, port, json_len, cbor_len, n = 0;
+
+  // bytes on air, the CoAP header and options are the same for both
+  fd = test_cbor_cse_listen(&port);
+  ctx = test_cbor_client(&binding, &client, port);
+  for(i = 0; i < (int)(sizeof(types) / sizeof(types[0])); i++) {
+    json_len = test_cbor_on_air(&client, fd, OM2M_FORMAT_JSON, types[i].ty);
+    cbor_len = test_cbor_on_air(&client, fd, OM2M_FORMAT_CBOR, types[i].ty);
+    TEST_ASSERT_TRUE(cbor_len > 0 && cbor_len < json_len);
+    printf("%s request: JSON %d bytes, CBOR %d bytes on air\n", types[i].name, json_len, cbor_len);
+  }
+  om2m_client_close(&client);
+  coap_free_context(ctx);
+  close(fd);
+
+  // content instance encoding
+  start = test_time_us();
+  for(i = 0; i < TEST_CBOR_COUNT; i++)
+    n += om2m_pc_cin(json, sizeof(json), "HB_42", TEST_SAMPLE);
+  json_us = test_time_us() - start;
+
+  start = test_time_us();
+  for(i = 0; i < TEST_CBOR_COUNT; i++) {
+    cJSON *payload = cJSON_CreateObject(), *cin;
+    char *out;
+
+    cJSON_AddItemToObject(payload, "m2m:cin", cin = cJSON_CreateObject());
+    cJSON_AddStringToObject(cin, "con", TEST_SAMPLE);
+    cJSON_AddStringToObject(cin, "cnf", "text/plain:19");
+    cJSON_AddStringToObject(cin, "rn", "HB_42");
+    out = cJSON_PrintUnformatted(payload);
+    n -= strlen(out);
+    cJSON_Delete(payload);
+    free(out);
+  }
+  cjson_us = test_time_us() - start;
+
+  start = test_time_us();
+  for(i = 0; i < TEST_CBOR_COUNT; i++)
+    cbor_len = om2m_cbor_cin(cbor, sizeof(cbor), "HB_42", TEST_SAMPLE);
+  cbor_us = test_time_us() - start;
+
+  TEST_ASSERT_EQUAL(0, n);
+  printf("content instance encoding: om2m JSON %.1f ns, cJSON %.1f ns, CBOR %.1f ns\n",
+         json_us * 1000.0 / TEST_CBOR_COUNT, cjson_us * 1000.0 / TEST_CBOR_COUNT, cbor_us * 1000.0 / TEST_CBOR_COUNT);
+
+  // notification decoding, what a monitor does for every sample
+  json_len = snprintf(json, sizeof(json), "{\"m2m:sgn\":{\"nev\":{\"rep\":{\"m2m:cin\":{\"con\":\"%s\",\"cnf\":\"text/plain:19\",\"rn\":\"HB_42\"}},\"net\":3},\"sur\":\"/in-cse/sub-1\"}}",
+                      "{\\\"hr\\\":72,\\\"spo2\\\":98}");
+  cbor_len = om2m_cbor_sgn(cbor, sizeof(cbor), "/in-cse/sub-1", 3, "HB_42", TEST_SAMPLE);
+  TEST_ASSERT_TRUE(cbor_len > 0);
+
+  start = test_time_us();
+  for(i = 0; i < TEST_CBOR_COUNT; i++) {
+    cJSON *root = cJSON_Parse(json), *sg, *nev;
+
+    sg = cJSON_GetObjectItem(root, "m2m:sgn");
+    nev = cJSON_GetObjectItem(sg, "nev");
+    TEST_ASSERT_NOT_NULL(cJSON_GetObjectItem(cJSON_GetObjectItem(cJSON_GetObjectItem(nev, "rep"), "m2m:cin"), "con"));
+    TEST_ASSERT_NOT_NULL(cJSON_GetObjectItem(sg, "sur"));
+    cJSON_Delete(root);
+  }
+  cjson_us = test_time_us() - start;
+
+  start = test_time_us();
+  for(i = 0; i < TEST_CBOR_COUNT; i++)
+    TEST_ASSERT_EQUAL(0, om2m_cbor_parse_sgn(cbor, cbor_len, &sgn));
+  cbor_us = test_time_us() - start;
+
+  test_assert_str(TEST_SAMPLE, &sgn.rep.con);
+  printf("notification decoding: cJSON %.1f ns for %d bytes, CBOR %.1f ns for %d bytes\n",
+         cjson_us * 1000.0 / TEST_CBOR_COUNT, json_len, cbor_us * 1000.0 / TEST_CBOR_COUNT, cbor_len);
+}
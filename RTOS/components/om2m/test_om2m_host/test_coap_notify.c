@@ -0,0 +1,235 @@
+#include "coap_config.h"
+#include "coap.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "unity.h"
+#include "cJSON.h"
+
+#define TEST_OBSERVERS_MAX	64
+#define TEST_NOTIFY_ROUNDS	2000
+
+static int s_renders;
+
+/*
+ * GET handler of the observed resource, renders the latest sample the way
+ * the applications do; the representation does not depend on the observer
+ */
+static void test_notify_get(coap_context_t *ctx, struct coap_resource_t *resource, const coap_endpoint_t *local_interface,
+                            coap_address_t *peer, coap_pdu_t *request, str *token, coap_pdu_t *response) {
+  cJSON *sample = cJSON_CreateObject(), *cin;
+  unsigned char buf[3];
+  char *out;
+
+  s_renders++;
+  cJSON_AddItemToObject(sample, "m2m:cin", cin = cJSON_CreateObject());
+  cJSON_AddNumberToObject(cin, "hr", 72);
+  cJSON_AddNumberToObject(cin, "spo2", 98);
+  cJSON_AddNumberToObject(cin, "ts", ctx->observe);
+  out = cJSON_PrintUnformatted(sample);
+
+  response->hdr->code = COAP_RESPONSE_CODE(205);
+  coap_add_option(response, COAP_OPTION_OBSERVE, coap_encode_var_bytes(buf, ctx->observe), buf);
+  coap_add_option(response, COAP_OPTION_CONTENT_FORMAT, coap_encode_var_bytes(buf, COAP_MEDIATYPE_APPLICATION_JSON), buf);
+  coap_add_data(response, strlen(out), (unsigned char *)out);
+
+  free(out);
+  cJSON_Delete(sample);
+}
+
+typedef struct {
+  coap_context_t *ctx;
+  coap_resource_t *resource;
+  coap_subscription_t *observers[TEST_OBSERVERS_MAX];
+  int fd;
+} test_notify_t;
+
+static void test_notify_init(test_notify_t *test, int observers) {
+  struct sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+  coap_address_t local, peer;
+  unsigned char id[4];
+  str token = { sizeof(id), id };
+  int i;
+
+  memset(test, 0, sizeof(*test));
+
+  // every observer subscribes from the same socket with its own token
+  test->fd = socket(AF_INET, SOCK_DGRAM, 0);
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  TEST_ASSERT_EQUAL(0, bind(test->fd, (struct sockaddr *)&addr, sizeof(addr)));
+  getsockname(test->fd, (struct sockaddr *)&addr, &len);
+
+  coap_address_init(&local);
+  local.addr.sin.sin_family = AF_INET;
+  local.addr.sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  TEST_ASSERT_NOT_NULL(test->ctx = coap_new_context(&local));
+
+  test->resource = coap_resource_init((unsigned char *)"hr", 2, 0);
+  coap_register_handler(test->resource, COAP_REQUEST_GET, test_notify_get);
+  test->resource->observable = 1;
+  coap_add_resource(test->ctx, test->resource);
+
+  coap_address_init(&peer);
+  peer.addr.sin = addr;
+  for(i = 0; i < observers; i++) {
+    memcpy(id, &i, sizeof(id));
+    TEST_ASSERT_NOT_NULL(test->observers[i] = coap_add_observer(test->resource, test->ctx->endpoint, &peer, &token));
+  }
+}
+
+static void test_notify_close(test_notify_t *test) {
+  coap_free_context(test->ctx);
+  close(test->fd);
+}
+
+/*
+ * Mark the resource changed and send the notifications,
+ * kept non-confirmable so that nothing piles up in the retransmission queue
+ */
+static void test_notify_round(test_notify_t *test, int observers) {
+  int i;
+
+  for(i = 0; i < observers; i++)
+    test->observers[i]->non_cnt = 0;
+
+  test->resource->dirty = 1;
+  coap_check_notify(test->ctx);
+}
+
+static int test_notify_recv(test_notify_t *test, unsigned char *buf, size_t size) {
+  return recv(test->fd, buf, size, MSG_DONTWAIT);
+}
+
+/*
+ * A shared rendering produces the same notifications as one rendering per
+ * observer, apart from the message id
+ */
+void test_coap_notify_shared(void) {
+  unsigned char expected[TEST_OBSERVERS_MAX][COAP_MAX_PDU_SIZE], buf[COAP_MAX_PDU_SIZE];
+  int expected_len[TEST_OBSERVERS_MAX], mode, i, len, observers = 8;
+  unsigned short ids[TEST_OBSERVERS_MAX];
+
+  for(mode = 0; mode < 2; mode++) {
+    test_notify_t test;
+
+    test_notify_init(&test, observers);
+    if(mode)
+      test.resource->flags |= COAP_RESOURCE_FLAGS_NOTIFY_SHARED;
+
+    s_renders = 0;
+    test_notify_round(&test, observers);
+    TEST_ASSERT_EQUAL(mode ? 1 : observers, s_renders);
+
+    for(i = 0; i < observers; i++) {
+      coap_hdr_t *hdr = (coap_hdr_t *)buf;
+      int observer;
+
+      TEST_ASSERT_TRUE((len = test_notify_recv(&test, buf, sizeof(buf))) > 0);
+      TEST_ASSERT_EQUAL(4, hdr->token_length);
+      TEST_ASSERT_EQUAL(COAP_MESSAGE_NON, hdr->type);
+      memcpy(&observer, hdr->token, sizeof(observer));
+      TEST_ASSERT_TRUE(observer >= 0 && observer < observers);
+
+      if(mode == 0) {
+        memcpy(expected[observer], buf, len);
+        expected_len[observer] = len;
+      }
+      else {
+        TEST_ASSERT_EQUAL(expected_len[observer], len);
+        TEST_ASSERT_EQUAL_MEMORY(expected[observer] + 4, buf + 4, len - 4);
+      }
+
+      // every notification is a message of its own
+      ids[i] = hdr->id;
+      if(i) {
+        TEST_ASSERT_TRUE(ids[i] != ids[i - 1]);
+      }
+    }
+    TEST_ASSERT_TRUE(test_notify_recv(&test, buf, sizeof(buf)) < 0);
+
+    test_notify_close(&test);
+  }
+}
+
+/*
+ * The type of a shared notification is that of each observer: the one
+ * that is due for a confirmable notification gets it, the others not
+ */
+void test_coap_notify_shared_type(void) {
+  unsigned char buf[COAP_MAX_PDU_SIZE];
+  coap_hdr_t *hdr = (coap_hdr_t *)buf;
+  int i, observer, due, con = 0, observers = 8;
+  test_notify_t test;
+
+  test_notify_init(&test, observers);
+  test.resource->flags |= COAP_RESOURCE_FLAGS_NOTIFY_SHARED;
+
+  // the first observer the notifications go to is the one rendered for
+  memcpy(&due, test.resource->subscribers->token, sizeof(due));
+  test.resource->subscribers->non_cnt = COAP_OBS_MAX_NON;
+  test.resource->dirty = 1;
+  coap_check_notify(test.ctx);
+
+  for(i = 0; i < observers; i++) {
+    TEST_ASSERT_TRUE(test_notify_recv(&test, buf, sizeof(buf)) > 0);
+    memcpy(&observer, hdr->token, sizeof(observer));
+    TEST_ASSERT_EQUAL(observer == due ? COAP_MESSAGE_CON : COAP_MESSAGE_NON, hdr->type);
+    con += hdr->type == COAP_MESSAGE_CON;
+  }
+  TEST_ASSERT_EQUAL(1, con);
+
+  test_notify_close(&test);
+}
+
+static uint64_t test_notify_time_us(void) {
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+/*
+ * Cost of one change notified to a growing number of observers
+ */
+void test_coap_notify_benchmark(void) {
+  static const int counts[] = { 1, 4, 16, 64 };
+  unsigned char buf[COAP_MAX_PDU_SIZE];
+  int c, mode, round;
+
+  for(c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+    uint64_t elapsed[2];
+
+    for(mode = 0; mode < 2; mode++) {
+      test_notify_t test;
+      uint64_t start;
+
+      test_notify_init(&test, counts[c]);
+      if(mode)
+        test.resource->flags |= COAP_RESOURCE_FLAGS_NOTIFY_SHARED;
+
+      elapsed[mode] = 0;
+      for(round = 0; round < TEST_NOTIFY_ROUNDS; round++) {
+        start = test_notify_time_us();
+        test_notify_round(&test, counts[c]);
+        elapsed[mode] += test_notify_time_us() - start;
+
+        while(test_notify_recv(&test, buf, sizeof(buf)) > 0)
+          ;
+      }
+
+      test_notify_close(&test);
+    }
+
+    printf("notify %2d observers: per observer %.2f us, shared %.2f us\n", counts[c],
+           elapsed[0] / (double)TEST_NOTIFY_ROUNDS, elapsed[1] / (double)TEST_NOTIFY_ROUNDS);
+  }
+}
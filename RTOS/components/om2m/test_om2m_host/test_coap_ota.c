@@ -0,0 +1,446 @@
+#include "coap_config.h"
+#include "coap.h"
+
+#include <math.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "unity.h"
+#include "nvs.h"
+#include "esp_ota_ops.h"
+#include "esp_ota_pack.h"
+#include "om2m/coap_ota.h"
+
+#define TEST_OTA_PATH		"fw/app.bin"
+#define TEST_OTA_IMAGE_MAX	(128 * 1024)
+#define TEST_OTA_TIMEOUT_MS	10
+#define TEST_OTA_OVERHEAD	46	// UDP, IPv4 and 802.11 headers of a datagram
+
+/*
+ * File server stand-in: serves one image with Block2, ETag and Size2 from
+ * a thread of its own. Datagrams in both directions are lost when one of
+ * their bits is, the way a weak radio link loses them.
+ */
+typedef struct {
+  int fd;
+  int port;
+  pthread_t thread;
+  volatile int stop;
+  const uint8_t *image;
+  size_t len;
+  uint8_t etag[4];
+  int szx_max;			// larger blocks are answered with this size
+  int size2;			// the server tells the size of the image
+  double ber;			// bit error rate
+  unsigned int seed;
+  unsigned int requests;	// that made it to the server
+  unsigned int dropped;		// datagrams lost, either way
+  size_t air_bytes;		// datagram bytes sent either way, lost ones and headers included
+  size_t payload;		// image bytes sent
+} test_ota_server_t;
+
+static uint8_t s_image[TEST_OTA_IMAGE_MAX], s_image_v2[TEST_OTA_IMAGE_MAX], s_packed[sizeof(esp_ota_pack_header_t) + TEST_OTA_IMAGE_MAX];
+
+static int test_ota_lost(test_ota_server_t *server, size_t len) {
+  double p = 1 - pow(1 - server->ber, 8.0 * (len + TEST_OTA_OVERHEAD));
+
+  server->air_bytes += len + TEST_OTA_OVERHEAD;
+  if(rand_r(&server->seed) < p * RAND_MAX) {
+    server->dropped++;
+    return 1;
+  }
+  return 0;
+}
+
+static void test_ota_serve(test_ota_server_t *server, const unsigned char *buf, int len, struct sockaddr_in *from, socklen_t from_len) {
+  coap_pdu_t *request, *response;
+  coap_opt_iterator_t opt_iter;
+  coap_block_t block;
+  unsigned char size[4];
+  int want_size2, szx;
+
+  request = coap_pdu_init(0, 0, 0, COAP_MAX_PDU_SIZE);
+  if(!coap_pdu_parse((unsigned char *)buf, len, request) || request->hdr->code != COAP_REQUEST_GET) {
+    coap_delete_pdu(request);
+    return;
+  }
+  server->requests++;
+
+  if(!coap_get_block(request, COAP_OPTION_BLOCK2, &block)) {
+    block.num = 0;
+    block.szx = 6;
+  }
+  // the block number follows the size the server picks
+  if(block.szx > server->szx_max) {
+    szx = block.szx;
+    block.szx = server->szx_max;
+    block.num <<= szx - block.szx;
+  }
+  want_size2 = coap_check_option(request, 28, &opt_iter) != NULL;
+
+  response = coap_pdu_init(COAP_MESSAGE_NON, COAP_RESPONSE_CODE(205), request->hdr->id, COAP_MAX_PDU_SIZE);
+  coap_add_token(response, request->hdr->token_length, request->hdr->token);
+  coap_add_option(response, COAP_OPTION_ETAG, sizeof(server->etag), server->etag);
+  if(coap_write_block_opt(&block, COAP_OPTION_BLOCK2, response, server->len) < 0) {
+    coap_delete_pdu(response);
+    response = coap_pdu_init(COAP_MESSAGE_NON, COAP_RESPONSE_CODE(402), request->hdr->id, COAP_MAX_PDU_SIZE);
+    coap_add_token(response, request->hdr->token_length, request->hdr->token);
+  }
+  else {
+    if(want_size2 && server->size2)
+      coap_add_option(response, 28, coap_encode_var_bytes(size, server->len), size);
+    coap_add_block(response, server->len, server->image, block.num, block.szx);
+    server->payload += response->length;
+  }
+
+  if(!test_ota_lost(server, response->length))
+    sendto(server->fd, response->hdr, response->length, 0, (struct sockaddr *)from, from_len);
+
+  coap_delete_pdu(request);
+  coap_delete_pdu(response);
+}
+
+static void *test_ota_server_thread(void *arg) {
+  test_ota_server_t *server = arg;
+  unsigned char buf[COAP_MAX_PDU_SIZE];
+  struct pollfd pfd = { server->fd, POLLIN, 0 };
+  struct sockaddr_in from;
+  socklen_t from_len;
+  int len;
+
+  while(!server->stop) {
+    if(poll(&pfd, 1, 10) <= 0)
+      continue;
+    from_len = sizeof(from);
+    len = recvfrom(server->fd, buf, sizeof(buf), 0, (struct sockaddr *)&from, &from_len);
+    if(len <= 0 || test_ota_lost(server, len))
+      continue;
+    test_ota_serve(server, buf, len, &from, from_len);
+  }
+
+  return NULL;
+}
+
+static void test_ota_server_start(test_ota_server_t *server, const uint8_t *image, size_t len, double ber) {
+  struct sockaddr_in addr;
+  socklen_t addr_len = sizeof(addr);
+
+  memset(server, 0, sizeof(*server));
+  server->image = image;
+  server->len = len;
+  memcpy(server->etag, image + len / 2, sizeof(server->etag));
+  server->szx_max = 6;
+  server->size2 = 1;
+  server->ber = ber;
+  server->seed = 1;
+
+  server->fd = socket(AF_INET, SOCK_DGRAM, 0);
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  TEST_ASSERT_EQUAL(0, bind(server->fd, (struct sockaddr *)&addr, sizeof(addr)));
+  getsockname(server->fd, (struct sockaddr *)&addr, &addr_len);
+  server->port = ntohs(addr.sin_port);
+
+  TEST_ASSERT_EQUAL(0, pthread_create(&server->thread, NULL, test_ota_server_thread, server));
+}
+
+static void test_ota_server_stop(test_ota_server_t *server) {
+  server->stop = 1;
+  pthread_join(server->thread, NULL);
+  close(server->fd);
+}
+
+static void test_ota_image(uint8_t *image, size_t len, unsigned int seed) {
+  size_t i;
+
+  srand(seed);
+  for(i = 0; i < len; i++)
+    image[i] = rand();
+  image[0] = 0xE9;
+}
+
+typedef struct {
+  coap_context_t *ctx;
+  om2m_coap_ota_t ota;
+} test_ota_client_t;
+
+static void test_ota_client_init(test_ota_client_t *client, const test_ota_server_t *server) {
+  coap_address_t local, dst;
+
+  coap_address_init(&local);
+  local.addr.sin.sin_family = AF_INET;
+  local.addr.sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  TEST_ASSERT_NOT_NULL(client->ctx = coap_new_context(&local));
+
+  coap_address_init(&dst);
+  dst.addr.sin.sin_family = AF_INET;
+  dst.addr.sin.sin_port = htons(server->port);
+  dst.addr.sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  om2m_coap_ota_init(&client->ota, client->ctx, &dst, TEST_OTA_PATH);
+  client->ota.timeout_ms = TEST_OTA_TIMEOUT_MS;
+}
+
+static int test_ota_run(const test_ota_server_t *server, test_ota_client_t *client) {
+  test_ota_client_init(client, server);
+  return om2m_coap_ota_run(&client->ota);
+}
+
+static void test_ota_client_close(test_ota_client_t *client) {
+  coap_free_context(client->ctx);
+}
+
+static uint32_t test_ota_resume_num(void) {
+  struct {
+    uint32_t path_hash, num, szx, etag_len;
+    uint8_t etag[OM2M_COAP_OTA_ETAG_MAX];
+  } resume;
+  size_t len = sizeof(resume);
+  nvs_handle handle;
+
+  nvs_open(OM2M_COAP_OTA_NAMESPACE, NVS_READONLY, &handle);
+  if(nvs_get_blob(handle, "coap_ota", &resume, &len) != ESP_OK)
+    return 0;
+  return resume.num << (resume.szx + 4);
+}
+
+void test_coap_ota_download(void) {
+  test_ota_server_t server;
+  test_ota_client_t client;
+  size_t len = 100000;
+
+  nvs_host_erase();
+  ota_host_reset();
+  test_ota_image(s_image, len, 1);
+  test_ota_server_start(&server, s_image, len, 0);
+
+  TEST_ASSERT_EQUAL(0, test_ota_run(&server, &client));
+  TEST_ASSERT_EQUAL_MEMORY(s_image, ota_host_data(), len);
+  TEST_ASSERT_EQUAL(len, ota_host_written);
+  TEST_ASSERT_EQUAL(0, client.ota.resumed_at);
+
+  // 1 KB blocks all along, each asked for once
+  TEST_ASSERT_EQUAL(OM2M_COAP_OTA_SZX_MAX, client.ota.szx);
+  TEST_ASSERT_EQUAL((len + 1023) / 1024, client.ota.requests);
+  TEST_ASSERT_EQUAL(0, client.ota.lost);
+
+  // a resume point every 16 KB, forgotten once the image is verified
+  TEST_ASSERT_EQUAL(len / OM2M_COAP_OTA_COMMIT + 1, nvs_host_writes);
+  TEST_ASSERT_EQUAL(0, test_ota_resume_num());
+
+  test_ota_client_close(&client);
+  test_ota_server_stop(&server);
+}
+
+/*
+ * A server with 256 byte blocks that does not tell the size of the image,
+ * the requests past the end find it
+ */
+void test_coap_ota_server_limits(void) {
+  test_ota_server_t server;
+  test_ota_client_t client;
+  size_t len = 30001;
+
+  nvs_host_erase();
+  ota_host_reset();
+  test_ota_image(s_image, len, 2);
+  test_ota_server_start(&server, s_image, len, 0);
+  server.szx_max = 4;
+  server.size2 = 0;
+
+  TEST_ASSERT_EQUAL(0, test_ota_run(&server, &client));
+  TEST_ASSERT_EQUAL_MEMORY(s_image, ota_host_data(), len);
+  TEST_ASSERT_EQUAL(len, ota_host_written);
+  TEST_ASSERT_EQUAL(4, client.ota.szx);
+  TEST_ASSERT_TRUE(client.ota.requests < len / 256 + 1 + 2 * OM2M_COAP_OTA_WINDOW);
+
+  test_ota_client_close(&client);
+  test_ota_server_stop(&server);
+}
+
+/*
+ * Reset in the middle of the download, the next boot goes on from the
+ * last resume point
+ */
+void test_coap_ota_resume(void) {
+  test_ota_server_t server;
+  test_ota_client_t client;
+  size_t len = 100000, payload;
+
+  nvs_host_erase();
+  ota_host_reset();
+  test_ota_image(s_image, len, 3);
+  test_ota_server_start(&server, s_image, len, 0);
+
+  ota_host_fail_at = 70000;
+  TEST_ASSERT_EQUAL(-1, test_ota_run(&server, &client));
+  test_ota_client_close(&client);
+  TEST_ASSERT_EQUAL(4 * OM2M_COAP_OTA_COMMIT, test_ota_resume_num());
+
+  ota_host_fail_at = 0;
+  ota_host_written = 0;
+  payload = server.payload;
+  TEST_ASSERT_EQUAL(0, test_ota_run(&server, &client));
+  TEST_ASSERT_EQUAL_MEMORY(s_image, ota_host_data(), len);
+  TEST_ASSERT_EQUAL(4 * OM2M_COAP_OTA_COMMIT, client.ota.resumed_at);
+  TEST_ASSERT_EQUAL(1, ota_host_resumes);
+  TEST_ASSERT_EQUAL(len - 4 * OM2M_COAP_OTA_COMMIT, ota_host_written);
+  // only the rest of the image came again, headers aside
+  TEST_ASSERT_TRUE(server.payload - payload < len - 4 * OM2M_COAP_OTA_COMMIT + 2048);
+  TEST_ASSERT_EQUAL(0, test_ota_resume_num());
+
+  test_ota_client_close(&client);
+  test_ota_server_stop(&server);
+}
+
+/*
+ * The server got a new image while the node was down, the ETag tells
+ */
+void test_coap_ota_resume_changed(void) {
+  test_ota_server_t server;
+  test_ota_client_t client;
+  size_t len = 100000;
+
+  nvs_host_erase();
+  ota_host_reset();
+  test_ota_image(s_image, len, 4);
+  test_ota_image(s_image_v2, len, 5);
+  test_ota_server_start(&server, s_image, len, 0);
+
+  ota_host_fail_at = 50000;
+  TEST_ASSERT_EQUAL(-1, test_ota_run(&server, &client));
+  test_ota_client_close(&client);
+  TEST_ASSERT_EQUAL(3 * OM2M_COAP_OTA_COMMIT, test_ota_resume_num());
+  test_ota_server_stop(&server);
+
+  ota_host_fail_at = 0;
+  test_ota_server_start(&server, s_image_v2, len, 0);
+  TEST_ASSERT_EQUAL(0, test_ota_run(&server, &client));
+  TEST_ASSERT_EQUAL_MEMORY(s_image_v2, ota_host_data(), len);
+  TEST_ASSERT_EQUAL(0, client.ota.resumed_at);
+  TEST_ASSERT_EQUAL(0, ota_host_resumes);
+
+  test_ota_client_close(&client);
+  test_ota_server_stop(&server);
+}
+
+/*
+ * A packed image is decoded as it comes, a download offset is no offset
+ * on flash: a reset starts the download over
+ */
+void test_coap_ota_resume_packed(void) {
+  esp_ota_pack_header_t header = { .magic = ESP_OTA_PACK_MAGIC, .window_bits = 12, .lookahead_bits = 4 };
+  test_ota_server_t server;
+  test_ota_client_t client;
+  size_t len = 100000;
+
+  nvs_host_erase();
+  ota_host_reset();
+  test_ota_image(s_image, len, 6);
+  header.image_size = len;
+  memcpy(s_packed, &header, sizeof(header));
+  memcpy(s_packed + sizeof(header), s_image, len);
+  test_ota_server_start(&server, s_packed, sizeof(header) + len, 0);
+
+  ota_host_fail_at = 70000;
+  TEST_ASSERT_EQUAL(-1, test_ota_run(&server, &client));
+  test_ota_client_close(&client);
+  TEST_ASSERT_EQUAL(1, client.ota.packed);
+  TEST_ASSERT_EQUAL(0, test_ota_resume_num());
+
+  ota_host_fail_at = 0;
+  ota_host_written = 0;
+  TEST_ASSERT_EQUAL(0, test_ota_run(&server, &client));
+  TEST_ASSERT_EQUAL_MEMORY(s_image, ota_host_data(), len);
+  TEST_ASSERT_EQUAL(0, client.ota.resumed_at);
+  TEST_ASSERT_EQUAL(0, ota_host_resumes);
+  TEST_ASSERT_EQUAL(sizeof(header) + len, ota_host_written);
+
+  test_ota_client_close(&client);
+  test_ota_server_stop(&server);
+}
+
+/*
+ * On a link that loses one 1 KB datagram in two the blocks get smaller
+ */
+void test_coap_ota_loss(void) {
+  test_ota_server_t server;
+  test_ota_client_t client;
+  size_t len = 64 * 1024;
+
+  nvs_host_erase();
+  ota_host_reset();
+  test_ota_image(s_image, len, 6);
+  test_ota_server_start(&server, s_image, len, 8e-5);
+
+  test_ota_client_init(&client, &server);
+  client.ota.retries = 20;
+  TEST_ASSERT_EQUAL(0, om2m_coap_ota_run(&client.ota));
+  TEST_ASSERT_EQUAL_MEMORY(s_image, ota_host_data(), len);
+  TEST_ASSERT_TRUE(client.ota.lost > 0);
+  TEST_ASSERT_TRUE(client.ota.szx < OM2M_COAP_OTA_SZX_MAX);
+  TEST_ASSERT_TRUE(client.ota.szx > OM2M_COAP_OTA_SZX_MIN);
+
+  test_ota_client_close(&client);
+  test_ota_server_stop(&server);
+}
+
+static uint64_t test_ota_time_us(void) {
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+/*
+ * Fixed 64 byte and 1 KB blocks against the adaptive size, over links
+ * from clean to lossy: datagrams sent, lost and bytes on the air
+ */
+void test_coap_ota_benchmark(void) {
+  static const double bers[] = { 0, 2e-5, 8e-5, 1.6e-4 };
+  static const int szx[][2] = { { 2, 2 }, { 6, 6 }, { OM2M_COAP_OTA_SZX_MIN, OM2M_COAP_OTA_SZX_MAX } };
+  static const char *names[] = { "64 B", "1 KB", "adaptive" };
+  size_t len = 64 * 1024, air[3];
+  int b, m;
+
+  test_ota_image(s_image, len, 7);
+
+  for(b = 0; b < sizeof(bers) / sizeof(bers[0]); b++) {
+    for(m = 0; m < 3; m++) {
+      test_ota_server_t server;
+      test_ota_client_t client;
+      uint64_t start;
+
+      nvs_host_erase();
+      ota_host_reset();
+      test_ota_server_start(&server, s_image, len, bers[b]);
+      test_ota_client_init(&client, &server);
+      client.ota.szx_min = szx[m][0];
+      client.ota.szx_max = szx[m][1];
+      client.ota.retries = 100;
+
+      start = test_ota_time_us();
+      TEST_ASSERT_EQUAL(0, om2m_coap_ota_run(&client.ota));
+      TEST_ASSERT_EQUAL_MEMORY(s_image, ota_host_data(), len);
+      air[m] = server.air_bytes;
+
+      printf("coap ota 64 KB, ber %.1e, %-8s: %5u requests, %4u lost, %6u bytes on the air, %4.0f ms, ends at %d B blocks\n",
+             bers[b], names[m], client.ota.requests, client.ota.lost, (unsigned int)server.air_bytes,
+             (test_ota_time_us() - start) / 1000.0, 1 << (client.ota.szx + 4));
+
+      test_ota_client_close(&client);
+      test_ota_server_stop(&server);
+    }
+
+    // no more than the better of the two fixed sizes, give or take the probing
+    TEST_ASSERT_TRUE(air[2] <= (air[0] < air[1] ? air[0] : air[1]) * 21 / 20);
+  }
+}
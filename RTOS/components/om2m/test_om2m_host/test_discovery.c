@@ -0,0 +1,365 @@
+#include "om2m/discovery.h"
+#include "om2m/om2m.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "unity.h"
+#include "mdns.h"
+#include "nvs.h"
+
+/**
+ * What the CSEs on the network announce, answered by the mdns stand-in
+ * */
+typedef struct {
+  const char *instance;
+  const char *host;
+  const char *addr;		// A record in the answer, NULL to leave it out
+  const char *host_addr;	// answer to a query of the host alone
+  uint16_t port;
+  uint32_t ttl;
+  const char *rn;
+  const char *csi;
+} test_announce_t;
+
+static const test_announce_t *s_announced;
+static int s_num_announced;
+static int s_mdns_running;
+static int s_ptr_queries;
+static int s_a_queries;
+static useconds_t s_round_trip_us;
+
+static const test_announce_t s_cse_a = { "in-cse", "cse-a", "192.168.137.1", NULL, 5683, 120, "dartes", "/in-cse" };
+static const test_announce_t s_cse_b = { "in-cse-2", "cse-b", "192.168.137.2", NULL, 5683, 120, "dartes", "/in-cse" };
+
+static void test_announce(const test_announce_t *announced, int num) {
+  s_announced = announced;
+  s_num_announced = num;
+}
+
+static char *test_strdup(const char *s) {
+  return s ? strdup(s) : NULL;
+}
+
+esp_err_t mdns_query_ptr(const char *service_type, const char *proto, uint32_t timeout, size_t max_results, mdns_result_t **results) {
+  mdns_result_t *last = NULL;
+  int i;
+
+  *results = NULL;
+  if(!s_mdns_running)
+    return ESP_ERR_INVALID_STATE;
+
+  s_ptr_queries++;
+  usleep(s_round_trip_us);
+  if(strcmp(service_type, "_onem2m") || strcmp(proto, "_udp"))
+    return ESP_OK;
+
+  for(i = 0; i < s_num_announced && i < max_results; i++) {
+    const test_announce_t *announce = &s_announced[i];
+    mdns_result_t *r = calloc(1, sizeof(*r));
+
+    r->instance_name = test_strdup(announce->instance);
+    r->hostname = test_strdup(announce->host);
+    r->port = announce->port;
+    r->ttl = announce->ttl;
+    if(announce->addr) {
+      r->addr = calloc(1, sizeof(*r->addr));
+      r->addr->addr.type = IPADDR_TYPE_V4;
+      r->addr->addr.u_addr.ip4.addr = inet_addr(announce->addr);
+    }
+    if(announce->rn) {
+      r->txt = calloc(2, sizeof(*r->txt));
+      r->txt[0].key = strdup("rn");
+      r->txt[0].value = strdup(announce->rn);
+      r->txt[1].key = strdup("csi");
+      r->txt[1].value = strdup(announce->csi);
+      r->txt_count = 2;
+    }
+
+    if(last)
+      last->next = r;
+    else
+      *results = r;
+    last = r;
+  }
+
+  return ESP_OK;
+}
+
+esp_err_t mdns_query_a(const char *host_name, uint32_t timeout, ip4_addr_t *addr) {
+  int i;
+
+  s_a_queries++;
+  usleep(s_round_trip_us);
+  for(i = 0; i < s_num_announced; i++) {
+    if(s_announced[i].host_addr && !strcmp(s_announced[i].host, host_name)) {
+      addr->addr = inet_addr(s_announced[i].host_addr);
+      return ESP_OK;
+    }
+  }
+
+  return ESP_ERR_NOT_FOUND;
+}
+
+void mdns_query_results_free(mdns_result_t *results) {
+  while(results) {
+    mdns_result_t *next = results->next;
+    size_t i;
+
+    for(i = 0; i < results->txt_count; i++) {
+      free(results->txt[i].key);
+      free(results->txt[i].value);
+    }
+    free(results->txt);
+    free(results->addr);
+    free(results->instance_name);
+    free(results->hostname);
+    free(results);
+    results = next;
+  }
+}
+
+static void test_discovery_reset(void) {
+  nvs_host_erase();
+  test_announce(NULL, 0);
+  s_mdns_running = 1;
+  s_ptr_queries = s_a_queries = 0;
+  s_round_trip_us = 0;
+}
+
+// until the background query, if any, is over
+static void test_discovery_wait(om2m_discovery_t *discovery) {
+  bool refreshing;
+
+  do {
+    usleep(1000);
+    xSemaphoreTake(discovery->lock, portMAX_DELAY);
+    refreshing = discovery->refreshing;
+    xSemaphoreGive(discovery->lock);
+  } while(refreshing);
+}
+
+static void test_discovery_expire(om2m_discovery_t *discovery) {
+  xSemaphoreTake(discovery->lock, portMAX_DELAY);
+  discovery->expires = om2m_now_ms() - 1;
+  xSemaphoreGive(discovery->lock);
+}
+
+/**
+ * The first discovery waits for mDNS, stores the answer and is then
+ * served from memory for the TTL
+ * */
+void test_om2m_discovery_cold(void) {
+  om2m_discovery_t discovery;
+  om2m_cse_t cse;
+  char path[OM2M_TO_MAX];
+
+  test_discovery_reset();
+  test_announce(&s_cse_a, 1);
+
+  TEST_ASSERT_EQUAL(0, om2m_discovery_init(&discovery, "_udp"));
+  TEST_ASSERT_EQUAL(0, om2m_discovery_get(&discovery, &cse));
+  TEST_ASSERT_EQUAL_HEX32(inet_addr("192.168.137.1"), cse.addr);
+  TEST_ASSERT_EQUAL(5683, cse.port);
+  TEST_ASSERT_EQUAL(120, cse.ttl);
+  TEST_ASSERT_EQUAL(14, om2m_cse_path(&cse, path, sizeof(path)));
+  TEST_ASSERT_EQUAL_STRING("/in-cse/dartes", path);
+  TEST_ASSERT_EQUAL(-1, om2m_cse_path(&cse, path, 8));
+  TEST_ASSERT_EQUAL(1, s_ptr_queries);
+  TEST_ASSERT_EQUAL(1, nvs_host_writes);
+
+  TEST_ASSERT_EQUAL(0, om2m_discovery_get(&discovery, &cse));
+  TEST_ASSERT_EQUAL(1, s_ptr_queries);
+  TEST_ASSERT_FALSE(discovery.refreshing);
+
+  // CSEs of the other protocols are cached on their own
+  om2m_discovery_close(&discovery);
+  TEST_ASSERT_EQUAL(0, om2m_discovery_init(&discovery, "_tcp"));
+  TEST_ASSERT_EQUAL(-1, om2m_discovery_get(&discovery, &cse));
+  TEST_ASSERT_EQUAL(2, s_ptr_queries);
+  om2m_discovery_close(&discovery);
+}
+
+/**
+ * After a reboot the cached CSE comes back without any round trip
+ * and is re-validated in the background
+ * */
+void test_om2m_discovery_warm_boot(void) {
+  om2m_discovery_t discovery;
+  om2m_cse_t cse;
+  uint32_t start, cold, warm;
+
+  test_discovery_reset();
+  test_announce(&s_cse_a, 1);
+  s_round_trip_us = 100000;
+
+  om2m_discovery_init(&discovery, "_udp");
+  start = om2m_now_ms();
+  TEST_ASSERT_EQUAL(0, om2m_discovery_get(&discovery, &cse));
+  cold = om2m_now_ms() - start;
+  om2m_discovery_close(&discovery);
+
+  om2m_discovery_init(&discovery, "_udp");
+  start = om2m_now_ms();
+  TEST_ASSERT_EQUAL(0, om2m_discovery_get(&discovery, &cse));
+  warm = om2m_now_ms() - start;
+  TEST_ASSERT_EQUAL_HEX32(inet_addr("192.168.137.1"), cse.addr);
+  TEST_ASSERT_TRUE(warm < s_round_trip_us / 1000);
+
+  test_discovery_wait(&discovery);
+  TEST_ASSERT_EQUAL(2, s_ptr_queries);
+  TEST_ASSERT_EQUAL(1, discovery.queries);
+  // the same answer is not written again
+  TEST_ASSERT_EQUAL(1, nvs_host_writes);
+
+  TEST_ASSERT_EQUAL(0, om2m_discovery_get(&discovery, &cse));
+  TEST_ASSERT_FALSE(discovery.refreshing);
+  TEST_ASSERT_EQUAL(2, s_ptr_queries);
+  om2m_discovery_close(&discovery);
+
+  printf("first CSE after boot: cold %u ms, warm %u ms\n", (unsigned)cold, (unsigned)warm);
+}
+
+/**
+ * A CSE which moved is picked up by the re-validation, the stale one
+ * is only used until then
+ * */
+void test_om2m_discovery_moved(void) {
+  om2m_discovery_t discovery;
+  om2m_cse_t cse;
+
+  test_discovery_reset();
+  test_announce(&s_cse_a, 1);
+  om2m_discovery_init(&discovery, "_udp");
+  om2m_discovery_get(&discovery, &cse);
+  om2m_discovery_close(&discovery);
+
+  test_announce(&s_cse_b, 1);
+  om2m_discovery_init(&discovery, "_udp");
+  TEST_ASSERT_EQUAL(0, om2m_discovery_get(&discovery, &cse));
+  TEST_ASSERT_EQUAL_HEX32(inet_addr("192.168.137.1"), cse.addr);
+  test_discovery_wait(&discovery);
+
+  TEST_ASSERT_EQUAL(0, om2m_discovery_get(&discovery, &cse));
+  TEST_ASSERT_EQUAL_HEX32(inet_addr("192.168.137.2"), cse.addr);
+  TEST_ASSERT_EQUAL(2, nvs_host_writes);
+  om2m_discovery_close(&discovery);
+
+  om2m_discovery_init(&discovery, "_udp");
+  TEST_ASSERT_EQUAL(0, om2m_discovery_get(&discovery, &cse));
+  TEST_ASSERT_EQUAL_HEX32(inet_addr("192.168.137.2"), cse.addr);
+  test_discovery_wait(&discovery);
+  om2m_discovery_close(&discovery);
+}
+
+/**
+ * Once its TTL ran out the CSE keeps being used while it is re-validated,
+ * also when nothing answers
+ * */
+void test_om2m_discovery_expired(void) {
+  static const test_announce_t both[] = { s_cse_b, s_cse_a };
+  om2m_discovery_t discovery;
+  om2m_cse_t cse;
+
+  test_discovery_reset();
+  test_announce(&s_cse_a, 1);
+  om2m_discovery_init(&discovery, "_udp");
+  om2m_discovery_get(&discovery, &cse);
+
+  // the CSE in use stays first when another one shows up
+  test_announce(both, 2);
+  test_discovery_expire(&discovery);
+  TEST_ASSERT_EQUAL(0, om2m_discovery_get(&discovery, &cse));
+  test_discovery_wait(&discovery);
+  TEST_ASSERT_EQUAL(2, s_ptr_queries);
+  TEST_ASSERT_EQUAL(2, discovery.num);
+  TEST_ASSERT_EQUAL(0, om2m_discovery_get(&discovery, &cse));
+  TEST_ASSERT_EQUAL_HEX32(inet_addr("192.168.137.1"), cse.addr);
+
+  test_announce(NULL, 0);
+  test_discovery_expire(&discovery);
+  TEST_ASSERT_EQUAL(0, om2m_discovery_get(&discovery, &cse));
+  test_discovery_wait(&discovery);
+  TEST_ASSERT_EQUAL(3, s_ptr_queries);
+  TEST_ASSERT_EQUAL(0, om2m_discovery_get(&discovery, &cse));
+  TEST_ASSERT_EQUAL_HEX32(inet_addr("192.168.137.1"), cse.addr);
+  TEST_ASSERT_FALSE(discovery.refreshing);
+  TEST_ASSERT_EQUAL(3, s_ptr_queries);
+  om2m_discovery_close(&discovery);
+}
+
+/**
+ * Failover moves to the next candidate without a round trip and
+ * survives a reboot
+ * */
+void test_om2m_discovery_failover(void) {
+  static const test_announce_t both[] = { s_cse_a, s_cse_b };
+  om2m_discovery_t discovery;
+  om2m_cse_t cse;
+
+  test_discovery_reset();
+  test_announce(both, 2);
+  om2m_discovery_init(&discovery, "_udp");
+  TEST_ASSERT_EQUAL(0, om2m_discovery_get(&discovery, &cse));
+  TEST_ASSERT_EQUAL_HEX32(inet_addr("192.168.137.1"), cse.addr);
+
+  TEST_ASSERT_EQUAL(0, om2m_discovery_failover(&discovery, &cse));
+  TEST_ASSERT_EQUAL_HEX32(inet_addr("192.168.137.2"), cse.addr);
+  TEST_ASSERT_EQUAL(1, s_ptr_queries);
+  TEST_ASSERT_EQUAL(2, nvs_host_writes);
+  om2m_discovery_close(&discovery);
+
+  om2m_discovery_init(&discovery, "_udp");
+  TEST_ASSERT_EQUAL(0, om2m_discovery_get(&discovery, &cse));
+  TEST_ASSERT_EQUAL_HEX32(inet_addr("192.168.137.2"), cse.addr);
+  test_discovery_wait(&discovery);
+  TEST_ASSERT_EQUAL(2, s_ptr_queries);
+
+  // the re-validation brought the other CSE back as a candidate
+  TEST_ASSERT_EQUAL(2, discovery.num);
+  TEST_ASSERT_EQUAL(0, om2m_discovery_failover(&discovery, &cse));
+  TEST_ASSERT_EQUAL_HEX32(inet_addr("192.168.137.1"), cse.addr);
+  TEST_ASSERT_EQUAL(2, s_ptr_queries);
+
+  // nothing left to fail over to, ask the network
+  test_announce(NULL, 0);
+  TEST_ASSERT_EQUAL(-1, om2m_discovery_failover(&discovery, &cse));
+  TEST_ASSERT_EQUAL(3, s_ptr_queries);
+  om2m_discovery_close(&discovery);
+}
+
+/**
+ * Goodbyes are skipped, an address left out of the answer is asked for
+ * */
+void test_om2m_discovery_records(void) {
+  static const test_announce_t announced[] = {
+    { "leaving", "cse-c", "192.168.137.3", NULL, 5683, 0, "dartes", "/in-cse" },
+    { "bare", "cse-d", NULL, "192.168.137.4", 5684, 4500, NULL, NULL },
+    { "gone", "cse-e", NULL, NULL, 5683, 120, NULL, NULL },
+  };
+  om2m_discovery_t discovery;
+  om2m_cse_t cse;
+  char path[OM2M_TO_MAX];
+
+  test_discovery_reset();
+  test_announce(announced, 3);
+  om2m_discovery_init(&discovery, "_udp");
+  TEST_ASSERT_EQUAL(0, om2m_discovery_get(&discovery, &cse));
+  TEST_ASSERT_EQUAL(1, discovery.num);
+  TEST_ASSERT_EQUAL_HEX32(inet_addr("192.168.137.4"), cse.addr);
+  TEST_ASSERT_EQUAL(5684, cse.port);
+  TEST_ASSERT_EQUAL(2, s_a_queries);
+  TEST_ASSERT_EQUAL(3, discovery.queries);
+  TEST_ASSERT_EQUAL(-1, om2m_cse_path(&cse, path, sizeof(path)));
+  om2m_discovery_close(&discovery);
+
+  test_discovery_reset();
+  s_mdns_running = 0;
+  om2m_discovery_init(&discovery, "_udp");
+  TEST_ASSERT_EQUAL(-1, om2m_discovery_get(&discovery, &cse));
+  TEST_ASSERT_EQUAL(0, nvs_host_writes);
+  om2m_discovery_close(&discovery);
+}
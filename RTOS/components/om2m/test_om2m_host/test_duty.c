@@ -0,0 +1,496 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "unity.h"
+#include "crc.h"
+#include "nvs.h"
+#include "om2m/om2m.h"
+#include "om2m/cbor.h"
+#include "om2m/duty.h"
+
+#define TEST_CSE		"/in-cse/dartes"
+#define TEST_ORIGINATOR		"admin:admin"
+#define TEST_PERIOD_MS		60000
+#define TEST_BATCH		4
+
+// modelled ESP8266 station times
+#define TEST_JOIN_MS		300	// straight to the cached BSSID and channel
+#define TEST_DHCP_MS		1200
+#define TEST_SCAN_MS		2200	// every channel, then the join
+#define TEST_SAMPLE_MS		40
+#define TEST_RTT_MS		30
+
+/*
+ * Stand-ins for the RTC memory, the station, deep sleep and the CSE,
+ * all on one simulated clock
+ */
+typedef struct {
+  uint32_t now;
+  int rtc_valid;
+  om2m_duty_rtc_t rtc;
+
+  uint8_t bssid[6];		// of the AP
+  uint8_t channel;		// 0 when it is down
+  uint32_t lease;		// ip handed out by DHCP
+  int joins;
+  int scans;
+  int dhcp;
+  const om2m_duty_link_t *joining;
+  om2m_duty_link_t request;
+
+  int sleeps;
+  uint32_t sleep_us;
+  int radio;
+  int radio_off_joins;		// joins on a wake with the radio off
+
+  int sample;
+
+  int provisioning;		// the wakes create the AE before the first batch
+  int provisions;
+  int created;			// rsc of the AE creation, 0 until answered
+
+  int answer;			// the CSE answers
+  int rsc;
+  int sent;
+  uint32_t sent_at;
+  om2m_request_t last;
+} test_duty_env_t;
+
+static test_duty_env_t env;
+
+static uint32_t test_duty_now(void *arg) {
+  return env.now;
+}
+
+static int test_duty_load(void *arg, om2m_duty_rtc_t *rtc) {
+  if(!env.rtc_valid)
+    return -1;
+
+  *rtc = env.rtc;
+  return 0;
+}
+
+static void test_duty_store(void *arg, const om2m_duty_rtc_t *rtc) {
+  env.rtc = *rtc;
+  env.rtc_valid = 1;
+}
+
+static int test_duty_connect(void *arg, const om2m_duty_link_t *link) {
+  if(!env.radio)
+    env.radio_off_joins++;
+
+  env.joins++;
+  env.joining = link ? &env.request : NULL;
+  if(link)
+    env.request = *link;
+  return 0;
+}
+
+static int test_duty_wait(void *arg, om2m_duty_link_t *link, int timeout_ms) {
+  int dhcp = !env.joining || !env.joining->ip;
+
+  if(!env.joining) {
+    env.scans++;
+    env.now += env.channel ? TEST_SCAN_MS : timeout_ms;
+  }
+  else if(env.channel && env.joining->channel == env.channel && !memcmp(env.joining->bssid, env.bssid, 6)) {
+    env.now += TEST_JOIN_MS;
+  }
+  else {
+    // the AP is elsewhere, the station gives up when the probes go unanswered
+    env.now += env.channel ? TEST_JOIN_MS : timeout_ms;
+    return -1;
+  }
+
+  if(!env.channel)
+    return -1;
+
+  if(dhcp) {
+    env.dhcp++;
+    env.now += TEST_DHCP_MS;
+  }
+
+  memcpy(link->bssid, env.bssid, 6);
+  link->channel = env.channel;
+  link->ip = dhcp ? env.lease : env.joining->ip;
+  link->netmask = 0x00ffffff;
+  link->gw = 0x0101a8c0;
+  link->dns = 0x0101a8c0;
+  return 0;
+}
+
+static void test_duty_sleep(void *arg, uint32_t us, int radio) {
+  env.sleeps++;
+  env.sleep_us = us;
+  env.radio = radio;
+}
+
+static const om2m_duty_ops_t test_duty_ops = {
+  .load = test_duty_load,
+  .store = test_duty_store,
+  .connect = test_duty_connect,
+  .wait = test_duty_wait,
+  .sleep = test_duty_sleep,
+  .now_ms = test_duty_now,
+};
+
+static int test_duty_sample(void *arg, om2m_duty_reading_t *reading) {
+  env.now += TEST_SAMPLE_MS;
+  reading->value[0] = 60 + env.sample;
+  reading->value[1] = 90 + env.sample % 10;
+  env.sample++;
+  return 0;
+}
+
+static void test_duty_created(void *arg, const om2m_response_t *response) {
+  env.created = response->rsc;
+}
+
+static om2m_client_t client;
+
+// waits on the simulated clock, like the application does on the real one
+static int test_duty_provision(void *arg, int timeout_ms) {
+  uint32_t start = env.now;
+
+  env.provisions++;
+  env.created = 0;
+  if(om2m_create_ae(&client, "MAX30100", 8989, "coap://127.0.0.1:5683", test_duty_created, NULL) < 0)
+    return -1;
+
+  while(!env.created && env.now - start < (uint32_t)timeout_ms)
+    om2m_client_poll(&client, OM2M_DUTY_POLL_MS);
+
+  return env.created == 2001 ? 0 : -1;
+}
+
+static int test_duty_send(om2m_client_t *client, const om2m_request_t *request) {
+  env.sent++;
+  env.sent_at = env.now;
+  env.last = *request;
+  return 0;
+}
+
+// the response, if any, comes one round trip after the request
+static int test_duty_poll(om2m_client_t *client, int timeout_ms) {
+  om2m_response_t response;
+
+  env.now += timeout_ms;
+  if(!env.answer || !env.last.rqi[0] || env.now - env.sent_at < TEST_RTT_MS)
+    return 0;
+
+  memset(&response, 0, sizeof(response));
+  response.rqi = env.last.rqi;
+  response.rsc = env.rsc;
+  response.pc = "";
+  om2m_client_response(client, &response);
+  env.last.rqi[0] = '\0';
+  return 1;
+}
+
+static const om2m_binding_t test_duty_binding = {
+  .name = "duty",
+  .send = test_duty_send,
+  .poll = test_duty_poll,
+};
+
+static void test_duty_power_on(void) {
+  memset(&env, 0, sizeof(env));
+  memcpy(env.bssid, "\x24\x0a\xc4\x01\x02\x03", 6);
+  env.channel = 6;
+  env.lease = 0x2a01a8c0;
+  env.answer = 1;
+  env.rsc = 2001;
+  // the radio is on after a power on
+  env.radio = 1;
+  nvs_host_erase();
+}
+
+/**
+ * The machine, the client and the clock start over as after a reset,
+ * only env.rtc and NVS are kept
+ * */
+static void test_duty_reset(om2m_duty_t *duty) {
+  env.now = 0;
+  TEST_ASSERT_EQUAL(0, om2m_client_init(&client, &test_duty_binding, NULL, TEST_CSE, TEST_ORIGINATOR));
+  client.timeout_ms = 5000;
+  om2m_duty_init(duty, &test_duty_ops, NULL, &client, "MAX30100", "DATA");
+  om2m_duty_sampler(duty, test_duty_sample, NULL);
+  if(env.provisioning)
+    om2m_duty_provisioner(duty, test_duty_provision, NULL);
+  duty->period_ms = TEST_PERIOD_MS;
+  duty->batch = TEST_BATCH;
+}
+
+static int test_duty_wake(om2m_duty_t *duty) {
+  int res;
+
+  test_duty_reset(duty);
+  res = om2m_duty_run(duty);
+  om2m_client_close(&client);
+  return res;
+}
+
+void test_om2m_duty_cycle(void) {
+  static const om2m_duty_state_t path[] = {
+    OM2M_DUTY_SAMPLE, OM2M_DUTY_CONNECT, OM2M_DUTY_PUBLISH, OM2M_DUTY_SLEEP, OM2M_DUTY_DONE
+  };
+  om2m_duty_t duty;
+  int i;
+
+  test_duty_power_on();
+
+  // wakes that only sample: no radio, back to sleep for the rest of the period
+  for(i = 0; i < TEST_BATCH - 1; i++) {
+    TEST_ASSERT_EQUAL(0, test_duty_wake(&duty));
+    TEST_ASSERT_EQUAL(i == 0, duty.cold);
+    TEST_ASSERT_EQUAL(0, env.joins);
+    TEST_ASSERT_EQUAL(0, env.sent);
+    TEST_ASSERT_EQUAL(i + 1, env.rtc.num);
+    TEST_ASSERT_EQUAL((TEST_PERIOD_MS - TEST_SAMPLE_MS) * 1000, env.sleep_us);
+    // only the wake before the publication gets the radio
+    TEST_ASSERT_EQUAL(i == TEST_BATCH - 2, env.radio);
+  }
+
+  // first publication, nothing cached: scan, DHCP, one request for the batch
+  test_duty_reset(&duty);
+  TEST_ASSERT_EQUAL(OM2M_DUTY_WAKE, duty.state);
+  for(i = 0; i < sizeof(path) / sizeof(path[0]); i++)
+    TEST_ASSERT_EQUAL(path[i], om2m_duty_step(&duty));
+  om2m_client_close(&client);
+
+  TEST_ASSERT_EQUAL(1, duty.published);
+  TEST_ASSERT_EQUAL(1, env.scans);
+  TEST_ASSERT_EQUAL(1, env.dhcp);
+  TEST_ASSERT_EQUAL(1, env.sent);
+  TEST_ASSERT_EQUAL_STRING(TEST_CSE "/MAX30100/DATA", env.last.to);
+  TEST_ASSERT_NULL(strstr(env.last.pc, "\"rn\""));
+  TEST_ASSERT_NOT_NULL(strstr(env.last.pc, "\"con\":\"0;60:90,61:91,62:92,63:93\""));
+  TEST_ASSERT_EQUAL(0, env.rtc.num);
+  TEST_ASSERT_EQUAL(TEST_BATCH, env.rtc.seq);
+  TEST_ASSERT_EQUAL(1, env.rtc.published);
+  TEST_ASSERT_EQUAL(1, env.rtc.latency.count);
+  TEST_ASSERT_EQUAL(TEST_SAMPLE_MS + TEST_SCAN_MS + TEST_DHCP_MS + TEST_RTT_MS, env.rtc.latency.last);
+  TEST_ASSERT_EQUAL(TEST_SCAN_MS + TEST_DHCP_MS, env.rtc.connect.last);
+  TEST_ASSERT_EQUAL((TEST_PERIOD_MS - env.rtc.latency.last) * 1000, env.sleep_us);
+  TEST_ASSERT_EQUAL(0, env.radio);
+  // the link went to NVS for the next power on
+  TEST_ASSERT_EQUAL(1, nvs_host_writes);
+
+  // the next batch joins the cached AP with the cached lease
+  for(i = 0; i < TEST_BATCH; i++)
+    TEST_ASSERT_EQUAL(0, test_duty_wake(&duty));
+  TEST_ASSERT_EQUAL(1, duty.published);
+  TEST_ASSERT_EQUAL(1, env.scans);
+  TEST_ASSERT_EQUAL(1, env.dhcp);
+  TEST_ASSERT_EQUAL(0x2a01a8c0, env.request.ip);
+  TEST_ASSERT_NOT_NULL(strstr(env.last.pc, "\"con\":\"4;64:94,65:95,66:96,67:97\""));
+  TEST_ASSERT_EQUAL(TEST_SAMPLE_MS + TEST_JOIN_MS + TEST_RTT_MS, env.rtc.latency.last);
+  TEST_ASSERT_EQUAL(TEST_SAMPLE_MS + TEST_JOIN_MS + TEST_RTT_MS, env.rtc.latency.min);
+  TEST_ASSERT_EQUAL(TEST_SAMPLE_MS + TEST_SCAN_MS + TEST_DHCP_MS + TEST_RTT_MS, env.rtc.latency.max);
+  TEST_ASSERT_EQUAL(2, env.rtc.latency.count);
+  TEST_ASSERT_EQUAL(1, env.rtc.link.uses);
+  TEST_ASSERT_EQUAL(1, nvs_host_writes);
+  TEST_ASSERT_EQUAL(0, env.radio_off_joins);
+  TEST_ASSERT_EQUAL(2 * TEST_BATCH, env.rtc.wakes);
+}
+
+void test_om2m_duty_link(void) {
+  om2m_duty_t duty;
+  int i;
+
+  test_duty_power_on();
+  for(i = 0; i < TEST_BATCH; i++)
+    test_duty_wake(&duty);
+  TEST_ASSERT_EQUAL(1, env.scans);
+
+  // the AP moved to another channel: the cached join fails, a scan finds it
+  env.channel = 11;
+  for(i = 0; i < TEST_BATCH; i++)
+    TEST_ASSERT_EQUAL(0, test_duty_wake(&duty));
+  TEST_ASSERT_EQUAL(1, duty.published);
+  TEST_ASSERT_EQUAL(2, env.scans);
+  TEST_ASSERT_EQUAL(11, env.rtc.link.channel);
+  TEST_ASSERT_EQUAL(2, nvs_host_writes);
+
+  // the lease is asked for again after OM2M_DUTY_REUSE joins on it
+  env.rtc.link.uses = OM2M_DUTY_REUSE - 1;
+  env.rtc.crc = crc32_le(0, (const uint8_t *)&env.rtc, offsetof(om2m_duty_rtc_t, crc));
+  for(i = 0; i < 2 * TEST_BATCH; i++)
+    TEST_ASSERT_EQUAL(0, test_duty_wake(&duty));
+  TEST_ASSERT_EQUAL(2, env.scans);
+  TEST_ASSERT_EQUAL(3, env.dhcp);
+  TEST_ASSERT_EQUAL(0, env.rtc.link.uses);
+  TEST_ASSERT_EQUAL(2, nvs_host_writes);
+
+  // a power on loses the RTC memory but not the AP: no scan, only DHCP
+  env.rtc_valid = 0;
+  env.radio = 1;
+  for(i = 0; i < TEST_BATCH; i++)
+    TEST_ASSERT_EQUAL(0, test_duty_wake(&duty));
+  TEST_ASSERT_EQUAL(1, duty.published);
+  TEST_ASSERT_EQUAL(2, env.scans);
+  TEST_ASSERT_EQUAL(4, env.dhcp);
+  TEST_ASSERT_EQUAL(11, env.request.channel);
+  TEST_ASSERT_EQUAL(0, env.request.ip);
+  TEST_ASSERT_EQUAL(TEST_BATCH, env.rtc.wakes);
+  TEST_ASSERT_NOT_NULL(strstr(env.last.pc, "\"con\":\"0;"));
+
+  // RTC memory that does not check out is the same as a power on
+  env.rtc.seq = 1234;
+  test_duty_wake(&duty);
+  TEST_ASSERT_TRUE(duty.cold);
+  TEST_ASSERT_EQUAL(0, env.rtc.seq);
+  TEST_ASSERT_EQUAL(1, env.rtc.num);
+}
+
+void test_om2m_duty_fail(void) {
+  om2m_duty_t duty;
+  char con[24];
+  int i, sent;
+
+  test_duty_power_on();
+  for(i = 0; i < TEST_BATCH; i++)
+    test_duty_wake(&duty);
+
+  // the CSE does not answer: the readings are kept and the next try waits
+  env.answer = 0;
+  for(i = 0; i < TEST_BATCH; i++)
+    test_duty_wake(&duty);
+  TEST_ASSERT_EQUAL(-1, duty.published);
+  TEST_ASSERT_EQUAL(2, env.sent);
+  TEST_ASSERT_EQUAL(TEST_BATCH, env.rtc.num);
+  TEST_ASSERT_EQUAL(1, env.rtc.fails);
+  TEST_ASSERT_EQUAL(env.rtc.wakes + 2, env.rtc.retry);
+  TEST_ASSERT_EQUAL(0, env.radio);
+
+  // the AP is down too: the batch keeps the newest readings, the wakes in between do not join
+  env.channel = 0;
+  sent = env.sent;
+  for(i = 0; i < 3 * TEST_BATCH; i++)
+    test_duty_wake(&duty);
+  TEST_ASSERT_EQUAL(sent, env.sent);
+  TEST_ASSERT_EQUAL(0, env.radio_off_joins);
+  TEST_ASSERT_TRUE(env.rtc.fails >= 2);
+  TEST_ASSERT_EQUAL(TEST_BATCH, env.rtc.num);
+  TEST_ASSERT_EQUAL(3 * TEST_BATCH, env.rtc.dropped);
+  TEST_ASSERT_EQUAL(0, env.rtc.link.channel);
+
+  // back up: the next try publishes the newest readings, the gap shows in seq
+  env.channel = 6;
+  env.answer = 1;
+  for(i = 0; i < OM2M_DUTY_BACKOFF_MAX + 1 && env.rtc.fails; i++)
+    test_duty_wake(&duty);
+  TEST_ASSERT_EQUAL(0, env.rtc.fails);
+  TEST_ASSERT_EQUAL(0, env.rtc.num);
+  TEST_ASSERT_EQUAL(2, env.rtc.published);
+  TEST_ASSERT_EQUAL(0, env.radio_off_joins);
+  TEST_ASSERT_EQUAL(env.rtc.seq, env.rtc.wakes);
+  snprintf(con, sizeof(con), "\"con\":\"%u;", (unsigned)(env.rtc.wakes - TEST_BATCH));
+  TEST_ASSERT_NOT_NULL(strstr(env.last.pc, con));
+
+  // an error from the CSE is a failure as well
+  env.rsc = 4004;
+  for(i = 0; i < TEST_BATCH; i++)
+    test_duty_wake(&duty);
+  TEST_ASSERT_EQUAL(-1, duty.published);
+  TEST_ASSERT_EQUAL(1, env.rtc.fails);
+}
+
+void test_om2m_duty_provision(void) {
+  static const om2m_duty_state_t path[] = {
+    OM2M_DUTY_SAMPLE, OM2M_DUTY_CONNECT, OM2M_DUTY_PUBLISH, OM2M_DUTY_SLEEP, OM2M_DUTY_DONE
+  };
+  om2m_duty_t duty;
+  int i;
+
+  test_duty_power_on();
+  env.provisioning = 1;
+  for(i = 0; i < TEST_BATCH - 1; i++)
+    test_duty_wake(&duty);
+
+  // the CSE never answers: provisioning gives up and the wake still goes to sleep
+  env.answer = 0;
+  test_duty_reset(&duty);
+  for(i = 0; i < sizeof(path) / sizeof(path[0]); i++)
+    TEST_ASSERT_EQUAL(path[i], om2m_duty_step(&duty));
+  om2m_client_close(&client);
+
+  TEST_ASSERT_EQUAL(-1, duty.published);
+  TEST_ASSERT_EQUAL(1, env.provisions);
+  TEST_ASSERT_EQUAL(1, env.sent);
+  TEST_ASSERT_EQUAL(OM2M_TY_AE, env.last.ty);
+  TEST_ASSERT_EQUAL(TEST_BATCH, env.sleeps);
+  TEST_ASSERT_EQUAL(0, env.radio);
+  TEST_ASSERT_EQUAL(1, env.rtc.fails);
+  TEST_ASSERT_EQUAL(TEST_BATCH, env.rtc.num);
+  TEST_ASSERT_TRUE(env.now <= TEST_SAMPLE_MS + TEST_SCAN_MS + TEST_DHCP_MS + OM2M_DUTY_PROVISION_MS + OM2M_DUTY_POLL_MS);
+
+  // answered again: the next try provisions, then publishes the batch
+  env.answer = 1;
+  for(i = 0; i < OM2M_DUTY_BACKOFF_MAX + 1 && env.rtc.fails; i++)
+    test_duty_wake(&duty);
+  TEST_ASSERT_EQUAL(1, duty.published);
+  TEST_ASSERT_EQUAL(2, env.provisions);
+  TEST_ASSERT_EQUAL(1, env.rtc.published);
+
+  // the resources are there for the rest of the power on
+  for(i = 0; i < TEST_BATCH; i++)
+    test_duty_wake(&duty);
+  TEST_ASSERT_EQUAL(1, duty.published);
+  TEST_ASSERT_EQUAL(2, env.provisions);
+  TEST_ASSERT_EQUAL(2, env.rtc.published);
+}
+
+void test_om2m_duty_content(void) {
+  om2m_duty_rtc_t rtc;
+  char buf[OM2M_PC_MAX];
+  om2m_request_t request;
+  int i;
+
+  memset(&rtc, 0, sizeof(rtc));
+  rtc.seq = 4294967295u;
+  TEST_ASSERT_EQUAL(11, om2m_duty_content(&rtc, buf, sizeof(buf)));
+  TEST_ASSERT_EQUAL_STRING("4294967295;", buf);
+
+  // a full batch of the widest values still fits one content instance
+  rtc.num = OM2M_DUTY_BATCH;
+  for(i = 0; i < OM2M_DUTY_BATCH; i++) {
+    rtc.batch[i].value[0] = -32768;
+    rtc.batch[i].value[1] = 255;
+  }
+  TEST_ASSERT_TRUE(om2m_duty_content(&rtc, buf, sizeof(buf)) > 0);
+  TEST_ASSERT_TRUE(om2m_pc_cin(request.pc, sizeof(request.pc), NULL, buf) > 0);
+  TEST_ASSERT_TRUE(om2m_cbor_cin(request.pc, sizeof(request.pc), NULL, buf) > 0);
+  TEST_ASSERT_EQUAL(-1, om2m_duty_content(&rtc, buf, 20));
+
+  rtc.num = 2;
+  rtc.seq = 7;
+  rtc.batch[1].value[0] = 72;
+  rtc.batch[1].value[1] = 97;
+  om2m_duty_content(&rtc, buf, sizeof(buf));
+  TEST_ASSERT_EQUAL_STRING("7;-32768:255,72:97", buf);
+}
+
+void test_om2m_duty_benchmark(void) {
+  om2m_duty_t duty;
+  uint32_t always_on_ms, duty_on_ms = 0;
+  int i, wakes = 10 * TEST_BATCH;
+
+  test_duty_power_on();
+  for(i = 0; i < wakes; i++) {
+    test_duty_wake(&duty);
+    // the radio is only on for the wakes that publish
+    if(env.rtc.latency.count && duty.published)
+      duty_on_ms += env.rtc.latency.last;
+  }
+
+  always_on_ms = wakes * TEST_PERIOD_MS;
+  printf("duty cycle, %d wakes %d s apart, batch of %d: wake to publish %u ms first, %u ms cached (avg %u ms), "
+         "radio on %u ms of %u ms (%.2f%%)\n",
+         wakes, TEST_PERIOD_MS / 1000, TEST_BATCH, (unsigned)env.rtc.latency.max, (unsigned)env.rtc.latency.min,
+         (unsigned)(env.rtc.latency.sum / env.rtc.latency.count), (unsigned)duty_on_ms, (unsigned)always_on_ms,
+         100.0 * duty_on_ms / always_on_ms);
+  TEST_ASSERT_EQUAL(wakes / TEST_BATCH, env.rtc.latency.count);
+  TEST_ASSERT_TRUE(env.rtc.latency.min * 5 < env.rtc.latency.max);
+}
@@ -0,0 +1,242 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "unity.h"
+#include "om2m/http.h"
+
+#define TEST_HTTP_COUNT 2000
+
+typedef struct {
+  char data[256];
+  size_t len;
+} test_body_t;
+
+static void test_body_cb(void *arg, const char *data, size_t len) {
+  test_body_t *body = arg;
+
+  TEST_ASSERT_TRUE(body->len + len < sizeof(body->data));
+  memcpy(body->data + body->len, data, len);
+  body->len += len;
+  body->data[body->len] = '\0';
+}
+
+static uint64_t test_time_us(void) {
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+void test_http_parser_content_length(void) {
+  const char rsp[] = "HTTP/1.1 201 Created\r\nX-M2M-RSC: 2001\r\ncontent-length: 11\r\n\r\n{\"m2m:cin\"}";
+  om2m_http_parser_t parser;
+  test_body_t body = { .len = 0 };
+
+  // one byte at a time, the parser must not depend on read boundaries
+  om2m_http_parser_init(&parser, test_body_cb, &body);
+  for(size_t i = 0; i < strlen(rsp); i++)
+    TEST_ASSERT_EQUAL(1, om2m_http_parser_feed(&parser, rsp + i, 1));
+
+  TEST_ASSERT_TRUE(om2m_http_parser_done(&parser));
+  TEST_ASSERT_EQUAL(201, parser.response.status);
+  TEST_ASSERT_EQUAL(2001, parser.response.rsc);
+  TEST_ASSERT_EQUAL(1, parser.response.keep_alive);
+  TEST_ASSERT_EQUAL_STRING("{\"m2m:cin\"}", body.data);
+}
+
+void test_http_parser_chunked(void) {
+  const char rsp[] = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\nConnection: close\r\n\r\n4\r\nWiki\r\n5;ext=1\r\npedia\r\n0\r\nX-Trailer: 1\r\n\r\n";
+  om2m_http_parser_t parser;
+  test_body_t body = { .len = 0 };
+
+  om2m_http_parser_init(&parser, test_body_cb, &body);
+  TEST_ASSERT_EQUAL(strlen(rsp), om2m_http_parser_feed(&parser, rsp, strlen(rsp)));
+  TEST_ASSERT_TRUE(om2m_http_parser_done(&parser));
+  TEST_ASSERT_EQUAL(200, parser.response.status);
+  TEST_ASSERT_EQUAL(0, parser.response.keep_alive);
+  TEST_ASSERT_EQUAL_STRING("Wikipedia", body.data);
+}
+
+void test_http_parser_pipelined(void) {
+  const char first[] = "HTTP/1.1 201 Created\r\nX-M2M-RSC: 2001\r\nContent-Length: 2\r\n\r\nok";
+  const char second[] = "HTTP/1.1 409 Conflict\r\nX-M2M-RSC: 4105\r\nContent-Length: 0\r\n\r\n";
+  char both[sizeof(first) + sizeof(second)];
+  om2m_http_parser_t parser;
+
+  sprintf(both, "%s%s", first, second);
+
+  om2m_http_parser_init(&parser, NULL, NULL);
+  TEST_ASSERT_EQUAL(strlen(first), om2m_http_parser_feed(&parser, both, strlen(both)));
+  TEST_ASSERT_EQUAL(2001, parser.response.rsc);
+
+  om2m_http_parser_init(&parser, NULL, NULL);
+  TEST_ASSERT_EQUAL(strlen(second), om2m_http_parser_feed(&parser, both + strlen(first), strlen(second)));
+  TEST_ASSERT_TRUE(om2m_http_parser_done(&parser));
+  TEST_ASSERT_EQUAL(409, parser.response.status);
+  TEST_ASSERT_EQUAL(4105, parser.response.rsc);
+}
+
+void test_http_parser_malformed(void) {
+  const char rsp[] = "ICY 200 OK\r\n\r\n";
+  om2m_http_parser_t parser;
+
+  om2m_http_parser_init(&parser, NULL, NULL);
+  TEST_ASSERT_EQUAL(-1, om2m_http_parser_feed(&parser, rsp, strlen(rsp)));
+}
+
+/*
+ * Minimal stand-in for the CSE HTTP binding: answers every request with
+ * 201 and keeps the connection open until the client closes it.
+ */
+static int test_server_fd;
+static int test_server_port;
+
+static void *test_http_server(void *arg) {
+  static char buf[4096];
+  static char out[4096];
+
+  while(1) {
+    int fd = accept(test_server_fd, NULL, NULL);
+    size_t len = 0;
+
+    if(fd < 0)
+      break;
+
+    while(1) {
+      size_t out_len = 0;
+      int res = read(fd, buf + len, sizeof(buf) - len);
+      if(res <= 0)
+        break;
+      len += res;
+
+      // answer every complete request in the buffer, pipelined ones with a single write
+      while(1) {
+        const char content[] = "{\"m2m:cin\":{\"rn\":\"x\"}}";
+        char *end = memmem(buf, len, "\r\n\r\n", 4);
+        char *cl;
+        size_t body, total;
+
+        if(end == NULL)
+          break;
+        *end = '\0';
+        cl = strstr(buf, "Content-Length: ");
+        body = cl ? strtoul(cl + 16, NULL, 10) : 0;
+        *end = '\r';
+        total = end + 4 - buf + body;
+        if(total > len || out_len + 160 > sizeof(out))
+          break;
+
+        out_len += sprintf(out + out_len, "HTTP/1.1 201 Created\r\nX-M2M-RSC: 2001\r\nContent-Type: application/json\r\nContent-Length: %d\r\n\r\n%s",
+                           (int)strlen(content), content);
+
+        memmove(buf, buf + total, len - total);
+        len -= total;
+      }
+      if(out_len && write(fd, out, out_len) < 0)
+        break;
+    }
+    close(fd);
+  }
+
+  return NULL;
+}
+
+static void test_http_server_start(void) {
+  static pthread_t thread;
+  struct sockaddr_in addr;
+  socklen_t addr_len = sizeof(addr);
+  int one = 1;
+
+  if(test_server_port)
+    return;
+
+  test_server_fd = socket(AF_INET, SOCK_STREAM, 0);
+  setsockopt(test_server_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  TEST_ASSERT_EQUAL(0, bind(test_server_fd, (struct sockaddr *)&addr, sizeof(addr)));
+  TEST_ASSERT_EQUAL(0, listen(test_server_fd, 16));
+  getsockname(test_server_fd, (struct sockaddr *)&addr, &addr_len);
+  test_server_port = ntohs(addr.sin_port);
+
+  pthread_create(&thread, NULL, test_http_server, NULL);
+}
+
+void test_http_client_loopback(void) {
+  om2m_http_client_t client;
+  om2m_http_response_t rsp;
+  test_body_t body = { .len = 0 };
+
+  test_http_server_start();
+  TEST_ASSERT_EQUAL(0, om2m_http_client_init(&client, "127.0.0.1", test_server_port));
+
+  TEST_ASSERT_EQUAL(0, om2m_http_create_container(&client, "ESP8266", "HR"));
+  TEST_ASSERT_EQUAL(0, om2m_http_create_content_instance(&client, "ESP8266", "HR", "HB_0", "42"));
+  TEST_ASSERT_EQUAL(2, client.pending);
+
+  TEST_ASSERT_EQUAL(201, om2m_http_client_response(&client, &rsp, test_body_cb, &body));
+  TEST_ASSERT_EQUAL(2001, rsp.rsc);
+  TEST_ASSERT_EQUAL_STRING("{\"m2m:cin\":{\"rn\":\"x\"}}", body.data);
+  TEST_ASSERT_EQUAL(201, om2m_http_client_response(&client, &rsp, NULL, NULL));
+  TEST_ASSERT_EQUAL(0, client.pending);
+
+  // a dropped idle connection is transparently reopened
+  close(client.fd);
+  client.fd = socket(AF_INET, SOCK_STREAM, 0);
+  TEST_ASSERT_EQUAL(0, om2m_http_delete(&client, "/~/in-cse/dartes/ESP8266/HR/HB_0"));
+  TEST_ASSERT_EQUAL(201, om2m_http_client_response(&client, &rsp, NULL, NULL));
+
+  om2m_http_client_close(&client);
+}
+
+void test_http_client_benchmark(void) {
+  const char payload[] = "{\"m2m:cin\":{\"con\":\"70.000000:0.000000\",\"cnf\":\"text/plain:19\",\"rn\":\"HB_1\"}}";
+  const char *url = "/~/in-cse/dartes/ESP8266/HR";
+  om2m_http_client_t client;
+  uint64_t start, per_request, persistent, pipelined;
+  int i;
+
+  test_http_server_start();
+  om2m_http_client_init(&client, "127.0.0.1", test_server_port);
+
+  start = test_time_us();
+  for(i = 0; i < TEST_HTTP_COUNT; i++) {
+    TEST_ASSERT_EQUAL(0, om2m_http_client_request(&client, "POST", url, 4, payload, strlen(payload)));
+    TEST_ASSERT_EQUAL(201, om2m_http_client_response(&client, NULL, NULL, NULL));
+    om2m_http_client_close(&client);
+  }
+  per_request = test_time_us() - start;
+
+  start = test_time_us();
+  for(i = 0; i < TEST_HTTP_COUNT; i++) {
+    TEST_ASSERT_EQUAL(0, om2m_http_client_request(&client, "POST", url, 4, payload, strlen(payload)));
+    TEST_ASSERT_EQUAL(201, om2m_http_client_response(&client, NULL, NULL, NULL));
+  }
+  persistent = test_time_us() - start;
+
+  start = test_time_us();
+  for(i = 0; i < TEST_HTTP_COUNT; i += OM2M_HTTP_PIPELINE_DEPTH) {
+    int j;
+    for(j = 0; j < OM2M_HTTP_PIPELINE_DEPTH; j++)
+      TEST_ASSERT_EQUAL(0, om2m_http_client_request(&client, "POST", url, 4, payload, strlen(payload)));
+    for(j = 0; j < OM2M_HTTP_PIPELINE_DEPTH; j++)
+      TEST_ASSERT_EQUAL(201, om2m_http_client_response(&client, NULL, NULL, NULL));
+  }
+  pipelined = test_time_us() - start;
+
+  om2m_http_client_close(&client);
+
+  printf("http %d requests: connection per request %llu req/s, keep-alive %llu req/s, pipelined x%d %llu req/s\n",
+         TEST_HTTP_COUNT,
+         TEST_HTTP_COUNT * 1000000ULL / per_request,
+         TEST_HTTP_COUNT * 1000000ULL / persistent,
+         OM2M_HTTP_PIPELINE_DEPTH,
+         TEST_HTTP_COUNT * 1000000ULL / pipelined);
+}
@@ -0,0 +1,170 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "unity.h"
+#include "om2m/http.h"
+#include "om2m/http_server.h"
+
+#define TEST_NOTIFY_COUNT 5000
+#define TEST_NOTIFY_PORT 18096
+
+static const char test_sgn[] = "{\"m2m:sgn\":{\"m2m:nev\":{\"m2m:rep\":{\"m2m:cin\":{\"con\":\"1\"}}},\"m2m:sur\":\"/in-cse/sub-1\"}}";
+
+void test_http_request_parse(void) {
+  char req[256];
+  om2m_http_request_t request;
+  const om2m_http_str_t *value;
+  int len;
+
+  len = sprintf(req, "POST /ESP8266/sub HTTP/1.1\r\nX-M2M-Origin: /in-cse\r\nContent-Length: %d\r\nContent-Type: application/json\r\n\r\n%s",
+                (int)strlen(test_sgn), test_sgn);
+
+  // every prefix is incomplete, nothing is consumed until the body is there
+  for(int i = 0; i < len; i++)
+    TEST_ASSERT_EQUAL(0, om2m_http_parse_request(req, i, &request));
+
+  TEST_ASSERT_EQUAL(len, om2m_http_parse_request(req, len, &request));
+  TEST_ASSERT_EQUAL(4, request.method.len);
+  TEST_ASSERT_EQUAL_STRING_LEN("POST", request.method.p, 4);
+  TEST_ASSERT_EQUAL_STRING_LEN("/ESP8266/sub", request.path.p, request.path.len);
+  TEST_ASSERT_EQUAL(1, request.keep_alive);
+  TEST_ASSERT_EQUAL(3, request.num_headers);
+
+  // the body is a view into the receive buffer, not a copy
+  TEST_ASSERT_EQUAL_PTR(req + len - strlen(test_sgn), request.body.p);
+  TEST_ASSERT_EQUAL(strlen(test_sgn), request.body.len);
+
+  value = om2m_http_request_header(&request, "x-m2m-origin");
+  TEST_ASSERT_NOT_NULL(value);
+  TEST_ASSERT_EQUAL_STRING_LEN("/in-cse", value->p, value->len);
+  TEST_ASSERT_NULL(om2m_http_request_header(&request, "X-M2M-RI"));
+}
+
+void test_http_request_parse_malformed(void) {
+  om2m_http_request_t request;
+  const char *bad[] = {
+    "POST\r\n\r\n",
+    "POST / SPDY/3\r\n\r\n",
+    "POST / HTTP/1.1\r\nno colon\r\n\r\n",
+    "POST / HTTP/1.1\r\nContent-Length: -1\r\n\r\n",
+  };
+
+  for(int i = 0; i < sizeof(bad) / sizeof(bad[0]); i++)
+    TEST_ASSERT_EQUAL(-1, om2m_http_parse_request(bad[i], strlen(bad[i]), &request));
+}
+
+/**
+ * Headers past OM2M_HTTP_SERVER_MAX_HEADERS are not stored, but the ones
+ * framing the request still apply, or the body would be read as the next request
+ * */
+void test_http_request_parse_many_headers(void) {
+  char req[1024], *p = req;
+  om2m_http_request_t request;
+  int len, i;
+
+  p += sprintf(p, "POST /ESP8266/sub HTTP/1.1\r\n");
+  for(i = 0; i < OM2M_HTTP_SERVER_MAX_HEADERS + 4; i++)
+    p += sprintf(p, "X-Pad-%d: %d\r\n", i, i);
+  p += sprintf(p, "Content-Length: %d\r\nConnection: close\r\n\r\n%s", (int)strlen(test_sgn), test_sgn);
+  len = p - req;
+
+  TEST_ASSERT_EQUAL(0, om2m_http_parse_request(req, len - 1, &request));
+  TEST_ASSERT_EQUAL(len, om2m_http_parse_request(req, len, &request));
+  TEST_ASSERT_EQUAL(OM2M_HTTP_SERVER_MAX_HEADERS, request.num_headers);
+  TEST_ASSERT_EQUAL(strlen(test_sgn), request.body.len);
+  TEST_ASSERT_EQUAL_STRING_LEN(test_sgn, request.body.p, request.body.len);
+  TEST_ASSERT_EQUAL(0, request.keep_alive);
+  TEST_ASSERT_NULL(om2m_http_request_header(&request, "Content-Length"));
+
+  // neither is a chunked body taken for the next request
+  p = req + sprintf(req, "POST /ESP8266/sub HTTP/1.1\r\n");
+  for(i = 0; i < OM2M_HTTP_SERVER_MAX_HEADERS; i++)
+    p += sprintf(p, "X-Pad-%d: %d\r\n", i, i);
+  p += sprintf(p, "Transfer-Encoding: chunked\r\n\r\n");
+  TEST_ASSERT_EQUAL(-1, om2m_http_parse_request(req, p - req, &request));
+}
+
+typedef struct {
+  int count;
+  size_t bytes;
+} test_notify_t;
+
+static int test_notify_handler(void *arg, const om2m_http_request_t *request) {
+  test_notify_t *notify = arg;
+
+  if(request->body.len != strlen(test_sgn) || memcmp(request->body.p, test_sgn, request->body.len))
+    return 400;
+
+  notify->count++;
+  notify->bytes += request->body.len;
+  return 200;
+}
+
+static volatile int test_server_stop;
+
+static void *test_server_task(void *arg) {
+  om2m_http_server_t *server = arg;
+
+  while(!test_server_stop)
+    om2m_http_server_poll(server, 10);
+
+  return NULL;
+}
+
+static uint64_t test_time_us(void) {
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+void test_http_server_loopback(void) {
+  static om2m_http_server_t server;
+  test_notify_t notify = { 0 };
+  om2m_http_client_t client;
+  om2m_http_response_t rsp;
+  pthread_t thread;
+  uint64_t start, elapsed;
+  int i, j;
+
+  TEST_ASSERT_EQUAL(0, om2m_http_server_init(&server, TEST_NOTIFY_PORT));
+  TEST_ASSERT_EQUAL(0, om2m_http_server_route(&server, "/ESP8266/sub", test_notify_handler, &notify));
+  test_server_stop = 0;
+  pthread_create(&thread, NULL, test_server_task, &server);
+
+  TEST_ASSERT_EQUAL(0, om2m_http_client_init(&client, "127.0.0.1", TEST_NOTIFY_PORT));
+
+  // unknown subscription path
+  TEST_ASSERT_EQUAL(0, om2m_http_client_request(&client, "POST", "/nobody", 0, test_sgn, strlen(test_sgn)));
+  TEST_ASSERT_EQUAL(404, om2m_http_client_response(&client, &rsp, NULL, NULL));
+  TEST_ASSERT_EQUAL(4004, rsp.rsc);
+
+  // keep-alive, with pipelined notifications
+  start = test_time_us();
+  for(i = 0; i < TEST_NOTIFY_COUNT; i += OM2M_HTTP_PIPELINE_DEPTH) {
+    for(j = 0; j < OM2M_HTTP_PIPELINE_DEPTH; j++)
+      TEST_ASSERT_EQUAL(0, om2m_http_client_request(&client, "POST", "/ESP8266/sub", 0, test_sgn, strlen(test_sgn)));
+    for(j = 0; j < OM2M_HTTP_PIPELINE_DEPTH; j++) {
+      TEST_ASSERT_EQUAL(200, om2m_http_client_response(&client, &rsp, NULL, NULL));
+      TEST_ASSERT_EQUAL(2000, rsp.rsc);
+      TEST_ASSERT_EQUAL(1, rsp.keep_alive);
+    }
+  }
+  elapsed = test_time_us() - start;
+
+  om2m_http_client_close(&client);
+  test_server_stop = 1;
+  pthread_join(thread, NULL);
+  om2m_http_server_close(&server);
+
+  TEST_ASSERT_EQUAL(TEST_NOTIFY_COUNT, notify.count);
+
+  printf("http server: %d notifications on one connection, %llu notifications/s\n",
+         TEST_NOTIFY_COUNT, TEST_NOTIFY_COUNT * 1000000ULL / elapsed);
+}
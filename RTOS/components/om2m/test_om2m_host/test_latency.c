@@ -0,0 +1,337 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "unity.h"
+#include "om2m/om2m.h"
+#include "om2m/coap.h"
+#include "om2m/latency.h"
+
+#define TEST_CSE		"/in-cse/dartes"
+#define TEST_ORIGINATOR		"admin:admin"
+#define TEST_LATENCY_SEND_US	200	// the test binding takes this long to send
+#define TEST_LATENCY_COUNT	100000
+
+static uint32_t s_now_us;
+static char s_sent_rqi[4][OM2M_RQI_MAX];
+static int s_sent;
+
+static uint32_t test_latency_now(void) {
+  return s_now_us;
+}
+
+static int test_latency_send(om2m_client_t *client, const om2m_request_t *request) {
+  s_now_us += TEST_LATENCY_SEND_US;
+  strcpy(s_sent_rqi[s_sent++ % 4], request->rqi);
+  return 0;
+}
+
+static const om2m_binding_t test_latency_binding = {
+  .name = "test",
+  .send = test_latency_send,
+};
+
+static void test_latency_cb(void *arg, const om2m_response_t *response) {
+  (*(int *)arg)++;
+}
+
+static void test_latency_respond(om2m_client_t *client, const char *rqi) {
+  om2m_response_t response;
+
+  memset(&response, 0, sizeof(response));
+  response.rqi = rqi;
+  response.rsc = 2001;
+  TEST_ASSERT_EQUAL(0, om2m_client_response(client, &response));
+}
+
+static uint64_t test_latency_time_ns(void) {
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000000000ULL + tv.tv_usec * 1000ULL;
+}
+
+static void test_latency_near(uint32_t expected, uint32_t actual) {
+  // a bucket spans 1/8 of its power of two
+  TEST_ASSERT_UINT32_WITHIN(expected / 8 + 1, expected, actual);
+}
+
+void test_om2m_latency_histogram(void) {
+  static om2m_latency_hist_t hist;
+  uint32_t us, sum;
+  int i;
+
+  memset(&hist, 0, sizeof(hist));
+  hist.min = UINT32_MAX;
+  TEST_ASSERT_EQUAL(0, om2m_latency_percentile(&hist, 500));
+
+  // small values are exact
+  for(us = 0; us < 8; us++)
+    om2m_latency_record(&hist, us);
+  TEST_ASSERT_EQUAL(3, om2m_latency_percentile(&hist, 500));
+  TEST_ASSERT_EQUAL(7, om2m_latency_percentile(&hist, 1000));
+  TEST_ASSERT_EQUAL(0, om2m_latency_percentile(&hist, 0));
+
+  // uniform over 1 us to 100 ms
+  memset(&hist, 0, sizeof(hist));
+  hist.min = UINT32_MAX;
+  for(us = 1; us <= TEST_LATENCY_COUNT; us++)
+    om2m_latency_record(&hist, us);
+  TEST_ASSERT_EQUAL(TEST_LATENCY_COUNT, hist.count);
+  test_latency_near(50000, om2m_latency_percentile(&hist, 500));
+  test_latency_near(99000, om2m_latency_percentile(&hist, 990));
+  TEST_ASSERT_EQUAL(TEST_LATENCY_COUNT, om2m_latency_percentile(&hist, 1000));
+  TEST_ASSERT_EQUAL(1, hist.min);
+
+  // past the last bucket only max is known
+  om2m_latency_record(&hist, 20000000);
+  TEST_ASSERT_EQUAL(20000000, om2m_latency_percentile(&hist, 1000));
+
+  // a full bucket halves them all, the shape stays
+  memset(&hist, 0, sizeof(hist));
+  hist.min = UINT32_MAX;
+  for(i = 0; i < 70000; i++) {
+    om2m_latency_record(&hist, 5);
+    om2m_latency_record(&hist, 1000);
+  }
+  for(i = 0, sum = 0; i < OM2M_LATENCY_BUCKETS; i++)
+    sum += hist.bucket[i];
+  TEST_ASSERT_EQUAL(sum, hist.count);
+  TEST_ASSERT_TRUE(hist.count < 2 * 65536);
+  TEST_ASSERT_EQUAL(5, om2m_latency_percentile(&hist, 250));
+  TEST_ASSERT_EQUAL(1000, om2m_latency_percentile(&hist, 990));
+}
+
+void test_om2m_latency_client(void) {
+  static om2m_latency_t latency;
+  om2m_latency_summary_t summary;
+  om2m_request_t request;
+  om2m_client_t client;
+  char report[OM2M_LATENCY_REPORT_MAX];
+  int calls = 0;
+
+  s_now_us = 1000;
+  s_sent = 0;
+  TEST_ASSERT_EQUAL(0, om2m_client_init(&client, &test_latency_binding, NULL, TEST_CSE, TEST_ORIGINATOR));
+  TEST_ASSERT_EQUAL(-1, om2m_latency_report(&client, report, sizeof(report)));
+
+  latency.now_us = test_latency_now;
+  om2m_client_latency(&client, &latency);
+
+  // acknowledged at 1 ms, answered at 5 ms
+  TEST_ASSERT_EQUAL(0, om2m_create_ae(&client, "ae", 1234, NULL, test_latency_cb, &calls));
+  s_now_us += 1000;
+  TEST_ASSERT_EQUAL(0, om2m_client_ack(&client, s_sent_rqi[0]));
+  TEST_ASSERT_EQUAL(0, om2m_client_ack(&client, s_sent_rqi[0]));
+  s_now_us += 4000 - TEST_LATENCY_SEND_US;
+  test_latency_respond(&client, s_sent_rqi[0]);
+
+  // answered at 8 ms, no acknowledgement
+  TEST_ASSERT_EQUAL(0, om2m_create_container(&client, "ae", "DATA", test_latency_cb, &calls));
+  s_now_us += 8000 - TEST_LATENCY_SEND_US;
+  test_latency_respond(&client, s_sent_rqi[1]);
+  TEST_ASSERT_EQUAL(-1, om2m_client_ack(&client, s_sent_rqi[1]));
+
+  // never answered
+  TEST_ASSERT_EQUAL(0, om2m_create_content_instance(&client, "ae", "DATA", NULL, "1", test_latency_cb, &calls));
+  TEST_ASSERT_EQUAL(1, om2m_client_expire(&client, om2m_now_ms() + OM2M_TIMEOUT_MS + 1));
+  TEST_ASSERT_EQUAL(3, calls);
+
+  // built by hand, measured from om2m_client_send
+  memset(&request, 0, sizeof(request));
+  request.op = OM2M_OP_RETRIEVE;
+  strcpy(request.to, TEST_CSE "/ae");
+  TEST_ASSERT_EQUAL(0, om2m_client_send(&client, &request, test_latency_cb, &calls));
+  s_now_us += 300 - TEST_LATENCY_SEND_US;
+  test_latency_respond(&client, s_sent_rqi[3]);
+
+  TEST_ASSERT_EQUAL(0, om2m_latency_get(&client, OM2M_OP_CREATE, OM2M_LATENCY_SEND, &summary));
+  TEST_ASSERT_EQUAL(3, summary.count);
+  TEST_ASSERT_EQUAL(TEST_LATENCY_SEND_US, summary.p50);
+  TEST_ASSERT_EQUAL(TEST_LATENCY_SEND_US, summary.max);
+
+  TEST_ASSERT_EQUAL(0, om2m_latency_get(&client, OM2M_OP_CREATE, OM2M_LATENCY_ACK, &summary));
+  TEST_ASSERT_EQUAL(1, summary.count);
+  TEST_ASSERT_EQUAL(1000, summary.max);
+
+  TEST_ASSERT_EQUAL(0, om2m_latency_get(&client, OM2M_OP_CREATE, OM2M_LATENCY_RESPONSE, &summary));
+  TEST_ASSERT_EQUAL(2, summary.count);
+  test_latency_near(5000, summary.p50);
+  TEST_ASSERT_EQUAL(8000, summary.p99);
+  TEST_ASSERT_EQUAL(8000, summary.max);
+  TEST_ASSERT_EQUAL(1, latency.timeouts[OM2M_OP_CREATE - 1]);
+
+  TEST_ASSERT_EQUAL(0, om2m_latency_get(&client, OM2M_OP_RETRIEVE, OM2M_LATENCY_RESPONSE, &summary));
+  TEST_ASSERT_EQUAL(1, summary.count);
+  TEST_ASSERT_EQUAL(300, summary.max);
+  TEST_ASSERT_EQUAL(-1, om2m_latency_get(&client, OM2M_OP_NOTIFY + 1, OM2M_LATENCY_SEND, &summary));
+
+  TEST_ASSERT_TRUE(om2m_latency_report(&client, report, sizeof(report)) > 0);
+  TEST_ASSERT_EQUAL_STRING("{\"create\":{\"timeouts\":1,\"send\":[3,200,200,200],\"ack\":[1,1000,1000,1000],\"response\":[2,5119,8000,8000]},"
+                           "\"retrieve\":{\"timeouts\":0,\"send\":[1,200,200,200],\"ack\":[0,0,0,0],\"response\":[1,300,300,300]}}", report);
+  TEST_ASSERT_EQUAL(-1, om2m_latency_report(&client, report, 64));
+
+  // stopped
+  om2m_client_latency(&client, NULL);
+  TEST_ASSERT_EQUAL(-1, om2m_latency_get(&client, OM2M_OP_CREATE, OM2M_LATENCY_SEND, &summary));
+
+  om2m_client_close(&client);
+}
+
+/*
+ * Stand-in CSE on a datagram socket: an empty ACK then a separate
+ * response, or a response piggybacked on the ACK
+ */
+static void test_latency_cse_serve(int fd, int separate) {
+  unsigned char buf[COAP_MAX_PDU_SIZE], rsc[2];
+  struct sockaddr_in from;
+  socklen_t from_len = sizeof(from);
+  coap_pdu_t *request, *ack, *response;
+  int len;
+
+  len = recvfrom(fd, buf, sizeof(buf), 0, (struct sockaddr *)&from, &from_len);
+  TEST_ASSERT_TRUE(len > 0);
+  request = coap_pdu_init(0, 0, 0, COAP_MAX_PDU_SIZE);
+  TEST_ASSERT_TRUE(coap_pdu_parse(buf, len, request));
+  TEST_ASSERT_EQUAL(COAP_MESSAGE_CON, request->hdr->type);
+
+  if(separate) {
+    ack = coap_pdu_init(COAP_MESSAGE_ACK, 0, request->hdr->id, COAP_MAX_PDU_SIZE);
+    TEST_ASSERT_EQUAL(ack->length, sendto(fd, ack->hdr, ack->length, 0, (struct sockaddr *)&from, from_len));
+    coap_delete_pdu(ack);
+    usleep(2000);
+  }
+
+  response = coap_pdu_init(separate ? COAP_MESSAGE_NON : COAP_MESSAGE_ACK, COAP_RESPONSE_CODE(201),
+                           separate ? request->hdr->id + 1 : request->hdr->id, COAP_MAX_PDU_SIZE);
+  coap_add_token(response, request->hdr->token_length, request->hdr->token);
+  coap_add_option(response, ONEM2M_OPTION_RSC, coap_encode_var_bytes(rsc, 2001), rsc);
+  TEST_ASSERT_EQUAL(response->length, sendto(fd, response->hdr, response->length, 0, (struct sockaddr *)&from, from_len));
+
+  coap_delete_pdu(request);
+  coap_delete_pdu(response);
+}
+
+void test_om2m_latency_coap(void) {
+  static om2m_latency_t latency;
+  unsigned char buf[COAP_MAX_PDU_SIZE];
+  char report[OM2M_LATENCY_REPORT_MAX];
+  om2m_latency_summary_t ack, rsp;
+  om2m_coap_binding_t binding;
+  om2m_client_t client;
+  coap_address_t local, dst;
+  coap_context_t *ctx;
+  coap_pdu_t *get, *reply;
+  struct sockaddr_in addr;
+  socklen_t addr_len = sizeof(addr);
+  size_t data_len;
+  unsigned char *data;
+  int fd, port, len, calls = 0, i;
+
+  fd = socket(AF_INET, SOCK_DGRAM, 0);
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  TEST_ASSERT_EQUAL(0, bind(fd, (struct sockaddr *)&addr, sizeof(addr)));
+  getsockname(fd, (struct sockaddr *)&addr, &addr_len);
+  port = ntohs(addr.sin_port);
+
+  coap_address_init(&local);
+  local.addr.sin.sin_family = AF_INET;
+  local.addr.sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  TEST_ASSERT_NOT_NULL(ctx = coap_new_context(&local));
+
+  coap_address_init(&dst);
+  dst.addr.sin.sin_family = AF_INET;
+  dst.addr.sin.sin_port = htons(port);
+  dst.addr.sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  om2m_coap_binding_init(&binding, ctx, &dst, COAP_MESSAGE_CON);
+  TEST_ASSERT_EQUAL(0, om2m_client_init(&client, &om2m_coap_binding, &binding, TEST_CSE, TEST_ORIGINATOR));
+  latency.now_us = NULL;
+  om2m_client_latency(&client, &latency);
+  TEST_ASSERT_EQUAL(0, om2m_coap_latency_resource(ctx, &client));
+  TEST_ASSERT_EQUAL(0, om2m_coap_latency_resource(ctx, &client));
+
+  for(i = 0; i < 2; i++) {
+    TEST_ASSERT_EQUAL(0, om2m_create_container(&client, "ae", "DATA", test_latency_cb, &calls));
+    test_latency_cse_serve(fd, i == 0);
+    while(om2m_client_pending(&client))
+      TEST_ASSERT_TRUE(om2m_client_poll(&client, 1000) > 0);
+  }
+  TEST_ASSERT_EQUAL(2, calls);
+
+  // the empty ACK came 2 ms ahead of the separate response, the piggybacked one with it
+  TEST_ASSERT_EQUAL(0, om2m_latency_get(&client, OM2M_OP_CREATE, OM2M_LATENCY_ACK, &ack));
+  TEST_ASSERT_EQUAL(0, om2m_latency_get(&client, OM2M_OP_CREATE, OM2M_LATENCY_RESPONSE, &rsp));
+  TEST_ASSERT_EQUAL(2, ack.count);
+  TEST_ASSERT_EQUAL(2, rsp.count);
+  TEST_ASSERT_TRUE(rsp.max >= 2000);
+  TEST_ASSERT_TRUE(ack.p50 < 2000);
+
+  // GET /latency from the CSE side
+  len = om2m_latency_report(&client, report, sizeof(report));
+  TEST_ASSERT_TRUE(len > 0);
+
+  addr_len = sizeof(addr);
+  getsockname(ctx->sockfd, (struct sockaddr *)&addr, &addr_len);
+  get = coap_pdu_init(COAP_MESSAGE_CON, COAP_REQUEST_GET, htons(0x1234), COAP_MAX_PDU_SIZE);
+  coap_add_option(get, COAP_OPTION_URI_PATH, strlen(OM2M_COAP_LATENCY_PATH), (unsigned char *)OM2M_COAP_LATENCY_PATH);
+  TEST_ASSERT_EQUAL(get->length, sendto(fd, get->hdr, get->length, 0, (struct sockaddr *)&addr, addr_len));
+  TEST_ASSERT_TRUE(om2m_client_poll(&client, 1000) > 0);
+
+  reply = coap_pdu_init(0, 0, 0, COAP_MAX_PDU_SIZE);
+  TEST_ASSERT_TRUE((i = recv(fd, buf, sizeof(buf), 0)) > 0);
+  TEST_ASSERT_TRUE(coap_pdu_parse(buf, i, reply));
+  TEST_ASSERT_EQUAL(COAP_RESPONSE_CODE(205), reply->hdr->code);
+  TEST_ASSERT_EQUAL(htons(0x1234), reply->hdr->id);
+  TEST_ASSERT_TRUE(coap_get_data(reply, &data_len, &data));
+  TEST_ASSERT_EQUAL(len, data_len);
+  TEST_ASSERT_EQUAL_MEMORY(report, data, len);
+
+  coap_delete_pdu(get);
+  coap_delete_pdu(reply);
+  om2m_client_close(&client);
+  coap_free_context(ctx);
+  close(fd);
+}
+
+void test_om2m_latency_benchmark(void) {
+  static om2m_latency_t latency;
+  om2m_latency_summary_t summary;
+  om2m_request_t request;
+  om2m_client_t client;
+  double ns[2];
+  uint64_t start;
+  int pass, i, calls = 0;
+
+  TEST_ASSERT_EQUAL(0, om2m_client_init(&client, &test_latency_binding, NULL, TEST_CSE, TEST_ORIGINATOR));
+  latency.now_us = NULL;
+
+  // send and response of prebuilt requests, only the bookkeeping of the client
+  for(pass = 0; pass < 2; pass++) {
+    om2m_client_latency(&client, pass ? &latency : NULL);
+    memset(&request, 0, sizeof(request));
+    request.op = OM2M_OP_CREATE;
+    start = test_latency_time_ns();
+    for(i = 0; i < TEST_LATENCY_COUNT; i++) {
+      request.built_us = 0;
+      om2m_client_send(&client, &request, test_latency_cb, &calls);
+      test_latency_respond(&client, request.rqi);
+    }
+    ns[pass] = (double)(test_latency_time_ns() - start) / TEST_LATENCY_COUNT;
+  }
+
+  TEST_ASSERT_EQUAL(2 * TEST_LATENCY_COUNT, calls);
+  TEST_ASSERT_EQUAL(0, om2m_latency_get(&client, OM2M_OP_CREATE, OM2M_LATENCY_RESPONSE, &summary));
+  // a bucket that filled up halved them all on the way
+  TEST_ASSERT_TRUE(summary.count > TEST_LATENCY_COUNT / 4 && summary.count <= TEST_LATENCY_COUNT);
+
+  printf("latency instrumentation, %d requests: %.0f ns per request unmeasured, %.0f ns measured, %u bytes per client\n",
+         TEST_LATENCY_COUNT, ns[0], ns[1], (unsigned)sizeof(latency));
+
+  om2m_client_close(&client);
+}
@@ -0,0 +1,695 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "unity.h"
+#include "cJSON.h"
+#include "om2m/om2m.h"
+#include "om2m/coap.h"
+#include "om2m/http.h"
+#include "om2m/http_server.h"
+#include "om2m/mqtt.h"
+
+#define TEST_CSE		"/in-cse/dartes"
+#define TEST_ORIGINATOR		"admin:admin"
+#define TEST_SERIALIZE_COUNT	100000
+
+typedef struct {
+  int calls;
+  int rsc;
+  char rqi[OM2M_RQI_MAX];
+  char pc[OM2M_HTTP_PC_MAX];
+} test_result_t;
+
+static void test_response_cb(void *arg, const om2m_response_t *response) {
+  test_result_t *result = arg;
+
+  result->calls++;
+  result->rsc = response->rsc;
+  strcpy(result->rqi, response->rqi);
+  TEST_ASSERT_TRUE(response->pc_len < sizeof(result->pc));
+  memcpy(result->pc, response->pc, response->pc_len);
+  result->pc[response->pc_len] = '\0';
+}
+
+static uint64_t test_time_us(void) {
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec * 1000000ULL + tv.tv_usec;
+}
+
+void test_om2m_serialize(void) {
+  char buf[OM2M_PC_MAX];
+  cJSON *json;
+
+  TEST_ASSERT_EQUAL(strlen(buf), om2m_pc_cnt(buf, sizeof(buf), "DATA"));
+  TEST_ASSERT_EQUAL_STRING("{\"m2m:cnt\":{\"rn\":\"DATA\"}}", buf);
+
+  om2m_pc_ae(buf, sizeof(buf), "MAX30100", 1234, "coap://127.0.0.1:5683");
+  TEST_ASSERT_EQUAL_STRING("{\"m2m:ae\":{\"rr\":true,\"api\":1234,\"rn\":\"MAX30100\",\"poa\":[\"coap://127.0.0.1:5683\"]}}", buf);
+
+  om2m_pc_sub(buf, sizeof(buf), "SUB", "/in-cse/dartes/MONITOR");
+  TEST_ASSERT_EQUAL_STRING("{\"m2m:sub\":{\"rn\":\"SUB\",\"nct\":2,\"nu\":[\"/in-cse/dartes/MONITOR\"]}}", buf);
+
+  // escaped content must survive a real JSON parser
+  TEST_ASSERT_TRUE(om2m_pc_cin(buf, sizeof(buf), "cin_1", "say \"hi\"\\\n\x01") > 0);
+  json = cJSON_Parse(buf);
+  TEST_ASSERT_NOT_NULL(json);
+  TEST_ASSERT_EQUAL_STRING("say \"hi\"\\\n\x01", cJSON_GetObjectItem(cJSON_GetObjectItem(json, "m2m:cin"), "con")->valuestring);
+  TEST_ASSERT_EQUAL_STRING("text/plain:11", cJSON_GetObjectItem(cJSON_GetObjectItem(json, "m2m:cin"), "cnf")->valuestring);
+  cJSON_Delete(json);
+
+  // exactly full is fine, one byte short is not
+  TEST_ASSERT_EQUAL(25, om2m_pc_cnt(buf, 25, "DATA"));
+  TEST_ASSERT_EQUAL(-1, om2m_pc_cnt(buf, 24, "DATA"));
+}
+
+void test_om2m_serialize_rqp(void) {
+  om2m_request_t request;
+  char buf[512];
+  cJSON *json, *rqp;
+
+  memset(&request, 0, sizeof(request));
+  request.op = OM2M_OP_CREATE;
+  request.ty = OM2M_TY_CNT;
+  request.fr = TEST_ORIGINATOR;
+  strcpy(request.to, TEST_CSE "/ae");
+  strcpy(request.rqi, "2a");
+  request.pc_len = om2m_pc_cnt(request.pc, sizeof(request.pc), "DATA");
+
+  TEST_ASSERT_TRUE(om2m_rqp(buf, sizeof(buf), &request) > 0);
+  json = cJSON_Parse(buf);
+  TEST_ASSERT_NOT_NULL(json);
+  rqp = cJSON_GetObjectItem(json, "m2m:rqp");
+  TEST_ASSERT_EQUAL_STRING(TEST_ORIGINATOR, cJSON_GetObjectItem(rqp, "m2m:fr")->valuestring);
+  TEST_ASSERT_EQUAL_STRING(TEST_CSE "/ae", cJSON_GetObjectItem(rqp, "m2m:to")->valuestring);
+  TEST_ASSERT_EQUAL_STRING("2a", cJSON_GetObjectItem(rqp, "m2m:rqi")->valuestring);
+  TEST_ASSERT_EQUAL(1, cJSON_GetObjectItem(rqp, "m2m:op")->valueint);
+  TEST_ASSERT_EQUAL(3, cJSON_GetObjectItem(rqp, "m2m:ty")->valueint);
+  TEST_ASSERT_EQUAL_STRING("DATA", cJSON_GetObjectItem(cJSON_GetObjectItem(cJSON_GetObjectItem(rqp, "m2m:pc"), "m2m:cnt"), "rn")->valuestring);
+  cJSON_Delete(json);
+}
+
+/*
+ * Stand-in binding recording what the client sends
+ */
+typedef struct {
+  int sent;
+  int fail;
+  om2m_request_t last;
+  char rqi[OM2M_PENDING_MAX + 2][OM2M_RQI_MAX];
+} test_binding_t;
+
+static int test_binding_send(om2m_client_t *client, const om2m_request_t *request) {
+  test_binding_t *binding = client->binding_ctx;
+
+  if(binding->fail)
+    return -1;
+
+  binding->last = *request;
+  strcpy(binding->rqi[binding->sent++], request->rqi);
+  return 0;
+}
+
+static const om2m_binding_t test_binding = {
+  .name = "test",
+  .send = test_binding_send,
+};
+
+void test_om2m_client_correlation(void) {
+  test_binding_t binding;
+  test_result_t results[OM2M_PENDING_MAX];
+  om2m_response_t response;
+  om2m_client_t client;
+  int i;
+
+  memset(&binding, 0, sizeof(binding));
+  memset(results, 0, sizeof(results));
+  TEST_ASSERT_EQUAL(0, om2m_client_init(&client, &test_binding, &binding, TEST_CSE, TEST_ORIGINATOR));
+
+  TEST_ASSERT_EQUAL(0, om2m_create_content_instance(&client, "ae", "DATA", "cin", "42", test_response_cb, &results[0]));
+  TEST_ASSERT_EQUAL_STRING(TEST_CSE "/ae/DATA", binding.last.to);
+  TEST_ASSERT_EQUAL_STRING(TEST_ORIGINATOR, binding.last.fr);
+  TEST_ASSERT_EQUAL(OM2M_TY_CIN, binding.last.ty);
+  TEST_ASSERT_EQUAL(OM2M_OP_CREATE, binding.last.op);
+
+  for(i = 1; i < OM2M_PENDING_MAX; i++)
+    TEST_ASSERT_EQUAL(0, om2m_create_container(&client, "ae", "DATA", test_response_cb, &results[i]));
+  TEST_ASSERT_EQUAL(OM2M_PENDING_MAX, om2m_client_pending(&client));
+
+  // table full, and the rqis handed out so far are all distinct
+  TEST_ASSERT_EQUAL(-1, om2m_create_container(&client, "ae", "DATA", test_response_cb, NULL));
+  for(i = 1; i < OM2M_PENDING_MAX; i++)
+    TEST_ASSERT_TRUE(strcmp(binding.rqi[i - 1], binding.rqi[i]) != 0);
+
+  // answer in reverse order, every response must reach its own callback
+  memset(&response, 0, sizeof(response));
+  for(i = OM2M_PENDING_MAX - 1; i >= 0; i--) {
+    response.rqi = binding.rqi[i];
+    response.rsc = 2001 + i;
+    TEST_ASSERT_EQUAL(0, om2m_client_response(&client, &response));
+  }
+  for(i = 0; i < OM2M_PENDING_MAX; i++) {
+    TEST_ASSERT_EQUAL(1, results[i].calls);
+    TEST_ASSERT_EQUAL(2001 + i, results[i].rsc);
+    TEST_ASSERT_EQUAL_STRING(binding.rqi[i], results[i].rqi);
+  }
+
+  // duplicates and strangers are dropped
+  response.rqi = binding.rqi[0];
+  TEST_ASSERT_EQUAL(-1, om2m_client_response(&client, &response));
+  response.rqi = "unknown";
+  TEST_ASSERT_EQUAL(-1, om2m_client_response(&client, &response));
+  TEST_ASSERT_EQUAL(0, om2m_client_pending(&client));
+
+  // a failed send does not leak its slot
+  binding.fail = 1;
+  TEST_ASSERT_EQUAL(-1, om2m_create_container(&client, "ae", "DATA", test_response_cb, &results[0]));
+  TEST_ASSERT_EQUAL(0, om2m_client_pending(&client));
+
+  om2m_client_close(&client);
+}
+
+void test_om2m_client_timeout(void) {
+  test_binding_t binding;
+  test_result_t results[2];
+  om2m_response_t response;
+  om2m_client_t client;
+  uint32_t now;
+
+  memset(&binding, 0, sizeof(binding));
+  memset(results, 0, sizeof(results));
+  TEST_ASSERT_EQUAL(0, om2m_client_init(&client, &test_binding, &binding, TEST_CSE, TEST_ORIGINATOR));
+
+  now = om2m_now_ms();
+  TEST_ASSERT_EQUAL(0, om2m_create_ae(&client, "ae", 1, NULL, test_response_cb, &results[0]));
+  client.timeout_ms = 2 * OM2M_TIMEOUT_MS;
+  TEST_ASSERT_EQUAL(0, om2m_create_ae(&client, "ae", 1, NULL, test_response_cb, &results[1]));
+
+  // nothing is due yet
+  TEST_ASSERT_EQUAL(0, om2m_client_expire(&client, now));
+
+  // only the first deadline has passed
+  TEST_ASSERT_EQUAL(1, om2m_client_expire(&client, now + OM2M_TIMEOUT_MS + 1000));
+  TEST_ASSERT_EQUAL(1, results[0].calls);
+  TEST_ASSERT_EQUAL(OM2M_RSC_TIMEOUT, results[0].rsc);
+  TEST_ASSERT_EQUAL_STRING(binding.rqi[0], results[0].rqi);
+  TEST_ASSERT_EQUAL(0, results[1].calls);
+
+  // a late response to the expired request is ignored
+  memset(&response, 0, sizeof(response));
+  response.rqi = binding.rqi[0];
+  response.rsc = 2001;
+  TEST_ASSERT_EQUAL(-1, om2m_client_response(&client, &response));
+  TEST_ASSERT_EQUAL(1, results[0].calls);
+
+  TEST_ASSERT_EQUAL(1, om2m_client_expire(&client, now + 2 * OM2M_TIMEOUT_MS + 1000));
+  TEST_ASSERT_EQUAL(1, results[1].calls);
+  TEST_ASSERT_EQUAL(0, om2m_client_pending(&client));
+
+  om2m_client_close(&client);
+}
+
+static void test_count_cb(void *arg, const om2m_response_t *response) {
+  (*(int *)arg)++;
+}
+
+void test_om2m_client_table(void) {
+  char rqi[OM2M_PENDING_MAX][OM2M_RQI_MAX];
+  int calls[OM2M_PENDING_MAX];
+  om2m_response_t response;
+  test_binding_t binding;
+  om2m_client_t client;
+  int round, i, n = 0;
+
+  memset(&binding, 0, sizeof(binding));
+  memset(&response, 0, sizeof(response));
+  memset(calls, 0, sizeof(calls));
+  TEST_ASSERT_EQUAL(0, om2m_client_init(&client, &test_binding, &binding, TEST_CSE, TEST_ORIGINATOR));
+
+  // keep the table full while completing requests in a shuffled order,
+  // so that probe runs wrap around and get shifted back on removal
+  srand(1);
+  for(i = 0; i < OM2M_PENDING_MAX; i++) {
+    binding.sent = 0;
+    TEST_ASSERT_EQUAL(0, om2m_create_container(&client, "ae", "DATA", test_count_cb, &calls[i]));
+    strcpy(rqi[i], binding.rqi[0]);
+  }
+
+  for(round = 0; round < 20000; round++) {
+    i = rand() % OM2M_PENDING_MAX;
+
+    response.rqi = rqi[i];
+    TEST_ASSERT_EQUAL(0, om2m_client_response(&client, &response));
+    TEST_ASSERT_EQUAL(-1, om2m_client_response(&client, &response));
+    n++;
+
+    binding.sent = 0;
+    TEST_ASSERT_EQUAL(0, om2m_create_container(&client, "ae", "DATA", test_count_cb, &calls[i]));
+    strcpy(rqi[i], binding.rqi[0]);
+    TEST_ASSERT_EQUAL(OM2M_PENDING_MAX, om2m_client_pending(&client));
+  }
+
+  for(i = 0; i < OM2M_PENDING_MAX; i++) {
+    response.rqi = rqi[i];
+    TEST_ASSERT_EQUAL(0, om2m_client_response(&client, &response));
+    n++;
+  }
+  TEST_ASSERT_EQUAL(0, om2m_client_pending(&client));
+
+  for(i = 0; i < OM2M_PENDING_MAX; i++)
+    n -= calls[i];
+  TEST_ASSERT_EQUAL(0, n);
+
+  om2m_client_close(&client);
+}
+
+/*
+ * HTTP binding against a stand-in CSE on a loopback socket,
+ * driven from this thread since every request fits in the socket buffers
+ */
+static int test_cse_listen(int type, int *port) {
+  struct sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+  int fd = socket(AF_INET, type, 0);
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  TEST_ASSERT_EQUAL(0, bind(fd, (struct sockaddr *)&addr, sizeof(addr)));
+  if(type == SOCK_STREAM)
+    TEST_ASSERT_EQUAL(0, listen(fd, 1));
+  getsockname(fd, (struct sockaddr *)&addr, &len);
+  *port = ntohs(addr.sin_port);
+
+  return fd;
+}
+
+static void test_http_cse_serve(int fd, int requests, int echo_rqi) {
+  char buf[2048], tx[2048];
+  size_t len = 0;
+  int tx_len = 0;
+
+  while(requests) {
+    om2m_http_request_t request;
+    const om2m_http_str_t *rqi;
+    int res = om2m_http_parse_request(buf, len, &request);
+
+    if(res == 0) {
+      int n = read(fd, buf + len, sizeof(buf) - len);
+      TEST_ASSERT_TRUE(n > 0);
+      len += n;
+      continue;
+    }
+    TEST_ASSERT_TRUE(res > 0);
+    TEST_ASSERT_EQUAL(0, strncmp(request.path.p, "/~" TEST_CSE, strlen("/~" TEST_CSE)));
+    TEST_ASSERT_NOT_NULL(om2m_http_request_header(&request, "X-M2M-Origin"));
+    TEST_ASSERT_NOT_NULL(rqi = om2m_http_request_header(&request, "X-M2M-RI"));
+
+    tx_len += sprintf(tx + tx_len, "HTTP/1.1 201 Created\r\nX-M2M-RSC: 2001\r\n");
+    if(echo_rqi)
+      tx_len += sprintf(tx + tx_len, "X-M2M-RI: %.*s\r\n", (int)rqi->len, rqi->p);
+    tx_len += sprintf(tx + tx_len, "Content-Length: %d\r\n\r\n{\"rqi\":\"%.*s\"}", 10 + (int)rqi->len, (int)rqi->len, rqi->p);
+
+    memmove(buf, buf + res, len - res);
+    len -= res;
+    requests--;
+  }
+
+  TEST_ASSERT_EQUAL(tx_len, write(fd, tx, tx_len));
+}
+
+void test_om2m_binding_http(void) {
+  om2m_http_binding_t binding;
+  om2m_client_t client;
+  test_result_t results[3];
+  int listen_fd, port, fd, i;
+
+  memset(results, 0, sizeof(results));
+  listen_fd = test_cse_listen(SOCK_STREAM, &port);
+
+  TEST_ASSERT_EQUAL(0, om2m_http_binding_init(&binding, "127.0.0.1", port));
+  TEST_ASSERT_EQUAL(0, om2m_client_init(&client, &om2m_http_binding, &binding, TEST_CSE, TEST_ORIGINATOR));
+
+  // three pipelined requests, the CSE echoes X-M2M-RI
+  TEST_ASSERT_EQUAL(0, om2m_create_ae(&client, "ae", 1234, "http://127.0.0.1:96", test_response_cb, &results[0]));
+  TEST_ASSERT_EQUAL(0, om2m_create_container(&client, "ae", "DATA", test_response_cb, &results[1]));
+  TEST_ASSERT_EQUAL(0, om2m_create_subscription(&client, "ae", "DATA", "MONITOR", "SUB", test_response_cb, &results[2]));
+
+  fd = accept(listen_fd, NULL, NULL);
+  test_http_cse_serve(fd, 3, 1);
+
+  TEST_ASSERT_EQUAL(3, om2m_client_poll(&client, 1000));
+  for(i = 0; i < 3; i++) {
+    char pc[32];
+
+    sprintf(pc, "{\"rqi\":\"%s\"}", results[i].rqi);
+    TEST_ASSERT_EQUAL(1, results[i].calls);
+    TEST_ASSERT_EQUAL(2001, results[i].rsc);
+    TEST_ASSERT_EQUAL_STRING(pc, results[i].pc);
+  }
+
+  // without X-M2M-RI the responses are matched by order
+  memset(results, 0, sizeof(results));
+  TEST_ASSERT_EQUAL(0, om2m_create_content_instance(&client, "ae", "DATA", "cin_1", "1", test_response_cb, &results[0]));
+  TEST_ASSERT_EQUAL(0, om2m_create_content_instance(&client, "ae", "DATA", "cin_2", "2", test_response_cb, &results[1]));
+  test_http_cse_serve(fd, 2, 0);
+
+  TEST_ASSERT_EQUAL(2, om2m_client_poll(&client, 1000));
+  TEST_ASSERT_EQUAL(1, results[0].calls);
+  TEST_ASSERT_EQUAL(1, results[1].calls);
+  TEST_ASSERT_TRUE(strcmp(results[0].rqi, results[1].rqi) != 0);
+  TEST_ASSERT_EQUAL(0, om2m_client_pending(&client));
+
+  // nothing pending, nothing to wait for
+  TEST_ASSERT_EQUAL(0, om2m_client_poll(&client, 1000));
+
+  om2m_client_close(&client);
+  om2m_http_client_close(&binding.http);
+  close(fd);
+  close(listen_fd);
+}
+
+// reads one request off fd and leaves the answer to the caller
+static void test_http_cse_read(int fd) {
+  om2m_http_request_t request;
+  char buf[2048];
+  size_t len = 0;
+  int res;
+
+  while((res = om2m_http_parse_request(buf, len, &request)) == 0) {
+    int n = read(fd, buf + len, sizeof(buf) - len);
+    TEST_ASSERT_TRUE(n > 0);
+    len += n;
+  }
+  TEST_ASSERT_EQUAL(len, res);
+}
+
+/*
+ * A CSE that stops in the middle of a response must not hold up the poll,
+ * a later poll completes the response. Without X-M2M-RSC the class of the
+ * HTTP status gives the RSC.
+ */
+void test_om2m_binding_http_partial(void) {
+  const char head[] = "HTTP/1.1 404 Not Found\r\nContent-Le";
+  const char tail[] = "ngth: 2\r\n\r\n{}";
+  const char error[] = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n\r\n";
+  om2m_http_binding_t binding;
+  om2m_client_t client;
+  test_result_t results[2];
+  int listen_fd, port, fd;
+  uint64_t start;
+
+  memset(results, 0, sizeof(results));
+  listen_fd = test_cse_listen(SOCK_STREAM, &port);
+
+  TEST_ASSERT_EQUAL(0, om2m_http_binding_init(&binding, "127.0.0.1", port));
+  TEST_ASSERT_EQUAL(0, om2m_client_init(&client, &om2m_http_binding, &binding, TEST_CSE, TEST_ORIGINATOR));
+
+  TEST_ASSERT_EQUAL(0, om2m_create_container(&client, "ae", "DATA", test_response_cb, &results[0]));
+  fd = accept(listen_fd, NULL, NULL);
+  test_http_cse_read(fd);
+  TEST_ASSERT_EQUAL(strlen(head), write(fd, head, strlen(head)));
+
+  start = test_time_us();
+  TEST_ASSERT_EQUAL(0, om2m_client_poll(&client, 100));
+  TEST_ASSERT_TRUE(test_time_us() - start < 1000000);
+  TEST_ASSERT_EQUAL(0, results[0].calls);
+  TEST_ASSERT_EQUAL(1, om2m_client_pending(&client));
+
+  TEST_ASSERT_EQUAL(strlen(tail), write(fd, tail, strlen(tail)));
+  TEST_ASSERT_EQUAL(1, om2m_client_poll(&client, 1000));
+  TEST_ASSERT_EQUAL(1, results[0].calls);
+  TEST_ASSERT_EQUAL(4000, results[0].rsc);
+  TEST_ASSERT_EQUAL_STRING("{}", results[0].pc);
+
+  TEST_ASSERT_EQUAL(0, om2m_create_container(&client, "ae", "DATA", test_response_cb, &results[1]));
+  test_http_cse_read(fd);
+  TEST_ASSERT_EQUAL(strlen(error), write(fd, error, strlen(error)));
+  TEST_ASSERT_EQUAL(1, om2m_client_poll(&client, 1000));
+  TEST_ASSERT_EQUAL(5000, results[1].rsc);
+  TEST_ASSERT_EQUAL_STRING("", results[1].pc);
+
+  om2m_client_close(&client);
+  om2m_http_client_close(&binding.http);
+  close(fd);
+  close(listen_fd);
+}
+
+/*
+ * CoAP binding through the host build of libcoap,
+ * the stand-in CSE answers with RQI and RSC options like OM2M does
+ */
+static void test_coap_cse_serve(int fd, int with_rqi) {
+  unsigned char buf[COAP_MAX_PDU_SIZE], rsc[2];
+  struct sockaddr_in from;
+  socklen_t from_len = sizeof(from);
+  coap_opt_iterator_t opt_iter;
+  coap_opt_t *opt;
+  coap_pdu_t *request, *response;
+  int len;
+
+  len = recvfrom(fd, buf, sizeof(buf), 0, (struct sockaddr *)&from, &from_len);
+  TEST_ASSERT_TRUE(len > 0);
+
+  request = coap_pdu_init(0, 0, 0, COAP_MAX_PDU_SIZE);
+  TEST_ASSERT_TRUE(coap_pdu_parse(buf, len, request));
+  TEST_ASSERT_EQUAL(COAP_REQUEST_POST, request->hdr->code);
+  TEST_ASSERT_NOT_NULL(coap_check_option(request, ONEM2M_OPTION_FR, &opt_iter));
+  TEST_ASSERT_NOT_NULL(coap_check_option(request, ONEM2M_OPTION_TY, &opt_iter));
+  TEST_ASSERT_NOT_NULL(opt = coap_check_option(request, COAP_OPTION_URI_PATH, &opt_iter));
+  TEST_ASSERT_EQUAL(0, strncmp((char *)coap_opt_value(opt), "~" TEST_CSE, strlen("~" TEST_CSE)));
+
+  response = coap_pdu_init(COAP_MESSAGE_NON, COAP_RESPONSE_CODE(201), request->hdr->id, COAP_MAX_PDU_SIZE);
+  coap_add_token(response, request->hdr->token_length, request->hdr->token);
+  if(with_rqi) {
+    TEST_ASSERT_NOT_NULL(opt = coap_check_option(request, ONEM2M_OPTION_RQI, &opt_iter));
+    coap_add_option(response, ONEM2M_OPTION_RQI, coap_opt_length(opt), coap_opt_value(opt));
+  }
+  coap_add_option(response, ONEM2M_OPTION_RSC, coap_encode_var_bytes(rsc, 2001), rsc);
+  coap_add_data(response, 2, (unsigned char *)"{}");
+
+  TEST_ASSERT_EQUAL(response->length, sendto(fd, response->hdr, response->length, 0, (struct sockaddr *)&from, from_len));
+
+  coap_delete_pdu(request);
+  coap_delete_pdu(response);
+}
+
+void test_om2m_binding_coap(void) {
+  om2m_coap_binding_t binding;
+  om2m_client_t client;
+  test_result_t results[3];
+  coap_address_t local, dst;
+  coap_context_t *ctx;
+  int fd, port;
+
+  memset(results, 0, sizeof(results));
+  fd = test_cse_listen(SOCK_DGRAM, &port);
+
+  coap_address_init(&local);
+  local.addr.sin.sin_family = AF_INET;
+  local.addr.sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  TEST_ASSERT_NOT_NULL(ctx = coap_new_context(&local));
+
+  coap_address_init(&dst);
+  dst.addr.sin.sin_family = AF_INET;
+  dst.addr.sin.sin_port = htons(port);
+  dst.addr.sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  om2m_coap_binding_init(&binding, ctx, &dst, COAP_MESSAGE_NON);
+  TEST_ASSERT_EQUAL(0, om2m_client_init(&client, &om2m_coap_binding, &binding, TEST_CSE, TEST_ORIGINATOR));
+
+  // provisioning in one round trip, the last response matched by token only
+  TEST_ASSERT_EQUAL(0, om2m_create_ae(&client, "ae", 1234, "coap://127.0.0.1:5683", test_response_cb, &results[0]));
+  TEST_ASSERT_EQUAL(0, om2m_create_container(&client, "ae", "DATA", test_response_cb, &results[1]));
+  TEST_ASSERT_EQUAL(0, om2m_create_subscription(&client, "ae", "DATA", "MONITOR", "SUB", test_response_cb, &results[2]));
+
+  test_coap_cse_serve(fd, 1);
+  test_coap_cse_serve(fd, 1);
+  test_coap_cse_serve(fd, 0);
+
+  while(om2m_client_pending(&client))
+    TEST_ASSERT_TRUE(om2m_client_poll(&client, 1000) > 0);
+
+  TEST_ASSERT_EQUAL(1, results[0].calls);
+  TEST_ASSERT_EQUAL(1, results[1].calls);
+  TEST_ASSERT_EQUAL(1, results[2].calls);
+  TEST_ASSERT_EQUAL(2001, results[0].rsc);
+  TEST_ASSERT_EQUAL(2001, results[2].rsc);
+  TEST_ASSERT_EQUAL_STRING("{}", results[2].pc);
+
+  om2m_client_close(&client);
+  coap_free_context(ctx);
+  close(fd);
+}
+
+/*
+ * The standalone calls give every request its own token and RQI
+ */
+void test_om2m_coap_legacy_ids(void) {
+  unsigned char buf[COAP_MAX_PDU_SIZE], token[2][8];
+  char rqi[2][OM2M_RQI_MAX];
+  coap_address_t local, dst;
+  coap_opt_iterator_t opt_iter;
+  coap_context_t *ctx;
+  coap_opt_t *opt;
+  int fd, port, i;
+
+  fd = test_cse_listen(SOCK_DGRAM, &port);
+
+  coap_address_init(&local);
+  local.addr.sin.sin_family = AF_INET;
+  local.addr.sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  TEST_ASSERT_NOT_NULL(ctx = coap_new_context(&local));
+
+  coap_address_init(&dst);
+  dst.addr.sin.sin_family = AF_INET;
+  dst.addr.sin.sin_port = htons(port);
+  dst.addr.sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  TEST_ASSERT_TRUE(om2m_coap_create_ae(ctx, dst, "ae", 1234) != COAP_INVALID_TID);
+  TEST_ASSERT_TRUE(om2m_coap_create_container(ctx, dst, "ae", "DATA") != COAP_INVALID_TID);
+
+  for(i = 0; i < 2; i++) {
+    coap_pdu_t *request = coap_pdu_init(0, 0, 0, COAP_MAX_PDU_SIZE);
+    int len = recv(fd, buf, sizeof(buf), 0);
+
+    TEST_ASSERT_TRUE(coap_pdu_parse(buf, len, request));
+    TEST_ASSERT_EQUAL(2, request->hdr->token_length);
+    memcpy(token[i], request->hdr->token, 2);
+    TEST_ASSERT_NOT_NULL(opt = coap_check_option(request, ONEM2M_OPTION_RQI, &opt_iter));
+    sprintf(rqi[i], "%.*s", coap_opt_length(opt), coap_opt_value(opt));
+    coap_delete_pdu(request);
+  }
+
+  TEST_ASSERT_TRUE(memcmp(token[0], token[1], 2) != 0);
+  TEST_ASSERT_TRUE(strcmp(rqi[0], rqi[1]) != 0);
+  TEST_ASSERT_EQUAL('m', rqi[0][0]);
+
+  coap_free_context(ctx);
+  close(fd);
+}
+
+/*
+ * MQTT binding against the in-memory stand-in broker,
+ * the CSE answers every m2m:rqp on the response topic
+ */
+static void test_mqtt_cse(MQTTClient *c, const char *topic, MQTTMessage *message) {
+  char rsp[256], *json = strndup(message->payload, message->payloadlen);
+  cJSON *root = cJSON_Parse(json), *rqp;
+  int len;
+
+  TEST_ASSERT_NOT_NULL(root);
+  TEST_ASSERT_EQUAL_STRING("/oneM2M/req/ae-1/in-cse/json", topic);
+  rqp = cJSON_GetObjectItem(root, "m2m:rqp");
+  TEST_ASSERT_NOT_NULL(cJSON_GetObjectItem(rqp, "m2m:pc"));
+
+  // the status code as a string, as some CSEs send it
+  len = sprintf(rsp, "{\"m2m:rsp\":{\"m2m:rsc\":\"2001\",\"m2m:rqi\":\"%s\",\"m2m:pc\":{\"m2m:cnt\":{\"rn\":\"DATA\"}}}}",
+                cJSON_GetObjectItem(rqp, "m2m:rqi")->valuestring);
+  test_mqtt_deliver(c, "/oneM2M/resp/ae-1/in-cse/json", rsp, len);
+
+  cJSON_Delete(root);
+  free(json);
+}
+
+void test_om2m_binding_mqtt(void) {
+  om2m_mqtt_binding_t binding;
+  om2m_client_t client;
+  test_result_t result;
+  MQTTClient mqtt;
+
+  memset(&mqtt, 0, sizeof(mqtt));
+  memset(&result, 0, sizeof(result));
+  mqtt.on_publish = test_mqtt_cse;
+
+  TEST_ASSERT_EQUAL(0, om2m_mqtt_binding_init(&binding, &mqtt, "ae-1", "in-cse"));
+  TEST_ASSERT_EQUAL(0, om2m_client_init(&client, &om2m_mqtt_binding, &binding, TEST_CSE, TEST_ORIGINATOR));
+  TEST_ASSERT_EQUAL_STRING("/oneM2M/resp/ae-1/in-cse/json", mqtt.topicFilter);
+
+  TEST_ASSERT_EQUAL(0, om2m_create_container(&client, "ae", "DATA", test_response_cb, &result));
+  TEST_ASSERT_EQUAL(0, om2m_client_poll(&client, 0));
+
+  TEST_ASSERT_EQUAL(1, result.calls);
+  TEST_ASSERT_EQUAL(2001, result.rsc);
+  TEST_ASSERT_EQUAL_STRING("{\"m2m:cnt\":{\"rn\":\"DATA\"}}", result.pc);
+  TEST_ASSERT_EQUAL(0, om2m_client_pending(&client));
+
+  om2m_client_close(&client);
+}
+
+int MQTTPublish(MQTTClient *c, const char *topicName, MQTTMessage *message) {
+  if(c->on_publish)
+    c->on_publish(c, topicName, message);
+  return 0;
+}
+
+int MQTTSubscribe(MQTTClient *c, const char *topicFilter, enum QoS qos, messageHandler messageHandler) {
+  c->topicFilter = topicFilter;
+  c->fp = messageHandler;
+  return 0;
+}
+
+int test_mqtt_deliver(MQTTClient *c, const char *topic, const char *payload, size_t len) {
+  if(c->queued == 8 || len > sizeof(c->payload[0]))
+    return -1;
+
+  strcpy(c->topic[c->queued], topic);
+  memcpy(c->payload[c->queued], payload, len);
+  c->payloadlen[c->queued++] = len;
+  return 0;
+}
+
+int MQTTYield(MQTTClient *c, int timeout_ms) {
+  int i;
+
+  for(i = 0; i < c->queued; i++) {
+    MQTTMessage message = { .payload = c->payload[i], .payloadlen = c->payloadlen[i] };
+    MQTTString topic = { .lenstring = { .len = strlen(c->topic[i]), .data = c->topic[i] } };
+    MessageData data = { .message = &message, .topicName = &topic };
+
+    if(c->fp && !strcmp(c->topic[i], c->topicFilter))
+      c->fp(&data);
+  }
+  c->queued = 0;
+
+  return 0;
+}
+
+void test_om2m_serialize_benchmark(void) {
+  char buf[OM2M_PC_MAX];
+  uint64_t start, om2m_us, cjson_us;
+  int i, len = 0;
+
+  start = test_time_us();
+  for(i = 0; i < TEST_SERIALIZE_COUNT; i++)
+    len += om2m_pc_cin(buf, sizeof(buf), "cin_12345", "{\"hr\":72,\"spo2\":98}");
+  om2m_us = test_time_us() - start;
+
+  start = test_time_us();
+  for(i = 0; i < TEST_SERIALIZE_COUNT; i++) {
+    cJSON *payload = cJSON_CreateObject(), *cin;
+    char *out;
+
+    cJSON_AddItemToObject(payload, "m2m:cin", cin = cJSON_CreateObject());
+    cJSON_AddStringToObject(cin, "con", "{\"hr\":72,\"spo2\":98}");
+    cJSON_AddStringToObject(cin, "cnf", "text/plain:19");
+    cJSON_AddStringToObject(cin, "rn", "cin_12345");
+    out = cJSON_PrintUnformatted(payload);
+    len -= strlen(out);
+    cJSON_Delete(payload);
+    free(out);
+  }
+  cjson_us = test_time_us() - start;
+
+  // both produce the same document
+  TEST_ASSERT_EQUAL(0, len);
+
+  printf("content instance serialization: om2m %.1f ns, cJSON %.1f ns\n",
+         om2m_us * 1000.0 / TEST_SERIALIZE_COUNT, cjson_us * 1000.0 / TEST_SERIALIZE_COUNT);
+}
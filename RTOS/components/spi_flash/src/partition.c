@@ -205,8 +205,8 @@ else
 #endif
 
         // it->label may not be zero-terminated
-        strncpy(item->info.label, (const char*) it->label, sizeof(it->label));
-        item->info.label[sizeof(it->label)] = 0;
+        strncpy(item->info.label, (const char*) it->label, sizeof(item->info.label) - 1);
+        item->info.label[sizeof(item->info.label) - 1] = 0;
         // add it to the list
         if (last == NULL) {
             SLIST_INSERT_HEAD(&s_partition_list, item, next);
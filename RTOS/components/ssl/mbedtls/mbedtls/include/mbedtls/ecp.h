@@ -229,6 +229,14 @@ mbedtls_ecp_keypair;
 #define MBEDTLS_ECP_FIXED_POINT_OPTIM  1   /**< Enable fixed-point speed-up */
 #endif /* MBEDTLS_ECP_FIXED_POINT_OPTIM */
 
+/*
+ * Comb width of the precomputed generator table used when
+ * MBEDTLS_ECP_FIXED_BASE_COMB_ROM is defined. The table holds
+ * 1 << ( MBEDTLS_ECP_FIXED_BASE_COMB_W - 1 ) points, so this value is
+ * tied to the constants in ecp_curves.c and must not be changed alone.
+ */
+#define MBEDTLS_ECP_FIXED_BASE_COMB_W  5
+
 /* \} name SECTION: Module settings */
 
 /*
@@ -339,7 +339,8 @@ void mbedtls_ecp_group_free( mbedtls_ecp_group *grp )
         mbedtls_mpi_free( &grp->N );
     }
 
-    if( grp->T != NULL )
+    /* A static comb table (T_size == 0) lives in flash, leave it alone */
+    if( grp->T != NULL && grp->T_size != 0 )
     {
         for( i = 0; i < grp->T_size; i++ )
             mbedtls_ecp_point_free( &grp->T[i] );
@@ -1397,6 +1398,15 @@ static int ecp_mul_comb( mbedtls_ecp_group *grp, mbedtls_ecp_point *R,
     if( w >= grp->nbits )
         w = 2;
 
+#if defined(MBEDTLS_ECP_FIXED_BASE_COMB_ROM)
+    /*
+     * A precomputed table in flash was built for a given comb width,
+     * which then takes precedence over the heuristic above.
+     */
+    if( p_eq_g && grp->T != NULL && grp->T_size == 0 )
+        w = MBEDTLS_ECP_FIXED_BASE_COMB_W;
+#endif
+
     /* Other sizes that depend on w */
     pre_len = 1U << ( w - 1 );
     d = ( grp->nbits + w - 1 ) / w;
@@ -625,6 +625,20 @@
 #define MBEDTLS_ECP_NIST_OPTIM
 #endif
 
+/**
+ * \def MBEDTLS_ECP_FIXED_BASE_COMB_ROM
+ *
+ * Use a constant, precomputed comb table for the secp256r1 generator
+ * instead of building it on the heap in every group that multiplies G.
+ *
+ * Requires: MBEDTLS_ECP_DP_SECP256R1_ENABLED
+ *
+ * Comment this macro to compute the generator table at run time.
+ */
+#ifdef CONFIG_MBEDTLS_ECP_FIXED_BASE_COMB_ROM
+#define MBEDTLS_ECP_FIXED_BASE_COMB_ROM
+#endif
+
 /**
  * \def MBEDTLS_ECDSA_DETERMINISTIC
  *
@@ -2845,8 +2859,12 @@
 
 /* ECP options */
 //#define MBEDTLS_ECP_MAX_BITS             521 /**< Maximum bit size of groups */
-//#define MBEDTLS_ECP_WINDOW_SIZE            6 /**< Maximum window size used */
-//#define MBEDTLS_ECP_FIXED_POINT_OPTIM      1 /**< Enable fixed-point speed-up */
+#ifdef CONFIG_MBEDTLS_ECP_WINDOW_SIZE
+#define MBEDTLS_ECP_WINDOW_SIZE            CONFIG_MBEDTLS_ECP_WINDOW_SIZE /**< Maximum window size used */
+#endif
+#ifdef CONFIG_MBEDTLS_ECP_FIXED_POINT_OPTIM
+#define MBEDTLS_ECP_FIXED_POINT_OPTIM      CONFIG_MBEDTLS_ECP_FIXED_POINT_OPTIM /**< Enable fixed-point speed-up */
+#endif
 
 /* Entropy options */
 //#define MBEDTLS_ENTROPY_MAX_SOURCES                20 /**< Maximum number of sources supported */
@@ -0,0 +1,101 @@
+// Copyright 2018-2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "unity.h"
+#include "sdkconfig.h"
+#include "esp_system.h"
+
+#ifdef CONFIG_SSL_USING_MBEDTLS
+
+#include "mbedtls/ecp.h"
+#include "mbedtls/ecdh.h"
+#include "mbedtls/ecdsa.h"
+
+#define TEST_ECP_COUNT 8
+#define TEST_ECP_DEBUG 0
+
+static int test_ecp_rng(void *ctx, unsigned char *buf, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+        buf[i] = (unsigned char)esp_random();
+
+    return 0;
+}
+
+TEST_CASE("Test ECDH/ECDSA secp256r1 performance", "[mbedtls]")
+{
+    uint32_t ecdh_time = 0, ecdsa_time = 0;
+    unsigned char hash[32];
+
+    extern uint32_t esp_get_time(void);
+
+    memset(hash, 0x5a, sizeof(hash));
+
+    for (int i = 0; i < TEST_ECP_COUNT; i++) {
+        mbedtls_ecdh_context cli, srv;
+        mbedtls_mpi r, s;
+
+        mbedtls_ecdh_init(&cli);
+        mbedtls_ecdh_init(&srv);
+        mbedtls_mpi_init(&r);
+        mbedtls_mpi_init(&s);
+
+        /* Each handshake loads a fresh group, so do it here as well */
+        TEST_ASSERT_EQUAL(0, mbedtls_ecp_group_load(&cli.grp, MBEDTLS_ECP_DP_SECP256R1));
+        TEST_ASSERT_EQUAL(0, mbedtls_ecp_group_load(&srv.grp, MBEDTLS_ECP_DP_SECP256R1));
+        TEST_ASSERT_EQUAL(0, mbedtls_ecdh_gen_public(&srv.grp, &srv.d, &srv.Q, test_ecp_rng, NULL));
+
+        uint32_t tmp = esp_get_time();
+
+        TEST_ASSERT_EQUAL(0, mbedtls_ecdh_gen_public(&cli.grp, &cli.d, &cli.Q, test_ecp_rng, NULL));
+        TEST_ASSERT_EQUAL(0, mbedtls_ecdh_compute_shared(&cli.grp, &cli.z, &srv.Q, &cli.d, test_ecp_rng, NULL));
+
+        ecdh_time += esp_get_time() - tmp;
+
+        TEST_ASSERT_EQUAL(0, mbedtls_ecdh_compute_shared(&srv.grp, &srv.z, &cli.Q, &srv.d, test_ecp_rng, NULL));
+        TEST_ASSERT_EQUAL(0, mbedtls_mpi_cmp_mpi(&cli.z, &srv.z));
+
+        tmp = esp_get_time();
+
+        TEST_ASSERT_EQUAL(0, mbedtls_ecdsa_sign(&srv.grp, &r, &s, &srv.d, hash, sizeof(hash), test_ecp_rng, NULL));
+
+        ecdsa_time += esp_get_time() - tmp;
+
+        TEST_ASSERT_EQUAL(0, mbedtls_ecdsa_verify(&srv.grp, hash, sizeof(hash), &srv.Q, &r, &s));
+
+        mbedtls_mpi_free(&r);
+        mbedtls_mpi_free(&s);
+        mbedtls_ecdh_free(&cli);
+        mbedtls_ecdh_free(&srv);
+    }
+
+#if TEST_ECP_DEBUG
+    printf("ecp profile: window %d, fixed point %d, flash comb table %s\n",
+        MBEDTLS_ECP_WINDOW_SIZE, MBEDTLS_ECP_FIXED_POINT_OPTIM,
+#ifdef MBEDTLS_ECP_FIXED_BASE_COMB_ROM
+        "yes"
+#else
+        "no"
+#endif
+        );
+    printf("ecp test cost time once is about ECDHE %u us and ECDSA sign %u us\n",
+        ecdh_time / TEST_ECP_COUNT, ecdsa_time / TEST_ECP_COUNT);
+#endif
+}
+
+#endif /* CONFIG_SSL_USING_MBEDTLS */
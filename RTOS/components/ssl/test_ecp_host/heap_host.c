@@ -0,0 +1,62 @@
+/*
+ * Heap accounting for the host test, linked with --wrap=calloc and
+ * --wrap=free so that every block mbedTLS takes is counted
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "heap_host.h"
+
+// keeps the block after the header aligned for any type
+typedef union {
+    size_t size;
+    max_align_t align;
+} heap_host_header_t;
+
+void *__real_calloc(size_t n, size_t size);
+void __real_free(void *ptr);
+
+static size_t s_heap_used, s_heap_peak;
+
+void *__wrap_calloc(size_t n, size_t size) {
+    heap_host_header_t *h;
+
+    if (size && n > (SIZE_MAX - sizeof(*h)) / size)
+        return NULL;
+
+    h = __real_calloc(1, sizeof(*h) + n * size);
+    if (!h)
+        return NULL;
+
+    h->size = n * size;
+    s_heap_used += h->size;
+    if (s_heap_used > s_heap_peak)
+        s_heap_peak = s_heap_used;
+
+    return h + 1;
+}
+
+void __wrap_free(void *ptr) {
+    heap_host_header_t *h;
+
+    if (!ptr)
+        return;
+
+    h = (heap_host_header_t *)ptr - 1;
+    s_heap_used -= h->size;
+    __real_free(h);
+}
+
+size_t heap_host_used(void) {
+    return s_heap_used;
+}
+
+// peak since the last call
+size_t heap_host_peak_reset(void) {
+    size_t peak = s_heap_peak;
+
+    s_heap_peak = s_heap_used;
+
+    return peak;
+}
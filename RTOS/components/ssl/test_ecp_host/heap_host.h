@@ -0,0 +1,9 @@
+/*
+ * Host stand-in for the heap statistics of the target
+ */
+#pragma once
+
+#include <stddef.h>
+
+size_t heap_host_used(void);
+size_t heap_host_peak_reset(void);
@@ -0,0 +1,15 @@
+#include "unity.h"
+
+void test_ecp_comb_table(void);
+void test_ecdh_ecdsa_roundtrip(void);
+void test_ecdh_ecdsa_benchmark(void);
+
+int main(void) {
+  UNITY_BEGIN();
+
+  RUN_TEST(test_ecp_comb_table);
+  RUN_TEST(test_ecdh_ecdsa_roundtrip);
+  RUN_TEST(test_ecdh_ecdsa_benchmark);
+
+  return UNITY_END();
+}
@@ -0,0 +1,31 @@
+/*
+ * Host stand-in for the build configuration, enough of it for the
+ * ECP modules of esp_config.h
+ *
+ * The Makefile defines CONFIG_MBEDTLS_ECP_PERFORMANCE_RAM or _SPEED,
+ * the values below follow from it the way they do in the Kconfig.
+ */
+#pragma once
+
+#define CONFIG_MBEDTLS_SSL_OUT_CONTENT_LEN 4096
+#define CONFIG_MBEDTLS_SSL_IN_CONTENT_LEN 4096
+#define CONFIG_MBEDTLS_AES_C 1
+
+#define CONFIG_MBEDTLS_ECP_C 1
+#define CONFIG_MBEDTLS_ECDH_C 1
+#define CONFIG_MBEDTLS_ECDSA_C 1
+#define CONFIG_MBEDTLS_ECP_DP_SECP256R1_ENABLED 1
+#define CONFIG_MBEDTLS_ECP_NIST_OPTIM 1
+
+#if defined(CONFIG_MBEDTLS_ECP_PERFORMANCE_RAM)
+#define CONFIG_MBEDTLS_ECP_WINDOW_SIZE 2
+#define CONFIG_MBEDTLS_ECP_FIXED_POINT_OPTIM 0
+#elif defined(CONFIG_MBEDTLS_ECP_PERFORMANCE_SPEED)
+#define CONFIG_MBEDTLS_ECP_WINDOW_SIZE 6
+#define CONFIG_MBEDTLS_ECP_FIXED_POINT_OPTIM 1
+#ifndef CONFIG_MBEDTLS_ECP_FIXED_BASE_COMB_ROM_DISABLED
+#define CONFIG_MBEDTLS_ECP_FIXED_BASE_COMB_ROM 1
+#endif
+#else
+#error "build with ECP_PROFILE=RAM or ECP_PROFILE=SPEED"
+#endif
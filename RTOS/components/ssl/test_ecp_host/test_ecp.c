@@ -0,0 +1,182 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "unity.h"
+#include "heap_host.h"
+#include "mbedtls/ecp.h"
+#include "mbedtls/ecdh.h"
+#include "mbedtls/ecdsa.h"
+
+#define TEST_ECP_COUNT 32
+
+static uint32_t s_rng_state = 0x12345678;
+
+// xorshift32, the same keys on every run
+static int test_ecp_rng(void *ctx, unsigned char *buf, size_t len) {
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        s_rng_state ^= s_rng_state << 13;
+        s_rng_state ^= s_rng_state >> 17;
+        s_rng_state ^= s_rng_state << 5;
+        buf[i] = (unsigned char)s_rng_state;
+    }
+
+    return 0;
+}
+
+static double test_time_us(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/*
+ * d * G through the table the group was loaded with, the one in flash
+ * with MBEDTLS_ECP_FIXED_BASE_COMB_ROM, against the same product through
+ * a table computed at run time
+ */
+void test_ecp_comb_table(void) {
+    mbedtls_ecp_group grp, ref;
+    mbedtls_ecp_point r, s;
+    mbedtls_mpi d;
+    int i;
+
+    mbedtls_ecp_group_init(&grp);
+    mbedtls_ecp_group_init(&ref);
+    mbedtls_ecp_point_init(&r);
+    mbedtls_ecp_point_init(&s);
+    mbedtls_mpi_init(&d);
+
+    TEST_ASSERT_EQUAL(0, mbedtls_ecp_group_load(&grp, MBEDTLS_ECP_DP_SECP256R1));
+    TEST_ASSERT_EQUAL(0, mbedtls_ecp_group_load(&ref, MBEDTLS_ECP_DP_SECP256R1));
+#ifdef MBEDTLS_ECP_FIXED_BASE_COMB_ROM
+    TEST_ASSERT_NOT_NULL(grp.T);
+    TEST_ASSERT_EQUAL(0, grp.T_size);
+    ref.T = NULL;
+#endif
+
+    for (i = 0; i < 8; i++) {
+        TEST_ASSERT_EQUAL(0, mbedtls_ecp_gen_keypair(&grp, &d, &r, test_ecp_rng, NULL));
+        TEST_ASSERT_EQUAL(0, mbedtls_ecp_mul(&ref, &s, &d, &ref.G, test_ecp_rng, NULL));
+        TEST_ASSERT_EQUAL(0, mbedtls_ecp_point_cmp(&r, &s));
+        TEST_ASSERT_EQUAL(0, mbedtls_ecp_check_pubkey(&grp, &r));
+    }
+
+    mbedtls_mpi_free(&d);
+    mbedtls_ecp_point_free(&r);
+    mbedtls_ecp_point_free(&s);
+    mbedtls_ecp_group_free(&ref);
+    mbedtls_ecp_group_free(&grp);
+
+    // the static table is left alone, everything else is returned
+    TEST_ASSERT_EQUAL(0, heap_host_used());
+}
+
+void test_ecdh_ecdsa_roundtrip(void) {
+    mbedtls_ecdh_context cli, srv;
+    mbedtls_mpi r, s;
+    unsigned char hash[32];
+
+    mbedtls_ecdh_init(&cli);
+    mbedtls_ecdh_init(&srv);
+    mbedtls_mpi_init(&r);
+    mbedtls_mpi_init(&s);
+    memset(hash, 0x5a, sizeof(hash));
+
+    TEST_ASSERT_EQUAL(0, mbedtls_ecp_group_load(&cli.grp, MBEDTLS_ECP_DP_SECP256R1));
+    TEST_ASSERT_EQUAL(0, mbedtls_ecp_group_load(&srv.grp, MBEDTLS_ECP_DP_SECP256R1));
+    TEST_ASSERT_EQUAL(0, mbedtls_ecdh_gen_public(&cli.grp, &cli.d, &cli.Q, test_ecp_rng, NULL));
+    TEST_ASSERT_EQUAL(0, mbedtls_ecdh_gen_public(&srv.grp, &srv.d, &srv.Q, test_ecp_rng, NULL));
+    TEST_ASSERT_EQUAL(0, mbedtls_ecdh_compute_shared(&cli.grp, &cli.z, &srv.Q, &cli.d, test_ecp_rng, NULL));
+    TEST_ASSERT_EQUAL(0, mbedtls_ecdh_compute_shared(&srv.grp, &srv.z, &cli.Q, &srv.d, test_ecp_rng, NULL));
+    TEST_ASSERT_EQUAL(0, mbedtls_mpi_cmp_mpi(&cli.z, &srv.z));
+
+    TEST_ASSERT_EQUAL(0, mbedtls_ecdsa_sign(&srv.grp, &r, &s, &srv.d, hash, sizeof(hash), test_ecp_rng, NULL));
+    TEST_ASSERT_EQUAL(0, mbedtls_ecdsa_verify(&cli.grp, hash, sizeof(hash), &srv.Q, &r, &s));
+    hash[0] ^= 1;
+    TEST_ASSERT_NOT_EQUAL(0, mbedtls_ecdsa_verify(&cli.grp, hash, sizeof(hash), &srv.Q, &r, &s));
+
+    mbedtls_mpi_free(&r);
+    mbedtls_mpi_free(&s);
+    mbedtls_ecdh_free(&cli);
+    mbedtls_ecdh_free(&srv);
+}
+
+/*
+ * The operations of an ECDHE-ECDSA handshake on the server side, each
+ * in a freshly loaded group as in a handshake: the ephemeral key, the
+ * shared secret and the signature of the key exchange
+ *
+ * Times are host times, only the ratio between profiles carries over to
+ * the target, test/test_ecp_perf.c measures there. The peak heap is that
+ * of the operation alone, on top of the group and the keys.
+ */
+void test_ecdh_ecdsa_benchmark(void) {
+    double gen_time = 0, ecdh_time = 0, ecdsa_time = 0, tmp;
+    size_t gen_peak = 0, ecdh_peak = 0, ecdsa_peak = 0, base, peak;
+    unsigned char hash[32];
+    int i;
+
+    memset(hash, 0x5a, sizeof(hash));
+
+    for (i = 0; i < TEST_ECP_COUNT; i++) {
+        mbedtls_ecdh_context cli, srv;
+        mbedtls_mpi r, s;
+
+        mbedtls_ecdh_init(&cli);
+        mbedtls_ecdh_init(&srv);
+        mbedtls_mpi_init(&r);
+        mbedtls_mpi_init(&s);
+
+        TEST_ASSERT_EQUAL(0, mbedtls_ecp_group_load(&cli.grp, MBEDTLS_ECP_DP_SECP256R1));
+        TEST_ASSERT_EQUAL(0, mbedtls_ecdh_gen_public(&cli.grp, &cli.d, &cli.Q, test_ecp_rng, NULL));
+        TEST_ASSERT_EQUAL(0, mbedtls_ecp_group_load(&srv.grp, MBEDTLS_ECP_DP_SECP256R1));
+
+        base = heap_host_used();
+        heap_host_peak_reset();
+        tmp = test_time_us();
+        TEST_ASSERT_EQUAL(0, mbedtls_ecdh_gen_public(&srv.grp, &srv.d, &srv.Q, test_ecp_rng, NULL));
+        gen_time += test_time_us() - tmp;
+        peak = heap_host_peak_reset() - base;
+        if (peak > gen_peak)
+            gen_peak = peak;
+
+        base = heap_host_used();
+        tmp = test_time_us();
+        TEST_ASSERT_EQUAL(0, mbedtls_ecdh_compute_shared(&srv.grp, &srv.z, &cli.Q, &srv.d, test_ecp_rng, NULL));
+        ecdh_time += test_time_us() - tmp;
+        peak = heap_host_peak_reset() - base;
+        if (peak > ecdh_peak)
+            ecdh_peak = peak;
+
+        base = heap_host_used();
+        tmp = test_time_us();
+        TEST_ASSERT_EQUAL(0, mbedtls_ecdsa_sign(&srv.grp, &r, &s, &srv.d, hash, sizeof(hash), test_ecp_rng, NULL));
+        ecdsa_time += test_time_us() - tmp;
+        peak = heap_host_peak_reset() - base;
+        if (peak > ecdsa_peak)
+            ecdsa_peak = peak;
+
+        mbedtls_mpi_free(&r);
+        mbedtls_mpi_free(&s);
+        mbedtls_ecdh_free(&cli);
+        mbedtls_ecdh_free(&srv);
+    }
+
+    printf("ecp profile: window %d, fixed point %d, flash comb table %s\n",
+           MBEDTLS_ECP_WINDOW_SIZE, MBEDTLS_ECP_FIXED_POINT_OPTIM,
+#ifdef MBEDTLS_ECP_FIXED_BASE_COMB_ROM
+           "yes"
+#else
+           "no"
+#endif
+           );
+    printf("ecdh_gen_public %.0f us, peak heap %u B\n", gen_time / TEST_ECP_COUNT, (unsigned)gen_peak);
+    printf("ecdh_compute_shared %.0f us, peak heap %u B\n", ecdh_time / TEST_ECP_COUNT, (unsigned)ecdh_peak);
+    printf("ecdsa_sign %.0f us, peak heap %u B\n", ecdsa_time / TEST_ECP_COUNT, (unsigned)ecdsa_peak);
+}
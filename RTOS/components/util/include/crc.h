@@ -16,6 +16,7 @@
 #define __CRC_H_
 
 #include <stdint.h>
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -50,6 +51,23 @@ extern "C" {
   */
 uint32_t crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len);
 
+/**
+  * @brief Crc32 register, little endian, after the next bytes of a stream.
+  *
+  *        No inversion on the way in or out: start from UINT32_MAX, feed the data in
+  *        pieces of any size and invert the last result. Goes on from a crc32_le()
+  *        result as crc32_le(crc, buf, len) == ~crc32_update(~crc, buf, len).
+  *
+  * @param  uint32_t crc : crc register after the bytes before buf.
+  *
+  * @param  const void *buf : buffer to start calculate crc.
+  *
+  * @param  size_t len : buffer length in byte.
+  *
+  * @return uint32_t: Crc register after buf.
+  */
+uint32_t crc32_update(uint32_t crc, const void *buf, size_t len);
+
 /**
   * @brief Crc32 value that is in big endian.
   *
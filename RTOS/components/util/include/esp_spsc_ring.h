@@ -0,0 +1,100 @@
+// Copyright 2018-2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief single producer, single consumer ring of fixed size elements
+ *
+ * One task pushes and one task pops without any lock: the producer is the
+ * only writer of head and overruns, the consumer the only writer of tail.
+ * Both counters run freely and wrap, their difference is the fill level.
+ * A push into a full ring drops the new element and counts it in overruns,
+ * the consumer never waits for the producer and the producer never blocks.
+ */
+typedef struct esp_spsc_ring {
+    uint8_t *buf;
+    uint32_t size;                  // bytes of an element
+    uint32_t mask;                  // elements in the ring less one
+    volatile uint32_t head;         // elements ever pushed
+    volatile uint32_t tail;         // elements ever popped
+    volatile uint32_t overruns;     // elements dropped because the ring was full
+} esp_spsc_ring_t;
+
+/**
+ * @brief initialize a ring over a caller provided buffer
+ *
+ * @param ring     ring to initialize
+ * @param buf      storage of at least num * size bytes
+ * @param num      elements the ring holds, a power of two
+ * @param size     bytes of an element
+ *
+ * @return the result
+ *           0 : Success
+ *     -EINVAL : num is not a power of two or an argument is 0
+ */
+int esp_spsc_ring_init(esp_spsc_ring_t *ring, void *buf, uint32_t num, uint32_t size);
+
+/**
+ * @brief append elements, producer side
+ *
+ * The elements which do not fit are dropped and counted as overruns,
+ * the ones which do are published to the consumer at once.
+ *
+ * @param ring     ring
+ * @param elems    n elements of the ring element size
+ * @param n        number of elements
+ *
+ * @return number of elements pushed
+ */
+uint32_t esp_spsc_ring_push(esp_spsc_ring_t *ring, const void *elems, uint32_t n);
+
+/**
+ * @brief remove the oldest elements, consumer side
+ *
+ * @param ring     ring
+ * @param elems    room for max elements
+ * @param max      most elements to take
+ *
+ * @return number of elements copied into elems, 0 if the ring is empty
+ */
+uint32_t esp_spsc_ring_pop(esp_spsc_ring_t *ring, void *elems, uint32_t max);
+
+/**
+ * @brief number of elements waiting, exact on the consumer side and a
+ *        lower bound of the free room on the producer side
+ */
+static inline uint32_t esp_spsc_ring_count(const esp_spsc_ring_t *ring)
+{
+    return ring->head - ring->tail;
+}
+
+/**
+ * @brief elements dropped since the ring was initialized, the counter wraps
+ *        so readers keep the last value and look at the difference
+ */
+static inline uint32_t esp_spsc_ring_overruns(const esp_spsc_ring_t *ring)
+{
+    return ring->overruns;
+}
+
+#ifdef __cplusplus
+}
+#endif
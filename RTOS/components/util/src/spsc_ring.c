@@ -0,0 +1,96 @@
+// Copyright 2018-2019 Espressif Systems (Shanghai) PTE LTD
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "esp_spsc_ring.h"
+#include <string.h>
+#include <sys/errno.h>
+
+int esp_spsc_ring_init(esp_spsc_ring_t *ring, void *buf, uint32_t num, uint32_t size)
+{
+    if (!ring || !buf || !size || !num || (num & (num - 1)))
+        return -EINVAL;
+
+    ring->buf = buf;
+    ring->size = size;
+    ring->mask = num - 1;
+    ring->head = 0;
+    ring->tail = 0;
+    ring->overruns = 0;
+
+    return 0;
+}
+
+/**
+ * Copy n elements between the ring and a linear buffer starting at the
+ * counter pos, in two pieces when they wrap around the end of the ring
+ */
+static void spsc_ring_copy(const esp_spsc_ring_t *ring, uint32_t pos, void *linear, uint32_t n, int to_ring)
+{
+    uint32_t off = pos & ring->mask;
+    uint32_t first = ring->mask + 1 - off;
+    uint8_t *slot = ring->buf + off * ring->size;
+
+    if (first > n)
+        first = n;
+
+    if (to_ring) {
+        memcpy(slot, linear, first * ring->size);
+        memcpy(ring->buf, (uint8_t *)linear + first * ring->size, (n - first) * ring->size);
+    } else {
+        memcpy(linear, slot, first * ring->size);
+        memcpy((uint8_t *)linear + first * ring->size, ring->buf, (n - first) * ring->size);
+    }
+}
+
+uint32_t esp_spsc_ring_push(esp_spsc_ring_t *ring, const void *elems, uint32_t n)
+{
+    uint32_t head = ring->head;
+    uint32_t room = ring->mask + 1 - (head - ring->tail);
+
+    if (n > room) {
+        ring->overruns += n - room;
+        n = room;
+    }
+    if (!n)
+        return 0;
+
+    spsc_ring_copy(ring, head, (void *)elems, n, 1);
+
+    // the elements have to be in memory before the consumer can see them
+    __sync_synchronize();
+    ring->head = head + n;
+
+    return n;
+}
+
+uint32_t esp_spsc_ring_pop(esp_spsc_ring_t *ring, void *elems, uint32_t max)
+{
+    uint32_t tail = ring->tail;
+    uint32_t n = ring->head - tail;
+
+    if (n > max)
+        n = max;
+    if (!n)
+        return 0;
+
+    // no element is read ahead of the head which published it
+    __sync_synchronize();
+    spsc_ring_copy(ring, tail, elems, n, 0);
+
+    // and the slots are only handed back once they have been read
+    __sync_synchronize();
+    ring->tail = tail + n;
+
+    return n;
+}
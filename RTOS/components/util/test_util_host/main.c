@@ -0,0 +1,29 @@
+#include "unity.h"
+
+void test_spsc_ring_init(void);
+void test_spsc_ring_order(void);
+void test_spsc_ring_wrap(void);
+void test_spsc_ring_overrun(void);
+void test_spsc_ring_threads(void);
+void test_spsc_ring_benchmark(void);
+void test_crc_check_values(void);
+void test_crc_unaligned(void);
+void test_crc32_update_stream(void);
+void test_crc_benchmark(void);
+
+int main(void) {
+  UNITY_BEGIN();
+
+  RUN_TEST(test_spsc_ring_init);
+  RUN_TEST(test_spsc_ring_order);
+  RUN_TEST(test_spsc_ring_wrap);
+  RUN_TEST(test_spsc_ring_overrun);
+  RUN_TEST(test_spsc_ring_threads);
+  RUN_TEST(test_spsc_ring_benchmark);
+  RUN_TEST(test_crc_check_values);
+  RUN_TEST(test_crc_unaligned);
+  RUN_TEST(test_crc32_update_stream);
+  RUN_TEST(test_crc_benchmark);
+
+  return UNITY_END();
+}
@@ -0,0 +1,141 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "unity.h"
+#include "crc.h"
+
+#define TEST_BENCH_BYTES	(16 * 1024 * 1024)	// checksummed per buffer size
+
+static uint8_t s_buf[64 * 1024 + 8];
+
+static uint64_t test_time_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void test_fill(uint8_t *buf, size_t len, uint32_t seed)
+{
+    for (size_t i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = seed >> 16;
+    }
+}
+
+// bit at a time, the definition the tables are checked against
+static uint32_t test_crc_bitwise(uint32_t crc, uint32_t poly, const uint8_t *buf, size_t len)
+{
+    while (len--) {
+        crc ^= *buf++;
+        for (int i = 0; i < 8; i++)
+            crc = (crc & 1) ? (crc >> 1) ^ poly : crc >> 1;
+    }
+    return crc;
+}
+
+// byte at a time with one table, as crc32_le() was before slicing
+static uint32_t s_bytewise_table[256];
+
+static uint32_t test_crc32_bytewise(uint32_t crc, const uint8_t *buf, size_t len)
+{
+    crc = ~crc;
+    while (len--)
+        crc = s_bytewise_table[(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+void test_crc_check_values(void)
+{
+    const uint8_t *check = (const uint8_t *)"123456789";
+
+    // CRC-32/ISO-HDLC and CRC-16/IBM-SDLC (X.25)
+    TEST_ASSERT_EQUAL_HEX32(0xCBF43926, crc32_le(0, check, 9));
+    TEST_ASSERT_EQUAL_HEX16(0x906E, crc16_le(0, check, 9));
+    TEST_ASSERT_EQUAL_HEX32(0, crc32_le(0, check, 0));
+    TEST_ASSERT_EQUAL_HEX32(0xCBF43926, ~crc32_update(UINT32_MAX, check, 9));
+}
+
+void test_crc_unaligned(void)
+{
+    test_fill(s_buf, 200, 1);
+
+    for (size_t offset = 0; offset < 8; offset++) {
+        for (size_t len = 0; len <= 150; len++) {
+            const uint8_t *p = s_buf + offset;
+
+            TEST_ASSERT_EQUAL_HEX32(~test_crc_bitwise(~0x12345678u, 0xEDB88320, p, len),
+                                    crc32_le(0x12345678, p, len));
+            TEST_ASSERT_EQUAL_HEX16((uint16_t)~test_crc_bitwise((uint16_t)~0x1234, 0x8408, p, len),
+                                    crc16_le(0x1234, p, len));
+        }
+    }
+}
+
+void test_crc32_update_stream(void)
+{
+    uint32_t whole, crc = UINT32_MAX;
+    size_t pos = 0;
+
+    test_fill(s_buf, sizeof(s_buf), 2);
+    whole = crc32_le(0, s_buf, sizeof(s_buf));
+
+    srand(3);
+    while (pos < sizeof(s_buf)) {
+        size_t len = rand() % 37;
+
+        if (len > sizeof(s_buf) - pos)
+            len = sizeof(s_buf) - pos;
+        crc = crc32_update(crc, s_buf + pos, len);
+        pos += len;
+    }
+    TEST_ASSERT_EQUAL_HEX32(whole, ~crc);
+
+    // goes on from crc32_le() chains such as the NVS item CRC
+    crc = crc32_le(0xffffffff, s_buf, 1000);
+    TEST_ASSERT_EQUAL_HEX32(crc32_le(crc, s_buf + 1000, 3000),
+                            ~crc32_update(~crc, s_buf + 1000, 3000));
+}
+
+void test_crc_benchmark(void)
+{
+    static const size_t sizes[] = { 32, 256, 2048, 16 * 1024, 64 * 1024 };
+    volatile uint32_t sink = 0;
+
+    for (int i = 0; i < 256; i++) {
+        uint8_t byte = i;
+
+        s_bytewise_table[i] = test_crc_bitwise(0, 0xEDB88320, &byte, 1);
+    }
+    test_fill(s_buf, sizeof(s_buf), 4);
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        size_t len = sizes[i], rounds = TEST_BENCH_BYTES / len;
+        uint64_t t0, sliced_ns, bytewise_ns;
+
+        TEST_ASSERT_EQUAL_HEX32(test_crc32_bytewise(0, s_buf, len), crc32_le(0, s_buf, len));
+
+        t0 = test_time_ns();
+        for (size_t r = 0; r < rounds; r++)
+            sink += crc32_le(r, s_buf, len);
+        sliced_ns = test_time_ns() - t0;
+
+        t0 = test_time_ns();
+        for (size_t r = 0; r < rounds; r++)
+            sink += test_crc32_bytewise(r, s_buf, len);
+        bytewise_ns = test_time_ns() - t0;
+
+        printf("crc32 %6zu B: sliced %6.0f MB/s, bytewise %6.0f MB/s\n", len,
+               rounds * len * 1e3 / sliced_ns, rounds * len * 1e3 / bytewise_ns);
+#ifndef CONFIG_UTIL_CRC_SLICE_BY_1
+        if (len >= 2048) {
+            TEST_ASSERT_TRUE(sliced_ns * 2 < bytewise_ns);
+        }
+#endif
+    }
+    (void)sink;
+}
@@ -0,0 +1,301 @@
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "unity.h"
+#include "esp_spsc_ring.h"
+
+#define TEST_RING_NUM		128
+#define TEST_BURST		16	// frames in a full MAX30100 FIFO
+#define TEST_BATCH		32	// frames the consumer takes at once
+#define TEST_THREAD_FRAMES	1000000
+#define TEST_BENCH_FRAMES	8000000
+
+// a MAX30100 sample, the sequence number is split over both channels
+typedef struct {
+    uint16_t ir;
+    uint16_t red;
+} test_frame_t;
+
+static test_frame_t s_storage[TEST_RING_NUM];
+
+static test_frame_t test_frame(uint32_t seq)
+{
+    test_frame_t frame = { seq & 0xffff, seq >> 16 };
+
+    return frame;
+}
+
+static uint32_t test_seq(const test_frame_t *frame)
+{
+    return frame->ir | (uint32_t)frame->red << 16;
+}
+
+static uint64_t test_time_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void test_spsc_ring_init(void)
+{
+    esp_spsc_ring_t ring;
+
+    TEST_ASSERT_EQUAL(-EINVAL, esp_spsc_ring_init(&ring, s_storage, 100, sizeof(test_frame_t)));
+    TEST_ASSERT_EQUAL(-EINVAL, esp_spsc_ring_init(&ring, s_storage, 0, sizeof(test_frame_t)));
+    TEST_ASSERT_EQUAL(-EINVAL, esp_spsc_ring_init(&ring, s_storage, TEST_RING_NUM, 0));
+    TEST_ASSERT_EQUAL(-EINVAL, esp_spsc_ring_init(&ring, NULL, TEST_RING_NUM, sizeof(test_frame_t)));
+    TEST_ASSERT_EQUAL(0, esp_spsc_ring_init(&ring, s_storage, 1, sizeof(test_frame_t)));
+    TEST_ASSERT_EQUAL(0, esp_spsc_ring_init(&ring, s_storage, TEST_RING_NUM, sizeof(test_frame_t)));
+    TEST_ASSERT_EQUAL(0, esp_spsc_ring_count(&ring));
+    TEST_ASSERT_EQUAL(0, esp_spsc_ring_overruns(&ring));
+}
+
+/*
+ * Frames come out in the order they went in, whatever the batch sizes
+ */
+void test_spsc_ring_order(void)
+{
+    esp_spsc_ring_t ring;
+    test_frame_t in[TEST_BURST], out[TEST_RING_NUM];
+    uint32_t next_in = 0, next_out = 0, n, i;
+    int round;
+
+    esp_spsc_ring_init(&ring, s_storage, TEST_RING_NUM, sizeof(test_frame_t));
+    TEST_ASSERT_EQUAL(0, esp_spsc_ring_pop(&ring, out, TEST_BATCH));
+
+    for (round = 0; round < 1000; round++) {
+        uint32_t burst = 1 + round % TEST_BURST;
+
+        for (i = 0; i < burst; i++)
+            in[i] = test_frame(next_in + i);
+        TEST_ASSERT_EQUAL(burst, esp_spsc_ring_push(&ring, in, burst));
+        next_in += burst;
+
+        n = esp_spsc_ring_pop(&ring, out, 1 + round % 31);
+        for (i = 0; i < n; i++)
+            TEST_ASSERT_EQUAL(next_out++, test_seq(&out[i]));
+    }
+
+    n = esp_spsc_ring_pop(&ring, out, TEST_RING_NUM);
+    for (i = 0; i < n; i++)
+        TEST_ASSERT_EQUAL(next_out++, test_seq(&out[i]));
+    TEST_ASSERT_EQUAL(next_in, next_out);
+    TEST_ASSERT_EQUAL(0, esp_spsc_ring_count(&ring));
+    TEST_ASSERT_EQUAL(0, esp_spsc_ring_overruns(&ring));
+}
+
+/*
+ * Copies split at the end of the storage and the counters wrap around 2^32
+ */
+void test_spsc_ring_wrap(void)
+{
+    esp_spsc_ring_t ring;
+    test_frame_t in[TEST_BURST], out[TEST_BURST];
+    uint32_t i;
+
+    esp_spsc_ring_init(&ring, s_storage, TEST_RING_NUM, sizeof(test_frame_t));
+    ring.head = ring.tail = UINT32_MAX - 5;
+
+    for (i = 0; i < TEST_BURST; i++)
+        in[i] = test_frame(i);
+    TEST_ASSERT_EQUAL(TEST_BURST, esp_spsc_ring_push(&ring, in, TEST_BURST));
+    TEST_ASSERT_EQUAL(TEST_BURST, esp_spsc_ring_count(&ring));
+    TEST_ASSERT_EQUAL(TEST_BURST - 6, ring.head);
+
+    // the first six frames sit at the end of the storage, the rest at the start
+    TEST_ASSERT_EQUAL(0, test_seq(&s_storage[TEST_RING_NUM - 6]));
+    TEST_ASSERT_EQUAL(6, test_seq(&s_storage[0]));
+
+    TEST_ASSERT_EQUAL(TEST_BURST, esp_spsc_ring_pop(&ring, out, TEST_BATCH));
+    TEST_ASSERT_EQUAL_MEMORY(in, out, sizeof(in));
+    TEST_ASSERT_EQUAL(0, esp_spsc_ring_count(&ring));
+}
+
+/*
+ * A full ring keeps the oldest frames and counts the dropped ones
+ */
+void test_spsc_ring_overrun(void)
+{
+    esp_spsc_ring_t ring;
+    test_frame_t in[TEST_BURST], out[TEST_RING_NUM];
+    uint32_t seq = 0, n, i;
+
+    esp_spsc_ring_init(&ring, s_storage, TEST_RING_NUM, sizeof(test_frame_t));
+
+    while (seq < TEST_RING_NUM + 5) {
+        for (i = 0; i < TEST_BURST; i++)
+            in[i] = test_frame(seq + i);
+        esp_spsc_ring_push(&ring, in, TEST_BURST);
+        seq += TEST_BURST;
+    }
+    TEST_ASSERT_EQUAL(TEST_RING_NUM, esp_spsc_ring_count(&ring));
+    TEST_ASSERT_EQUAL(seq - TEST_RING_NUM, esp_spsc_ring_overruns(&ring));
+    TEST_ASSERT_EQUAL(0, esp_spsc_ring_push(&ring, in, 1));
+    TEST_ASSERT_EQUAL(seq - TEST_RING_NUM + 1, esp_spsc_ring_overruns(&ring));
+
+    // room made by the consumer is used again
+    n = esp_spsc_ring_pop(&ring, out, 3);
+    TEST_ASSERT_EQUAL(3, n);
+    TEST_ASSERT_EQUAL(3, esp_spsc_ring_push(&ring, in, TEST_BURST));
+    TEST_ASSERT_EQUAL(seq - TEST_RING_NUM + 1 + TEST_BURST - 3, esp_spsc_ring_overruns(&ring));
+
+    n = esp_spsc_ring_pop(&ring, out, TEST_RING_NUM);
+    TEST_ASSERT_EQUAL(TEST_RING_NUM, n);
+    for (i = 0; i < TEST_RING_NUM - 3; i++)
+        TEST_ASSERT_EQUAL(i + 3, test_seq(&out[i]));
+}
+
+typedef struct {
+    esp_spsc_ring_t ring;
+    pthread_mutex_t lock;
+    int locked;             // take the mutex around every access, for comparison
+    int lossless;           // the producer waits for room instead of dropping
+    uint32_t frames;
+    volatile int done;
+    uint32_t received;
+    uint32_t errors;
+} test_pipe_t;
+
+static uint32_t test_pipe_push(test_pipe_t *pipe, const test_frame_t *in, uint32_t n)
+{
+    uint32_t pushed;
+
+    if (pipe->locked)
+        pthread_mutex_lock(&pipe->lock);
+    pushed = esp_spsc_ring_push(&pipe->ring, in, n);
+    if (pipe->locked)
+        pthread_mutex_unlock(&pipe->lock);
+
+    return pushed;
+}
+
+static uint32_t test_pipe_pop(test_pipe_t *pipe, test_frame_t *out, uint32_t max)
+{
+    uint32_t n;
+
+    if (pipe->locked)
+        pthread_mutex_lock(&pipe->lock);
+    n = esp_spsc_ring_pop(&pipe->ring, out, max);
+    if (pipe->locked)
+        pthread_mutex_unlock(&pipe->lock);
+
+    return n;
+}
+
+// stands in for the task draining the MAX30100 FIFO
+static void *test_producer(void *arg)
+{
+    test_pipe_t *pipe = arg;
+    test_frame_t in[TEST_BURST];
+    uint32_t seq = 0, i;
+
+    while (seq < pipe->frames) {
+        uint32_t burst = pipe->frames - seq < TEST_BURST ? pipe->frames - seq : TEST_BURST;
+        uint32_t pushed = 0;
+
+        for (i = 0; i < burst; i++)
+            in[i] = test_frame(seq + i);
+
+        do {
+            pushed += test_pipe_push(pipe, in + pushed, burst - pushed);
+            if (pushed < burst)
+                sched_yield();
+        } while (pipe->lossless && pushed < burst);
+
+        seq += burst;
+    }
+
+    pipe->done = 1;
+    return NULL;
+}
+
+// stands in for the publisher task
+static void *test_consumer(void *arg)
+{
+    test_pipe_t *pipe = arg;
+    test_frame_t out[TEST_BATCH];
+    uint32_t last = UINT32_MAX, n, i;
+
+    while (1) {
+        int done = pipe->done;
+
+        n = test_pipe_pop(pipe, out, TEST_BATCH);
+        for (i = 0; i < n; i++) {
+            uint32_t seq = test_seq(&out[i]);
+
+            // dropped frames leave gaps, never reorder or repeat
+            if (last != UINT32_MAX && seq <= last)
+                pipe->errors++;
+            if (pipe->lossless && seq != last + 1)
+                pipe->errors++;
+            last = seq;
+        }
+        pipe->received += n;
+
+        if (!n && done)
+            break;
+        if (!n)
+            sched_yield();
+    }
+
+    return NULL;
+}
+
+static uint64_t test_pipe_run(test_pipe_t *pipe, uint32_t frames, int locked, int lossless)
+{
+    pthread_t producer, consumer;
+    uint64_t start;
+
+    memset(pipe, 0, sizeof(*pipe));
+    esp_spsc_ring_init(&pipe->ring, s_storage, TEST_RING_NUM, sizeof(test_frame_t));
+    pthread_mutex_init(&pipe->lock, NULL);
+    pipe->frames = frames;
+    pipe->locked = locked;
+    pipe->lossless = lossless;
+
+    start = test_time_ns();
+    pthread_create(&consumer, NULL, test_consumer, pipe);
+    pthread_create(&producer, NULL, test_producer, pipe);
+    pthread_join(producer, NULL);
+    pthread_join(consumer, NULL);
+
+    pthread_mutex_destroy(&pipe->lock);
+    return test_time_ns() - start;
+}
+
+/*
+ * Every frame is either received in order or counted as an overrun
+ */
+void test_spsc_ring_threads(void)
+{
+    test_pipe_t pipe;
+
+    test_pipe_run(&pipe, TEST_THREAD_FRAMES, 0, 0);
+    TEST_ASSERT_EQUAL(0, pipe.errors);
+    TEST_ASSERT_EQUAL(TEST_THREAD_FRAMES, pipe.received + esp_spsc_ring_overruns(&pipe.ring));
+
+    test_pipe_run(&pipe, TEST_THREAD_FRAMES, 0, 1);
+    TEST_ASSERT_EQUAL(0, pipe.errors);
+    TEST_ASSERT_EQUAL(TEST_THREAD_FRAMES, pipe.received);
+}
+
+void test_spsc_ring_benchmark(void)
+{
+    test_pipe_t pipe;
+    uint64_t free_ns, locked_ns;
+
+    free_ns = test_pipe_run(&pipe, TEST_BENCH_FRAMES, 0, 1);
+    TEST_ASSERT_EQUAL(TEST_BENCH_FRAMES, pipe.received);
+    locked_ns = test_pipe_run(&pipe, TEST_BENCH_FRAMES, 1, 1);
+    TEST_ASSERT_EQUAL(TEST_BENCH_FRAMES, pipe.received);
+
+    printf("spsc ring: lock-free %.1f Mframes/s, mutex %.1f Mframes/s\n",
+           TEST_BENCH_FRAMES * 1e3 / free_ns, TEST_BENCH_FRAMES * 1e3 / locked_ns);
+}
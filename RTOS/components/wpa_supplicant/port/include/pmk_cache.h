@@ -0,0 +1,47 @@
+/*
+ * PMK cache in NVS
+ * Copyright (c) 2018 Espressif Systems (Shanghai) PTE LTD
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Alternatively, this software may be distributed under the terms of BSD
+ * license.
+ *
+ * See README and COPYING for more details.
+ */
+
+#ifndef PMK_CACHE_H
+#define PMK_CACHE_H
+
+#define PMK_CACHE_LEN 32
+
+/**
+ * pmk_cache_get - Look up a key derived by pbkdf2_sha1()
+ * @passphrase: ASCII passphrase
+ * @ssid: SSID
+ * @ssid_len: SSID length in bytes
+ * @iterations: Number of iterations of the derivation
+ * @buf: Buffer for the key
+ * @buflen: Length of the buffer in bytes
+ * Returns: 0 if the key was found, -1 otherwise
+ */
+int pmk_cache_get(const char *passphrase, const char *ssid, size_t ssid_len,
+		  int iterations, u8 *buf, size_t buflen);
+
+/**
+ * pmk_cache_set - Remember a key derived by pbkdf2_sha1()
+ * @passphrase: ASCII passphrase
+ * @ssid: SSID
+ * @ssid_len: SSID length in bytes
+ * @iterations: Number of iterations of the derivation
+ * @buf: The key
+ * @buflen: Length of the key in bytes
+ *
+ * Only one key is kept, the one of the network the station joined last.
+ */
+void pmk_cache_set(const char *passphrase, const char *ssid, size_t ssid_len,
+		   int iterations, const u8 *buf, size_t buflen);
+
+#endif /* PMK_CACHE_H */
@@ -0,0 +1,112 @@
+/*
+ * PMK cache in NVS
+ * Copyright (c) 2018 Espressif Systems (Shanghai) PTE LTD
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Alternatively, this software may be distributed under the terms of BSD
+ * license.
+ *
+ * See README and COPYING for more details.
+ */
+
+#include "crypto/includes.h"
+#include "crypto/common.h"
+#include "crypto/sha1.h"
+#include "crypto/crypto.h"
+
+#if CONFIG_WPA_PMK_CACHE
+
+#include "nvs.h"
+#include "pmk_cache.h"
+
+#define PMK_CACHE_NAMESPACE "wpa_pmk"
+#define PMK_CACHE_KEY "pmk"
+
+/*
+ * The entry is found by a hash of everything the key derives from, the
+ * passphrase itself is not stored
+ */
+struct pmk_cache_entry {
+	u8 id[SHA1_MAC_LEN];
+	u8 pmk[PMK_CACHE_LEN];
+};
+
+static int 
+pmk_cache_id(const char *passphrase, const char *ssid, size_t ssid_len,
+	     int iterations, size_t buflen, u8 *id)
+{
+	u8 params[9];
+	const u8 *addr[3];
+	size_t len[3];
+
+	WPA_PUT_BE32(params, iterations);
+	WPA_PUT_BE32(params + 4, buflen);
+	params[8] = ssid_len;
+
+	addr[0] = params;
+	len[0] = sizeof(params);
+	addr[1] = (const u8 *) ssid;
+	len[1] = ssid_len;
+	addr[2] = (const u8 *) passphrase;
+	len[2] = os_strlen(passphrase);
+
+	return sha1_vector(3, addr, len, id);
+}
+
+int 
+pmk_cache_get(const char *passphrase, const char *ssid, size_t ssid_len,
+	      int iterations, u8 *buf, size_t buflen)
+{
+	struct pmk_cache_entry entry;
+	u8 id[SHA1_MAC_LEN];
+	size_t len = sizeof(entry);
+	nvs_handle handle;
+	esp_err_t err;
+
+	if (buflen > PMK_CACHE_LEN)
+		return -1;
+
+	if (nvs_open(PMK_CACHE_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+		return -1;
+	err = nvs_get_blob(handle, PMK_CACHE_KEY, &entry, &len);
+	nvs_close(handle);
+
+	if (err != ESP_OK || len != sizeof(entry))
+		return -1;
+
+	if (pmk_cache_id(passphrase, ssid, ssid_len, iterations, buflen, id) ||
+	    os_memcmp(id, entry.id, SHA1_MAC_LEN) != 0)
+		return -1;
+
+	os_memcpy(buf, entry.pmk, buflen);
+	return 0;
+}
+
+void 
+pmk_cache_set(const char *passphrase, const char *ssid, size_t ssid_len,
+	      int iterations, const u8 *buf, size_t buflen)
+{
+	struct pmk_cache_entry entry;
+	nvs_handle handle;
+
+	if (buflen > PMK_CACHE_LEN)
+		return;
+
+	os_memset(&entry, 0, sizeof(entry));
+	if (pmk_cache_id(passphrase, ssid, ssid_len, iterations, buflen,
+			 entry.id))
+		return;
+	os_memcpy(entry.pmk, buf, buflen);
+
+	if (nvs_open(PMK_CACHE_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK)
+		return;
+	if (nvs_set_blob(handle, PMK_CACHE_KEY, &entry, sizeof(entry)) ==
+	    ESP_OK)
+		nvs_commit(handle);
+	nvs_close(handle);
+}
+
+#endif /* CONFIG_WPA_PMK_CACHE */
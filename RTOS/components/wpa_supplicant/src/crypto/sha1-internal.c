@@ -127,21 +127,14 @@ A million repetitions of "a"
   34AA973C D4C4DAA4 F61EEB2B DBAD2731 6534016F
 */
 
-/* Disable the option, and reduce memory copying */
-#define SHA1HANDSOFF
-
 #define rol(value, bits) (((value) << (bits)) | ((value) >> (32 - (bits))))
 
-/* blk0() and blk() perform the initial expand. */
+/* blk0() takes the message words as they are, blk() performs the expand in
+ * place over a 16 word window, the input is consumed */
 /* I got the idea of expanding during the round function from SSLeay */
-#ifndef WORDS_BIGENDIAN
-#define blk0(i) (block->l[i] = (rol(block->l[i], 24) & 0xFF00FF00) | \
-	(rol(block->l[i], 8) & 0x00FF00FF))
-#else
-#define blk0(i) block->l[i]
-#endif
-#define blk(i) (block->l[i & 15] = rol(block->l[(i + 13) & 15] ^ \
-	block->l[(i + 8) & 15] ^ block->l[(i + 2) & 15] ^ block->l[i & 15], 1))
+#define blk0(i) block[i]
+#define blk(i) (block[i & 15] = rol(block[(i + 13) & 15] ^ \
+	block[(i + 8) & 15] ^ block[(i + 2) & 15] ^ block[i & 15], 1))
 
 /* (R0+R1), R2, R3, R4 are the different operations used in SHA1 */
 #define R0(v,w,x,y,z,i) \
@@ -174,24 +167,14 @@ void SHAPrintContext(SHA1_CTX *context, char *msg)
 }
 #endif
 
-/* Hash a single 512-bit block. This is the core of the algorithm. */
+/* Hash a single 512-bit block given as 16 host order words, which are
+ * overwritten by the message schedule. This is the core of the algorithm. */
 
 void 
-SHA1Transform(u32 state[5], const unsigned char buffer[64])
+SHA1TransformWords(u32 state[5], u32 block[16])
 {
 	u32 a, b, c, d, e;
-	typedef union {
-		unsigned char c[64];
-		u32 l[16];
-	} CHAR64LONG16;
-	CHAR64LONG16* block;
-#ifdef SHA1HANDSOFF
-	CHAR64LONG16 workspace;
-	block = &workspace;
-	os_memcpy(block, buffer, 64);
-#else
-	block = (CHAR64LONG16 *) buffer;
-#endif
+
 	/* Copy context->state[] to working vars */
 	a = state[0];
 	b = state[1];
@@ -225,13 +208,23 @@ SHA1Transform(u32 state[5], const unsigned char buffer[64])
 	state[2] += c;
 	state[3] += d;
 	state[4] += e;
+}
 
-	/* Wipe variables */
-	/* Disable to reduce memory copying */
-	//a = b = c = d = e = 0;
-#ifdef SHA1HANDSOFF
-	//os_memset(block, 0, 64);
-#endif
+
+/* Hash a single 512-bit block. The words are read big endian straight from
+ * the buffer, which needs no alignment, instead of being copied to a
+ * workspace and swapped there. */
+
+void 
+SHA1Transform(u32 state[5], const unsigned char buffer[64])
+{
+	u32 block[16];
+	int i;
+
+	for (i = 0; i < 16; i++)
+		block[i] = WPA_GET_BE32(buffer + 4 * i);
+
+	SHA1TransformWords(state, block);
 }
 
 
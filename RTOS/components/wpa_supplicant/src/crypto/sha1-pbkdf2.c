@@ -15,15 +15,88 @@
 #include "crypto/includes.h"
 #include "crypto/common.h"
 #include "crypto/sha1.h"
+#include "crypto/sha1_i.h"
 #include "crypto/md5.h"
 #include "crypto/crypto.h"
 
+#if CONFIG_WPA_PMK_CACHE
+#include "pmk_cache.h"
+#endif
+
+/*
+ * The HMAC-SHA1 key only changes the first block of the inner and the outer
+ * hash, both are compressed once for all the iterations
+ */
+static int 
+pbkdf2_sha1_key(const u8 *key, size_t key_len, u32 istate[5], u32 ostate[5])
+{
+	struct SHA1Context ctx;
+	unsigned char k_pad[64];
+	unsigned char tk[SHA1_MAC_LEN];
+	int i;
+
+	if (key_len > 64) {
+		if (sha1_vector(1, &key, &key_len, tk))
+			return -1;
+		key = tk;
+		key_len = SHA1_MAC_LEN;
+	}
+
+	os_memset(k_pad, 0, sizeof(k_pad));
+	os_memcpy(k_pad, key, key_len);
+	for (i = 0; i < 64; i++)
+		k_pad[i] ^= 0x36;
+	SHA1Init(&ctx);
+	SHA1Transform(ctx.state, k_pad);
+	os_memcpy(istate, ctx.state, sizeof(ctx.state));
+
+	for (i = 0; i < 64; i++)
+		k_pad[i] ^= 0x36 ^ 0x5c;
+	SHA1Init(&ctx);
+	SHA1Transform(ctx.state, k_pad);
+	os_memcpy(ostate, ctx.state, sizeof(ctx.state));
+
+	return 0;
+}
+
+/*
+ * HMAC-SHA1 of a previous HMAC-SHA1 output, in host order words. Both the
+ * inner and the outer message fit a single block whose padding is known, so
+ * each costs one compression
+ */
+static void 
+pbkdf2_sha1_prf(const u32 istate[5], const u32 ostate[5], const u32 in[5],
+		u32 out[5])
+{
+	u32 state[5], block[16];
+	int i;
+
+	os_memcpy(state, istate, sizeof(state));
+	for (i = 0; i < 5; i++)
+		block[i] = in[i];
+	block[5] = 0x80000000;
+	for (i = 6; i < 15; i++)
+		block[i] = 0;
+	block[15] = (64 + SHA1_MAC_LEN) * 8;
+	SHA1TransformWords(state, block);
+
+	os_memcpy(out, ostate, sizeof(state));
+	for (i = 0; i < 5; i++)
+		block[i] = state[i];
+	block[5] = 0x80000000;
+	for (i = 6; i < 15; i++)
+		block[i] = 0;
+	block[15] = (64 + SHA1_MAC_LEN) * 8;
+	SHA1TransformWords(out, block);
+}
+
 static int 
 pbkdf2_sha1_f(const char *passphrase, const char *ssid,
 			 size_t ssid_len, int iterations, unsigned int count,
 			 u8 *digest)
 {
-	unsigned char tmp[SHA1_MAC_LEN], tmp2[SHA1_MAC_LEN];
+	unsigned char tmp[SHA1_MAC_LEN];
+	u32 istate[5], ostate[5], u[5], f[5];
 	int i, j;
 	unsigned char count_buf[4];
 	const u8 *addr[2];
@@ -48,17 +121,21 @@ pbkdf2_sha1_f(const char *passphrase, const char *ssid,
 	if (hmac_sha1_vector((u8 *) passphrase, passphrase_len, 2, addr, len,
 			     tmp))
 		return -1;
-	os_memcpy(digest, tmp, SHA1_MAC_LEN);
+	if (pbkdf2_sha1_key((u8 *) passphrase, passphrase_len, istate, ostate))
+		return -1;
+
+	for (j = 0; j < 5; j++)
+		u[j] = f[j] = WPA_GET_BE32(tmp + 4 * j);
 
 	for (i = 1; i < iterations; i++) {
-		if (hmac_sha1((u8 *) passphrase, passphrase_len, tmp,
-			      SHA1_MAC_LEN, tmp2))
-			return -1;
-		os_memcpy(tmp, tmp2, SHA1_MAC_LEN);
-		for (j = 0; j < SHA1_MAC_LEN; j++)
-			digest[j] ^= tmp2[j];
+		pbkdf2_sha1_prf(istate, ostate, u, u);
+		for (j = 0; j < 5; j++)
+			f[j] ^= u[j];
 	}
 
+	for (j = 0; j < 5; j++)
+		WPA_PUT_BE32(digest + 4 * j, f[j]);
+
 	return 0;
 }
 
@@ -86,6 +163,12 @@ pbkdf2_sha1(const char *passphrase, const char *ssid, size_t ssid_len,
 	size_t left = buflen, plen;
 	unsigned char digest[SHA1_MAC_LEN];
 
+#if CONFIG_WPA_PMK_CACHE
+	if (pmk_cache_get(passphrase, ssid, ssid_len, iterations, buf,
+			  buflen) == 0)
+		return 0;
+#endif
+
 	while (left > 0) {
 		count++;
 		if (pbkdf2_sha1_f(passphrase, ssid, ssid_len, iterations,
@@ -97,5 +180,9 @@ pbkdf2_sha1(const char *passphrase, const char *ssid, size_t ssid_len,
 		left -= plen;
 	}
 
+#if CONFIG_WPA_PMK_CACHE
+	pmk_cache_set(passphrase, ssid, ssid_len, iterations, buf, buflen);
+#endif
+
 	return 0;
 }
@@ -0,0 +1,21 @@
+#include "unity.h"
+
+void test_sha1_vectors(void);
+void test_sha1_benchmark(void);
+void test_pbkdf2_sha1_vectors(void);
+void test_pbkdf2_sha1_benchmark(void);
+void test_pmk_cache_reuse(void);
+void test_pmk_cache_no_nvs(void);
+
+int main(void) {
+  UNITY_BEGIN();
+
+  RUN_TEST(test_sha1_vectors);
+  RUN_TEST(test_sha1_benchmark);
+  RUN_TEST(test_pbkdf2_sha1_vectors);
+  RUN_TEST(test_pbkdf2_sha1_benchmark);
+  RUN_TEST(test_pmk_cache_reuse);
+  RUN_TEST(test_pmk_cache_no_nvs);
+
+  return UNITY_END();
+}
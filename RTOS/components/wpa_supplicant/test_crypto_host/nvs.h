@@ -0,0 +1,32 @@
+/*
+ * Host stand-in for NVS, a single namespace of blobs kept in memory
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef int32_t esp_err_t;
+typedef uint32_t nvs_handle;
+
+#define ESP_OK                          0
+#define ESP_FAIL                        -1
+#define ESP_ERR_NVS_NOT_FOUND           0x1102
+#define ESP_ERR_NVS_INVALID_LENGTH      0x110c
+
+typedef enum {
+    NVS_READONLY,
+    NVS_READWRITE
+} nvs_open_mode;
+
+esp_err_t nvs_open(const char *name, nvs_open_mode open_mode, nvs_handle *out_handle);
+esp_err_t nvs_set_blob(nvs_handle handle, const char *key, const void *value, size_t length);
+esp_err_t nvs_get_blob(nvs_handle handle, const char *key, void *out_value, size_t *length);
+esp_err_t nvs_commit(nvs_handle handle);
+void nvs_close(nvs_handle handle);
+
+/* test hooks */
+extern int nvs_host_ready;
+extern int nvs_host_reads;
+extern int nvs_host_writes;
+void nvs_host_erase(void);
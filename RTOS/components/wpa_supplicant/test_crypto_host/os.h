@@ -0,0 +1,20 @@
+/*
+ * Host stand-in for the OS specific functions, only what the crypto code uses
+ */
+#ifndef OS_H
+#define OS_H
+
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sdkconfig.h"
+
+#define os_memcpy(d, s, n) memcpy((d), (s), (n))
+#define os_memset(s, c, n) memset(s, c, n)
+#define os_memcmp(s1, s2, n) memcmp((s1), (s2), (n))
+#define os_strlen(s) strlen(s)
+#define os_malloc(s) malloc((s))
+#define os_free(p) free((p))
+
+#endif /* OS_H */
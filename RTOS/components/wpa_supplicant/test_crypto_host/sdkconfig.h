@@ -0,0 +1,6 @@
+/*
+ * Host stand-in for the build configuration
+ */
+#pragma once
+
+#define CONFIG_WPA_PMK_CACHE 1
@@ -0,0 +1,59 @@
+#include <string.h>
+
+#include "unity.h"
+#include "nvs.h"
+#include "crypto/includes.h"
+#include "crypto/common.h"
+#include "crypto/sha1.h"
+
+/*
+ * The first derivation is stored, the next one for the same network is read
+ * back, another network or passphrase takes the place
+ */
+void test_pmk_cache_reuse(void) {
+    u8 pmk[32], cached[32], other[32];
+
+    nvs_host_erase();
+
+    TEST_ASSERT_EQUAL(0, pbkdf2_sha1("password", "IEEE", 4, 4096, pmk, sizeof(pmk)));
+    TEST_ASSERT_EQUAL(1, nvs_host_writes);
+
+    TEST_ASSERT_EQUAL(0, pbkdf2_sha1("password", "IEEE", 4, 4096, cached, sizeof(cached)));
+    TEST_ASSERT_EQUAL(1, nvs_host_writes);
+    TEST_ASSERT_EQUAL(2, nvs_host_reads);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(pmk, cached, sizeof(pmk));
+
+    // neither the passphrase nor the SSID may hit the entry of another network
+    TEST_ASSERT_EQUAL(0, pbkdf2_sha1("passwore", "IEEE", 4, 4096, other, sizeof(other)));
+    TEST_ASSERT_EQUAL(2, nvs_host_writes);
+    TEST_ASSERT_TRUE(memcmp(pmk, other, sizeof(pmk)) != 0);
+
+    TEST_ASSERT_EQUAL(0, pbkdf2_sha1("password", "IEEE", 4, 4096, cached, sizeof(cached)));
+    TEST_ASSERT_EQUAL(3, nvs_host_writes);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(pmk, cached, sizeof(pmk));
+
+    TEST_ASSERT_EQUAL(0, pbkdf2_sha1("password", "IEEF", 4, 4096, other, sizeof(other)));
+    TEST_ASSERT_EQUAL(4, nvs_host_writes);
+    TEST_ASSERT_TRUE(memcmp(pmk, other, sizeof(pmk)) != 0);
+
+    // nor a shorter key of the same network
+    TEST_ASSERT_EQUAL(0, pbkdf2_sha1("password", "IEEF", 4, 4096, other, 16));
+    TEST_ASSERT_EQUAL(5, nvs_host_writes);
+}
+
+/*
+ * Without NVS the key is derived as before
+ */
+void test_pmk_cache_no_nvs(void) {
+    u8 pmk[32], derived[32];
+
+    nvs_host_erase();
+    TEST_ASSERT_EQUAL(0, pbkdf2_sha1("password", "IEEE", 4, 4096, pmk, sizeof(pmk)));
+
+    nvs_host_ready = 0;
+    TEST_ASSERT_EQUAL(0, pbkdf2_sha1("password", "IEEE", 4, 4096, derived, sizeof(derived)));
+    nvs_host_ready = 1;
+
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(pmk, derived, sizeof(pmk));
+    TEST_ASSERT_EQUAL(1, nvs_host_writes);
+}
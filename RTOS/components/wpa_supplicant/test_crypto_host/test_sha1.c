@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "unity.h"
+#include "nvs.h"
+#include "crypto/includes.h"
+#include "crypto/common.h"
+#include "crypto/sha1.h"
+#include "crypto/crypto.h"
+#include "crypto/sha1_i.h"
+
+static double test_time_ms(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/*
+ * FIPS 180-1 vectors, the long one fed in pieces which leave the blocks
+ * unaligned in the input
+ */
+void test_sha1_vectors(void) {
+    static const u8 abc[] = {
+        0xa9, 0x99, 0x3e, 0x36, 0x47, 0x06, 0x81, 0x6a, 0xba, 0x3e,
+        0x25, 0x71, 0x78, 0x50, 0xc2, 0x6c, 0x9c, 0xd0, 0xd8, 0x9d
+    };
+    static const u8 two_blocks[] = {
+        0x84, 0x98, 0x3e, 0x44, 0x1c, 0x3b, 0xd2, 0x6e, 0xba, 0xae,
+        0x4a, 0xa1, 0xf9, 0x51, 0x29, 0xe5, 0xe5, 0x46, 0x70, 0xf1
+    };
+    static const u8 million_a[] = {
+        0x34, 0xaa, 0x97, 0x3c, 0xd4, 0xc4, 0xda, 0xa4, 0xf6, 0x1e,
+        0xeb, 0x2b, 0xdb, 0xad, 0x27, 0x31, 0x65, 0x34, 0x01, 0x6f
+    };
+    const char *msg = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+    struct SHA1Context ctx;
+    u8 mac[SHA1_MAC_LEN], a[1001];
+    const u8 *addr[1];
+    size_t len[1], done;
+
+    addr[0] = (const u8 *)"abc";
+    len[0] = 3;
+    sha1_vector(1, addr, len, mac);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(abc, mac, SHA1_MAC_LEN);
+
+    addr[0] = (const u8 *)msg;
+    len[0] = strlen(msg);
+    sha1_vector(1, addr, len, mac);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(two_blocks, mac, SHA1_MAC_LEN);
+
+    memset(a, 'a', sizeof(a));
+    SHA1Init(&ctx);
+    for (done = 0; done < 1000000; done += 999)
+        SHA1Update(&ctx, a + 1, done + 999 > 1000000 ? 1000000 - done : 999);
+    SHA1Final(mac, &ctx);
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(million_a, mac, SHA1_MAC_LEN);
+}
+
+/*
+ * RFC 6070 vectors and the IEEE 802.11i passphrase vector, the one with
+ * 16777216 iterations is left out, so is the password holding a NUL which
+ * pbkdf2_sha1 takes as a C string
+ */
+void test_pbkdf2_sha1_vectors(void) {
+    static const struct {
+        const char *p, *s;
+        int c;
+        size_t dk_len;
+        u8 dk[32];
+    } vectors[] = {
+        { "password", "salt", 1, 20,
+          { 0x0c, 0x60, 0xc8, 0x0f, 0x96, 0x1f, 0x0e, 0x71, 0xf3, 0xa9,
+            0xb5, 0x24, 0xaf, 0x60, 0x12, 0x06, 0x2f, 0xe0, 0x37, 0xa6 } },
+        { "password", "salt", 2, 20,
+          { 0xea, 0x6c, 0x01, 0x4d, 0xc7, 0x2d, 0x6f, 0x8c, 0xcd, 0x1e,
+            0xd9, 0x2a, 0xce, 0x1d, 0x41, 0xf0, 0xd8, 0xde, 0x89, 0x57 } },
+        { "password", "salt", 4096, 20,
+          { 0x4b, 0x00, 0x79, 0x01, 0xb7, 0x65, 0x48, 0x9a, 0xbe, 0xad,
+            0x49, 0xd9, 0x26, 0xf7, 0x21, 0xd0, 0x65, 0xa4, 0x29, 0xc1 } },
+        { "passwordPASSWORDpassword", "saltSALTsaltSALTsaltSALTsaltSALTsalt", 4096, 25,
+          { 0x3d, 0x2e, 0xec, 0x4f, 0xe4, 0x1c, 0x84, 0x9b, 0x80, 0xc8,
+            0xd8, 0x36, 0x62, 0xc0, 0xe4, 0x4a, 0x8b, 0x29, 0x1a, 0x96,
+            0x4c, 0xf2, 0xf0, 0x70, 0x38 } },
+        { "password", "IEEE", 4096, 32,
+          { 0xf4, 0x2c, 0x6f, 0xc5, 0x2d, 0xf0, 0xeb, 0xef, 0x9e, 0xbb,
+            0x4b, 0x90, 0xb3, 0x8a, 0x5f, 0x90, 0x2e, 0x83, 0xfe, 0x1b,
+            0x13, 0x5a, 0x70, 0xe2, 0x3a, 0xed, 0x76, 0x2e, 0x97, 0x10,
+            0xa1, 0x2e } },
+    };
+    u8 dk[32];
+    int i;
+
+    // derive every time, the cache has its own test
+    nvs_host_ready = 0;
+
+    for (i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+        memset(dk, 0, sizeof(dk));
+        TEST_ASSERT_EQUAL(0, pbkdf2_sha1(vectors[i].p, vectors[i].s, strlen(vectors[i].s), vectors[i].c,
+                                         dk, vectors[i].dk_len));
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(vectors[i].dk, dk, vectors[i].dk_len);
+    }
+
+    nvs_host_ready = 1;
+}
+
+/*
+ * PBKDF2 the way it is written in IEEE 802.11i, one full HMAC per iteration
+ */
+static void test_pbkdf2_sha1_reference(const char *passphrase, const char *ssid, int iterations, u8 *buf, size_t buflen) {
+    u8 u[SHA1_MAC_LEN], f[SHA1_MAC_LEN], count_buf[4];
+    const u8 *addr[2] = { (const u8 *)ssid, count_buf };
+    size_t len[2] = { strlen(ssid), 4 }, done;
+    unsigned int count;
+    int i, j;
+
+    for (count = 1, done = 0; done < buflen; count++, done += SHA1_MAC_LEN) {
+        WPA_PUT_BE32(count_buf, count);
+        hmac_sha1_vector((const u8 *)passphrase, strlen(passphrase), 2, addr, len, u);
+        memcpy(f, u, SHA1_MAC_LEN);
+        for (i = 1; i < iterations; i++) {
+            hmac_sha1((const u8 *)passphrase, strlen(passphrase), u, SHA1_MAC_LEN, u);
+            for (j = 0; j < SHA1_MAC_LEN; j++)
+                f[j] ^= u[j];
+        }
+        memcpy(buf + done, f, buflen - done < SHA1_MAC_LEN ? buflen - done : SHA1_MAC_LEN);
+    }
+}
+
+/*
+ * A WPA2 PMK derived one HMAC at a time against the precomputed pads
+ */
+void test_pbkdf2_sha1_benchmark(void) {
+    const char *passphrase = "sdis-om2m-passphrase", *ssid = "om2m-gateway";
+    u8 pmk[32], ref[32];
+    double start, reference, derived;
+    const int rounds = 10;
+    int i;
+
+    nvs_host_ready = 0;
+
+    start = test_time_ms();
+    for (i = 0; i < rounds; i++)
+        test_pbkdf2_sha1_reference(passphrase, ssid, 4096, ref, sizeof(ref));
+    reference = (test_time_ms() - start) / rounds;
+
+    start = test_time_ms();
+    for (i = 0; i < rounds; i++)
+        pbkdf2_sha1(passphrase, ssid, strlen(ssid), 4096, pmk, sizeof(pmk));
+    derived = (test_time_ms() - start) / rounds;
+
+    nvs_host_ready = 1;
+
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(ref, pmk, sizeof(pmk));
+    printf("pbkdf2_sha1 4096 iterations: per HMAC %.2f ms, precomputed pads %.2f ms\n", reference, derived);
+}
+
+/*
+ * Throughput of the compression function alone
+ */
+void test_sha1_benchmark(void) {
+    static u8 data[64 * 1024];
+    u8 mac[SHA1_MAC_LEN];
+    const u8 *addr[1] = { data };
+    size_t len[1] = { sizeof(data) };
+    double start, elapsed;
+    const int rounds = 200;
+    int i;
+
+    for (i = 0; i < sizeof(data); i++)
+        data[i] = i * 7;
+
+    start = test_time_ms();
+    for (i = 0; i < rounds; i++)
+        sha1_vector(1, addr, len, mac);
+    elapsed = test_time_ms() - start;
+
+    printf("sha1: %.1f MB/s\n", rounds * sizeof(data) / 1000.0 / elapsed);
+}